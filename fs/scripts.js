@@ -101,6 +101,44 @@ $( document ).ready(function()
 
     }
 
+    var tableStatus = $('div.status table.status');
+    if (tableStatus.length)
+    {
+        // update the status table from the status.json long-poll (with the changed LEDs only)
+        var version = tableStatus.data('version');
+        var colours = { success: 'green', unstable: 'yellow', failure: 'red', unknown: 'unknown' };
+        var updateStatus = function ()
+        {
+            $.ajax(
+            {
+                url: '/status.json?v=' + version, timeout: 40000, type: 'GET',
+                success: function(data, textStatus, jqXHR)
+                {
+                    DEBUG('status', data);
+                    version = data.version;
+                    $('div.status span.state').text(data.state);
+                    data.leds.forEach(function (led) // [ ix, state, result, name, server ]
+                    {
+                        var colour = colours[led[2]] || 'off';
+                        var tr = tableStatus.find('tr[data-ix=' + led[0] + ']');
+                        tr.find('div.led')
+                            .attr('class', 'led led-' + colour + ' led-' + (led[1] === 'running' ? colour : 'nope') + '-ani')
+                            .attr('title', led[1] + ' ' + led[2]);
+                        tr.find('span.name').text(led[3]);
+                        tr.find('span.server').text(led[4]);
+                    });
+                    setTimeout(updateStatus, 100);
+                },
+                error: function(jqXHR, textStatus, errorThrown)
+                {
+                    DEBUG('status: ' + textStatus);
+                    setTimeout(updateStatus, 5000);
+                }
+            });
+        };
+        updateStatus();
+    }
+
     function DEBUG(strOrObj, obj)
     {
         if (window.console && location.href.match(/debug=1/))
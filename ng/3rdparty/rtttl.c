@@ -165,54 +165,44 @@ const char *rtttlBuiltinMelodyRandom(void)
 
 #define OCTAVE_OFFSET 0
 
-void rtttlMelody(const char *melodyStr, int16_t *pFreqDur, const int nFreqDur)
+static const int16_t skRtttlNotes[] =
+{ 0,
+  RTTTL_NOTE_C4, RTTTL_NOTE_CS4, RTTTL_NOTE_D4, RTTTL_NOTE_DS4, RTTTL_NOTE_E4, RTTTL_NOTE_F4, RTTTL_NOTE_FS4, RTTTL_NOTE_G4, RTTTL_NOTE_GS4, RTTTL_NOTE_A4, RTTTL_NOTE_AS4, RTTTL_NOTE_B4,
+  RTTTL_NOTE_C5, RTTTL_NOTE_CS5, RTTTL_NOTE_D5, RTTTL_NOTE_DS5, RTTTL_NOTE_E5, RTTTL_NOTE_F5, RTTTL_NOTE_FS5, RTTTL_NOTE_G5, RTTTL_NOTE_GS5, RTTTL_NOTE_A5, RTTTL_NOTE_AS5, RTTTL_NOTE_B5,
+  RTTTL_NOTE_C6, RTTTL_NOTE_CS6, RTTTL_NOTE_D6, RTTTL_NOTE_DS6, RTTTL_NOTE_E6, RTTTL_NOTE_F6, RTTTL_NOTE_FS6, RTTTL_NOTE_G6, RTTTL_NOTE_GS6, RTTTL_NOTE_A6, RTTTL_NOTE_AS6, RTTTL_NOTE_B6,
+  RTTTL_NOTE_C7, RTTTL_NOTE_CS7, RTTTL_NOTE_D7, RTTTL_NOTE_DS7, RTTTL_NOTE_E7, RTTTL_NOTE_F7, RTTTL_NOTE_FS7, RTTTL_NOTE_G7, RTTTL_NOTE_GS7, RTTTL_NOTE_A7, RTTTL_NOTE_AS7, RTTTL_NOTE_B7
+};
+
+void rtttlIterInit(RTTTL_ITER_t *pIter, const char *melodyStr)
 {
     // from http://domoticx.com/arduino-melodie-afspelen-rtttl/
     // Copyright 2017 DomoticX
 
-    // Absolutely no error checking in here
-
-    const int16_t notes[] =
-    { 0,
-      RTTTL_NOTE_C4, RTTTL_NOTE_CS4, RTTTL_NOTE_D4, RTTTL_NOTE_DS4, RTTTL_NOTE_E4, RTTTL_NOTE_F4, RTTTL_NOTE_FS4, RTTTL_NOTE_G4, RTTTL_NOTE_GS4, RTTTL_NOTE_A4, RTTTL_NOTE_AS4, RTTTL_NOTE_B4,
-      RTTTL_NOTE_C5, RTTTL_NOTE_CS5, RTTTL_NOTE_D5, RTTTL_NOTE_DS5, RTTTL_NOTE_E5, RTTTL_NOTE_F5, RTTTL_NOTE_FS5, RTTTL_NOTE_G5, RTTTL_NOTE_GS5, RTTTL_NOTE_A5, RTTTL_NOTE_AS5, RTTTL_NOTE_B5,
-      RTTTL_NOTE_C6, RTTTL_NOTE_CS6, RTTTL_NOTE_D6, RTTTL_NOTE_DS6, RTTTL_NOTE_E6, RTTTL_NOTE_F6, RTTTL_NOTE_FS6, RTTTL_NOTE_G6, RTTTL_NOTE_GS6, RTTTL_NOTE_A6, RTTTL_NOTE_AS6, RTTTL_NOTE_B6,
-      RTTTL_NOTE_C7, RTTTL_NOTE_CS7, RTTTL_NOTE_D7, RTTTL_NOTE_DS7, RTTTL_NOTE_E7, RTTTL_NOTE_F7, RTTTL_NOTE_FS7, RTTTL_NOTE_G7, RTTTL_NOTE_GS7, RTTTL_NOTE_A7, RTTTL_NOTE_AS7, RTTTL_NOTE_B7
-    };
-
-    //int16_t melody[2 * RTTTL_MELODY_N + 1];
-    int16_t melodyIx = 0;
+    // Absolutely no error checking in here (except for not running past the end of the string)
 
     uint8_t default_dur = 4;
     uint8_t default_oct = 6;
     int16_t bpm = 63;
     int16_t num;
-    int32_t wholenote;
-    int32_t duration;
-    uint8_t note;
-    uint8_t scale;
-    const int melodyStrLen = strlen(melodyStr);
-    char melodyCopy[melodyStrLen + 1];
-    strcpy(melodyCopy, melodyStr);
-    const char *p = melodyCopy;
+    const char *p = melodyStr;
 
     // format: d=N,o=N,b=NNN:
     // find the start (skip name, etc)
 
-    while(*p != ':') p++;    // ignore name
-    p++;                     // skip ':'
+    while(*p && (*p != ':')) p++;    // ignore name
+    if(*p) p++;                      // skip ':'
 
     // get default duration
     if(*p == 'd')
     {
-        p++; p++;              // skip "d="
+        p++; if(*p) p++;       // skip "d="
         num = 0;
         while(isdigit((int)(*p)))
         {
             num = (num * 10) + (*p++ - '0');
         }
         if(num > 0) default_dur = num;
-        p++;                   // skip comma
+        if(*p) p++;            // skip comma
     }
 
     //Serial.print("ddur: "); Serial.println(default_dur, 10);
@@ -220,10 +210,11 @@ void rtttlMelody(const char *melodyStr, int16_t *pFreqDur, const int nFreqDur)
     // get default octave
     if(*p == 'o')
     {
-        p++; p++;              // skip "o="
-        num = *p++ - '0';
+        p++; if(*p) p++;       // skip "o="
+        num = *p - '0';
+        if(*p) p++;
         if(num >= 3 && num <=7) default_oct = num;
-        p++;                   // skip comma
+        if(*p) p++;            // skip comma
     }
 
     //Serial.print("doct: "); Serial.println(default_oct, 10);
@@ -231,137 +222,137 @@ void rtttlMelody(const char *melodyStr, int16_t *pFreqDur, const int nFreqDur)
     // get BPM
     if(*p == 'b')
     {
-        p++; p++;              // skip "b="
+        p++; if(*p) p++;       // skip "b="
         num = 0;
         while(isdigit((int)(*p)))
         {
             num = (num * 10) + (*p++ - '0');
         }
-        bpm = num;
-        p++;                   // skip colon
+        if(num > 0) bpm = num;
+        if(*p) p++;            // skip colon
     }
 
     //Serial.print("bpm: "); Serial.println(bpm, 10);
 
     // BPM usually expresses the number of quarter notes per minute
-    wholenote = (60 * 1000L / bpm) * 4;  // this is the time for whole note (in milliseconds)
+    pIter->wholenote = (60 * 1000L / bpm) * 4;  // this is the time for whole note (in milliseconds)
+    pIter->defDur = default_dur;
+    pIter->defOct = default_oct;
+    pIter->p = p;
 
     //Serial.print("wn: "); Serial.println(wholenote, 10);
+}
 
-
-    // now begin note loop
-    while(*p)
+bool rtttlIterNext(RTTTL_ITER_t *pIter, int16_t *pFreq, int16_t *pDur)
+{
+    const char *p = pIter->p;
+    if (!*p)
     {
-        // first, get note duration, if available
-        num = 0;
-        while(isdigit((int)(*p)))
-        {
-            num = (num * 10) + (*p++ - '0');
-        }
+        return false;
+    }
 
-        if(num) duration = wholenote / num;
-        else duration = wholenote / default_dur;  // we will need to check if we are a dotted note after
+    int16_t num;
+    int32_t duration;
+    uint8_t note;
+    uint8_t scale;
 
-        // now get the note
-        note = 0;
+    // first, get note duration, if available
+    num = 0;
+    while(isdigit((int)(*p)))
+    {
+        num = (num * 10) + (*p++ - '0');
+    }
 
-        switch(*p)
-        {
-            case 'c':
-                note = 1;
-                break;
-            case 'd':
-                note = 3;
-                break;
-            case 'e':
-                note = 5;
-                break;
-            case 'f':
-                note = 6;
-                break;
-            case 'g':
-                note = 8;
-                break;
-            case 'a':
-                note = 10;
-                break;
-            case 'b':
-                note = 12;
-                break;
-            case 'p':
-            default:
-                note = 0;
-        }
-        p++;
+    if(num) duration = pIter->wholenote / num;
+    else duration = pIter->wholenote / pIter->defDur;  // we will need to check if we are a dotted note after
 
-        // now, get optional '#' sharp
-        if(*p == '#')
-        {
-            note++;
-            p++;
-        }
+    // now get the note
+    note = 0;
 
-        // now, get optional '.' dotted note
-        if(*p == '.')
-        {
-            duration += duration/2;
-            p++;
-        }
+    switch(*p)
+    {
+        case 'c':
+            note = 1;
+            break;
+        case 'd':
+            note = 3;
+            break;
+        case 'e':
+            note = 5;
+            break;
+        case 'f':
+            note = 6;
+            break;
+        case 'g':
+            note = 8;
+            break;
+        case 'a':
+            note = 10;
+            break;
+        case 'b':
+            note = 12;
+            break;
+        case 'p':
+        default:
+            note = 0;
+    }
+    if(*p) p++;
 
-        // now, get scale
-        if(isdigit((int)(*p)))
-        {
-            scale = *p - '0';
-            p++;
-        }
-        else
-        {
-            scale = default_oct;
-        }
+    // now, get optional '#' sharp
+    if(*p == '#')
+    {
+        note++;
+        p++;
+    }
 
-        scale += OCTAVE_OFFSET;
+    // now, get optional '.' dotted note
+    if(*p == '.')
+    {
+        duration += duration/2;
+        p++;
+    }
 
-        if(*p == ',')
-            p++;       // skip comma for next note (or we may be at the end)
+    // now, get scale
+    if(isdigit((int)(*p)))
+    {
+        scale = *p - '0';
+        p++;
+    }
+    else
+    {
+        scale = pIter->defOct;
+    }
 
-        // now play the note
-        const int16_t dur = duration;
-        if (note)
-        {
-            const int16_t freq = notes[(scale - 4) * 12 + note];
-            pFreqDur[melodyIx] = freq;
-            melodyIx++;
-            //DEBUG("note: RTTTL %4d %4d", freq, dur);
-
-            //Serial.print("Playing: ");
-            //Serial.print(scale, 10); Serial.print(' ');
-            //Serial.print(note, 10); Serial.print(" (");
-            //Serial.print(notes[(scale - 4) * 12 + note], 10);
-            //Serial.print(") ");
-            //Serial.println(duration, 10);
-            //tone1.play(notes[(scale - 4) * 12 + note]);
-            //delay(duration);
-            //tone1.stop();
-        }
-        else
-        {
-            pFreqDur[melodyIx] = RTTTL_NOTE_PAUSE;
-            melodyIx++;
-            //DEBUG("note: RTTTL ---- %4d", dur);
+    scale += OCTAVE_OFFSET;
 
-            //Serial.print("Pausing: ");
-            //Serial.println(duration, 10);
-            //delay(duration);
-        }
-        pFreqDur[melodyIx] = dur;
-        melodyIx++;
+    if(*p == ',')
+        p++;       // skip comma for next note (or we may be at the end)
 
-        if (melodyIx > (nFreqDur - 3))
-        {
-            break;
-        }
+    pIter->p = p;
+
+    // now play the note
+    *pDur = duration;
+    if (note && (scale >= 4) && (scale <= 7))
+    {
+        *pFreq = skRtttlNotes[(scale - 4) * 12 + note];
+        //DEBUG("note: RTTTL %4d %4d", *pFreq, *pDur);
     }
+    else
+    {
+        *pFreq = RTTTL_NOTE_PAUSE;
+        //DEBUG("note: RTTTL ---- %4d", *pDur);
+    }
+    return true;
+}
 
+void rtttlMelody(const char *melodyStr, int16_t *pFreqDur, const int nFreqDur)
+{
+    RTTTL_ITER_t iter;
+    rtttlIterInit(&iter, melodyStr);
+    int melodyIx = 0;
+    while ( (melodyIx <= (nFreqDur - 3)) && rtttlIterNext(&iter, &pFreqDur[melodyIx], &pFreqDur[melodyIx + 1]) )
+    {
+        melodyIx += 2;
+    }
     pFreqDur[melodyIx] = RTTTL_NOTE_END;
 }
-
@@ -4,12 +4,28 @@
 #define __RTTTL_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 
 // takes a https://en.wikipedia.org/wiki/Ring_Tone_Transfer_Language melody,
 // (s.a. http://merwin.bespin.org/t4a/specs/nokia_rtttl.txt)
 // and fills in a list of frequency and duration pairs
 void rtttlMelody(const char *melodyStr, int16_t *pFreqDur, const int nFreqDur);
 
+// iterates the notes of a melody (without copying or parsing it all at once)
+typedef struct RTTTL_ITER_s
+{
+    const char *p;          // next note
+    int32_t     wholenote;  // duration of a whole note [ms]
+    uint8_t     defDur;     // default duration
+    uint8_t     defOct;     // default octave
+} RTTTL_ITER_t;
+
+// start iterating a melody (the string must remain valid while iterating)
+void rtttlIterInit(RTTTL_ITER_t *pIter, const char *melodyStr);
+
+// get the next note (frequency or RTTTL_NOTE_PAUSE, and duration [ms]), returns false at the end
+bool rtttlIterNext(RTTTL_ITER_t *pIter, int16_t *pFreq, int16_t *pDur);
+
 const char *rtttlBuiltinMelody(const char *name);
 
 const char *rtttlBuiltinMelodyRandom(void);
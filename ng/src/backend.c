@@ -4,8 +4,6 @@
 
     - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
       https://oinkzwurgl.org/projaeggd/tschenggins-laempli
-
-    \todo SSL connection using mbedtls, see examples/http_get_bearssl
 */
 
 #include "stdinc.h"
@@ -18,10 +16,11 @@
 #include "wifi.h"
 #include "jenkins.h"
 #include "status.h"
-#include "tone.h"
 #include "config.h"
-#include "json.h"
+#include "base64.h"
 #include "backend.h"
+#include "trace.h"
+#include "ota.h"
 
 
 #define BACKEND_HEARTBEAT_INTERVAL 5000
@@ -31,47 +30,77 @@ static uint32_t sLastHello;
 static uint32_t sLastHeartbeat;
 static uint32_t sBytesReceived;
 static uint32_t sConnCount;
+static uint32_t sLinesReceived;
+static uint32_t sLinesDropped;
+static uint32_t sBytesTotal;
+static uint32_t sLinesTotal;
+static uint32_t sResumeCount;
+static int      sRetryHint;
+
+// the backend session we can resume (see sBackendHandleSession()), "" for none
+static char     sBackendSessionId[12];
+static uint32_t sBackendSessionSeq;
+static bool     sBackendSessionSeen; // on the current connection
+
+// fires when we didn't resume the session in time after a disconnect
+static TimerHandle_t sBackendResumeTimer;
+
+// maximum length of a line from the backend (status line with all channels, plus some margin)
+#define BACKEND_LINEBUF_SIZE ( (JENKINS_MAX_CH * 128) + 256 )
+
+// the (partial) line we're currently assembling
+static char sBackendLineBuf[BACKEND_LINEBUF_SIZE];
+static int  sBackendLineLen;
+static bool sBackendLineDiscard;
+
+static void sBackendLineReset(void)
+{
+    sBackendLineLen = 0;
+    sBackendLineDiscard = false;
+}
+
+// forward declarations
+static BACKEND_STATUS_t sBackendDispatchLine(char *line, const int len);
+static void sBackendProcessStatus(char *resp, const int respLen);
+static void sBackendProcessBinStatus(const char *b64);
+static void sBackendResumeTimerFunc(TimerHandle_t timer);
 
-bool backendConnect(char *resp, const int len)
+
+void backendConnect(void)
 {
     DEBUG("backend: connect");
     // update statistics
     sLastHello = 0;
     sLastHeartbeat = 0;
     sBytesReceived = 0;
+    sLinesReceived = 0;
+    sLinesDropped = 0;
     sConnCount++;
+    sBackendSessionSeen = false;
 
-    // look for "hello"
-    char *pHello = strstr(resp, "\r\nhello ");
-    if (pHello == NULL)
-    {
-        ERROR("backend: no 'hello' :-(");
-        return false;
-    }
-    pHello += 2;
-    char *endOfHello = strstr(pHello, "\r\n");
-    if (endOfHello != NULL)
-    {
-        *endOfHello = '\0';
-    }
-    const uint32_t now = osTime();
-    sLastHello = now;
-    sLastHeartbeat = now;
-
-    // handle remaining data
-    char *pParse = endOfHello + 2;
-    const int len2 = len - (pParse - resp);
-    sBytesReceived += len - len2;
-    backendHandle(pParse, len2);
+    // start with a fresh line buffer
+    sBackendLineReset();
+}
 
-    return true;
+bool backendIsConnected(void)
+{
+    return sLastHello != 0;
 }
 
 void backendDisconnect(void)
 {
     DEBUG("backend: disconnect");
     const uint32_t now = osTime();
-    if ( (now - sLastHello) > (1000 * BACKEND_STABLE_CONN_THRS) )
+    // keep the channels for now, we'll hopefully resume the session soon
+    bool haveSession;
+    CS_ENTER;
+    haveSession = sBackendSessionId[0] != '\0';
+    CS_LEAVE;
+    if (haveSession)
+    {
+        xTimerReset(sBackendResumeTimer, 0);
+    }
+    else if ( (now - sLastHello) > (1000 * BACKEND_STABLE_CONN_THRS) )
     {
         jenkinsUnknownAll();
     }
@@ -82,15 +111,59 @@ void backendDisconnect(void)
     sLastHeartbeat = 0;
     sLastHello = 0;
     sBytesReceived = 0;
+    sBackendLineReset();
 }
 
 void backendMonStatus(void)
 {
     const uint32_t now = osTime();
-    DEBUG("mon: backend: count=%u uptime=%u (%s) heartbeat=%u bytes=%u",
+    DEBUG("mon: backend: count=%u uptime=%u (%s) heartbeat=%u bytes=%u lines=%u drop=%u session=%s:%u resume=%u",
         sConnCount, sLastHello ? now - sLastHello : 0,
         sLastHello ? ((now - sLastHello) > (1000 * BACKEND_STABLE_CONN_THRS) ? "stable" : "unstable" ) : "n/a",
-        sLastHeartbeat ? now - sLastHeartbeat : 0, sBytesReceived);
+        sLastHeartbeat ? now - sLastHeartbeat : 0, sBytesReceived, sLinesReceived, sLinesDropped,
+        sBackendSessionId[0] ? sBackendSessionId : "none", sBackendSessionSeq, sResumeCount);
+}
+
+void backendGetCounters(uint32_t *pBytes, uint32_t *pLines, uint32_t *pConnCount)
+{
+    *pBytes = sBytesTotal;
+    *pLines = sLinesTotal;
+    *pConnCount = sConnCount;
+}
+
+const char *backendSession(void)
+{
+    static char str[sizeof(sBackendSessionId) + 12];
+    bool haveSession;
+    CS_ENTER;
+    haveSession = sBackendSessionId[0] != '\0';
+    if (haveSession)
+    {
+        snprintf(str, sizeof(str), "%s:%u", sBackendSessionId, sBackendSessionSeq);
+    }
+    CS_LEAVE;
+    return haveSession ? str : NULL;
+}
+
+// too late to resume, show the channels as stale, and start a new session on the next connection
+static void sBackendResumeTimerFunc(TimerHandle_t timer)
+{
+    UNUSED(timer);
+    WARNING("backend: session expired");
+    CS_ENTER;
+    sBackendSessionId[0] = '\0';
+    sBackendSessionSeq = 0;
+    CS_LEAVE;
+    jenkinsUnknownAll();
+}
+
+void backendRelayed(void)
+{
+    xTimerStop(sBackendResumeTimer, 0);
+    CS_ENTER;
+    sBackendSessionId[0] = '\0';
+    sBackendSessionSeq = 0;
+    CS_LEAVE;
 }
 
 bool backendIsOkay(void)
@@ -109,10 +182,104 @@ bool backendIsOkay(void)
     }
 }
 
+int32_t backendHeartbeatRemaining(void)
+{
+    const uint32_t now = osTime();
+    return (int32_t)BACKEND_HEARTBEAT_TIMEOUT - (int32_t)(now - sLastHeartbeat);
+}
 
-// forward declarations
-void sBackendProcessStatus(char *resp, const int respLen);
+// process data from backend, dispatches all complete lines and keeps any incomplete line for later
+BACKEND_STATUS_t backendHandle(char *resp, const int len)
+{
+    BACKEND_STATUS_t res = BACKEND_STATUS_OKAY;
+    sBytesReceived += len;
+    sBytesTotal += len;
+
+    //DEBUG("backendHandle() [%d]", len);
+
+    char *pData = resp;
+    int remaining = len;
+    while ( (remaining > 0) && (res == BACKEND_STATUS_OKAY) )
+    {
+        char *pEol = memchr(pData, '\n', remaining);
+
+        // no end of line (yet) --> keep partial line for later
+        if (pEol == NULL)
+        {
+            if (!sBackendLineDiscard)
+            {
+                if ( (sBackendLineLen + remaining) < (int)sizeof(sBackendLineBuf) )
+                {
+                    memcpy(&sBackendLineBuf[sBackendLineLen], pData, remaining);
+                    sBackendLineLen += remaining;
+                }
+                else
+                {
+                    WARNING("backend: line too long");
+                    sBackendLineDiscard = true;
+                    sBackendLineLen = 0;
+                }
+            }
+            break;
+        }
+
+        // we have the end of a line
+        const int segLen = pEol - pData;
+        char *pLine = NULL;
+        int lineLen = 0;
+
+        // line was too long, drop it
+        if (sBackendLineDiscard)
+        {
+            sBackendLineDiscard = false;
+            sLinesDropped++;
+        }
+        // complete previously received partial line
+        else if (sBackendLineLen > 0)
+        {
+            if ( (sBackendLineLen + segLen) < (int)sizeof(sBackendLineBuf) )
+            {
+                memcpy(&sBackendLineBuf[sBackendLineLen], pData, segLen);
+                pLine = sBackendLineBuf;
+                lineLen = sBackendLineLen + segLen;
+            }
+            else
+            {
+                WARNING("backend: line too long");
+                sLinesDropped++;
+            }
+            sBackendLineLen = 0;
+        }
+        // complete line in the data, use it in place
+        else
+        {
+            pLine = pData;
+            lineLen = segLen;
+        }
 
+        // strip "\r" and nul-terminate (overwrites the "\r" or "\n")
+        if (pLine != NULL)
+        {
+            if ( (lineLen > 0) && (pLine[lineLen - 1] == '\r') )
+            {
+                lineLen--;
+            }
+            pLine[lineLen] = '\0';
+            if (lineLen > 0)
+            {
+                res = sBackendDispatchLine(pLine, lineLen);
+            }
+        }
+
+        pData = pEol + 1;
+        remaining -= segLen + 1;
+    }
+
+    return res;
+}
+
+
+/* ***** line handlers ************************************************************************** */
 
 static void sBackendHandleSetTime(const char *timestamp)
 {
@@ -124,274 +291,444 @@ static void sBackendHandleSetTime(const char *timestamp)
     }
 }
 
+// skip to the next space-separated argument (returns pointer to the end of string if there are no more)
+static char *sBackendNextArg(char *str)
+{
+    char *pSpace = strchr(str, ' ');
+    return pSpace != NULL ? pSpace + 1 : &str[strlen(str)];
+}
 
-// process response from backend
-BACKEND_STATUS_t backendHandle(char *resp, const int len)
+// "hello 9f8e7d 256 name"
+static BACKEND_STATUS_t sBackendHandleHello(char *args)
 {
-    BACKEND_STATUS_t res = BACKEND_STATUS_OKAY;
-    sBytesReceived += len;
+    DEBUG("backend: hello %s", args);
+    const uint32_t now = osTime();
+    sLastHello = now;
+    sLastHeartbeat = now;
+    xTimerStop(sBackendResumeTimer, 0);
+    return BACKEND_STATUS_OKAY;
+}
+
+// "session 1491146576 9f8e7d6c 42" (after a batch of updates, which we have all applied by now)
+static BACKEND_STATUS_t sBackendHandleSession(char *args)
+{
+    sBackendHandleSetTime(args);
+    char *pId = sBackendNextArg(args);
+    char *pSeq = sBackendNextArg(pId);
+    const int idLen = pSeq - pId - 1;
+    if ( (idLen < 1) || (idLen >= (int)sizeof(sBackendSessionId)) || (*pSeq == '\0') )
+    {
+        WARNING("backend: session %s ???", pId);
+        return BACKEND_STATUS_OKAY;
+    }
+    const uint32_t seq = (uint32_t)atoi(pSeq);
+    CS_ENTER;
+    if ( (strncmp(sBackendSessionId, pId, idLen) == 0) && (sBackendSessionId[idLen] == '\0') )
+    {
+        // first session line on this connection --> we have resumed
+        if (!sBackendSessionSeen)
+        {
+            sResumeCount++;
+        }
+    }
+    else
+    {
+        memcpy(sBackendSessionId, pId, idLen);
+        sBackendSessionId[idLen] = '\0';
+    }
+    sBackendSessionSeq = seq;
+    sBackendSessionSeen = true;
+    CS_LEAVE;
+    //DEBUG("backend: session %s %u", sBackendSessionId, seq);
+    return BACKEND_STATUS_OKAY;
+}
 
-    //DEBUG("backendHandle() [%d] %s", len, resp);
+// "error 1491146601 WTF?"
+static BACKEND_STATUS_t sBackendHandleError(char *args)
+{
+    sBackendHandleSetTime(args);
+    ERROR("backend: error: %s", sBackendNextArg(args));
+    return BACKEND_STATUS_OKAY;
+}
 
-    char *pConfig    = strstr(resp, "\r\n""config ");
-    char *pStatus    = strstr(resp, "\r\n""status ");
-    char *pHeartbeat = strstr(resp, "\r\n""heartbeat ");
-    char *pError     = strstr(resp, "\r\n""error ");
-    char *pReconnect = strstr(resp, "\r\n""reconnect ");
-    char *pCommand   = strstr(resp, "\r\n""command ");
+// "reconnect 1491146601" or "reconnect 1491146601 25" (with retry hint [s])
+static BACKEND_STATUS_t sBackendHandleReconnect(char *args)
+{
+    sBackendHandleSetTime(args);
+    const int hint = atoi(sBackendNextArg(args));
+    sRetryHint = hint < 0 ? 0 : (hint > BACKEND_RECONNECT_INTERVAL_SLOW ? BACKEND_RECONNECT_INTERVAL_SLOW : hint);
+    WARNING("backend: reconnect (in %ds)", sRetryHint);
+    return BACKEND_STATUS_RECONNECT;
+}
 
-    // "\r\nerror 1491146601 WTF?\r\n"
-    if (pError != NULL)
+int backendRetryHint(void)
+{
+    const int hint = sRetryHint;
+    sRetryHint = 0;
+    return hint;
+}
+
+// "heartbeat 1491146601 25" or "heartbeat 1491146601 25 -123" (with the sub-second part [ms] of the time)
+static BACKEND_STATUS_t sBackendHandleHeartbeat(char *args)
+{
+    sBackendHandleSetTime(args);
+    const char *pkMs = sBackendNextArg(sBackendNextArg(args));
+    if (*pkMs != '\0')
     {
-        pError += 2;
-        char *endOfLine = strstr(pError, "\r\n");
-        if (endOfLine != NULL)
+        const int ms = atoi(pkMs);
+        const uint32_t ts = (uint32_t)atoi(args);
+        if ( (ts != 0) && (ms >= -500) && (ms < 500) )
         {
-            *endOfLine = '\0';
-            sBackendHandleSetTime(&pError[6]);
-            const char *pMsg = &pError[6 + 10 + 1];
-            ERROR("backend: error: %s", pMsg);
+            osSyncTime(ts, ms);
         }
     }
+    DEBUG("backend: heartbeat %s", sBackendNextArg(args));
+    return BACKEND_STATUS_OKAY;
+}
+
+// "config 1491146576 {"key":"value", ... }"
+static BACKEND_STATUS_t sBackendHandleConfig(char *args)
+{
+    sBackendHandleSetTime(args);
+    char *pJson = sBackendNextArg(args);
+    const int jsonLen = strlen(pJson);
+    DEBUG("backend: config");
+    if (configParseJson(pJson, jsonLen))
+    {
+        statusNoise(STATUS_NOISE_OTHER);
+    }
+    else
+    {
+        statusNoise(STATUS_NOISE_ERROR);
+    }
+    return BACKEND_STATUS_OKAY;
+}
+
+// "status 1491146576 [[ ... ], ... ]"
+static BACKEND_STATUS_t sBackendHandleStatus(char *args)
+{
+    sBackendHandleSetTime(args);
+    DEBUG("backend: status");
+    char *pJson = sBackendNextArg(args);
+    const int jsonLen = strlen(pJson);
+    sBackendProcessStatus(pJson, jsonLen);
+    return BACKEND_STATUS_OKAY;
+}
 
-    // "\r\nreconnect 1491146601\r\n"
-    if (pReconnect != NULL)
+// "bstatus 1491146576 AARavJRsAaNavJRs"
+static BACKEND_STATUS_t sBackendHandleBinStatus(char *args)
+{
+    sBackendHandleSetTime(args);
+    DEBUG("backend: bstatus");
+    sBackendProcessBinStatus(sBackendNextArg(args));
+    return BACKEND_STATUS_OKAY;
+}
+
+// "command 1491146601 reset"
+static BACKEND_STATUS_t sBackendHandleCommand(char *args)
+{
+    BACKEND_STATUS_t res = BACKEND_STATUS_OKAY;
+    sBackendHandleSetTime(args);
+    const char *pCmd = sBackendNextArg(args);
+    if (strcmp("reconnect", pCmd) == 0)
+    {
+        PRINT("backend: command reconnect");
+        statusNoise(STATUS_NOISE_OTHER);
+        res = BACKEND_STATUS_RECONNECT;
+    }
+    else if (strcmp("reset", pCmd) == 0)
     {
-        pReconnect += 2;
-        char *endOfLine = strstr(pReconnect, "\r\n");
-        if (endOfLine != NULL)
+        WARNING("backend: command restart");
+        statusNoise(STATUS_NOISE_OTHER);
+        osSleep(250);
+        sdk_system_restart();
+    }
+    else if (strcmp("identify", pCmd) == 0)
+    {
+        PRINT("backend: command identify");
+        statusCommandMelody("PacMan");
+    }
+    else if (strcmp("trace", pCmd) == 0)
+    {
+        PRINT("backend: command trace");
+        traceDump();
+    }
+    else if (strcmp("dump", pCmd) == 0)
+    {
+        PRINT("backend: command dump");
+        jenkinsDump();
+    }
+    else if (strcmp("random", pCmd) == 0)
+    {
+        PRINT("backend: command random");
+        statusCommandMelody(NULL);
+    }
+    // "melody <name>" (builtin melody) or "melody <name>:d=4,o=5,b=100:..." (RTTTL)
+    else if (strncmp("melody ", pCmd, 7) == 0)
+    {
+        const char *pMelody = sBackendNextArg((char *)pCmd);
+        PRINT("backend: command melody %.20s", pMelody);
+        statusCommandMelody(pMelody);
+    }
+    // "update <image> <size> <sha256> <signature>" (firmware update, see ota.h)
+    else if (strncmp("update ", pCmd, 7) == 0)
+    {
+        const char *pImage = sBackendNextArg((char *)pCmd);
+        const char *pSize  = sBackendNextArg((char *)pImage);
+        char       *pHash  = sBackendNextArg((char *)pSize);
+        char       *pSig   = sBackendNextArg(pHash);
+        if (*pSig != '\0')
         {
-            *endOfLine = '\0';
-            sBackendHandleSetTime(&pReconnect[10]);
-            WARNING("backend: reconnect");
+            pSig[-1] = '\0'; // terminate hash
+        }
+        PRINT("backend: command update %.20s", pImage);
+        if (otaRequest(pImage, pSize - pImage - 1, (uint32_t)atoi(pSize), pHash, pSig))
+        {
+            statusNoise(STATUS_NOISE_OTHER);
             res = BACKEND_STATUS_RECONNECT;
         }
+        else
+        {
+            statusNoise(STATUS_NOISE_ERROR);
+        }
+    }
+    else
+    {
+        WARNING("backend: command %s ???", pCmd);
+        statusNoise(STATUS_NOISE_ERROR);
     }
+    return res;
+}
+
+typedef BACKEND_STATUS_t (*BACKEND_LINE_HANDLER_t)(char *args);
+
+typedef struct BACKEND_LINE_TYPE_s
+{
+    const char            *type;
+    int                    typeLen;
+    BACKEND_LINE_HANDLER_t handler;
+} BACKEND_LINE_TYPE_t;
+
+#define BACKEND_LINE_TYPE(_type, _handler) { .type = _type, .typeLen = sizeof(_type) - 1, .handler = _handler }
+
+// line handlers, keyed on the first word of the line
+static const BACKEND_LINE_TYPE_t skBackendLineTypes[] =
+{
+    BACKEND_LINE_TYPE("heartbeat", sBackendHandleHeartbeat),
+    BACKEND_LINE_TYPE("bstatus",   sBackendHandleBinStatus),
+    BACKEND_LINE_TYPE("status",    sBackendHandleStatus),
+    BACKEND_LINE_TYPE("config",    sBackendHandleConfig),
+    BACKEND_LINE_TYPE("command",   sBackendHandleCommand),
+    BACKEND_LINE_TYPE("hello",     sBackendHandleHello),
+    BACKEND_LINE_TYPE("session",   sBackendHandleSession),
+    BACKEND_LINE_TYPE("error",     sBackendHandleError),
+    BACKEND_LINE_TYPE("reconnect", sBackendHandleReconnect),
+};
+
+// handle one complete (nul-terminated, no "\r\n") line
+static BACKEND_STATUS_t sBackendDispatchLine(char *line, const int len)
+{
+    TRACE(TRACE_EV_BACKEND_LINE, len);
+    sLinesReceived++;
+    sLinesTotal++;
 
-    // "\r\nheartbeat 1491146601 25\r\n"
-    if (pHeartbeat != NULL)
+    // length of first word
+    const char *pSpace = memchr(line, ' ', len);
+    const int typeLen = pSpace != NULL ? (pSpace - line) : len;
+
+    for (int ix = 0; ix < NUMOF(skBackendLineTypes); ix++)
     {
-        pHeartbeat += 2;
-        char *endOfLine = strstr(pHeartbeat, "\r\n");
-        if (endOfLine != NULL)
+        const BACKEND_LINE_TYPE_t *pkType = &skBackendLineTypes[ix];
+        if ( (pkType->typeLen == typeLen) && (memcmp(pkType->type, line, typeLen) == 0) )
         {
-            *endOfLine = '\0';
-            sBackendHandleSetTime(&pHeartbeat[10]);
-            const char *pCnt = &pHeartbeat[10 + 10 + 1];
-            DEBUG("backend: heartbeat %s", pCnt);
+            return pkType->handler(pSpace != NULL ? &line[typeLen + 1] : &line[typeLen]);
         }
     }
 
-    // "\r\nconfig 1491146576 json={"key":"value", ... }\r\n"
-    if (pConfig != NULL)
+    // ignore everything else (e.g. chunked transfer encoding chunk sizes)
+    //DEBUG("backend: ignore %s", line);
+    return BACKEND_STATUS_OKAY;
+}
+
+
+/* ***** status processing ********************************************************************** */
+
+// scanner for the status JSON
+typedef struct BACKEND_SCAN_s
+{
+    const char *p;       // current position
+    const char *end;     // end of data
+} BACKEND_SCAN_t;
+
+static void sBackendScanSpace(BACKEND_SCAN_t *pScan)
+{
+    while ( (pScan->p < pScan->end) &&
+            ( (*pScan->p == ' ') || (*pScan->p == '\t') || (*pScan->p == '\r') || (*pScan->p == '\n') ) )
+    {
+        pScan->p++;
+    }
+}
+
+// expect character, skipping any whitespace before it
+static bool sBackendScanChar(BACKEND_SCAN_t *pScan, const char c)
+{
+    sBackendScanSpace(pScan);
+    if ( (pScan->p < pScan->end) && (*pScan->p == c) )
     {
-        pConfig += 2;
-        char *endOfLine = strstr(pConfig, "\r\n");
-        if (endOfLine != NULL)
-        {
-            *endOfLine = '\0';
-            sBackendHandleSetTime(&pConfig[7]);
-            char *pJson = &pConfig[7 + 10 + 1];
-            const int jsonLen = strlen(pJson);
-            DEBUG("backend: config");
-            if (configParseJson(pJson, jsonLen))
-            {
-                statusNoise(STATUS_NOISE_OTHER);
-            }
-            else
-            {
-                statusNoise(STATUS_NOISE_ERROR);
-            }
-        }
+        pScan->p++;
+        return true;
     }
+    return false;
+}
+
+// peek next non-whitespace character
+static char sBackendScanPeek(BACKEND_SCAN_t *pScan)
+{
+    sBackendScanSpace(pScan);
+    return pScan->p < pScan->end ? *pScan->p : '\0';
+}
 
-    // "\r\nstatus 1491146576 json={"jobs": ... }\r\n"
-    if (pStatus != NULL)
+// integer number, optionally in quotes
+static bool sBackendScanInt(BACKEND_SCAN_t *pScan, int32_t *pVal)
+{
+    const bool quoted = sBackendScanChar(pScan, '"');
+    bool neg = false;
+    if ( (pScan->p < pScan->end) && (*pScan->p == '-') )
     {
-        pStatus += 2;
-        char *endOfLine = strstr(pStatus, "\r\n");
-        if (endOfLine != NULL)
-        {
-            *endOfLine = '\0';
-            sBackendHandleSetTime(&pStatus[7]);
-            DEBUG("backend: status");
-            char *pJson = &pStatus[7 + 10 + 1];
-            const int jsonLen = strlen(pJson);
-            sBackendProcessStatus(pJson, jsonLen);
-        }
+        neg = true;
+        pScan->p++;
+    }
+    const char *pStart = pScan->p;
+    int32_t val = 0;
+    while ( (pScan->p < pScan->end) && (*pScan->p >= '0') && (*pScan->p <= '9') )
+    {
+        val = (val * 10) + (*pScan->p - '0');
+        pScan->p++;
     }
+    if ( (pScan->p == pStart) || (quoted && !sBackendScanChar(pScan, '"')) )
+    {
+        return false;
+    }
+    *pVal = neg ? -val : val;
+    return true;
+}
 
-    // "\r\ncommand 1491146601 reset\r\n"
-    if (pCommand != NULL)
+// string, copied (and possibly truncated) to the buffer
+static bool sBackendScanStr(BACKEND_SCAN_t *pScan, char *buf, const int size)
+{
+    if (!sBackendScanChar(pScan, '"'))
+    {
+        return false;
+    }
+    int len = 0;
+    while (pScan->p < pScan->end)
     {
-        pCommand += 2;
-        char *endOfLine = strstr(pCommand, "\r\n");
-        if (endOfLine != NULL)
+        char c = *pScan->p++;
+        if (c == '"')
         {
-            *endOfLine = '\0';
-            sBackendHandleSetTime(&pCommand[8]);
-            const char *pCmd = &pCommand[8 + 10 + 1];
-            if (strcmp("reconnect", pCmd) == 0)
-            {
-                PRINT("backend: command reconnect");
-                statusNoise(STATUS_NOISE_OTHER);
-                res = BACKEND_STATUS_RECONNECT;
-            }
-            else if (strcmp("reset", pCmd) == 0)
-            {
-                WARNING("backend: command restart");
-                statusNoise(STATUS_NOISE_OTHER);
-                osSleep(250);
-                sdk_system_restart();
-            }
-            else if (strcmp("identify", pCmd) == 0)
-            {
-                PRINT("backend: command identify");
-                toneStop();
-                toneBuiltinMelody("PacMan"); // ignore noise config
-            }
-            else if (strcmp("random", pCmd) == 0)
-            {
-                PRINT("backend: command random");
-                toneStop();
-                toneBuiltinMelodyRandom();
-            }
-            else
+            buf[len] = '\0';
+            return true;
+        }
+        // escaped char (we don't expect anything fancy here, so just take the next char as-is)
+        else if (c == '\\')
+        {
+            if (pScan->p >= pScan->end)
             {
-                WARNING("backend: command %s ???", pCmd);
-                toneStop();
-                statusNoise(STATUS_NOISE_ERROR);
+                break;
             }
+            c = *pScan->p++;
+        }
+        if (len < (size - 1))
+        {
+            buf[len++] = c;
         }
     }
-
-    return res;
+    return false;
 }
 
-
-void sBackendProcessStatus(char *resp, const int respLen)
+// decode one channel info: [ch] or [ch,"job","server","state","result",ts]
+static bool sBackendScanInfo(BACKEND_SCAN_t *pScan, JENKINS_INFO_t *pInfo)
 {
-    DEBUG("backend: [%d] %s", respLen, resp);
+    memset(pInfo, 0, sizeof(*pInfo));
 
-    const int maxTokens = (6 * JENKINS_MAX_CH) + 20;
-    jsmntok_t *pTokens = jsmnAllocTokens(maxTokens);
-    if (pTokens == NULL)
+    int32_t chIx;
+    if (!sBackendScanChar(pScan, '[') || !sBackendScanInt(pScan, &chIx))
     {
-        ERROR("backend: json malloc fail");
-        return;
+        return false;
+    }
+    pInfo->chIx = chIx;
+    pInfo->active = false;
+
+    // inactive channel
+    if (sBackendScanChar(pScan, ']'))
+    {
+        return true;
     }
 
-    // parse JSON response
-    const int numTokens = jsmnParse(resp, respLen, pTokens, maxTokens);
-    bool okay = numTokens > 0 ? true : false;
-
-    //jsmnDumpTokens(resp, pTokens, numTokens);
-    /*
-      004.974 D: json 00: 2 arr   000..218 10 <-1
-      004.984 D: json 01: 2 arr   001..057 6 < 0 [0,"PROJECT03","server-abc","idle","unknown",1522616716]
-      004.985 D: json 02: 4 prim  002..003 0 < 1 0
-      004.985 D: json 03: 3 str   005..014 0 < 1 PROJECT03
-      004.995 D: json 04: 3 str   017..027 0 < 1 server-abc
-      004.995 D: json 05: 3 str   030..034 0 < 1 idle
-      004.995 D: json 06: 3 str   037..044 0 < 1 unknown
-      005.006 D: json 07: 4 prim  046..056 0 < 1 1522616716
-      005.016 D: json 08: 2 arr   058..121 6 < 0 [1,"CI_Project_Foo1","server-abc","idle","unstable",1522616736]
-      005.017 D: json 09: 4 prim  059..060 0 < 8 1
-      005.017 D: json 10: 3 str   062..077 0 < 8 CI_Project_Foo1
-      005.027 D: json 11: 3 str   080..090 0 < 8 server-abc
-      005.027 D: json 12: 3 str   093..097 0 < 8 idle
-      005.027 D: json 13: 3 str   100..108 0 < 8 unstable
-      005.038 D: json 14: 4 prim  110..120 0 < 8 1522616736
-      005.048 D: json 15: 2 arr   122..189 6 < 0 [2,"CI_Project1_Foo02","server-abc","unknown","unknown",1505942566]
-      005.048 D: json 16: 4 prim  123..124 0 <15 2
-      005.048 D: json 17: 3 str   126..143 0 <15 CI_Project1_Foo02
-      005.059 D: json 18: 3 str   146..156 0 <15 server-abc
-      005.059 D: json 19: 3 str   159..166 0 <15 unknown
-      005.059 D: json 20: 3 str   169..176 0 <15 unknown
-      005.069 D: json 21: 4 prim  178..188 0 <15 1505942566
-      005.069 D: json 22: 2 arr   190..193 1 < 0 [3]
-      005.080 D: json 23: 4 prim  191..192 0 <22 3
-      005.080 D: json 24: 2 arr   194..197 1 < 0 [4]
-      005.080 D: json 25: 4 prim  195..196 0 <24 4
-    */
-
-    // process JSON data
-
-    if (okay && (pTokens[0].type != JSMN_ARRAY))
+    char stateStr[16];
+    char resultStr[16];
+    int32_t ts;
+    if (!sBackendScanChar(pScan, ',') || !sBackendScanStr(pScan, pInfo->job, sizeof(pInfo->job))       ||
+        !sBackendScanChar(pScan, ',') || !sBackendScanStr(pScan, pInfo->server, sizeof(pInfo->server)) ||
+        !sBackendScanChar(pScan, ',') || !sBackendScanStr(pScan, stateStr, sizeof(stateStr))           ||
+        !sBackendScanChar(pScan, ',') || !sBackendScanStr(pScan, resultStr, sizeof(resultStr))         ||
+        !sBackendScanChar(pScan, ',') || !sBackendScanInt(pScan, &ts)                                  ||
+        !sBackendScanChar(pScan, ']') )
+    {
+        return false;
+    }
+    pInfo->active = true;
+    pInfo->state  = jenkinsStrToState(stateStr);
+    pInfo->result = jenkinsStrToResult(resultStr);
+    pInfo->time   = ts;
+
+    return true;
+}
+
+// decode status JSON "[[0,"PROJECT03","server-abc","idle","unknown",1522616716],[1],...]"
+// in a single pass, without tokenising it first (and without allocating anything)
+static void sBackendProcessStatus(char *resp, const int respLen)
+{
+    DEBUG("backend: [%d] %s", respLen, resp);
+
+    BACKEND_SCAN_t scan = { .p = resp, .end = &resp[respLen] };
+    bool okay = true;
+
+    if (!sBackendScanChar(&scan, '['))
     {
         WARNING("backend: json not array");
         okay = false;
     }
 
-    // look for results
-    if (okay)
+    // non-empty array
+    else if (!sBackendScanChar(&scan, ']'))
     {
-        // look for response result
-        for (int ix = 0; ix < numTokens; ix++)
+        while (true)
         {
-            const jsmntok_t *pkTok = &pTokens[ix];
-            // top-level array, size 1 or 6
-            if ( (pkTok->parent == 0) && (pkTok->type == JSMN_ARRAY) &&
-                ( (pkTok->size == 1) || (pkTok->size == 6) ) )
+            // decode channel info and send it to the Jenkins task
+            JENKINS_INFO_t jInfo;
+            if (!sBackendScanInfo(&scan, &jInfo))
             {
-                // create message to Jenkins task
-                JENKINS_INFO_t jInfo;
-                memset(&jInfo, 0, sizeof(jInfo));
-
-                // first element is the channel index
-                const jsmntok_t *pkTokCh = &pTokens[ix + 1];
-                if ( (pkTokCh->type == JSMN_STRING) || (pkTokCh->type == JSMN_PRIMITIVE) )
-                {
-                    resp[ pkTokCh->end ] = '\0';
-                    const char *chStr = &resp[ pkTokCh->start ];
-                    jInfo.chIx = atoi(chStr);
-                    jInfo.active = false;
-                    ix++;
-                }
-                else
-                {
-                    WARNING("backend: json jobs format at %d (%d)", ix, pkTokCh->type);
-                    okay = false;
-                    break;
-                }
-
-                // the next five elements are the job info
-                const jsmntok_t *pkTokName   = &pTokens[ix + 1];
-                const jsmntok_t *pkTokServer = &pTokens[ix + 2];
-                const jsmntok_t *pkTokState  = &pTokens[ix + 3];
-                const jsmntok_t *pkTokResult = &pTokens[ix + 4];
-                const jsmntok_t *pkTokTime   = &pTokens[ix + 5];
-                if ( (pkTok->size == 6) &&
-                     (pkTokName->type == JSMN_STRING) &&  (pkTokServer->type == JSMN_STRING) &&
-                     (pkTokState->type == JSMN_STRING) &&  (pkTokResult->type == JSMN_STRING) &&
-                     ( (pkTokTime->type == JSMN_STRING) || (pkTokTime->type == JSMN_PRIMITIVE) ) )
-                {
-
-                    resp[ pkTokName->end   ] = '\0'; const char *nameStr   = &resp[ pkTokName->start ];
-                    resp[ pkTokServer->end ] = '\0'; const char *serverStr = &resp[ pkTokServer->start ];
-                    resp[ pkTokState->end  ] = '\0'; const char *stateStr  = &resp[ pkTokState->start ];
-                    resp[ pkTokResult->end ] = '\0'; const char *resultStr = &resp[ pkTokResult->start ];
-                    resp[ pkTokTime->end   ] = '\0'; const char *timeStr   = &resp[ pkTokTime->start ];
-                    ix += 5;
-
-                    jInfo.active = true;
-                    jInfo.state  = jenkinsStrToState(stateStr);
-                    jInfo.result = jenkinsStrToResult(resultStr);
-                    strncpy(jInfo.job, nameStr, sizeof(jInfo.job));
-                    strncpy(jInfo.server, serverStr, sizeof(jInfo.server));
-                    jInfo.time = (uint32_t)atoi(timeStr);
-                }
-                else if (pkTok->size == 6)
-                {
-                    WARNING("backend: json jobs format at %d (%d, %d, %d, %d, %d)", ix,
-                        pkTokName->type, pkTokServer->type, pkTokState->type,
-                        pkTokResult->type, pkTokTime->type);
-                    okay = false;
-                    break;
-                }
+                WARNING("backend: json jobs format at %d", (int)(scan.p - resp));
+                okay = false;
+                break;
+            }
+            jenkinsSetInfo(&jInfo);
 
-                // send info the Jenkins task
-                jenkinsSetInfo(&jInfo);
+            // more or done?
+            if (sBackendScanChar(&scan, ','))
+            {
+                continue;
+            }
+            else if (sBackendScanChar(&scan, ']'))
+            {
+                break;
+            }
+            else
+            {
+                WARNING("backend: json array format at %d (%c)", (int)(scan.p - resp), sBackendScanPeek(&scan));
+                okay = false;
+                break;
             }
         }
     }
@@ -407,16 +744,54 @@ void sBackendProcessStatus(char *resp, const int respLen)
         statusNoise(STATUS_NOISE_ERROR);
         ERROR("backend: json parse fail");
     }
-
-    // cleanup
-    free(pTokens);
 }
 
 
+// binary status record (see _realtime() in tschenggins-status.pl), base64 encoded on the wire
+#define BACKEND_BSTATUS_REC_SIZE 6 // [ch:8] [state:4|result:4] [ts:32 (big endian)]
+
+// decode binary status "bstatus" frame, which updates state, result and timestamp of channels
+// that we already have the job and server names of (from a previous JSON "status" line)
+static void sBackendProcessBinStatus(const char *b64)
+{
+    static char sBuf[ (BACKEND_BSTATUS_REC_SIZE * JENKINS_MAX_CH) + 4 ];
+    const int b64Len = strlen(b64);
+    if ( (b64Len == 0) || !base64dec(b64, sBuf, sizeof(sBuf)) )
+    {
+        ERROR("backend: bstatus decode fail");
+        statusNoise(STATUS_NOISE_ERROR);
+        return;
+    }
+    const int padLen = (b64[b64Len - 1] == '=' ? 1 : 0) + (b64[b64Len - 2] == '=' ? 1 : 0);
+    const int len = (b64Len / 4 * 3) - padLen;
+    if ( (len % BACKEND_BSTATUS_REC_SIZE) != 0 )
+    {
+        ERROR("backend: bstatus size %d", len);
+        statusNoise(STATUS_NOISE_ERROR);
+        return;
+    }
+
+    for (int offs = 0; offs < len; offs += BACKEND_BSTATUS_REC_SIZE)
+    {
+        const uint8_t *pkRec = (const uint8_t *)&sBuf[offs];
+        const int chIx = pkRec[0];
+        const JENKINS_STATE_t  state  = (JENKINS_STATE_t)( (pkRec[1] >> 4) & 0x0f );
+        const JENKINS_RESULT_t result = (JENKINS_RESULT_t)( pkRec[1] & 0x0f );
+        const int32_t ts = (int32_t)( ((uint32_t)pkRec[2] << 24) | ((uint32_t)pkRec[3] << 16) |
+                                      ((uint32_t)pkRec[4] <<  8) |  (uint32_t)pkRec[5] );
+        jenkinsSetState(chIx,
+            state  <= JENKINS_STATE_IDLE      ? state  : JENKINS_STATE_UNKNOWN,
+            result <= JENKINS_RESULT_FAILURE  ? result : JENKINS_RESULT_UNKNOWN, ts);
+    }
+    statusNoise(STATUS_NOISE_OTHER);
+}
+
 
 void backendInit(void)
 {
     DEBUG("backend: init");
+    static StaticTimer_t sTimer;
+    sBackendResumeTimer = xTimerCreateStatic("backend_resume", MS2TICKS(1000 * BACKEND_RESUME_TIMEOUT), false, NULL, sBackendResumeTimerFunc, &sTimer);
 }
 
 /* ********************************************************************************************** */
@@ -26,20 +26,74 @@ typedef enum BACKEND_STATUS_e
 
 } BACKEND_STATUS_t;
 
+//! protocol version we request from the backend (1 = JSON status only, 2 = also "bstatus" frames,
+//! 3 = also "session" lines, see backendSession())
+#define BACKEND_PROTOCOL_VERSION 3
+
 #define BACKEND_STABLE_CONN_THRS  300 // [s]
 #define BACKEND_RECONNECT_INTERVAL 10 // [s]
 #define BACKEND_RECONNECT_INTERVAL_SLOW 300 // [s]
+#define BACKEND_RESUME_TIMEOUT     60 // [s]
 #if (BACKEND_RECONNECT_INTERVAL_SLOW <= BACKEND_RECONNECT_INTERVAL)
 #  error Nope!
 #endif
 
-bool backendConnect(char *resp, const int len);
+//! start new connection (the response data is then fed to backendHandle())
+void backendConnect(void);
+
+//! check if the backend said "hello" on the current connection
+bool backendIsConnected(void);
+
+//! handle data from backend
+/*!
+    Feeds the data to the line framer. Complete lines are dispatched to the line handlers right
+    away (in place, \c resp is modified), incomplete lines are kept until the rest arrives.
+
+    \param[in] resp  received data (does not have to be nul-terminated)
+    \param[in] len   length of received data
 
+    \returns #BACKEND_STATUS_OKAY if all is good, #BACKEND_STATUS_RECONNECT if the backend
+              asked us to reconnect
+*/
 BACKEND_STATUS_t backendHandle(char *resp, const int len);
 
 bool backendIsOkay(void);
+
+//! time left until the heartbeat deadline (for use as receive timeout) [ms], <= 0 if the deadline has passed
+int32_t backendHeartbeatRemaining(void);
 void backendDisconnect(void);
 
+//! how long the backend asked us to wait before reconnecting ("reconnect" with a retry hint)
+/*!
+    \returns the time [s] (0 if there was no hint, then we reconnect right away), once
+*/
+int backendRetryHint(void);
+
+//! session to resume on the next connection
+/*!
+    The backend tells us its session ID and sequence number after each batch of updates we have
+    received. When we reconnect within #BACKEND_RESUME_TIMEOUT with these, it only sends what has
+    changed since, and we keep showing the channels we have until then.
+
+    \returns the session ("id:seq") for the "session" query parameter, or NULL if there is none
+*/
+const char *backendSession(void);
+
+//! the channels are now updated by the LAN relay (see relay.h) instead of the backend
+/*!
+    Forgets the session (the next connection starts a new one) and stops the resume timeout, so
+    that the channels aren't shown as stale.
+*/
+void backendRelayed(void);
+
 void backendMonStatus(void);
 
+//! get backend traffic counters (since boot)
+/*!
+    \param[out] pBytes      number of bytes received
+    \param[out] pLines      number of lines received
+    \param[out] pConnCount  number of connections
+*/
+void backendGetCounters(uint32_t *pBytes, uint32_t *pLines, uint32_t *pConnCount);
+
 #endif // __BACKEND_H__
@@ -0,0 +1,213 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: button (see \ref FF_BUTTON)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \addtogroup FF_BUTTON
+
+    @{
+*/
+
+#include "stdinc.h"
+
+#include <esp8266.h>
+
+#include "debug.h"
+#include "stuff.h"
+#include "tone.h"
+#include "status.h"
+#include "wifi.h"
+#include "mon.h"
+#include "button.h"
+
+
+/* ***** debounce state machine ****************************************************************** */
+
+typedef enum BUTTON_STATE_e
+{
+    BUTTON_STATE_IDLE,      // released, nothing going on (timer not running)
+    BUTTON_STATE_PRESSED,   // pressed, waiting for release or long press
+    BUTTON_STATE_HELD,      // long press reported, waiting for release or very long press
+    BUTTON_STATE_DONE,      // very long (or double) press reported, waiting for release
+    BUTTON_STATE_RELEASED,  // released after a short press, waiting for a second press
+} BUTTON_STATE_t;
+
+typedef enum BUTTON_EVENT_e
+{
+    BUTTON_EVENT_SHORT,
+    BUTTON_EVENT_LONG,
+    BUTTON_EVENT_PROV,
+    BUTTON_EVENT_DOUBLE,
+} BUTTON_EVENT_t;
+
+static TimerHandle_t sButtonTimer;
+static BUTTON_STATE_t sButtonState; // only touched in the timer callback
+static uint32_t sButtonTick;        // when the current state was entered [ticks]
+static uint16_t sButtonNumShort;    // statistics, for buttonMonStatus()
+static uint16_t sButtonNumLong;
+static uint16_t sButtonNumDouble;
+static uint16_t sButtonNumProv;
+static volatile uint16_t svButtonNumEdges;
+
+static void sButtonEvent(const BUTTON_EVENT_t event)
+{
+    switch (event)
+    {
+        case BUTTON_EVENT_SHORT:
+            PRINT("button: short (acknowledge)");
+            sButtonNumShort++;
+            toneStop();
+            break;
+        case BUTTON_EVENT_LONG:
+            PRINT("button: long (reconnect)");
+            sButtonNumLong++;
+            statusNoise(STATUS_NOISE_OTHER);
+            wifiReconnect();
+            break;
+        case BUTTON_EVENT_PROV:
+            PRINT("button: very long (provisioning)");
+            sButtonNumProv++;
+            wifiStartProvisioning();
+            break;
+        case BUTTON_EVENT_DOUBLE:
+            PRINT("button: double (identify)");
+            sButtonNumDouble++;
+            statusCommandMelody("PacMan");
+            break;
+    }
+}
+
+// (re-)arm the timer to run the state machine again in a while
+static void sButtonSchedule(const uint32_t ms)
+{
+    xTimerChangePeriod(sButtonTimer, MS2TICKS(ms), 0);
+}
+
+// the pin has been stable for (at least) BUTTON_DEBOUNCE_MS, or a deadline has expired
+static void sButtonTimerFunc(TimerHandle_t timer)
+{
+    UNUSED(timer);
+    const bool pressed = !gpio_read(BUTTON_GPIO); // active low
+    const uint32_t now = xTaskGetTickCount();
+    const uint32_t dt = now - sButtonTick;
+
+    switch (sButtonState)
+    {
+        case BUTTON_STATE_IDLE:
+            if (pressed)
+            {
+                sButtonState = BUTTON_STATE_PRESSED;
+                sButtonTick = now;
+                sButtonSchedule(BUTTON_LONG_MS);
+            }
+            break;
+
+        case BUTTON_STATE_PRESSED:
+            if (!pressed)
+            {
+                sButtonState = BUTTON_STATE_RELEASED;
+                sButtonTick = now;
+                sButtonSchedule(BUTTON_DOUBLE_MS);
+            }
+            else if (dt >= MS2TICKS(BUTTON_LONG_MS))
+            {
+                sButtonState = BUTTON_STATE_HELD;
+                sButtonEvent(BUTTON_EVENT_LONG);
+                sButtonSchedule(BUTTON_PROV_MS - TICKS2MS(dt));
+            }
+            else
+            {
+                // bounced (the interrupt has re-armed the timer), wait for the rest of the long press
+                sButtonSchedule(BUTTON_LONG_MS - TICKS2MS(dt));
+            }
+            break;
+
+        case BUTTON_STATE_HELD:
+            if (!pressed)
+            {
+                sButtonState = BUTTON_STATE_IDLE;
+            }
+            else if (dt >= MS2TICKS(BUTTON_PROV_MS))
+            {
+                sButtonState = BUTTON_STATE_DONE;
+                sButtonEvent(BUTTON_EVENT_PROV);
+            }
+            else
+            {
+                // bounced, wait for the rest of the very long press
+                sButtonSchedule(BUTTON_PROV_MS - TICKS2MS(dt));
+            }
+            break;
+
+        case BUTTON_STATE_DONE:
+            if (!pressed)
+            {
+                sButtonState = BUTTON_STATE_IDLE;
+            }
+            break;
+
+        case BUTTON_STATE_RELEASED:
+            if (pressed)
+            {
+                // second press, report now and ignore the rest of it
+                sButtonState = BUTTON_STATE_DONE;
+                sButtonEvent(BUTTON_EVENT_DOUBLE);
+            }
+            else if (dt >= MS2TICKS(BUTTON_DOUBLE_MS))
+            {
+                sButtonState = BUTTON_STATE_IDLE;
+                sButtonEvent(BUTTON_EVENT_SHORT);
+            }
+            else
+            {
+                sButtonSchedule(BUTTON_DOUBLE_MS - TICKS2MS(dt));
+            }
+            break;
+    }
+}
+
+// pin change interrupt, restarts the debounce period
+IRAM static void sButtonIsr(uint8_t gpio)
+{
+    const uint32_t t0 = monIsrEnter();
+    UNUSED(gpio);
+    svButtonNumEdges++;
+    BaseType_t woken = pdFALSE;
+    xTimerChangePeriodFromISR(sButtonTimer, MS2TICKS(BUTTON_DEBOUNCE_MS), &woken);
+    monIsrLeave(MON_ISR_BUTTON, t0);
+    portYIELD_FROM_ISR(woken);
+}
+
+
+/* ***** monitor and init ************************************************************************ */
+
+void buttonMonStatus(void)
+{
+    DEBUG("mon: button: state=%d edges=%u short=%u long=%u prov=%u double=%u",
+        sButtonState, svButtonNumEdges, sButtonNumShort, sButtonNumLong, sButtonNumProv, sButtonNumDouble);
+    svButtonNumEdges = 0;
+    sButtonNumShort = 0;
+    sButtonNumLong = 0;
+    sButtonNumDouble = 0;
+    sButtonNumProv = 0;
+}
+
+void buttonInit(void)
+{
+    DEBUG("button: init (GPIO%u)", BUTTON_GPIO);
+
+    static StaticTimer_t sTimer;
+    sButtonTimer = xTimerCreateStatic("button", MS2TICKS(BUTTON_DEBOUNCE_MS), false, NULL, sButtonTimerFunc, &sTimer);
+    sButtonState = BUTTON_STATE_IDLE;
+
+    gpio_enable(BUTTON_GPIO, GPIO_INPUT);
+    gpio_set_pullup(BUTTON_GPIO, true, false);
+    gpio_set_interrupt(BUTTON_GPIO, GPIO_INTTYPE_EDGE_ANY, sButtonIsr);
+}
+
+
+/* *********************************************************************************************** */
+//@}
+// eof
@@ -0,0 +1,55 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: button (see \ref FF_BUTTON)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \defgroup FF_BUTTON BUTTON
+    \ingroup FF
+
+    The button is the FLASH (BOOT) button on GPIO0 (#BUTTON_GPIO, active low, with pull-up). Both
+    edges trigger an interrupt, which only (re-)arms a one-shot timer. The debounce state machine
+    runs in that timer's callback (in the FreeRTOS timer task) once the pin has been stable for
+    #BUTTON_DEBOUNCE_MS. The timer re-arms itself only while a press is in progress, so there is
+    nothing running while the button is idle.
+
+    - short press (released before #BUTTON_LONG_MS and no second press within #BUTTON_DOUBLE_MS):
+      acknowledge, i.e. stop the noise that is currently playing (see toneStop())
+    - long press (held for #BUTTON_LONG_MS): reconnect to the backend (see wifiReconnect())
+    - very long press (held for #BUTTON_PROV_MS): go to the provisioning mode (see
+      wifiStartProvisioning()), which is the only way to get there if the device has a wifi config
+    - double press (two short presses within #BUTTON_DOUBLE_MS): identify (like the backend
+      "identify" command)
+
+    @{
+*/
+#ifndef __BUTTON_H__
+#define __BUTTON_H__
+
+#include "stdinc.h"
+
+//! button GPIO
+#define BUTTON_GPIO           0
+
+//! pin must be stable for this long to consider it pressed or released [ms]
+#define BUTTON_DEBOUNCE_MS   30
+
+//! a press becomes a long press after this long [ms]
+#define BUTTON_LONG_MS      800
+
+//! a long press becomes a very long press after this long [ms]
+#define BUTTON_PROV_MS     5000
+
+//! a second press within this long after a short press makes it a double press [ms]
+#define BUTTON_DOUBLE_MS    350
+
+//! initialise
+void buttonInit(void);
+
+//! print button monitor string
+void buttonMonStatus(void);
+
+#endif // __BUTTON_H__
+//@}
+// eof
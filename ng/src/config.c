@@ -8,11 +8,15 @@
 
 #include "stdinc.h"
 
+#include <ctype.h>
+
 #include "stuff.h"
 #include "debug.h"
 #include "status.h"
+#include "jenkins.h"
 #include "config.h"
 #include "json.h"
+#include "flash.h"
 #include "cfg_gen.h"
 
 CONFIG_MODEL_t  sConfigModel;
@@ -20,15 +24,53 @@ CONFIG_DRIVER_t sConfigDriver;
 CONFIG_ORDER_t  sConfigOrder;
 CONFIG_BRIGHT_t sConfigBright;
 CONFIG_NOISE_t  sConfigNoise;
+int             sConfigFps;
+int             sConfigSpiClk;
+bool            sConfigDither;
+int             sConfigLeds;
+int             sConfigChLeds;
+CONFIG_POWER_t  sConfigPower;
+bool            sConfigRelay;
+int             sConfigQuietFrom;
+int             sConfigQuietTo;
+int             sConfigTzOffs;
+uint8_t         sConfigFx[CONFIG_FX_MAX];
+int             sConfigFxLen;
 
-void configInit(void)
+static volatile uint32_t svConfigVersion;
+static TaskHandle_t sConfigSubs[CONFIG_MAX_SUBS];
+
+static void sConfigDefaults(void)
 {
-    DEBUG("config: init");
     sConfigModel  = CONFIG_MODEL_UNKNOWN;
     sConfigDriver = CONFIG_DRIVER_UNKNOWN;
     sConfigOrder  = CONFIG_ORDER_UNKNOWN;
     sConfigBright = CONFIG_BRIGHT_UNKNOWN;
     sConfigNoise  = CONFIG_NOISE_SOME;
+    sConfigFps    = CONFIG_FPS_DEFAULT;
+    sConfigSpiClk = 0;
+    sConfigDither = false;
+    sConfigLeds   = JENKINS_MAX_CH;
+    sConfigChLeds = 1;
+    sConfigPower  = CONFIG_POWER_MODEM;
+    sConfigRelay  = false;
+    sConfigQuietFrom = 0;
+    sConfigQuietTo   = 0;
+    sConfigTzOffs    = 0;
+    sConfigFxLen     = 0;
+}
+
+static void sConfigLoad(void);
+
+static void sConfigInitTabs(void);
+
+void configInit(void)
+{
+    DEBUG("config: init");
+    sConfigInitTabs();
+    svConfigVersion = 1; // (consumers start with 0)
+    sConfigDefaults();
+    sConfigLoad();
 }
 
 __INLINE CONFIG_MODEL_t  configGetModel(void)  { return sConfigModel; }
@@ -36,6 +78,59 @@ __INLINE CONFIG_DRIVER_t configGetDriver(void) { return sConfigDriver; }
 __INLINE CONFIG_ORDER_t  configGetOrder(void)  { return sConfigOrder; }
 __INLINE CONFIG_BRIGHT_t configGetBright(void) { return sConfigBright; }
 __INLINE CONFIG_NOISE_t  configGetNoise(void)  { return sConfigNoise; }
+__INLINE int             configGetFps(void)    { return sConfigFps; }
+__INLINE int             configGetSpiClk(void) { return sConfigSpiClk; }
+__INLINE bool            configGetDither(void) { return sConfigDither; }
+__INLINE int             configGetLeds(void)   { return sConfigLeds; }
+__INLINE int             configGetChLeds(void) { return sConfigChLeds; }
+__INLINE CONFIG_POWER_t  configGetPower(void)  { return sConfigPower; }
+__INLINE bool            configGetRelay(void)  { return sConfigRelay; }
+__INLINE int             configGetQuietFrom(void) { return sConfigQuietFrom; }
+__INLINE int             configGetQuietTo(void)   { return sConfigQuietTo; }
+__INLINE int             configGetTzOffs(void)    { return sConfigTzOffs; }
+__INLINE uint32_t        configGetVersion(void)   { return svConfigVersion; }
+
+int configGetFx(uint8_t *buf)
+{
+    int len;
+    CS_ENTER;
+    len = sConfigFxLen;
+    memcpy(buf, sConfigFx, len);
+    CS_LEAVE;
+    return len;
+}
+
+bool configSubscribe(TaskHandle_t task)
+{
+    bool res = false;
+    CS_ENTER;
+    for (int ix = 0; ix < NUMOF(sConfigSubs); ix++)
+    {
+        if (sConfigSubs[ix] == NULL)
+        {
+            sConfigSubs[ix] = task;
+            res = true;
+            break;
+        }
+    }
+    CS_LEAVE;
+    if (!res)
+    {
+        ERROR("config: too many subs");
+    }
+    return res;
+}
+
+static void sConfigNotify(void)
+{
+    for (int ix = 0; ix < NUMOF(sConfigSubs); ix++)
+    {
+        if (sConfigSubs[ix] != NULL)
+        {
+            xTaskNotifyGive(sConfigSubs[ix]);
+        }
+    }
+}
 
 static const char * const skConfigModelStrs[] =
 {
@@ -48,7 +143,7 @@ static const char * const skConfigDriverStrs[] =
 {
     [CONFIG_DRIVER_UNKNOWN] = "unknown",
     [CONFIG_DRIVER_WS2801]  = "WS2801",
-    //[CONFIG_DRIVER_WS2812]  = "WS2812",
+    [CONFIG_DRIVER_WS2812]  = "WS2812",
     [CONFIG_DRIVER_SK9822]  = "SK9822",
 };
 
@@ -81,67 +176,276 @@ static const char * const skConfigNoiseStrs[] =
     [CONFIG_NOISE_MOST]    = "most",
 };
 
+static const char * const skConfigPowerStrs[] =
+{
+    [CONFIG_POWER_UNKNOWN] = "unknown",
+    [CONFIG_POWER_NONE]    = "none",
+    [CONFIG_POWER_MODEM]   = "modem",
+    [CONFIG_POWER_LIGHT]   = "light",
+};
+
+const char *configPowerStr(const CONFIG_POWER_t power)
+{
+    return skConfigPowerStrs[power];
+}
+
 void configMonStatus(void)
 {
-    DEBUG("mon: config: model=%s driver=%s order=%s bright=%s noise=%s",
+    DEBUG("mon: config: model=%s driver=%s order=%s bright=%s noise=%s fps=%d spiclk=%d dither=%s leds=%d chleds=%d power=%s relay=%s quiet=%d-%d tzoffs=%d fx=%d",
         skConfigModelStrs[sConfigModel], skConfigDriverStrs[sConfigDriver],
         skConfigOrderStrs[sConfigOrder], skConfigBrightStrs[sConfigBright],
-        skConfigNoiseStrs[sConfigNoise]);
+        skConfigNoiseStrs[sConfigNoise], sConfigFps, sConfigSpiClk, sConfigDither ? "on" : "off", sConfigLeds, sConfigChLeds,
+        skConfigPowerStrs[sConfigPower], sConfigRelay ? "on" : "off", sConfigQuietFrom, sConfigQuietTo, sConfigTzOffs, sConfigFxLen);
 }
 
+// decoding the strings via the above string tables
+static STRTAB_t sConfigModelTab  = STRTAB(skConfigModelStrs);
+static STRTAB_t sConfigDriverTab = STRTAB(skConfigDriverStrs);
+static STRTAB_t sConfigOrderTab  = STRTAB(skConfigOrderStrs);
+static STRTAB_t sConfigBrightTab = STRTAB(skConfigBrightStrs);
+static STRTAB_t sConfigNoiseTab  = STRTAB(skConfigNoiseStrs);
+static STRTAB_t sConfigPowerTab  = STRTAB(skConfigPowerStrs);
+
 static CONFIG_MODEL_t sConfigStrToModel(const char *str)
 {
-    if      (strcmp("standard", str) == 0) { return CONFIG_MODEL_STANDARD; }
-    else if (strcmp("hello",    str) == 0) { return CONFIG_MODEL_HELLO; }
-    else                                   { return CONFIG_MODEL_UNKNOWN; }
+    return (CONFIG_MODEL_t)strTabFind(&sConfigModelTab, str, -1, CONFIG_MODEL_UNKNOWN);
 }
 
 static CONFIG_DRIVER_t sConfigStrToDriver(const char *str)
 {
-    if      (strcmp("WS2801", str) == 0) { return CONFIG_DRIVER_WS2801; }
-    //else if (strcmp("WS2812", str) == 0) { return CONFIG_DRIVER_WS2812; }
-    else if (strcmp("SK9822", str) == 0) { return CONFIG_DRIVER_SK9822; }
-    else                                 { return CONFIG_DRIVER_UNKNOWN; }
+    return (CONFIG_DRIVER_t)strTabFind(&sConfigDriverTab, str, -1, CONFIG_DRIVER_UNKNOWN);
 }
 
 static CONFIG_ORDER_t sConfigStrToOrder(const char *str)
 {
-    if      (strcmp("RGB",    str) == 0) { return CONFIG_ORDER_RGB; }
-    else if (strcmp("RBG",    str) == 0) { return CONFIG_ORDER_RBG; }
-    else if (strcmp("GRB",    str) == 0) { return CONFIG_ORDER_GRB; }
-    else if (strcmp("GBR",    str) == 0) { return CONFIG_ORDER_GBR; }
-    else if (strcmp("BRG",    str) == 0) { return CONFIG_ORDER_BRG; }
-    else if (strcmp("BGR",    str) == 0) { return CONFIG_ORDER_BGR; }
-    else                                 { return CONFIG_ORDER_UNKNOWN; }
+    return (CONFIG_ORDER_t)strTabFind(&sConfigOrderTab, str, -1, CONFIG_ORDER_UNKNOWN);
 }
 
 static CONFIG_BRIGHT_t sConfigStrToBright(const char *str)
 {
-    if      (strcmp("low",    str) == 0) { return CONFIG_BRIGHT_LOW; }
-    else if (strcmp("medium", str) == 0) { return CONFIG_BRIGHT_MEDIUM; }
-    else if (strcmp("high",   str) == 0) { return CONFIG_BRIGHT_HIGH; }
-    else if (strcmp("full",   str) == 0) { return CONFIG_BRIGHT_FULL; }
-    else                                 { return CONFIG_BRIGHT_UNKNOWN; }
+    return (CONFIG_BRIGHT_t)strTabFind(&sConfigBrightTab, str, -1, CONFIG_BRIGHT_UNKNOWN);
+}
+
+static int sConfigIntToFps(const int fps)
+{
+    return fps > 0 ? CLIP(fps, CONFIG_FPS_MIN, CONFIG_FPS_MAX) : CONFIG_FPS_DEFAULT;
+}
+
+static int sConfigIntToSpiClk(const int spiClk)
+{
+    return spiClk > 0 ? CLIP(spiClk, 1, CONFIG_SPICLK_MAX) : 0;
+}
+
+static bool sConfigStrToDither(const char *str)
+{
+    return strcmp("on", str) == 0;
+}
+
+static bool sConfigStrToRelay(const char *str)
+{
+    return strcmp("on", str) == 0;
+}
+
+static int sConfigIntToLeds(const int leds)
+{
+    return leds > 0 ? CLIP(leds, 1, CONFIG_LEDS_MAX) : JENKINS_MAX_CH;
+}
+
+static int sConfigIntToChLeds(const int chLeds)
+{
+    return chLeds > 0 ? CLIP(chLeds, 1, CONFIG_LEDS_MAX) : 1;
+}
+
+static CONFIG_POWER_t sConfigStrToPower(const char *str)
+{
+    const CONFIG_POWER_t power = (CONFIG_POWER_t)strTabFind(&sConfigPowerTab, str, -1, CONFIG_POWER_UNKNOWN);
+    return power != CONFIG_POWER_UNKNOWN ? power : CONFIG_POWER_MODEM;
+}
+
+// "22-7" --> from = 22, to = 7 (anything else is off)
+static void sConfigStrToQuiet(const char *str, int *pFrom, int *pTo)
+{
+    int from = 0, to = 0;
+    const char *pkDash = strchr(str, '-');
+    if (pkDash != NULL)
+    {
+        from = atoi(str);
+        to   = atoi(&pkDash[1]);
+    }
+    if ( (pkDash == NULL) || (from < 0) || (from > 23) || (to < 0) || (to > 23) )
+    {
+        from = 0;
+        to   = 0;
+    }
+    *pFrom = from;
+    *pTo   = to;
+}
+
+static int sConfigIntToTzOffs(const int tzOffs)
+{
+    return CLIP(tzOffs, -CONFIG_TZOFFS_MAX, CONFIG_TZOFFS_MAX);
+}
+
+// "0a1b2c..." --> bytes, returns number of bytes (0 for invalid strings, or if they're too long)
+static int sConfigStrToFx(const char *str, uint8_t *fx)
+{
+    int len = 0;
+    while ( isxdigit((int)str[0]) && isxdigit((int)str[1]) && (len < CONFIG_FX_MAX) )
+    {
+        const char hex[3] = { str[0], str[1], '\0' };
+        fx[len++] = strtoul(hex, NULL, 16);
+        str += 2;
+    }
+    return *str == '\0' ? len : 0;
 }
 
 static CONFIG_NOISE_t sConfigStrToNoise(const char *str)
 {
-    if      (strcmp("none", str) == 0) { return CONFIG_NOISE_NONE; }
-    else if (strcmp("some", str) == 0) { return CONFIG_NOISE_SOME; }
-    else if (strcmp("more", str) == 0) { return CONFIG_NOISE_MORE; }
-    else if (strcmp("most", str) == 0) { return CONFIG_NOISE_MOST; }
-    else                               { return CONFIG_NOISE_UNKNOWN; }
+    return (CONFIG_NOISE_t)strTabFind(&sConfigNoiseTab, str, -1, CONFIG_NOISE_UNKNOWN);
 }
 
+static void sConfigInitTabs(void)
+{
+    strTabInit(&sConfigModelTab);
+    strTabInit(&sConfigDriverTab);
+    strTabInit(&sConfigOrderTab);
+    strTabInit(&sConfigBrightTab);
+    strTabInit(&sConfigNoiseTab);
+    strTabInit(&sConfigPowerTab);
+}
+
+/* ***** persistent config ********************************************************************* */
+
+// the config is stored in the flash key-value store (see flash.c) using the same keys and value strings
+// as in the backend response, so that we can start with the last-known config (no waiting for the
+// backend connection, no flashing of the LEDs when that comes)
+
+static bool sConfigLoadStr(const char *key, char *str, const int size)
+{
+    const int len = flashKvGet(key, str, size - 1);
+    str[ len > 0 ? len : 0 ] = '\0';
+    return len > 0;
+}
+
+// the effect programs are too long for one value, they're stored in chunks ("fx0", "fx1", ...)
+#define CONFIG_FX_CHUNK (FLASH_KV_VAL_MAX / 2)
+
+static void sConfigLoadFx(void)
+{
+    char str[(CONFIG_FX_MAX * 2) + 1];
+    int len = 0;
+    for (int chunk = 0; (chunk * CONFIG_FX_CHUNK) < CONFIG_FX_MAX; chunk++)
+    {
+        char key[4] = { 'f', 'x', '0' + chunk, '\0' };
+        if (!sConfigLoadStr(key, &str[len], sizeof(str) - len))
+        {
+            break;
+        }
+        len += strlen(&str[len]);
+    }
+    str[len] = '\0';
+    sConfigFxLen = sConfigStrToFx(str, sConfigFx);
+}
+
+static void sConfigLoad(void)
+{
+    char str[FLASH_KV_VAL_MAX + 1];
+    if (sConfigLoadStr("model",  str, sizeof(str))) { sConfigModel  = sConfigStrToModel(str); }
+    if (sConfigLoadStr("driver", str, sizeof(str))) { sConfigDriver = sConfigStrToDriver(str); }
+    if (sConfigLoadStr("order",  str, sizeof(str))) { sConfigOrder  = sConfigStrToOrder(str); }
+    if (sConfigLoadStr("bright", str, sizeof(str))) { sConfigBright = sConfigStrToBright(str); }
+    if (sConfigLoadStr("noise",  str, sizeof(str))) { sConfigNoise  = sConfigStrToNoise(str); }
+    if (sConfigLoadStr("fps",    str, sizeof(str))) { sConfigFps    = sConfigIntToFps(atoi(str)); }
+    if (sConfigLoadStr("spiclk", str, sizeof(str))) { sConfigSpiClk = sConfigIntToSpiClk(atoi(str)); }
+    if (sConfigLoadStr("dither", str, sizeof(str))) { sConfigDither = sConfigStrToDither(str); }
+    if (sConfigLoadStr("leds",   str, sizeof(str))) { sConfigLeds   = sConfigIntToLeds(atoi(str)); }
+    if (sConfigLoadStr("chleds", str, sizeof(str))) { sConfigChLeds = sConfigIntToChLeds(atoi(str)); }
+    if (sConfigLoadStr("power",  str, sizeof(str))) { sConfigPower  = sConfigStrToPower(str); }
+    if (sConfigLoadStr("relay",  str, sizeof(str))) { sConfigRelay  = sConfigStrToRelay(str); }
+    if (sConfigLoadStr("quiet",  str, sizeof(str))) { sConfigStrToQuiet(str, &sConfigQuietFrom, &sConfigQuietTo); }
+    if (sConfigLoadStr("tzoffs", str, sizeof(str))) { sConfigTzOffs = sConfigIntToTzOffs(atoi(str)); }
+    sConfigLoadFx();
+
+    // all or nothing
+    if ( (sConfigModel != CONFIG_MODEL_UNKNOWN)   &&
+         (sConfigDriver != CONFIG_DRIVER_UNKNOWN) &&
+         (sConfigOrder != CONFIG_ORDER_UNKNOWN)   &&
+         (sConfigBright != CONFIG_BRIGHT_UNKNOWN) &&
+         (sConfigNoise != CONFIG_NOISE_UNKNOWN) )
+    {
+        PRINT("config: loaded from flash");
+        configMonStatus();
+    }
+    else
+    {
+        DEBUG("config: nothing in flash");
+        sConfigDefaults();
+    }
+}
+
+static void sConfigStoreStr(const char *key, const char *str)
+{
+    flashKvSet(key, str, strlen(str));
+}
+
+static void sConfigStoreInt(const char *key, const int val)
+{
+    char str[12];
+    snprintf(str, sizeof(str), "%d", val);
+    sConfigStoreStr(key, str);
+}
+
+// store current config (the key-value store only writes changed values)
+static void sConfigStore(void)
+{
+    sConfigStoreStr("model",  skConfigModelStrs[sConfigModel]);
+    sConfigStoreStr("driver", skConfigDriverStrs[sConfigDriver]);
+    sConfigStoreStr("order",  skConfigOrderStrs[sConfigOrder]);
+    sConfigStoreStr("bright", skConfigBrightStrs[sConfigBright]);
+    sConfigStoreStr("noise",  skConfigNoiseStrs[sConfigNoise]);
+    sConfigStoreInt("fps",    sConfigFps);
+    sConfigStoreInt("spiclk", sConfigSpiClk);
+    sConfigStoreStr("dither", sConfigDither ? "on" : "off");
+    sConfigStoreInt("leds",   sConfigLeds);
+    sConfigStoreInt("chleds", sConfigChLeds);
+    sConfigStoreStr("power",  skConfigPowerStrs[sConfigPower]);
+    sConfigStoreStr("relay",  sConfigRelay ? "on" : "off");
+    char quiet[8];
+    snprintf(quiet, sizeof(quiet), "%d-%d", sConfigQuietFrom, sConfigQuietTo);
+    sConfigStoreStr("quiet",  quiet);
+    sConfigStoreInt("tzoffs", sConfigTzOffs);
+    for (int chunk = 0; (chunk * CONFIG_FX_CHUNK) < CONFIG_FX_MAX; chunk++)
+    {
+        char key[4] = { 'f', 'x', '0' + chunk, '\0' };
+        char str[FLASH_KV_VAL_MAX + 1] = { 0 };
+        for (int ix = chunk * CONFIG_FX_CHUNK, n = 0; (ix < sConfigFxLen) && (n < CONFIG_FX_CHUNK); ix++, n++)
+        {
+            snprintf(&str[n * 2], 3, "%02x", sConfigFx[ix]);
+        }
+        sConfigStoreStr(key, str);
+    }
+}
+
+
+/* ***** backend config ************************************************************************** */
+
+// number of config keys (including the "name", which the backend sends, too), and the JSON tokens we need
+// for them (and some slack for unknown keys)
+#define CONFIG_JSON_KEYS   16
+#define CONFIG_JSON_TOKENS ((CONFIG_JSON_KEYS * 2) + 10)
+#if (CONFIG_JSON_TOKENS > FF_JSON_TOKENS)
+#  error FF_JSON_TOKENS is too small for the config
+#endif
+
 bool configParseJson(char *resp, const int respLen)
 {
     DEBUG("config: [%d] %s", respLen, resp);
 
-    const int maxTokens = (4 * 2) + 10;
-    jsmntok_t *pTokens = jsmnAllocTokens(maxTokens);
+    const int maxTokens = CONFIG_JSON_TOKENS;
+    jsmntok_t *pTokens = jsmnTakeTokens(maxTokens);
     if (pTokens == NULL)
     {
-        ERROR("config: json malloc fail");
+        ERROR("config: json tokens fail");
         return false;
     }
 
@@ -172,35 +476,40 @@ bool configParseJson(char *resp, const int respLen)
     // look for config key value pairs
     if (okay)
     {
-        CONFIG_MODEL_t  configModel  = CONFIG_MODEL_UNKNOWN;
-        CONFIG_DRIVER_t configDriver = CONFIG_DRIVER_UNKNOWN;;
-        CONFIG_ORDER_t  configOrder  = CONFIG_ORDER_UNKNOWN;
-        CONFIG_BRIGHT_t configBright = CONFIG_BRIGHT_UNKNOWN;
-        CONFIG_NOISE_t  configNoise  = CONFIG_NOISE_UNKNOWN;
+        const CONFIG_MODEL_t  configModel  = JSMN_GETENUM_K(resp, pTokens, numTokens, 0, "model",  &sConfigModelTab,  CONFIG_MODEL_UNKNOWN);
+        const CONFIG_DRIVER_t configDriver = JSMN_GETENUM_K(resp, pTokens, numTokens, 0, "driver", &sConfigDriverTab, CONFIG_DRIVER_UNKNOWN);
+        const CONFIG_ORDER_t  configOrder  = JSMN_GETENUM_K(resp, pTokens, numTokens, 0, "order",  &sConfigOrderTab,  CONFIG_ORDER_UNKNOWN);
+        const CONFIG_BRIGHT_t configBright = JSMN_GETENUM_K(resp, pTokens, numTokens, 0, "bright", &sConfigBrightTab, CONFIG_BRIGHT_UNKNOWN);
+        const CONFIG_NOISE_t  configNoise  = JSMN_GETENUM_K(resp, pTokens, numTokens, 0, "noise",  &sConfigNoiseTab,  CONFIG_NOISE_UNKNOWN);
+        int             configFps    = 0;                  // optional
+        int             configSpiClk = 0;                  // optional
+        bool            configDither = false;              // optional
+        int             configLeds   = 0;                  // optional
+        int             configChLeds = 0;                  // optional
+        CONFIG_POWER_t  configPower  = CONFIG_POWER_MODEM; // optional
+        bool            configRelay  = false;              // optional
+        int             configQuietFrom = 0;               // optional
+        int             configQuietTo   = 0;               // optional
+        int             configTzOffs    = 0;               // optional
+        uint8_t         configFx[CONFIG_FX_MAX];           // optional
+        int             configFxLen     = 0;
+        const char     *val;
 
-        for (int ix = 0; ix < (numTokens - 1); ix++)
-        {
-            const jsmntok_t *pkTok = &pTokens[ix];
-
-            // top-level key
-            if (pkTok->parent == 0)
-            {
-                resp[ pkTok->end ] = '\0';
-                const char *key = &resp[ pkTok->start ];
-                const jsmntok_t *pkNext = &pTokens[ix + 1];
-                if ( (pkNext->parent == ix) && (pkNext->type == JSMN_STRING) )
-                {
-                    resp[ pkNext->end ] = '\0';
-                    const char *val = &resp[ pkNext->start ];
-                    //DEBUG("config: %s=%s", key, val);
-                    if      (strcmp("model",  key) == 0) { configModel  = sConfigStrToModel(val); }
-                    else if (strcmp("driver", key) == 0) { configDriver = sConfigStrToDriver(val); }
-                    else if (strcmp("order",  key) == 0) { configOrder  = sConfigStrToOrder(val); }
-                    else if (strcmp("bright", key) == 0) { configBright = sConfigStrToBright(val); }
-                    else if (strcmp("noise",  key) == 0) { configNoise  = sConfigStrToNoise(val); }
-                }
-            }
-        }
+        JSMN_GETINT_K(resp, pTokens, numTokens, 0, "fps",    &configFps);
+        JSMN_GETINT_K(resp, pTokens, numTokens, 0, "spiclk", &configSpiClk);
+        JSMN_GETINT_K(resp, pTokens, numTokens, 0, "leds",   &configLeds);
+        JSMN_GETINT_K(resp, pTokens, numTokens, 0, "chleds", &configChLeds);
+        JSMN_GETINT_K(resp, pTokens, numTokens, 0, "tzoffs", &configTzOffs);
+        configFps    = sConfigIntToFps(configFps);
+        configSpiClk = sConfigIntToSpiClk(configSpiClk);
+        configLeds   = sConfigIntToLeds(configLeds);
+        configChLeds = sConfigIntToChLeds(configChLeds);
+        configTzOffs = sConfigIntToTzOffs(configTzOffs);
+        if ((val = JSMN_GETSTR_K(resp, pTokens, numTokens, 0, "dither")) != NULL) { configDither = sConfigStrToDither(val); }
+        if ((val = JSMN_GETSTR_K(resp, pTokens, numTokens, 0, "power"))  != NULL) { configPower  = sConfigStrToPower(val); }
+        if ((val = JSMN_GETSTR_K(resp, pTokens, numTokens, 0, "relay"))  != NULL) { configRelay  = sConfigStrToRelay(val); }
+        if ((val = JSMN_GETSTR_K(resp, pTokens, numTokens, 0, "quiet"))  != NULL) { sConfigStrToQuiet(val, &configQuietFrom, &configQuietTo); }
+        if ((val = JSMN_GETSTR_K(resp, pTokens, numTokens, 0, "fx"))     != NULL) { configFxLen = sConfigStrToFx(val, configFx); }
 
         if ( (configModel != CONFIG_MODEL_UNKNOWN)   &&
              (configDriver != CONFIG_DRIVER_UNKNOWN) &&
@@ -208,13 +517,42 @@ bool configParseJson(char *resp, const int respLen)
              (configBright != CONFIG_BRIGHT_UNKNOWN)   &&
              (configNoise != CONFIG_NOISE_UNKNOWN) )
         {
+            bool changed;
             CS_ENTER;
+            changed =
+                (sConfigModel  != configModel)  || (sConfigDriver != configDriver) || (sConfigOrder  != configOrder)  ||
+                (sConfigBright != configBright) || (sConfigNoise  != configNoise)  || (sConfigFps    != configFps)    ||
+                (sConfigSpiClk != configSpiClk) || (sConfigDither != configDither) || (sConfigLeds   != configLeds)   ||
+                (sConfigChLeds != configChLeds) || (sConfigPower  != configPower)  || (sConfigRelay  != configRelay)  ||
+                (sConfigQuietFrom != configQuietFrom) || (sConfigQuietTo != configQuietTo) || (sConfigTzOffs != configTzOffs) ||
+                (sConfigFxLen != configFxLen) || (memcmp(sConfigFx, configFx, configFxLen) != 0);
             sConfigModel  = configModel;
             sConfigDriver = configDriver;
             sConfigOrder  = configOrder;
             sConfigBright = configBright;
             sConfigNoise  = configNoise;
+            sConfigFps    = configFps;
+            sConfigSpiClk = configSpiClk;
+            sConfigDither = configDither;
+            sConfigLeds   = configLeds;
+            sConfigChLeds = configChLeds;
+            sConfigPower  = configPower;
+            sConfigRelay  = configRelay;
+            sConfigQuietFrom = configQuietFrom;
+            sConfigQuietTo   = configQuietTo;
+            sConfigTzOffs    = configTzOffs;
+            sConfigFxLen     = configFxLen;
+            memcpy(sConfigFx, configFx, configFxLen);
+            if (changed)
+            {
+                svConfigVersion++;
+            }
             CS_LEAVE;
+            if (changed)
+            {
+                sConfigStore();
+                sConfigNotify();
+            }
         }
         else
         {
@@ -224,7 +562,7 @@ bool configParseJson(char *resp, const int respLen)
     }
 
     // cleanup
-    free(pTokens);
+    jsmnGiveTokens(pTokens);
 
     return okay;
 }
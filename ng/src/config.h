@@ -31,7 +31,7 @@ typedef enum CONFIG_DRIVER_e
 {
     CONFIG_DRIVER_UNKNOWN,
     CONFIG_DRIVER_WS2801,
-    //CONFIG_DRIVER_WS2812,
+    CONFIG_DRIVER_WS2812,
     CONFIG_DRIVER_SK9822,
 } CONFIG_DRIVER_t;
 
@@ -64,11 +64,87 @@ typedef enum CONFIG_NOISE_e
     CONFIG_NOISE_MOST,
 } CONFIG_NOISE_t;
 
+//! wifi power saving (the "power" config is optional, modem sleep by default)
+typedef enum CONFIG_POWER_e
+{
+    CONFIG_POWER_UNKNOWN,
+    CONFIG_POWER_NONE,   //!< radio always on
+    CONFIG_POWER_MODEM,  //!< modem sleep: radio off between DTIM beacons, CPU keeps running
+    CONFIG_POWER_LIGHT,  //!< light sleep: like modem sleep, and the CPU is suspended when idle
+} CONFIG_POWER_t;
+
+//! LED frame rate limits and default [Hz] (the "fps" config is optional)
+#define CONFIG_FPS_MIN      10
+#define CONFIG_FPS_MAX     100
+#define CONFIG_FPS_DEFAULT 100
+
+//! maximum SPI clock for the LED drivers [MHz] (the "spiclk" config is optional, 0 = driver default)
+#define CONFIG_SPICLK_MAX   20
+
+//! LED temporal dithering is off by default (the "dither" config is optional, "on" or "off"), with
+//! dithering the LEDs are rendered at the full frame rate all the time
+
+//! sharing the backend connection with other devices is off by default (the "relay" config is optional,
+//! "on" or "off", see relay.h)
+
+//! maximum number of LEDs on the strip (the "leds" and "chleds" configs are optional)
+#define CONFIG_LEDS_MAX    150
+
+//! quiet hours (the "quiet" config is optional, "<from>-<to>" local hours, e.g. "22-7", from == to is off),
+//! with the local time offset from UTC [min] (the "tzoffs" config, which the backend adds)
+#define CONFIG_TZOFFS_MAX  (14 * 60)
+
+//! maximum size of the LED effect programs [bytes] (the "fx" config is optional, a hex string, see leds.h)
+#define CONFIG_FX_MAX       96
+
 CONFIG_MODEL_t  configGetModel(void);
 CONFIG_DRIVER_t configGetDriver(void);
 CONFIG_ORDER_t  configGetOrder(void);
 CONFIG_BRIGHT_t configGetBright(void);
 CONFIG_NOISE_t  configGetNoise(void);
+int             configGetFps(void);
+int             configGetSpiClk(void);
+bool            configGetDither(void);
+int             configGetLeds(void);
+int             configGetChLeds(void);
+CONFIG_POWER_t  configGetPower(void);
+bool            configGetRelay(void);
+int             configGetQuietFrom(void);
+int             configGetQuietTo(void);
+int             configGetTzOffs(void);
+
+//! get LED effect programs
+/*!
+    \param[out] buf   buffer for the programs (#CONFIG_FX_MAX bytes)
+
+    \returns the size of the programs [bytes], 0 if there are none
+*/
+int configGetFx(uint8_t *buf);
+
+//! stringify power config
+const char *configPowerStr(const CONFIG_POWER_t power);
+
+//! config version, which changes whenever the config changes
+/*!
+    Consumers that derive things from the config (lookup tables and such) can compare this to the
+    version they last used instead of comparing all the values. Re-read the version after reading
+    the values to be sure that they belong together (the config may change while reading them).
+*/
+uint32_t configGetVersion(void);
+
+//! maximum number of config change subscribers
+#define CONFIG_MAX_SUBS 4
+
+//! get notified when the config changes
+/*!
+    The task gets a task notification (xTaskNotifyGive()) whenever the config changes, so that it
+    can wake up from ulTaskNotifyTake() and check configGetVersion().
+
+    \param[in] task  the task to notify
+
+    \returns true if subscribed, false if there are too many subscribers already
+*/
+bool configSubscribe(TaskHandle_t task);
 
 bool configParseJson(char *resp, const int respLen);
 
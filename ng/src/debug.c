@@ -8,6 +8,7 @@
 
 #include "stdinc.h"
 
+#include <stdarg.h>
 #include <stdout_redirect.h>
 #include <user_exception.h>
 #include <esp/uart.h>
@@ -15,6 +16,7 @@
 
 #include "stuff.h"
 #include "mon.h"
+#include "stacks.h"
 #include "debug.h"
 
 #define UART_NUM 0
@@ -37,6 +39,10 @@ void debugLock(void)
 {
 }
 
+void debugLockBlocking(void)
+{
+}
+
 void debugUnlock(void)
 {
 }
@@ -45,49 +51,91 @@ void debugUnlock(void)
 #else // (TXBUF_SIZE <= 0)
 // non-blocking, buffered
 
-static volatile char     svDebugBuf[TXBUF_SIZE];       // debug buffer
-static volatile uint16_t svDebugBufHead;               // write-to-buffer pointer (index)
-static volatile uint16_t svDebugBufTail;               // read-from-buffer pointer (index)
-static volatile uint16_t svDebugBufSize;               // size of buffered data
+#if ((TXBUF_SIZE & (TXBUF_SIZE - 1)) != 0)
+#  error TXBUF_SIZE must be a power of two
+#endif
+#define TXBUF_MASK (TXBUF_SIZE - 1)
+
+// the output data is copied into the buffer by the tasks (one at a time, with the scheduler suspended but
+// with interrupts enabled) and drained by the UART ISR, head and tail are free-running indices (the used
+// size is head - tail), the tasks write only the head and the ISR writes only the tail
+static char              sDebugBuf[TXBUF_SIZE];        // debug buffer
+static volatile uint32_t svDebugBufHead;               // write-to-buffer pointer (free-running index)
+static volatile uint32_t svDebugBufTail;               // read-from-buffer pointer (free-running index)
 static volatile uint16_t svDebugBufPeak;               // peak output buffer size
 static volatile uint16_t svDebugBufDrop;               // number of dropped bytes
+static volatile uint16_t svDebugBufWait;               // number of waits for space in the buffer
+static volatile bool     svDebugBlocking;              // wait for space in the buffer (see debugLockBlocking())
+
+#define DEBUG_WAIT_MS     10 // wait time for space in the buffer
+#define DEBUG_WAIT_MAX   100 // maximum wait time per write
+
+#define DEBUG_BARRIER() __asm__ __volatile__ ("" ::: "memory")
 
 // add stdio output data to buffer
 static ssize_t sWriteStdoutFunc(struct _reent *r, int fd, const void *ptr, size_t len)
 {
-    CS_ENTER;
-
     const char *pkBuf = (const char *)ptr;
-    for (int i = 0; i < len; i++)
+    size_t remaining = len;
+    int waited = 0;
+    // we can only sleep if the scheduler is running, not before it was started nor when the caller has
+    // suspended it (must check before we suspend it ourselves below)
+    const bool canSleep = xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+    while (true)
     {
+        vTaskSuspendAll();
 
-        // add to ring buffer if there's space
-        if ( (svDebugBufSize == 0) || (svDebugBufHead != svDebugBufTail) )
+        // copy as much as fits, in (at most) two segments
+        const uint32_t head = svDebugBufHead;
+        const uint32_t used = head - svDebugBufTail;
+        const size_t n = MIN(remaining, TXBUF_SIZE - used);
+        if (n > 0)
         {
-            svDebugBuf[svDebugBufHead] = *pkBuf;
-            svDebugBufHead += 1;
-            svDebugBufHead %= sizeof(svDebugBuf);
-            svDebugBufSize++;
+            const uint32_t offs = head & TXBUF_MASK;
+            const size_t n1 = MIN(n, TXBUF_SIZE - offs);
+            memcpy(&sDebugBuf[offs], pkBuf, n1);
+            if (n > n1)
+            {
+                memcpy(&sDebugBuf[0], &pkBuf[n1], n - n1);
+            }
+            pkBuf += n;
+            remaining -= n;
+            // publish the data to the ISR
+            DEBUG_BARRIER();
+            svDebugBufHead = head + n;
             // keep statistics on the buffer size
-            if (svDebugBufSize > svDebugBufPeak)
+            if ((used + n) > svDebugBufPeak)
             {
-                svDebugBufPeak = svDebugBufSize;
+                svDebugBufPeak = used + n;
             }
         }
-        // drop char otherwise
-        else
+
+        // all done, or drop the rest unless we can wait for the ISR to make space
+        const bool wait = (remaining > 0) && svDebugBlocking && (waited < DEBUG_WAIT_MAX) && canSleep;
+        if (!wait)
         {
             // FIXME: put "\nE: tx buf\n" into buffer
-            svDebugBufDrop++;
+            svDebugBufDrop += remaining;
+        }
+        else
+        {
+            svDebugBufWait++;
         }
 
-        pkBuf++;
-    }
+        xTaskResumeAll();
 
-    CS_LEAVE;
+        // enable tx fifo empty interrupt
+        CS_ENTER;
+        UART(UART_NUM).INT_ENABLE |= UART_INT_ENABLE_TXFIFO_EMPTY;
+        CS_LEAVE;
 
-    // enable tx fifo empty interrupt
-    UART(UART_NUM).INT_ENABLE |= UART_INT_ENABLE_TXFIFO_EMPTY;
+        if (!wait)
+        {
+            break;
+        }
+        osSleep(DEBUG_WAIT_MS);
+        waited += DEBUG_WAIT_MS;
+    }
 
     return len;
 }
@@ -97,7 +145,7 @@ static ssize_t sWriteStdoutFunc(struct _reent *r, int fd, const void *ptr, size_
 // flushs buffered debug data to the tx fifo
 IRAM static void sUartISR(void *pArg) // RAM function
 {
-    monIsrEnter();
+    const uint32_t t0 = monIsrEnter();
 
     //UNUSED(pArg);
 
@@ -108,19 +156,20 @@ IRAM static void sUartISR(void *pArg) // RAM function
         UART(UART_NUM).INT_ENABLE &= ~UART_INT_ENABLE_TXFIFO_EMPTY;
 
         // write more data to the UART tx FIFO
-        uint8_t fifoRemaining = (UART_FIFO_MAX + 1) - FIELD2VAL(UART_STATUS_TXFIFO_COUNT, UART(UART_NUM).STATUS);
-        while (svDebugBufSize && fifoRemaining--)
+        const uint32_t head = svDebugBufHead;
+        uint32_t tail = svDebugBufTail;
+        const uint32_t fifoRemaining = (UART_FIFO_MAX + 1) - FIELD2VAL(UART_STATUS_TXFIFO_COUNT, UART(UART_NUM).STATUS);
+        const uint32_t n = MIN(head - tail, fifoRemaining);
+        DEBUG_BARRIER();
+        for (uint32_t i = 0; i < n; i++)
         {
-            const char c = svDebugBuf[svDebugBufTail];
-            svDebugBufTail += 1;
-            svDebugBufTail %= sizeof(svDebugBuf);
-            svDebugBufSize--;
-            UART(UART_NUM).FIFO = (c & UART_FIFO_DATA_M) << UART_FIFO_DATA_S;
-            //UART(UART_NUM).FIFO = SET_FIELD_M(UART(UART_NUM).FIFO, UART_FIFO_DATA, c);
+            UART(UART_NUM).FIFO = (sDebugBuf[tail & TXBUF_MASK] & UART_FIFO_DATA_M) << UART_FIFO_DATA_S;
+            tail++;
         }
+        svDebugBufTail = tail;
 
         // there's more data to fill to the FIFO once it's empty
-        if (svDebugBufSize)
+        if (head != tail)
         {
             UART(UART_NUM).INT_ENABLE |= UART_INT_ENABLE_TXFIFO_EMPTY;
         }
@@ -130,7 +179,7 @@ IRAM static void sUartISR(void *pArg) // RAM function
     }
     // else if (...) // handle other sources of this interrupt
 
-    monIsrLeave();
+    monIsrLeave(MON_ISR_UART, t0);
 }
 
 static SemaphoreHandle_t sDebugMutex;
@@ -140,8 +189,15 @@ __INLINE void debugLock(void)
     xSemaphoreTake(sDebugMutex, portMAX_DELAY);
 }
 
+__INLINE void debugLockBlocking(void)
+{
+    xSemaphoreTake(sDebugMutex, portMAX_DELAY);
+    svDebugBlocking = true;
+}
+
 __INLINE void debugUnlock(void)
 {
+    svDebugBlocking = false;
     xSemaphoreGive(sDebugMutex);
 }
 
@@ -149,27 +205,257 @@ __INLINE void debugUnlock(void)
 #endif // (TXBUF_SIZE <= 0)
 
 
+/* ***** deferred formatting ********************************************************************* */
+
+#if (defined FF_DEBUG_DEFER && FF_DEBUG_DEFER > 0)
+
+#define DEFER_NUM_REC   32
+#define DEFER_NUM_ARGS   8
+#define DEFER_STR_SIZE  24
+
+// a deferred message, the strings are copied and the corresponding args[] are offsets into strs[]
+typedef struct DEFER_REC_s
+{
+    const char *fmt;                    // the format (a literal, see DEBUG())
+    uint8_t     nArgs;                  // number of arguments
+    uint8_t     strMask;                // which arguments are strings
+    uint16_t    strLen;                 // used size of strs[]
+    uint32_t    args[DEFER_NUM_ARGS];   // the arguments (int, unsigned, char, pointer)
+    char        strs[DEFER_STR_SIZE];   // the strings (nul-terminated)
+} DEFER_REC_t;
+
+static DEFER_REC_t       sDeferRecs[DEFER_NUM_REC];
+static volatile uint16_t svDeferHead;                  // write-to-queue pointer (index)
+static volatile uint16_t svDeferTail;                  // read-from-queue pointer (index)
+static volatile uint16_t svDeferSize;                  // number of queued messages
+static volatile uint16_t svDeferPeak;                  // peak number of queued messages
+static volatile uint16_t svDeferDrop;                  // number of dropped messages
+static volatile uint16_t svDeferNow;                   // number of messages printed immediately
+static TaskHandle_t      sDeferTaskHandle;
+
+// collect the arguments for the format, fails for what we cannot (or don't want to) defer
+static bool sDebugDeferPack(DEFER_REC_t *pRec, const char *fmt, va_list ap)
+{
+    pRec->fmt = fmt;
+    const char *pkFmt = fmt;
+    while (*pkFmt != '\0')
+    {
+        if (*pkFmt++ != '%')
+        {
+            continue;
+        }
+        if (*pkFmt == '%')
+        {
+            pkFmt++;
+            continue;
+        }
+
+        // flags, width and precision
+        while ( (*pkFmt != '\0') && (strchr("-+ #0123456789.*", *pkFmt) != NULL) )
+        {
+            if (*pkFmt == '*')
+            {
+                if (pRec->nArgs >= NUMOF(pRec->args))
+                {
+                    return false;
+                }
+                pRec->args[pRec->nArgs++] = (uint32_t)va_arg(ap, int);
+            }
+            pkFmt++;
+        }
+
+        // length modifiers, h, l, z and t are (at most) 32 bits here, ll, j, q and L are not
+        while ( (*pkFmt != '\0') && (strchr("hlztjqL", *pkFmt) != NULL) )
+        {
+            if ( (strchr("jqL", *pkFmt) != NULL) || ((pkFmt[0] == 'l') && (pkFmt[1] == 'l')) )
+            {
+                return false;
+            }
+            pkFmt++;
+        }
+
+        if (pRec->nArgs >= NUMOF(pRec->args))
+        {
+            return false;
+        }
+        switch (*pkFmt++)
+        {
+            case 'd': case 'i': case 'c':
+                pRec->args[pRec->nArgs++] = (uint32_t)va_arg(ap, int);
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                pRec->args[pRec->nArgs++] = va_arg(ap, unsigned int);
+                break;
+            case 'p':
+                pRec->args[pRec->nArgs++] = (uint32_t)(uintptr_t)va_arg(ap, void *);
+                break;
+            case 's':
+            {
+                const char *str = va_arg(ap, const char *);
+                if (str == NULL)
+                {
+                    str = "(null)";
+                }
+                const int len = strlen(str) + 1;
+                if ((pRec->strLen + len) > (int)sizeof(pRec->strs))
+                {
+                    return false;
+                }
+                memcpy(&pRec->strs[pRec->strLen], str, len);
+                pRec->strMask |= BIT(pRec->nArgs);
+                pRec->args[pRec->nArgs++] = pRec->strLen;
+                pRec->strLen += len;
+                break;
+            }
+            // floats, %n, malformed formats, ...
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+void debugDefer(const char *fmt, ...)
+{
+    DEFER_REC_t rec = { .nArgs = 0, .strMask = 0, .strLen = 0 };
+    va_list ap;
+    va_start(ap, fmt);
+    const bool deferOk = sDebugDeferPack(&rec, fmt, ap);
+    va_end(ap);
+
+    // cannot be deferred, print now
+    if (!deferOk)
+    {
+        va_start(ap, fmt);
+        debugLock();
+        vprintf(fmt, ap);
+        debugUnlock();
+        va_end(ap);
+        CS_ENTER;
+        svDeferNow++;
+        CS_LEAVE;
+        return;
+    }
+
+    // queue it (if there's space)
+    bool queued = false;
+    CS_ENTER;
+    if (svDeferSize < NUMOF(sDeferRecs))
+    {
+        sDeferRecs[svDeferHead] = rec;
+        svDeferHead += 1;
+        svDeferHead %= NUMOF(sDeferRecs);
+        svDeferSize++;
+        if (svDeferSize > svDeferPeak)
+        {
+            svDeferPeak = svDeferSize;
+        }
+        queued = true;
+    }
+    else
+    {
+        svDeferDrop++;
+    }
+    CS_LEAVE;
+
+    if (queued && (sDeferTaskHandle != NULL))
+    {
+        xTaskNotifyGive(sDeferTaskHandle);
+    }
+}
+
+static void sDebugDeferFormat(const DEFER_REC_t *pkRec)
+{
+    uint32_t args[DEFER_NUM_ARGS] = { 0 };
+    for (int ix = 0; ix < pkRec->nArgs; ix++)
+    {
+        args[ix] = (pkRec->strMask & BIT(ix)) != 0 ?
+            (uint32_t)(uintptr_t)&pkRec->strs[pkRec->args[ix]] : pkRec->args[ix];
+    }
+    // excess arguments are ignored by printf()
+    printf(pkRec->fmt, args[0], args[1], args[2], args[3], args[4], args[5], args[6], args[7]);
+}
+
+static bool sDebugDeferGet(DEFER_REC_t *pRec)
+{
+    bool res = false;
+    CS_ENTER;
+    if (svDeferSize > 0)
+    {
+        *pRec = sDeferRecs[svDeferTail];
+        svDeferTail += 1;
+        svDeferTail %= NUMOF(sDeferRecs);
+        svDeferSize--;
+        res = true;
+    }
+    CS_LEAVE;
+    return res;
+}
+
+// format the queued messages
+static void sDebugDeferTask(void *pArg)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        DEFER_REC_t rec;
+        while (sDebugDeferGet(&rec))
+        {
+            debugLock();
+            sDebugDeferFormat(&rec);
+            debugUnlock();
+        }
+    }
+}
+
+#endif // (FF_DEBUG_DEFER > 0)
+
+
 void debugMonStatus(void)
 {
 #if (TXBUF_SIZE > 0)
-    uint16_t size, peak, drop;
+    uint16_t size, peak, drop, wait;
     CS_ENTER;
-    size = svDebugBufSize;
+    size = svDebugBufHead - svDebugBufTail;
     peak = svDebugBufPeak;
     drop = svDebugBufDrop;
+    wait = svDebugBufWait;
     svDebugBufPeak = 0;
     svDebugBufDrop = 0;
+    svDebugBufWait = 0;
     CS_LEAVE;
-    uint16_t percPeak = ((peak * 8 * 100 / sizeof(svDebugBuf)) + 4) >> 3;
+    uint16_t percPeak = ((peak * 8 * 100 / sizeof(sDebugBuf)) + 4) >> 3;
     if (drop)
     {
-        WARNING("mon: debug: size=%u/%u peak=%u (%u%%) drop=%u",
-            size, sizeof(svDebugBuf), peak, percPeak, drop);
+        WARNING("mon: debug: size=%u/%u peak=%u (%u%%) drop=%u wait=%u",
+            size, sizeof(sDebugBuf), peak, percPeak, drop, wait);
     }
     else
     {
-        DEBUG("mon: debug: size=%u/%u peak=%u (%u%%) drop=%u",
-            size, sizeof(svDebugBuf), peak, percPeak, drop);
+        DEBUG("mon: debug: size=%u/%u peak=%u (%u%%) drop=%u wait=%u",
+            size, sizeof(sDebugBuf), peak, percPeak, drop, wait);
+    }
+#endif
+#if (defined FF_DEBUG_DEFER && FF_DEBUG_DEFER > 0)
+    uint16_t dSize, dPeak, dDrop, dNow;
+    CS_ENTER;
+    dSize = svDeferSize;
+    dPeak = svDeferPeak;
+    dDrop = svDeferDrop;
+    dNow  = svDeferNow;
+    svDeferPeak = 0;
+    svDeferDrop = 0;
+    svDeferNow  = 0;
+    CS_LEAVE;
+    if (dDrop)
+    {
+        WARNING("mon: debug: defer=%u/%u peak=%u drop=%u now=%u",
+            dSize, NUMOF(sDeferRecs), dPeak, dDrop, dNow);
+    }
+    else
+    {
+        DEBUG("mon: debug: defer=%u/%u peak=%u drop=%u now=%u",
+            dSize, NUMOF(sDeferRecs), dPeak, dDrop, dNow);
     }
 #endif
 }
@@ -181,17 +467,25 @@ void debugMonStatus(void)
 static void sDebugResetStdout(void)
 {
     // dump what's in the buffer
-    while (svDebugBufSize > 0)
+    while (svDebugBufTail != svDebugBufHead)
     {
-        const char c = svDebugBuf[svDebugBufTail];
-        svDebugBufTail += 1;
-        svDebugBufTail %= sizeof(svDebugBuf);
-        svDebugBufSize--;
-        uart_putc(0, c);
+        uart_putc(0, sDebugBuf[svDebugBufTail & TXBUF_MASK]);
+        svDebugBufTail++;
     }
 
     // revert back to blocking direct-to-UART stdout
     set_write_stdout(NULL);
+
+#if (defined FF_DEBUG_DEFER && FF_DEBUG_DEFER > 0)
+    // and print the queued messages
+    while (svDeferSize > 0)
+    {
+        sDebugDeferFormat(&sDeferRecs[svDeferTail]);
+        svDeferTail += 1;
+        svDeferTail %= NUMOF(sDeferRecs);
+        svDeferSize--;
+    }
+#endif
 }
 
 void debugInit(void)
@@ -207,12 +501,19 @@ void debugInit(void)
     static StaticSemaphore_t sMutex;
     sDebugMutex = xSemaphoreCreateMutexStatic(&sMutex);
 
+#if (defined FF_DEBUG_DEFER && FF_DEBUG_DEFER > 0)
+    static StackType_t sDeferTaskStack[STACK_SIZE(DEBUG)];
+    static StaticTask_t sDeferTaskTCB;
+    sDeferTaskHandle = xTaskCreateStatic(sDebugDeferTask, "ff_debug", NUMOF(sDeferTaskStack), NULL, 1, sDeferTaskStack, &sDeferTaskTCB);
+    monRegisterStack("ff_debug", "DEBUG", NUMOF(sDeferTaskStack));
+#endif
+
 #if (TXBUF_SIZE > 0)
 
     // clear tx fifo
     uart_clear_txfifo(UART_NUM);
 
-    DEBUG("debug: init buf=%u fifo=%u", sizeof(svDebugBuf), UART_FIFO_MAX);
+    DEBUG("debug: init buf=%u fifo=%u", sizeof(sDebugBuf), UART_FIFO_MAX);
 
     set_write_stdout(sWriteStdoutFunc);
 
@@ -6,7 +6,8 @@
       https://oinkzwurgl.org/projaeggd/tschenggins-laempli
 
     This implements buffered and non-blocking debugging output (uses interrupts and the UART
-    hardware FIFO, drops output if the buffer is full).
+    hardware FIFO, drops output if the buffer is full). ERROR(), WARNING(), NOTICE() and PRINT() wait
+    (a bounded time) for space in the buffer, only DEBUG() output is dropped.
 
     \defgroup FF_DEBUG DEBUG
     \ingroup FF
@@ -26,20 +27,74 @@ void debugMonStatus(void);
 void debugLock(void);
 void debugUnlock(void);
 
+//! like debugLock(), and the output waits (up to 100ms) for space in the buffer instead of dropping it
+void debugLockBlocking(void);
+
+/*!
+    \name Log levels
+
+    The log level is a compile-time setting. Messages above the level are not compiled in (but their
+    arguments are still type-checked). The global level is #FF_DEBUG_LEVEL ("make ... DEBUGLEVEL=n"), a
+    module can override it by defining #DEBUG_LEVEL before including debug.h.
+
+    @{
+*/
+#define DEBUG_LEVEL_NONE    0  //!< no output
+#define DEBUG_LEVEL_ERROR   1  //!< only ERROR()
+#define DEBUG_LEVEL_WARNING 2  //!< ERROR() and WARNING()
+#define DEBUG_LEVEL_NOTICE  3  //!< ... and NOTICE()
+#define DEBUG_LEVEL_PRINT   4  //!< ... and PRINT()
+#define DEBUG_LEVEL_DEBUG   5  //!< everything
+
+#ifndef FF_DEBUG_LEVEL
+#  define FF_DEBUG_LEVEL DEBUG_LEVEL_DEBUG //!< global log level \hideinitializer
+#endif
+#ifndef DEBUG_LEVEL
+#  define DEBUG_LEVEL FF_DEBUG_LEVEL       //!< log level of the module \hideinitializer
+#endif
+//@}
+
+//! print a message (or not, depending on the level), PRINT() and above are not dropped \hideinitializer
+#define _DEBUG_PRINT(lvl, fmt, ...) do { if (DEBUG_LEVEL >= (lvl)) { \
+            if ((lvl) <= DEBUG_LEVEL_PRINT) { debugLockBlocking(); } else { debugLock(); } \
+            printf(fmt "\n", ## __VA_ARGS__); debugUnlock(); } } while (0)
+
 //! print an error message \hideinitializer
-#define ERROR(fmt, ...)   debugLock(); printf("E: " fmt "\n", ## __VA_ARGS__); debugUnlock()
+#define ERROR(fmt, ...)   _DEBUG_PRINT(DEBUG_LEVEL_ERROR,   "E: " fmt, ## __VA_ARGS__)
 
 //! print a warning message \hideinitializer
-#define WARNING(fmt, ...) debugLock(); printf("W: " fmt "\n", ## __VA_ARGS__); debugUnlock()
+#define WARNING(fmt, ...) _DEBUG_PRINT(DEBUG_LEVEL_WARNING, "W: " fmt, ## __VA_ARGS__)
 
 //! print a notice \hideinitializer
-#define NOTICE(fmt, ...)  debugLock(); printf("N: " fmt "\n", ## __VA_ARGS__); debugUnlock()
+#define NOTICE(fmt, ...)  _DEBUG_PRINT(DEBUG_LEVEL_NOTICE,  "N: " fmt, ## __VA_ARGS__)
 
 //! print a normal message \hideinitializer
-#define PRINT(fmt, ...)   debugLock(); printf("P: " fmt "\n", ## __VA_ARGS__); debugUnlock()
+#define PRINT(fmt, ...)   _DEBUG_PRINT(DEBUG_LEVEL_PRINT,   "P: " fmt, ## __VA_ARGS__)
+
+#if (defined FF_DEBUG_DEFER && FF_DEBUG_DEFER > 0) || defined __DOXYGEN__
+
+/*!
+    \brief queue a debug message for formatting in the background
+
+    Builds a record of the format pointer and the raw arguments (integers, pointers and copies of
+    strings), adds it to a queue (which takes only a short critical section) and leaves the formatting
+    to a low-priority task. Formats that cannot be deferred (floats, 64 bit integers, too many arguments
+    or too long strings) are printed immediately. See DEBUG().
+
+    \param[in] fmt  printf() style format string, must be a literal (it is kept by reference)
+*/
+void debugDefer(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+//! print a debug message (deferred formatting with "make ... DEBUGDEFER=1", see debugDefer()) \hideinitializer
+#  define DEBUG(fmt, ...)   do { if (DEBUG_LEVEL >= DEBUG_LEVEL_DEBUG) { \
+            debugDefer("D: " fmt "\n", ## __VA_ARGS__); } } while (0)
+
+#else
 
 //! print a debug message \hideinitializer
-#define DEBUG(fmt, ...)   debugLock(); printf("D: " fmt "\n", ## __VA_ARGS__); debugUnlock()
+#  define DEBUG(fmt, ...)   _DEBUG_PRINT(DEBUG_LEVEL_DEBUG, "D: " fmt, ## __VA_ARGS__)
+
+#endif
 
 //! hex dump data
 void HEXDUMP(const void *pkData, int size);
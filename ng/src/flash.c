@@ -0,0 +1,639 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: persistent storage in flash (see \ref FF_FLASH)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \addtogroup FF_FLASH
+
+    @{
+*/
+
+#include "stdinc.h"
+
+#include <espressif/spi_flash.h>
+
+#include "stuff.h"
+#include "debug.h"
+#include "flash.h"
+
+/* ***** CRC32 *********************************************************************************** */
+
+// CRC32 (reflected 0x04c11db7), nibble-wise, which needs a much smaller table than the usual byte-wise one
+static const uint32_t skFlashCrc32Tab[16] =
+{
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+uint32_t flashCrc32(uint32_t crc, const void *pData, const int size)
+{
+    const uint8_t *pkData = (const uint8_t *)pData;
+    crc = ~crc;
+    for (int ix = 0; ix < size; ix++)
+    {
+        crc = skFlashCrc32Tab[(crc ^  pkData[ix]      ) & 0x0f] ^ (crc >> 4);
+        crc = skFlashCrc32Tab[(crc ^ (pkData[ix] >> 4)) & 0x0f] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+
+/* ***** flash layout **************************************************************************** */
+
+// Our sectors are below the esp-open-rtos sysparam area (default 4 sectors), which is below the last
+// 4+1 sectors used by the SDK (RF calibration, wifi config, etc.):
+//
+//   ... | FLASH_NUM_SECTORS (ours) | sysparam (4) | SDK (5) | end of flash
+//
+#define FLASH_SYSPARAM_SECTORS 4
+#define FLASH_SDK_SECTORS      5
+
+// snapshot areas and the key-value store (offsets in sectors relative to our first sector, new areas go
+// below the existing ones so that these stay where they are)
+typedef struct FLASH_AREA_s
+{
+    const char *name;
+    uint16_t    sector;
+    uint16_t    numSectors;
+} FLASH_AREA_t;
+
+static const FLASH_AREA_t skFlashSnapAreas[] =
+{
+    [FLASH_SNAP_JENKINS] = { .name = "jenkins", .sector = 4, .numSectors = 2 },
+    [FLASH_SNAP_WIFI]    = { .name = "wifi",    .sector = 0, .numSectors = 2 },
+};
+
+static const FLASH_AREA_t skFlashKvArea = { .name = "kv", .sector = 2, .numSectors = 2 };
+
+#define FLASH_NUM_SECTORS 6
+
+static uint16_t sFlashBaseSector;
+
+uint32_t flashReservedAddr(void)
+{
+    return (uint32_t)sFlashBaseSector * SPI_FLASH_SEC_SIZE;
+}
+
+
+/* ***** snapshots ******************************************************************************* */
+
+// record header, followed by the data (padded to a multiple of 4 bytes)
+typedef struct FLASH_REC_s
+{
+    uint32_t magic;  // FLASH_REC_MAGIC
+    uint32_t seq;    // sequence number (> 0)
+    uint16_t size;   // size of data
+    uint16_t snap;   // FLASH_SNAP_t
+    uint32_t crc;    // CRC32 of seq, size, snap and the data
+} FLASH_REC_t;
+
+#define FLASH_REC_MAGIC    0x4c6d7066 // "fpmL"
+#define FLASH_ERASED       0xffffffff
+#define FLASH_ALIGN4(size) ( ((size) + 3) & ~3 )
+
+// state of the snapshot areas
+typedef struct FLASH_SNAP_STATE_s
+{
+    uint32_t seq;       // sequence number of latest record (0 = none)
+    uint32_t addr;      // address of latest record
+    uint32_t next;      // address for next record (0 = new sector needed)
+    uint32_t nWrites;   // number of writes since boot
+    uint32_t nErases;   // number of erases since boot
+} FLASH_SNAP_STATE_t;
+
+static FLASH_SNAP_STATE_t sFlashSnapStates[NUMOF(skFlashSnapAreas)];
+
+// read/write buffer (the flash functions want aligned buffers)
+static uint32_t sFlashBuf[ (sizeof(FLASH_REC_t) + FLASH_SNAP_MAX_SIZE) / sizeof(uint32_t) ];
+
+static SemaphoreHandle_t sFlashMutex;
+
+static uint32_t sFlashSectorAddr(const FLASH_AREA_t *pkArea, const int sectorIx)
+{
+    return (uint32_t)(sFlashBaseSector + pkArea->sector + sectorIx) * SPI_FLASH_SEC_SIZE;
+}
+
+static uint32_t sFlashRecCrc(const FLASH_REC_t *pkRec, const void *pkData)
+{
+    uint32_t crc = flashCrc32(0, &pkRec->seq, sizeof(pkRec->seq));
+    crc = flashCrc32(crc, &pkRec->size, sizeof(pkRec->size));
+    crc = flashCrc32(crc, &pkRec->snap, sizeof(pkRec->snap));
+    return flashCrc32(crc, pkData, pkRec->size);
+}
+
+// read and verify record into sFlashBuf (header only if !withData), returns true if valid
+static bool sFlashReadRec(const uint32_t addr, const FLASH_SNAP_t snap, const bool withData)
+{
+    FLASH_REC_t *pRec = (FLASH_REC_t *)sFlashBuf;
+    if (sdk_spi_flash_read(addr, sFlashBuf, sizeof(*pRec)) != SPI_FLASH_RESULT_OK)
+    {
+        return false;
+    }
+    if ( (pRec->magic != FLASH_REC_MAGIC) || (pRec->size > FLASH_SNAP_MAX_SIZE) || (pRec->snap != snap) )
+    {
+        return false;
+    }
+    if (withData)
+    {
+        if (sdk_spi_flash_read(addr + sizeof(*pRec), &sFlashBuf[sizeof(*pRec) / sizeof(uint32_t)],
+                FLASH_ALIGN4(pRec->size)) != SPI_FLASH_RESULT_OK)
+        {
+            return false;
+        }
+        if (pRec->crc != sFlashRecCrc(pRec, &pRec[1]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// find latest valid record and the place for the next record
+static void sFlashSnapScan(const FLASH_SNAP_t snap)
+{
+    const FLASH_AREA_t *pkArea = &skFlashSnapAreas[snap];
+    FLASH_SNAP_STATE_t *pState = &sFlashSnapStates[snap];
+    memset(pState, 0, sizeof(*pState));
+
+    for (int sectorIx = 0; sectorIx < pkArea->numSectors; sectorIx++)
+    {
+        const uint32_t start = sFlashSectorAddr(pkArea, sectorIx);
+        const uint32_t end = start + SPI_FLASH_SEC_SIZE;
+        uint32_t addr = start;
+        bool isLatest = false;
+        while ( (addr + sizeof(FLASH_REC_t)) <= end )
+        {
+            // stop at first invalid (or erased) header
+            if (!sFlashReadRec(addr, snap, false))
+            {
+                break;
+            }
+            const FLASH_REC_t *pkRec = (const FLASH_REC_t *)sFlashBuf;
+            const uint32_t seq = pkRec->seq;
+            const uint32_t recSize = sizeof(FLASH_REC_t) + FLASH_ALIGN4(pkRec->size);
+            if ( (seq > pState->seq) && sFlashReadRec(addr, snap, true) )
+            {
+                pState->seq = seq;
+                pState->addr = addr;
+                isLatest = true;
+            }
+            addr += recSize;
+        }
+
+        // appending to this sector is possible if it has the latest record and the rest is erased
+        if (isLatest)
+        {
+            uint32_t word = 0;
+            pState->next = 0;
+            if ( ((addr + sizeof(FLASH_REC_t)) <= end) &&
+                 (sdk_spi_flash_read(addr, &word, sizeof(word)) == SPI_FLASH_RESULT_OK) && (word == FLASH_ERASED) )
+            {
+                pState->next = addr;
+            }
+        }
+    }
+
+    if (pState->seq > 0)
+    {
+        DEBUG("flash: %s: seq %u at 0x%06x, next 0x%06x", pkArea->name, pState->seq, pState->addr, pState->next);
+    }
+    else
+    {
+        DEBUG("flash: %s: empty", pkArea->name);
+    }
+}
+
+bool flashSnapLoad(const FLASH_SNAP_t snap, void *pData, const int size)
+{
+    if ( (snap >= NUMOF(skFlashSnapAreas)) || (pData == NULL) )
+    {
+        return false;
+    }
+    xSemaphoreTake(sFlashMutex, portMAX_DELAY);
+    const FLASH_SNAP_STATE_t *pkState = &sFlashSnapStates[snap];
+    bool res = false;
+    if ( (pkState->seq > 0) && sFlashReadRec(pkState->addr, snap, true) )
+    {
+        const FLASH_REC_t *pkRec = (const FLASH_REC_t *)sFlashBuf;
+        if (pkRec->size == size)
+        {
+            memcpy(pData, &pkRec[1], size);
+            res = true;
+        }
+        else
+        {
+            WARNING("flash: %s: size mismatch (%u != %d)", skFlashSnapAreas[snap].name, pkRec->size, size);
+        }
+    }
+    xSemaphoreGive(sFlashMutex);
+    return res;
+}
+
+bool flashSnapSave(const FLASH_SNAP_t snap, const void *pData, const int size)
+{
+    if ( (snap >= NUMOF(skFlashSnapAreas)) || (pData == NULL) || (size <= 0) || (size > FLASH_SNAP_MAX_SIZE) )
+    {
+        return false;
+    }
+    const FLASH_AREA_t *pkArea = &skFlashSnapAreas[snap];
+    FLASH_SNAP_STATE_t *pState = &sFlashSnapStates[snap];
+    const uint32_t recSize = sizeof(FLASH_REC_t) + FLASH_ALIGN4(size);
+
+    xSemaphoreTake(sFlashMutex, portMAX_DELAY);
+
+    // prepare record
+    FLASH_REC_t *pRec = (FLASH_REC_t *)sFlashBuf;
+    memset(sFlashBuf, 0xff, recSize);
+    pRec->magic = FLASH_REC_MAGIC;
+    pRec->seq   = pState->seq + 1;
+    pRec->size  = size;
+    pRec->snap  = snap;
+    memcpy(&pRec[1], pData, size);
+    pRec->crc   = sFlashRecCrc(pRec, &pRec[1]);
+
+    // does it fit into the current sector? otherwise start using the next sector
+    const uint32_t sectorAddr = pState->next & ~(SPI_FLASH_SEC_SIZE - 1);
+    if ( (pState->next == 0) || ((pState->next + recSize) > (sectorAddr + SPI_FLASH_SEC_SIZE)) )
+    {
+        int sectorIx = 0;
+        if (pState->seq > 0)
+        {
+            const int currIx = (pState->addr / SPI_FLASH_SEC_SIZE) - (sFlashBaseSector + pkArea->sector);
+            sectorIx = (currIx + 1) % pkArea->numSectors;
+        }
+        const uint32_t addr = sFlashSectorAddr(pkArea, sectorIx);
+        DEBUG("flash: %s: erase 0x%06x", pkArea->name, addr);
+        pState->nErases++;
+        pState->next = 0;
+        if (sdk_spi_flash_erase_sector(addr / SPI_FLASH_SEC_SIZE) == SPI_FLASH_RESULT_OK)
+        {
+            pState->next = addr;
+        }
+    }
+
+    // write record
+    bool res = false;
+    if (pState->next != 0)
+    {
+        const uint32_t addr = pState->next;
+        pState->nWrites++;
+        if (sdk_spi_flash_write(addr, sFlashBuf, recSize) == SPI_FLASH_RESULT_OK)
+        {
+            pState->seq  = pRec->seq;
+            pState->addr = addr;
+            pState->next = addr + recSize;
+            // check that it worked
+            res = sFlashReadRec(addr, snap, true);
+        }
+        // in any case, don't try to write there again
+        if (!res)
+        {
+            pState->next = 0;
+        }
+    }
+
+    xSemaphoreGive(sFlashMutex);
+
+    if (res)
+    {
+        DEBUG("flash: %s: saved seq %u at 0x%06x (%d)", pkArea->name, pState->seq, pState->addr, size);
+    }
+    else
+    {
+        ERROR("flash: %s: save failed", pkArea->name);
+    }
+    return res;
+}
+
+
+/* ***** key-value store ************************************************************************* */
+
+// sector header (written last, when the sector is complete)
+typedef struct FLASH_KV_SEC_s
+{
+    uint32_t magic;  // FLASH_KV_SEC_MAGIC
+    uint32_t seq;    // sector sequence number (> 0)
+} FLASH_KV_SEC_t;
+
+// record header, followed by the key, the value and padding to a multiple of 4 bytes
+typedef struct FLASH_KV_REC_s
+{
+    uint32_t magic;  // FLASH_KV_REC_MAGIC
+    uint8_t  keyLen;
+    uint8_t  valLen;
+    uint16_t pad;
+    uint32_t crc;    // CRC32 of keyLen, valLen, key and value
+} FLASH_KV_REC_t;
+
+#define FLASH_KV_SEC_MAGIC 0x4b6d7066 // "fpmK"
+#define FLASH_KV_REC_MAGIC 0x566d7066 // "fpmV"
+#define FLASH_KV_REC_SIZE(keyLen, valLen) ( sizeof(FLASH_KV_REC_t) + FLASH_ALIGN4((keyLen) + (valLen)) )
+
+// index of the latest record for each key in the active sector
+typedef struct FLASH_KV_KEY_s
+{
+    char     key[FLASH_KV_KEY_MAX + 1];
+    uint32_t addr;
+} FLASH_KV_KEY_t;
+
+static FLASH_KV_KEY_t sFlashKvKeys[FLASH_KV_MAX_KEYS];
+static int            sFlashKvNumKeys;
+static int            sFlashKvSector;  // active sector (-1 = none)
+static uint32_t       sFlashKvSeq;     // active sector sequence number
+static uint32_t       sFlashKvNext;    // address for next record (0 = sector full)
+static uint32_t       sFlashKvWrites;
+static uint32_t       sFlashKvErases;
+
+static uint32_t sFlashKvSectorEnd(const int sectorIx)
+{
+    return sFlashSectorAddr(&skFlashKvArea, sectorIx) + SPI_FLASH_SEC_SIZE;
+}
+
+static uint32_t sFlashKvRecCrc(const FLASH_KV_REC_t *pkRec)
+{
+    const uint32_t crc = flashCrc32(0, &pkRec->keyLen, sizeof(pkRec->keyLen) + sizeof(pkRec->valLen));
+    return flashCrc32(crc, &pkRec[1], pkRec->keyLen + pkRec->valLen);
+}
+
+// read record header into sFlashBuf, returns true if it looks like a record (that fits into the sector)
+static bool sFlashKvReadHdr(const uint32_t addr, const uint32_t end)
+{
+    const FLASH_KV_REC_t *pkRec = (const FLASH_KV_REC_t *)sFlashBuf;
+    return ((addr + sizeof(*pkRec)) <= end) &&
+        (sdk_spi_flash_read(addr, sFlashBuf, sizeof(*pkRec)) == SPI_FLASH_RESULT_OK) &&
+        (pkRec->magic == FLASH_KV_REC_MAGIC) && (pkRec->keyLen > 0) && (pkRec->keyLen <= FLASH_KV_KEY_MAX) &&
+        (pkRec->valLen <= FLASH_KV_VAL_MAX) && ((addr + FLASH_KV_REC_SIZE(pkRec->keyLen, pkRec->valLen)) <= end);
+}
+
+// read and verify record into sFlashBuf, returns true if valid
+static bool sFlashKvReadRec(const uint32_t addr, const uint32_t end)
+{
+    if (!sFlashKvReadHdr(addr, end))
+    {
+        return false;
+    }
+    const FLASH_KV_REC_t *pkRec = (const FLASH_KV_REC_t *)sFlashBuf;
+    if (sdk_spi_flash_read(addr + sizeof(*pkRec), &sFlashBuf[sizeof(*pkRec) / sizeof(uint32_t)],
+            FLASH_ALIGN4(pkRec->keyLen + pkRec->valLen)) != SPI_FLASH_RESULT_OK)
+    {
+        return false;
+    }
+    return pkRec->crc == sFlashKvRecCrc(pkRec);
+}
+
+static FLASH_KV_KEY_t *sFlashKvFind(const char *key, const int keyLen)
+{
+    for (int ix = 0; ix < sFlashKvNumKeys; ix++)
+    {
+        if ( (strncmp(sFlashKvKeys[ix].key, key, keyLen) == 0) && (sFlashKvKeys[ix].key[keyLen] == '\0') )
+        {
+            return &sFlashKvKeys[ix];
+        }
+    }
+    return NULL;
+}
+
+// (re-)build the index from a sector, find the place for the next record
+static void sFlashKvScanSector(const int sectorIx)
+{
+    const uint32_t end = sFlashKvSectorEnd(sectorIx);
+    uint32_t addr = sFlashSectorAddr(&skFlashKvArea, sectorIx) + sizeof(FLASH_KV_SEC_t);
+    sFlashKvNumKeys = 0;
+
+    // stop at the first invalid (or erased) header, skip records with bad data
+    while (sFlashKvReadHdr(addr, end))
+    {
+        const FLASH_KV_REC_t *pkRec = (const FLASH_KV_REC_t *)sFlashBuf;
+        const uint32_t recSize = FLASH_KV_REC_SIZE(pkRec->keyLen, pkRec->valLen);
+        if (sFlashKvReadRec(addr, end))
+        {
+            const char *key = (const char *)&pkRec[1];
+            FLASH_KV_KEY_t *pKey = sFlashKvFind(key, pkRec->keyLen);
+            if ( (pKey == NULL) && (sFlashKvNumKeys < NUMOF(sFlashKvKeys)) )
+            {
+                pKey = &sFlashKvKeys[sFlashKvNumKeys++];
+                memcpy(pKey->key, key, pkRec->keyLen);
+                pKey->key[pkRec->keyLen] = '\0';
+            }
+            if (pKey != NULL)
+            {
+                pKey->addr = addr;
+            }
+        }
+        else
+        {
+            WARNING("flash: kv: bad record at 0x%06x", addr);
+        }
+        addr += recSize;
+    }
+
+    // appending is possible if the rest of the sector is erased
+    uint32_t word = 0;
+    sFlashKvNext = 0;
+    if ( ((addr + sizeof(FLASH_KV_REC_t)) <= end) &&
+         (sdk_spi_flash_read(addr, &word, sizeof(word)) == SPI_FLASH_RESULT_OK) && (word == FLASH_ERASED) )
+    {
+        sFlashKvNext = addr;
+    }
+}
+
+// find the active sector (the one with a valid header and the highest sequence number)
+static void sFlashKvScan(void)
+{
+    sFlashKvSector = -1;
+    sFlashKvSeq = 0;
+    sFlashKvNumKeys = 0;
+    sFlashKvNext = 0;
+    for (int sectorIx = 0; sectorIx < skFlashKvArea.numSectors; sectorIx++)
+    {
+        FLASH_KV_SEC_t hdr;
+        if ( (sdk_spi_flash_read(sFlashSectorAddr(&skFlashKvArea, sectorIx), (uint32_t *)&hdr, sizeof(hdr)) == SPI_FLASH_RESULT_OK) &&
+             (hdr.magic == FLASH_KV_SEC_MAGIC) && (hdr.seq != FLASH_ERASED) && (hdr.seq > sFlashKvSeq) )
+        {
+            sFlashKvSector = sectorIx;
+            sFlashKvSeq = hdr.seq;
+        }
+    }
+    if (sFlashKvSector >= 0)
+    {
+        sFlashKvScanSector(sFlashKvSector);
+        DEBUG("flash: kv: sector %d, seq %u, %d keys, next 0x%06x", sFlashKvSector, sFlashKvSeq, sFlashKvNumKeys, sFlashKvNext);
+    }
+    else
+    {
+        DEBUG("flash: kv: empty");
+    }
+}
+
+// write record from sFlashBuf
+static bool sFlashKvWriteRec(const uint32_t addr)
+{
+    const FLASH_KV_REC_t *pkRec = (const FLASH_KV_REC_t *)sFlashBuf;
+    sFlashKvWrites++;
+    return sdk_spi_flash_write(addr, sFlashBuf, FLASH_KV_REC_SIZE(pkRec->keyLen, pkRec->valLen)) == SPI_FLASH_RESULT_OK;
+}
+
+// copy the latest records to the other sector and make that the active one
+static bool sFlashKvRotate(void)
+{
+    const int newSector = (sFlashKvSector + 1) % skFlashKvArea.numSectors;
+    const uint32_t start = sFlashSectorAddr(&skFlashKvArea, newSector);
+    const uint32_t end = sFlashKvSectorEnd(newSector);
+    DEBUG("flash: kv: erase 0x%06x", start);
+    sFlashKvErases++;
+    if (sdk_spi_flash_erase_sector(start / SPI_FLASH_SEC_SIZE) != SPI_FLASH_RESULT_OK)
+    {
+        return false;
+    }
+
+    // copy records
+    uint32_t addr = start + sizeof(FLASH_KV_SEC_t);
+    for (int ix = 0; (sFlashKvSector >= 0) && (ix < sFlashKvNumKeys); ix++)
+    {
+        if (sFlashKvReadRec(sFlashKvKeys[ix].addr, sFlashKvSectorEnd(sFlashKvSector)))
+        {
+            const FLASH_KV_REC_t *pkRec = (const FLASH_KV_REC_t *)sFlashBuf;
+            const uint32_t recSize = FLASH_KV_REC_SIZE(pkRec->keyLen, pkRec->valLen);
+            if ( ((addr + recSize) > end) || !sFlashKvWriteRec(addr) )
+            {
+                return false;
+            }
+            addr += recSize;
+        }
+    }
+
+    // activate sector (if we get interrupted before this the old sector remains the active one)
+    const FLASH_KV_SEC_t hdr = { .magic = FLASH_KV_SEC_MAGIC, .seq = sFlashKvSeq + 1 };
+    if (sdk_spi_flash_write(start, (uint32_t *)&hdr, sizeof(hdr)) != SPI_FLASH_RESULT_OK)
+    {
+        return false;
+    }
+    sFlashKvSector = newSector;
+    sFlashKvSeq = hdr.seq;
+    sFlashKvScanSector(newSector);
+    return true;
+}
+
+int flashKvGet(const char *key, void *pVal, const int size)
+{
+    const int keyLen = key != NULL ? strlen(key) : 0;
+    if ( (keyLen < 1) || (keyLen > FLASH_KV_KEY_MAX) || (pVal == NULL) )
+    {
+        return -1;
+    }
+    int res = -1;
+    xSemaphoreTake(sFlashMutex, portMAX_DELAY);
+    const FLASH_KV_KEY_t *pkKey = sFlashKvFind(key, keyLen);
+    if ( (pkKey != NULL) && sFlashKvReadRec(pkKey->addr, sFlashKvSectorEnd(sFlashKvSector)) )
+    {
+        const FLASH_KV_REC_t *pkRec = (const FLASH_KV_REC_t *)sFlashBuf;
+        if (pkRec->valLen <= size)
+        {
+            memcpy(pVal, (const uint8_t *)&pkRec[1] + pkRec->keyLen, pkRec->valLen);
+            res = pkRec->valLen;
+        }
+    }
+    xSemaphoreGive(sFlashMutex);
+    return res;
+}
+
+bool flashKvSet(const char *key, const void *pVal, const int len)
+{
+    const int keyLen = key != NULL ? strlen(key) : 0;
+    if ( (keyLen < 1) || (keyLen > FLASH_KV_KEY_MAX) || (len < 0) || (len > FLASH_KV_VAL_MAX) ||
+         ((pVal == NULL) && (len > 0)) )
+    {
+        return false;
+    }
+
+    // same value already stored?
+    uint8_t val[FLASH_KV_VAL_MAX];
+    if ( (flashKvGet(key, val, sizeof(val)) == len) && (memcmp(val, pVal, len) == 0) )
+    {
+        return true;
+    }
+
+    xSemaphoreTake(sFlashMutex, portMAX_DELAY);
+
+    // new keys must fit into the index
+    const uint32_t recSize = FLASH_KV_REC_SIZE(keyLen, len);
+    bool res = (sFlashKvFind(key, keyLen) != NULL) || (sFlashKvNumKeys < NUMOF(sFlashKvKeys));
+
+    // make space (rotate to the other sector, which may still not have enough space if all other keys
+    // have long values)
+    if ( res && ( (sFlashKvSector < 0) || (sFlashKvNext == 0) ||
+                  ((sFlashKvNext + recSize) > sFlashKvSectorEnd(sFlashKvSector)) ) )
+    {
+        res = sFlashKvRotate() && (sFlashKvNext != 0) &&
+            ((sFlashKvNext + recSize) <= sFlashKvSectorEnd(sFlashKvSector));
+    }
+
+    // write record
+    if (res)
+    {
+        FLASH_KV_REC_t *pRec = (FLASH_KV_REC_t *)sFlashBuf;
+        memset(sFlashBuf, 0xff, recSize);
+        pRec->magic  = FLASH_KV_REC_MAGIC;
+        pRec->keyLen = keyLen;
+        pRec->valLen = len;
+        memcpy(&pRec[1], key, keyLen);
+        memcpy((uint8_t *)&pRec[1] + keyLen, pVal, len);
+        pRec->crc    = sFlashKvRecCrc(pRec);
+        const uint32_t addr = sFlashKvNext;
+        res = sFlashKvWriteRec(addr);
+
+        // rescan in any case (updates the index and the next address, copes with failed writes)
+        sFlashKvScanSector(sFlashKvSector);
+        const FLASH_KV_KEY_t *pkKey = sFlashKvFind(key, keyLen);
+        res = res && (pkKey != NULL) && (pkKey->addr == addr);
+    }
+
+    xSemaphoreGive(sFlashMutex);
+
+    if (res)
+    {
+        DEBUG("flash: kv: %s set (%d)", key, len);
+    }
+    else
+    {
+        ERROR("flash: kv: %s set failed", key);
+    }
+    return res;
+}
+
+
+/* ***** init and monitoring ********************************************************************* */
+
+void flashInit(void)
+{
+    static StaticSemaphore_t sMutex;
+    sFlashMutex = xSemaphoreCreateMutexStatic(&sMutex);
+
+    sFlashBaseSector = (sdk_flashchip.chip_size / SPI_FLASH_SEC_SIZE)
+        - FLASH_SDK_SECTORS - FLASH_SYSPARAM_SECTORS - FLASH_NUM_SECTORS;
+    DEBUG("flash: init (sectors %u..%u, 0x%06x)", sFlashBaseSector, sFlashBaseSector + FLASH_NUM_SECTORS - 1,
+        sFlashBaseSector * SPI_FLASH_SEC_SIZE);
+
+    for (int snap = 0; snap < NUMOF(skFlashSnapAreas); snap++)
+    {
+        sFlashSnapScan(snap);
+    }
+    sFlashKvScan();
+}
+
+void flashMonStatus(void)
+{
+    for (int snap = 0; snap < NUMOF(skFlashSnapAreas); snap++)
+    {
+        const FLASH_SNAP_STATE_t *pkState = &sFlashSnapStates[snap];
+        DEBUG("mon: flash: %s: seq=%u addr=0x%06x writes=%u erases=%u", skFlashSnapAreas[snap].name,
+            pkState->seq, pkState->addr, pkState->nWrites, pkState->nErases);
+    }
+    DEBUG("mon: flash: kv: sector=%d seq=%u keys=%d next=0x%06x writes=%u erases=%u", sFlashKvSector, sFlashKvSeq,
+        sFlashKvNumKeys, sFlashKvNext, sFlashKvWrites, sFlashKvErases);
+}
+
+//@}
+// eof
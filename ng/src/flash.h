@@ -0,0 +1,113 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: persistent storage in flash (see \ref FF_FLASH)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \defgroup FF_FLASH FLASH
+    \ingroup FF
+
+    This implements wear-levelled snapshots of data and a small key-value store in spare flash
+    sectors (below the esp-open-rtos sysparam area at the end of the flash).
+
+    Each snapshot area uses a few sectors into which the snapshots (records with a sequence number
+    and a CRC32) are appended. The newest valid record wins. When a sector is full the next sector is
+    erased and used.
+
+    The key-value store is log-structured, too: records (key, value, CRC32) are appended to the active
+    sector and the last record for a key wins. When the sector is full, the latest values of all keys
+    are copied to the other sector, which then becomes the active one (it has a higher sequence number
+    in its sector header, which is written last, so an interrupted rotation leaves the old sector
+    active).
+
+    @{
+*/
+#ifndef __FLASH_H__
+#define __FLASH_H__
+
+#include "stdinc.h"
+
+//! initialise (find latest snapshots and the active key-value store sector)
+void flashInit(void);
+
+//! print flash monitor string
+void flashMonStatus(void);
+
+//! start of the flash reserved for our sectors, the sysparam area and the SDK (up to the end of the flash)
+uint32_t flashReservedAddr(void);
+
+//! snapshot areas
+typedef enum FLASH_SNAP_e
+{
+    FLASH_SNAP_JENKINS = 0,  //!< last-known Jenkins state (see jenkins.c)
+    FLASH_SNAP_WIFI,         //!< provisioned wifi and backend config (see wifi.c)
+} FLASH_SNAP_t;
+
+//! maximum size of a snapshot
+#define FLASH_SNAP_MAX_SIZE 512
+
+//! load latest snapshot
+/*!
+    \param[in]  snap   snapshot area
+    \param[out] pData  buffer to load the data to
+    \param[in]  size   size of the data (must be the same as stored)
+    \returns true if a valid snapshot of the given size was found and loaded, false otherwise
+*/
+bool flashSnapLoad(const FLASH_SNAP_t snap, void *pData, const int size);
+
+//! store new snapshot
+/*!
+    \param[in] snap   snapshot area
+    \param[in] pData  data to store
+    \param[in] size   size of the data (<= #FLASH_SNAP_MAX_SIZE)
+    \returns true if the data was written successfully, false otherwise
+
+    \note This blocks for the write and possibly a sector erase (which can take some tens of milliseconds).
+*/
+bool flashSnapSave(const FLASH_SNAP_t snap, const void *pData, const int size);
+
+//! maximum length of a key-value store key
+#define FLASH_KV_KEY_MAX 15
+
+//! maximum length of a key-value store value
+#define FLASH_KV_VAL_MAX 64
+
+//! maximum number of keys in the key-value store
+#define FLASH_KV_MAX_KEYS 24
+
+//! get value from key-value store
+/*!
+    \param[in]  key   the key
+    \param[out] pVal  buffer for the value
+    \param[in]  size  size of the buffer
+    \returns the length of the value (which may be 0), or -1 if the key does not exist (or the value
+              does not fit into the buffer)
+*/
+int flashKvGet(const char *key, void *pVal, const int size);
+
+//! store value in key-value store
+/*!
+    \param[in] key   the key (up to #FLASH_KV_KEY_MAX characters)
+    \param[in] pVal  the value
+    \param[in] len   length of the value (up to #FLASH_KV_VAL_MAX)
+    \returns true if the value was stored (or was already stored), false otherwise
+
+    \note Writing the same value again does nothing. Otherwise this blocks for the write and possibly a
+           sector erase.
+*/
+bool flashKvSet(const char *key, const void *pVal, const int len);
+
+//! calculate CRC32 (IEEE 802.3)
+/*!
+    \param[in] crc    initial value (0 for a new checksum)
+    \param[in] pData  data
+    \param[in] size   size of the data
+    \returns the CRC32
+*/
+uint32_t flashCrc32(uint32_t crc, const void *pData, const int size);
+
+
+#endif // __FLASH_H__
+//@}
+// eof
@@ -94,6 +94,53 @@ void hsv2rgb(const uint8_t H, const uint8_t S, uint8_t V, uint8_t *R, uint8_t *G
 #endif
 
 
+/* ***** batched HSV to RGB conversion *********************************************************** */
+
+// hue lookup table: for each hue the segment's ramp position (t, bits 0-7), the ramp direction (bit 8,
+// V - r instead of l + r) and the output index for the V (bits 9-10), ramp (bits 11-12) and lower (bits
+// 13-14) levels, i.e. the same as the switch in HSV2RGB_CLASSIC() without any branching
+// (in IRAM, which we can afford for 1kB, and which must be accessed 32 bits wide)
+#define HSV2RGB_SEG(v, ramp, low, down) ( ((down) << 8) | ((v) << 9) | ((ramp) << 11) | ((low) << 13) )
+#define HSV2RGB_SEG_BITS(s) (      \
+    (s) == 0 ? HSV2RGB_SEG(0, 1, 2, 0) : \
+    (s) == 1 ? HSV2RGB_SEG(1, 0, 2, 1) : \
+    (s) == 2 ? HSV2RGB_SEG(1, 2, 0, 0) : \
+    (s) == 3 ? HSV2RGB_SEG(2, 1, 0, 1) : \
+    (s) == 4 ? HSV2RGB_SEG(2, 0, 1, 0) : \
+               HSV2RGB_SEG(0, 2, 1, 1) )
+#define HSV2RGB_HUE(h)    ( HSV2RGB_SEG_BITS((6 * (h)) >> 8) | ((6 * (h)) & 0xff) )
+#define HSV2RGB_HUE4(h)   HSV2RGB_HUE(h), HSV2RGB_HUE(h + 1), HSV2RGB_HUE(h + 2), HSV2RGB_HUE(h + 3)
+#define HSV2RGB_HUE16(h)  HSV2RGB_HUE4(h), HSV2RGB_HUE4(h + 4), HSV2RGB_HUE4(h + 8), HSV2RGB_HUE4(h + 12)
+#define HSV2RGB_HUE64(h)  HSV2RGB_HUE16(h), HSV2RGB_HUE16(h + 16), HSV2RGB_HUE16(h + 32), HSV2RGB_HUE16(h + 48)
+
+IRAM static const uint32_t skHsv2rgbHueLut[256] =
+{
+    HSV2RGB_HUE64(0), HSV2RGB_HUE64(64), HSV2RGB_HUE64(128), HSV2RGB_HUE64(192)
+};
+
+IRAM void hsv2rgbN(const uint8_t (*pkHsv)[3], uint8_t (*pRgb)[3], const int num)
+{
+    for (int ix = 0; ix < num; ix++)
+    {
+        const uint32_t hue = skHsv2rgbHueLut[ pkHsv[ix][0] ];
+#if (HSV2RGB_METHOD == 2)
+        const uint32_t S = 255 - skMatrixDimCurve[255 - pkHsv[ix][1]];
+        const uint32_t V = skMatrixDimCurve[ pkHsv[ix][2] ];
+#else
+        const uint32_t S = pkHsv[ix][1];
+        const uint32_t V = pkHsv[ix][2];
+#endif
+        const uint32_t t = hue & 0xff;
+        const uint32_t l = (V * (255 - S)) >> 8;
+        const uint32_t r = (V * S * t) >> 16;
+        uint8_t *pOut = pRgb[ix];
+        pOut[ (hue >>  9) & 0x3 ] = V;
+        pOut[ (hue >> 11) & 0x3 ] = (hue & BIT(8)) ? (V - r) : (l + r);
+        pOut[ (hue >> 13) & 0x3 ] = l;
+    }
+}
+
+
 
 /* *********************************************************************************************** */
 
@@ -28,6 +28,16 @@
 */
 void hsv2rgb(const uint8_t H, const uint8_t S, uint8_t V, uint8_t *R, uint8_t *G, uint8_t *B);
 
+//! batched hue, saturation and value (HSV) to red, green, blue (RGB) conversion
+/*!
+    Same as hsv2rgb() (and gives the same results), but for many values at once and faster.
+
+    \param[in]  pkHsv  HSV values (H, S, V)
+    \param[out] pRgb   RGB values (R, G, B)
+    \param[in]  num    number of values
+*/
+void hsv2rgbN(const uint8_t (*pkHsv)[3], uint8_t (*pRgb)[3], const int num);
+
 
 #endif // __HSV2RGB_H__
 //@}
@@ -0,0 +1,413 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: streaming HTTP/1.1 client (see \ref FF_HTTP)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+*/
+
+#include "stdinc.h"
+
+#include <ctype.h>
+
+#include "debug.h"
+#include "stuff.h"
+#include "http.h"
+#include "version_gen.h"
+
+// response parser states
+typedef enum HTTP_STATE_e
+{
+    HTTP_STATE_IDLE = 0,    // no response expected (fresh connection)
+    HTTP_STATE_STATUS,      // status line ("HTTP/1.1 200 OK")
+    HTTP_STATE_HEADER,      // header lines
+    HTTP_STATE_BODY,        // body (Content-Length, or until the connection closes)
+    HTTP_STATE_CHUNK_SIZE,  // chunk size line
+    HTTP_STATE_CHUNK_DATA,  // chunk data
+    HTTP_STATE_CHUNK_END,   // CRLF after the chunk data
+    HTTP_STATE_TRAILER,     // trailer lines after the last chunk
+    HTTP_STATE_DONE,        // response complete
+    HTTP_STATE_FAIL,        // response failed
+} HTTP_STATE_t;
+
+static const char *sHttpStateStr(const HTTP_STATE_t state)
+{
+    switch (state)
+    {
+        case HTTP_STATE_IDLE:       return "idle";
+        case HTTP_STATE_STATUS:     return "status";
+        case HTTP_STATE_HEADER:     return "header";
+        case HTTP_STATE_BODY:       return "body";
+        case HTTP_STATE_CHUNK_SIZE: return "chunksize";
+        case HTTP_STATE_CHUNK_DATA: return "chunkdata";
+        case HTTP_STATE_CHUNK_END:  return "chunkend";
+        case HTTP_STATE_TRAILER:    return "trailer";
+        case HTTP_STATE_DONE:       return "done";
+        case HTTP_STATE_FAIL:       return "fail";
+    }
+    return "???";
+}
+
+void httpInit(HTTP_CLIENT_t *pClient, HTTP_WRITE_FUNC_t write, HTTP_RECV_FUNC_t recv)
+{
+    memset(pClient, 0, sizeof(*pClient));
+    pClient->write = write;
+    pClient->recv  = recv;
+}
+
+void httpConnected(HTTP_CLIENT_t *pClient)
+{
+    pClient->state = HTTP_STATE_IDLE;
+}
+
+
+/* ***** request ******************************************************************************** */
+
+// send what's in the buffer (the last flush, without more, also pushes out what the transport has)
+static void sHttpReqFlush(HTTP_CLIENT_t *pClient, const bool more)
+{
+    if (!pClient->count && (pClient->err == ERR_OK) && ((pClient->bufLen > 0) || !more))
+    {
+        pClient->err = pClient->write(pClient->buf, pClient->bufLen, NETCONN_COPY | (more ? NETCONN_MORE : 0));
+    }
+    pClient->bufLen = 0;
+}
+
+void httpReqBegin(HTTP_CLIENT_t *pClient, const bool count)
+{
+    pClient->count  = count;
+    pClient->reqLen = 0;
+    pClient->err    = ERR_OK;
+    pClient->bufLen = 0;
+}
+
+void httpReqConst(HTTP_CLIENT_t *pClient, const char *str)
+{
+    const int len = strlen(str);
+    pClient->reqLen += len;
+    if (!pClient->count && (len > 0))
+    {
+        sHttpReqFlush(pClient, true);
+        if (pClient->err == ERR_OK)
+        {
+            pClient->err = pClient->write(str, len, NETCONN_NOCOPY | NETCONN_MORE);
+        }
+    }
+}
+
+void httpReqStr(HTTP_CLIENT_t *pClient, const char *str, const bool urlencode)
+{
+    static const char skHex[] = "0123456789ABCDEF";
+    for (const char *pkC = str; *pkC != '\0'; pkC++)
+    {
+        const char c = *pkC;
+        const bool plain = !urlencode ||
+            ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) ||
+            (c == '-') || (c == '_') || (c == '.') || (c == '~');
+        const int n = plain ? 1 : 3;
+        pClient->reqLen += n;
+        if (pClient->count)
+        {
+            continue;
+        }
+        if ((pClient->bufLen + n) > (int)sizeof(pClient->buf))
+        {
+            sHttpReqFlush(pClient, true);
+        }
+        if (plain)
+        {
+            pClient->buf[pClient->bufLen++] = c;
+        }
+        else
+        {
+            pClient->buf[pClient->bufLen++] = '%';
+            pClient->buf[pClient->bufLen++] = skHex[ ((uint8_t)c >> 4) & 0x0f ];
+            pClient->buf[pClient->bufLen++] = skHex[  (uint8_t)c       & 0x0f ];
+        }
+    }
+}
+
+err_t httpReqEnd(HTTP_CLIENT_t *pClient)
+{
+    if (pClient->count)
+    {
+        return ERR_OK;
+    }
+    sHttpReqFlush(pClient, false);
+
+    // expect response
+    pClient->state     = HTTP_STATE_STATUS;
+    pClient->status    = 0;
+    pClient->chunked   = false;
+    pClient->remaining = -1;
+    pClient->lineLen   = 0;
+
+    pClient->nReq++;
+    return pClient->err;
+}
+
+int httpReqLen(const HTTP_CLIENT_t *pClient)
+{
+    return pClient->reqLen;
+}
+
+
+/* ***** response ******************************************************************************* */
+
+// handle a complete status, header, chunk size or trailer line
+static HTTP_RESP_t sHttpLine(HTTP_CLIENT_t *pClient)
+{
+    char *line = pClient->line;
+    switch ((HTTP_STATE_t)pClient->state)
+    {
+        // "HTTP/1.1 200 OK"
+        case HTTP_STATE_STATUS:
+            if ( (strncmp(line, "HTTP/1.", 7) != 0) || (line[8] != ' ') ||
+                 !isdigit((int)line[9]) || !isdigit((int)line[10]) || !isdigit((int)line[11]) )
+            {
+                ERROR("http: response is not HTTP/1.x");
+                break;
+            }
+            pClient->status = ((line[9] - '0') * 100) + ((line[10] - '0') * 10) + (line[11] - '0');
+            DEBUG("http: HTTP/1.%c (code %d)", line[7], pClient->status);
+            pClient->state = HTTP_STATE_HEADER;
+            return HTTP_RESP_MORE;
+
+        // "Name: value", and an empty line at the end
+        case HTTP_STATE_HEADER:
+            if (line[0] != '\0')
+            {
+                for (char *pC = line; *pC != '\0'; pC++)
+                {
+                    *pC = tolower((int)*pC);
+                }
+                if (strncmp(line, "content-length:", 15) == 0)
+                {
+                    pClient->remaining = atoi(&line[15]);
+                }
+                else if (strncmp(line, "transfer-encoding:", 18) == 0)
+                {
+                    pClient->chunked = strstr(&line[18], "chunked") != NULL;
+                }
+                return HTTP_RESP_MORE;
+            }
+            if ( (pClient->status < 200) || (pClient->status > 299) )
+            {
+                ERROR("http: unsuccessful response: %d (maybe redirect?)", pClient->status);
+                break;
+            }
+            if (pClient->chunked)
+            {
+                pClient->state = HTTP_STATE_CHUNK_SIZE;
+            }
+            else if (pClient->remaining == 0)
+            {
+                pClient->state = HTTP_STATE_DONE;
+                return HTTP_RESP_DONE;
+            }
+            else
+            {
+                // without a Content-Length the body ends when the connection closes
+                pClient->state = HTTP_STATE_BODY;
+            }
+            return HTTP_RESP_MORE;
+
+        // "1a2b" (hex), optionally followed by ";extension"
+        case HTTP_STATE_CHUNK_SIZE:
+        {
+            int32_t size = 0;
+            int nDigits = 0;
+            for (const char *pkC = line; isxdigit((int)*pkC) && (nDigits < 7); pkC++, nDigits++)
+            {
+                const char c = tolower((int)*pkC);
+                size = (size << 4) | (c <= '9' ? c - '0' : c - 'a' + 10);
+            }
+            if (nDigits == 0)
+            {
+                ERROR("http: bad chunk size");
+                break;
+            }
+            pClient->remaining = size;
+            pClient->state = size > 0 ? HTTP_STATE_CHUNK_DATA : HTTP_STATE_TRAILER;
+            return HTTP_RESP_MORE;
+        }
+
+        // empty line after the chunk data
+        case HTTP_STATE_CHUNK_END:
+            if (line[0] != '\0')
+            {
+                ERROR("http: bad chunk end");
+                break;
+            }
+            pClient->state = HTTP_STATE_CHUNK_SIZE;
+            return HTTP_RESP_MORE;
+
+        // trailers (ignored), and an empty line at the end
+        case HTTP_STATE_TRAILER:
+            if (line[0] != '\0')
+            {
+                return HTTP_RESP_MORE;
+            }
+            pClient->state = HTTP_STATE_DONE;
+            return HTTP_RESP_DONE;
+
+        default:
+            break;
+    }
+
+    pClient->state = HTTP_STATE_FAIL;
+    return HTTP_RESP_FAIL;
+}
+
+HTTP_RESP_t httpRespFeed(HTTP_CLIENT_t *pClient, char *data, const int len, HTTP_SINK_FUNC_t sink, void *pArg)
+{
+    int offs = 0;
+    while (offs < len)
+    {
+        switch ((HTTP_STATE_t)pClient->state)
+        {
+            // line-based states
+            case HTTP_STATE_STATUS:
+            case HTTP_STATE_HEADER:
+            case HTTP_STATE_CHUNK_SIZE:
+            case HTTP_STATE_CHUNK_END:
+            case HTTP_STATE_TRAILER:
+            {
+                const char c = data[offs++];
+                if (c != '\n')
+                {
+                    if ( (c != '\r') && (pClient->lineLen < (int)(sizeof(pClient->line) - 1)) )
+                    {
+                        pClient->line[pClient->lineLen++] = c;
+                    }
+                    break;
+                }
+                pClient->line[pClient->lineLen] = '\0';
+                pClient->lineLen = 0;
+                const HTTP_RESP_t res = sHttpLine(pClient);
+                if (res != HTTP_RESP_MORE)
+                {
+                    return res;
+                }
+                break;
+            }
+
+            // body data, hand over as much as we have (and belongs to the body or chunk)
+            case HTTP_STATE_BODY:
+            case HTTP_STATE_CHUNK_DATA:
+            {
+                int n = len - offs;
+                if ( (pClient->remaining >= 0) && (n > pClient->remaining) )
+                {
+                    n = pClient->remaining;
+                }
+                if (!sink(&data[offs], n, pArg))
+                {
+                    pClient->state = HTTP_STATE_FAIL;
+                    return HTTP_RESP_ABORT;
+                }
+                offs += n;
+                if (pClient->remaining >= 0)
+                {
+                    pClient->remaining -= n;
+                    if (pClient->remaining == 0)
+                    {
+                        if (pClient->state == HTTP_STATE_BODY)
+                        {
+                            pClient->state = HTTP_STATE_DONE;
+                            return HTTP_RESP_DONE;
+                        }
+                        pClient->state = HTTP_STATE_CHUNK_END;
+                    }
+                }
+                break;
+            }
+
+            case HTTP_STATE_DONE:
+                WARNING("http: %d bytes after the response", len - offs);
+                return HTTP_RESP_DONE;
+
+            case HTTP_STATE_IDLE:
+            case HTTP_STATE_FAIL:
+                return HTTP_RESP_FAIL;
+        }
+    }
+    return HTTP_RESP_MORE;
+}
+
+HTTP_RESP_t httpRespClosed(HTTP_CLIENT_t *pClient)
+{
+    if ( (pClient->state == HTTP_STATE_BODY) && (pClient->remaining < 0) )
+    {
+        pClient->state = HTTP_STATE_DONE;
+        return HTTP_RESP_DONE;
+    }
+    if (pClient->state != HTTP_STATE_DONE)
+    {
+        WARNING("http: connection closed in %s", sHttpStateStr(pClient->state));
+        pClient->state = HTTP_STATE_FAIL;
+        return HTTP_RESP_FAIL;
+    }
+    return HTTP_RESP_DONE;
+}
+
+HTTP_RESP_t httpRespRecv(HTTP_CLIENT_t *pClient, const uint32_t timeout, HTTP_SINK_FUNC_t sink, void *pArg)
+{
+    const uint32_t deadline = osTime() + timeout;
+    HTTP_RESP_t res = HTTP_RESP_MORE;
+    while (res == HTTP_RESP_MORE)
+    {
+        const int32_t left = (int32_t)(deadline - osTime());
+        char *pData;
+        int dataLen;
+        const err_t err = left > 0 ? pClient->recv(left, &pData, &dataLen) : ERR_TIMEOUT;
+        if (err == ERR_CLSD)
+        {
+            res = httpRespClosed(pClient);
+        }
+        else if (err != ERR_OK)
+        {
+            ERROR("http: recv failed: %s", lwipErrStr(err));
+            pClient->state = HTTP_STATE_FAIL;
+            res = HTTP_RESP_FAIL;
+        }
+        else
+        {
+            res = httpRespFeed(pClient, pData, dataLen, sink, pArg);
+        }
+    }
+    return res;
+}
+
+HTTP_RESP_t httpGet(HTTP_CLIENT_t *pClient, const char *host, const char *path, const char *auth,
+    const uint32_t timeout, HTTP_SINK_FUNC_t sink, void *pArg)
+{
+    httpReqBegin(pClient, false);
+    httpReqConst(pClient, "GET /");
+    httpReqStr(pClient, path, false);
+    httpReqConst(pClient, " HTTP/1.1\r\nHost: ");
+    httpReqStr(pClient, host, false);
+    if (auth != NULL)
+    {
+        httpReqConst(pClient, "\r\nAuthorization: Basic ");
+        httpReqStr(pClient, auth, false);
+    }
+    httpReqConst(pClient, "\r\nUser-Agent: "FF_PROGRAM"/"FF_BUILDVER"\r\n\r\n");
+    const err_t err = httpReqEnd(pClient);
+    DEBUG("http: GET /%s [%d]", path, httpReqLen(pClient));
+    if (err != ERR_OK)
+    {
+        ERROR("http: GET /%s failed: %s", path, lwipErrStr(err));
+        pClient->state = HTTP_STATE_FAIL;
+        return HTTP_RESP_FAIL;
+    }
+    return httpRespRecv(pClient, timeout, sink, pArg);
+}
+
+void httpMonStatus(const HTTP_CLIENT_t *pClient)
+{
+    DEBUG("mon: http: req=%u state=%s status=%d chunked=%s",
+        pClient->nReq, sHttpStateStr(pClient->state), pClient->status, pClient->chunked ? "yes" : "no");
+}
+
+// eof
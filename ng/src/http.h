@@ -0,0 +1,174 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: streaming HTTP/1.1 client (see \ref FF_HTTP)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \defgroup FF_HTTP HTTP
+    \ingroup FF
+
+    HTTP/1.1 client on top of a transport (TCP or TLS connection) provided by the user (see \ref
+    FF_WIFI). It does not buffer the response: the data is fed to the client as it arrives, the status
+    line and headers are parsed incrementally, and the body is handed to a sink callback in fragments,
+    with "Transfer-Encoding: chunked" and "Content-Length" taken care of. Each request is made on a
+    fresh connection (see httpConnected()).
+
+    Requests are written with httpReqConst() (constant strings, passed on as they are) and
+    httpReqStr() (everything else, collected in a small buffer). A "count" pass can be made first to
+    get the length of a request body (for the Content-Length).
+
+\code{.c}
+static bool sFooSink(char *data, const int len, void *pArg)
+{
+    // ... use the data
+    return true; // or false to abort
+}
+
+httpReqBegin(&client, false);
+httpReqConst(&client, "GET /foo HTTP/1.1\r\nHost: ");
+httpReqStr(&client, host, false);
+httpReqConst(&client, "\r\n\r\n");
+if (httpReqEnd(&client) == ERR_OK)
+{
+    httpRespRecv(&client, 5000, sFooSink, NULL);
+}
+\endcode
+
+    @{
+*/
+#ifndef __HTTP_H__
+#define __HTTP_H__
+
+#include "stdinc.h"
+
+#include <lwip/api.h>
+
+//! transport write function (flags are NETCONN_COPY or NETCONN_NOCOPY, and NETCONN_MORE if more data follows)
+typedef err_t (*HTTP_WRITE_FUNC_t)(const char *data, const int len, const uint8_t flags);
+
+//! transport receive function (next chunk of data, valid until the next call)
+typedef err_t (*HTTP_RECV_FUNC_t)(const int32_t timeout, char **ppData, int *pLen);
+
+//! response body sink (the data can be modified), return false to abort the response
+typedef bool (*HTTP_SINK_FUNC_t)(char *data, const int len, void *pArg);
+
+//! response feed result
+typedef enum HTTP_RESP_e
+{
+    HTTP_RESP_MORE = 0,  //!< response not complete yet, feed more data
+    HTTP_RESP_DONE,      //!< response complete
+    HTTP_RESP_FAIL,      //!< illegal or unsuccessful (i.e. no 2xx status) response
+    HTTP_RESP_ABORT,     //!< the sink aborted the response
+} HTTP_RESP_t;
+
+//! size of the request buffer (see httpReqStr())
+#define HTTP_REQ_BUF_SIZE 64
+
+//! size of the response header line buffer (longer lines are truncated)
+#define HTTP_LINE_SIZE 48
+
+//! HTTP client state (treat as opaque)
+typedef struct HTTP_CLIENT_s
+{
+    // transport
+    HTTP_WRITE_FUNC_t write;
+    HTTP_RECV_FUNC_t  recv;
+
+    // request
+    bool     count;                   // only count the bytes
+    int      reqLen;                  // number of bytes written (or counted)
+    err_t    err;                     // first error
+    int      bufLen;                  // number of bytes in buf
+    char     buf[HTTP_REQ_BUF_SIZE];
+
+    // response
+    uint8_t  state;                   // parser state
+    int      status;                  // status code (0 = status line not seen yet)
+    bool     chunked;                 // "Transfer-Encoding: chunked"
+    int32_t  remaining;               // remaining bytes of the body or chunk (-1 = until the connection closes)
+    int      lineLen;                 // number of chars in line
+    char     line[HTTP_LINE_SIZE];    // current status, header or chunk size line
+
+    // statistics
+    uint32_t nReq;                    // number of requests
+} HTTP_CLIENT_t;
+
+//! initialise HTTP client
+/*!
+    \param[out] pClient  client state
+    \param[in]  write    transport write function
+    \param[in]  recv     transport receive function
+*/
+void httpInit(HTTP_CLIENT_t *pClient, HTTP_WRITE_FUNC_t write, HTTP_RECV_FUNC_t recv);
+
+//! the transport has (re)connected, i.e. the connection is fresh
+void httpConnected(HTTP_CLIENT_t *pClient);
+
+//! start request
+/*!
+    \param[in,out] pClient  client state
+    \param[in]     count    only count the bytes (see httpReqLen())
+*/
+void httpReqBegin(HTTP_CLIENT_t *pClient, const bool count);
+
+//! add constant string (literal or otherwise static data) to the request
+void httpReqConst(HTTP_CLIENT_t *pClient, const char *str);
+
+//! add string to the request (copied, and optionally url-encoded)
+void httpReqStr(HTTP_CLIENT_t *pClient, const char *str, const bool urlencode);
+
+//! finish request (sends what's pending), this also prepares for the response (see httpRespFeed())
+/*!
+    \returns ERR_OK if the whole request was sent, or the first error
+*/
+err_t httpReqEnd(HTTP_CLIENT_t *pClient);
+
+//! number of bytes written (or counted) since httpReqBegin()
+int httpReqLen(const HTTP_CLIENT_t *pClient);
+
+//! feed response data
+/*!
+    \param[in,out] pClient  client state
+    \param[in]     data     received data (can be modified in place)
+    \param[in]     len      length of received data
+    \param[in]     sink     body sink
+    \param[in]     pArg     argument for the sink
+    \returns #HTTP_RESP_MORE if more data is expected, otherwise the final result
+*/
+HTTP_RESP_t httpRespFeed(HTTP_CLIENT_t *pClient, char *data, const int len, HTTP_SINK_FUNC_t sink, void *pArg);
+
+//! the connection was closed by the server
+/*!
+    \returns #HTTP_RESP_DONE if this ended the response (no "Content-Length" and not chunked), #HTTP_RESP_FAIL otherwise
+*/
+HTTP_RESP_t httpRespClosed(HTTP_CLIENT_t *pClient);
+
+//! receive response (using the transport receive function) and feed it until it has completed
+/*!
+    \param[in,out] pClient  client state
+    \param[in]     timeout  timeout for the whole response [ms]
+    \param[in]     sink     body sink
+    \param[in]     pArg     argument for the sink
+    \returns the final result (never #HTTP_RESP_MORE), timeouts and transport errors are #HTTP_RESP_FAIL
+*/
+HTTP_RESP_t httpRespRecv(HTTP_CLIENT_t *pClient, const uint32_t timeout, HTTP_SINK_FUNC_t sink, void *pArg);
+
+//! make a GET request and receive the response
+/*!
+    \param[in,out] pClient  client state (connected transport)
+    \param[in]     host     host name (for the "Host" header)
+    \param[in]     path     path (without the leading "/", can include the query)
+    \param[in]     auth     HTTP basic auth token, or NULL
+    \param[in]     timeout  timeout for the response [ms]
+    \param[in]     sink     body sink
+    \param[in]     pArg     argument for the sink
+    \returns the final result (see httpRespRecv())
+*/
+HTTP_RESP_t httpGet(HTTP_CLIENT_t *pClient, const char *host, const char *path, const char *auth,
+    const uint32_t timeout, HTTP_SINK_FUNC_t sink, void *pArg);
+
+//! print HTTP client monitor string
+void httpMonStatus(const HTTP_CLIENT_t *pClient);
+
+#endif // __HTTP_H__
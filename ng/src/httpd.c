@@ -0,0 +1,594 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: HTTP status server (see \ref FF_HTTPD)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+*/
+
+#include "stdinc.h"
+
+#include <stdarg.h>
+#include <ctype.h>
+#include <strings.h>
+#include <lwip/api.h>
+
+#include "debug.h"
+#include "stuff.h"
+#include "jenkins.h"
+#include "wifi.h"
+#include "mon.h"
+#include "stacks.h"
+#include "httpd.h"
+#include "httpd_gen.h"
+#include "version_gen.h"
+
+#if (!LWIP_SO_RCVTIMEO)
+#  error We need LWIP_SO_RCVTIMEO!
+#endif
+
+#define HTTPD_PORT          80
+#define HTTPD_REQ_SIZE     256 // [bytes] request buffer (we only need the request line)
+#define HTTPD_REQ_MAX     2048 // [bytes] maximum request size (request line and headers)
+#define HTTPD_BUF_SIZE     512 // [bytes] response buffer
+#define HTTPD_RECV_TIMEOUT 2000 // [ms] timeout for receiving the request
+#define HTTPD_PROV_SIZE   1536 // [bytes] request buffer in the provisioning mode (headers and form)
+
+// connection slot, one per worker task
+typedef struct HTTPD_SLOT_s
+{
+    struct netconn *conn;                // the connection (NULL if idle)
+    err_t           err;                 // first write error
+    int             bufLen;              // number of bytes in buf
+    char            req[HTTPD_REQ_SIZE]; // request (the beginning of it)
+    char            buf[HTTPD_BUF_SIZE]; // response
+} HTTPD_SLOT_t;
+
+static HTTPD_SLOT_t  sHttpdSlots[HTTPD_CONN_NUM];
+static QueueHandle_t sHttpdQueue; // accepted connections for the workers
+
+// statistics
+static volatile uint32_t svHttpdNumConn;
+static volatile uint32_t svHttpdNumBusy;
+static volatile uint32_t svHttpdNumReq;
+static volatile uint32_t svHttpdNumFail;
+
+
+/* ***** response helpers *********************************************************************** */
+
+// send what's in the response buffer
+static void sHttpdFlush(HTTPD_SLOT_t *pSlot)
+{
+    if ( (pSlot->err == ERR_OK) && (pSlot->bufLen > 0) )
+    {
+        pSlot->err = netconn_write(pSlot->conn, pSlot->buf, pSlot->bufLen, NETCONN_COPY);
+    }
+    pSlot->bufLen = 0;
+}
+
+// send data (flags are NETCONN_COPY or NETCONN_NOCOPY, the latter for static data)
+static void sHttpdWrite(HTTPD_SLOT_t *pSlot, const void *data, const int len, const uint8_t flags)
+{
+    sHttpdFlush(pSlot);
+    if ( (pSlot->err == ERR_OK) && (len > 0) )
+    {
+        pSlot->err = netconn_write(pSlot->conn, data, len, flags);
+    }
+}
+
+// format into the response buffer (flushing it if necessary)
+static void sHttpdPrintf(HTTPD_SLOT_t *pSlot, const char *fmt, ...) __PRINTF(2, 3);
+static void sHttpdPrintf(HTTPD_SLOT_t *pSlot, const char *fmt, ...)
+{
+    for (int tries = 0; tries < 2; tries++)
+    {
+        const int size = sizeof(pSlot->buf) - pSlot->bufLen;
+        va_list args;
+        va_start(args, fmt);
+        const int len = vsnprintf(&pSlot->buf[pSlot->bufLen], size, fmt, args);
+        va_end(args);
+        if ( (len >= 0) && (len < size) )
+        {
+            pSlot->bufLen += len;
+            return;
+        }
+        if (pSlot->bufLen == 0)
+        {
+            break;
+        }
+        sHttpdFlush(pSlot);
+    }
+    WARNING("httpd: response too long");
+    pSlot->err = ERR_BUF;
+}
+
+// add JSON string (quoted and escaped) to the response buffer
+static void sHttpdJsonStr(HTTPD_SLOT_t *pSlot, const char *str)
+{
+    sHttpdPrintf(pSlot, "\"");
+    while (*str != '\0')
+    {
+        if (pSlot->bufLen > (int)(sizeof(pSlot->buf) - 3))
+        {
+            sHttpdFlush(pSlot);
+        }
+        const char c = *str++;
+        if ( (c == '"') || (c == '\\') )
+        {
+            pSlot->buf[pSlot->bufLen++] = '\\';
+            pSlot->buf[pSlot->bufLen++] = c;
+        }
+        else
+        {
+            pSlot->buf[pSlot->bufLen++] = (uint8_t)c < ' ' ? ' ' : c;
+        }
+    }
+    sHttpdPrintf(pSlot, "\"");
+}
+
+static void sHttpdHeader(HTTPD_SLOT_t *pSlot, const char *status, const char *type, const int len, const char *xtra)
+{
+    sHttpdPrintf(pSlot, "HTTP/1.0 %s\r\nServer: "FF_PROGRAM"/"FF_BUILDVER"\r\nContent-Type: %s\r\n", status, type);
+    if (len >= 0)
+    {
+        sHttpdPrintf(pSlot, "Content-Length: %d\r\n", len);
+    }
+    sHttpdPrintf(pSlot, "%sConnection: close\r\n\r\n", xtra != NULL ? xtra : "");
+}
+
+static void sHttpdError(HTTPD_SLOT_t *pSlot, const char *status, const bool head)
+{
+    sHttpdHeader(pSlot, status, "text/plain", strlen(status) + 1, NULL);
+    if (!head)
+    {
+        sHttpdPrintf(pSlot, "%s\n", status);
+    }
+    sHttpdFlush(pSlot);
+}
+
+
+/* ***** request handlers *********************************************************************** */
+
+// the single-page UI (or the provisioning form)
+static void sHttpdSendPage(HTTPD_SLOT_t *pSlot, const uint8_t *pkGz, const int size, const bool head)
+{
+    sHttpdHeader(pSlot, "200 OK", "text/html; charset=utf-8", size,
+        "Content-Encoding: gzip\r\nCache-Control: no-cache\r\n");
+    if (!head)
+    {
+        sHttpdWrite(pSlot, pkGz, size, NETCONN_NOCOPY);
+    }
+    sHttpdFlush(pSlot);
+}
+
+// get a field from an "application/x-www-form-urlencoded" form (URL-decoded), returns false if it's
+// not there or too long
+static bool sHttpdFormField(const char *form, const char *name, char *val, const int size)
+{
+    const int nameLen = strlen(name);
+    const char *pkF = form;
+    while ( (pkF != NULL) && ((strncmp(pkF, name, nameLen) != 0) || (pkF[nameLen] != '=')) )
+    {
+        pkF = strchr(pkF, '&');
+        pkF = pkF != NULL ? &pkF[1] : NULL;
+    }
+    if (pkF == NULL)
+    {
+        return false;
+    }
+    int len = 0;
+    for (const char *pkV = &pkF[nameLen + 1]; (*pkV != '\0') && (*pkV != '&'); pkV++)
+    {
+        char c = *pkV;
+        if (c == '+')
+        {
+            c = ' ';
+        }
+        else if ( (c == '%') && isxdigit((int)pkV[1]) && isxdigit((int)pkV[2]) )
+        {
+            const char hex[3] = { pkV[1], pkV[2], '\0' };
+            c = (char)strtol(hex, NULL, 16);
+            pkV += 2;
+        }
+        if (len >= (size - 1))
+        {
+            return false;
+        }
+        val[len++] = c;
+    }
+    val[len] = '\0';
+    return true;
+}
+
+// store the config from the provisioning form
+static void sHttpdProvision(HTTPD_SLOT_t *pSlot, const char *form)
+{
+    char ssid[WIFI_SSID_MAX + 1];
+    char pass[WIFI_PASS_MAX + 1];
+    char urls[WIFI_URLS_MAX + 1];
+    if (!sHttpdFormField(form, "ssid", ssid, sizeof(ssid)) || !sHttpdFormField(form, "pass", pass, sizeof(pass)) ||
+        !sHttpdFormField(form, "urls", urls, sizeof(urls)) || !wifiProvision(ssid, pass, urls))
+    {
+        sHttpdError(pSlot, "400 Bad Request", false);
+        return;
+    }
+    static const char skDone[] = "Saved. The Lämpli closes this network now and connects to yours.\n";
+    sHttpdHeader(pSlot, "200 OK", "text/plain; charset=utf-8", sizeof(skDone) - 1, NULL);
+    sHttpdWrite(pSlot, skDone, sizeof(skDone) - 1, NETCONN_NOCOPY);
+    sHttpdFlush(pSlot);
+}
+
+// {"version":build version,"mon":telemetry (see monGetTelemetry()) or null,"wifi":status (see wifiGetStatusJson()),
+//  "jenkins":{"worst":result,"chs":[[ix,job,server,state,result,age[s] (or -1)],...]}}
+static void sHttpdSendStatus(HTTPD_SLOT_t *pSlot, const bool head)
+{
+    sHttpdHeader(pSlot, "200 OK", "application/json", -1, "Cache-Control: no-store\r\n");
+    if (head)
+    {
+        sHttpdFlush(pSlot);
+        return;
+    }
+
+    // latest monitor telemetry record (copied out, as it's replaced by the next one eventually)
+    sHttpdPrintf(pSlot, "{\"version\":\""FF_BUILDVER"\",\"mon\":");
+    const char *telemetry = monGetTelemetry();
+    if (telemetry != NULL)
+    {
+        sHttpdWrite(pSlot, telemetry, strlen(telemetry), NETCONN_COPY);
+    }
+    else
+    {
+        sHttpdPrintf(pSlot, "null");
+    }
+
+    // wifi status
+    sHttpdPrintf(pSlot, ",\"wifi\":");
+    if ((sizeof(pSlot->buf) - pSlot->bufLen) < 256)
+    {
+        sHttpdFlush(pSlot);
+    }
+    const int wifiLen = wifiGetStatusJson(&pSlot->buf[pSlot->bufLen], sizeof(pSlot->buf) - pSlot->bufLen);
+    if (wifiLen > 0)
+    {
+        pSlot->bufLen += wifiLen;
+    }
+    else
+    {
+        sHttpdPrintf(pSlot, "null");
+    }
+
+    // Jenkins jobs (only the active channels)
+    sHttpdPrintf(pSlot, ",\"jenkins\":{\"chs\":[");
+    const uint32_t now = osGetPosixTime();
+    JENKINS_RESULT_t worst = JENKINS_RESULT_UNKNOWN;
+    bool first = true;
+    for (int chIx = 0; (chIx < JENKINS_MAX_CH) && (pSlot->err == ERR_OK); chIx++)
+    {
+        JENKINS_INFO_t info;
+        if (!jenkinsGetInfo(chIx, &info) || !info.active)
+        {
+            continue;
+        }
+        if (info.result > worst)
+        {
+            worst = info.result;
+        }
+        sHttpdPrintf(pSlot, "%s[%d,", first ? "" : ",", chIx);
+        sHttpdJsonStr(pSlot, info.job);
+        sHttpdPrintf(pSlot, ",");
+        sHttpdJsonStr(pSlot, info.server);
+        sHttpdPrintf(pSlot, ",\"%s\",\"%s\",%d]", jenkinsStateToStr(info.state), jenkinsResultToStr(info.result),
+            (now != 0) && (info.time != 0) ? (int)(now - info.time) : -1);
+        first = false;
+    }
+    sHttpdPrintf(pSlot, "],\"worst\":\"%s\"}}", jenkinsResultToStr(worst));
+    sHttpdFlush(pSlot);
+}
+
+
+/* ***** connection handling ******************************************************************** */
+
+// receive request into buf (the beginning of it, up to the empty line after the headers and whatever
+// came with that), returns the length of the request line and headers (which may be more than what
+// fits into buf), or -1 on error, and the length of the data in buf (which is nul-terminated)
+static int sHttpdRecvRequest(HTTPD_SLOT_t *pSlot, char *buf, const int size, int *pLen)
+{
+    netconn_set_recvtimeout(pSlot->conn, HTTPD_RECV_TIMEOUT);
+
+    // receive until the empty line after the headers
+    static const char skEnd[] = "\r\n\r\n";
+    int reqLen = 0;
+    int total = 0;
+    int endIx = 0;
+    while (skEnd[endIx] != '\0')
+    {
+        struct netbuf *pBuf = NULL;
+        const err_t err = netconn_recv(pSlot->conn, &pBuf);
+        if (err != ERR_OK)
+        {
+            WARNING("httpd: recv failed: %s", lwipErrStr(err));
+            return -1;
+        }
+        do
+        {
+            void *data;
+            uint16_t len;
+            netbuf_data(pBuf, &data, &len);
+            const char *pkData = (const char *)data;
+            for (int ix = 0; ix < len; ix++)
+            {
+                const char c = pkData[ix];
+                if (skEnd[endIx] != '\0')
+                {
+                    endIx = c == skEnd[endIx] ? endIx + 1 : (c == skEnd[0] ? 1 : 0);
+                    total++;
+                }
+                if (reqLen < (size - 1))
+                {
+                    buf[reqLen++] = c;
+                }
+            }
+        }
+        while (netbuf_next(pBuf) >= 0);
+        netbuf_delete(pBuf);
+
+        if (total > HTTPD_REQ_MAX)
+        {
+            WARNING("httpd: request too long");
+            return -1;
+        }
+    }
+    buf[reqLen] = '\0';
+    *pLen = reqLen;
+    return total;
+}
+
+// receive the rest of the body (as given by the Content-Length header) into buf, returns the
+// (nul-terminated) body, or NULL on error (or if it doesn't fit)
+static const char *sHttpdRecvBody(HTTPD_SLOT_t *pSlot, char *buf, const int size, const int hdrLen, int len)
+{
+    if (hdrLen > len)
+    {
+        return NULL;
+    }
+    int bodyLen = -1;
+    for (const char *pkHdr = strstr(buf, "\r\n"); (pkHdr != NULL) && (pkHdr < &buf[hdrLen]); pkHdr = strstr(&pkHdr[2], "\r\n"))
+    {
+        if (strncasecmp(&pkHdr[2], "Content-Length:", 15) == 0)
+        {
+            bodyLen = atoi(&pkHdr[17]);
+            break;
+        }
+    }
+    if ( (bodyLen < 0) || ((hdrLen + bodyLen) > (size - 1)) )
+    {
+        return NULL;
+    }
+    while (len < (hdrLen + bodyLen))
+    {
+        struct netbuf *pBuf = NULL;
+        const err_t err = netconn_recv(pSlot->conn, &pBuf);
+        if (err != ERR_OK)
+        {
+            WARNING("httpd: recv failed: %s", lwipErrStr(err));
+            return NULL;
+        }
+        len += netbuf_copy(pBuf, &buf[len], (hdrLen + bodyLen) - len);
+        netbuf_delete(pBuf);
+    }
+    buf[hdrLen + bodyLen] = '\0';
+    return &buf[hdrLen];
+}
+
+static void sHttpdHandleReq(HTTPD_SLOT_t *pSlot, char *buf, const int size, const bool prov)
+{
+    int len = 0;
+    const int hdrLen = sHttpdRecvRequest(pSlot, buf, size, &len);
+    if (hdrLen < 0)
+    {
+        svHttpdNumFail++;
+        return;
+    }
+    svHttpdNumReq++;
+
+    // the form (before we chop up the request line)
+    const char *body = NULL;
+    if (prov && (strncmp(buf, "POST ", 5) == 0))
+    {
+        body = sHttpdRecvBody(pSlot, buf, size, hdrLen, len);
+        if (body == NULL)
+        {
+            sHttpdError(pSlot, "413 Payload Too Large", false);
+            return;
+        }
+    }
+
+    // split "METHOD /path?query HTTP/1.x"
+    char *method = buf;
+    char *path = strchr(method, ' ');
+    char *end = path != NULL ? strpbrk(&path[1], " ?\r") : NULL;
+    if (end == NULL)
+    {
+        sHttpdError(pSlot, "400 Bad Request", false);
+        return;
+    }
+    *path++ = '\0';
+    *end = '\0';
+    DEBUG("httpd: %s %s", method, path);
+
+    const bool head = strcmp(method, "HEAD") == 0;
+    if ( (body != NULL) && (strcmp(path, "/provision") == 0) )
+    {
+        sHttpdProvision(pSlot, body);
+    }
+    else if (!head && (strcmp(method, "GET") != 0))
+    {
+        sHttpdError(pSlot, "405 Method Not Allowed", false);
+    }
+    else if ( (strcmp(path, "/") == 0) || (strcmp(path, "/index.html") == 0) )
+    {
+        if (prov)
+        {
+            sHttpdSendPage(pSlot, skHttpdProvGz, sizeof(skHttpdProvGz), head);
+        }
+        else
+        {
+            sHttpdSendPage(pSlot, skHttpdIndexGz, sizeof(skHttpdIndexGz), head);
+        }
+    }
+    else if (strcmp(path, "/status.json") == 0)
+    {
+        sHttpdSendStatus(pSlot, head);
+    }
+    // captive portal: send everything else to the form (and make the phone's connectivity checks fail)
+    else if (prov)
+    {
+        sHttpdHeader(pSlot, "302 Found", "text/plain", 0, "Location: http://"WIFI_PROV_IP"/\r\n");
+        sHttpdFlush(pSlot);
+    }
+    else
+    {
+        sHttpdError(pSlot, "404 Not Found", head);
+    }
+}
+
+static void sHttpdHandleConn(HTTPD_SLOT_t *pSlot)
+{
+    // in the provisioning mode we need a bigger request buffer (for the form), but only then
+    const bool prov = wifiIsProvisioning();
+    char *pProvBuf = prov ? malloc(HTTPD_PROV_SIZE) : NULL;
+    if (prov && (pProvBuf == NULL))
+    {
+        sHttpdError(pSlot, "503 Service Unavailable", false);
+        svHttpdNumFail++;
+        return;
+    }
+
+    if (prov)
+    {
+        sHttpdHandleReq(pSlot, pProvBuf, HTTPD_PROV_SIZE, true);
+        free(pProvBuf);
+    }
+    else
+    {
+        sHttpdHandleReq(pSlot, pSlot->req, sizeof(pSlot->req), false);
+    }
+
+    if (pSlot->err != ERR_OK)
+    {
+        WARNING("httpd: send failed: %s", lwipErrStr(pSlot->err));
+        svHttpdNumFail++;
+    }
+}
+
+static void sHttpdWorkerTask(void *pArg)
+{
+    HTTPD_SLOT_t *pSlot = (HTTPD_SLOT_t *)pArg;
+    while (true)
+    {
+        struct netconn *conn;
+        if (xQueueReceive(sHttpdQueue, &conn, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        pSlot->err    = ERR_OK;
+        pSlot->bufLen = 0;
+        pSlot->conn   = conn;
+        sHttpdHandleConn(pSlot);
+        pSlot->conn = NULL;
+        netconn_close(conn);
+        netconn_delete(conn);
+    }
+}
+
+static void sHttpdListenTask(void *pArg)
+{
+    struct netconn *listenConn = netconn_new(NETCONN_TCP);
+    err_t err = listenConn != NULL ? netconn_bind(listenConn, IP_ADDR_ANY, HTTPD_PORT) : ERR_MEM;
+    if (err == ERR_OK)
+    {
+        err = netconn_listen(listenConn);
+    }
+    if (err != ERR_OK)
+    {
+        ERROR("httpd: listen on port %u failed: %s", HTTPD_PORT, lwipErrStr(err));
+        vTaskDelete(NULL);
+    }
+    DEBUG("httpd: listening on port %u", HTTPD_PORT);
+
+    static const char skBusy[] = "HTTP/1.0 503 Service Unavailable\r\nRetry-After: 1\r\nConnection: close\r\n\r\n";
+    while (true)
+    {
+        struct netconn *conn = NULL;
+        err = netconn_accept(listenConn, &conn);
+        if (err != ERR_OK)
+        {
+            WARNING("httpd: accept failed: %s", lwipErrStr(err));
+            osSleep(100);
+            continue;
+        }
+        svHttpdNumConn++;
+
+        // hand over to a worker, or turn the client away if they're all busy
+        if (xQueueSend(sHttpdQueue, &conn, 0) != pdTRUE)
+        {
+            svHttpdNumBusy++;
+            netconn_write(conn, skBusy, sizeof(skBusy) - 1, NETCONN_NOCOPY);
+            netconn_close(conn);
+            netconn_delete(conn);
+        }
+    }
+}
+
+
+/* ***** external interface ********************************************************************* */
+
+void httpdMonStatus(void)
+{
+    int nActive = 0;
+    for (int ix = 0; ix < NUMOF(sHttpdSlots); ix++)
+    {
+        if (sHttpdSlots[ix].conn != NULL)
+        {
+            nActive++;
+        }
+    }
+    DEBUG("mon: httpd: active=%d/%d conns=%u busy=%u req=%u fail=%u ui=%u",
+        nActive, (int)NUMOF(sHttpdSlots), svHttpdNumConn, svHttpdNumBusy, svHttpdNumReq, svHttpdNumFail,
+        (unsigned int)sizeof(skHttpdIndexGz));
+}
+
+void httpdInit(void)
+{
+    DEBUG("httpd: init");
+    memset(sHttpdSlots, 0, sizeof(sHttpdSlots));
+
+    // one pending connection (on top of the ones being served by the workers)
+    static StaticQueue_t sQueue;
+    static uint8_t sQueueBuf[1 * sizeof(struct netconn *)];
+    sHttpdQueue = xQueueCreateStatic(NUMOF(sQueueBuf) / sizeof(struct netconn *), sizeof(struct netconn *), sQueueBuf, &sQueue);
+}
+
+void httpdStart(void)
+{
+    DEBUG("httpd: start");
+
+    static StackType_t sWorkerTaskStacks[HTTPD_CONN_NUM][STACK_SIZE(HTTPD_WORKER)];
+    static StaticTask_t sWorkerTaskTCBs[HTTPD_CONN_NUM];
+    static char sWorkerTaskNames[HTTPD_CONN_NUM][configMAX_TASK_NAME_LEN]; // (for monRegisterStack())
+    for (int ix = 0; ix < HTTPD_CONN_NUM; ix++)
+    {
+        char *name = sWorkerTaskNames[ix];
+        snprintf(name, sizeof(sWorkerTaskNames[ix]), "ff_httpd%d", ix);
+        xTaskCreateStatic(sHttpdWorkerTask, name, NUMOF(sWorkerTaskStacks[ix]), &sHttpdSlots[ix], 1,
+            sWorkerTaskStacks[ix], &sWorkerTaskTCBs[ix]);
+        monRegisterStack(name, "HTTPD_WORKER", NUMOF(sWorkerTaskStacks[ix]));
+    }
+
+    static StackType_t sListenTaskStack[STACK_SIZE(HTTPD)];
+    static StaticTask_t sListenTaskTCB;
+    xTaskCreateStatic(sHttpdListenTask, "ff_httpd", NUMOF(sListenTaskStack), NULL, 1, sListenTaskStack, &sListenTaskTCB);
+    monRegisterStack("ff_httpd", "HTTPD", NUMOF(sListenTaskStack));
+}
+
+// eof
@@ -0,0 +1,45 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: HTTP status server (see \ref FF_HTTPD)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \defgroup FF_HTTPD HTTPD
+    \ingroup FF
+
+    A small HTTP/1.0 server on port 80 for looking at the status in a browser. It serves a single
+    page (src/httpd.html, gzipped at build time) at "/", and the current status (Jenkins jobs, wifi,
+    and the monitor telemetry, see monGetTelemetry()) as JSON at "/status.json".
+
+    Everything is statically allocated: a listener task accepts the connections and hands them to a
+    fixed number of worker tasks (#HTTPD_CONN_NUM), each with its own request and response buffer.
+    Connections that arrive while all workers are busy are answered with "503 Service Unavailable"
+    right away. Requests that don't fit the request buffer or that are not received in time are
+    dropped. Responses are sent with "Connection: close".
+
+    In the provisioning mode (see wifi.h) "/" is the form (src/httpd-prov.html) instead, which is
+    posted to "/provision" (see wifiProvision()), and all other paths are redirected to the form
+    (the captive portal). Only then each request gets a bigger buffer from the heap (for the headers
+    and the form), which is freed right after.
+
+    @{
+*/
+#ifndef __HTTPD_H__
+#define __HTTPD_H__
+
+#include "stdinc.h"
+
+//! number of connections served at the same time (worker tasks)
+#define HTTPD_CONN_NUM 2
+
+//! initialise
+void httpdInit(void);
+
+//! start HTTP server tasks
+void httpdStart(void);
+
+//! print HTTP server monitor string
+void httpdMonStatus(void);
+
+#endif // __HTTPD_H__
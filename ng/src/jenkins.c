@@ -7,13 +7,19 @@
 */
 
 #include "stdinc.h"
+#include <ctype.h>
 
 #include "debug.h"
 #include "stuff.h"
 #include "leds.h"
 #include "config.h"
-#include "tone.h"
+#include "status.h"
+#include "flash.h"
+#include "backend.h"
 #include "jenkins.h"
+#include "trace.h"
+#include "mon.h"
+#include "stacks.h"
 
 /* ***** external interface ********************************************************************* */
 
@@ -29,43 +35,20 @@ static const char * const  skJenkinsResultStrs[] =
     [JENKINS_RESULT_SUCCESS] = "success", [JENKINS_RESULT_FAILURE] "failure",
 };
 
+static STRTAB_t sJenkinsStateTab  = STRTAB(skJenkinsStateStrs);
+static STRTAB_t sJenkinsResultTab = STRTAB(skJenkinsResultStrs);
+
 JENKINS_STATE_t jenkinsStrToState(const char *str)
 {
-    JENKINS_STATE_t state = JENKINS_STATE_UNKNOWN;
-    if (strcmp(str, skJenkinsStateStrs[JENKINS_STATE_IDLE]) == 0)
-    {
-        state = JENKINS_STATE_IDLE;
-    }
-    else if (strcmp(str, skJenkinsStateStrs[JENKINS_STATE_RUNNING]) == 0)
-    {
-        state = JENKINS_STATE_RUNNING;
-    }
-    else if (strcmp(str, skJenkinsStateStrs[JENKINS_STATE_OFF]) == 0)
-    {
-        state = JENKINS_STATE_OFF;
-    }
-    return state;
+    return (JENKINS_STATE_t)strTabFind(&sJenkinsStateTab, str, -1, JENKINS_STATE_UNKNOWN);
 }
 
 JENKINS_RESULT_t jenkinsStrToResult(const char *str)
 {
-    JENKINS_RESULT_t result = JENKINS_RESULT_UNKNOWN;
-    if (strcmp(str, skJenkinsResultStrs[JENKINS_RESULT_FAILURE]) == 0)
-    {
-        result = JENKINS_RESULT_FAILURE;
-    }
-    else if (strcmp(str, skJenkinsResultStrs[JENKINS_RESULT_UNSTABLE]) == 0)
-    {
-        result = JENKINS_RESULT_UNSTABLE;
-    }
-    else if (strcmp(str, skJenkinsResultStrs[JENKINS_RESULT_SUCCESS]) == 0)
-    {
-        result = JENKINS_RESULT_SUCCESS;
-    }
-    return result;
+    return (JENKINS_RESULT_t)strTabFind(&sJenkinsResultTab, str, -1, JENKINS_RESULT_UNKNOWN);
 }
 
-const char *sJenkinsStateToStr(const JENKINS_STATE_t state)
+const char *jenkinsStateToStr(const JENKINS_STATE_t state)
 {
     switch (state)
     {
@@ -77,7 +60,7 @@ const char *sJenkinsStateToStr(const JENKINS_STATE_t state)
     return "???";
 }
 
-const char *sJenkinsResultToStr(const JENKINS_RESULT_t result)
+const char *jenkinsResultToStr(const JENKINS_RESULT_t result)
 {
     switch (result)
     {
@@ -90,59 +73,210 @@ const char *sJenkinsResultToStr(const JENKINS_RESULT_t result)
 }
 
 
-typedef enum JENKINS_MSG_TYPE_e
+// server names are interned: each channel only stores a small handle into this pool of (reference
+// counted) names, as most channels share the same two or three servers
+#define JENKINS_MAX_SERVERS 8
+#define JENKINS_SERVER_NONE 0 // handle for no (or no more space for the) server name
+typedef struct JENKINS_SERVER_s
 {
-    JENKINS_MSG_TYPE_INFO,
-    JENKINS_MSG_TYPE_CLEAR_ALL,
-    JENKINS_MSG_TYPE_UNKNOWN_ALL,
-} JENKINS_MSG_TYPE_t;
+    char    name[JENKINS_SERVER_LEN];
+    uint8_t refs;
+} JENKINS_SERVER_t;
+static JENKINS_SERVER_t sJenkinsServers[JENKINS_MAX_SERVERS];
 
-typedef struct JENKINS_MSG_s
+// get handle for server name (must be called in a critical section)
+static uint8_t sJenkinsServerIntern(const char *name)
 {
-    JENKINS_MSG_TYPE_t type;
-    union
+    int freeIx = -1;
+    for (int ix = 0; ix < NUMOF(sJenkinsServers); ix++)
     {
-        JENKINS_INFO_t info;
-    };
-} JENKINS_MSG_t;
+        JENKINS_SERVER_t *pServer = &sJenkinsServers[ix];
+        if (pServer->refs == 0)
+        {
+            if (freeIx < 0)
+            {
+                freeIx = ix;
+            }
+        }
+        else if (strncmp(pServer->name, name, sizeof(pServer->name)) == 0)
+        {
+            pServer->refs++;
+            return ix + 1;
+        }
+    }
+    if (freeIx >= 0)
+    {
+        JENKINS_SERVER_t *pServer = &sJenkinsServers[freeIx];
+        strncpy(pServer->name, name, sizeof(pServer->name));
+        pServer->name[sizeof(pServer->name) - 1] = '\0';
+        pServer->refs = 1;
+        return freeIx + 1;
+    }
+    return JENKINS_SERVER_NONE;
+}
 
-static QueueHandle_t sJenkinsMsgQueue;
+// add and remove references to interned server names (must be called in a critical section)
+static void sJenkinsServerRef(const uint8_t handle)
+{
+    if (handle != JENKINS_SERVER_NONE)
+    {
+        sJenkinsServers[handle - 1].refs++;
+    }
+}
+
+static void sJenkinsServerUnref(const uint8_t handle)
+{
+    if ( (handle != JENKINS_SERVER_NONE) && (sJenkinsServers[handle - 1].refs > 0) )
+    {
+        sJenkinsServers[handle - 1].refs--;
+    }
+}
+
+static const char *sJenkinsServerName(const uint8_t handle)
+{
+    return handle != JENKINS_SERVER_NONE ? sJenkinsServers[handle - 1].name : "?";
+}
+
+// compact channel record
+typedef struct JENKINS_CH_s
+{
+    char     job[JENKINS_JOBNAME_LEN];  // job name
+    int32_t  time;                      // timestamp
+    uint8_t  server;                    // server name handle (see sJenkinsServerIntern())
+    bool     active;                    // active, i.e. all other fields valid
+    uint8_t  state;                     // JENKINS_STATE_t
+    uint8_t  result;                    // JENKINS_RESULT_t
+} JENKINS_CH_t;
+
+// channel table shared between the writers (backend, via the functions below) and the Jenkins task, and a
+// dirty flag per channel, all protected by a (short) critical section; the writers update the entries in
+// place and notify the task, which then processes all dirty channels in one go (see sJenkinsUpdate())
+static JENKINS_CH_t      sJenkinsShared[JENKINS_MAX_CH];
+static volatile uint32_t svJenkinsSharedDirty[(JENKINS_MAX_CH + 31) / 32];
+static TaskHandle_t      sJenkinsTaskHandle;
+
+#define JENKINS_DIRTY_SET(ix)   svJenkinsSharedDirty[(ix) / 32] |=  BIT((ix) % 32)
+#define JENKINS_DIRTY_CLR(ix)   svJenkinsSharedDirty[(ix) / 32] &= ~BIT((ix) % 32)
+#define JENKINS_DIRTY_IS(ix)  ((svJenkinsSharedDirty[(ix) / 32] &   BIT((ix) % 32)) != 0)
+
+static void sJenkinsNotify(void)
+{
+    if (sJenkinsTaskHandle != NULL)
+    {
+        xTaskNotifyGive(sJenkinsTaskHandle);
+    }
+}
 
 void jenkinsSetInfo(const JENKINS_INFO_t *pkInfo)
 {
-    if (pkInfo != NULL)
+    if ( (pkInfo != NULL) && (pkInfo->chIx < NUMOF(sJenkinsShared)) )
+    {
+        const int ix = pkInfo->chIx;
+        TRACE(TRACE_EV_JENKINS_SET, ix);
+        bool serverOk = true;
+        CS_ENTER;
+        JENKINS_CH_t *pCh = &sJenkinsShared[ix];
+        sJenkinsServerUnref(pCh->server);
+        memset(pCh, 0, sizeof(*pCh));
+        if (pkInfo->active)
+        {
+            memcpy(pCh->job, pkInfo->job, sizeof(pCh->job));
+            pCh->job[sizeof(pCh->job) - 1] = '\0';
+            pCh->time   = pkInfo->time;
+            pCh->server = sJenkinsServerIntern(pkInfo->server);
+            pCh->active = true;
+            pCh->state  = pkInfo->state;
+            pCh->result = pkInfo->result;
+            serverOk = pCh->server != JENKINS_SERVER_NONE;
+        }
+        JENKINS_DIRTY_SET(ix);
+        CS_LEAVE;
+        if (!serverOk)
+        {
+            WARNING("jenkins: too many servers for #%02d", ix);
+        }
+        sJenkinsNotify();
+    }
+}
+
+void jenkinsSetState(const int chIx, const JENKINS_STATE_t state, const JENKINS_RESULT_t result, const int32_t time)
+{
+    if ( (chIx >= 0) && (chIx < NUMOF(sJenkinsShared)) )
     {
-        JENKINS_MSG_t msg;
-        memset(&msg, 0, sizeof(msg));
-        msg.type = JENKINS_MSG_TYPE_INFO;
-        memcpy(&msg.info, pkInfo, sizeof(msg.info));
-        if (xQueueSend(sJenkinsMsgQueue, &msg, 10) != pdTRUE)
+        bool active;
+        CS_ENTER;
+        JENKINS_CH_t *pCh = &sJenkinsShared[chIx];
+        active = pCh->active;
+        if (active)
+        {
+            pCh->state  = state;
+            pCh->result = result;
+            pCh->time   = time;
+            JENKINS_DIRTY_SET(chIx);
+        }
+        CS_LEAVE;
+        if (active)
+        {
+            sJenkinsNotify();
+        }
+        else
         {
-            ERROR("jenkins: queue full");
+            WARNING("jenkins: state for unused #%02d", chIx);
         }
     }
 }
 
 void jenkinsClearAll(void)
 {
-    JENKINS_MSG_t msg;
-    memset(&msg, 0, sizeof(msg));
-    msg.type = JENKINS_MSG_TYPE_CLEAR_ALL;
-    if (xQueueSend(sJenkinsMsgQueue, &msg, 10) != pdTRUE)
+    PRINT("jenkins: clear all");
+    CS_ENTER;
+    for (int ix = 0; ix < NUMOF(sJenkinsShared); ix++)
     {
-        ERROR("jenkins: queue full");
+        sJenkinsServerUnref(sJenkinsShared[ix].server);
+        memset(&sJenkinsShared[ix], 0, sizeof(sJenkinsShared[ix]));
+        JENKINS_DIRTY_SET(ix);
     }
+    CS_LEAVE;
+    sJenkinsNotify();
 }
 
 void jenkinsUnknownAll(void)
 {
-    JENKINS_MSG_t msg;
-    memset(&msg, 0, sizeof(msg));
-    msg.type = JENKINS_MSG_TYPE_UNKNOWN_ALL;
-    if (xQueueSend(sJenkinsMsgQueue, &msg, 10) != pdTRUE)
+    PRINT("jenkins: unknown all");
+    CS_ENTER;
+    for (int ix = 0; ix < NUMOF(sJenkinsShared); ix++)
+    {
+        if (sJenkinsShared[ix].active)
+        {
+            sJenkinsShared[ix].state = JENKINS_STATE_UNKNOWN;
+            JENKINS_DIRTY_SET(ix);
+        }
+    }
+    CS_LEAVE;
+    sJenkinsNotify();
+}
+
+bool jenkinsGetInfo(const int chIx, JENKINS_INFO_t *pInfo)
+{
+    if ( (chIx < 0) || (chIx >= NUMOF(sJenkinsShared)) || (pInfo == NULL) )
     {
-        ERROR("jenkins: queue full");
+        return false;
     }
+    memset(pInfo, 0, sizeof(*pInfo));
+    pInfo->chIx = chIx;
+    CS_ENTER;
+    const JENKINS_CH_t *pkCh = &sJenkinsShared[chIx];
+    if (pkCh->active)
+    {
+        memcpy(pInfo->job, pkCh->job, sizeof(pInfo->job));
+        strncpy(pInfo->server, sJenkinsServerName(pkCh->server), sizeof(pInfo->server) - 1);
+        pInfo->time   = pkCh->time;
+        pInfo->active = true;
+        pInfo->state  = pkCh->state;
+        pInfo->result = pkCh->result;
+    }
+    CS_LEAVE;
+    return true;
 }
 
 
@@ -255,235 +389,486 @@ static const LEDS_PARAM_t *sJenkinsLedStateFromJenkins(const JENKINS_STATE_t sta
     return pRes;
 }
 
-// current info for all channels
-static JENKINS_INFO_t sJenkinsInfo[JENKINS_MAX_CH];
-
-// current dirty flag for all channels
-static bool sJenkinsInfoDirty[NUMOF(sJenkinsInfo)];
+// current info for all channels (the Jenkins task's copy of sJenkinsShared)
+static JENKINS_CH_t sJenkinsInfo[JENKINS_MAX_CH];
 
 // curent worst result
 static JENKINS_RESULT_t sJenkinsWorstResult;
 
-// store info
-static void sJenkinsStoreInfo(const JENKINS_INFO_t *pkInfo)
+// number of channels per result (all channels, i.e. unused ones count as JENKINS_RESULT_UNKNOWN), updated
+// whenever a channel changes, so that the worst result is readily available
+static int sJenkinsResultCount[JENKINS_RESULT_FAILURE + 1] = { [JENKINS_RESULT_UNKNOWN] = JENKINS_MAX_CH };
+
+// channels that have changed since the last jenkinsMonStatus() (bitmask)
+static uint32_t sJenkinsMonChanged[(JENKINS_MAX_CH + 31) / 32];
+
+static JENKINS_RESULT_t sJenkinsWorstFromCount(void)
 {
-    // store new info
-    JENKINS_INFO_t *pInfo = NULL;
-    if (pkInfo->chIx < NUMOF(sJenkinsInfo))
+    JENKINS_RESULT_t worstResult = JENKINS_RESULT_FAILURE;
+    while ( (worstResult > JENKINS_RESULT_UNKNOWN) && (sJenkinsResultCount[worstResult] == 0) )
     {
-        pInfo = &sJenkinsInfo[pkInfo->chIx];
-        memcpy(pInfo, pkInfo, sizeof(*pInfo));
-        if (!pInfo->active)
+        worstResult--;
+    }
+    return worstResult;
+}
+
+// event subscribers
+static JENKINS_EVENT_FUNC_t sJenkinsEventFuncs[JENKINS_MAX_SUBS];
+static void *sJenkinsEventArgs[JENKINS_MAX_SUBS];
+
+bool jenkinsSubscribe(JENKINS_EVENT_FUNC_t func, void *pArg)
+{
+    for (int ix = 0; ix < NUMOF(sJenkinsEventFuncs); ix++)
+    {
+        if (sJenkinsEventFuncs[ix] == NULL)
         {
-            const int ix = pInfo->chIx;
-            memset(pInfo, 0, sizeof(*pInfo));
-            pInfo->chIx = ix;
+            sJenkinsEventArgs[ix] = pArg;
+            sJenkinsEventFuncs[ix] = func;
+            return true;
         }
-        sJenkinsInfoDirty[pkInfo->chIx] = true;
     }
+    ERROR("jenkins: too many subscribers");
+    return false;
+}
 
-    // inform
-    if (pInfo != NULL)
+static const char * const skJenkinsEventStrs[] =
+{
+    [JENKINS_EVENT_FIRST_FAILURE]  = "first failure",
+    [JENKINS_EVENT_FIRST_UNSTABLE] = "first unstable",
+    [JENKINS_EVENT_ALL_GREEN]      = "all green again",
+};
+
+static void sJenkinsEvent(const JENKINS_EVENT_t event)
+{
+    PRINT("jenkins: event %s", skJenkinsEventStrs[event]);
+    for (int ix = 0; ix < NUMOF(sJenkinsEventFuncs); ix++)
     {
-        if (pInfo->active)
+        if (sJenkinsEventFuncs[ix] != NULL)
         {
-            const char *state  = sJenkinsStateToStr(pInfo->state);
-            const char *result = sJenkinsResultToStr(pInfo->result);
-            const uint32_t now = osGetPosixTime();
-            const uint32_t age = now - pInfo->time;
-            PRINT("jenkins: info: #%02d %-"STRINGIFY(JENKINS_JOBNAME_LEN)"s %-"STRINGIFY(JENKINS_SERVER_LEN)"s %-7s %-8s %6.1fh",
-                pInfo->chIx, pInfo->job, pInfo->server, state, result, (double)age / 3600.0);
+            sJenkinsEventFuncs[ix](event, sJenkinsEventArgs[ix]);
+        }
+    }
+}
+
+// play sound if we changed from failure/warning to success or from success/warning to failure
+// TODO: play more sounds if CONFIG_NOISE_MORE
+// FIXME: also check for state == idle?
+static void sJenkinsEventNoise(const JENKINS_EVENT_t event, void *pArg)
+{
+    switch (event)
+    {
+        case JENKINS_EVENT_FIRST_FAILURE:
+            statusMelody("ImperialShort");
+            break;
+        case JENKINS_EVENT_ALL_GREEN:
+            statusMelody("IndianaShort");
+            break;
+        case JENKINS_EVENT_FIRST_UNSTABLE:
+            break;
+    }
+}
+
+// print info (compact, no padding and no floating point, this is called for every change)
+static void sJenkinsPrintInfo(const int chIx, const JENKINS_CH_t *pkCh)
+{
+    if (pkCh->active)
+    {
+        const char *state  = jenkinsStateToStr(pkCh->state);
+        const char *result = jenkinsResultToStr(pkCh->result);
+        const uint32_t now = osGetPosixTime();
+        if ( (now != 0) && (pkCh->time != 0) && (now >= (uint32_t)pkCh->time) )
+        {
+            const uint32_t age = now - pkCh->time;
+            PRINT("jenkins: info: #%02d %s %s %uh%02um %s@%s", chIx, state, result,
+                age / 3600, (age / 60) % 60, pkCh->job, sJenkinsServerName(pkCh->server));
         }
         else
         {
-            PRINT("jenkins: info: #%02d <unused>", pInfo->chIx);
+            PRINT("jenkins: info: #%02d %s %s ? %s@%s", chIx, state, result,
+                pkCh->job, sJenkinsServerName(pkCh->server));
         }
     }
+    else
+    {
+        PRINT("jenkins: info: #%02d <unused>", chIx);
+    }
 }
 
-// clear all info
-static void sJenkinsClearAll(void)
+// full dump of the channel table (see jenkinsDump()), a few channels at a time (in the Jenkins task)
+// so that it doesn't overflow the debug output buffer
+#define JENKINS_DUMP_CHUNK   4 // channels per chunk
+#define JENKINS_DUMP_PERIOD 50 // [ms] between chunks
+
+static volatile bool sJenkinsDumpReq; // dump requested
+static int           sJenkinsDumpIx = -1; // next channel to dump, -1 if none
+
+static void sJenkinsDumpNext(void)
 {
-    PRINT("jenkins: clear all");
-    memset(&sJenkinsInfo, 0, sizeof(sJenkinsInfo));
-    for (int ix = 0; ix < NUMOF(sJenkinsInfo); ix++)
+    if (sJenkinsDumpReq)
+    {
+        sJenkinsDumpReq = false;
+        sJenkinsDumpIx = 0;
+        PRINT("jenkins: dump: %d channels", (int)NUMOF(sJenkinsInfo));
+    }
+    if (sJenkinsDumpIx < 0)
+    {
+        return;
+    }
+    for (int n = 0; (n < JENKINS_DUMP_CHUNK) && (sJenkinsDumpIx < NUMOF(sJenkinsInfo)); n++)
     {
-        sJenkinsInfoDirty[ix] = true;
+        sJenkinsPrintInfo(sJenkinsDumpIx, &sJenkinsInfo[sJenkinsDumpIx]);
+        sJenkinsDumpIx++;
+    }
+    if (sJenkinsDumpIx >= NUMOF(sJenkinsInfo))
+    {
+        sJenkinsDumpIx = -1;
     }
 }
 
-// set all channels to state unknown
-static void sJenkinsUnknownAll(void)
+// build duration tracking, exponentially smoothed, in fixed-point
+#define JENKINS_DUR_SHIFT           4 // fractional bits of the average duration
+#define JENKINS_DUR_ALPHA           2 // smoothing: average += (duration - average) / 2^JENKINS_DUR_ALPHA
+#define JENKINS_DUR_MAX         86400 // [s] ignore (implausibly) long builds
+#define JENKINS_PROGRESS_PERIOD  5000 // [ms] progress LED update period
+
+typedef struct JENKINS_DUR_s
 {
-    PRINT("jenkins: unknown all");
-    for (int ix = 0; ix < NUMOF(sJenkinsInfo); ix++)
+    int32_t  runStart;  // [s] start of the current build (0 = not running)
+    uint32_t avgDur;    // [s * 2^JENKINS_DUR_SHIFT] average build duration (0 = unknown)
+} JENKINS_DUR_t;
+static JENKINS_DUR_t sJenkinsDur[JENKINS_MAX_CH];
+
+// track build start and duration on channel changes
+static void sJenkinsTrackDuration(const int ix, const uint8_t oldState, const bool newJob)
+{
+    JENKINS_DUR_t *pDur = &sJenkinsDur[ix];
+    const JENKINS_CH_t *pkCh = &sJenkinsInfo[ix];
+    if (newJob || !pkCh->active)
+    {
+        memset(pDur, 0, sizeof(*pDur));
+        return;
+    }
+
+    // build started
+    if (pkCh->state == JENKINS_STATE_RUNNING)
     {
-        if (sJenkinsInfo[ix].active)
+        if ( (oldState != JENKINS_STATE_RUNNING) || (pDur->runStart == 0) )
         {
-            sJenkinsInfo[ix].state = JENKINS_STATE_UNKNOWN;
-            sJenkinsInfoDirty[ix] = true;
+            pDur->runStart = pkCh->time;
         }
     }
+    // build finished
+    else
+    {
+        if ( (oldState == JENKINS_STATE_RUNNING) && (pkCh->state == JENKINS_STATE_IDLE) && (pDur->runStart != 0) )
+        {
+            const int32_t dur = pkCh->time - pDur->runStart;
+            if ( (dur > 0) && (dur < JENKINS_DUR_MAX) )
+            {
+                const int32_t durFp = dur << JENKINS_DUR_SHIFT;
+                pDur->avgDur = pDur->avgDur == 0 ? durFp :
+                    (int32_t)pDur->avgDur + ((durFp - (int32_t)pDur->avgDur) >> JENKINS_DUR_ALPHA);
+                DEBUG("jenkins: #%02d duration %ds, average %us", ix, dur, pDur->avgDur >> JENKINS_DUR_SHIFT);
+            }
+        }
+        pDur->runStart = 0;
+    }
 }
 
-// update all dirty channels, re-calculate worst result, play sounds
-void sJenkinsUpdate(void)
+// estimated progress (0..255) of running build, -1 if unknown
+static int sJenkinsProgress(const int ix)
 {
-    DEBUG("jenkins: update");
+    const JENKINS_DUR_t *pkDur = &sJenkinsDur[ix];
+    if ( (pkDur->runStart == 0) || (pkDur->avgDur == 0) )
+    {
+        return -1;
+    }
+    const int32_t elapsed = CLIP((int32_t)osGetPosixTime() - pkDur->runStart, 0, JENKINS_DUR_MAX);
+    const uint32_t progress = ((uint32_t)elapsed << (JENKINS_DUR_SHIFT + 8)) / pkDur->avgDur;
+    return MIN(progress, 255);
+}
+
+// LED state tag for the effect programs (see leds.h)
+#define JENKINS_LED_TAG(_state, _result) ( (((_state) + 1) << 4) | (_result) )
 
-    // update LEDs
+// set LED for channel
+static void sJenkinsSetLed(const int ix)
+{
+    const JENKINS_CH_t *pkInfo = &sJenkinsInfo[ix];
+    const JENKINS_STATE_t  state  = pkInfo->active ? pkInfo->state  : JENKINS_STATE_UNKNOWN;
+    const JENKINS_RESULT_t result = pkInfo->active ? pkInfo->result : JENKINS_RESULT_UNKNOWN;
+    LEDS_PARAM_t param = *sJenkinsLedStateFromJenkins(state, result);
+    param.tag = JENKINS_LED_TAG(state, result);
+    const int progress = state == JENKINS_STATE_RUNNING ? sJenkinsProgress(ix) : -1;
+    if ( (progress >= 0) && (param.fx == LEDS_FX_PULSE) )
+    {
+        param.fx = LEDS_FX_PROGRESS;
+        param.progress = progress;
+    }
+    ledsSetState(ix, &param);
+}
+
+// update progress of running builds
+static void sJenkinsUpdateProgress(void)
+{
     for (int ix = 0; ix < NUMOF(sJenkinsInfo); ix++)
     {
-        if (sJenkinsInfoDirty[ix])
+        if ( sJenkinsInfo[ix].active && (sJenkinsInfo[ix].state == JENKINS_STATE_RUNNING) &&
+             (sJenkinsDur[ix].avgDur != 0) )
         {
-            sJenkinsInfoDirty[ix] = false;
-            const JENKINS_INFO_t *pkInfo = &sJenkinsInfo[ix];
-            if (pkInfo->active)
-            {
-                ledsSetState(ix, sJenkinsLedStateFromJenkins(pkInfo->state, pkInfo->result));
-            }
-            else
+            sJenkinsSetLed(ix);
+        }
+    }
+}
+
+// last-known state snapshot stored in flash (see flash.c), restored on boot (see jenkinsInit())
+#define JENKINS_SNAP_PERIOD 60000 // [ms] minimal time between snapshot writes
+
+typedef struct JENKINS_SNAP_CH_s
+{
+    int32_t  time;
+    uint8_t  active;
+    uint8_t  state;
+    uint8_t  result;
+    uint8_t  pad;
+} JENKINS_SNAP_CH_t;
+
+typedef struct JENKINS_SNAP_s
+{
+    JENKINS_SNAP_CH_t ch[JENKINS_MAX_CH];
+} JENKINS_SNAP_t;
+
+static JENKINS_SNAP_t sJenkinsSnap;        // current snapshot (as loaded, saved, or to be saved)
+static bool           sJenkinsSnapDirty;   // snapshot has (real) changes
+static uint32_t       sJenkinsSnapLastSave;
+
+// update snapshot from channel, only real changes (i.e. no timestamp only updates, and no unknown states
+// or cleared channels while we're not connected to the backend) make it dirty
+static void sJenkinsSnapUpdate(const int ix)
+{
+    const JENKINS_CH_t *pkCh = &sJenkinsInfo[ix];
+    JENKINS_SNAP_CH_t *pSnap = &sJenkinsSnap.ch[ix];
+    if (pkCh->active)
+    {
+        if (pkCh->state != JENKINS_STATE_UNKNOWN)
+        {
+            if ( !pSnap->active || (pSnap->state != pkCh->state) || (pSnap->result != pkCh->result) )
             {
-                ledsSetState(ix, sJenkinsLedStateFromJenkins(JENKINS_STATE_UNKNOWN, JENKINS_RESULT_UNKNOWN));
+                pSnap->active = true;
+                pSnap->state  = pkCh->state;
+                pSnap->result = pkCh->result;
+                sJenkinsSnapDirty = true;
             }
+            pSnap->time = pkCh->time;
+        }
+    }
+    else if (pSnap->active && backendIsConnected())
+    {
+        memset(pSnap, 0, sizeof(*pSnap));
+        sJenkinsSnapDirty = true;
+    }
+}
+
+// save snapshot if necessary and not too often
+static void sJenkinsSnapSave(void)
+{
+    const uint32_t now = osTime();
+    if ( sJenkinsSnapDirty && ((sJenkinsSnapLastSave == 0) || ((now - sJenkinsSnapLastSave) >= JENKINS_SNAP_PERIOD)) )
+    {
+        flashSnapSave(FLASH_SNAP_JENKINS, &sJenkinsSnap, sizeof(sJenkinsSnap));
+        sJenkinsSnapDirty = false;
+        sJenkinsSnapLastSave = now;
+    }
+}
+
+// restore channels from snapshot, shown as stale (state unknown) until the backend tells us more
+static void sJenkinsSnapRestore(void)
+{
+    if (!flashSnapLoad(FLASH_SNAP_JENKINS, &sJenkinsSnap, sizeof(sJenkinsSnap)))
+    {
+        memset(&sJenkinsSnap, 0, sizeof(sJenkinsSnap));
+        return;
+    }
+    int nRestored = 0;
+    for (int ix = 0; ix < NUMOF(sJenkinsSnap.ch); ix++)
+    {
+        const JENKINS_SNAP_CH_t *pkSnap = &sJenkinsSnap.ch[ix];
+        if (pkSnap->active)
+        {
+            JENKINS_INFO_t info;
+            memset(&info, 0, sizeof(info));
+            info.chIx   = ix;
+            info.active = true;
+            info.state  = JENKINS_STATE_UNKNOWN;
+            info.result = pkSnap->result;
+            info.time   = pkSnap->time;
+            jenkinsSetInfo(&info);
+            nRestored++;
         }
     }
+    PRINT("jenkins: restored %d channels", nRestored);
+}
+
+// update all dirty channels, re-calculate worst result, play sounds
+void sJenkinsUpdate(void)
+{
+    DEBUG("jenkins: update");
 
-    // find worst result
-    JENKINS_RESULT_t worstResult = JENKINS_RESULT_UNKNOWN;
+    // update LEDs of all dirty channels (copying one channel at a time to keep the critical sections short)
     for (int ix = 0; ix < NUMOF(sJenkinsInfo); ix++)
     {
-        const JENKINS_INFO_t *pkInfo = &sJenkinsInfo[ix];
-        if (pkInfo->result >= worstResult)
+        bool dirty = false;
+        bool newJob = false;
+        const uint8_t oldResult = sJenkinsInfo[ix].result;
+        const uint8_t oldState  = sJenkinsInfo[ix].state;
+        CS_ENTER;
+        if (JENKINS_DIRTY_IS(ix))
         {
-            worstResult = pkInfo->result;
+            TRACE(TRACE_EV_JENKINS_UPDATE, ix);
+            JENKINS_DIRTY_CLR(ix);
+            newJob = strncmp(sJenkinsInfo[ix].job, sJenkinsShared[ix].job, sizeof(sJenkinsInfo[ix].job)) != 0;
+            // (our copy holds a reference to the server name, too)
+            sJenkinsServerUnref(sJenkinsInfo[ix].server);
+            memcpy(&sJenkinsInfo[ix], &sJenkinsShared[ix], sizeof(sJenkinsInfo[ix]));
+            sJenkinsServerRef(sJenkinsInfo[ix].server);
+            dirty = true;
+        }
+        CS_LEAVE;
+        if (dirty)
+        {
+            const JENKINS_CH_t *pkInfo = &sJenkinsInfo[ix];
+            sJenkinsResultCount[oldResult]--;
+            sJenkinsResultCount[pkInfo->result]++;
+            CS_ENTER;
+            sJenkinsMonChanged[ix / 32] |= BIT(ix % 32);
+            CS_LEAVE;
+            sJenkinsPrintInfo(ix, pkInfo);
+            sJenkinsTrackDuration(ix, oldState, newJob);
+            sJenkinsSnapUpdate(ix);
+            sJenkinsSetLed(ix);
         }
     }
-    DEBUG("jenkins: worst is now %s (was %s)", sJenkinsResultToStr(worstResult), sJenkinsResultToStr(sJenkinsWorstResult));
 
-    // play sound if we changed from failure/warning to success or from success/warning to failure
-    // TODO: play more sounds if CONFIG_NOISE_MORE
-    // FIXME: also check for state == idle?
-    if (sJenkinsWorstResult != JENKINS_RESULT_UNKNOWN)
+    // worst result and transitions (but not from the initial or a cleared state)
+    const JENKINS_RESULT_t worstResult = sJenkinsWorstFromCount();
+    DEBUG("jenkins: worst is now %s (was %s)", jenkinsResultToStr(worstResult), jenkinsResultToStr(sJenkinsWorstResult));
+    if ( (sJenkinsWorstResult != JENKINS_RESULT_UNKNOWN) && (worstResult != sJenkinsWorstResult) )
     {
-        if (worstResult != sJenkinsWorstResult)
+        switch (worstResult)
         {
-            switch (worstResult)
-            {
-                case JENKINS_RESULT_FAILURE:
-                    PRINT("jenkins: failure!");
-                    if (configGetNoise() >= CONFIG_NOISE_MORE)
-                    {
-                        toneStop();
-                        toneBuiltinMelody("ImperialShort");
-                    }
-                    break;
-                case JENKINS_RESULT_SUCCESS:
-                    PRINT("jenkins: success!");
-                    if (configGetNoise() >= CONFIG_NOISE_MORE)
-                    {
-                        toneStop();
-                        toneBuiltinMelody("IndianaShort");
-                    }
-                    break;
-                case JENKINS_RESULT_UNSTABLE:
-                    PRINT("jenkins: unstable!");
-                    break;
-                default:
-                    break;
-            }
+            case JENKINS_RESULT_FAILURE:
+                sJenkinsEvent(JENKINS_EVENT_FIRST_FAILURE);
+                break;
+            case JENKINS_RESULT_SUCCESS:
+                sJenkinsEvent(JENKINS_EVENT_ALL_GREEN);
+                break;
+            case JENKINS_RESULT_UNSTABLE:
+                sJenkinsEvent(JENKINS_EVENT_FIRST_UNSTABLE);
+                break;
+            case JENKINS_RESULT_UNKNOWN:
+                break;
         }
     }
     sJenkinsWorstResult = worstResult;
 }
 
-// Jenkins task, waits for messages and updates LEDs accordingly
+// Jenkins task, waits for notifications and updates LEDs accordingly (and the progress of running builds)
 static void sJenkinsTask(void *pArg)
 {
+    // show initial (restored) state
+    sJenkinsUpdate();
+
     while (true)
     {
-        static JENKINS_MSG_t msg;
-        static bool doUpdate;
-
-        while (xQueueReceive(sJenkinsMsgQueue, &msg, 100))
+        const bool dumping = sJenkinsDumpIx >= 0;
+        if (ulTaskNotifyTake(pdTRUE, MS2TICKS(dumping ? JENKINS_DUMP_PERIOD : JENKINS_PROGRESS_PERIOD)) > 0)
         {
-            switch (msg.type)
-            {
-                case JENKINS_MSG_TYPE_INFO:
-                    sJenkinsStoreInfo(&msg.info);
-                    doUpdate = true;
-                    break;
-                case JENKINS_MSG_TYPE_CLEAR_ALL:
-                    sJenkinsClearAll();
-                    doUpdate = true;
-                    break;
-                case JENKINS_MSG_TYPE_UNKNOWN_ALL:
-                    sJenkinsUnknownAll();
-                    doUpdate = true;
-                    break;
-            }
+            sJenkinsUpdate();
         }
-
-        if (doUpdate)
+        // (the progress waits while we're dumping, that doesn't take long)
+        else if (!dumping)
         {
-            sJenkinsUpdate();
-            doUpdate = false;
+            sJenkinsUpdateProgress();
         }
+        sJenkinsDumpNext();
+        sJenkinsSnapSave();
     }
 }
 
 
 /* ***** init and monitoring stuff ************************************************************** */
 
+void jenkinsDump(void)
+{
+    sJenkinsDumpReq = true;
+    sJenkinsNotify();
+}
+
+// the channels that have changed since the last time, up to a line full (so that this doesn't grow
+// with JENKINS_MAX_CH), see jenkinsDump() for all of them
+#define JENKINS_MON_CHANGED_MAX 10
+
 void jenkinsMonStatus(void)
 {
-    static char str[10 * 6 + 2];
-    char *pStr = str;
-    int len = sizeof(str) - 1;
-    bool last = false;
-    int ix = 0;
-    while (!last)
-    {
-        const JENKINS_INFO_t *pkInfo = &sJenkinsInfo[ix];
-        const char *stateStr  = sJenkinsStateToStr(pkInfo->state);
-        const char *resultStr = sJenkinsResultToStr(pkInfo->result);
-        const char stateChar  = pkInfo->state  == JENKINS_STATE_UNKNOWN  ? '?' : stateStr[0];
-        const char resultChar = pkInfo->result == JENKINS_RESULT_UNKNOWN ? '?' : resultStr[0];
-        const int n = snprintf(pStr, len, " %02i%c%c%c", ix, pkInfo->active ? '=' : '-',
-            toupper((int)stateChar), pkInfo->state > JENKINS_STATE_OFF ? toupper((int)resultChar) : resultChar);
-        len -= n;
-        pStr += n;
-        ix++;
-        last = (ix >= NUMOF(sJenkinsInfo)) || (len < 1);
-        if ( ((ix % 10) == 0) || last )
+    uint32_t changed[NUMOF(sJenkinsMonChanged)];
+    CS_ENTER;
+    memcpy(changed, sJenkinsMonChanged, sizeof(changed));
+    memset(sJenkinsMonChanged, 0, sizeof(sJenkinsMonChanged));
+    CS_LEAVE;
+
+    char str[(JENKINS_MON_CHANGED_MAX * 6) + 1];
+    int len = 0;
+    int nChanged = 0;
+    int nActive = 0;
+    for (int ix = 0; ix < NUMOF(sJenkinsInfo); ix++)
+    {
+        const JENKINS_CH_t *pkInfo = &sJenkinsInfo[ix];
+        if (pkInfo->active)
+        {
+            nActive++;
+        }
+        if ((changed[ix / 32] & BIT(ix % 32)) == 0)
+        {
+            continue;
+        }
+        if (nChanged < JENKINS_MON_CHANGED_MAX)
         {
-            DEBUG("mon: jenkins:%s", str);
-            pStr = str;
-            len = sizeof(str) - 1;
+            const char *stateStr  = jenkinsStateToStr(pkInfo->state);
+            const char *resultStr = jenkinsResultToStr(pkInfo->result);
+            const char stateChar  = pkInfo->state  == JENKINS_STATE_UNKNOWN  ? '?' : stateStr[0];
+            const char resultChar = pkInfo->result == JENKINS_RESULT_UNKNOWN ? '?' : resultStr[0];
+            len += snprintf(&str[len], sizeof(str) - len, " %02i%c%c%c", ix, pkInfo->active ? '=' : '-',
+                toupper((int)stateChar), pkInfo->state > JENKINS_STATE_OFF ? toupper((int)resultChar) : resultChar);
         }
+        nChanged++;
     }
-    DEBUG("mon: jenkins: worst=%s", sJenkinsResultToStr(sJenkinsWorstResult));
-}
+    str[len] = '\0';
 
-#define JENKINS_MSG_QUEUE_LEN 5
+    DEBUG("mon: jenkins: worst=%s success=%d unstable=%d failure=%d unknown=%d active=%d/%d changed=%d%s%s",
+        jenkinsResultToStr(sJenkinsWorstResult),
+        sJenkinsResultCount[JENKINS_RESULT_SUCCESS], sJenkinsResultCount[JENKINS_RESULT_UNSTABLE],
+        sJenkinsResultCount[JENKINS_RESULT_FAILURE], sJenkinsResultCount[JENKINS_RESULT_UNKNOWN],
+        nActive, (int)NUMOF(sJenkinsInfo), nChanged, str, nChanged > JENKINS_MON_CHANGED_MAX ? " ..." : "");
+}
 
 void jenkinsInit(void)
 {
     DEBUG("jenkins: init");
-
-    static StaticQueue_t sQueue;
-    static uint8_t sQueueBuf[sizeof(JENKINS_INFO_t) * JENKINS_MSG_QUEUE_LEN];
-    sJenkinsMsgQueue = xQueueCreateStatic(JENKINS_MSG_QUEUE_LEN, sizeof(JENKINS_MSG_t), sQueueBuf, &sQueue);
-    sJenkinsClearAll();
+    strTabInit(&sJenkinsStateTab);
+    strTabInit(&sJenkinsResultTab);
+    jenkinsClearAll();
+    sJenkinsSnapRestore();
+    jenkinsSubscribe(sJenkinsEventNoise, NULL);
 }
 
 void jenkinsStart(void)
 {
     DEBUG("jenkins: start");
 
-    static StackType_t sJenkinsTaskStack[512];
+    static StackType_t sJenkinsTaskStack[STACK_SIZE(JENKINS)];
     static StaticTask_t sJenkinsTaskTCB;
-    xTaskCreateStatic(sJenkinsTask, "ff_jenkins", NUMOF(sJenkinsTaskStack), NULL, 2, sJenkinsTaskStack, &sJenkinsTaskTCB);
+    sJenkinsTaskHandle = xTaskCreateStatic(sJenkinsTask, "ff_jenkins", NUMOF(sJenkinsTaskStack), NULL, 2, sJenkinsTaskStack, &sJenkinsTaskTCB);
+    monRegisterStack("ff_jenkins", "JENKINS", NUMOF(sJenkinsTaskStack));
 }
 
 // eof
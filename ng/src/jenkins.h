@@ -22,8 +22,15 @@ void jenkinsInit(void);
 void jenkinsStart(void);
 
 //! print Jenkins task/status  monitor string
+/*!
+    Prints a summary and the channels that have changed since the last time (see jenkinsDump() for
+    all channels).
+*/
 void jenkinsMonStatus(void);
 
+//! print all channels (in the Jenkins task, a few at a time, e.g. for the backend "dump" command)
+void jenkinsDump(void);
+
 //! maximum number of channels (jobs) we can track
 #define JENKINS_MAX_CH 20
 
@@ -43,6 +50,13 @@ typedef enum JENKINS_STATE_e
 */
 JENKINS_STATE_t jenkinsStrToState(const char *str);
 
+//! stringify Jenkins state
+/*!
+    \param[in] state  the state
+    \returns the state string ("unknown", "off", "running", "idle")
+*/
+const char *jenkinsStateToStr(const JENKINS_STATE_t state);
+
 //! possible job results, ordered from best to worst
 typedef enum JENKINS_RESULT_e
 {
@@ -59,6 +73,13 @@ typedef enum JENKINS_RESULT_e
 */
 JENKINS_RESULT_t jenkinsStrToResult(const char *str);
 
+//! stringify Jenkins result
+/*!
+    \param[in] result  the result
+    \returns the result string ("unknown", "success", "unstable", "failure")
+*/
+const char *jenkinsResultToStr(const JENKINS_RESULT_t result);
+
 //! maximum length of a job name
 #define JENKINS_JOBNAME_LEN 48
 
@@ -83,10 +104,49 @@ typedef struct JENKINS_INFO_s
 */
 void jenkinsSetInfo(const JENKINS_INFO_t *pkInfo);
 
+//! update state, result and timestamp of an active channel (keeping job and server name)
+/*!
+    \param[in] chIx    channel (< #JENKINS_MAX_CH)
+    \param[in] state   job state
+    \param[in] result  job result
+    \param[in] time    timestamp
+*/
+void jenkinsSetState(const int chIx, const JENKINS_STATE_t state, const JENKINS_RESULT_t result, const int32_t time);
+
 //! set all states to JENKINS_STATE_UNKNOWN
 void jenkinsUnknownAll(void);
 
 //! clear all info
 void jenkinsClearAll(void);
 
+//! get (a copy of the) current Jenkins job info
+/*!
+    \param[in]  chIx   channel (< #JENKINS_MAX_CH)
+    \param[out] pInfo  pointer to Jenkins job info struct to copy the data to
+    \returns true if the channel is valid (the info may still be inactive), false otherwise
+*/
+bool jenkinsGetInfo(const int chIx, JENKINS_INFO_t *pInfo);
+
+//! worst result transition events
+typedef enum JENKINS_EVENT_e
+{
+    JENKINS_EVENT_FIRST_FAILURE,   //!< worst result changed to failure
+    JENKINS_EVENT_FIRST_UNSTABLE,  //!< worst result changed to unstable
+    JENKINS_EVENT_ALL_GREEN,       //!< worst result changed to success (i.e. all green again)
+} JENKINS_EVENT_t;
+
+//! event callback (called from the Jenkins task, should not block)
+typedef void (*JENKINS_EVENT_FUNC_t)(const JENKINS_EVENT_t event, void *pArg);
+
+//! maximum number of event subscribers
+#define JENKINS_MAX_SUBS 4
+
+//! subscribe to worst result transition events
+/*!
+    \param[in] func  callback function
+    \param[in] pArg  argument passed to the callback
+    \returns true if subscribed, false if there are too many subscribers
+*/
+bool jenkinsSubscribe(JENKINS_EVENT_FUNC_t func, void *pArg);
+
 #endif // __JENKINS_H__
@@ -14,16 +14,28 @@
 #include "stuff.h"
 #include "json.h"
 
-jsmntok_t *jsmnAllocTokens(const int maxTokens)
+// the token pool, see jsmnTakeTokens()
+static jsmntok_t sJsmnPool[FF_JSON_TOKENS];
+static SemaphoreHandle_t sJsmnMutex;
+
+jsmntok_t *jsmnTakeTokens(const int maxTokens)
 {
-    const int tokensSize = maxTokens * sizeof(jsmntok_t);
-    jsmntok_t *pTokens = malloc(tokensSize);
-    if (pTokens == NULL)
+    if (maxTokens > NUMOF(sJsmnPool))
     {
+        WARNING("json: pool %d > %d", maxTokens, (int)NUMOF(sJsmnPool));
         return NULL;
     }
-    memset(pTokens, 0, tokensSize);
-    return pTokens;
+    xSemaphoreTake(sJsmnMutex, portMAX_DELAY);
+    memset(sJsmnPool, 0, maxTokens * sizeof(jsmntok_t));
+    return sJsmnPool;
+}
+
+void jsmnGiveTokens(jsmntok_t *pTokens)
+{
+    if (pTokens == sJsmnPool)
+    {
+        xSemaphoreGive(sJsmnMutex);
+    }
 }
 
 int jsmnParse(char *json, const int len, jsmntok_t *pTokens, const int maxTokens)
@@ -77,6 +89,96 @@ void jsmnDumpTokens(char *json, jsmntok_t *pTokens, const int numTokens)
     }
 }
 
+int jsmnFindKey(const char *json, const jsmntok_t *pkTokens, const int numTokens,
+    const int objIx, const char *key, const int keyLen)
+{
+    if ( (objIx < 0) || (objIx >= numTokens) || (pkTokens[objIx].type != JSMN_OBJECT) )
+    {
+        return -1;
+    }
+    // the keys are the direct children of the object, their values follow them
+    for (int ix = objIx + 1; ix < (numTokens - 1); ix++)
+    {
+        const jsmntok_t *pkTok = &pkTokens[ix];
+        if (pkTok->start >= pkTokens[objIx].end)
+        {
+            break;
+        }
+        if ( (pkTok->parent == objIx) && (pkTok->type == JSMN_STRING) &&
+             ((pkTok->end - pkTok->start) == keyLen) && (memcmp(&json[pkTok->start], key, keyLen) == 0) &&
+             (pkTokens[ix + 1].parent == ix) )
+        {
+            return ix + 1;
+        }
+    }
+    return -1;
+}
+
+const char *jsmnGetStr(char *json, const jsmntok_t *pkTokens, const int numTokens,
+    const int objIx, const char *key, const int keyLen)
+{
+    const int valIx = jsmnFindKey(json, pkTokens, numTokens, objIx, key, keyLen);
+    if ( (valIx < 0) || (pkTokens[valIx].type != JSMN_STRING) )
+    {
+        return NULL;
+    }
+    json[ pkTokens[valIx].end ] = '\0';
+    return &json[ pkTokens[valIx].start ];
+}
+
+bool jsmnGetInt(const char *json, const jsmntok_t *pkTokens, const int numTokens,
+    const int objIx, const char *key, const int keyLen, int *pVal)
+{
+    const int valIx = jsmnFindKey(json, pkTokens, numTokens, objIx, key, keyLen);
+    if ( (valIx < 0) ||
+         ( (pkTokens[valIx].type != JSMN_STRING) && (pkTokens[valIx].type != JSMN_PRIMITIVE) ) )
+    {
+        return false;
+    }
+    const char *pkStr = &json[ pkTokens[valIx].start ];
+    const char *pkEnd = &json[ pkTokens[valIx].end ];
+    int val = 0;
+    bool neg = false;
+    if ( (pkStr < pkEnd) && ((*pkStr == '-') || (*pkStr == '+')) )
+    {
+        neg = *pkStr == '-';
+        pkStr++;
+    }
+    if (pkStr >= pkEnd)
+    {
+        return false;
+    }
+    while (pkStr < pkEnd)
+    {
+        if ( (*pkStr < '0') || (*pkStr > '9') || (val > 99999999) )
+        {
+            return false;
+        }
+        val = (val * 10) + (*pkStr - '0');
+        pkStr++;
+    }
+    *pVal = neg ? -val : val;
+    return true;
+}
+
+int jsmnGetEnum(const char *json, const jsmntok_t *pkTokens, const int numTokens,
+    const int objIx, const char *key, const int keyLen, const STRTAB_t *pkTab, const int defVal)
+{
+    const int valIx = jsmnFindKey(json, pkTokens, numTokens, objIx, key, keyLen);
+    if ( (valIx < 0) || (pkTokens[valIx].type != JSMN_STRING) )
+    {
+        return defVal;
+    }
+    return strTabFind(pkTab, &json[ pkTokens[valIx].start ], pkTokens[valIx].end - pkTokens[valIx].start, defVal);
+}
+
+
+void jsonInit(void)
+{
+    DEBUG("json: init (pool %d)", (int)NUMOF(sJsmnPool));
+    static StaticSemaphore_t sMutex;
+    sJsmnMutex = xSemaphoreCreateMutexStatic(&sMutex);
+}
 
 
 // eof
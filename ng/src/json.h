@@ -16,6 +16,7 @@
 #include <jsmn.h>
 
 #include "stdinc.h"
+#include "stuff.h"
 
 #define JSMN_STREQ(json, pkTok, str) (    \
         ((pkTok)->type == JSMN_STRING) && \
@@ -27,9 +28,40 @@
         (strlen(str) == ( (pkTok)->end - (pkTok)->start ) ) && \
         (strncmp(&json[(pkTok)->start], str, (pkTok)->end - (pkTok)->start) == 0) )
 
+//! like JSMN_STREQ() for string literals (length known at compile time)
+#define JSMN_STREQ_K(json, pkTok, str) (    \
+        ((pkTok)->type == JSMN_STRING) && \
+        ((sizeof(str) - 1) == ( (pkTok)->end - (pkTok)->start ) ) && \
+        (memcmp(&json[(pkTok)->start], str, sizeof(str) - 1) == 0) )
+
+//! like JSMN_ANYEQ() for string literals (length known at compile time)
+#define JSMN_ANYEQ_K(json, pkTok, str) (    \
+        ( ((pkTok)->type == JSMN_STRING) || ((pkTok)->type == JSMN_PRIMITIVE) ) && \
+        ((sizeof(str) - 1) == ( (pkTok)->end - (pkTok)->start ) ) && \
+        (memcmp(&json[(pkTok)->start], str, sizeof(str) - 1) == 0) )
+
+
+//! size of the static token pool (see jsmnTakeTokens()), "make ... JSONTOKENS=60" to change
+#ifndef FF_JSON_TOKENS
+#  define FF_JSON_TOKENS 48
+#endif
+
+//! initialise
+void jsonInit(void);
+
+//! get memory for the JSON parser
+/*!
+    There is one static pool of #FF_JSON_TOKENS tokens, which this locks. It must be returned
+    with jsmnGiveTokens() when done.
 
-//! memory for JSON parser
-jsmntok_t *jsmnAllocTokens(const int maxTokens);
+    \param[in] maxTokens  number of tokens needed
+
+    \returns the (cleared) tokens, or NULL if there are not that many
+*/
+jsmntok_t *jsmnTakeTokens(const int maxTokens);
+
+//! return memory for the JSON parser
+void jsmnGiveTokens(jsmntok_t *pTokens);
 
 //! parse JSON into tokens
 int jsmnParse(char *json, const int len, jsmntok_t *pTokens, const int maxTokens);
@@ -37,5 +69,61 @@ int jsmnParse(char *json, const int len, jsmntok_t *pTokens, const int maxTokens
 //! dump tokens
 void jsmnDumpTokens(char *json, jsmntok_t *pTokens, const int numTokens);
 
+//! find the value of a key in an object
+/*!
+    \param[in] json       the JSON string
+    \param[in] pkTokens   the tokens
+    \param[in] numTokens  number of tokens
+    \param[in] objIx      index of the object token
+    \param[in] key        the key
+    \param[in] keyLen     its length
+
+    \returns the index of the value token, or -1 if there is no such key
+*/
+int jsmnFindKey(const char *json, const jsmntok_t *pkTokens, const int numTokens,
+    const int objIx, const char *key, const int keyLen);
+
+//! jsmnFindKey() for string literal keys
+#define JSMN_FIND_K(json, pkTokens, numTokens, objIx, key) \
+    jsmnFindKey(json, pkTokens, numTokens, objIx, key, sizeof(key) - 1)
+
+//! get string value of a key in an object
+/*!
+    The value is terminated in place in the JSON string.
+
+    \returns the string, or NULL if there is no such key or it is not a string
+*/
+const char *jsmnGetStr(char *json, const jsmntok_t *pkTokens, const int numTokens,
+    const int objIx, const char *key, const int keyLen);
+
+//! get integer value (number or string) of a key in an object
+/*!
+    \returns true if the key was found and the value is an integer (\a pVal is unchanged otherwise)
+*/
+bool jsmnGetInt(const char *json, const jsmntok_t *pkTokens, const int numTokens,
+    const int objIx, const char *key, const int keyLen, int *pVal);
+
+//! get enum value (string) of a key in an object
+/*!
+    \param[in] pkTab     enum value strings (see strTabFind())
+    \param[in] defVal    value if the key is not found or the string is unknown
+
+    \returns the index of the string in the table, or \a defVal
+*/
+int jsmnGetEnum(const char *json, const jsmntok_t *pkTokens, const int numTokens,
+    const int objIx, const char *key, const int keyLen, const STRTAB_t *pkTab, const int defVal);
+
+//! jsmnGetStr() for string literal keys
+#define JSMN_GETSTR_K(json, pkTokens, numTokens, objIx, key) \
+    jsmnGetStr(json, pkTokens, numTokens, objIx, key, sizeof(key) - 1)
+
+//! jsmnGetInt() for string literal keys
+#define JSMN_GETINT_K(json, pkTokens, numTokens, objIx, key, pVal) \
+    jsmnGetInt(json, pkTokens, numTokens, objIx, key, sizeof(key) - 1, pVal)
+
+//! jsmnGetEnum() for string literal keys
+#define JSMN_GETENUM_K(json, pkTokens, numTokens, objIx, key, pkTab, defVal) \
+    jsmnGetEnum(json, pkTokens, numTokens, objIx, key, sizeof(key) - 1, pkTab, defVal)
+
 
 #endif // __JSON_H__
@@ -14,117 +14,217 @@
     - GPIO 13 (D7) = MOSI
     - GPIO 14 (D5) = SCK
 
+    And for the WS2812 driver the I2S peripheral (and its DMA):
+    - GPIO 3 (RX) = I2S data out
+
     @{
 */
 
 #include "stdinc.h"
 
 #include <esp/spi.h>
+#include <i2s_dma/i2s_dma.h>
 
 #include "stuff.h"
 #include "debug.h"
 #include "mon.h"
+#include "stacks.h"
 #include "jenkins.h"
 #include "config.h"
 #include "hsv2rgb.h"
 #include "leds.h"
+#include "trace.h"
 
 #define LEDS_SPI 1
-#define LEDS_NUM JENKINS_MAX_CH
-#define LEDS_FPS 100
+#define LEDS_NUM_CH JENKINS_MAX_CH // number of channels (LED states)
+#define LEDS_MAX_NUM CONFIG_LEDS_MAX // max. number of LEDs on the strip
+#define LEDS_IDLE_PERIOD 1000 // [ms] max. time between frames if nothing is animated
+#define LEDS_LIGHT_SLEEP_FPS 25 // [Hz] max. frame rate in light sleep power mode
+#define LEDS_PULSE_PERIOD 2000 // [ms] duration of one pulse
 
 /* *********************************************************************************************** */
 
-// LED frame buffer
-static uint8_t sLedsData[LEDS_NUM][3];
+// LED frame buffer (allocated in ledsInit())
+static uint8_t (*sLedsData)[3];
+
+// number of LEDs on the strip (<= #LEDS_MAX_NUM)
+static int sLedsNum;
+
+// LEDs per channel, channel ch drives LEDs ch * sLedsPerCh .. ((ch + 1) * sLedsPerCh) - 1
+static int sLedsPerCh;
 
 static void sLedsClear(void)
 {
-    memset(&sLedsData, 0, sizeof(sLedsData));
+    memset(sLedsData, 0, LEDS_MAX_NUM * sizeof(*sLedsData));
+}
+
+static void sLedsSetNum(const int num, const int perCh)
+{
+    sLedsNum   = CLIP(num, 1, LEDS_MAX_NUM);
+    sLedsPerCh = CLIP(perCh, 1, sLedsNum);
 }
 
 enum { _R_ = 0, _G_ = 1, _B_ = 2 };
 
-static void sLedsSetRGB(const uint16_t ix, const uint8_t R, const uint8_t G, const uint8_t B)
+// colour order permutation: output byte n of each LED is sLedsData[ix][ sLedsOrderPerm[n] ]
+static const uint8_t skLedsOrderPerms[][3] =
 {
-    if (ix < LEDS_NUM)
-    {
-        switch (configGetOrder())
-        {
-            case CONFIG_ORDER_RGB: sLedsData[ix][0] = R; sLedsData[ix][1] = G; sLedsData[ix][2] = B; break;
-            case CONFIG_ORDER_RBG: sLedsData[ix][0] = R; sLedsData[ix][1] = B; sLedsData[ix][2] = G; break;
-            case CONFIG_ORDER_GRB: sLedsData[ix][0] = G; sLedsData[ix][1] = R; sLedsData[ix][2] = B; break;
-            case CONFIG_ORDER_GBR: sLedsData[ix][0] = G; sLedsData[ix][1] = B; sLedsData[ix][2] = R; break;
-            case CONFIG_ORDER_BRG: sLedsData[ix][0] = B; sLedsData[ix][1] = R; sLedsData[ix][2] = G; break;
-            case CONFIG_ORDER_BGR: sLedsData[ix][0] = B; sLedsData[ix][1] = G; sLedsData[ix][2] = R; break;
-            case CONFIG_ORDER_UNKNOWN:
-            {
-                const uint8_t RGB = ((uint16_t)R + (uint16_t)G + (uint16_t)B) / 3;
-                sLedsData[ix][0] = RGB; sLedsData[ix][1] = RGB; sLedsData[ix][2] = RGB;
-                break;
-            }
-        }
-    }
+    [CONFIG_ORDER_UNKNOWN] = { _R_, _G_, _B_ }, // (grey, see sLedsSetRGB())
+    [CONFIG_ORDER_RGB]     = { _R_, _G_, _B_ },
+    [CONFIG_ORDER_RBG]     = { _R_, _B_, _G_ },
+    [CONFIG_ORDER_GRB]     = { _G_, _R_, _B_ },
+    [CONFIG_ORDER_GBR]     = { _G_, _B_, _R_ },
+    [CONFIG_ORDER_BRG]     = { _B_, _R_, _G_ },
+    [CONFIG_ORDER_BGR]     = { _B_, _G_, _R_ },
+};
+static const uint8_t *sLedsOrderPerm = skLedsOrderPerms[CONFIG_ORDER_UNKNOWN];
+static bool sLedsOrderGrey = true;
+
+static void sLedsSetOrder(const CONFIG_ORDER_t order)
+{
+    sLedsOrderPerm = skLedsOrderPerms[order < NUMOF(skLedsOrderPerms) ? order : CONFIG_ORDER_UNKNOWN];
+    sLedsOrderGrey = (order == CONFIG_ORDER_UNKNOWN);
 }
 
-static void sLedsSetHSV(const uint16_t ix, const uint8_t H, const uint8_t S, const uint8_t V)
+// output value lookup table (brightness scaling), 8.8 fixed point
+static uint16_t sLedsOutLut[256];
+
+// temporal dithering: the fractional part of the output values is accumulated per LED and colour and
+// carried into the integer part whenever it overflows, so at 100Hz the LED shows the average of the
+// fractional value (the accumulators are carved from the arena next to sLedsData, see ledsInit())
+static bool sLedsDitherOn;
+static uint8_t (*sLedsDither)[3];
+
+// SK9822 global brightness (5 bits) for the brightness levels
+static uint8_t sLedsSK9822Bright(const CONFIG_BRIGHT_t bright)
 {
-    if (ix < LEDS_NUM)
+    switch (bright)
     {
-        uint8_t R, G, B;
-        hsv2rgb(H, S, V, &R, &G, &B);
-        sLedsSetRGB(ix, R, G, B);
+        case CONFIG_BRIGHT_FULL:   return 31;
+        case CONFIG_BRIGHT_HIGH:   return 20;
+        case CONFIG_BRIGHT_MEDIUM: return 10;
+        case CONFIG_BRIGHT_UNKNOWN:
+        case CONFIG_BRIGHT_LOW:    break;
     }
+    return 5;
 }
 
-#define LEDS_WS2801_BUFSIZE sizeof(sLedsData)
+// SK9822 global brightness in use (see sLedsRenderSK9822(), updated with the LUT)
+static uint8_t sLedsSK9822Global = 31;
 
-static int sLedsRenderWS2801(uint8_t *outBuf, const int bufSize)
+// rebuild output LUT for driver and brightness
+// (the perceptual correction is already done by hsv2rgb(), so this is only brightness scaling, keeping
+// non-zero values non-zero)
+static void sLedsUpdateLut(const CONFIG_DRIVER_t driver, const CONFIG_BRIGHT_t bright, const bool dither)
 {
-    memset(outBuf, 0, bufSize);
-    const int outSize = MIN(bufSize, sizeof(sLedsData));
-    uint32_t brightness = 0;
-    switch (configGetBright())
+    uint32_t brightness = 256;
+    switch (driver)
     {
-        case CONFIG_BRIGHT_FULL:   brightness =   0; break;
-        case CONFIG_BRIGHT_HIGH:   brightness = 200; break;
-        case CONFIG_BRIGHT_MEDIUM: brightness = 100; break;
-        case CONFIG_BRIGHT_UNKNOWN:
-        case CONFIG_BRIGHT_LOW:    brightness =  50; break;
+        // scale values in software
+        case CONFIG_DRIVER_UNKNOWN:
+        case CONFIG_DRIVER_WS2801:
+        case CONFIG_DRIVER_WS2812:
+            switch (bright)
+            {
+                case CONFIG_BRIGHT_FULL:   brightness = 256; break;
+                case CONFIG_BRIGHT_HIGH:   brightness = 200; break;
+                case CONFIG_BRIGHT_MEDIUM: brightness = 100; break;
+                case CONFIG_BRIGHT_UNKNOWN:
+                case CONFIG_BRIGHT_LOW:    brightness =  50; break;
+            }
+            break;
+        // the LEDs do it (global brightness, see sLedsRenderSK9822()), unless we're dithering, in which
+        // case we run the LEDs at full global brightness and scale (and dither) in software
+        case CONFIG_DRIVER_SK9822:
+            if (dither)
+            {
+                brightness = ((uint32_t)sLedsSK9822Bright(bright) * 256) / 31;
+            }
+            break;
     }
-    if (brightness == 0)
+    sLedsOutLut[0] = 0;
+    for (uint32_t in = 1; in < NUMOF(sLedsOutLut); in++)
     {
-        memcpy(outBuf, sLedsData, outSize);
+        const uint32_t out = in * brightness;
+        sLedsOutLut[in] = CLIP(out, 256, 255 * 256);
+    }
+    sLedsDitherOn = dither;
+    sLedsSK9822Global = dither ? 31 : sLedsSK9822Bright(bright);
+    memset(sLedsDither, 0, LEDS_MAX_NUM * sizeof(*sLedsDither));
+}
+
+// output value for a LED colour (brightness scaled, dithered)
+__INLINE static uint8_t sLedsOutVal(const int ix, const int c)
+{
+    const uint16_t val = sLedsOutLut[ sLedsData[ix][c] ];
+    if (sLedsDitherOn)
+    {
+        const uint16_t acc = (uint16_t)sLedsDither[ix][c] + (val & 0xff);
+        sLedsDither[ix][c] = acc;
+        return (val >> 8) + (acc >> 8);
     }
     else
     {
-        const uint32_t thrs = 256 / brightness;
-        const uint8_t *inBuf = (const uint8_t *)sLedsData;
-        for (uint32_t ix = 0; ix < bufSize; ix++)
+        const uint32_t out = (val + 128) >> 8;
+        return out;
+    }
+}
+
+static void sLedsSetRGB(const uint16_t ix, const uint8_t R, const uint8_t G, const uint8_t B)
+{
+    if (ix < sLedsNum)
+    {
+        if (!sLedsOrderGrey)
+        {
+            sLedsData[ix][_R_] = R; sLedsData[ix][_G_] = G; sLedsData[ix][_B_] = B;
+        }
+        else
+        {
+            const uint8_t RGB = ((uint16_t)R + (uint16_t)G + (uint16_t)B) / 3;
+            sLedsData[ix][_R_] = RGB; sLedsData[ix][_G_] = RGB; sLedsData[ix][_B_] = RGB;
+        }
+    }
+}
+
+// set LEDs of a channel
+static void sLedsSetChRGB(const uint16_t chIx, const uint8_t R, const uint8_t G, const uint8_t B)
+{
+    const int ix0 = chIx * sLedsPerCh;
+    if (ix0 < sLedsNum)
+    {
+        const int ix1 = MIN(ix0 + sLedsPerCh, sLedsNum);
+        for (int ix = ix0; ix < ix1; ix++)
         {
-            const uint32_t in = inBuf[ix];
-            if (in != 0) { outBuf[ix] = (in <= thrs) ? 1 : ((in * brightness) >> 8); } else { outBuf[ix] = in; }
+            sLedsSetRGB(ix, R, G, B);
         }
     }
-    return outSize;
 }
 
-#define LEDS_SK9822_END_BYTES ( LEDS_NUM / 2 / 8 + 1 )
-#define LEDS_SK9822_BUFSIZE ( 4 + (LEDS_NUM * 4) + 4 + LEDS_SK9822_END_BYTES )
+#define LEDS_WS2801_BUFSIZE ( LEDS_MAX_NUM * 3 )
 
-static int sLedsRenderSK9822(uint8_t *outBuf, const int bufSize)
+static int sLedsRenderWS2801(uint8_t *outBuf, const int bufSize)
 {
     memset(outBuf, 0, bufSize);
-
-    uint8_t brightness = 0;
-    switch (configGetBright())
+    const uint8_t p0 = sLedsOrderPerm[0], p1 = sLedsOrderPerm[1], p2 = sLedsOrderPerm[2];
+    int outIx = 0;
+    for (int ix = 0; (ix < sLedsNum) && (outIx <= (bufSize - 3)); ix++)
     {
-        case CONFIG_BRIGHT_FULL:   brightness = 31; break;
-        case CONFIG_BRIGHT_HIGH:   brightness = 20; break;
-        case CONFIG_BRIGHT_MEDIUM: brightness = 10; break;
-        case CONFIG_BRIGHT_UNKNOWN:
-        case CONFIG_BRIGHT_LOW:    brightness =  5; break;
+        outBuf[outIx++] = sLedsOutVal(ix, p0);
+        outBuf[outIx++] = sLedsOutVal(ix, p1);
+        outBuf[outIx++] = sLedsOutVal(ix, p2);
     }
+    return outIx;
+}
+
+#define LEDS_SK9822_END_BYTES(num) ( (num) / 2 / 8 + 1 )
+#define LEDS_SK9822_BUFSIZE ( 4 + (LEDS_MAX_NUM * 4) + 4 + LEDS_SK9822_END_BYTES(LEDS_MAX_NUM) )
+
+static int sLedsRenderSK9822(uint8_t *outBuf, const int bufSize)
+{
+    memset(outBuf, 0, bufSize);
+
+    // (when dithering the brightness is applied in software, see sLedsUpdateLut())
+    const uint8_t brightness = sLedsSK9822Global;
 
     // Tim (https://cpldcpu.wordpress.com/2016/12/13/sk9822-a-clone-of-the-apa102/) says:
     // «A protocol that is compatible to both the SK9822 and the APA102 consists of the following:
@@ -142,12 +242,14 @@ static int sLedsRenderSK9822(uint8_t *outBuf, const int bufSize)
     outBuf[outIx++] = 0x00;
 
     // 2. LEDs data
-    for (int ix = 0; (ix < LEDS_NUM) && (outIx < (bufSize - 4 - LEDS_SK9822_END_BYTES )); ix++)
+    const uint8_t p0 = sLedsOrderPerm[0], p1 = sLedsOrderPerm[1], p2 = sLedsOrderPerm[2];
+    const int nEndBytes = LEDS_SK9822_END_BYTES(sLedsNum);
+    for (int ix = 0; (ix < sLedsNum) && (outIx < (bufSize - 4 - nEndBytes)); ix++)
     {
         outBuf[outIx++] = 0xe0 | (brightness & 0x1f); // global brightness
-        outBuf[outIx++] = sLedsData[ix][0];
-        outBuf[outIx++] = sLedsData[ix][1];
-        outBuf[outIx++] = sLedsData[ix][2];
+        outBuf[outIx++] = sLedsOutVal(ix, p0);
+        outBuf[outIx++] = sLedsOutVal(ix, p1);
+        outBuf[outIx++] = sLedsOutVal(ix, p2);
     }
 
     // 3. reset frame
@@ -157,7 +259,7 @@ static int sLedsRenderSK9822(uint8_t *outBuf, const int bufSize)
     outBuf[outIx++] = 0x00;
 
     // 4. end frame
-    int n = LEDS_SK9822_END_BYTES;
+    int n = nEndBytes;
     while (n-- > 0)
     {
         outBuf[outIx++] = 0x00;
@@ -170,8 +272,9 @@ static int sLedsRenderSK9822(uint8_t *outBuf, const int bufSize)
 
 /* *********************************************************************************************** */
 
-// copy of working frame buffer for transferring to SPI
-static uint32_t sLedsSpiBuf[ MAX(LEDS_WS2801_BUFSIZE, LEDS_SK9822_BUFSIZE) / 4 + 1 ];
+// copy of working frame buffer for transferring to SPI (allocated in ledsInit())
+#define LEDS_SPIBUF_WORDS ( MAX(LEDS_WS2801_BUFSIZE, LEDS_SK9822_BUFSIZE) / 4 + 1 )
+static uint32_t *sLedsSpiBuf;
 static int sLedsSpiBufIx;
 static int sLedsSpiBufNum;
 
@@ -192,8 +295,9 @@ IRAM static void sLedsSpiBufLoad(void)
     // data to send left
     if (nBits)
     {
-        // set number of bits to send
+        // set number of bits to send (clear first, the last chunk may be shorter than the previous one)
         //SPI(LEDS_SPI).USER1 = VAL2FIELD_M(SPI_USER1_MOSI_BITLEN, nBits - 1);
+        CLEAR_MASK_BITS(SPI(LEDS_SPI).USER1, VAL2FIELD_M(SPI_USER1_MOSI_BITLEN, SPI_USER1_MOSI_BITLEN_M));
         SET_MASK_BITS(SPI(LEDS_SPI).USER1, VAL2FIELD_M(SPI_USER1_MOSI_BITLEN, nBits - 1));
 
         // trigger send
@@ -218,7 +322,7 @@ IRAM static void sLedsSpiBufLoad(void)
 // SPI interrupt handler
 IRAM static void sLedsSpiIsr(void *pArg)
 {
-    monIsrEnter();
+    const uint32_t t0 = monIsrEnter();
 
     // this must be read first (_before_ reading the status or clearing the interrupts)
     const uint32_t isrStatus = DPORT.SPI_INT_STATUS;
@@ -240,16 +344,187 @@ IRAM static void sLedsSpiIsr(void *pArg)
     // clear all interrupts (must be done _after_ reading the status registers)
     CLEAR_MASK_BITS(SPI(LEDS_SPI).SLAVE0, SPI_SLAVE0_ALL_DONE);
 
-    monIsrLeave();
+    monIsrLeave(MON_ISR_SPI, t0);
 }
 
-// update LEDs (send data to SPI)
-static void sLedsFlush(const CONFIG_DRIVER_t driver)
+
+// SPI clock dividers for the supported SPI clocks, the configured clock is rounded down
+static const struct { int mhz; uint32_t div; } skLedsSpiClks[] =
 {
-    // it seems to be crucial to clear and disable all interrupts on _both_ SPIs
-    // (some enabled by default?!), similar to the UART IRQs (see user_stuff.c)
-    CLEAR_MASK_BITS(SPI(0).SLAVE0, SPI_SLAVE0_ALL_DONE | SPI_SLAVE0_ALL_DONE_EN);
-    CLEAR_MASK_BITS(SPI(1).SLAVE0, SPI_SLAVE0_ALL_DONE | SPI_SLAVE0_ALL_DONE_EN);
+    {  1, SPI_FREQ_DIV_1M  },
+    {  2, SPI_FREQ_DIV_2M  },
+    {  4, SPI_FREQ_DIV_4M  },
+    {  8, SPI_FREQ_DIV_8M  },
+    { 10, SPI_FREQ_DIV_10M },
+    { 20, SPI_FREQ_DIV_20M },
+};
+
+// default SPI clock per driver [MHz] (WS2801 likes it slow on longer cables, SK9822 is fine with a fast clock)
+#define LEDS_SPICLK_WS2801   2
+#define LEDS_SPICLK_SK9822  10
+
+static int sLedsSpiClk; // current SPI clock [MHz]
+
+// set SPI clock for the driver (configured clock, or the driver's default)
+static void sLedsSetSpiClk(const CONFIG_DRIVER_t driver)
+{
+    int mhz = configGetSpiClk();
+    if (mhz <= 0)
+    {
+        mhz = driver == CONFIG_DRIVER_SK9822 ? LEDS_SPICLK_SK9822 : LEDS_SPICLK_WS2801;
+    }
+    int clkIx = 0;
+    while ( (clkIx < ((int)NUMOF(skLedsSpiClks) - 1)) && (skLedsSpiClks[clkIx + 1].mhz <= mhz) )
+    {
+        clkIx++;
+    }
+    if (skLedsSpiClks[clkIx].mhz != sLedsSpiClk)
+    {
+        sLedsSpiClk = skLedsSpiClks[clkIx].mhz;
+        DEBUG("leds: SPI clock %dMHz", sLedsSpiClk);
+        spi_set_frequency_div(LEDS_SPI, skLedsSpiClks[clkIx].div);
+    }
+}
+
+
+/* *********************************************************************************************** */
+
+// WS2812 via I2S DMA: at 3.33MHz I2S bit clock, each WS2812 bit is four I2S bits, "1000" for a 0 (0.3us high,
+// 0.9us low) and "1110" for a 1 (0.9us high, 0.3us low), i.e. each colour byte takes two 16 bit patterns.
+// The rendered bytes (sLedsRenderWS2801() format) are encoded incrementally into a ring of DMA buffers
+// by the (DMA) end of frame interrupt, followed by a few all-zero buffers for the reset (latch) time.
+
+#define LEDS_I2S_FREQ           3333333
+#define LEDS_I2S_DESC_NUM       4                       // number of DMA descriptors (and buffers) in the ring
+#define LEDS_I2S_BUF_BYTES      24                      // colour bytes per buffer (8 LEDs)
+#define LEDS_I2S_BUF_SIZE      (LEDS_I2S_BUF_BYTES * 4) // 4 I2S bits per WS2812 bit
+#define LEDS_I2S_RESET_BUFS     2                       // 2 x 96 bytes at 3.33MHz = ~230us (> 50us for WS2812, > 80us for SK6812)
+
+// bit patterns for nibbles (low nibble goes first, the I2S sends 16 bit half-words swapped)
+static const uint16_t skLedsI2sPatterns[16] =
+{
+    0x8888, 0x888e, 0x88e8, 0x88ee, 0x8e88, 0x8e8e, 0x8ee8, 0x8eee,
+    0xe888, 0xe88e, 0xe8e8, 0xe8ee, 0xee88, 0xee8e, 0xeee8, 0xeeee,
+};
+
+static dma_descriptor_t sLedsI2sDescs[LEDS_I2S_DESC_NUM];
+static uint16_t sLedsI2sBufs[LEDS_I2S_DESC_NUM][LEDS_I2S_BUF_SIZE / 2];
+static volatile bool svLedsI2sBusy;    // transfer in progress
+static int           sLedsI2sSrcIx;    // next byte in sLedsSpiBuf to encode
+static int           sLedsI2sSrcNum;   // number of bytes to encode
+static int           sLedsI2sZerosTx;  // number of all-zero buffers sent
+
+// encode next chunk of data into buffer (or fill it with zeros if all data has been encoded)
+IRAM static void sLedsI2sFill(dma_descriptor_t *pDesc)
+{
+    uint16_t *pOut = (uint16_t *)pDesc->buf_ptr;
+    const uint8_t *pkSrc = (const uint8_t *)sLedsSpiBuf;
+    int n = 0;
+    while ( (sLedsI2sSrcIx < sLedsI2sSrcNum) && (n < LEDS_I2S_BUF_BYTES) )
+    {
+        const uint8_t b = pkSrc[sLedsI2sSrcIx++];
+        *pOut++ = skLedsI2sPatterns[b & 0x0f];
+        *pOut++ = skLedsI2sPatterns[b >> 4];
+        n++;
+    }
+    // zero the remainder, or the whole buffer
+    if (n < LEDS_I2S_BUF_BYTES)
+    {
+        memset(pOut, 0, (LEDS_I2S_BUF_BYTES - n) * 4);
+    }
+    pDesc->unused = (n == 0) ? 1 : 0; // (ab)use as a flag for all-zero buffers
+    pDesc->owner = 1;
+}
+
+// I2S DMA interrupt handler
+IRAM static void sLedsI2sIsr(void *pArg)
+{
+    const uint32_t t0 = monIsrEnter();
+
+    if (i2s_dma_is_eof_interrupt())
+    {
+        dma_descriptor_t *pDesc = i2s_dma_get_eof_descriptor();
+
+        // count reset time sent, stop once it's all out
+        if (pDesc->unused != 0)
+        {
+            sLedsI2sZerosTx++;
+        }
+        if (sLedsI2sZerosTx >= LEDS_I2S_RESET_BUFS)
+        {
+            i2s_dma_stop();
+            svLedsI2sBusy = false;
+        }
+        // refill buffer
+        else
+        {
+            sLedsI2sFill(pDesc);
+        }
+    }
+    i2s_dma_clear_interrupt();
+
+    monIsrLeave(MON_ISR_I2S, t0);
+}
+
+static void sLedsI2sSend(const int nBytes)
+{
+    static bool sInited;
+    if (!sInited)
+    {
+        DEBUG("leds: I2S init");
+        const i2s_pins_t pins = { .data = true, .clock = false, .ws = false };
+        i2s_dma_init(sLedsI2sIsr, NULL, i2s_get_clock_div(LEDS_I2S_FREQ), pins);
+        for (int ix = 0; ix < LEDS_I2S_DESC_NUM; ix++)
+        {
+            dma_descriptor_t *pDesc = &sLedsI2sDescs[ix];
+            pDesc->owner         = 1;
+            pDesc->eof           = 1;
+            pDesc->sub_sof       = 0;
+            pDesc->datalen       = LEDS_I2S_BUF_SIZE;
+            pDesc->blocksize     = LEDS_I2S_BUF_SIZE;
+            pDesc->buf_ptr       = sLedsI2sBufs[ix];
+            pDesc->unused        = 0;
+            pDesc->next_link_ptr = &sLedsI2sDescs[(ix + 1) % LEDS_I2S_DESC_NUM];
+        }
+        sInited = true;
+    }
+
+    // pre-fill all buffers and start DMA, the interrupt handles the rest
+    sLedsI2sSrcIx = 0;
+    sLedsI2sSrcNum = nBytes;
+    sLedsI2sZerosTx = 0;
+    for (int ix = 0; ix < LEDS_I2S_DESC_NUM; ix++)
+    {
+        sLedsI2sFill(&sLedsI2sDescs[ix]);
+    }
+    svLedsI2sBusy = true;
+    i2s_dma_start(&sLedsI2sDescs[0]);
+}
+
+/* *********************************************************************************************** */
+
+// last frame sent (to skip sending unchanged frames)
+static uint32_t *sLedsSpiBufLast;
+static int sLedsSpiBufLastSize;
+
+// statistics
+static uint32_t sLedsNumFrames;
+static uint32_t sLedsNumFlushes;
+static uint32_t sLedsNumHsv;
+static uint32_t sLedsNumBusy;
+static uint32_t sLedsNumSingle;
+static bool     sLedsIdle;
+
+// update LEDs (send data to SPI or I2S), unless the data is the same as in the previous frame or force is set
+static void sLedsFlush(const CONFIG_DRIVER_t driver, const bool force)
+{
+    // the WS2812 DMA encodes from the buffer while sending, so we must not touch it,
+    // and the SPI interrupt may still be loading the previous frame (very long strips and slow clock)
+    if (svLedsI2sBusy || (sLedsSpiBufIx < sLedsSpiBufNum))
+    {
+        sLedsNumBusy++;
+        return;
+    }
 
     // copy framebuffer
     int nBytesToSend = 0;
@@ -258,13 +533,44 @@ static void sLedsFlush(const CONFIG_DRIVER_t driver)
         case CONFIG_DRIVER_UNKNOWN:
             break;
         case CONFIG_DRIVER_WS2801:
-            nBytesToSend = sLedsRenderWS2801((uint8_t *)sLedsSpiBuf, sizeof(sLedsSpiBuf));
+        case CONFIG_DRIVER_WS2812:
+            nBytesToSend = sLedsRenderWS2801((uint8_t *)sLedsSpiBuf, LEDS_SPIBUF_WORDS * sizeof(*sLedsSpiBuf));
             break;
         case CONFIG_DRIVER_SK9822:
-            nBytesToSend = sLedsRenderSK9822((uint8_t *)sLedsSpiBuf, sizeof(sLedsSpiBuf));
+            nBytesToSend = sLedsRenderSK9822((uint8_t *)sLedsSpiBuf, LEDS_SPIBUF_WORDS * sizeof(*sLedsSpiBuf));
             break;
     }
-    const int nWordsToSend = nBytesToSend / 4 + 1;
+
+    // skip frame if nothing has changed
+    sLedsNumFrames++;
+    if ( !force && (nBytesToSend == sLedsSpiBufLastSize) &&
+         (memcmp(sLedsSpiBuf, sLedsSpiBufLast, nBytesToSend) == 0) )
+    {
+        return;
+    }
+    memcpy(sLedsSpiBufLast, sLedsSpiBuf, nBytesToSend);
+    sLedsSpiBufLastSize = nBytesToSend;
+    sLedsNumFlushes++;
+    TRACE(TRACE_EV_LEDS_FLUSH, nBytesToSend);
+
+    // WS2812 goes via I2S DMA
+    if (driver == CONFIG_DRIVER_WS2812)
+    {
+        if (nBytesToSend > 0)
+        {
+            sLedsI2sSend(nBytesToSend);
+        }
+        return;
+    }
+
+    // it seems to be crucial to clear and disable all interrupts on _both_ SPIs
+    // (some enabled by default?!), similar to the UART IRQs (see user_stuff.c)
+    CLEAR_MASK_BITS(SPI(0).SLAVE0, SPI_SLAVE0_ALL_DONE | SPI_SLAVE0_ALL_DONE_EN);
+    CLEAR_MASK_BITS(SPI(1).SLAVE0, SPI_SLAVE0_ALL_DONE | SPI_SLAVE0_ALL_DONE_EN);
+
+    sLedsSetSpiClk(driver);
+
+    const int nWordsToSend = (nBytesToSend + 3) / 4;
     //DEBUG("sLedsFlush() %d %d", nBytesToSend, nWordsToSend);
     if ( (nBytesToSend > 0) && (nWordsToSend > 0) )
     {
@@ -276,8 +582,11 @@ static void sLedsFlush(const CONFIG_DRIVER_t driver)
         return;
     }
 
-    // enable transfer done interrupt source
-    SET_MASK_BITS(SPI(LEDS_SPI).SLAVE0, SPI_SLAVE0_TRANS_DONE_EN);
+    // wait for the previous transaction to complete (in case there is one, e.g. a same-sized frame sent
+    // at a high frame rate)
+    while ((SPI(LEDS_SPI).CMD & SPI_CMD_USR) != 0)
+    {
+    }
 
     // disable MOSI, MISO, ADDR, COMMAND, DUMMY in case previously set
     CLEAR_MASK_BITS(SPI(LEDS_SPI).USER0, SPI_USER0_COMMAND | SPI_USER0_ADDR | SPI_USER0_DUMMY | SPI_USER0_MISO | SPI_USER0_MOSI);
@@ -285,10 +594,21 @@ static void sLedsFlush(const CONFIG_DRIVER_t driver)
     // enable only MOSI part of SPI transaction
     SET_MASK_BITS(SPI(LEDS_SPI).USER0, SPI_USER0_MOSI);
 
+    // frame fits into the SPI buffer (<= 64 bytes), send it in one transaction without the interrupt
+    if (nWordsToSend <= (int)NUMOF(SPI(LEDS_SPI).W))
+    {
+        sLedsNumSingle++;
+        sLedsSpiBufLoad();
+        return;
+    }
+
+    // enable transfer done interrupt source
+    SET_MASK_BITS(SPI(LEDS_SPI).SLAVE0, SPI_SLAVE0_TRANS_DONE_EN);
+
     // unmask SPI interrupt
     _xt_isr_unmask(BIT(INUM_SPI));
 
-    // load next words into SPI buffer and send
+    // load next words into SPI buffer and send, the interrupt loads the rest
     sLedsSpiBufLoad();
 }
 
@@ -298,35 +618,272 @@ static void sLedsFlush(const CONFIG_DRIVER_t driver)
 typedef struct LEDS_STATE_s
 {
     LEDS_PARAM_t param;
+    bool    dirty;      // param changed, needs rendering
     bool    inited;
+    bool    animated;
     uint8_t val;
-    int     count;
+    int     count;  // [ms] flicker duration
+    int8_t  prog;   // effect program (index into sLedsProgs[]), -1 for none
+    uint8_t kf;     // current keyframe of the effect program
+    uint32_t pos;   // [ms] effect program position
+    uint32_t t0;    // [ms] synchronised time at the start of the effect program
 
 } LEDS_STATE_t;
 
-static LEDS_STATE_t sLedsStates[LEDS_NUM];
+// render state, owned by the LEDs task
+static LEDS_STATE_t sLedsStates[LEDS_NUM_CH];
+
+// LED parameters published by ledsSetState() (seqlock: odd sequence number = update in progress)
+typedef struct LEDS_SHARED_s
+{
+    LEDS_PARAM_t param;
+    uint32_t     gen;     // incremented for each ledsSetState()
+} LEDS_SHARED_t;
+static volatile LEDS_SHARED_t svLedsShared[LEDS_NUM_CH];
+static volatile uint32_t svLedsSharedSeq;
+
+// serialises writers (the LEDs task never takes this)
+static SemaphoreHandle_t sLedsSharedMutex;
 
-static SemaphoreHandle_t sLedsStateMutex;
+static uint32_t sLedsNumSwaps;
 
 #define LEDS_PULSE_MIN_VAL 10
 
+static TaskHandle_t sLedsTaskHandle;
+
 void ledsSetState(const uint16_t ledIx, const LEDS_PARAM_t *pkParam)
 {
-    if (ledIx < LEDS_NUM)
+    if (ledIx < LEDS_NUM_CH)
+    {
+        TRACE(TRACE_EV_LEDS_STATE, ledIx);
+        xSemaphoreTake(sLedsSharedMutex, portMAX_DELAY);
+        svLedsSharedSeq++;
+        svLedsShared[ledIx].param = *pkParam;
+        svLedsShared[ledIx].gen++;
+        svLedsSharedSeq++;
+        xSemaphoreGive(sLedsSharedMutex);
+
+        // wake up LEDs task in case it's idle
+        if (sLedsTaskHandle != NULL)
+        {
+            xTaskNotifyGive(sLedsTaskHandle);
+        }
+    }
+}
+
+// pick up new LED parameters (if any), never blocks
+static void sLedsUpdateStates(void)
+{
+    static uint32_t sLastSeq;
+    static uint32_t sLastGen[LEDS_NUM_CH];
+
+    const uint32_t seq = svLedsSharedSeq;
+    if ( (seq == sLastSeq) || ((seq & 0x1) != 0) )
+    {
+        return;
+    }
+
+    // take snapshot, keep old parameters if a writer interfered (we'll try again next frame)
+    LEDS_SHARED_t shared[LEDS_NUM_CH];
+    for (uint16_t ix = 0; ix < LEDS_NUM_CH; ix++)
+    {
+        shared[ix].param = svLedsShared[ix].param;
+        shared[ix].gen   = svLedsShared[ix].gen;
+    }
+    if (svLedsSharedSeq != seq)
+    {
+        return;
+    }
+    sLastSeq = seq;
+    sLedsNumSwaps++;
+
+    // (re-)initialise changed LEDs, but keep the animation going if only the progress has changed
+    for (uint16_t ix = 0; ix < LEDS_NUM_CH; ix++)
+    {
+        if (shared[ix].gen != sLastGen[ix])
+        {
+            sLastGen[ix] = shared[ix].gen;
+            LEDS_STATE_t *pState = &sLedsStates[ix];
+            const LEDS_PARAM_t *pkParam = &shared[ix].param;
+            if ( (pState->param.fx == pkParam->fx) && (pState->param.hue == pkParam->hue) &&
+                 (pState->param.sat == pkParam->sat) && (pState->param.val == pkParam->val) &&
+                 (pState->param.tag == pkParam->tag) )
+            {
+                pState->param.progress = pkParam->progress;
+            }
+            else
+            {
+                memset(pState, 0, sizeof(*pState));
+                pState->param = *pkParam;
+            }
+            pState->dirty = true;
+        }
+    }
+}
+
+// mark all LEDs for re-rendering (e.g. after the frame buffer was messed with)
+static void sLedsSetAllDirty(void)
+{
+    for (uint16_t ix = 0; ix < NUMOF(sLedsStates); ix++)
+    {
+        sLedsStates[ix].dirty = true;
+    }
+}
+
+// effect programs (see leds.h), compiled from the "fx" config by the LEDs task
+#define LEDS_PROG_HDR_SIZE 3
+#define LEDS_PROG_KF_SIZE  5
+#define LEDS_PROG_MAX      8
+
+typedef struct LEDS_KF_s
+{
+    uint8_t  hue;
+    uint8_t  sat;
+    uint8_t  val;
+    uint8_t  ease;  // LEDS_EASE_t
+    uint16_t dur;   // [ms]
+    uint16_t inv;   // 2^16 / dur
+    uint32_t end;   // [ms] end of the keyframe, relative to the program start
+
+} LEDS_KF_t;
+
+typedef struct LEDS_PROG_s
+{
+    uint8_t  tag;
+    uint8_t  kf0;       // first keyframe in sLedsKfs[]
+    uint8_t  num;       // number of keyframes
+    uint8_t  loop;      // first keyframe of the loop (relative to kf0)
+    uint16_t phase;     // [ms] phase offset between channels
+    uint32_t loopStart; // [ms] start of the loop, relative to the program start
+    uint32_t dur;       // [ms] duration of the whole program
+
+} LEDS_PROG_t;
+
+static LEDS_KF_t   sLedsKfs[CONFIG_FX_MAX / LEDS_PROG_KF_SIZE];
+static LEDS_PROG_t sLedsProgs[LEDS_PROG_MAX];
+static int         sLedsNumProgs;
+
+// compile effect programs (the states pick them up when they're re-initialised)
+static void sLedsProgsCompile(const uint8_t *fx, const int len)
+{
+    sLedsNumProgs = 0;
+    int nKfs = 0;
+    int ix = 0;
+    while ( (ix + LEDS_PROG_HDR_SIZE) <= len )
+    {
+        const uint8_t tag  = fx[ix + 0];
+        const int     num  = fx[ix + 1] & 0x0f;
+        const int     loop = fx[ix + 1] >> 4;
+        const int     phase = (int)fx[ix + 2] * 10;
+        ix += LEDS_PROG_HDR_SIZE;
+        if ( (tag == 0) || (num == 0) || (loop >= num) || ((ix + (num * LEDS_PROG_KF_SIZE)) > len) ||
+             ((nKfs + num) > (int)NUMOF(sLedsKfs)) || (sLedsNumProgs >= (int)NUMOF(sLedsProgs)) )
+        {
+            WARNING("leds: fx program %d invalid", sLedsNumProgs);
+            break;
+        }
+
+        LEDS_PROG_t *pProg = &sLedsProgs[sLedsNumProgs++];
+        pProg->tag   = tag;
+        pProg->kf0   = nKfs;
+        pProg->num   = num;
+        pProg->loop  = loop;
+        pProg->phase = phase;
+        uint32_t t = 0;
+        for (int n = 0; n < num; n++)
+        {
+            LEDS_KF_t *pKf = &sLedsKfs[nKfs++];
+            pKf->hue  = fx[ix + 0];
+            pKf->sat  = fx[ix + 1];
+            pKf->val  = fx[ix + 2];
+            pKf->dur  = MAX(fx[ix + 3], 1) * ((fx[ix + 4] & LEDS_EASE_SLOW) != 0 ? 100 : 10);
+            pKf->inv  = 0x10000 / pKf->dur;
+            pKf->ease = fx[ix + 4] & 0x0f;
+            if (n == loop)
+            {
+                pProg->loopStart = t;
+            }
+            t += pKf->dur;
+            pKf->end = t;
+            ix += LEDS_PROG_KF_SIZE;
+        }
+        pProg->dur = t;
+    }
+    DEBUG("leds: %d fx programs (%d keyframes)", sLedsNumProgs, nKfs);
+
+    // re-initialise all states
+    for (uint16_t chIx = 0; chIx < NUMOF(sLedsStates); chIx++)
+    {
+        sLedsStates[chIx].inited = false;
+        sLedsStates[chIx].dirty = true;
+    }
+}
+
+// find effect program for a tag, -1 if there's none
+static int sLedsProgFind(const uint8_t tag)
+{
+    for (int ix = 0; (tag != 0) && (ix < sLedsNumProgs); ix++)
     {
-        xSemaphoreTake(sLedsStateMutex, portMAX_DELAY);
-        //if (memcmp(&sLedsStates[ledIx].param, pkParam, sizeof(*pkParam)) != 0)
+        if (sLedsProgs[ix].tag == tag)
         {
-            memset(&sLedsStates[ledIx], 0, sizeof(*sLedsStates));
-            sLedsStates[ledIx].param = *pkParam;
+            return ix;
         }
-        xSemaphoreGive(sLedsStateMutex);
     }
+    return -1;
 }
 
+// keyframe easing, f (and result) 0..256
+__INLINE static int sLedsEase(const uint8_t ease, const int f)
+{
+    switch (ease)
+    {
+        case LEDS_EASE_HOLD:   return 256;
+        case LEDS_EASE_LINEAR: return f;
+        case LEDS_EASE_INOUT:  return (f * f * ((3 * 256) - (2 * f))) >> 16;
+        case LEDS_EASE_IN:     return (f * f) >> 8;
+        case LEDS_EASE_OUT:    return 256 - (((256 - f) * (256 - f)) >> 8);
+    }
+    return f;
+}
+
+// render effect program, now is the synchronised time [ms] (constant cost, but for the rare walk over the
+// keyframes when the position jumps)
+static void sLedsRenderProg(LEDS_STATE_t *pState, const uint32_t now, uint8_t *pHue, uint8_t *pSat, uint8_t *pVal)
+{
+    const LEDS_PROG_t *pkProg = &sLedsProgs[pState->prog];
+    const LEDS_KF_t *pkKfs = &sLedsKfs[pkProg->kf0];
+
+    // the keyframes before the loop play from the start of the program, the loop is locked to the
+    // synchronised time (so that it runs in step on all devices)
+    const uint32_t phase = (uint32_t)(pState - sLedsStates) * pkProg->phase;
+    uint32_t pos = now - pState->t0 + phase;
+    if (pos >= pkProg->loopStart)
+    {
+        pos = pkProg->loopStart + ((now + phase) % (pkProg->dur - pkProg->loopStart));
+    }
+    if (pos < pState->pos)
+    {
+        pState->kf = pos >= pkProg->loopStart ? pkProg->loop : 0;
+    }
+    pState->pos = pos;
+    while (pState->pos >= pkKfs[pState->kf].end)
+    {
+        pState->kf++;
+    }
+
+    // fade from the previous keyframe's colour (hue the shorter way round)
+    const LEDS_KF_t *pkKf = &pkKfs[pState->kf];
+    const LEDS_KF_t *pkPrev = &pkKfs[ (pState->kf > 0) && (pState->kf != pkProg->loop) ? pState->kf - 1 : pkProg->num - 1 ];
+    const uint32_t t = pState->pos - (pkKf->end - pkKf->dur);
+    const int f = sLedsEase(pkKf->ease, (t * pkKf->inv) >> 8);
+    *pHue = pkPrev->hue + ((  (int)(int8_t)(pkKf->hue - pkPrev->hue)  * f) >> 8);
+    *pSat = pkPrev->sat + ((( (int)pkKf->sat - (int)pkPrev->sat )      * f) >> 8);
+    *pVal = pkPrev->val + ((( (int)pkKf->val - (int)pkPrev->val )      * f) >> 8);
+}
+
+// pulse amplitude, indexed by phase (0..LEDS_PULSE_PERIOD)
 static const int sLedsPulseAmpl[] =
 {
-#if (LEDS_FPS == 100)
     // floor(sin(0:pi/2/100:pi).*100)
     0, 1, 3, 4, 6, 7, 9, 10, 12, 14, 15, 17, 18, 20, 21, 23, 24, 26, 27, 29, 30, 32, 33, 35, 36, 38, 39,
     41, 42, 43, 45, 46, 48, 49, 50, 52, 53, 54, 56, 57, 58, 60, 61, 62, 63, 64, 66, 67, 68, 69, 70, 71,
@@ -336,21 +893,31 @@ static const int sLedsPulseAmpl[] =
     91, 90, 89, 89, 88, 87, 86, 86, 85, 84, 83, 82, 81, 80, 79, 79, 78, 77, 76, 75, 73, 72, 71, 70, 69,
     68, 67, 66, 64, 63, 62, 61, 60, 58, 57, 56, 54, 53, 52, 50, 49, 48, 46, 45, 43, 42, 41, 39, 38, 36,
     35, 33, 32, 30, 29, 27, 26, 24, 23, 21, 20, 18, 17, 15, 14, 12, 10, 9, 7, 6, 4, 3, 1, 0,
-#else
-#  error missing LUT for LEDS_FPS value
-#endif
 };
 
-static void sLedsRenderFx(LEDS_STATE_t *pState, uint8_t *pHue, uint8_t *pSat, uint8_t *pVal)
+// render effect, now is the synchronised time [ms], dt is the time [ms] since the previous frame
+static void sLedsRenderFx(LEDS_STATE_t *pState, const uint32_t now, const int dt, uint8_t *pHue, uint8_t *pSat, uint8_t *pVal)
 {
     if (!pState->inited)
     {
+        pState->prog = sLedsProgFind(pState->param.tag);
+        if (pState->prog >= 0)
+        {
+            const LEDS_PROG_t *pkProg = &sLedsProgs[pState->prog];
+            pState->animated = pkProg->num > 1;
+            pState->kf = 0;
+            pState->pos = 0;
+            pState->t0 = now;
+            pState->inited = true;
+            sLedsRenderProg(pState, now, pHue, pSat, pVal);
+            return;
+        }
+        pState->animated = pState->param.fx != LEDS_FX_STILL;
         switch (pState->param.fx)
         {
             case LEDS_FX_STILL:
-                break;
             case LEDS_FX_PULSE:
-                pState->count = 0;
+            case LEDS_FX_PROGRESS:
                 break;
             case LEDS_FX_FLICKER:
                 pState->count = 0;
@@ -359,6 +926,12 @@ static void sLedsRenderFx(LEDS_STATE_t *pState, uint8_t *pHue, uint8_t *pSat, ui
         pState->inited = true;
     }
 
+    if (pState->prog >= 0)
+    {
+        sLedsRenderProg(pState, now, pHue, pSat, pVal);
+        return;
+    }
+
     uint8_t hue = 0, sat = 0, val = 0;
 
     switch (pState->param.fx)
@@ -371,11 +944,16 @@ static void sLedsRenderFx(LEDS_STATE_t *pState, uint8_t *pHue, uint8_t *pSat, ui
             break;
         }
         case LEDS_FX_PULSE:
+        case LEDS_FX_PROGRESS:
         {
-            const uint8_t minVal = MAX(10, pState->param.val / 10);
-            pState->val = minVal + (( (pState->param.val - minVal) * sLedsPulseAmpl[pState->count] ) / 100);
-            pState->count++;
-            pState->count %= NUMOF(sLedsPulseAmpl);
+            uint8_t minVal = MAX(10, pState->param.val / 10);
+            if ( (pState->param.fx == LEDS_FX_PROGRESS) && (pState->param.val > minVal) )
+            {
+                minVal += ((pState->param.val - minVal) * pState->param.progress) >> 8;
+            }
+            // (phase from the synchronised time, so that all pulse in step)
+            const int amplIx = ((now % LEDS_PULSE_PERIOD) * NUMOF(sLedsPulseAmpl)) / LEDS_PULSE_PERIOD;
+            pState->val = minVal + (( (pState->param.val - minVal) * sLedsPulseAmpl[amplIx] ) / 100);
             hue = pState->param.hue;
             sat = pState->param.sat;
             val = pState->val;
@@ -396,7 +974,7 @@ static void sLedsRenderFx(LEDS_STATE_t *pState, uint8_t *pHue, uint8_t *pSat, ui
             //   3%          20 - 30 ms
             //   3%          10 - 20 ms
             //   4%           0 - 10 ms
-            if (pState->count == 0)
+            if (pState->count <= 0)
             {
                 const int pBright = rand() % 100;
                 if      (pBright < 50)  { pState->val = 196 + (rand() % (204 - 196)); }
@@ -406,14 +984,15 @@ static void sLedsRenderFx(LEDS_STATE_t *pState, uint8_t *pHue, uint8_t *pSat, ui
                 else                    { pState->val =  77 + (rand() % (102 -  77)); }
 
                 const int pTime = rand() % 100;
-                if      (pTime < 90) { pState->count =  20                         / (1000 / LEDS_FPS / 2); }
-                else if (pTime < 93) { pState->count = (20 + (rand() % (30 - 20))) / (1000 / LEDS_FPS / 2); }
-                else if (pTime < 96) { pState->count = (10 + (rand() % (20 - 10))) / (1000 / LEDS_FPS / 2); }
-                else                 { pState->count = (      rand() %  10       ) / (1000 / LEDS_FPS / 2); }
+                // (durations doubled, as we did at 100Hz, where the flicker looked best)
+                if      (pTime < 90) { pState->count = 2 *  20;                         }
+                else if (pTime < 93) { pState->count = 2 * (20 + (rand() % (30 - 20))); }
+                else if (pTime < 96) { pState->count = 2 * (10 + (rand() % (20 - 10))); }
+                else                 { pState->count = 2 * (      rand() %  10       ); }
             }
             else
             {
-                pState->count--;
+                pState->count -= dt;
             }
             hue = pState->param.hue;
             sat = pState->param.sat;
@@ -427,43 +1006,126 @@ static void sLedsRenderFx(LEDS_STATE_t *pState, uint8_t *pHue, uint8_t *pSat, ui
     *pVal = val;
 }
 
+// render next frame (only the LEDs that have changed or are animated) and send it, returns true if
+// something is animated (see also tools/host-bench.c)
+static bool sLedsRenderFrame(const CONFIG_DRIVER_t driver)
+{
+    static uint32_t sLastFrame;
+    const uint32_t now = osTime();
+    const int dt = MIN(now - sLastFrame, LEDS_IDLE_PERIOD);
+    sLastFrame = now;
+    const uint32_t syncNow = osGetSyncTime();
+    bool animated = false;
+    sLedsUpdateStates();
+    static uint8_t sHsv[LEDS_NUM_CH][3];
+    static uint8_t sRgb[LEDS_NUM_CH][3];
+    static uint8_t sChs[LEDS_NUM_CH];
+    int nHsv = 0;
+    for (uint16_t ix = 0; ix < NUMOF(sLedsStates); ix++)
+    {
+        LEDS_STATE_t *pState = &sLedsStates[ix];
+        if (pState->dirty || pState->animated)
+        {
+            sLedsRenderFx(pState, syncNow, dt, &sHsv[nHsv][0], &sHsv[nHsv][1], &sHsv[nHsv][2]);
+            pState->dirty = false;
+            sChs[nHsv++] = ix;
+        }
+        animated = animated || pState->animated;
+    }
+    // convert all rendered channels in one go
+    hsv2rgbN((const uint8_t (*)[3])sHsv, sRgb, nHsv);
+    for (int ix = 0; ix < nHsv; ix++)
+    {
+        sLedsSetChRGB(sChs[ix], sRgb[ix][0], sRgb[ix][1], sRgb[ix][2]);
+    }
+    sLedsNumHsv += nHsv;
+    TRACE(TRACE_EV_LEDS_FRAME, nHsv);
+    sLedsFlush(driver, false);
+    return animated;
+}
+
 static void sLedsTask(void *pArg)
 {
     static CONFIG_DRIVER_t sConfigDriverLast = CONFIG_DRIVER_UNKNOWN;
     static CONFIG_ORDER_t  sConfigOrderLast  = CONFIG_ORDER_UNKNOWN;
     static CONFIG_BRIGHT_t sConfigBrightLast = CONFIG_BRIGHT_UNKNOWN;
+    static bool            sConfigDitherLast = false;
+    static int             sConfigLedsLast   = 0;
+    static int             sConfigChLedsLast = 0;
+    static uint32_t        sConfigVersionLast = 0;
+    static int             sFps = CONFIG_FPS_DEFAULT;
+    static uint8_t         sConfigFxLast[CONFIG_FX_MAX];
+    static int             sConfigFxLenLast  = 0;
+    static uint8_t         sConfigFx[CONFIG_FX_MAX];
 
     while (true)
     {
-        const CONFIG_DRIVER_t configDriver = configGetDriver();
-        const CONFIG_ORDER_t  configOrder  = configGetOrder();
-        const CONFIG_BRIGHT_t configBright = configGetBright();
-
-        // handle config changes
+        // handle config changes (we get notified, see configSubscribe())
         bool doDemo = false;
-        if (sConfigDriverLast != configDriver)
+        uint32_t configVersion;
+        while ( (configVersion = configGetVersion()) != sConfigVersionLast )
         {
-            DEBUG("leds: driver change");
-            sLedsClear();
-            sLedsFlush(sConfigDriverLast);
-            sConfigDriverLast = configDriver;
-            doDemo = true;
-        }
-        if (sConfigOrderLast != configOrder)
-        {
-            DEBUG("leds: order change");
-            sConfigOrderLast = configOrder;
-            doDemo = true;
-        }
-        if (sConfigBrightLast != configBright)
-        {
-            DEBUG("leds: bright change");
-            sConfigBrightLast = configBright;
-            //doDemo = true;
+            const CONFIG_DRIVER_t configDriver = configGetDriver();
+            const CONFIG_ORDER_t  configOrder  = configGetOrder();
+            const CONFIG_BRIGHT_t configBright = configGetBright();
+            const bool            configDither = configGetDither();
+            const int             configLeds   = configGetLeds();
+            const int             configChLeds = configGetChLeds();
+            sFps = configGetPower() == CONFIG_POWER_LIGHT ? MIN(configGetFps(), LEDS_LIGHT_SLEEP_FPS) : configGetFps();
+            const int             configFxLen  = configGetFx(sConfigFx);
+            if (configGetVersion() != configVersion)
+            {
+                continue; // changed while reading, try again
+            }
+            sConfigVersionLast = configVersion;
+
+            if ( (sConfigLedsLast != configLeds) || (sConfigChLedsLast != configChLeds) )
+            {
+                DEBUG("leds: number change (%d, %d per channel)", configLeds, configChLeds);
+                sLedsClear();
+                sLedsFlush(sConfigDriverLast, true); // switch off all LEDs of the old config
+                sConfigLedsLast = configLeds;
+                sConfigChLedsLast = configChLeds;
+                sLedsSetNum(configLeds, configChLeds);
+                sLedsSetAllDirty();
+            }
+            if (sConfigDriverLast != configDriver)
+            {
+                DEBUG("leds: driver change");
+                sLedsClear();
+                sLedsFlush(sConfigDriverLast, true);
+                sConfigDriverLast = configDriver;
+                sLedsUpdateLut(configDriver, configBright, configDither);
+                sLedsSetAllDirty();
+                doDemo = true;
+            }
+            if (sConfigOrderLast != configOrder)
+            {
+                DEBUG("leds: order change");
+                sConfigOrderLast = configOrder;
+                sLedsSetOrder(configOrder);
+                sLedsSetAllDirty();
+                doDemo = true;
+            }
+            if ( (sConfigBrightLast != configBright) || (sConfigDitherLast != configDither) )
+            {
+                DEBUG("leds: bright change (dither %s)", configDither ? "on" : "off");
+                sConfigBrightLast = configBright;
+                sConfigDitherLast = configDither;
+                sLedsUpdateLut(configDriver, configBright, configDither);
+                //doDemo = true;
+            }
+            if ( (sConfigFxLenLast != configFxLen) || (memcmp(sConfigFxLast, sConfigFx, configFxLen) != 0) )
+            {
+                sConfigFxLenLast = configFxLen;
+                memcpy(sConfigFxLast, sConfigFx, configFxLen);
+                sLedsProgsCompile(sConfigFx, configFxLen);
+            }
         }
 
         // cannot do much if we don't know the driver
-        if (configGetDriver() == CONFIG_DRIVER_UNKNOWN)
+        const CONFIG_DRIVER_t configDriver = sConfigDriverLast;
+        if (configDriver == CONFIG_DRIVER_UNKNOWN)
         {
             osSleep(100);
             continue;
@@ -473,7 +1135,7 @@ static void sLedsTask(void *pArg)
         if (doDemo)
         {
             DEBUG("leds: demo");
-            for (uint16_t ix = 0; ix < LEDS_NUM; ix += 3)
+            for (uint16_t ix = 0; ix < sLedsNum; ix += 3)
             {
                 sLedsSetRGB(ix + 0, 255, 0, 0);
                 sLedsSetRGB(ix + 1, 0, 255, 0);
@@ -481,24 +1143,31 @@ static void sLedsTask(void *pArg)
             }
             for (uint16_t n = 0; n < 20; n++)
             {
-                sLedsFlush(configDriver);
+                sLedsFlush(configDriver, true);
                 osSleep(100);
             }
+            sLedsClear();
+            sLedsSetAllDirty();
         }
 
-        // render next frame..
+        // render and send next frame (dithering only works at the full frame rate, as the accumulators
+        // advance with each frame, also if nothing is animated)
+        const bool animated = sLedsRenderFrame(configDriver) || sLedsDitherOn;
+
+        // wait for next frame, full frame rate while something moves (but fewer frames in light sleep
+        // mode, so that the CPU can actually sleep in between)..
         static uint32_t sTick;
-        sLedsClear();
-        for (uint16_t ix = 0; ix < NUMOF(sLedsStates); ix++)
+        if (animated)
+        {
+            vTaskDelayUntil(&sTick, MS2TICKS(1000 / sFps));
+        }
+        // ..otherwise sleep until something has changed (or the config changed, or a while)
+        else
         {
-            uint8_t h = 0, s = 0, v = 0;
-            xSemaphoreTake(sLedsStateMutex, portMAX_DELAY);
-            sLedsRenderFx(&sLedsStates[ix], &h, &s, &v);
-            xSemaphoreGive(sLedsStateMutex);
-            sLedsSetHSV(ix, h, s, v);
+            ulTaskNotifyTake(pdTRUE, MS2TICKS(LEDS_IDLE_PERIOD));
+            sTick = xTaskGetTickCount();
         }
-        vTaskDelayUntil(&sTick, MS2TICKS(1000 / LEDS_FPS));
-        sLedsFlush(configDriver);
+        sLedsIdle = !animated;
     }
 
 }
@@ -508,10 +1177,19 @@ static void sLedsTask(void *pArg)
 
 void ledsInit(void)
 {
-    DEBUG("leds: init (%ux3=%u / %u, %u / %u*4=%u)",
-        LEDS_NUM, sizeof(sLedsData),
+    // carve buffers from the arena
+    static uint32_t sLedsArena[ ((2 * LEDS_MAX_NUM * 3) + 3) / 4 + (2 * LEDS_SPIBUF_WORDS) ];
+    uint32_t *pArena = sLedsArena;
+    sLedsSpiBuf     = pArena; pArena += LEDS_SPIBUF_WORDS;
+    sLedsSpiBufLast = pArena; pArena += LEDS_SPIBUF_WORDS;
+    sLedsData       = (uint8_t (*)[3])pArena;
+    sLedsDither     = &sLedsData[LEDS_MAX_NUM];
+    sLedsSetNum(JENKINS_MAX_CH, 1);
+
+    DEBUG("leds: init (%ux3=%u / %u, %u / %u*4=%u, arena %u)",
+        LEDS_MAX_NUM, LEDS_MAX_NUM * 3,
         LEDS_WS2801_BUFSIZE, LEDS_SK9822_BUFSIZE,
-        NUMOF(sLedsSpiBuf), sizeof(sLedsSpiBuf));
+        LEDS_SPIBUF_WORDS, LEDS_SPIBUF_WORDS * 4, (unsigned int)sizeof(sLedsArena));
 
     memset(&sLedsStates, 0, sizeof(sLedsStates));
 
@@ -524,6 +1202,7 @@ void ledsInit(void)
         .minimal_pins = true
     };
     spi_set_settings(LEDS_SPI, &skSpiSettings);
+    sLedsSpiClk = 2;
 
     //const uint8_t buf[] = { 0xff, 0x00, 0x00,  0x00, 0xff, 0x00,  0x00, 0x00, 0xff };
     //spi_transfer(LEDS_SPI, buf, NULL, sizeof(buf), SPI_8BIT);
@@ -531,23 +1210,34 @@ void ledsInit(void)
     _xt_isr_mask(BIT(INUM_SPI));
     _xt_isr_attach(INUM_SPI, sLedsSpiIsr, NULL);
 
+    sLedsSetOrder(CONFIG_ORDER_UNKNOWN);
+    sLedsUpdateLut(CONFIG_DRIVER_UNKNOWN, CONFIG_BRIGHT_UNKNOWN, false);
     sLedsClear();
-    sLedsFlush(CONFIG_DRIVER_SK9822);
+    sLedsFlush(CONFIG_DRIVER_SK9822, true);
     osSleep(100);
-    sLedsFlush(CONFIG_DRIVER_WS2801);
+    sLedsFlush(CONFIG_DRIVER_WS2801, true);
     osSleep(100);
 }
 
+void ledsMonStatus(void)
+{
+    DEBUG("mon: leds: num=%d/%d frames=%u flushes=%u single=%u busy=%u hsv=%u swaps=%u progs=%d fps=%d spi=%dMHz (%s)", sLedsNum, sLedsPerCh,
+        sLedsNumFrames, sLedsNumFlushes, sLedsNumSingle, sLedsNumBusy, sLedsNumHsv, sLedsNumSwaps, sLedsNumProgs, configGetFps(), sLedsSpiClk, sLedsIdle ? "idle" : "active");
+    sLedsNumSwaps = 0;
+}
+
 void ledsStart(void)
 {
     DEBUG("leds: start");
 
     static StaticSemaphore_t sMutex;
-    sLedsStateMutex = xSemaphoreCreateMutexStatic(&sMutex);
+    sLedsSharedMutex = xSemaphoreCreateMutexStatic(&sMutex);
 
-    static StackType_t sLedsTaskStack[512];
+    static StackType_t sLedsTaskStack[STACK_SIZE(LEDS)];
     static StaticTask_t sLedsTaskTCB;
-    xTaskCreateStatic(sLedsTask, "ff_leds", NUMOF(sLedsTaskStack), NULL, 2, sLedsTaskStack, &sLedsTaskTCB);
+    sLedsTaskHandle = xTaskCreateStatic(sLedsTask, "ff_leds", NUMOF(sLedsTaskStack), NULL, 2, sLedsTaskStack, &sLedsTaskTCB);
+    monRegisterStack("ff_leds", "LEDS", NUMOF(sLedsTaskStack));
+    configSubscribe(sLedsTaskHandle);
 }
 
 
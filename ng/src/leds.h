@@ -21,11 +21,15 @@ void ledsInit(void);
 //! start
 void ledsStart(void);
 
+//! print LEDs monitor string
+void ledsMonStatus(void);
+
 typedef enum LEDS_FX_e
 {
     LEDS_FX_STILL,
     LEDS_FX_PULSE,
     LEDS_FX_FLICKER,
+    LEDS_FX_PROGRESS,   //!< like #LEDS_FX_PULSE, but with the lower level rising with the progress
 
 } LEDS_FX_t;
 
@@ -40,6 +44,12 @@ typedef struct LEDS_PARAM_s
     // effect
     LEDS_FX_t fx;
 
+    // progress (0..255) for #LEDS_FX_PROGRESS
+    uint8_t progress;
+
+    // effect program tag (see below), 0 for none
+    uint8_t tag;
+
 } LEDS_PARAM_t;
 
 #define LEDS_MAKE_PARAM(_hue, _sat, _val, _fx) { .hue = (_hue), .sat = (_sat), .val = (_val), .fx = CONCAT(LEDS_FX_, _fx) }
@@ -47,6 +57,44 @@ typedef struct LEDS_PARAM_s
 
 void ledsSetState(const uint16_t ledIx, const LEDS_PARAM_t *pkParam);
 
+/*!
+    \name Effect programs
+
+    The backend can push effect programs in the "fx" config (see config.h). A LED state whose tag matches
+    the tag of a program renders that program instead of its colour and effect. The programs are a
+    sequence of bytes:
+
+    - Header: tag (1..255), number of keyframes (low nibble, 1..15) and the keyframe at which the loop
+      starts (high nibble), phase offset between channels [10ms]
+    - Keyframes: hue, saturation, value, duration [10ms] and easing (#LEDS_EASE_t, or'ed with
+      #LEDS_EASE_SLOW for a duration in [100ms])
+
+    Each keyframe fades from the previous keyframe's colour to its own colour over its duration (the first
+    keyframe and the first keyframe of the loop fade from the last one). The keyframes before the loop
+    start play once, the rest loops in step with the synchronised time (see osGetSyncTime()), like the
+    built-in pulses, so that all devices animate alike.
+    Channel n starts n times the phase offset into the program.
+
+    The Jenkins module tags its LED states with ((state + 1) << 4) | result (see #JENKINS_STATE_t and
+    #JENKINS_RESULT_t), e.g. "33020a55ffff640200ffff6402" makes running with a previous failure pulse
+    between green and red.
+    @{
+*/
+
+//! keyframe easing
+typedef enum LEDS_EASE_e
+{
+    LEDS_EASE_HOLD = 0, //!< jump to the colour and hold it
+    LEDS_EASE_LINEAR,   //!< linear
+    LEDS_EASE_INOUT,    //!< slow start and end (smoothstep)
+    LEDS_EASE_IN,       //!< slow start (quadratic)
+    LEDS_EASE_OUT,      //!< slow end (quadratic)
+} LEDS_EASE_t;
+
+#define LEDS_EASE_SLOW 0x10 //!< duration is in [100ms] instead of [10ms]
+
+//@}
+
 
 #endif // __LEDS_H__
 //@}
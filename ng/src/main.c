@@ -15,11 +15,18 @@
 #include "mon.h"
 #include "jenkins.h"
 #include "wifi.h"
+#include "relay.h"
+#include "mqtt.h"
 #include "tone.h"
 #include "config.h"
 #include "status.h"
+#include "button.h"
 #include "backend.h"
 #include "leds.h"
+#include "flash.h"
+#include "json.h"
+#include "httpd.h"
+#include "ota.h"
 #include "version_gen.h"
 
 //void vApplicationIdleHook(void)
@@ -94,14 +101,21 @@ void user_init(void)
     // initialise stuff
     debugInit(); // must be first
     stuffInit();
+    jsonInit();
+    flashInit();
+    otaInit();
     configInit();
     monInit();
     toneInit();
     statusInit();
+    buttonInit();
     backendInit();
     ledsInit();
     jenkinsInit();
     wifiInit();
+    relayInit();
+    mqttInit();
+    httpdInit();
 
     // trigger core dump
     //*((volatile uint32_t *)0) = 0; // null pointer deref, instant crash
@@ -118,6 +132,7 @@ void user_init(void)
     ledsStart();
     wifiStart();
     jenkinsStart();
+    httpdStart();
 }
 
 
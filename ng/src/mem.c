@@ -0,0 +1,233 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: memory pools and heap statistics (see \ref FF_MEM)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \addtogroup FF_MEM
+
+    @{
+*/
+
+#include "stdinc.h"
+
+#include "stuff.h"
+#include "debug.h"
+#include "mem.h"
+
+/* ***** fixed-size block pools ***************************************************************** */
+
+static MEM_POOL_t *spMemPools; // pools that have been used, for memMonStatus()
+
+void *memPoolAlloc(MEM_POOL_t *pPool)
+{
+    void *pBlock = NULL;
+    bool first = false;
+    CS_ENTER;
+    if ( (pPool->nAlloc == 0) && (pPool->nFail == 0) )
+    {
+        pPool->next = spMemPools;
+        spMemPools = pPool;
+        first = true;
+    }
+    for (int ix = 0; ix < (int)pPool->numBlocks; ix++)
+    {
+        const uint32_t mask = BIT(ix);
+        if ((pPool->used & mask) == 0)
+        {
+            pPool->used |= mask;
+            pBlock = &pPool->blocks[ix * pPool->blockSize];
+            const int nUsed = __builtin_popcount(pPool->used);
+            if (nUsed > pPool->maxUsed)
+            {
+                pPool->maxUsed = nUsed;
+            }
+            break;
+        }
+    }
+    if (pBlock != NULL)
+    {
+        pPool->nAlloc++;
+    }
+    else
+    {
+        pPool->nFail++;
+    }
+    CS_LEAVE;
+
+    if (first)
+    {
+        DEBUG("mem: pool %s (%ux%u)", pPool->name, pPool->numBlocks, pPool->blockSize);
+    }
+    if (pBlock == NULL)
+    {
+        WARNING("mem: pool %s exhausted", pPool->name);
+    }
+    return pBlock;
+}
+
+void memPoolFree(MEM_POOL_t *pPool, void *pBlock)
+{
+    if (pBlock == NULL)
+    {
+        return;
+    }
+    const int ix = ((uint8_t *)pBlock - pPool->blocks) / pPool->blockSize;
+    if ( (ix < 0) || (ix >= (int)pPool->numBlocks) || (&pPool->blocks[ix * pPool->blockSize] != pBlock) )
+    {
+        ERROR("mem: pool %s bad block %p", pPool->name, pBlock);
+        return;
+    }
+    CS_ENTER;
+    pPool->used &= ~BIT(ix);
+    CS_LEAVE;
+}
+
+
+/* ***** heap statistics ************************************************************************ */
+
+static uint32_t sMemMinFree;
+
+void memHeapStats(MEM_HEAP_STATS_t *pStats)
+{
+    // the free heap (see xPortGetFreeHeapSize()) is what's free in the newlib arena (fordblks) plus
+    // what it hasn't claimed yet (sbrk()), the top-most free chunk (keepcost) borders the latter
+    const struct mallinfo mi = mallinfo();
+    const uint32_t heap = sdk_system_get_free_heap_size();
+    const uint32_t unclaimed = heap > mi.fordblks ? heap - mi.fordblks : 0;
+    pStats->free    = heap;
+    pStats->top     = unclaimed + mi.keepcost;
+    pStats->holes   = mi.fordblks > mi.keepcost ? mi.fordblks - mi.keepcost : 0;
+    pStats->nHoles  = mi.keepcost > 0 ? (mi.ordblks > 0 ? mi.ordblks - 1 : 0) : mi.ordblks;
+    if ( (sMemMinFree == 0) || (heap < sMemMinFree) )
+    {
+        sMemMinFree = heap;
+    }
+    pStats->minFree = sMemMinFree;
+}
+
+
+/* ***** allocation statistics per call site (HEAPSTATS=1, the linker wraps malloc() etc.) ****** */
+
+#if (defined FF_MEM_HEAPSTATS && (FF_MEM_HEAPSTATS > 0))
+
+#define MEM_SITES_NUM 16
+
+typedef struct MEM_SITE_s
+{
+    uint32_t addr;   // return address (0 = all others, when the table is full)
+    uint32_t nAlloc;
+    uint32_t nBytes;
+    uint32_t nFail;
+} MEM_SITE_t;
+
+static MEM_SITE_t sMemSites[MEM_SITES_NUM + 1];
+static volatile uint32_t svMemNumFail;
+
+static void sMemCount(const void *pkAddr, const size_t size, const bool ok)
+{
+    const uint32_t addr = (uint32_t)pkAddr;
+    CS_ENTER;
+    MEM_SITE_t *pSite = &sMemSites[MEM_SITES_NUM];
+    for (int ix = 0; ix < MEM_SITES_NUM; ix++)
+    {
+        if ( (sMemSites[ix].addr == addr) || (sMemSites[ix].addr == 0) )
+        {
+            pSite = &sMemSites[ix];
+            pSite->addr = addr;
+            break;
+        }
+    }
+    pSite->nAlloc++;
+    pSite->nBytes += size;
+    if (!ok)
+    {
+        pSite->nFail++;
+        svMemNumFail++;
+    }
+    CS_LEAVE;
+}
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    sMemCount(__builtin_return_address(0), size, ptr != NULL);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t num, size_t size)
+{
+    void *ptr = __real_calloc(num, size);
+    sMemCount(__builtin_return_address(0), num * size, ptr != NULL);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    void *newPtr = __real_realloc(ptr, size);
+    sMemCount(__builtin_return_address(0), size, (newPtr != NULL) || (size == 0));
+    return newPtr;
+}
+
+static void sMemSitesMonStatus(void)
+{
+    MEM_SITE_t sites[NUMOF(sMemSites)];
+    CS_ENTER;
+    memcpy(sites, sMemSites, sizeof(sites));
+    CS_LEAVE;
+    for (int ix = 0; ix < (int)NUMOF(sites); ix++)
+    {
+        const MEM_SITE_t *pkSite = &sites[ix];
+        if (pkSite->nAlloc == 0)
+        {
+            continue;
+        }
+        if (ix < MEM_SITES_NUM)
+        {
+            DEBUG("mon: mem: site 0x%08x n=%u bytes=%u fail=%u", pkSite->addr, pkSite->nAlloc, pkSite->nBytes, pkSite->nFail);
+        }
+        else
+        {
+            DEBUG("mon: mem: site others     n=%u bytes=%u fail=%u", pkSite->nAlloc, pkSite->nBytes, pkSite->nFail);
+        }
+    }
+    static uint32_t sLastNumFail;
+    const uint32_t nFail = svMemNumFail;
+    if (nFail != sLastNumFail)
+    {
+        WARNING("mem: %u malloc fails", nFail - sLastNumFail);
+        sLastNumFail = nFail;
+    }
+}
+
+#endif // (FF_MEM_HEAPSTATS > 0)
+
+
+/* ***** monitor ******************************************************************************** */
+
+void memMonStatus(void)
+{
+    MEM_HEAP_STATS_t stats;
+    memHeapStats(&stats);
+    DEBUG("mon: mem: heap free=%u min=%u top=%u holes=%u/%u (%u%%)",
+        stats.free, stats.minFree, stats.top, stats.holes, stats.nHoles,
+        stats.free > 0 ? stats.holes * 100 / stats.free : 0);
+
+    for (const MEM_POOL_t *pkPool = spMemPools; pkPool != NULL; pkPool = pkPool->next)
+    {
+        DEBUG("mon: mem: pool %s %u/%u max=%u alloc=%u fail=%u", pkPool->name,
+            __builtin_popcount(pkPool->used), pkPool->numBlocks, pkPool->maxUsed, pkPool->nAlloc, pkPool->nFail);
+    }
+
+#if (defined FF_MEM_HEAPSTATS && (FF_MEM_HEAPSTATS > 0))
+    sMemSitesMonStatus();
+#endif
+}
+
+//@}
+// eof
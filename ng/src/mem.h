@@ -0,0 +1,92 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: memory pools and heap statistics (see \ref FF_MEM)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \defgroup FF_MEM MEM
+    \ingroup FF
+
+    Our own code doesn't use the heap in the normal operation: the buffers are static (e.g. the
+    JSON token pool, see json.h) or come from fixed-size block pools (MEM_POOL()). The heap is left
+    to the SDK, lwIP and BearSSL. The pools and the heap statistics are printed by the system
+    monitor (memMonStatus()).
+
+    The heap statistics are cheap estimates from newlib's mallinfo(): the free heap, the space at
+    the top of the heap (the largest block that can be allocated is at least that big) and the free
+    space in the holes below it (fragmentation).
+
+    With "make ... HEAPSTATS=1" (which defines FF_MEM_HEAPSTATS) all malloc(), calloc() and
+    realloc() calls are counted per call site (return address, look it up in the .lst file or with
+    addr2line) and the failed allocations are reported.
+
+    @{
+*/
+#ifndef __MEM_H__
+#define __MEM_H__
+
+#include "stdinc.h"
+
+//! fixed-size block pool (define with MEM_POOL())
+typedef struct MEM_POOL_s
+{
+    const char         *name;       //!< name (for memMonStatus())
+    uint8_t            *blocks;     //!< storage (numBlocks * blockSize bytes)
+    uint16_t            blockSize;  //!< size of a block [bytes]
+    uint8_t             numBlocks;  //!< number of blocks (max. 32)
+    uint8_t             maxUsed;    //!< (statistics) most blocks in use at a time
+    uint32_t            used;       //!< blocks in use (bitmask)
+    uint32_t            nAlloc;     //!< (statistics) number of allocations
+    uint32_t            nFail;      //!< (statistics) number of failed allocations
+    struct MEM_POOL_s  *next;       //!< next pool (for memMonStatus())
+} MEM_POOL_t;
+
+//! define a static fixed-size block pool \hideinitializer
+/*!
+    \param[in] var   name of the (static) MEM_POOL_t variable
+    \param[in] name  name of the pool (string, for memMonStatus())
+    \param[in] size  block size [bytes] (rounded up to a multiple of 4)
+    \param[in] num   number of blocks (max. 32)
+*/
+#define MEM_POOL(var, name, size, num) \
+    static uint8_t var ## Blocks[(num) * (((size) + 3) & ~3)] __attribute__((aligned(4))); \
+    static MEM_POOL_t var = { name, var ## Blocks, ((size) + 3) & ~3, (num), 0, 0, 0, 0, NULL }
+
+//! allocate block from pool
+/*!
+    \param[in] pPool  the pool
+    \returns a block (blockSize bytes) or NULL if all blocks are in use
+*/
+void *memPoolAlloc(MEM_POOL_t *pPool);
+
+//! return block to pool
+/*!
+    \param[in] pPool   the pool
+    \param[in] pBlock  block from memPoolAlloc() (or NULL, which is ignored)
+*/
+void memPoolFree(MEM_POOL_t *pPool, void *pBlock);
+
+//! heap statistics
+typedef struct MEM_HEAP_STATS_s
+{
+    uint32_t free;     //!< free heap [bytes]
+    uint32_t minFree;  //!< lowest free heap seen by memHeapStats() [bytes]
+    uint32_t top;      //!< free space at the top of the heap [bytes] (the largest block is at least that big)
+    uint32_t holes;    //!< free space in the holes below the top [bytes]
+    uint32_t nHoles;   //!< number of holes
+} MEM_HEAP_STATS_t;
+
+//! get heap statistics
+/*!
+    \param[out] pStats  the statistics
+*/
+void memHeapStats(MEM_HEAP_STATS_t *pStats);
+
+//! print memory monitor string
+void memMonStatus(void);
+
+
+#endif // __MEM_H__
+//@}
+// eof
@@ -7,34 +7,140 @@
 */
 
 #include "stdinc.h"
-#include <esp/rtc_regs.h>
+#include <xtensa_ops.h>
 
 #include "debug.h"
 #include "stuff.h"
 #include "wifi.h"
+#include "relay.h"
+#include "mqtt.h"
 #include "backend.h"
 #include "config.h"
 #include "jenkins.h"
+#include "leds.h"
+#include "flash.h"
+#include "tone.h"
+#include "status.h"
+#include "button.h"
+#include "httpd.h"
+#include "ota.h"
+#include "stacks.h"
+#include "mem.h"
 #include "mon.h"
 
 
 #define MON_PERIOD 5000
-#define MAX_TASKS 10
+#define MAX_TASKS 14
+#define MON_TELEMETRY_SIZE 512
+#define MON_STACK_WARN 85 // [%]
 
 
-static volatile uint32_t svMonIsrStart;
-static volatile uint32_t svMonIsrCount;
-static volatile uint32_t svMonIsrTime;
+// per interrupt source statistics (in CPU cycles, the counter wraps every ~27s at 160MHz)
+typedef struct MON_ISR_STATS_s
+{
+    uint32_t count;
+    uint32_t cycles;
+    uint32_t maxCycles;
+} MON_ISR_STATS_t;
+
+static volatile MON_ISR_STATS_t svMonIsrStats[_MON_ISR_NUM];
+
+static const char * const skMonIsrNames[] =
+{
+    [MON_ISR_UART]   = "uart",
+    [MON_ISR_SPI]    = "spi",
+    [MON_ISR_I2S]    = "i2s",
+    [MON_ISR_TONE]   = "tone",
+    [MON_ISR_BUTTON] = "button",
+};
+
+IRAM uint32_t monIsrEnter(void)
+{
+    uint32_t ccount;
+    RSR(ccount, ccount);
+    return ccount;
+}
+
+IRAM void monIsrLeave(const MON_ISR_t src, const uint32_t t0)
+{
+    uint32_t ccount;
+    RSR(ccount, ccount);
+    const uint32_t cycles = ccount - t0;
+    volatile MON_ISR_STATS_t *pStats = &svMonIsrStats[src];
+    pStats->count++;
+    pStats->cycles += cycles;
+    if (cycles > pStats->maxCycles)
+    {
+        pStats->maxCycles = cycles;
+    }
+}
 
-void monIsrEnter(void)
+// registered task stacks (see monRegisterStack())
+typedef struct MON_STACK_s
 {
-    svMonIsrStart = RTC.COUNTER;
-    svMonIsrCount++;
+    const char *task;
+    const char *id;
+    uint32_t    size;    // [StackType_t]
+    uint32_t    minFree; // lowest high-water mark seen [StackType_t]
+    uint32_t    warned;  // high-water mark we last warned about
+} MON_STACK_t;
+
+static MON_STACK_t sMonStacks[MAX_TASKS];
+static int sMonNumStacks;
+
+void monRegisterStack(const char *task, const char *id, const uint32_t size)
+{
+    bool ok = false;
+    CS_ENTER;
+    if (sMonNumStacks < (int)NUMOF(sMonStacks))
+    {
+        MON_STACK_t *pStack = &sMonStacks[sMonNumStacks];
+        pStack->task    = task;
+        pStack->id      = id;
+        pStack->size    = size;
+        pStack->minFree = size;
+        pStack->warned  = size;
+        sMonNumStacks++;
+        ok = true;
+    }
+    CS_LEAVE;
+    if (!ok)
+    {
+        WARNING("mon: too many stacks (%s)", task);
+    }
 }
 
-void monIsrLeave(void)
+// stack watchdog: warn when a task gets close to overflowing its stack (each time it gets worse),
+// print the lowest high-water marks in the calibration build (see tools/stacks.pl)
+static void sMonCheckStacks(const TaskStatus_t *pkTasks, const int nTasks)
 {
-    svMonIsrTime += RTC.COUNTER - svMonIsrStart;
+    for (int stackIx = 0; stackIx < sMonNumStacks; stackIx++)
+    {
+        MON_STACK_t *pStack = &sMonStacks[stackIx];
+        for (int taskIx = 0; taskIx < nTasks; taskIx++)
+        {
+            const TaskStatus_t *pkTask = &pkTasks[taskIx];
+            if (strcmp(pkTask->pcTaskName, pStack->task) != 0)
+            {
+                continue;
+            }
+            const uint32_t hwm = pkTask->usStackHighWaterMark;
+            if (hwm < pStack->minFree)
+            {
+                pStack->minFree = hwm;
+            }
+            if ( (hwm < pStack->warned) && (((pStack->size - hwm) * 100) > (pStack->size * MON_STACK_WARN)) )
+            {
+                WARNING("mon: stack %s %u%% used (%u of %u free)", pStack->task,
+                    (pStack->size - hwm) * 100 / pStack->size, hwm, pStack->size);
+                pStack->warned = hwm;
+            }
+            break;
+        }
+#if (defined FF_STACKS_CALIB && (FF_STACKS_CALIB > 0))
+        PRINT("mon: stk: %s %s %u %u", pStack->id, pStack->task, pStack->size, pStack->minFree);
+#endif
+    }
 }
 
 static int sTaskSortFunc(const void *a, const void *b)
@@ -42,18 +148,67 @@ static int sTaskSortFunc(const void *a, const void *b)
     return (int)((const TaskStatus_t *)a)->xTaskNumber - (int)((const TaskStatus_t *)b)->xTaskNumber;
 }
 
+// telemetry records (compact JSON), the one not being written to is the latest (see monGetTelemetry())
+static char sMonTelemetry[2][MON_TELEMETRY_SIZE];
+static volatile int svMonTelemetryIx = -1;
+
+const char *monGetTelemetry(void)
+{
+    const int ix = svMonTelemetryIx;
+    return ix >= 0 ? sMonTelemetry[ix] : NULL;
+}
+
+// {"up":uptime[s],"heap":free,"minheap":lowest free,"isr":rate[Hz],"isrload":[1/1000],"rssi":dBm,
+//  "rx":bytes,"lines":n,"conns":n,"tasks":[[name,cpu[1/1000],stack high water],...],
+//  "isrs":[[name,rate[Hz],mean[us],max[us]],...]}
+static void sMonUpdateTelemetry(const uint32_t heap, const uint32_t minHeap, const uint32_t isrRate,
+    const uint32_t isrLoad, const TaskStatus_t *pkTasks, const int nTasks, const uint32_t totalRuntimeTasks,
+    const MON_ISR_STATS_t *pkIsrStats)
+{
+    const int ix = svMonTelemetryIx == 0 ? 1 : 0;
+    char *str = sMonTelemetry[ix];
+    const int size = sizeof(sMonTelemetry[ix]);
+
+    uint32_t bytes, lines, conns;
+    backendGetCounters(&bytes, &lines, &conns);
+    int len = snprintf(str, size,
+        "{\"up\":%u,\"heap\":%u,\"minheap\":%u,\"isr\":%u,\"isrload\":%u,\"rssi\":%d,\"rx\":%u,\"lines\":%u,\"conns\":%u,\"tasks\":[",
+        osTime() / 1000, heap, minHeap, isrRate, isrLoad, sdk_wifi_station_get_rssi(), bytes, lines, conns);
+    for (int taskIx = 0; (taskIx < nTasks) && (len < size); taskIx++)
+    {
+        const TaskStatus_t *pkTask = &pkTasks[taskIx];
+        const uint32_t cpu = totalRuntimeTasks != 0 ?
+            (uint32_t)(((uint64_t)pkTask->ulRunTimeCounter * 1000) / totalRuntimeTasks) : 0;
+        len += snprintf(&str[len], size - len, "%s[\"%s\",%u,%u]", taskIx > 0 ? "," : "",
+            pkTask->pcTaskName, cpu, (unsigned int)pkTask->usStackHighWaterMark);
+    }
+    const uint32_t mhz = sdk_system_get_cpu_freq();
+    for (int isrIx = 0; (isrIx < _MON_ISR_NUM) && (len < size); isrIx++)
+    {
+        const MON_ISR_STATS_t *pkStats = &pkIsrStats[isrIx];
+        len += snprintf(&str[len], size - len, "%s[\"%s\",%u,%u,%u]", isrIx > 0 ? "," : "],\"isrs\":[",
+            skMonIsrNames[isrIx], pkStats->count * 1000 / MON_PERIOD,
+            pkStats->count != 0 ? pkStats->cycles / pkStats->count / mhz : 0, pkStats->maxCycles / mhz);
+    }
+    if (len < (size - 3))
+    {
+        strcpy(&str[len], "]}");
+        svMonTelemetryIx = ix;
+    }
+    else
+    {
+        WARNING("mon: telemetry too long");
+    }
+}
+
 
 static void sMonTask(void *pArg)
 {
-    TaskStatus_t *pTasks = NULL;
+    static TaskStatus_t sTasks[MAX_TASKS];
+    TaskStatus_t *pTasks = sTasks;
 
     while (true)
     {
-        if (pTasks != NULL)
-        {
-            free(pTasks);
-        }
-
         // wait until it's time to dump the status
         static uint32_t sTick;
         vTaskDelayUntil(&sTick, MS2TICKS(MON_PERIOD));
@@ -65,28 +220,32 @@ static void sMonTask(void *pArg)
             continue;
         }
 
-        // allocate memory for tasks status
-        const unsigned int allocSize = nTasks * sizeof(TaskStatus_t);
-        pTasks = malloc(allocSize);
-        if (pTasks == NULL)
-        {
-            ERROR("mon: malloc");
-            continue;
-        }
-        memset(pTasks, 0, allocSize);
+        memset(sTasks, 0, sizeof(sTasks));
 
         // get ISR runtime stats
-        uint32_t isrCount, isrTime, isrTotalRuntime;
+        MON_ISR_STATS_t isrStats[_MON_ISR_NUM];
+        uint32_t isrTotalRuntime;
         static uint32_t sIsrLastRuntime;
         CS_ENTER;
-        const uint32_t rtcCounter = RTC.COUNTER;
-        isrTotalRuntime = rtcCounter - sIsrLastRuntime;
-        sIsrLastRuntime = rtcCounter;
-        isrCount = svMonIsrTime;
-        isrTime = svMonIsrCount;
-        svMonIsrCount = 0;
-        svMonIsrTime = 0;
+        uint32_t ccount;
+        RSR(ccount, ccount);
+        isrTotalRuntime = ccount - sIsrLastRuntime;
+        sIsrLastRuntime = ccount;
+        for (int ix = 0; ix < _MON_ISR_NUM; ix++)
+        {
+            isrStats[ix] = *(MON_ISR_STATS_t *)&svMonIsrStats[ix];
+            svMonIsrStats[ix].count = 0;
+            svMonIsrStats[ix].cycles = 0;
+            svMonIsrStats[ix].maxCycles = 0;
+        }
         CS_LEAVE;
+        uint32_t isrCount = 0;
+        uint32_t isrTime = 0;
+        for (int ix = 0; ix < _MON_ISR_NUM; ix++)
+        {
+            isrCount += isrStats[ix].count;
+            isrTime += isrStats[ix].cycles;
+        }
 
         // get tasks info
         uint32_t totalRuntime;
@@ -134,18 +293,57 @@ static void sMonTask(void *pArg)
             * (1.0/1000.0/4096.0) * sdk_system_rtc_clock_cali_proc() ); // us -> ms
         sLastRtc = thisRtc;
 
+        // heap
+        static uint32_t sMinHeap;
+        const uint32_t heap = sdk_system_get_free_heap_size();
+        if ( (sMinHeap == 0) || (heap < sMinHeap) )
+        {
+            sMinHeap = heap;
+        }
+
+        // telemetry record for the backend
+        sMonUpdateTelemetry(heap, sMinHeap, isrCount * 1000 / MON_PERIOD,
+            isrTotalRuntime != 0 ? (uint32_t)(((uint64_t)isrTime * 1000) / isrTotalRuntime) : 0,
+            pTasks, nTasks, totalRuntimeTasks, isrStats);
+
+        // check stacks
+        sMonCheckStacks(pTasks, nTasks);
+
         // print monitor info
         DEBUG("--------------------------------------------------------------------------------");
-        DEBUG("mon: sys: ticks=%u msss=%u drtc=%u heap=%u isr=%u (%.2fkHz, %.1f%%) mhz=%u",
-            sTick, msss, drtc, /*xPortGetFreeHeapSize(), */sdk_system_get_free_heap_size(),
+        DEBUG("mon: sys: ticks=%u msss=%u drtc=%u heap=%u/%u isr=%u (%.2fkHz, %.1f%%) mhz=%u",
+            sTick, msss, drtc, /*xPortGetFreeHeapSize(), */heap, sMinHeap,
             isrCount,
             (double)isrCount / ((double)MON_PERIOD / 1000.0) / 1000.0,
             (double)isrTime * 100.0 / (double)isrTotalRuntime, sdk_system_get_cpu_freq());
+        {
+            const double mhz = sdk_system_get_cpu_freq();
+            char str[(_MON_ISR_NUM * 48) + 1];
+            int len = 0;
+            for (int ix = 0; (ix < _MON_ISR_NUM) && (len < (int)sizeof(str)); ix++)
+            {
+                const MON_ISR_STATS_t *pkStats = &isrStats[ix];
+                len += snprintf(&str[len], sizeof(str) - len, " %s=%u (%.1f/%.1fus, %.2f%%)", skMonIsrNames[ix],
+                    pkStats->count, pkStats->count != 0 ? (double)pkStats->cycles / (double)pkStats->count / mhz : 0.0,
+                    (double)pkStats->maxCycles / mhz, (double)pkStats->cycles * 100.0 / (double)isrTotalRuntime);
+            }
+            DEBUG("mon: isr:%s", str);
+        }
+        memMonStatus();
         debugMonStatus();
         wifiMonStatus();
+        relayMonStatus();
+        mqttMonStatus();
         backendMonStatus();
         configMonStatus();
         jenkinsMonStatus();
+        ledsMonStatus();
+        flashMonStatus();
+        toneMonStatus();
+        statusMonStatus();
+        buttonMonStatus();
+        httpdMonStatus();
+        otaMonStatus();
 
         // print tasks info
         for (int ix = 0; ix < nTasks; ix++)
@@ -192,9 +390,10 @@ void monInit(void)
 {
     DEBUG("mon: init");
 
-    static StackType_t sMonTaskStack[384];
+    static StackType_t sMonTaskStack[STACK_SIZE(MON)];
     static StaticTask_t sMonTaskTCB;
     xTaskCreateStatic(sMonTask, "ff_mon", NUMOF(sMonTaskStack), NULL, 9, sMonTaskStack, &sMonTaskTCB);
+    monRegisterStack("ff_mon", "MON", NUMOF(sMonTaskStack));
 }
 
 // eof
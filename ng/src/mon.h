@@ -18,8 +18,47 @@
 //! initialise system monitor
 void monInit(void);
 
-void monIsrEnter(void);
-void monIsrLeave(void);
+//! interrupt sources we keep statistics for
+typedef enum MON_ISR_e
+{
+    MON_ISR_UART = 0, //!< debug output UART
+    MON_ISR_SPI,      //!< LEDs SPI
+    MON_ISR_I2S,      //!< LEDs I2S DMA
+    MON_ISR_TONE,     //!< tone FRC1 timer
+    MON_ISR_BUTTON,   //!< button GPIO
+    _MON_ISR_NUM
+} MON_ISR_t;
+
+//! start of interrupt handler
+/*!
+    \returns the CPU cycle counter, to be passed to monIsrLeave()
+*/
+uint32_t monIsrEnter(void);
+
+//! end of interrupt handler
+/*!
+    \param[in] src  interrupt source
+    \param[in] t0   CPU cycle counter from monIsrEnter()
+*/
+void monIsrLeave(const MON_ISR_t src, const uint32_t t0);
+
+//! get latest telemetry record
+/*!
+    \returns the latest telemetry record (compact JSON with heap, ISR, task, wifi and backend stats),
+              which stays valid for at least one monitor period, or NULL if there is none yet
+*/
+const char *monGetTelemetry(void);
+
+//! register a task's stack for the stack watchdog (and the calibration, see \ref FF_STACKS)
+/*!
+    The monitor warns when a registered task has used more than MON_STACK_WARN percent of its
+    stack. In the calibration build it prints the lowest high-water mark of each registered task.
+
+    \param[in] task  task name (as given to xTaskCreateStatic())
+    \param[in] id    stack size identifier (e.g. "LEDS" for STACK_SIZE(LEDS), see stacks.h)
+    \param[in] size  stack size [StackType_t]
+*/
+void monRegisterStack(const char *task, const char *id, const uint32_t size);
 
 
 #endif // __MON_H__
@@ -0,0 +1,526 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: MQTT transport (see \ref FF_MQTT)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \addtogroup FF_MQTT
+
+    @{
+*/
+
+#include "stdinc.h"
+
+#include "stuff.h"
+#include "debug.h"
+#include "mqtt.h"
+#include "cfg_gen.h"
+
+#if (defined FF_MQTT && (FF_MQTT > 0))
+
+#include <lwip/api.h>
+#include <lwip/tcpip.h>
+#include <lwip/apps/mqtt.h>
+
+#include "jenkins.h"
+#include "mem.h"
+
+#ifndef FF_CFG_MQTTURL
+#  error MQTT=1 needs MQTTURL in the CFGFILE!
+#endif
+
+#if (!LWIP_TCPIP_CORE_LOCKING)
+#  error We need LWIP_TCPIP_CORE_LOCKING!
+#endif
+
+#define MQTT_CONNECT_TIMEOUT 5000 // [ms] until the broker has accepted the connection
+#define MQTT_SUB_RETRIES       20 // times 50ms, when lwIP has too many requests in flight
+#define MQTT_TOPIC_MAX        160 // maximum length of a topic
+
+/* ***** messages ******************************************************************************* */
+
+typedef enum MQTT_MSG_TYPE_e
+{
+    MQTT_MSG_LINES, // realtime stream lines (heartbeat, client and command topics)
+    MQTT_MSG_JOB,   // job state
+} MQTT_MSG_TYPE_t;
+
+// message in a pool block: for MQTT_MSG_LINES data is the payload plus "\n", for MQTT_MSG_JOB it's
+// "<server>/<job>" (the topic without "<prefix>/job/"), a nul, and the payload, all nul-terminated
+typedef struct MQTT_MSG_s
+{
+    MEM_POOL_t     *pPool;   // the pool the block is from
+    MQTT_MSG_TYPE_t type;
+    uint16_t        size;    // size of data[]
+    uint16_t        len;     // length of data[] so far
+    uint16_t        payload; // offset of the payload in data[]
+    char            data[];
+} MQTT_MSG_t;
+
+MEM_POOL(sMqttLinesPool, "mqtt",    sizeof(MQTT_MSG_t) + MQTT_LINES_MAX, 2);
+// (a block for each channel, as the broker sends the retained states of all jobs right after subscribing)
+MEM_POOL(sMqttJobPool,   "mqttjob", sizeof(MQTT_MSG_t) + MQTT_JOB_MAX,  JENKINS_MAX_CH);
+
+// received messages, from the tcpip thread to the wifi task (NULL to wake it up)
+static QueueHandle_t sMqttQueue;
+
+// broker (decomposed FF_CFG_MQTTURL)
+typedef struct MQTT_DATA_s
+{
+    char            url[sizeof(FF_CFG_MQTTURL)];
+    bool            haveUrl;
+    const char     *host;
+    const char     *user;
+    const char     *pass;
+    const char     *prefix;
+    uint16_t        port;
+    mqtt_client_t  *client;
+    SemaphoreHandle_t connSem;   // given when the broker responds to the connect
+    volatile mqtt_connection_status_t svConnStatus;
+    volatile bool   svConnected;
+    MQTT_MSG_t     *pMsgIn;      // message being received (tcpip thread)
+    char            jobPrefix[MQTT_TOPIC_MAX]; // "<prefix>/job/"
+    int             jobPrefixLen;
+    uint32_t        subHashes[JENKINS_MAX_CH]; // job topics we have subscribed to on this connection
+    int             nSubHashes;
+    // statistics
+    uint32_t        nConnect;
+    uint32_t        nMsgs;
+    uint32_t        nLines;
+    uint32_t        nJobs;
+    uint32_t        nDrop;
+    uint32_t        nSubs;
+    uint32_t        nSubFail;
+} MQTT_DATA_t;
+
+static MQTT_DATA_t sMqttData;
+
+// "mqtt://[<user>:<pass>@]<host>[:<port>]/<prefix>"
+static bool sMqttParseUrl(void)
+{
+    strcpy(sMqttData.url, FF_CFG_MQTTURL);
+    char *pParse = sMqttData.url;
+    if (strncmp(pParse, "mqtt://", 7) != 0)
+    {
+        return false;
+    }
+    pParse += 7;
+
+    char *pSlash = strchr(pParse, '/');
+    if ( (pSlash == NULL) || (pSlash[1] == '\0') )
+    {
+        return false;
+    }
+    *pSlash = '\0';
+    sMqttData.prefix = &pSlash[1];
+
+    char *pMonkey = strchr(pParse, '@');
+    if (pMonkey != NULL)
+    {
+        *pMonkey = '\0';
+        char *pColon = strchr(pParse, ':');
+        if (pColon == NULL)
+        {
+            return false;
+        }
+        *pColon = '\0';
+        sMqttData.user = pParse;
+        sMqttData.pass = &pColon[1];
+        pParse = &pMonkey[1];
+    }
+
+    sMqttData.port = 1883;
+    char *pColon = strchr(pParse, ':');
+    if (pColon != NULL)
+    {
+        *pColon = '\0';
+        sMqttData.port = atoi(&pColon[1]);
+    }
+    sMqttData.host = pParse;
+
+    const int len = snprintf(sMqttData.jobPrefix, sizeof(sMqttData.jobPrefix), "%s/job/", sMqttData.prefix);
+    sMqttData.jobPrefixLen = len;
+    return (sMqttData.host[0] != '\0') && (sMqttData.port != 0) && (len < (int)sizeof(sMqttData.jobPrefix));
+}
+
+// FNV-1a of the topic
+static uint32_t sMqttTopicHash(const char *topic)
+{
+    uint32_t hash = 2166136261;
+    for (const char *pkC = topic; *pkC != '\0'; pkC++)
+    {
+        hash = (hash ^ (uint8_t)*pkC) * 16777619;
+    }
+    return hash;
+}
+
+// "<prefix>/job/<server>/<job>", or just "<server>/<job>" (without the prefix)
+static bool sMqttJobTopic(const JENKINS_INFO_t *pkInfo, char *topic, const int size, const bool prefix)
+{
+    const int len = snprintf(topic, size, "%s%s/%s", prefix ? sMqttData.jobPrefix : "", pkInfo->server, pkInfo->job);
+    return (len > 0) && (len < size);
+}
+
+
+/* ***** lwIP callbacks (in the tcpip thread) *************************************************** */
+
+static void sMqttConnCb(mqtt_client_t *client, void *arg, mqtt_connection_status_t status)
+{
+    UNUSED(client);
+    UNUSED(arg);
+    sMqttData.svConnStatus = status;
+    sMqttData.svConnected = status == MQTT_CONNECT_ACCEPTED;
+    xSemaphoreGive(sMqttData.connSem);
+    if (status != MQTT_CONNECT_ACCEPTED)
+    {
+        // wake up the wifi task
+        MQTT_MSG_t *pMsg = NULL;
+        xQueueSend(sMqttQueue, &pMsg, 0);
+    }
+}
+
+static void sMqttPublishCb(void *arg, const char *topic, uint32_t totLen)
+{
+    UNUSED(arg);
+
+    // drop incomplete message (shouldn't happen)
+    if (sMqttData.pMsgIn != NULL)
+    {
+        memPoolFree(sMqttData.pMsgIn->pPool, sMqttData.pMsgIn);
+        sMqttData.pMsgIn = NULL;
+        sMqttData.nDrop++;
+    }
+
+    const bool isJob = strncmp(topic, sMqttData.jobPrefix, sMqttData.jobPrefixLen) == 0;
+    const char *jobTopic = &topic[sMqttData.jobPrefixLen];
+    const int topicSize = isJob ? (strlen(jobTopic) + 1) : 0;
+    MEM_POOL_t *pPool = isJob ? &sMqttJobPool : &sMqttLinesPool;
+    const int size = pPool->blockSize - sizeof(MQTT_MSG_t);
+    if ((topicSize + totLen + 2) > size)
+    {
+        WARNING("mqtt: %s too big (%u)", topic, totLen);
+        sMqttData.nDrop++;
+        return;
+    }
+    MQTT_MSG_t *pMsg = memPoolAlloc(pPool);
+    if (pMsg == NULL)
+    {
+        sMqttData.nDrop++;
+        return;
+    }
+    pMsg->pPool   = pPool;
+    pMsg->type    = isJob ? MQTT_MSG_JOB : MQTT_MSG_LINES;
+    pMsg->size    = size;
+    pMsg->len     = topicSize;
+    pMsg->payload = topicSize;
+    if (isJob)
+    {
+        memcpy(pMsg->data, jobTopic, topicSize);
+    }
+    sMqttData.pMsgIn = pMsg;
+}
+
+static void sMqttDataCb(void *arg, const uint8_t *data, uint16_t len, uint8_t flags)
+{
+    UNUSED(arg);
+    MQTT_MSG_t *pMsg = sMqttData.pMsgIn;
+    if (pMsg == NULL)
+    {
+        return;
+    }
+    // (always fits, see sMqttPublishCb())
+    memcpy(&pMsg->data[pMsg->len], data, len);
+    pMsg->len += len;
+
+    if ((flags & MQTT_DATA_FLAG_LAST) != 0)
+    {
+        if (pMsg->type == MQTT_MSG_LINES)
+        {
+            pMsg->data[pMsg->len++] = '\n';
+        }
+        pMsg->data[pMsg->len] = '\0';
+        sMqttData.pMsgIn = NULL;
+        if (xQueueSend(sMqttQueue, &pMsg, 0) != pdTRUE)
+        {
+            memPoolFree(pMsg->pPool, pMsg);
+            sMqttData.nDrop++;
+        }
+    }
+}
+
+static void sMqttSubCb(void *arg, err_t err)
+{
+    UNUSED(arg);
+    if (err != ERR_OK)
+    {
+        sMqttData.nSubFail++;
+    }
+}
+
+
+/* ***** wifi task ****************************************************************************** */
+
+static void sMqttFlushQueue(void)
+{
+    MQTT_MSG_t *pMsg;
+    while (xQueueReceive(sMqttQueue, &pMsg, 0) == pdTRUE)
+    {
+        if (pMsg != NULL)
+        {
+            memPoolFree(pMsg->pPool, pMsg);
+        }
+    }
+}
+
+static bool sMqttSubscribe(const char *topic)
+{
+    err_t err = ERR_OK;
+    for (int retry = 0; retry < MQTT_SUB_RETRIES; retry++)
+    {
+        LOCK_TCPIP_CORE();
+        err = mqtt_subscribe(sMqttData.client, topic, 0, sMqttSubCb, NULL);
+        UNLOCK_TCPIP_CORE();
+        // too many requests in flight --> wait for the acks
+        if (err != ERR_MEM)
+        {
+            break;
+        }
+        osSleep(50);
+    }
+    if (err != ERR_OK)
+    {
+        ERROR("mqtt: subscribe %s fail: %s", topic, lwipErrStr(err));
+        sMqttData.nSubFail++;
+        return false;
+    }
+    DEBUG("mqtt: subscribe %s", topic);
+    sMqttData.nSubs++;
+    return true;
+}
+
+// subscribe to the topics of the jobs on our channels that we haven't subscribed to yet (we don't
+// unsubscribe from the others, that happens when we reconnect)
+static void sMqttSubscribeJobs(void)
+{
+    for (int ix = 0; ix < JENKINS_MAX_CH; ix++)
+    {
+        JENKINS_INFO_t info;
+        char topic[MQTT_TOPIC_MAX];
+        if (!jenkinsGetInfo(ix, &info) || !info.active || !sMqttJobTopic(&info, topic, sizeof(topic), true))
+        {
+            continue;
+        }
+        const uint32_t hash = sMqttTopicHash(topic);
+        bool subscribed = false;
+        for (int subIx = 0; !subscribed && (subIx < sMqttData.nSubHashes); subIx++)
+        {
+            subscribed = sMqttData.subHashes[subIx] == hash;
+        }
+        if (!subscribed && (sMqttData.nSubHashes < NUMOF(sMqttData.subHashes)) && sMqttSubscribe(topic))
+        {
+            sMqttData.subHashes[sMqttData.nSubHashes++] = hash;
+        }
+    }
+}
+
+// "<state> <result> <ts>" for "<server>/<job>"
+static void sMqttHandleJob(MQTT_MSG_t *pMsg)
+{
+    const char *jobTopic = pMsg->data;
+    char *pState = &pMsg->data[pMsg->payload];
+    char *pResult = strchr(pState, ' ');
+    char *pTs = pResult != NULL ? strchr(&pResult[1], ' ') : NULL;
+    if (pTs == NULL)
+    {
+        WARNING("mqtt: %s: %s ???", jobTopic, pState);
+        return;
+    }
+    *pResult++ = '\0';
+    *pTs++ = '\0';
+    const JENKINS_STATE_t  state  = jenkinsStrToState(pState);
+    const JENKINS_RESULT_t result = jenkinsStrToResult(pResult);
+    const int32_t          ts     = atoi(pTs);
+
+    // the same job may be on more than one channel
+    for (int ix = 0; ix < JENKINS_MAX_CH; ix++)
+    {
+        JENKINS_INFO_t info;
+        char topic[MQTT_TOPIC_MAX];
+        if ( jenkinsGetInfo(ix, &info) && info.active && sMqttJobTopic(&info, topic, sizeof(topic), false) &&
+             (strcmp(topic, jobTopic) == 0) )
+        {
+            DEBUG("mqtt: #%02d %s %s %s", ix, jobTopic, pState, pResult);
+            jenkinsSetState(ix, state, result, ts);
+        }
+    }
+}
+
+bool mqttConnect(void)
+{
+    if (!sMqttData.haveUrl)
+    {
+        if (!sMqttParseUrl())
+        {
+            ERROR("mqtt: fishy broker url!");
+            return false;
+        }
+        DEBUG("mqtt: host=%s port=%u user=%s prefix=%s", sMqttData.host, sMqttData.port,
+            sMqttData.user != NULL ? sMqttData.user : "", sMqttData.prefix);
+        sMqttData.haveUrl = true;
+    }
+
+    ip_addr_t ip;
+    const err_t errDns = netconn_gethostbyname(sMqttData.host, &ip);
+    if (errDns != ERR_OK)
+    {
+        ERROR("mqtt: lookup %s fail: %s", sMqttData.host, lwipErrStr(errDns));
+        return false;
+    }
+
+    const uint32_t t0 = osTime();
+    backendConnect();
+    sMqttFlushQueue();
+    xSemaphoreTake(sMqttData.connSem, 0);
+    sMqttData.nSubHashes = 0;
+    sMqttData.svConnected = false;
+    sMqttData.svConnStatus = MQTT_CONNECT_DISCONNECTED;
+
+    const struct mqtt_connect_client_info_t ci =
+    {
+        .client_id   = getSystemId(),
+        .client_user = sMqttData.user,
+        .client_pass = sMqttData.pass,
+        .keep_alive  = MQTT_KEEPALIVE,
+    };
+    LOCK_TCPIP_CORE();
+    const err_t errConn = mqtt_client_connect(sMqttData.client, &ip, sMqttData.port, sMqttConnCb, NULL, &ci);
+    // (after connecting, which resets the client)
+    mqtt_set_inpub_callback(sMqttData.client, sMqttPublishCb, sMqttDataCb, NULL);
+    UNLOCK_TCPIP_CORE();
+    if (errConn != ERR_OK)
+    {
+        ERROR("mqtt: connect %s:%u fail: %s", sMqttData.host, sMqttData.port, lwipErrStr(errConn));
+        return false;
+    }
+    if ( (xSemaphoreTake(sMqttData.connSem, MS2TICKS(MQTT_CONNECT_TIMEOUT)) != pdTRUE) || !sMqttData.svConnected )
+    {
+        ERROR("mqtt: connect %s:%u fail: %d", sMqttData.host, sMqttData.port, sMqttData.svConnStatus);
+        mqttDisconnect();
+        return false;
+    }
+    sMqttData.nConnect++;
+
+    // the retained messages on these come right away, and then the job topics (see mqttHandle())
+    char topic[MQTT_TOPIC_MAX];
+    snprintf(topic, sizeof(topic), "%s/heartbeat", sMqttData.prefix);
+    bool okay = sMqttSubscribe(topic);
+    snprintf(topic, sizeof(topic), "%s/client/%s", sMqttData.prefix, getSystemId());
+    okay = okay && sMqttSubscribe(topic);
+    snprintf(topic, sizeof(topic), "%s/client/%s/command", sMqttData.prefix, getSystemId());
+    okay = okay && sMqttSubscribe(topic);
+    if (!okay)
+    {
+        mqttDisconnect();
+        return false;
+    }
+
+    // the broker connection is our "hello" (see backendIsConnected())
+    char hello[] = "hello mqtt\n";
+    backendHandle(hello, sizeof(hello) - 1);
+
+    PRINT("mqtt: connected %s:%u after %ums", sMqttData.host, sMqttData.port, osTime() - t0);
+    return true;
+}
+
+bool mqttIsConnected(void)
+{
+    return sMqttData.svConnected;
+}
+
+BACKEND_STATUS_t mqttHandle(const int32_t timeout)
+{
+    MQTT_MSG_t *pMsg = NULL;
+    if ( (xQueueReceive(sMqttQueue, &pMsg, MS2TICKS(timeout > 0 ? timeout : 1)) != pdTRUE) || (pMsg == NULL) )
+    {
+        return BACKEND_STATUS_OKAY;
+    }
+
+    BACKEND_STATUS_t status = BACKEND_STATUS_OKAY;
+    sMqttData.nMsgs++;
+    switch (pMsg->type)
+    {
+        case MQTT_MSG_LINES:
+            sMqttData.nLines++;
+            status = backendHandle(pMsg->data, pMsg->len);
+            // the status may have changed our jobs
+            sMqttSubscribeJobs();
+            break;
+        case MQTT_MSG_JOB:
+            sMqttData.nJobs++;
+            sMqttHandleJob(pMsg);
+            break;
+    }
+    memPoolFree(pMsg->pPool, pMsg);
+    return status;
+}
+
+void mqttDisconnect(void)
+{
+    DEBUG("mqtt: disconnect");
+    LOCK_TCPIP_CORE();
+    mqtt_disconnect(sMqttData.client);
+    if (sMqttData.pMsgIn != NULL)
+    {
+        memPoolFree(sMqttData.pMsgIn->pPool, sMqttData.pMsgIn);
+        sMqttData.pMsgIn = NULL;
+    }
+    UNLOCK_TCPIP_CORE();
+    sMqttData.svConnected = false;
+    sMqttFlushQueue();
+}
+
+void mqttMonStatus(void)
+{
+    DEBUG("mon: mqtt: broker=%s:%u connected=%s connects=%u msgs=%u lines=%u jobs=%u drop=%u subs=%u/%u (%u fail)",
+        sMqttData.host != NULL ? sMqttData.host : "?", sMqttData.port, sMqttData.svConnected ? "yes" : "no",
+        sMqttData.nConnect, sMqttData.nMsgs, sMqttData.nLines, sMqttData.nJobs, sMqttData.nDrop,
+        sMqttData.nSubHashes, sMqttData.nSubs, sMqttData.nSubFail);
+}
+
+void mqttInit(void)
+{
+    DEBUG("mqtt: init");
+    memset(&sMqttData, 0, sizeof(sMqttData));
+
+    static StaticSemaphore_t sSem;
+    sMqttData.connSem = xSemaphoreCreateBinaryStatic(&sSem);
+
+    // all job topics at once after connecting, and the heartbeat and client topics
+    static StaticQueue_t sQueue;
+    static uint8_t sQueueBuf[(JENKINS_MAX_CH + 4) * sizeof(MQTT_MSG_t *)];
+    sMqttQueue = xQueueCreateStatic(NUMOF(sQueueBuf) / sizeof(MQTT_MSG_t *), sizeof(MQTT_MSG_t *), sQueueBuf, &sQueue);
+
+    sMqttData.client = mqtt_client_new();
+    if (sMqttData.client == NULL)
+    {
+        ERROR("mqtt: mqtt_client_new() fail");
+    }
+}
+
+/* ********************************************************************************************** */
+
+#else // (FF_MQTT > 0)
+
+void mqttInit(void)
+{
+}
+
+void mqttMonStatus(void)
+{
+}
+
+#endif // (FF_MQTT > 0)
+
+//@}
+// eof
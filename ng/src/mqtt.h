@@ -0,0 +1,80 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: MQTT transport (see \ref FF_MQTT)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \defgroup FF_MQTT MQTT
+    \ingroup FF
+
+    With "make ... MQTT=1" (which defines FF_MQTT) and a "MQTTURL" in the CFGFILE
+    ("mqtt://[<user>:<pass>@]<host>[:<port>]/<prefix>") the wifi task gets the status from an MQTT
+    broker (using lwIP's MQTT client) instead of the backend's realtime stream. The backend
+    (tools/tschenggins-status.pl) publishes to the broker whenever something changes, and the
+    broker does the fan-out to all the Lämpli:
+
+    - <prefix>/heartbeat: "heartbeat <ts> 0" (retained, the time of the last change)
+    - <prefix>/client/<id>: "config <ts> {...}" and "status <ts> [...]" lines (retained)
+    - <prefix>/client/<id>/command: "command <ts> <command>" (not retained)
+    - <prefix>/job/<server>/<job>: "<state> <result> <ts>" (retained)
+
+    The lines (for the first three) are the same as in the realtime stream and they go to
+    backendHandle(). For each job on our channels (from the status) we subscribe to the job topic.
+    All with QoS 0, the retained messages give us the current state right after connecting. The
+    broker connection is our "hello", and lwIP's MQTT keep-alive replaces the backend heartbeat.
+
+    The messages are received in the tcpip thread (lwIP's callbacks) into blocks from fixed-size
+    pools (see mem.h) and are handed over to the wifi task by a queue.
+
+    The firmware update still comes from the backend (HTTP, the "update" command), but the
+    telemetry (see monGetTelemetry()) isn't reported.
+
+    @{
+*/
+#ifndef __MQTT_H__
+#define __MQTT_H__
+
+#include "stdinc.h"
+
+#include "backend.h"
+#include "jenkins.h"
+
+//! keep-alive interval [s]
+#define MQTT_KEEPALIVE        30
+
+//! maximum size of a message with lines (topic, config and status) [bytes]
+#define MQTT_LINES_MAX        ( (JENKINS_MAX_CH * 128) + 512 )
+
+//! maximum size of a job topic (without the prefix) and state message [bytes]
+#define MQTT_JOB_MAX          ( JENKINS_SERVER_LEN + JENKINS_JOBNAME_LEN + 48 )
+
+//! initialise
+void mqttInit(void);
+
+//! connect to the broker (in the wifi task, instead of the backend connection)
+/*!
+    \returns true if connected (and subscribed to the client and heartbeat topics), false otherwise
+*/
+bool mqttConnect(void);
+
+//! check if we're (still) connected to the broker
+bool mqttIsConnected(void);
+
+//! wait for and handle messages from the broker
+/*!
+    \param[in] timeout  maximum time to wait for a message [ms]
+
+    \returns #BACKEND_STATUS_OKAY if all is good (also on timeout), see backendHandle() for the rest
+*/
+BACKEND_STATUS_t mqttHandle(const int32_t timeout);
+
+//! disconnect from the broker
+void mqttDisconnect(void);
+
+//! print MQTT monitor string
+void mqttMonStatus(void);
+
+#endif // __MQTT_H__
+//@}
+// eof
@@ -0,0 +1,403 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: over-the-air firmware updates (see \ref FF_OTA)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \addtogroup FF_OTA
+
+    @{
+*/
+
+#include "stdinc.h"
+
+#include <espressif/spi_flash.h>
+#include <rboot-api.h>
+#include <bearssl.h>
+
+#include "stuff.h"
+#include "debug.h"
+#include "flash.h"
+#include "ota.h"
+#include "cfg_gen.h"
+
+// flash page size (the data is collected and written in pages)
+#define OTA_PAGE_SIZE 256
+
+// maximum size of the (ASN.1/DER) ECDSA P-256 signature
+#define OTA_SIG_MAX 72
+
+// the key to check the image signature with
+#if defined(FF_CFG_OTAKEY)
+#  define HAVE_OTAKEY 1
+#else
+#  define HAVE_OTAKEY 0
+#endif
+
+typedef struct OTA_STATE_s
+{
+    // pending request
+    bool     pending;
+    char     image[OTA_IMAGE_MAX + 1];
+    uint32_t size;
+    uint8_t  sha256[32];
+    uint8_t  sig[OTA_SIG_MAX];
+    int      sigLen;
+
+    // update in progress
+    bool     active;
+    uint8_t  slot;      // target ROM slot
+    uint32_t addr;      // flash address of the slot
+    uint32_t maxSize;   // size of the slot
+    uint32_t offs;      // bytes received
+    uint32_t written;   // bytes written to the flash
+    uint32_t t0;
+    br_sha256_context sha;
+
+    // statistics
+    uint32_t nUpdates;
+    uint32_t nFails;
+    uint32_t nErases;
+    uint32_t lastDuration;
+    const char *lastError;
+} OTA_STATE_t;
+
+static OTA_STATE_t sOta;
+
+// public key (uncompressed P-256 point, 0x04 x y) from FF_CFG_OTAKEY (see otaInit())
+static uint8_t sOtaKey[65];
+static bool    sOtaHaveKey;
+
+// page buffer (the flash functions want aligned buffers)
+static uint32_t sOtaPage[OTA_PAGE_SIZE / sizeof(uint32_t)];
+static int sOtaPageLen;
+
+static int sOtaHexVal(const char c)
+{
+    if ( (c >= '0') && (c <= '9') ) { return c - '0'; }
+    if ( (c >= 'a') && (c <= 'f') ) { return c - 'a' + 10; }
+    if ( (c >= 'A') && (c <= 'F') ) { return c - 'A' + 10; }
+    return -1;
+}
+
+// parse hex digits (optionally separated by colons) into bytes, returns number of bytes or -1 on error
+static int sOtaHexToBin(const char *str, uint8_t *buf, const int size)
+{
+    int nDigits = 0;
+    for (int ix = 0; str[ix] != '\0'; ix++)
+    {
+        const char c = str[ix];
+        if (c == ':')
+        {
+            continue;
+        }
+        const int val = sOtaHexVal(c);
+        if ( (val < 0) || (nDigits >= (2 * size)) )
+        {
+            return -1;
+        }
+        buf[nDigits / 2] = (buf[nDigits / 2] << 4) | val;
+        nDigits++;
+    }
+    return (nDigits % 2) == 0 ? (nDigits / 2) : -1;
+}
+
+// find the slot we're not running from, and its size (up to the next slot or our sectors, see flash.c)
+static bool sOtaFindSlot(uint8_t *pSlot, uint32_t *pAddr, uint32_t *pSize)
+{
+    const rboot_config conf = rboot_get_config();
+    if (conf.count < 2)
+    {
+        sOta.lastError = "no slot";
+        return false;
+    }
+    const uint8_t slot = (conf.current_rom + 1) % conf.count;
+    const uint32_t addr = conf.roms[slot];
+    uint32_t end = flashReservedAddr();
+    for (int ix = 0; ix < conf.count; ix++)
+    {
+        if ( (conf.roms[ix] > addr) && (conf.roms[ix] < end) )
+        {
+            end = conf.roms[ix];
+        }
+    }
+    if ( (addr % SPI_FLASH_SEC_SIZE) != 0 )
+    {
+        sOta.lastError = "slot address";
+        return false;
+    }
+    *pSlot = slot;
+    *pAddr = addr;
+    *pSize = end > addr ? end - addr : 0;
+    return true;
+}
+
+// write the page buffer (padded to a multiple of 4 bytes), erase sectors as we get to them
+static bool sOtaFlushPage(void)
+{
+    if (sOtaPageLen <= 0)
+    {
+        return true;
+    }
+    const uint32_t addr = sOta.addr + sOta.written;
+    if ( (addr % SPI_FLASH_SEC_SIZE) == 0 )
+    {
+        if (sdk_spi_flash_erase_sector(addr / SPI_FLASH_SEC_SIZE) != SPI_FLASH_RESULT_OK)
+        {
+            ERROR("ota: erase 0x%06x failed", addr);
+            sOta.lastError = "erase";
+            return false;
+        }
+        sOta.nErases++;
+    }
+    const int size = (sOtaPageLen + 3) & ~3;
+    memset((uint8_t *)sOtaPage + sOtaPageLen, 0xff, size - sOtaPageLen);
+    if (sdk_spi_flash_write(addr, sOtaPage, size) != SPI_FLASH_RESULT_OK)
+    {
+        ERROR("ota: write 0x%06x failed", addr);
+        sOta.lastError = "write";
+        return false;
+    }
+    sOta.written += sOtaPageLen;
+    sOtaPageLen = 0;
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool otaRequest(const char *image, const int imageLen, const uint32_t size, const char *sha256, const char *sig)
+{
+    if (!sOtaHaveKey)
+    {
+        WARNING("ota: no key, no updates");
+        return false;
+    }
+    if ( (imageLen < 1) || (imageLen > OTA_IMAGE_MAX) || (size == 0) || (strlen(sha256) != (2 * sizeof(sOta.sha256))) )
+    {
+        WARNING("ota: illegal request");
+        return false;
+    }
+    for (int ix = 0; ix < imageLen; ix++)
+    {
+        // the name goes into the query
+        const char c = image[ix];
+        if ( !( ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) ||
+                (c == '-') || (c == '_') || (c == '.') ) )
+        {
+            WARNING("ota: illegal image name");
+            return false;
+        }
+    }
+    uint8_t hash[sizeof(sOta.sha256)];
+    for (int ix = 0; ix < (int)sizeof(hash); ix++)
+    {
+        const int hi = sOtaHexVal(sha256[2 * ix]);
+        const int lo = sOtaHexVal(sha256[(2 * ix) + 1]);
+        if ( (hi < 0) || (lo < 0) )
+        {
+            WARNING("ota: illegal hash");
+            return false;
+        }
+        hash[ix] = (hi << 4) | lo;
+    }
+    uint8_t sigBin[sizeof(sOta.sig)];
+    const int sigLen = sOtaHexToBin(sig, sigBin, sizeof(sigBin));
+    if (sigLen < 8)
+    {
+        WARNING("ota: illegal signature");
+        return false;
+    }
+    if (sOta.active)
+    {
+        return false;
+    }
+
+    memcpy(sOta.image, image, imageLen);
+    sOta.image[imageLen] = '\0';
+    sOta.size = size;
+    memcpy(sOta.sha256, hash, sizeof(sOta.sha256));
+    memcpy(sOta.sig, sigBin, sigLen);
+    sOta.sigLen = sigLen;
+    sOta.pending = true;
+    PRINT("ota: request %s (%u bytes)", sOta.image, sOta.size);
+    return true;
+}
+
+const char *otaPending(void)
+{
+    return sOta.pending ? sOta.image : NULL;
+}
+
+bool otaBegin(void)
+{
+    if (!sOta.pending)
+    {
+        return false;
+    }
+    sOta.pending = false;
+
+    if (!sOtaFindSlot(&sOta.slot, &sOta.addr, &sOta.maxSize))
+    {
+        ERROR("ota: no ROM slot to update (%s)", sOta.lastError);
+        sOta.nFails++;
+        return false;
+    }
+    if (sOta.size > sOta.maxSize)
+    {
+        ERROR("ota: image too large (%u > %u)", sOta.size, sOta.maxSize);
+        sOta.lastError = "size";
+        sOta.nFails++;
+        return false;
+    }
+
+    PRINT("ota: updating slot %u (0x%06x, %u/%u bytes)", sOta.slot, sOta.addr, sOta.size, sOta.maxSize);
+    sOta.offs = 0;
+    sOta.written = 0;
+    sOtaPageLen = 0;
+    br_sha256_init(&sOta.sha);
+    sOta.t0 = osTime();
+    sOta.active = true;
+    return true;
+}
+
+bool otaWrite(const void *data, const int len)
+{
+    if (!sOta.active)
+    {
+        return false;
+    }
+    if ((sOta.offs + len) > sOta.size)
+    {
+        ERROR("ota: too much data");
+        sOta.lastError = "size";
+        return false;
+    }
+    br_sha256_update(&sOta.sha, data, len);
+    sOta.offs += len;
+
+    const uint8_t *pkData = (const uint8_t *)data;
+    int remaining = len;
+    while (remaining > 0)
+    {
+        const int chunk = MIN(remaining, OTA_PAGE_SIZE - sOtaPageLen);
+        memcpy((uint8_t *)sOtaPage + sOtaPageLen, pkData, chunk);
+        sOtaPageLen += chunk;
+        pkData += chunk;
+        remaining -= chunk;
+        if ( (sOtaPageLen == OTA_PAGE_SIZE) && !sOtaFlushPage() )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool otaEnd(const bool okay)
+{
+    if (!sOta.active)
+    {
+        return false;
+    }
+    sOta.active = false;
+    sOta.lastDuration = osTime() - sOta.t0;
+
+    bool res = okay && sOtaFlushPage();
+    if (res && (sOta.offs != sOta.size))
+    {
+        ERROR("ota: incomplete image (%u/%u)", sOta.offs, sOta.size);
+        sOta.lastError = "incomplete";
+        res = false;
+    }
+    if (res)
+    {
+        uint8_t hash[sizeof(sOta.sha256)];
+        br_sha256_out(&sOta.sha, hash);
+        if (memcmp(hash, sOta.sha256, sizeof(hash)) != 0)
+        {
+            ERROR("ota: hash mismatch");
+            sOta.lastError = "hash";
+            res = false;
+        }
+        // the hash only guards against transfer errors, the signature proves where the image is from
+        else
+        {
+            const br_ec_public_key key =
+            {
+                .curve = BR_EC_secp256r1, .q = sOtaKey, .qlen = sizeof(sOtaKey)
+            };
+            if (br_ecdsa_i15_vrfy_asn1(&br_ec_p256_m15, hash, sizeof(hash), &key, sOta.sig, sOta.sigLen) != 1)
+            {
+                ERROR("ota: bad signature");
+                sOta.lastError = "signature";
+                res = false;
+            }
+        }
+    }
+    if (res)
+    {
+        uint32_t imageLen = 0;
+        const char *errMsg = NULL;
+        if (!rboot_verify_image(sOta.addr, &imageLen, &errMsg))
+        {
+            ERROR("ota: bad image (%s)", errMsg != NULL ? errMsg : "?");
+            sOta.lastError = "image";
+            res = false;
+        }
+    }
+    if (res && !rboot_set_current_rom(sOta.slot))
+    {
+        ERROR("ota: boot config update failed");
+        sOta.lastError = "boot config";
+        res = false;
+    }
+
+    if (res)
+    {
+        PRINT("ota: slot %u updated after %ums, booting it next", sOta.slot, sOta.lastDuration);
+        sOta.lastError = NULL;
+        sOta.nUpdates++;
+    }
+    else
+    {
+        if (sOta.lastError == NULL)
+        {
+            sOta.lastError = "transfer";
+        }
+        ERROR("ota: update failed (%s, %u/%u bytes)", sOta.lastError, sOta.offs, sOta.size);
+        sOta.nFails++;
+    }
+    return res;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void otaInit(void)
+{
+    const rboot_config conf = rboot_get_config();
+    DEBUG("ota: init (slot %u of %u, 0x%06x)", conf.current_rom, conf.count, conf.roms[conf.current_rom]);
+
+#if (HAVE_OTAKEY > 0)
+    // FF_CFG_OTAKEY: 130 hex digits, optionally separated by colons (as "make ota-pubkey" prints it)
+    static const char skKeyStr[] = FF_CFG_OTAKEY;
+    sOtaHaveKey = (sOtaHexToBin(skKeyStr, sOtaKey, sizeof(sOtaKey)) == (int)sizeof(sOtaKey)) && (sOtaKey[0] == 0x04);
+    if (!sOtaHaveKey)
+    {
+        ERROR("ota: illegal key");
+    }
+#else
+    WARNING("ota: no OTAKEY in the config, updates disabled");
+#endif
+}
+
+void otaMonStatus(void)
+{
+    DEBUG("mon: ota: key=%s slot=%u pending=%s active=%s offs=%u/%u updates=%u fails=%u erases=%u last=%ums (%s)",
+        sOtaHaveKey ? "yes" : "no", rboot_get_current_rom(), sOta.pending ? sOta.image : "-",
+        sOta.active ? "yes" : "no",
+        sOta.offs, sOta.size, sOta.nUpdates, sOta.nFails, sOta.nErases, sOta.lastDuration,
+        sOta.lastError != NULL ? sOta.lastError : "ok");
+}
+
+//@}
+// eof
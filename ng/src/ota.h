@@ -0,0 +1,87 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: over-the-air firmware updates (see \ref FF_OTA)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \defgroup FF_OTA OTA
+    \ingroup FF
+
+    The backend triggers an update with the command "update <image> <size> <sha256> <signature>"
+    (see backendHandle()). The wifi task then drops the realtime connection and fetches the image
+    ("cmd=firmware;image=<image>", see \ref FF_WIFI) on a new connection to the backend, using the
+    same HTTP client. The body of the response is written straight to the rboot ROM slot that is
+    not running: each sector is erased when the image gets to it, and the data is written in
+    flash pages while the SHA-256 of it is calculated on the way. Only when the size and the hash
+    match, the signature is good, and rboot is happy with the image, the boot config is switched to
+    the new slot (and the system restarted). The old slot stays as it is until the next update, so
+    that a broken image can be replaced by flashing the boot config only.
+
+    Nothing is written before the response header has arrived and the image fits the slot. An
+    interrupted or failed update leaves the running firmware (and the boot config) alone.
+
+    The images are signed (ECDSA P-256 over the SHA-256 of the image) by "make ota-image
+    OTAKEY=<private key file>" and the signature is checked against the public key in the
+    firmware (OTAKEY in the CFGFILE, "make ota-pubkey OTAKEY=<private key file>" prints it). The
+    backend (and the network) are therefore not trusted with the firmware. Without a key, all
+    update requests are refused. The check needs a few kB of stack in the wifi task (see
+    STACK_WIFI_OTA). A new key: "openssl ecparam -name prime256v1 -genkey -noout -out
+    <private key file>".
+
+    @{
+*/
+#ifndef __OTA_H__
+#define __OTA_H__
+
+#include "stdinc.h"
+
+//! maximum length of the image name
+#define OTA_IMAGE_MAX 47
+
+//! initialise (check ROM slots)
+void otaInit(void);
+
+//! request update (called by the backend for the "update" command)
+/*!
+    \param[in] image     image name (not nul-terminated)
+    \param[in] imageLen  length of the image name
+    \param[in] size      size of the image [bytes]
+    \param[in] sha256    SHA-256 of the image (64 hex digits)
+    \param[in] sig       signature of the image (ASN.1/DER ECDSA signature in hex digits)
+    \returns true if the request is okay (and now pending), false otherwise
+*/
+bool otaRequest(const char *image, const int imageLen, const uint32_t size, const char *sha256, const char *sig);
+
+//! check for pending update request
+/*!
+    \returns the name of the image to fetch, or NULL if no update is pending
+*/
+const char *otaPending(void);
+
+//! start writing the pending update to the inactive ROM slot
+/*!
+    \returns true if we're ready for the data (see otaWrite()), false otherwise (the request is dropped)
+*/
+bool otaBegin(void);
+
+//! write next fragment of the image
+/*!
+    \param[in] data  image data
+    \param[in] len   length of the data
+    \returns true if all is good, false if the image is too large or the flash write failed
+*/
+bool otaWrite(const void *data, const int len);
+
+//! finish update
+/*!
+    \param[in] okay  all data has been received successfully
+    \returns true if the image has been verified (size, hash and signature) and the boot config
+             now points to it (and the system should be restarted), false otherwise
+*/
+bool otaEnd(const bool okay);
+
+//! print OTA monitor string
+void otaMonStatus(void);
+
+#endif // __OTA_H__
@@ -0,0 +1,700 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: LAN relay (see \ref FF_RELAY)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \addtogroup FF_RELAY
+
+    @{
+*/
+
+#include "stdinc.h"
+
+#include <lwip/api.h>
+#include <esp/hwrand.h>
+
+#include "stuff.h"
+#include "debug.h"
+#include "backend.h"
+#include "jenkins.h"
+#include "config.h"
+#include "relay.h"
+
+#if (!LWIP_IGMP)
+#  error We need LWIP_IGMP!
+#endif
+
+/* ***** frames ********************************************************************************* */
+
+// all frames: header, then the job records (multi-byte values in network byte order)
+//   0  'T', 'L' (magic)
+//   2  version (RELAY_VERSION)
+//   3  type (RELAY_TYPE_t)
+//   4  relay ID (chip ID)
+//   8  sequence number
+//  12  age [s] (how long the relay has been relaying)
+//  16  timestamp (backend time, see osSetPosixTime())
+//  20  number of records
+//  21  (reserved)
+// the records:
+//   0  job hash (see sRelayJobHash())
+//   4  timestamp (JENKINS_INFO_t.time)
+//   8  state (JENKINS_STATE_t)
+//   9  result (JENKINS_RESULT_t)
+//  10  (reserved)
+#define RELAY_VERSION    1
+#define RELAY_HDR_SIZE  24
+#define RELAY_REC_SIZE  12
+#define RELAY_FRAME_MAX (RELAY_HDR_SIZE + (JENKINS_MAX_CH * RELAY_REC_SIZE))
+
+typedef enum RELAY_TYPE_e
+{
+    RELAY_TYPE_ALL  = 1, // heartbeat, all job states
+    RELAY_TYPE_SOME = 2, // changed job states
+    RELAY_TYPE_BYE  = 3, // relay stops, no records
+} RELAY_TYPE_t;
+
+typedef struct RELAY_FRAME_s
+{
+    RELAY_TYPE_t   type;
+    uint32_t       id;
+    uint32_t       seq;
+    uint32_t       age;
+    uint32_t       ts;
+    int            num;
+    const uint8_t *recs;
+} RELAY_FRAME_t;
+
+static void sRelayPut32(uint8_t *p, const uint32_t val)
+{
+    p[0] = (val >> 24) & 0xff;
+    p[1] = (val >> 16) & 0xff;
+    p[2] = (val >>  8) & 0xff;
+    p[3] =  val        & 0xff;
+}
+
+static uint32_t sRelayGet32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// FNV-1a of "<server>/<job>" (the listeners know their jobs by name, the relay by channel)
+static uint32_t sRelayJobHash(const JENKINS_INFO_t *pkInfo)
+{
+    uint32_t hash = 2166136261;
+    for (const char *pkC = pkInfo->server; *pkC != '\0'; pkC++)
+    {
+        hash = (hash ^ (uint8_t)*pkC) * 16777619;
+    }
+    hash = (hash ^ (uint8_t)'/') * 16777619;
+    for (const char *pkC = pkInfo->job; *pkC != '\0'; pkC++)
+    {
+        hash = (hash ^ (uint8_t)*pkC) * 16777619;
+    }
+    return hash;
+}
+
+
+/* ***** state ********************************************************************************** */
+
+typedef enum RELAY_ROLE_e
+{
+    RELAY_ROLE_NONE,     // not relaying (or not yet), not listening
+    RELAY_ROLE_RELAY,    // relaying the backend connection
+    RELAY_ROLE_LISTENER, // listening to a relay
+} RELAY_ROLE_t;
+
+typedef struct RELAY_JOB_s
+{
+    bool             active;
+    uint32_t         hash;
+    JENKINS_STATE_t  state;
+    JENKINS_RESULT_t result;
+    int32_t          time;
+} RELAY_JOB_t;
+
+typedef struct RELAY_DATA_s
+{
+    struct netconn *conn;
+    ip_addr_t       group;
+    RELAY_ROLE_t    role;
+    uint32_t        id;            // our ID
+    uint32_t        seq;           // relay: sequence number of the last frame sent
+    uint32_t        connStart;     // relay: [ms] start of the backend connection
+    uint32_t        relayStart;    // relay: [ms] when we started relaying
+    uint32_t        lastAll;       // relay: [ms] last heartbeat frame sent
+    RELAY_JOB_t     jobs[JENKINS_MAX_CH]; // relay: last sent job states, listener: our jobs
+    uint32_t        relayId;       // listener: the relay we're listening to
+    uint32_t        relaySeq;      // listener: last sequence number from the relay
+    uint32_t        relayAge;      // listener: the relay's age [s]
+    uint32_t        lastHeard;     // listener: [ms] last frame from the relay
+    uint32_t        listenStart;   // listener: [ms] when we started listening
+    bool            resyncPending; // listener: connect directly next time
+    uint8_t         buf[RELAY_FRAME_MAX]; // frame we're sending or have received
+    // statistics
+    uint32_t        nTx;
+    uint32_t        nRx;
+    uint32_t        nDrop;
+    uint32_t        nFail;
+    uint32_t        nRelay;
+    uint32_t        nYield;
+    uint32_t        nListen;
+    uint32_t        nLost;
+} RELAY_DATA_t;
+
+static RELAY_DATA_t sRelayData;
+
+static const char * const skRelayRoleStrs[] =
+{
+    [RELAY_ROLE_NONE]     = "none",
+    [RELAY_ROLE_RELAY]    = "relay",
+    [RELAY_ROLE_LISTENER] = "listener",
+};
+
+const char *relayRoleStr(void)
+{
+    return configGetRelay() ? skRelayRoleStrs[sRelayData.role] : "off";
+}
+
+void relayInit(void)
+{
+    DEBUG("relay: init");
+    memset(&sRelayData, 0, sizeof(sRelayData));
+    sRelayData.id  = sdk_system_get_chip_id();
+    sRelayData.seq = hwrand(); // (so that the listeners don't take the frames after a restart for duplicates)
+    ipaddr_aton(RELAY_GROUP, &sRelayData.group);
+}
+
+void relayMonStatus(void)
+{
+    const uint32_t now = osTime();
+    DEBUG("mon: relay: role=%s id=%08x relay=%08x age=%u heard=%u tx=%u rx=%u drop=%u fail=%u",
+        relayRoleStr(), sRelayData.id, sRelayData.relayId,
+        sRelayData.role == RELAY_ROLE_RELAY ? (now - sRelayData.relayStart) / 1000 : sRelayData.relayAge,
+        sRelayData.role == RELAY_ROLE_LISTENER ? now - sRelayData.lastHeard : 0,
+        sRelayData.nTx, sRelayData.nRx, sRelayData.nDrop, sRelayData.nFail);
+    DEBUG("mon: relay: relaying=%u yield=%u listen=%u lost=%u",
+        sRelayData.nRelay, sRelayData.nYield, sRelayData.nListen, sRelayData.nLost);
+}
+
+
+/* ***** network ******************************************************************************** */
+
+static bool sRelayOpen(void)
+{
+    if (sRelayData.conn != NULL)
+    {
+        return true;
+    }
+    sRelayData.conn = netconn_new(NETCONN_UDP);
+    if (sRelayData.conn == NULL)
+    {
+        ERROR("relay: netconn_new() fail");
+        return false;
+    }
+    err_t err = netconn_bind(sRelayData.conn, IP_ADDR_ANY, RELAY_PORT);
+    if (err == ERR_OK)
+    {
+        err = netconn_join_leave_group(sRelayData.conn, &sRelayData.group, IP_ADDR_ANY, NETCONN_JOIN);
+    }
+    if (err != ERR_OK)
+    {
+        ERROR("relay: join "RELAY_GROUP":%u fail: %s", RELAY_PORT, lwipErrStr(err));
+        netconn_delete(sRelayData.conn);
+        sRelayData.conn = NULL;
+        return false;
+    }
+    DEBUG("relay: joined "RELAY_GROUP":%u", RELAY_PORT);
+    return true;
+}
+
+static void sRelayClose(void)
+{
+    if (sRelayData.conn != NULL)
+    {
+        netconn_join_leave_group(sRelayData.conn, &sRelayData.group, IP_ADDR_ANY, NETCONN_LEAVE);
+        netconn_delete(sRelayData.conn);
+        sRelayData.conn = NULL;
+        DEBUG("relay: left "RELAY_GROUP":%u", RELAY_PORT);
+    }
+}
+
+// send frame from the buffer
+static void sRelaySend(const RELAY_TYPE_t type, const int num)
+{
+    const uint32_t now = osTime();
+    uint8_t *pHdr = sRelayData.buf;
+    sRelayData.seq++;
+    pHdr[0] = 'T';
+    pHdr[1] = 'L';
+    pHdr[2] = RELAY_VERSION;
+    pHdr[3] = type;
+    sRelayPut32(&pHdr[ 4], sRelayData.id);
+    sRelayPut32(&pHdr[ 8], sRelayData.seq);
+    sRelayPut32(&pHdr[12], (now - sRelayData.relayStart) / 1000);
+    sRelayPut32(&pHdr[16], osGetPosixTime());
+    pHdr[20] = num;
+    pHdr[21] = 0;
+    pHdr[22] = 0;
+    pHdr[23] = 0;
+    const int len = RELAY_HDR_SIZE + (num * RELAY_REC_SIZE);
+
+    // (copy, the frame may still be in some queue when we reuse the buffer)
+    err_t err = ERR_MEM;
+    struct netbuf *pBuf = netbuf_new();
+    void *pData = pBuf != NULL ? netbuf_alloc(pBuf, len) : NULL;
+    if (pData != NULL)
+    {
+        memcpy(pData, sRelayData.buf, len);
+        err = netconn_sendto(sRelayData.conn, pBuf, &sRelayData.group, RELAY_PORT);
+    }
+    if (pBuf != NULL)
+    {
+        netbuf_delete(pBuf);
+    }
+    if (err == ERR_OK)
+    {
+        sRelayData.nTx++;
+    }
+    else
+    {
+        sRelayData.nFail++;
+        WARNING("relay: send fail: %s", lwipErrStr(err));
+    }
+}
+
+// receive a frame into the buffer, returns false on timeout (timeout = 0: don't wait) or error
+static bool sRelayRecv(const int32_t timeout, RELAY_FRAME_t *pFrame)
+{
+    if (timeout > 0)
+    {
+        netconn_set_nonblocking(sRelayData.conn, false);
+        netconn_set_recvtimeout(sRelayData.conn, timeout);
+    }
+    else
+    {
+        netconn_set_nonblocking(sRelayData.conn, true);
+    }
+
+    struct netbuf *pBuf = NULL;
+    const err_t err = netconn_recv(sRelayData.conn, &pBuf);
+    if (err != ERR_OK)
+    {
+        if ( (err != ERR_TIMEOUT) && (err != ERR_WOULDBLOCK) )
+        {
+            WARNING("relay: recv fail: %s", lwipErrStr(err));
+            osSleep(100);
+        }
+        return false;
+    }
+
+    void *pData = NULL;
+    uint16_t len = 0;
+    netbuf_data(pBuf, &pData, &len);
+    const uint8_t *pkHdr = pData;
+    const int num = len >= RELAY_HDR_SIZE ? pkHdr[20] : 0;
+    const bool valid = (len >= RELAY_HDR_SIZE) && (len <= sizeof(sRelayData.buf)) &&
+        (pkHdr[0] == 'T') && (pkHdr[1] == 'L') && (pkHdr[2] == RELAY_VERSION) &&
+        (len == (RELAY_HDR_SIZE + (num * RELAY_REC_SIZE)));
+    if (valid)
+    {
+        memcpy(sRelayData.buf, pData, len);
+    }
+    netbuf_delete(pBuf);
+    if (!valid)
+    {
+        sRelayData.nDrop++;
+        return false;
+    }
+
+    pFrame->type = sRelayData.buf[3];
+    pFrame->id   = sRelayGet32(&sRelayData.buf[ 4]);
+    pFrame->seq  = sRelayGet32(&sRelayData.buf[ 8]);
+    pFrame->age  = sRelayGet32(&sRelayData.buf[12]);
+    pFrame->ts   = sRelayGet32(&sRelayData.buf[16]);
+    pFrame->num  = num;
+    pFrame->recs = &sRelayData.buf[RELAY_HDR_SIZE];
+
+    // (we may hear our own frames)
+    if (pFrame->id == sRelayData.id)
+    {
+        return false;
+    }
+    sRelayData.nRx++;
+    return true;
+}
+
+// check if all of our jobs are in the frame
+static bool sRelayFrameHasAllOurs(const RELAY_FRAME_t *pkFrame)
+{
+    for (int ix = 0; ix < NUMOF(sRelayData.jobs); ix++)
+    {
+        if (!sRelayData.jobs[ix].active)
+        {
+            continue;
+        }
+        bool found = false;
+        for (int recIx = 0; !found && (recIx < pkFrame->num); recIx++)
+        {
+            found = sRelayGet32(&pkFrame->recs[recIx * RELAY_REC_SIZE]) == sRelayData.jobs[ix].hash;
+        }
+        if (!found)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// check if we have all the jobs in the frame
+static bool sRelayWeHaveAllTheirs(const RELAY_FRAME_t *pkFrame)
+{
+    for (int recIx = 0; recIx < pkFrame->num; recIx++)
+    {
+        const uint32_t hash = sRelayGet32(&pkFrame->recs[recIx * RELAY_REC_SIZE]);
+        bool found = false;
+        for (int ix = 0; !found && (ix < NUMOF(sRelayData.jobs)); ix++)
+        {
+            found = sRelayData.jobs[ix].active && (sRelayData.jobs[ix].hash == hash);
+        }
+        if (!found)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/* ***** listener ******************************************************************************* */
+
+// our jobs (the channel mapping from the last backend connection, or from flash), returns the number of jobs
+static int sRelayLoadJobs(void)
+{
+    int nJobs = 0;
+    for (int ix = 0; ix < NUMOF(sRelayData.jobs); ix++)
+    {
+        JENKINS_INFO_t info;
+        RELAY_JOB_t *pJob = &sRelayData.jobs[ix];
+        memset(pJob, 0, sizeof(*pJob));
+        if (jenkinsGetInfo(ix, &info) && info.active)
+        {
+            pJob->active = true;
+            pJob->hash   = sRelayJobHash(&info);
+            nJobs++;
+        }
+    }
+    return nJobs;
+}
+
+// update our channels from the records in the frame
+static void sRelayApply(const RELAY_FRAME_t *pkFrame)
+{
+    for (int recIx = 0; recIx < pkFrame->num; recIx++)
+    {
+        const uint8_t *pkRec = &pkFrame->recs[recIx * RELAY_REC_SIZE];
+        const uint32_t hash = sRelayGet32(&pkRec[0]);
+        const int32_t  time = (int32_t)sRelayGet32(&pkRec[4]);
+        const JENKINS_STATE_t  state  = pkRec[8] <= JENKINS_STATE_IDLE     ? (JENKINS_STATE_t)pkRec[8]  : JENKINS_STATE_UNKNOWN;
+        const JENKINS_RESULT_t result = pkRec[9] <= JENKINS_RESULT_FAILURE ? (JENKINS_RESULT_t)pkRec[9] : JENKINS_RESULT_UNKNOWN;
+
+        // the same job may be on more than one channel
+        for (int ix = 0; ix < NUMOF(sRelayData.jobs); ix++)
+        {
+            JENKINS_INFO_t info;
+            if ( !sRelayData.jobs[ix].active || (sRelayData.jobs[ix].hash != hash) || !jenkinsGetInfo(ix, &info) )
+            {
+                continue;
+            }
+            if ( info.active && ((info.state != state) || (info.result != result) || (info.time != time)) )
+            {
+                DEBUG("relay: #%02d %s %s %s", ix, info.job, jenkinsStateToStr(state), jenkinsResultToStr(result));
+                jenkinsSetState(ix, state, result, time);
+            }
+        }
+    }
+}
+
+bool relayWait(void)
+{
+    if (!configGetRelay())
+    {
+        return false;
+    }
+    if (sRelayData.resyncPending)
+    {
+        PRINT("relay: resync");
+        sRelayData.resyncPending = false;
+        return false;
+    }
+    const int nJobs = sRelayLoadJobs();
+    if (nJobs == 0)
+    {
+        DEBUG("relay: no jobs");
+        return false;
+    }
+    if (!sRelayOpen())
+    {
+        return false;
+    }
+
+    // random wait, so that only one of many waiting Lämpli connects directly (and then relays to the others)
+    const uint32_t waitTime = RELAY_WAIT + (hwrand() % RELAY_WAIT);
+    PRINT("relay: waiting %u.%us for a relay with our %d jobs", waitTime / 1000, (waitTime % 1000) / 100, nJobs);
+    const uint32_t t0 = osTime();
+    bool found = false;
+    while (!found)
+    {
+        const int32_t remaining = (int32_t)waitTime - (int32_t)(osTime() - t0);
+        if (remaining <= 0)
+        {
+            break;
+        }
+        RELAY_FRAME_t frame;
+        if ( sRelayRecv(remaining, &frame) && (frame.type == RELAY_TYPE_ALL) && sRelayFrameHasAllOurs(&frame) )
+        {
+            found = true;
+            sRelayData.relayId  = frame.id;
+            sRelayData.relaySeq = frame.seq;
+            sRelayData.relayAge = frame.age;
+            sRelayData.lastHeard = osTime();
+            if (frame.ts != 0)
+            {
+                osSetPosixTime(frame.ts);
+            }
+            sRelayApply(&frame);
+        }
+    }
+
+    if (!found)
+    {
+        DEBUG("relay: no relay");
+        sRelayClose();
+    }
+    return found;
+}
+
+static volatile bool svRelayStopListening;
+
+void relayStopListening(void)
+{
+    svRelayStopListening = true;
+}
+
+void relayListen(void)
+{
+    PRINT("relay: listening to %08x (age %us)", sRelayData.relayId, sRelayData.relayAge);
+    sRelayData.role = RELAY_ROLE_LISTENER;
+    sRelayData.listenStart = osTime();
+    sRelayData.nListen++;
+
+    // the channels are ours now, not the backend's
+    backendRelayed();
+
+    while (true)
+    {
+        const uint32_t now = osTime();
+        const int32_t remaining = RELAY_TIMEOUT - (int32_t)(now - sRelayData.lastHeard);
+        if (remaining <= 0)
+        {
+            WARNING("relay: lost %08x", sRelayData.relayId);
+            sRelayData.nLost++;
+            break;
+        }
+        if ( (now - sRelayData.listenStart) > (1000 * RELAY_RESYNC_INTERVAL) )
+        {
+            sRelayData.resyncPending = true;
+            break;
+        }
+        if (svRelayStopListening)
+        {
+            svRelayStopListening = false;
+            break;
+        }
+
+        RELAY_FRAME_t frame;
+        if ( !sRelayRecv(remaining, &frame) || (frame.id != sRelayData.relayId) )
+        {
+            continue;
+        }
+        if ((int32_t)(frame.seq - sRelayData.relaySeq) <= 0)
+        {
+            sRelayData.nDrop++;
+            continue;
+        }
+        sRelayData.relaySeq  = frame.seq;
+        sRelayData.relayAge  = frame.age;
+        sRelayData.lastHeard = osTime();
+        if (frame.type == RELAY_TYPE_BYE)
+        {
+            PRINT("relay: %08x stopped", sRelayData.relayId);
+            break;
+        }
+        if ( (frame.type == RELAY_TYPE_ALL) && !sRelayFrameHasAllOurs(&frame) )
+        {
+            WARNING("relay: %08x lacks our jobs", sRelayData.relayId);
+            break;
+        }
+        if (frame.ts != 0)
+        {
+            osSetPosixTime(frame.ts);
+        }
+        sRelayApply(&frame);
+    }
+
+    sRelayClose();
+    sRelayData.role = RELAY_ROLE_NONE;
+}
+
+
+/* ***** relay ********************************************************************************** */
+
+void relayStart(void)
+{
+    svRelayStopListening = false;
+    sRelayData.connStart = osTime();
+    sRelayData.role = RELAY_ROLE_NONE;
+}
+
+// send the changed job states (all = false) or all of them (all = true)
+static void sRelaySendJobs(const bool all)
+{
+    int num = 0;
+    for (int ix = 0; ix < NUMOF(sRelayData.jobs); ix++)
+    {
+        JENKINS_INFO_t info;
+        RELAY_JOB_t *pJob = &sRelayData.jobs[ix];
+        if (!jenkinsGetInfo(ix, &info) || !info.active)
+        {
+            pJob->active = false;
+            continue;
+        }
+        const uint32_t hash = sRelayJobHash(&info);
+        const bool changed = !pJob->active || (pJob->hash != hash) || (pJob->state != info.state) ||
+            (pJob->result != info.result) || (pJob->time != info.time);
+        pJob->active = true;
+        pJob->hash   = hash;
+        pJob->state  = info.state;
+        pJob->result = info.result;
+        pJob->time   = info.time;
+        if (all || changed)
+        {
+            uint8_t *pRec = &sRelayData.buf[RELAY_HDR_SIZE + (num * RELAY_REC_SIZE)];
+            sRelayPut32(&pRec[0], hash);
+            sRelayPut32(&pRec[4], (uint32_t)info.time);
+            pRec[ 8] = info.state;
+            pRec[ 9] = info.result;
+            pRec[10] = 0;
+            pRec[11] = 0;
+            num++;
+        }
+    }
+    if (all || (num > 0))
+    {
+        sRelaySend(all ? RELAY_TYPE_ALL : RELAY_TYPE_SOME, num);
+        if (all)
+        {
+            sRelayData.lastAll = osTime();
+        }
+    }
+}
+
+static void sRelayStopRelaying(void)
+{
+    PRINT("relay: stop relaying");
+    sRelaySend(RELAY_TYPE_BYE, 0);
+    sRelayClose();
+    sRelayData.role = RELAY_ROLE_NONE;
+}
+
+bool relayPoll(void)
+{
+    if (!configGetRelay())
+    {
+        if (sRelayData.role == RELAY_ROLE_RELAY)
+        {
+            sRelayStopRelaying();
+        }
+        return false;
+    }
+
+    // start relaying once the backend connection has settled (and we have the config and the job states)
+    const uint32_t now = osTime();
+    if (sRelayData.role != RELAY_ROLE_RELAY)
+    {
+        if ( !backendIsConnected() || ((now - sRelayData.connStart) < RELAY_SETTLE) || !sRelayOpen() )
+        {
+            return false;
+        }
+        PRINT("relay: relaying");
+        sRelayData.role = RELAY_ROLE_RELAY;
+        sRelayData.relayStart = now;
+        sRelayData.lastAll = 0;
+        sRelayData.nRelay++;
+        for (int ix = 0; ix < NUMOF(sRelayData.jobs); ix++)
+        {
+            sRelayData.jobs[ix].active = false;
+        }
+    }
+
+    // the job states
+    sRelaySendJobs((sRelayData.lastAll == 0) || ((now - sRelayData.lastAll) >= RELAY_HEARTBEAT_INTERVAL));
+
+    // give way to another relay that has all our jobs, unless we have all of its jobs and we're
+    // older (this has to be the other way around for the other relay, so that only one gives way)
+    bool haveJobs = false;
+    for (int ix = 0; !haveJobs && (ix < NUMOF(sRelayData.jobs)); ix++)
+    {
+        haveJobs = sRelayData.jobs[ix].active;
+    }
+    bool yield = false;
+    RELAY_FRAME_t frame;
+    while (!yield && sRelayRecv(0, &frame))
+    {
+        if ( !haveJobs || (frame.type != RELAY_TYPE_ALL) || !sRelayFrameHasAllOurs(&frame) )
+        {
+            continue;
+        }
+        const uint32_t age = (now - sRelayData.relayStart) / 1000;
+        const bool older = (frame.age > age) || ((frame.age == age) && (frame.id < sRelayData.id));
+        if ( older || !sRelayWeHaveAllTheirs(&frame) )
+        {
+            PRINT("relay: giving way to %08x (age %us)", frame.id, frame.age);
+            sRelayData.nYield++;
+            yield = true;
+        }
+    }
+    return yield;
+}
+
+int32_t relayPollRemaining(void)
+{
+    const uint32_t now = osTime();
+    int32_t remaining = RELAY_HEARTBEAT_INTERVAL;
+    if (!configGetRelay())
+    {
+        remaining = 1000 * RELAY_RESYNC_INTERVAL;
+    }
+    else if (sRelayData.role == RELAY_ROLE_RELAY)
+    {
+        remaining = RELAY_HEARTBEAT_INTERVAL - (int32_t)(now - sRelayData.lastAll);
+    }
+    else if ((now - sRelayData.connStart) < RELAY_SETTLE)
+    {
+        remaining = RELAY_SETTLE - (int32_t)(now - sRelayData.connStart);
+    }
+    return remaining > 0 ? remaining : 1;
+}
+
+void relayStop(void)
+{
+    if (sRelayData.role == RELAY_ROLE_RELAY)
+    {
+        sRelayStopRelaying();
+    }
+}
+
+//@}
+// eof
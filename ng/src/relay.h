@@ -0,0 +1,112 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: LAN relay (see \ref FF_RELAY)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \defgroup FF_RELAY RELAY
+    \ingroup FF
+
+    Devices with the "relay" config on share one backend connection per network: One of them (the
+    relay) keeps its realtime connection to the backend and re-broadcasts the job states to the
+    others (the listeners) over UDP multicast (#RELAY_GROUP, #RELAY_PORT). This runs in the wifi task
+    (see wifi.c), there is no extra task.
+
+    - When the station comes online, the device listens for a relay for a few seconds (randomised,
+      relayWait()). If it hears one that knows (a superset of) all its jobs, it becomes a listener
+      (relayListen()). Otherwise it connects to the backend directly, and then it sends its job states
+      (relayPoll()), i.e. it becomes a relay itself.
+    - The relay sends a heartbeat frame with all its job states every #RELAY_HEARTBEAT_INTERVAL and
+      the changed states in between. The jobs are identified by a hash of the server and job name,
+      and each listener picks those that are on its channels (i.e. in the info restored from flash,
+      see jenkins.c).
+    - When a listener doesn't hear the relay for #RELAY_TIMEOUT, or when the relay says goodbye, it
+      starts over (with relayWait() and the random wait, so that only one of them takes over).
+    - When two relays know each other's jobs, the younger one (the one with the lower ID if they're
+      the same age) gives way and becomes a listener.
+    - Every #RELAY_RESYNC_INTERVAL a listener connects to the backend directly once, to get the
+      current config and channel mapping (which the relay doesn't relay), and then gives way to
+      the relay again.
+
+    The frames are not authenticated. Anyone on the network can make the listeners show whatever,
+    so this is off by default.
+
+    @{
+*/
+#ifndef __RELAY_H__
+#define __RELAY_H__
+
+#include "stdinc.h"
+
+//! multicast group (administratively scoped, see RFC 2365)
+#define RELAY_GROUP                "239.255.76.76"
+
+//! UDP port
+#define RELAY_PORT                 7676
+
+//! relay sends all job states this often [ms]
+#define RELAY_HEARTBEAT_INTERVAL   2000
+
+//! listener gives up on the relay after not hearing from it for this long [ms]
+#define RELAY_TIMEOUT              7000
+
+//! listeners wait this long for a relay before connecting to the backend directly [ms] (plus up to the same again, random)
+#define RELAY_WAIT                 5000
+
+//! relay starts relaying (and considers giving way) when the backend connection is this old [ms]
+#define RELAY_SETTLE              10000
+
+//! listener connects directly once after listening this long [s]
+#define RELAY_RESYNC_INTERVAL     (30 * 60)
+
+//! initialise
+void relayInit(void);
+
+//! wait for a relay (in the wifi task when the station is online, before connecting to the backend)
+/*!
+    \returns true if there is a relay that knows all our jobs (then use relayListen()), false if
+             the relay is off (config), or there is no suitable relay, or it's time to get the
+             config from the backend (then connect directly)
+*/
+bool relayWait(void);
+
+//! listen to the relay and update our channels (in the wifi task, instead of the backend connection)
+/*!
+    Returns when the relay has stopped (or is gone), or when it's time to resync (see
+    #RELAY_RESYNC_INTERVAL), or when the station has gone offline, or when asked to (see
+    relayStopListening()).
+*/
+void relayListen(void);
+
+//! make relayListen() return (soon), e.g. to reconnect (see wifiReconnect())
+void relayStopListening(void);
+
+//! start relaying (in the wifi task, on a new backend connection)
+void relayStart(void);
+
+//! relay our job states (in the wifi task, whenever data from the backend has been handled)
+/*!
+    \returns true if we should give way to another relay (i.e. close the backend connection and
+             listen to that one), false otherwise
+*/
+bool relayPoll(void);
+
+//! time until relayPoll() has something to do [ms] (for use as receive timeout)
+int32_t relayPollRemaining(void);
+
+//! stop relaying (in the wifi task, when the backend connection is closed)
+void relayStop(void);
+
+//! print relay monitor string
+void relayMonStatus(void);
+
+//! get relay status (for wifiGetStatusJson())
+/*!
+    \returns the role ("off", "none", "relay", "listener")
+*/
+const char *relayRoleStr(void);
+
+#endif // __RELAY_H__
+//@}
+// eof
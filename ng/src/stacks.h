@@ -0,0 +1,75 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: task stack sizes (see \ref FF_STACKS)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \defgroup FF_STACKS STACKS
+    \ingroup FF
+
+    The sizes (in StackType_t, i.e. words) of the static task stacks. The defaults here are
+    hand-picked. The calibration build ("make ... STACKSCALIB=1") doubles all of them and the system
+    monitor prints the lowest high-water mark of each task ("mon: stk: ..." lines). "make stacks-gen
+    MONLOG=<debug output>" turns that into src/stacks_gen.h with the peak usage plus a safety
+    margin (see tools/stacks.pl), which "make ... STACKS=1" uses instead of the defaults. The
+    calibration should run through the heavy cases, e.g. many channels with frequent updates from
+    "tools/tschenggins-stream.pl load" and a config change, and it is only valid for the build
+    options (TLS, debug deferring, etc.) it was done with.
+
+    In all builds the system monitor warns when a task has used most of its stack (see
+    monRegisterStack()).
+
+    @{
+*/
+#ifndef __STACKS_H__
+#define __STACKS_H__
+
+#if (!defined FF_STACKS_CALIB || (FF_STACKS_CALIB == 0)) && (defined FF_STACKS_GEN && (FF_STACKS_GEN > 0))
+#  include "stacks_gen.h"
+#endif
+
+#ifndef STACK_DEBUG
+#  define STACK_DEBUG          384 //!< ff_debug (deferred debug output, see debug.h)
+#endif
+#ifndef STACK_HTTPD
+#  define STACK_HTTPD          256 //!< ff_httpd (listener)
+#endif
+#ifndef STACK_HTTPD_WORKER
+#  define STACK_HTTPD_WORKER   512 //!< ff_httpd0.. (connection workers, for each)
+#endif
+#ifndef STACK_JENKINS
+#  define STACK_JENKINS        512 //!< ff_jenkins
+#endif
+#ifndef STACK_LEDS
+#  define STACK_LEDS           512 //!< ff_leds
+#endif
+#ifndef STACK_MON
+#  define STACK_MON            512 //!< ff_mon
+#endif
+#ifndef STACK_STATUS
+#  define STACK_STATUS         256 //!< ff_status
+#endif
+#ifndef STACK_TONE
+#  define STACK_TONE           256 //!< ff_tone
+#endif
+#ifndef STACK_WIFI
+#  define STACK_WIFI           768 //!< ff_wifi (without TLS)
+#endif
+#ifndef STACK_WIFI_TLS
+#  define STACK_WIFI_TLS      2048 //!< ff_wifi (with TLS, the handshake needs quite a bit of stack)
+#endif
+#ifndef STACK_WIFI_OTA
+#  define STACK_WIFI_OTA      1792 //!< ff_wifi (without TLS, but with the OTA signature check, see ota.h)
+#endif
+
+#if (defined FF_STACKS_CALIB && (FF_STACKS_CALIB > 0))
+//! stack size for a task (e.g. STACK_SIZE(LEDS)) \hideinitializer
+#  define STACK_SIZE(id) (2 * STACK_ ## id)
+#else
+#  define STACK_SIZE(id) (STACK_ ## id)
+#endif
+
+#endif // __STACKS_H__
+//@}
+// eof
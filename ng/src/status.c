@@ -15,6 +15,9 @@
 #include "tone.h"
 #include "config.h"
 #include "status.h"
+#include "mon.h"
+#include "mem.h"
+#include "stacks.h"
 
 #define STATUS_GPIO 2
 
@@ -67,13 +70,136 @@ void statusLed(const STATUS_LED_t status)
 }
 
 
+/* ***** notification scheduler ****************************************************************** */
+
+// the wifi and backend tasks post events to the queue, the status task plays them
+
+typedef enum STATUS_EV_TYPE_e
+{
+    STATUS_EV_NOISE,    // noise (.noise)
+    STATUS_EV_MELODY,   // builtin melody (.str is a static string)
+    STATUS_EV_COMMAND,  // backend command melody (.str is from sStatusCmdPool, NULL for random)
+} STATUS_EV_TYPE_t;
+
+typedef struct STATUS_EV_s
+{
+    uint8_t        type;   // STATUS_EV_TYPE_t
+    uint8_t        noise;  // STATUS_NOISE_t
+    const char    *str;
+} STATUS_EV_t;
+
+// priorities of the notifications
+#define STATUS_PRIO_NONE    0
+#define STATUS_PRIO_LOW     1 // dropped if anything else is playing
+#define STATUS_PRIO_NORMAL  2
+#define STATUS_PRIO_MELODY  3
+#define STATUS_PRIO_ALERT   4
+#define STATUS_PRIO_COMMAND 5
+
+static const uint8_t skStatusNoisePrio[] =
+{
+    [STATUS_NOISE_ABORT]  = STATUS_PRIO_NORMAL,
+    [STATUS_NOISE_FAIL]   = STATUS_PRIO_ALERT,
+    [STATUS_NOISE_ONLINE] = STATUS_PRIO_NORMAL,
+    [STATUS_NOISE_OTHER]  = STATUS_PRIO_LOW,
+    [STATUS_NOISE_TICK]   = STATUS_PRIO_LOW,
+    [STATUS_NOISE_ERROR]  = STATUS_PRIO_ALERT,
+};
+
+static QueueHandle_t sStatusQueue;
+
+// the command melody strings (one playing, one waiting, longer ones are truncated by the tone functions anyway)
+MEM_POOL(sStatusCmdPool, "status", TONE_RTTTL_MAX, 2);
+static uint8_t  sStatusPrio;        // priority of what is playing
+static uint16_t sStatusNumPosted;   // statistics, for statusMonStatus()
+static uint16_t sStatusNumPlayed;
+static uint16_t sStatusNumDropped;
+
+static uint8_t sStatusEvPrio(const STATUS_EV_t *pkEv)
+{
+    switch ((STATUS_EV_TYPE_t)pkEv->type)
+    {
+        case STATUS_EV_NOISE:   return skStatusNoisePrio[pkEv->noise];
+        case STATUS_EV_MELODY:  return STATUS_PRIO_MELODY;
+        case STATUS_EV_COMMAND: return STATUS_PRIO_COMMAND;
+    }
+    return STATUS_PRIO_NONE;
+}
+
+static void sStatusPost(const STATUS_EV_t *pkEv)
+{
+    if (xQueueSend(sStatusQueue, pkEv, 0) == pdTRUE)
+    {
+        sStatusNumPosted++;
+    }
+    else
+    {
+        sStatusNumDropped++;
+        if (pkEv->type == STATUS_EV_COMMAND)
+        {
+            memPoolFree(&sStatusCmdPool, (void *)pkEv->str);
+        }
+    }
+}
+
 void statusNoise(const STATUS_NOISE_t noise)
 {
-    if (toneIsPlaying() || (configGetNoise() == CONFIG_NOISE_NONE) )
+    if (configGetNoise() == CONFIG_NOISE_NONE)
     {
         return;
     }
+    const STATUS_EV_t ev = { .type = STATUS_EV_NOISE, .noise = noise, .str = NULL };
+    sStatusPost(&ev);
+}
 
+void statusMelody(const char *name)
+{
+    if (configGetNoise() < CONFIG_NOISE_MORE)
+    {
+        return;
+    }
+    const STATUS_EV_t ev = { .type = STATUS_EV_MELODY, .noise = 0, .str = name };
+    sStatusPost(&ev);
+}
+
+void statusCommandMelody(const char *melody)
+{
+    char *str = NULL;
+    if (melody != NULL)
+    {
+        str = memPoolAlloc(&sStatusCmdPool);
+        if (str == NULL)
+        {
+            sStatusNumDropped++;
+            return;
+        }
+        if (strlen(melody) >= sStatusCmdPool.blockSize)
+        {
+            WARNING("status: melody too long");
+        }
+        strncpy(str, melody, sStatusCmdPool.blockSize - 1);
+        str[sStatusCmdPool.blockSize - 1] = '\0';
+    }
+    const STATUS_EV_t ev = { .type = STATUS_EV_COMMAND, .noise = 0, .str = str };
+    sStatusPost(&ev);
+}
+
+// are we in the quiet hours?
+static bool sStatusIsQuiet(void)
+{
+    const int from = configGetQuietFrom();
+    const int to   = configGetQuietTo();
+    const uint32_t now = osGetPosixTime();
+    if ( (from == to) || (now < 1000000000) ) // off, or we don't know the time yet
+    {
+        return false;
+    }
+    const int hour = ( ((int)((now / 60) % (24 * 60)) + configGetTzOffs() + (24 * 60)) % (24 * 60) ) / 60;
+    return from < to ? ( (hour >= from) && (hour < to) ) : ( (hour >= from) || (hour < to) );
+}
+
+static const int16_t *sStatusNoiseMelody(const STATUS_NOISE_t noise)
+{
     switch (noise)
     {
         case STATUS_NOISE_ABORT:
@@ -82,8 +208,7 @@ void statusNoise(const STATUS_NOISE_t noise)
             {
                 TONE(A5, 30), TONE(PAUSE, 20), TONE(G5, 60), TONE_END
             };
-            toneMelody(skNoiseAbort);
-            break;
+            return skNoiseAbort;
         }
         case STATUS_NOISE_FAIL:
         {
@@ -91,8 +216,7 @@ void statusNoise(const STATUS_NOISE_t noise)
             {
                 TONE(A5, 30), TONE(PAUSE, 20), TONE(G5, 60), TONE(PAUSE, 20), TONE(F5, 100), TONE_END
             };
-            toneMelody(skNoiseFail);
-            break;
+            return skNoiseFail;
         }
         case STATUS_NOISE_ONLINE:
         {
@@ -100,8 +224,7 @@ void statusNoise(const STATUS_NOISE_t noise)
             {
                 TONE(D6, 30), TONE(PAUSE, 20), TONE(E6, 60), TONE_END
             };
-            toneMelody(skNoiseOnline);
-            break;
+            return skNoiseOnline;
         }
         case STATUS_NOISE_OTHER:
         {
@@ -109,8 +232,7 @@ void statusNoise(const STATUS_NOISE_t noise)
             {
                 TONE(C6, 30), TONE_END
             };
-            toneMelody(skNoiseOther);
-            break;
+            return skNoiseOther;
         }
         case STATUS_NOISE_ERROR:
         {
@@ -118,29 +240,138 @@ void statusNoise(const STATUS_NOISE_t noise)
             {
                 TONE(C4, 200), TONE(PAUSE, 50), TONE(C4, 200), TONE_END
             };
-            toneMelody(skNoiseError);
-            break;
+            return skNoiseError;
         }
         case STATUS_NOISE_TICK:
         {
-            static const int16_t skNoiseError[] =
+            static const int16_t skNoiseTick[] =
             {
                 TONE(C8, 40), TONE(PAUSE, 30), TONE(C7, 40), TONE_END
             };
-            toneMelody(skNoiseError);
-            break;
+            return skNoiseTick;
         }
     }
+    return NULL;
 }
 
-void statusMelody(const char *name)
+static void sStatusPlay(const STATUS_EV_t *pkEv, const int nCoalesced)
 {
-    if (configGetNoise() < CONFIG_NOISE_MORE)
+    const uint8_t prio = sStatusEvPrio(pkEv);
+    const bool isPlaying = toneIsPlaying();
+    if (!isPlaying)
     {
+        sStatusPrio = STATUS_PRIO_NONE;
+    }
+
+    // rules
+    bool play = true;
+    if ( (prio < STATUS_PRIO_COMMAND) && sStatusIsQuiet() )
+    {
+        play = false;
+    }
+    else if ( isPlaying && (prio == STATUS_PRIO_LOW) )
+    {
+        play = false;
+    }
+    else if ( isPlaying && (pkEv->type == STATUS_EV_MELODY) && (prio <= sStatusPrio) ) // melodies don't queue up
+    {
+        play = false;
+    }
+    if (!play)
+    {
+        DEBUG("status: drop %u/%u (%u)", pkEv->type, pkEv->noise, prio);
+        sStatusNumDropped += 1 + nCoalesced;
         return;
     }
-    toneStop();
-    toneBuiltinMelody(name);
+    sStatusNumPlayed++;
+    sStatusNumDropped += nCoalesced;
+
+    // pre-empt less important things, queue up noises after more or equally important ones
+    const bool preempt = isPlaying && ( (prio > sStatusPrio) || (pkEv->type != STATUS_EV_NOISE) );
+    DEBUG("status: play %u/%u (%u, prio %u/%u, coalesced %d)", pkEv->type, pkEv->noise, preempt, prio, sStatusPrio, nCoalesced);
+    if (preempt)
+    {
+        toneStop();
+    }
+    if (prio > sStatusPrio)
+    {
+        sStatusPrio = prio;
+    }
+
+    switch ((STATUS_EV_TYPE_t)pkEv->type)
+    {
+        case STATUS_EV_NOISE:
+            toneMelodyQueue(sStatusNoiseMelody((STATUS_NOISE_t)pkEv->noise));
+            break;
+        case STATUS_EV_MELODY:
+            toneBuiltinMelody(pkEv->str);
+            break;
+        case STATUS_EV_COMMAND:
+            if (pkEv->str == NULL)
+            {
+                toneBuiltinMelodyRandom();
+            }
+            else if (strchr(pkEv->str, ':') != NULL)
+            {
+                toneRtttlMelody(pkEv->str);
+            }
+            else
+            {
+                toneBuiltinMelody(pkEv->str);
+            }
+            break;
+    }
+}
+
+static void sStatusTask(void *pArg)
+{
+    while (true)
+    {
+        STATUS_EV_t ev;
+        if (xQueueReceive(sStatusQueue, &ev, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        // collect the burst, keep the most important (the first one of those, the last command)
+        osSleep(STATUS_COALESCE_MS);
+        int nCoalesced = 0;
+        STATUS_EV_t next;
+        while (xQueueReceive(sStatusQueue, &next, 0) == pdTRUE)
+        {
+            nCoalesced++;
+            const uint8_t prioEv = sStatusEvPrio(&ev);
+            const uint8_t prioNext = sStatusEvPrio(&next);
+            if ( (prioNext > prioEv) || ((prioNext == STATUS_PRIO_COMMAND) && (prioEv == STATUS_PRIO_COMMAND)) )
+            {
+                if (ev.type == STATUS_EV_COMMAND)
+                {
+                    memPoolFree(&sStatusCmdPool, (void *)ev.str);
+                }
+                ev = next;
+            }
+            else if (next.type == STATUS_EV_COMMAND)
+            {
+                memPoolFree(&sStatusCmdPool, (void *)next.str);
+            }
+        }
+
+        sStatusPlay(&ev, nCoalesced);
+
+        if (ev.type == STATUS_EV_COMMAND)
+        {
+            memPoolFree(&sStatusCmdPool, (void *)ev.str); // (the tone functions copy what they need)
+        }
+    }
+}
+
+void statusMonStatus(void)
+{
+    DEBUG("mon: status: posted=%u played=%u dropped=%u quiet=%s",
+        sStatusNumPosted, sStatusNumPlayed, sStatusNumDropped, sStatusIsQuiet() ? "yes" : "no");
+    sStatusNumPosted = 0;
+    sStatusNumPlayed = 0;
+    sStatusNumDropped = 0;
 }
 
 
@@ -157,6 +388,15 @@ void statusInit(void)
     xTimerStart(timer, 1000);
 
     statusLed(STATUS_LED_NONE);
+
+    // notification scheduler
+    static StaticQueue_t sQueue;
+    static uint8_t sQueueBuf[8 * sizeof(STATUS_EV_t)];
+    sStatusQueue = xQueueCreateStatic(NUMOF(sQueueBuf) / sizeof(STATUS_EV_t), sizeof(STATUS_EV_t), sQueueBuf, &sQueue);
+    static StackType_t sStatusTaskStack[STACK_SIZE(STATUS)];
+    static StaticTask_t sStatusTaskTCB;
+    xTaskCreateStatic(sStatusTask, "ff_status", NUMOF(sStatusTaskStack), NULL, 1, sStatusTaskStack, &sStatusTaskTCB);
+    monRegisterStack("ff_status", "STATUS", NUMOF(sStatusTaskStack));
 }
 
 // eof
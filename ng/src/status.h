@@ -31,18 +31,48 @@ typedef enum STATUS_LED_e
 
 void statusLed(const STATUS_LED_t status);
 
+/*!
+    \name Noises
+
+    Noises and melodies are notifications, which are posted to the status task. It collects those
+    that come in a burst (within #STATUS_COALESCE_MS) and plays the most important one. A more
+    important notification stops what is playing (e.g. a failure beats a tick), an equally or less
+    important one queues up after it (#STATUS_NOISE_OTHER and #STATUS_NOISE_TICK are dropped
+    instead). Nothing but backend commands is played during the configured quiet hours.
+
+    @{
+*/
+
+//! time window in which bursts of notifications are coalesced [ms]
+#define STATUS_COALESCE_MS 150
+
+//! noises
 typedef enum STATUS_NOISE_e
 {
-    STATUS_NOISE_ABORT,
-    STATUS_NOISE_FAIL,
-    STATUS_NOISE_ONLINE,
-    STATUS_NOISE_OTHER,
-    STATUS_NOISE_TICK,
-    STATUS_NOISE_ERROR,
+    STATUS_NOISE_ABORT,    //!< connection aborted
+    STATUS_NOISE_FAIL,     //!< connection failed
+    STATUS_NOISE_ONLINE,   //!< connected to the backend
+    STATUS_NOISE_OTHER,    //!< something went okay (e.g. a status update)
+    STATUS_NOISE_TICK,     //!< reconnect count-down
+    STATUS_NOISE_ERROR,    //!< something went wrong (e.g. bad data from the backend)
 } STATUS_NOISE_t;
 
+//! post a noise (unless the noise config is "none")
 void statusNoise(const STATUS_NOISE_t noise);
 
+//! post a builtin melody (if the noise config is "more" or "most")
 void statusMelody(const char *name);
 
+//! post a melody requested by a backend command (always played, stops anything else)
+/*!
+    \param[in] melody  builtin melody name, RTTTL melody (if it contains a ':'), or NULL for a random
+                        builtin melody (the string is copied)
+*/
+void statusCommandMelody(const char *melody);
+
+//! print monitor info
+void statusMonStatus(void);
+
+//@}
+
 #endif // __STATUS_H__
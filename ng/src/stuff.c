@@ -295,6 +295,56 @@ const char *lwipErrStr(const int8_t error)
     return "???";
 }
 
+
+// hash from length and first and last characters, which is enough to tell our enum strings apart
+static __INLINE uint32_t sStrTabHash(const char *str, const int len)
+{
+    return len > 0 ? ( ((uint32_t)len << 2) ^ (uint8_t)str[0] ^ ((uint32_t)(uint8_t)str[len - 1] << 1) ) : 0;
+}
+
+void strTabInit(STRTAB_t *pTab)
+{
+    memset(pTab->slots, 0, sizeof(pTab->slots));
+    if (pTab->nStrs >= STRTAB_SLOTS)
+    {
+        ERROR("strtab: %s... %d > %d", pTab->kStrs[0], pTab->nStrs, STRTAB_SLOTS - 1);
+    }
+    for (int ix = 0; (ix < pTab->nStrs) && (ix < (STRTAB_SLOTS - 1)); ix++)
+    {
+        if (pTab->kStrs[ix] == NULL)
+        {
+            continue;
+        }
+        // linear probing
+        uint32_t slot = sStrTabHash(pTab->kStrs[ix], strlen(pTab->kStrs[ix]));
+        while (pTab->slots[slot % STRTAB_SLOTS] != 0)
+        {
+            slot++;
+        }
+        pTab->slots[slot % STRTAB_SLOTS] = ix + 1;
+    }
+}
+
+int strTabFind(const STRTAB_t *pkTab, const char *str, const int len, const int defVal)
+{
+    const int strLen = len < 0 ? (int)strlen(str) : len;
+    uint32_t slot = sStrTabHash(str, strLen);
+    for (int n = 0; n < STRTAB_SLOTS; n++, slot++)
+    {
+        const int ix = (int)pkTab->slots[slot % STRTAB_SLOTS] - 1;
+        if (ix < 0)
+        {
+            break;
+        }
+        const char *pkStr = pkTab->kStrs[ix];
+        if ( (strncmp(pkStr, str, strLen) == 0) && (pkStr[strLen] == '\0') )
+        {
+            return ix;
+        }
+    }
+    return defVal;
+}
+
 static uint32_t sOsTimePosix;
 static uint32_t sOsTimeOs;
 
@@ -312,6 +362,78 @@ uint32_t osGetPosixTime(void)
     return sOsTimePosix + ((now - sOsTimeOs) / 1000);
 }
 
+// the synchronised time is osTime() plus an offset, estimated from the backend timestamps: each gives a
+// lower bound for the offset (the message took some unknown time to arrive), and the largest of the
+// last few is the one that took the least time (e.g. not delayed by wifi power saving)
+#define OS_SYNC_NUM       8  // number of offset samples
+#define OS_SYNC_SLEW     20  // [ms/s] max. rate of offset change (i.e. the clock runs up to 2% fast or slow)
+#define OS_SYNC_STEP   2000  // [ms] step instead of slewing if the offset is off by more than this
+#define OS_SYNC_MAXAGE 60000 // [ms] forget the samples if there were none for this long
+
+static uint32_t sOsSyncSamples[OS_SYNC_NUM];
+static int      sOsSyncNum;
+static int      sOsSyncIx;
+static uint32_t sOsSyncT0;     // [ms] osTime() of the last sample
+static uint32_t sOsSyncOff0;   // [ms] offset at sOsSyncT0
+static uint32_t sOsSyncTarget; // [ms] offset we're slewing towards
+
+// offset at (osTime()) time t
+static uint32_t sOsSyncOffset(const uint32_t t)
+{
+    const int32_t err = (int32_t)(sOsSyncTarget - sOsSyncOff0);
+    const int32_t maxSlew = (MIN(t - sOsSyncT0, 3600 * 1000) * OS_SYNC_SLEW) / 1000;
+    return sOsSyncOff0 + CLIP(err, -maxSlew, maxSlew);
+}
+
+void osSyncTime(const uint32_t timestamp, const int ms)
+{
+    const uint32_t now = osTime();
+    const uint32_t sample = (timestamp * 1000) + ms - now;
+    int32_t err;
+    bool step;
+    CS_ENTER;
+    const uint32_t offs = sOsSyncOffset(now);
+    err = (int32_t)(sample - offs);
+    step = (sOsSyncNum == 0) || (ABS(err) > OS_SYNC_STEP);
+    // forget old samples (the clocks drift apart)
+    if ( step || ((now - sOsSyncT0) > OS_SYNC_MAXAGE) )
+    {
+        sOsSyncNum = 0;
+        sOsSyncIx = 0;
+    }
+    sOsSyncOff0 = step ? sample : offs;
+    sOsSyncT0 = now;
+    sOsSyncSamples[sOsSyncIx] = sample;
+    sOsSyncIx = (sOsSyncIx + 1) % OS_SYNC_NUM;
+    if (sOsSyncNum < OS_SYNC_NUM)
+    {
+        sOsSyncNum++;
+    }
+    sOsSyncTarget = sample;
+    for (int ix = 0; ix < sOsSyncNum; ix++)
+    {
+        if ((int32_t)(sOsSyncSamples[ix] - sOsSyncTarget) > 0)
+        {
+            sOsSyncTarget = sOsSyncSamples[ix];
+        }
+    }
+    CS_LEAVE;
+    if (step)
+    {
+        DEBUG("os: sync step (%dms)", err);
+    }
+}
+
+uint32_t osGetSyncTime(void)
+{
+    uint32_t res;
+    CS_ENTER;
+    const uint32_t now = osTime();
+    res = now + sOsSyncOffset(now);
+    CS_LEAVE;
+    return res;
+}
+
 
 void stuffInit(void)
 {
@@ -106,6 +106,23 @@ void osSetPosixTime(const uint32_t timestamp);
 //! get POSIX time
 uint32_t osGetPosixTime(void);
 
+//! discipline the synchronised time
+/*!
+    \param[in] timestamp  POSIX time from the backend [s] (rounded)
+    \param[in] ms         when exactly the backend said so, relative to the timestamp [ms] (-500..499)
+
+    Call this as soon as possible after the message with the timestamp arrived. Small corrections are
+    slewed, large ones (and the first one) are stepped.
+*/
+void osSyncTime(const uint32_t timestamp, const int ms);
+
+//! get synchronised time
+/*!
+    \returns the POSIX time [ms] (modulo 2^32), the same on all devices (to within some 10ms) once
+              synchronised (see osSyncTime()), a free-running clock until then
+*/
+uint32_t osGetSyncTime(void);
+
 //@}
 
 /* ***** SDK enumeration stringifications ******************************************************** */
@@ -187,6 +204,55 @@ const char *lwipErrStr(const int8_t error);
 //@}
 
 
+/* ***** string tables *************************************************************************** */
+
+/*!
+    \name String tables
+
+    Decodes strings to enum values using the same string tables that are used for stringifying the
+    enum values. strTabInit() builds a small hash index from the table (so it always matches the
+    table contents), and strTabFind() then needs one hash and typically one string compare.
+
+\code{.c}
+static const char * const skFooStrs[] = { [FOO_UNKNOWN] = "unknown", [FOO_BAR] = "bar", [FOO_BAZ] = "baz" };
+static STRTAB_t sFooTab = STRTAB(skFooStrs);
+strTabInit(&sFooTab); // once, at init
+const FOO_t foo = strTabFind(&sFooTab, "baz", -1, FOO_UNKNOWN); // --> FOO_BAZ
+\endcode
+    @{
+*/
+
+//! number of hash slots (must be a power of two and larger than the largest table)
+#define STRTAB_SLOTS 16
+
+//! string table with hash index
+typedef struct STRTAB_s
+{
+    const char * const *kStrs;            //!< the strings (may contain NULL)
+    int                 nStrs;            //!< number of strings
+    uint8_t             slots[STRTAB_SLOTS]; //!< index + 1 of the strings (0 = empty slot)
+} STRTAB_t;
+
+//! initialiser for STRTAB_t \hideinitializer
+#define STRTAB(strs) { .kStrs = (strs), .nStrs = NUMOF(strs), .slots = { 0 } }
+
+//! build hash index
+void strTabInit(STRTAB_t *pTab);
+
+//! find string in table
+/*!
+    \param[in] pkTab   the string table (initialised with strTabInit())
+    \param[in] str     the string (need not be terminated if \a len >= 0)
+    \param[in] len     length of the string, or -1 to use strlen()
+    \param[in] defVal  value to return if the string is not in the table
+
+    \returns the index of the string in the table, or \a defVal
+*/
+int strTabFind(const STRTAB_t *pkTab, const char *str, const int len, const int defVal);
+
+//@}
+
+
 /* ***** JSMN helpers **************************************************************************** */
 
 /*!
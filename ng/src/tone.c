@@ -14,15 +14,53 @@
 
 #include <esp8266.h>
 
+#if (defined FF_TONE_I2S && FF_TONE_I2S > 0)
+#  include <i2s_dma/i2s_dma.h>
+#endif
+
 #include "stuff.h"
 #include "debug.h"
 #include "mon.h"
+#include "stacks.h"
+#include "config.h"
+#include "flash.h"
 #include "tone.h"
 
 /* *********************************************************************************************** */
 
 #define TONE_GPIO 4
 
+#define PAUSE_FREQ 1000
+
+// a note as played by the timer ISR: timer value and number of times to toggle the PIO (negative for pauses)
+typedef struct TONE_NOTE_s
+{
+    uint32_t timerval;
+    int32_t  togglecnt;
+} TONE_NOTE_t;
+
+#define TONE_TIMERVAL(freq)       ( (APB_CLK_FREQ / 1000000 * 500000) / ((freq) != TONE_PAUSE ? (freq) : PAUSE_FREQ) )
+#define TONE_TOGGLECNT(freq, dur) ( (freq) != TONE_PAUSE ? ((int16_t)(2 * (freq) * (dur) / 1000)) : \
+                                                          -((int16_t)(2 * PAUSE_FREQ * (dur) / 1000)) )
+#define TONE_NOTE(freq, dur)      { .timerval = TONE_TIMERVAL(freq), .togglecnt = TONE_TOGGLECNT(freq, dur) }
+
+// a builtin melody
+typedef struct TONE_BUILTIN_s
+{
+    const char        *name;
+    const TONE_NOTE_t *notes;
+    int                nNotes;
+} TONE_BUILTIN_t;
+
+// the builtin melodies from rtttl.c, precompiled by tools/rtttl-gen.c (skRtttlGenMelodies[])
+#include "rtttl_gen.h"
+
+#if (defined FF_TONE_I2S && FF_TONE_I2S > 0)
+static bool sToneI2sAvail(void);
+static void sToneI2sNext(TimerHandle_t timer);
+static void sToneI2sStop(void);
+#endif
+
 // forward declarations
 static void sToneIsr(void *pArg);
 static void sToneStop(void);
@@ -30,81 +68,327 @@ static void sToneStart(void);
 
 static volatile bool sToneIsPlaying;
 
-void toneStart(const uint32_t freq, const uint32_t dur)
-{
-    sToneStop();
 
-    // set "melody"
-    const int16_t pkFreqDur[] = { freq, dur, TONE_END };
-    toneMelody(pkFreqDur);
-}
+/* ***** note queue ****************************************************************************** */
 
-#define TONE_MELODY_N 50
+// The player (the FRC1 ISR, or the I2S timer) takes the notes from a small ring buffer, which the tone
+// task refills from the melody sources (see below) whenever it is half empty. Only the player writes
+// the tail and only the tone task writes the head, so there's no locking between them. If the player
+// runs out of notes before the end of the melody it stalls and the tone task restarts it.
 
-static volatile uint32_t svToneMelodyTimervals[TONE_MELODY_N + 1];
-static volatile int16_t  svToneMelodyTogglecnts[TONE_MELODY_N + 1];
-static volatile int16_t  svToneMelodyIx;
+#define TONE_QUEUE_N 16
 
-#define PAUSE_FREQ 1000
+static TONE_NOTE_t       sToneQueue[TONE_QUEUE_N];
+static volatile uint32_t svToneQueueHead;    // write-to-queue pointer (free-running index)
+static volatile uint32_t svToneQueueTail;    // read-from-queue pointer (free-running index)
+static volatile bool     svToneQueueLast;    // no more notes (after those in the queue)
+static volatile bool     svToneStalled;      // player ran out of notes
+static volatile uint16_t svToneNumStalls;
 
-void toneMelody(const int16_t *pkFreqDur)
-{
-    sToneStop();
-    uint32_t totalDur = 0;
-    uint16_t nNotes = 0;
+#define TONE_BARRIER() __asm__ __volatile__ ("" ::: "memory")
 
-    //memset(svToneMelodyTimervals, 0, sizeof(svToneMelodyTimervals));
-    for (int ix = 0; ix < NUMOF(svToneMelodyTimervals); ix++)
-    {
-        svToneMelodyTimervals[ix] = 0;
-    }
-    //memset(svToneMelodyTogglecnts, 0, sizeof(svToneMelodyTogglecnts));
-    for (int ix = 0; ix < NUMOF(svToneMelodyTogglecnts); ix++)
+static bool sToneQueuePop(TONE_NOTE_t *pNote) // RAM func
+{
+    const uint32_t tail = svToneQueueTail;
+    if (tail == svToneQueueHead)
     {
-        svToneMelodyTogglecnts[ix] = 0;
+        return false;
     }
-    svToneMelodyIx = 0;
+    *pNote = sToneQueue[tail % TONE_QUEUE_N];
+    TONE_BARRIER();
+    svToneQueueTail = tail + 1;
+    return true;
+}
 
-    for (int16_t ix = 0; ix < TONE_MELODY_N; ix++)
-    {
-        const int16_t freq = pkFreqDur[ 2 * ix ];
-        if ( (freq != TONE_END) && (freq > 0) )
-        {
-            const int16_t _freq = freq != TONE_PAUSE ? freq : PAUSE_FREQ;
-            const int16_t dur = pkFreqDur[ (2 * ix) + 1 ];
+static void sToneQueuePush(const TONE_NOTE_t *pkNote)
+{
+    const uint32_t head = svToneQueueHead;
+    sToneQueue[head % TONE_QUEUE_N] = *pkNote;
+    TONE_BARRIER();
+    svToneQueueHead = head + 1;
+}
 
-            // timer value
-            const uint32_t timerval = (APB_CLK_FREQ / 1000000 * 500000) / _freq;
+static __INLINE uint32_t sToneQueueSize(void)
+{
+    return svToneQueueHead - svToneQueueTail;
+}
 
-            // number of times to toggle the PIO
-            const int16_t togglecnt = 2 * _freq * dur / 1000;
 
-            svToneMelodyTimervals[ix]  = timerval;
-            svToneMelodyTogglecnts[ix] = freq != TONE_PAUSE ? togglecnt : -togglecnt;
+/* ***** melody sources ************************************************************************** */
 
-            totalDur += dur;
-            nNotes++;
+// the current melody and the ones queued by toneMelodyQueue()
+typedef enum TONE_SRC_TYPE_e
+{
+    TONE_SRC_FREQDUR,   // list of frequency and duration pairs (toneMelody(), toneStart())
+    TONE_SRC_NOTES,     // list of notes (builtin and cached melodies)
+    TONE_SRC_RTTTL,     // RTTTL string (sToneRtttlStr)
+} TONE_SRC_TYPE_t;
 
-            //DEBUG("toneMelody() %2d %4d %4d -> %6u %4d", ix, freq, dur, timerval, togglecnt);
+typedef struct TONE_SRC_s
+{
+    TONE_SRC_TYPE_t    type;
+    const int16_t     *pkFreqDur;   // TONE_SRC_FREQDUR (or NULL to use freqDur[])
+    int16_t            freqDur[3];  // TONE_SRC_FREQDUR for toneStart()
+    const TONE_NOTE_t *pkNotes;     // TONE_SRC_NOTES
+    int                nNotes;      // TONE_SRC_NOTES
+    int                ix;          // next note
+} TONE_SRC_t;
+
+#define TONE_SRC_N     4
+
+static TONE_SRC_t        sToneSrcs[TONE_SRC_N];           // [0] = current, then queued
+static int               sToneSrcNum;
+static RTTTL_ITER_t      sToneRtttlIter;
+static char              sToneRtttlStr[TONE_RTTTL_MAX];
+static SemaphoreHandle_t sToneMutex;
+static TaskHandle_t      sToneTaskHandle;
+#if (defined FF_TONE_I2S && FF_TONE_I2S > 0)
+static bool              sToneUseI2s;
+#endif
+
+// get next note from the sources
+static bool sToneSrcNext(TONE_NOTE_t *pNote)
+{
+    while (sToneSrcNum > 0)
+    {
+        TONE_SRC_t *pSrc = &sToneSrcs[0];
+        bool haveNote = false;
+        switch (pSrc->type)
+        {
+            case TONE_SRC_FREQDUR:
+            {
+                const int16_t *pkFreqDur = pSrc->pkFreqDur != NULL ? pSrc->pkFreqDur : pSrc->freqDur;
+                const int16_t freq = pkFreqDur[ 2 * pSrc->ix ];
+                if ( (freq != TONE_END) && (freq > 0) )
+                {
+                    const int16_t dur = pkFreqDur[ (2 * pSrc->ix) + 1 ];
+                    const TONE_NOTE_t note = TONE_NOTE(freq, dur);
+                    *pNote = note;
+                    pSrc->ix++;
+                    haveNote = true;
+                }
+                break;
+            }
+            case TONE_SRC_NOTES:
+                if (pSrc->ix < pSrc->nNotes)
+                {
+                    *pNote = pSrc->pkNotes[pSrc->ix++];
+                    haveNote = true;
+                }
+                break;
+            case TONE_SRC_RTTTL:
+            {
+                int16_t freq, dur;
+                if (rtttlIterNext(&sToneRtttlIter, &freq, &dur))
+                {
+                    const TONE_NOTE_t note = TONE_NOTE(freq, dur);
+                    *pNote = note;
+                    haveNote = true;
+                }
+                break;
+            }
+        }
+
+        if (haveNote)
+        {
+            // skip notes too short to play
+            if (pNote->togglecnt != 0)
+            {
+                return true;
+            }
         }
+        // next source
         else
         {
+            sToneSrcNum--;
+            memmove(&sToneSrcs[0], &sToneSrcs[1], sToneSrcNum * sizeof(sToneSrcs[0]));
+        }
+    }
+    return false;
+}
+
+// refill the queue (if it's half empty), must hold sToneMutex
+static void sToneRefill(void)
+{
+    if (sToneQueueSize() > (TONE_QUEUE_N / 2))
+    {
+        return;
+    }
+    while (sToneQueueSize() < TONE_QUEUE_N)
+    {
+        TONE_NOTE_t note;
+        if (!sToneSrcNext(&note))
+        {
+            svToneQueueLast = true;
             break;
         }
+        sToneQueuePush(&note);
     }
+}
 
-    //DEBUG("toneMelody() %ums, %u", totalDur, nNotes);
+// start the player, must hold sToneMutex
+static void sTonePlay(void)
+{
+    svToneQueueLast = false;
+    svToneStalled = false;
+    sToneRefill();
+    if (sToneQueueSize() == 0)
+    {
+        return;
+    }
+    sToneIsPlaying = true;
+
+#if (defined FF_TONE_I2S && FF_TONE_I2S > 0)
+    // generate the square wave by I2S DMA, if the LEDs don't need it
+    sToneUseI2s = sToneI2sAvail();
+    if (sToneUseI2s)
+    {
+        sToneI2sNext(NULL);
+        return;
+    }
+#endif
 
     // configure hw timer
     timer_set_divider(FRC1, TIMER_CLKDIV_1);
     timer_set_reload(FRC1, true);
     timer_set_interrupts(FRC1, true); // enable and unmask interrupt
 
-    sToneIsPlaying = true;
     sToneStart();
 }
 
-/* *********************************************************************************************** */
+// stop the player and forget all melodies, must hold sToneMutex
+static void sToneClear(void)
+{
+    sToneStop();
+#if (defined FF_TONE_I2S && FF_TONE_I2S > 0)
+    sToneI2sStop();
+#endif
+    // the player is stopped, it's safe to reset the queue
+    svToneQueueTail = svToneQueueHead;
+    svToneQueueLast = true;
+    svToneStalled = false;
+    sToneSrcNum = 0;
+}
+
+// add a source, and start playing if nothing is playing
+static void sToneAddSrc(const TONE_SRC_t *pkSrc)
+{
+    if (sToneSrcNum < NUMOF(sToneSrcs))
+    {
+        sToneSrcs[sToneSrcNum++] = *pkSrc;
+        if (!sToneIsPlaying)
+        {
+            sTonePlay();
+        }
+        else
+        {
+            svToneQueueLast = false;
+        }
+        xTaskNotifyGive(sToneTaskHandle);
+    }
+    else
+    {
+        WARNING("tone: too many melodies");
+    }
+}
+
+// refill the queue while playing, and restart the player if it stalled
+static void sToneTask(void *pArg)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, sToneIsPlaying ? MS2TICKS(20) : portMAX_DELAY);
+
+        xSemaphoreTake(sToneMutex, portMAX_DELAY);
+        // melody added just when the player stopped
+        if (!sToneIsPlaying && (sToneSrcNum > 0))
+        {
+            sTonePlay();
+        }
+        else if (sToneIsPlaying)
+        {
+            sToneRefill();
+            if (svToneStalled)
+            {
+                svToneNumStalls++;
+                if (sToneQueueSize() > 0)
+                {
+                    svToneStalled = false;
+#if (defined FF_TONE_I2S && FF_TONE_I2S > 0)
+                    if (sToneUseI2s)
+                    {
+                        sToneI2sNext(NULL);
+                    }
+                    else
+#endif
+                    {
+                        sToneStart();
+                    }
+                }
+                else if (svToneQueueLast)
+                {
+                    sToneClear();
+                }
+            }
+        }
+        xSemaphoreGive(sToneMutex);
+    }
+}
+
+
+/* ***** API ************************************************************************************* */
+
+void toneStart(const uint32_t freq, const uint32_t dur)
+{
+    xSemaphoreTake(sToneMutex, portMAX_DELAY);
+    sToneClear();
+
+    // set "melody"
+    const TONE_SRC_t src = { .type = TONE_SRC_FREQDUR, .pkFreqDur = NULL, .freqDur = { freq, dur, TONE_END } };
+    sToneAddSrc(&src);
+    xSemaphoreGive(sToneMutex);
+}
+
+void toneMelody(const int16_t *pkFreqDur)
+{
+    xSemaphoreTake(sToneMutex, portMAX_DELAY);
+    sToneClear();
+    const TONE_SRC_t src = { .type = TONE_SRC_FREQDUR, .pkFreqDur = pkFreqDur };
+    sToneAddSrc(&src);
+    xSemaphoreGive(sToneMutex);
+}
+
+void toneMelodyQueue(const int16_t *pkFreqDur)
+{
+    xSemaphoreTake(sToneMutex, portMAX_DELAY);
+    const TONE_SRC_t src = { .type = TONE_SRC_FREQDUR, .pkFreqDur = pkFreqDur };
+    sToneAddSrc(&src);
+    xSemaphoreGive(sToneMutex);
+}
+
+static void sTonePlayNotes(const TONE_NOTE_t *pkNotes, const int nNotes)
+{
+    xSemaphoreTake(sToneMutex, portMAX_DELAY);
+    sToneClear();
+    const TONE_SRC_t src = { .type = TONE_SRC_NOTES, .pkNotes = pkNotes, .nNotes = nNotes };
+    sToneAddSrc(&src);
+    xSemaphoreGive(sToneMutex);
+}
+
+void toneStop(void)
+{
+    xSemaphoreTake(sToneMutex, portMAX_DELAY);
+    sToneClear();
+    xSemaphoreGive(sToneMutex);
+}
+
+__INLINE bool toneIsPlaying(void)
+{
+    return sToneIsPlaying;
+}
+
+
+/* ***** FRC1 timer player *********************************************************************** */
 
 static volatile int16_t svToneToggleCnt;
 static volatile bool svToneSilent;
@@ -113,23 +397,27 @@ static void sToneStart(void) // RAM func
 {
     gpio_write(TONE_GPIO, false);
 
-    const int32_t timerval  = svToneMelodyTimervals[svToneMelodyIx];
-    const int16_t togglecnt = svToneMelodyTogglecnts[svToneMelodyIx];
-    svToneMelodyIx++;
-
-    if (togglecnt)
+    TONE_NOTE_t note;
+    if (sToneQueuePop(&note))
     {
-        svToneToggleCnt = togglecnt < 0 ? -togglecnt : togglecnt;
-        svToneSilent = togglecnt < 0 ? true : false;
+        svToneToggleCnt = note.togglecnt < 0 ? -note.togglecnt : note.togglecnt;
+        svToneSilent = note.togglecnt < 0 ? true : false;
 
         // arm timer (23 bits, 0-8388607)
-        timer_set_load(FRC1, timerval);
+        timer_set_load(FRC1, note.timerval);
         timer_set_run(FRC1, true);
     }
-    else
+    // end of melody
+    else if (svToneQueueLast)
     {
         sToneStop();
     }
+    // the tone task will restart us
+    else
+    {
+        timer_set_run(FRC1, false);
+        svToneStalled = true;
+    }
 }
 
 static void sToneStop(void) // RAM func
@@ -141,20 +429,9 @@ static void sToneStop(void) // RAM func
     sToneIsPlaying = false;
 }
 
-void toneStop(void)
-{
-    sToneStop();
-}
-
-__INLINE bool toneIsPlaying(void)
-{
-    return sToneIsPlaying;
-}
-
-
 IRAM static void sToneIsr(void *pArg) // RAM func
 {
-    monIsrEnter();
+    const uint32_t t0 = monIsrEnter();
     //UNUSED(pArg);
 
     // toggle PIO...
@@ -178,49 +455,244 @@ IRAM static void sToneIsr(void *pArg) // RAM func
         sToneStart();
     }
 
-    monIsrLeave();
+    monIsrLeave(MON_ISR_TONE, t0);
 }
 
 
-/* *********************************************************************************************** */
+/* ***** I2S player ****************************************************************************** */
 
-void toneBuiltinMelody(const char *name)
+#if (defined FF_TONE_I2S && FF_TONE_I2S > 0)
+
+// Instead of toggling the GPIO from the FRC1 ISR on every edge, the I2S peripheral sends a buffer with a
+// few periods of the square wave in a loop (a single DMA descriptor that links to itself and generates no
+// interrupts). The I2S bit clock is chosen such that a period is k 32-bit words (k * 16 bits high, k * 16
+// bits low). A timer (the FreeRTOS timer task, not an ISR) switches to the next note at note boundaries.
+// The output is on the I2S data pin (GPIO3, RX), and this is only used if the LEDs don't use the I2S
+// (i.e. not for the WS2812 driver).
+
+#define TONE_I2S_GPIO        3
+#define TONE_I2S_CLK_MIN 40313   // minimal I2S bit clock (160MHz / 63 / 63) [Hz]
+#define TONE_I2S_BUF_HW    128   // buffer size in 16 bit half-words
+
+static dma_descriptor_t sToneI2sDesc;
+static uint16_t         sToneI2sBuf[TONE_I2S_BUF_HW];
+static TimerHandle_t    sToneI2sTimer;
+static bool             sToneI2sRunning;
+
+static bool sToneI2sAvail(void)
+{
+    return (sToneI2sTimer != NULL) && (configGetDriver() != CONFIG_DRIVER_WS2812);
+}
+
+IRAM static void sToneI2sIsr(void *pArg) // RAM func
+{
+    // there are no eof interrupts, nothing to do
+    i2s_dma_clear_interrupt();
+}
+
+static void sToneI2sPlay(const int16_t freq)
 {
-    const char *rtttl = rtttlBuiltinMelody(name);
-    if (rtttl == NULL)
+    i2s_dma_stop();
+
+    // half-words per half-period (>= 1 and such that the bit clock (32 * k * freq) is not too low)
+    const int16_t _freq = freq != TONE_PAUSE ? CLIP(freq, 20, 20000) : PAUSE_FREQ;
+    const int k = MIN((TONE_I2S_CLK_MIN + (32 * _freq) - 1) / (32 * _freq), TONE_I2S_BUF_HW / 2);
+
+    // fill the buffer with as many (full) periods as fit, the I2S sends the half-words swapped
+    const int n = (TONE_I2S_BUF_HW / (2 * k)) * (2 * k);
+    for (int ix = 0; ix < n; ix++)
+    {
+        sToneI2sBuf[ix ^ 1] = (freq != TONE_PAUSE) && ((ix % (2 * k)) < k) ? 0xffff : 0x0000;
+    }
+
+    sToneI2sDesc.owner         = 1;
+    sToneI2sDesc.eof           = 0;
+    sToneI2sDesc.sub_sof       = 0;
+    sToneI2sDesc.datalen       = n * sizeof(uint16_t);
+    sToneI2sDesc.blocksize     = n * sizeof(uint16_t);
+    sToneI2sDesc.buf_ptr       = sToneI2sBuf;
+    sToneI2sDesc.unused        = 0;
+    sToneI2sDesc.next_link_ptr = &sToneI2sDesc;
+
+    const i2s_pins_t pins = { .data = true, .clock = false, .ws = false };
+    i2s_dma_init(sToneI2sIsr, NULL, i2s_get_clock_div(32 * k * _freq), pins);
+    i2s_dma_start(&sToneI2sDesc);
+    sToneI2sRunning = true;
+}
+
+// play next note from the queue (timer == NULL to (re)start)
+static void sToneI2sNext(TimerHandle_t timer)
+{
+    if ( (timer != NULL) && !sToneIsPlaying )
     {
-        ERROR("tone: no such melody: %s", name);
         return;
     }
-    toneRtttlMelody(rtttl);
+
+    TONE_NOTE_t note;
+    if (sToneQueuePop(&note))
+    {
+        const int freq = (APB_CLK_FREQ / 2) / note.timerval;
+        const int togglecnt = note.togglecnt < 0 ? -note.togglecnt : note.togglecnt;
+        sToneI2sPlay(note.togglecnt < 0 ? TONE_PAUSE : freq);
+        const TickType_t ticks = MS2TICKS(togglecnt * 1000 / (2 * freq));
+        xTimerChangePeriod(sToneI2sTimer, ticks > 0 ? ticks : 1, 0);
+    }
+    // end of melody
+    else if (svToneQueueLast)
+    {
+        sToneI2sStop();
+    }
+    // the tone task will restart us
+    else
+    {
+        sToneI2sPlay(TONE_PAUSE);
+        svToneStalled = true;
+    }
+}
+
+static void sToneI2sStop(void)
+{
+    if (sToneI2sTimer != NULL)
+    {
+        xTimerStop(sToneI2sTimer, 0);
+    }
+    if (sToneI2sRunning)
+    {
+        i2s_dma_stop();
+        // leave the pin low
+        gpio_enable(TONE_I2S_GPIO, GPIO_OUTPUT);
+        gpio_write(TONE_I2S_GPIO, false);
+        sToneI2sRunning = false;
+    }
+    sToneIsPlaying = false;
+}
+
+#endif // (FF_TONE_I2S > 0)
+
+
+/* ***** builtin and RTTTL melodies ************************************************************** */
+
+void toneBuiltinMelody(const char *name)
+{
+    // same as rtttlBuiltinMelody(): the last melody whose name starts with the given name
+    const int nameLen = strlen(name);
+    int ix = NUMOF(skRtttlGenMelodies);
+    while (ix--)
+    {
+        if (strncmp(skRtttlGenMelodies[ix].name, name, nameLen) == 0)
+        {
+            sTonePlayNotes(skRtttlGenMelodies[ix].notes, skRtttlGenMelodies[ix].nNotes);
+            return;
+        }
+    }
+    ERROR("tone: no such melody: %s", name);
 }
 
 void toneBuiltinMelodyRandom(void)
 {
-    const char *rtttl = rtttlBuiltinMelodyRandom();
-    toneRtttlMelody(rtttl);
+    const int ix = rand() % NUMOF(skRtttlGenMelodies);
+    sTonePlayNotes(skRtttlGenMelodies[ix].notes, skRtttlGenMelodies[ix].nNotes);
 }
 
 
+// least recently used cache of compiled RTTTL melodies (from the backend), longer melodies are parsed
+// while playing
+#define TONE_CACHE_N     2
+#define TONE_CACHE_NOTES 50
+
+typedef struct TONE_CACHE_s
+{
+    uint32_t    crc;                    // CRC32 of the RTTTL string
+    uint32_t    used;                   // last use (sequence number), 0 = unused entry
+    int         nNotes;
+    TONE_NOTE_t notes[TONE_CACHE_NOTES];
+} TONE_CACHE_t;
+
+static TONE_CACHE_t sToneCache[TONE_CACHE_N];
+static uint32_t     sToneCacheSeq;
+
 void toneRtttlMelody(const char *rtttl)
 {
-    toneStop();
-    const int nMelody = (TONE_MELODY_N * 2) + 1;
-    int16_t *pMelody = malloc( nMelody * sizeof(int16_t) );
-    if (pMelody)
+    xSemaphoreTake(sToneMutex, portMAX_DELAY);
+    sToneClear(); // (no source refers to a cache entry or sToneRtttlStr now)
+
+    const uint32_t crc = flashCrc32(0, rtttl, strlen(rtttl));
+    sToneCacheSeq++;
+
+    // play from cache, or use the least recently used entry
+    TONE_CACHE_t *pEntry = &sToneCache[0];
+    for (int ix = 0; ix < NUMOF(sToneCache); ix++)
     {
-        rtttlMelody(rtttl, pMelody, nMelody);
-        toneMelody(pMelody);
-        free(pMelody);
+        if ( (sToneCache[ix].used != 0) && (sToneCache[ix].crc == crc) )
+        {
+            sToneCache[ix].used = sToneCacheSeq;
+            const TONE_SRC_t src = { .type = TONE_SRC_NOTES, .pkNotes = sToneCache[ix].notes, .nNotes = sToneCache[ix].nNotes };
+            sToneAddSrc(&src);
+            xSemaphoreGive(sToneMutex);
+            return;
+        }
+        if (sToneCache[ix].used < pEntry->used)
+        {
+            pEntry = &sToneCache[ix];
+        }
     }
+
+    // compile into the cache if it fits
+    RTTTL_ITER_t iter;
+    rtttlIterInit(&iter, rtttl);
+    pEntry->crc    = crc;
+    pEntry->used   = sToneCacheSeq;
+    pEntry->nNotes = 0;
+    int16_t freq, dur;
+    while (rtttlIterNext(&iter, &freq, &dur))
+    {
+        if (pEntry->nNotes >= NUMOF(pEntry->notes))
+        {
+            pEntry->used = 0;
+            break;
+        }
+        const TONE_NOTE_t note = TONE_NOTE(freq, dur);
+        pEntry->notes[pEntry->nNotes++] = note;
+    }
+
+    if (pEntry->used != 0)
+    {
+        DEBUG("tone: cache %08x %d", crc, pEntry->nNotes);
+        const TONE_SRC_t src = { .type = TONE_SRC_NOTES, .pkNotes = pEntry->notes, .nNotes = pEntry->nNotes };
+        sToneAddSrc(&src);
+    }
+    // too long, parse while playing
     else
     {
-        ERROR("tone: malloc fail");
+        const int len = strlen(rtttl);
+        if (len >= (int)sizeof(sToneRtttlStr))
+        {
+            WARNING("tone: melody too long (%d)", len);
+        }
+        strncpy(sToneRtttlStr, rtttl, sizeof(sToneRtttlStr) - 1);
+        sToneRtttlStr[sizeof(sToneRtttlStr) - 1] = '\0';
+        rtttlIterInit(&sToneRtttlIter, sToneRtttlStr);
+        const TONE_SRC_t src = { .type = TONE_SRC_RTTTL };
+        sToneAddSrc(&src);
     }
+    xSemaphoreGive(sToneMutex);
 }
 
+
 /* *********************************************************************************************** */
 
+void toneMonStatus(void)
+{
+    uint16_t nStalls;
+    CS_ENTER;
+    nStalls = svToneNumStalls;
+    svToneNumStalls = 0;
+    CS_LEAVE;
+    if (nStalls > 0)
+    {
+        WARNING("mon: tone: stalls=%u", nStalls);
+    }
+}
 
 void toneInit(void)
 {
@@ -237,6 +709,20 @@ void toneInit(void)
 
     // attach ISR
     _xt_isr_attach(INUM_TIMER_FRC1, sToneIsr, NULL);
+
+    static StaticSemaphore_t sMutex;
+    sToneMutex = xSemaphoreCreateMutexStatic(&sMutex);
+
+    static StackType_t sToneTaskStack[STACK_SIZE(TONE)];
+    static StaticTask_t sToneTaskTCB;
+    sToneTaskHandle = xTaskCreateStatic(sToneTask, "ff_tone", NUMOF(sToneTaskStack), NULL, 1, sToneTaskStack, &sToneTaskTCB);
+    monRegisterStack("ff_tone", "TONE", NUMOF(sToneTaskStack));
+
+#if (defined FF_TONE_I2S && FF_TONE_I2S > 0)
+    static StaticTimer_t sTimer;
+    sToneI2sTimer = xTimerCreateStatic("tone_i2s", 1, false, NULL, sToneI2sNext, &sTimer);
+    DEBUG("tone: I2S on GPIO%u (unless WS2812 LEDs)", TONE_I2S_GPIO);
+#endif
 }
 
 
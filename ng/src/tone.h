@@ -11,6 +11,10 @@
     This implements tones and melodies (piezo or other small speaker on GPIO, currently hard-coded
     to GPIO4/D2).
 
+    With "make ... TONEI2S=1" the tones are generated by the I2S peripheral on GPIO3 (RX) instead,
+    which needs interrupts only at note boundaries rather than on every edge. This falls back to
+    GPIO4 if the LEDs need the I2S (WS2812 driver).
+
     @{
 */
 #ifndef __TONE_H__
@@ -23,6 +27,9 @@
 //! initialise tone module
 void toneInit(void);
 
+//! print tone player status (if there's something to tell)
+void toneMonStatus(void);
+
 //! play a tone
 /*!
     \note This is non-blocking and returns immediately, while the tone might still be playing. Use
@@ -54,7 +61,8 @@ bool toneIsPlaying(void);
 //! play a melody given a series of frequency-duration pairs
 /*!
     \note This is non-blocking and returns immediately. It stopy any currently playing tone or
-    melody.
+    melody. The list is read while playing, so it must remain valid (e.g. a static const).
+    Melodies can be of any length.
 
     \param[in] pkFreqDur  list of pairs of tone frequency and duration
 
@@ -66,6 +74,15 @@ toneMelody(pkFreqDur);
 */
 void toneMelody(const int16_t *pkFreqDur);
 
+//! play a melody after the currently playing melodies (or now, if nothing is playing)
+/*!
+    Like toneMelody(), but without stopping what is playing. A few melodies can be queued, more are
+    dropped.
+
+    \param[in] pkFreqDur  list of pairs of tone frequency and duration (must remain valid)
+*/
+void toneMelodyQueue(const int16_t *pkFreqDur);
+
 //! play melody given a name of a melody
 /*!
     \param[in] name  name of the melody (see rtttl.c for available names)
@@ -75,6 +92,9 @@ void toneBuiltinMelody(const char *name);
 //! play a random melody
 void toneBuiltinMelodyRandom(void);
 
+//! buffer size for RTTTL melodies (longer ones are truncated)
+#define TONE_RTTTL_MAX 512
+
 //! play melody in RTTTL format
 /*!
     \param[in] rtttl  string with melody in RTTTL format (see rtttl.c, https://en.wikipedia.org/wiki/Ring_Tone_Transfer_Language)
@@ -0,0 +1,86 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: trace events (see \ref FF_TRACE)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+*/
+
+#include "stdinc.h"
+#include <xtensa_ops.h>
+#include <xtensa_interrupts.h>
+
+#include "stuff.h"
+#include "debug.h"
+#include "trace.h"
+
+#if (defined FF_TRACE) && (FF_TRACE > 0)
+
+#define TRACE_RING_SIZE 256 // must be a power of 2
+
+typedef struct TRACE_REC_s
+{
+    uint32_t ts;  // CPU cycle counter
+    uint16_t arg;
+    uint8_t  ev;
+    uint8_t  task; // task number (see uxTaskGetTaskNumber())
+} TRACE_REC_t;
+
+static TRACE_REC_t sTraceRing[TRACE_RING_SIZE];
+static volatile uint32_t svTraceNum; // total number of events recorded
+static volatile bool svTracePause;   // while dumping
+
+IRAM void traceEvent(const TRACE_EV_t ev, const uint32_t arg)
+{
+    if (svTracePause)
+    {
+        return;
+    }
+    uint32_t ccount;
+    RSR(ccount, ccount);
+    const UBaseType_t task = uxTaskGetTaskNumber(xTaskGetCurrentTaskHandle());
+    // no locking, only claim the slot with the interrupts (i.e. also task switches) masked
+    const uint32_t ps = _xt_disable_interrupts();
+    TRACE_REC_t *pRec = &sTraceRing[ svTraceNum++ & (TRACE_RING_SIZE - 1) ];
+    pRec->ts   = ccount;
+    pRec->arg  = arg < 0xffff ? arg : 0xffff;
+    pRec->ev   = ev;
+    pRec->task = task < 0xff ? task : 0xff;
+    _xt_restore_interrupts(ps);
+}
+
+// the dump is DEBUG() lines (see tools/debug.pl), but far more than fit the debug output buffer, so
+// print them with the blocking output, which waits for the UART to drain instead of dropping lines
+#define TRACE_PRINT(fmt, ...) do { if (DEBUG_LEVEL >= DEBUG_LEVEL_DEBUG) { debugLockBlocking(); \
+            printf("D: trace: " fmt "\n", ## __VA_ARGS__); debugUnlock(); } } while (0)
+
+void traceDump(void)
+{
+    svTracePause = true;
+    const uint32_t num = svTraceNum;
+    const uint32_t n = MIN(num, TRACE_RING_SIZE);
+    TRACE_PRINT("start n=%u total=%u mhz=%u", n, num, sdk_system_get_cpu_freq());
+    for (uint32_t ix = num - n; ix < num; ix++)
+    {
+        const TRACE_REC_t *pkRec = &sTraceRing[ ix & (TRACE_RING_SIZE - 1) ];
+        TRACE_PRINT("%08x %u %u %u", pkRec->ts, pkRec->ev, pkRec->arg, pkRec->task);
+    }
+    TRACE_PRINT("end");
+    svTraceNum = 0;
+    svTracePause = false;
+}
+
+#else // (FF_TRACE > 0)
+
+void traceEvent(const TRACE_EV_t ev, const uint32_t arg)
+{
+}
+
+void traceDump(void)
+{
+    WARNING("trace: not compiled in (make ... TRACE=1)");
+}
+
+#endif // (FF_TRACE > 0)
+
+// eof
@@ -0,0 +1,58 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: trace events (see \ref FF_TRACE)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \defgroup FF_TRACE TRACE
+    \ingroup FF
+
+    This records events (CPU cycle counter timestamp, event ID, argument and task number) along the
+    path from receiving data from the backend to the LEDs into a fixed-size ring buffer. The "trace"
+    backend command dumps it, and tools/debug.pl (with the "trace" option) shows it as a timeline,
+    and per task (with the names from the "mon: tsk:" lines, see mon.c).
+
+    Trace events are only compiled in with "make ... TRACE=1" (which defines FF_TRACE).
+
+    @{
+*/
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "stdinc.h"
+
+//! trace events (keep in sync with tools/debug.pl)
+typedef enum TRACE_EV_e
+{
+    TRACE_EV_NONE = 0,       //!< (unused)
+    TRACE_EV_WIFI_RECV,      //!< wifi: data from backend received (arg: number of bytes)
+    TRACE_EV_BACKEND_LINE,   //!< backend: line dispatched (arg: line length)
+    TRACE_EV_JENKINS_SET,    //!< jenkins: jenkinsSetInfo() (arg: channel)
+    TRACE_EV_JENKINS_UPDATE, //!< jenkins: channel updated by sJenkinsUpdate() (arg: channel)
+    TRACE_EV_LEDS_STATE,     //!< leds: ledsSetState() (arg: LED state index)
+    TRACE_EV_LEDS_FRAME,     //!< leds: frame rendered (arg: number of rendered channels)
+    TRACE_EV_LEDS_FLUSH,     //!< leds: data sent to the LEDs (arg: number of bytes)
+} TRACE_EV_t;
+
+#if (defined FF_TRACE) && (FF_TRACE > 0)
+//! record trace event \hideinitializer
+#  define TRACE(ev, arg) traceEvent(ev, arg)
+#else
+#  define TRACE(ev, arg) do { } while (0)
+#endif
+
+//! record trace event (use the TRACE() macro)
+/*!
+    \param[in] ev   the event
+    \param[in] arg  argument (saturated to 16 bits)
+*/
+void traceEvent(const TRACE_EV_t ev, const uint32_t arg);
+
+//! print (and clear) the recorded events
+void traceDump(void);
+
+
+#endif // __TRACE_H__
+//@}
+// eof
@@ -4,14 +4,15 @@
 
     - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
       https://oinkzwurgl.org/projaeggd/tschenggins-laempli
-
-    \todo SSL connection using mbedtls, see examples/http_get_bearssl
 */
 
 #include "stdinc.h"
 
 #include <lwip/api.h>
 #include <lwip/netif.h>
+#include <lwip/dns.h>
+#include <esp/hwrand.h>
+#include <dhcpserver.h>
 
 #include "jsmn.h"
 
@@ -21,19 +22,108 @@
 #include "status.h"
 #include "backend.h"
 #include "jenkins.h"
+#include "config.h"
+#include "flash.h"
+#include "mon.h"
+#include "stacks.h"
+#include "trace.h"
+#include "http.h"
+#include "ota.h"
+#include "relay.h"
+#include "mqtt.h"
 #include "cfg_gen.h"
 #include "version_gen.h"
 
+// defaults for the wifi and backend config (see sWifiCredLoad() and wifiProvision())
 #if (!defined FF_CFG_STASSID || !defined FF_CFG_STAPASS || !defined FF_CFG_BACKENDURL)
-#  define HAVE_CONFIG 0
-#  warning incomplete or missing configuration
+#  warning incomplete or missing configuration, the device needs provisioning
+#  undef FF_CFG_STASSID
+#  undef FF_CFG_STAPASS
+#  undef FF_CFG_BACKENDURL
+#  define FF_CFG_STASSID    ""
+#  define FF_CFG_STAPASS    ""
+#  define FF_CFG_BACKENDURL ""
+#endif
+
+#if (!LWIP_SO_RCVTIMEO)
+#  error We need LWIP_SO_RCVTIMEO!
+#endif
+
+// https backend (needs the SHA-256 fingerprint of the server certificate to pin it)
+#if defined(FF_CFG_BACKENDFPR)
+#  define HAVE_TLS 1
+#  include <bearssl.h>
 #else
-#  define HAVE_CONFIG 1
+#  define HAVE_TLS 0
 #endif
 
-/* ********************************************************************************************** */
+// status from an MQTT broker instead of the backend's realtime stream (see mqtt.h)
+#if defined(FF_MQTT) && (FF_MQTT > 0)
+#  define HAVE_MQTT 1
+#else
+#  define HAVE_MQTT 0
+#endif
+
+/* ***** power saving *************************************************************************** */
+
+// In modem sleep the radio is only switched on to receive the DTIM beacons from the AP (and the
+// buffered frames announced in them) and to transmit. Light sleep additionally suspends the CPU
+// when nothing is scheduled for a while. Both are handled by the SDK. We can only estimate the
+// radio-active time from the number of transmit and receive events.
+
+#define WIFI_RADIO_DTIM_DUTY  30 // [1/1000] radio on for ~3ms per DTIM beacon (~102ms with DTIM 1)
+#define WIFI_RADIO_EVENT_MS   30 // [ms] radio on for a transmit or receive exchange
+
+static CONFIG_POWER_t sWifiPower;         // power mode in use
+static uint32_t sWifiRadioMs;             // estimated radio-active time [ms]
+static uint32_t sWifiRadioTs;             // last update of the estimate
+static volatile uint32_t svWifiRadioEvents; // number of transmit and receive events since the last update
+
+static void sWifiRadioUpdate(void)
+{
+    const uint32_t now = osTime();
+    const uint32_t dt = now - sWifiRadioTs;
+    sWifiRadioTs = now;
+    const uint32_t nEvents = svWifiRadioEvents;
+    svWifiRadioEvents = 0;
+    if ( (sWifiPower == CONFIG_POWER_NONE) || (sdk_wifi_station_get_connect_status() != STATION_GOT_IP) )
+    {
+        sWifiRadioMs += dt;
+    }
+    else
+    {
+        const uint32_t radioMs = ((dt * WIFI_RADIO_DTIM_DUTY) / 1000) + (nEvents * WIFI_RADIO_EVENT_MS);
+        sWifiRadioMs += MIN(radioMs, dt);
+    }
+}
+
+// apply the configured power mode (if it has changed)
+static void sWifiSetPower(void)
+{
+    const CONFIG_POWER_t power = configGetPower();
+    if (power == sWifiPower)
+    {
+        return;
+    }
+    sWifiRadioUpdate();
+
+    enum sdk_sleep_type type = WIFI_SLEEP_MODEM;
+    switch (power)
+    {
+        case CONFIG_POWER_NONE:    type = WIFI_SLEEP_NONE;  break;
+        case CONFIG_POWER_LIGHT:   type = WIFI_SLEEP_LIGHT; break;
+        case CONFIG_POWER_MODEM:
+        case CONFIG_POWER_UNKNOWN: type = WIFI_SLEEP_MODEM; break;
+    }
+    DEBUG("wifi: power %s (%s)", configPowerStr(power), sdkWifiSleepTypeStr(type));
+    if (!sdk_wifi_set_sleep_type(type))
+    {
+        ERROR("wifi: sdk_wifi_set_sleep_type(%s) fail!", sdkWifiSleepTypeStr(type));
+    }
+    sWifiPower = power;
+}
 
-#if (HAVE_CONFIG > 0)
+/* ********************************************************************************************** */
 
 // the state of the wifi (network) connection
 typedef enum WIFI_STATE_e
@@ -41,7 +131,9 @@ typedef enum WIFI_STATE_e
     WIFI_STATE_OFFLINE = 0, // offline --> wait for station connect
     WIFI_STATE_ONLINE,      // station online --> connect to backend
     WIFI_STATE_CONNECTED,   // backend connected
+    WIFI_STATE_RELAYED,     // listening to a LAN relay (see relay.h) instead
     WIFI_STATE_FAIL,        // failure (e.g. connection lost) --> initialise
+    WIFI_STATE_PROVISION,   // no config, or requested --> access point for provisioning
 } WIFI_STATE_t;
 
 static const char *sWifiStateStr(const WIFI_STATE_t state)
@@ -51,36 +143,260 @@ static const char *sWifiStateStr(const WIFI_STATE_t state)
         case WIFI_STATE_OFFLINE:    return "OFFLINE";
         case WIFI_STATE_ONLINE:     return "ONLINE";
         case WIFI_STATE_CONNECTED:  return "CONNECTED";
+        case WIFI_STATE_RELAYED:    return "RELAYED";
         case WIFI_STATE_FAIL:       return "FAIL";
+        case WIFI_STATE_PROVISION:  return "PROVISION";
     }
     return "???";
 }
 
-// query parameters for the backend
-#define BACKEND_QUERY "cmd=realtime;ascii=1;client=%s;name=%s;stassid="FF_CFG_STASSID";staip="IPSTR";version="FF_BUILDVER";maxch="STRINGIFY(JENKINS_MAX_CH)
-
-// wifi (network) state data
-typedef struct WIFI_DATA_s
+// last AP and IP config, for the fast connect (stored in flash, see sWifiFastSave())
+typedef struct WIFI_FAST_s
 {
-    char            url[ (2 * sizeof(FF_CFG_BACKENDURL)) + (2 * sizeof(BACKEND_QUERY)) ];
+    uint32_t        ssidCrc;      // CRC32 of the SSID (the data is invalid if that has changed)
+    uint8_t         bssid[6];
+    uint8_t         channel;
+    uint8_t         res;
+    uint32_t        ip;           // last DHCP lease (0 for static IP config, see FF_CFG_STAIP)
+    uint32_t        netmask;
+    uint32_t        gw;
+    uint32_t        dns;
+} WIFI_FAST_t;
+
+// backend (the config has a space-separated list of URLs, see sWifiParseBackends())
+#define WIFI_BACKENDS_MAX 3
+
+typedef struct WIFI_BACKEND_s
+{
+    char            url[ (2 * WIFI_URL_MAX) + 8 ]; // decomposed backend URL
     const char     *host;
     const char     *path;
-    const char     *query;
     const char     *auth;
     bool            https;
     uint16_t        port;
     ip_addr_t       hostIp;
+    uint32_t        hostIpTs;     // time of the DNS lookup of hostIp, 0 if we don't know it
+    bool            cachedIp;     // connecting with the hostIp we already knew
+    uint32_t        connectTime;  // [ms] smoothed time from connecting until the hello, 0 if we don't know yet
+    uint16_t        fails;        // consecutive failures
+    bool            roundFail;    // failed in this round (see sWifiConnectBackend())
+    uint32_t        nOkay;
+    uint32_t        nFail;
+    struct netconn *conn;         // connection being made (see sWifiConnectHedged())
+    volatile int8_t svConnState;  // 0 = connecting, 1 = connected, -1 = failed (see sWifiConnCb())
+} WIFI_BACKEND_t;
+
+// preferred backend (stored in flash, see sWifiBackendOkay())
+typedef struct WIFI_BACKEND_PREF_s
+{
+    uint32_t        urlCrc;       // CRC32 of the backend URLs (the data is invalid if they have changed)
+    uint8_t         ix;           // index into the list
+    uint8_t         res[3];
+} WIFI_BACKEND_PREF_t;
+
+// wifi (network) state data
+typedef struct WIFI_DATA_s
+{
+    WIFI_BACKEND_t  backends[WIFI_BACKENDS_MAX];
+    int             nBackends;
+    bool            haveBackends; // backends[] initialised (see sWifiParseBackends())
+    WIFI_BACKEND_t *pBackend;     // current (or preferred) backend
+    SemaphoreHandle_t connSem;    // given by sWifiConnCb()
+    uint32_t        nHedged;      // connects where we tried another backend in parallel
+    uint32_t        nFailover;    // connects to another backend than the first choice
+    uint32_t        connectTime;  // [ms] last time from connecting to the backend until its hello
+    uint32_t        nFastConnect; // connects with cached URL and address
+    uint32_t        nFullConnect; // connects with DNS lookup
     ip_addr_t       staIp;
     char            staName[32];
+    WIFI_FAST_t     fast;         // last AP and IP config
+    bool            haveFast;     // fast is valid
+    bool            fastPending;  // we're trying to connect with that
+    uint32_t        nFastAssoc;   // station connects using the last AP and IP config
+    uint32_t        nFullAssoc;   // station connects with scan and DHCP
+    uint32_t        offlineTs;    // since when the station is offline (0 if it's online, see sWifiTask())
+    uint32_t        nProvision;   // provisioning mode entered
+    uint32_t        nDnsQueries;  // DNS queries answered in the provisioning mode
     struct netconn *conn;
+    struct netbuf  *recvBuf; // current netbuf (see sWifiTcpRecv())
+    HTTP_CLIENT_t   http;    // HTTP client on top of conn (see sWifiWrite() and sWifiRecv())
 } WIFI_DATA_t;
 
 // -------------------------------------------------------------------------------------------------
 
 static WIFI_STATE_t sWifiState;
 static WIFI_DATA_t sWifiData;
+static volatile uint32_t svWifiWakeups; // number of times the wifi task woke up from waiting for data
+static volatile bool svWifiReconnect; // reconnect requested (see wifiReconnect())
+static volatile bool svWifiProvisioned; // new config stored (see wifiProvision())
+static volatile bool svWifiProvRequest; // provisioning mode requested (see wifiStartProvisioning())
+
+// wifi and backend config: the defaults from the config file, or the provisioned one (see wifiProvision())
+typedef struct WIFI_CRED_s
+{
+    char            ssid[WIFI_SSID_MAX + 1];
+    char            pass[WIFI_PASS_MAX + 1];
+    char            urls[WIFI_URLS_MAX + 1];
+} WIFI_CRED_t;
+
+static WIFI_CRED_t sWifiCred;
 
 #define WIFI_CONNECT_TIMEOUT 30
+#define WIFI_DNS_MAX_AGE 3600 // [s] (netconn_gethostbyname() doesn't tell us the TTL)
+#define WIFI_HELLO_TIMEOUT 5000 // [ms]
+#define WIFI_OTA_TIMEOUT 180000 // [ms] for the whole firmware image (see sWifiUpdate())
+#define WIFI_FAST_TIMEOUT 3000 // [ms] give up fast connect (and do a normal one) after this
+#define WIFI_FAST_KEY "wififast" // flash key-value store key for WIFI_FAST_t
+#define WIFI_HEDGE_DELAY 1500 // [ms] start connecting to the next backend if the first one doesn't connect within this
+#define WIFI_CONNECT_MAX 10000 // [ms] give up connecting (to any backend)
+#define WIFI_BACKEND_FAIL_PENALTY 10000 // [ms] per consecutive failure, for the backend order (see sWifiBackendOrder())
+#define WIFI_BACKEND_KEY "wifibe" // flash key-value store key for WIFI_BACKEND_PREF_t
+#define WIFI_DNS_PORT 53
+#define WIFI_DNS_TTL 10 // [s] for the answers of the DNS responder in the provisioning mode
+#define WIFI_PROV_LEASES 4 // clients of the access point in the provisioning mode
+#define WIFI_PROV_LINGER 2000 // [ms] keep the access point up for this long after the config has been stored
+
+// -------------------------------------------------------------------------------------------------
+
+// the config from flash, or the defaults
+static void sWifiCredLoad(void)
+{
+    if (flashSnapLoad(FLASH_SNAP_WIFI, &sWifiCred, sizeof(sWifiCred)))
+    {
+        sWifiCred.ssid[WIFI_SSID_MAX] = '\0';
+        sWifiCred.pass[WIFI_PASS_MAX] = '\0';
+        sWifiCred.urls[WIFI_URLS_MAX] = '\0';
+        DEBUG("wifi: provisioned config (ssid=%s)", sWifiCred.ssid);
+        return;
+    }
+    memset(&sWifiCred, 0, sizeof(sWifiCred));
+    if ( (strlen(FF_CFG_STASSID) > WIFI_SSID_MAX) || (strlen(FF_CFG_STAPASS) > WIFI_PASS_MAX) ||
+         (strlen(FF_CFG_BACKENDURL) > WIFI_URLS_MAX) )
+    {
+        ERROR("wifi: STASSID, STAPASS or BACKENDURL too long!");
+        return;
+    }
+    strcpy(sWifiCred.ssid, FF_CFG_STASSID);
+    strcpy(sWifiCred.pass, FF_CFG_STAPASS);
+    strcpy(sWifiCred.urls, FF_CFG_BACKENDURL);
+}
+
+static bool sWifiHaveCred(void)
+{
+    return (sWifiCred.ssid[0] != '\0') && (sWifiCred.urls[0] != '\0');
+}
+
+// -------------------------------------------------------------------------------------------------
+
+// A normal connect scans all channels for the AP and then waits for DHCP, which takes several
+// seconds. Instead we first try the last AP (BSSID, channel) and IP config (last DHCP lease or
+// static IP config). If that doesn't work quickly we fall back to a normal connect.
+
+static bool sWifiFastLoad(void)
+{
+    const uint32_t ssidCrc = flashCrc32(0, sWifiCred.ssid, strlen(sWifiCred.ssid));
+    if ( (flashKvGet(WIFI_FAST_KEY, &sWifiData.fast, sizeof(sWifiData.fast)) != sizeof(sWifiData.fast)) ||
+         (sWifiData.fast.ssidCrc != ssidCrc) || (sWifiData.fast.channel < 1) || (sWifiData.fast.channel > 14) )
+    {
+        memset(&sWifiData.fast, 0, sizeof(sWifiData.fast));
+        return false;
+    }
+    return true;
+}
+
+static void sWifiFastSave(const struct ip_info *pkIpinfo)
+{
+    // the SDK fills in the BSSID of the AP we're connected to
+    struct sdk_station_config config;
+    if (!sdk_wifi_station_get_config(&config))
+    {
+        return;
+    }
+    WIFI_FAST_t fast;
+    memset(&fast, 0, sizeof(fast));
+    fast.ssidCrc = flashCrc32(0, sWifiCred.ssid, strlen(sWifiCred.ssid));
+    memcpy(fast.bssid, config.bssid, sizeof(fast.bssid));
+    fast.channel = sdk_wifi_get_channel();
+#ifndef FF_CFG_STAIP
+    const ip_addr_t *pkDns = dns_getserver(0);
+    fast.ip      = pkIpinfo->ip.addr;
+    fast.netmask = pkIpinfo->netmask.addr;
+    fast.gw      = pkIpinfo->gw.addr;
+    fast.dns     = pkDns != NULL ? pkDns->addr : 0;
+#endif
+    static const uint8_t skNoBssid[6];
+    if ( (memcmp(fast.bssid, skNoBssid, sizeof(fast.bssid)) == 0) || (fast.channel < 1) || (fast.channel > 14) )
+    {
+        return;
+    }
+    // (this does nothing if the data hasn't changed)
+    if (flashKvSet(WIFI_FAST_KEY, &fast, sizeof(fast)))
+    {
+        sWifiData.fast = fast;
+        sWifiData.haveFast = true;
+    }
+}
+
+// configure station, for a fast or a normal connect
+static void sWifiStationConfig(const bool fast)
+{
+    struct sdk_station_config config;
+    memset(&config, 0, sizeof(config));
+    strncpy((char *)config.ssid, sWifiCred.ssid, sizeof(config.ssid));
+    strncpy((char *)config.password, sWifiCred.pass, sizeof(config.password));
+    if (fast)
+    {
+        config.bssid_set = true;
+        memcpy(config.bssid, sWifiData.fast.bssid, sizeof(config.bssid));
+        sdk_wifi_set_channel(sWifiData.fast.channel);
+    }
+    sdk_wifi_station_set_config(&config);
+
+    // IP config: static, last DHCP lease, or DHCP
+    struct ip_info ipinfo;
+    ip_addr_t dns;
+    memset(&ipinfo, 0, sizeof(ipinfo));
+    memset(&dns, 0, sizeof(dns));
+#ifdef FF_CFG_STAIP
+    ip4addr_aton(FF_CFG_STAIP,   &ipinfo.ip);
+    ip4addr_aton(FF_CFG_STAMASK, &ipinfo.netmask);
+    ip4addr_aton(FF_CFG_STAGW,   &ipinfo.gw);
+#  ifdef FF_CFG_STADNS
+    ipaddr_aton(FF_CFG_STADNS, &dns);
+#  else
+    ipaddr_aton(FF_CFG_STAGW, &dns);
+#  endif
+#else
+    if (fast)
+    {
+        ipinfo.ip.addr      = sWifiData.fast.ip;
+        ipinfo.netmask.addr = sWifiData.fast.netmask;
+        ipinfo.gw.addr      = sWifiData.fast.gw;
+        dns.addr            = sWifiData.fast.dns;
+    }
+#endif
+    if (ipinfo.ip.addr != 0)
+    {
+        DEBUG("wifi: %s connect ip="IPSTR" mask="IPSTR" gw="IPSTR, fast ? "fast" : "normal",
+            IP2STR(&ipinfo.ip), IP2STR(&ipinfo.netmask), IP2STR(&ipinfo.gw));
+        sdk_wifi_station_dhcpc_stop();
+        sdk_wifi_set_ip_info(STATION_IF, &ipinfo);
+        if (dns.addr != 0)
+        {
+            dns_setserver(0, &dns);
+        }
+    }
+    else
+    {
+        DEBUG("wifi: %s connect (DHCP)", fast ? "fast" : "normal");
+        if (sdk_wifi_station_dhcpc_status() == DHCP_STOPPED)
+        {
+            sdk_wifi_station_dhcpc_start();
+        }
+    }
+
+    sWifiData.fastPending = fast;
+}
 
 // wait for wifi station connect
 static bool sWifiWaitConnect(void)
@@ -93,6 +409,15 @@ static bool sWifiWaitConnect(void)
     int n = 0;
     while (osTime() < timeout)
     {
+        // fast connect didn't work (AP has changed, lease has expired, ...) --> normal connect
+        if ( sWifiData.fastPending && ((osTime() - now) > WIFI_FAST_TIMEOUT) )
+        {
+            WARNING("wifi: fast connect failed");
+            sdk_wifi_station_disconnect();
+            sWifiStationConfig(false);
+            sdk_wifi_station_connect();
+        }
+
         const uint8_t status = sdk_wifi_station_get_connect_status();
         struct ip_info ipinfo;
         sdk_wifi_get_ip_info(STATION_IF, &ipinfo);
@@ -118,266 +443,1416 @@ static bool sWifiWaitConnect(void)
             }
             lastStatus = status;
         }
-        if ( (status == STATION_GOT_IP) && (ipinfo.ip.addr != 0) )
+        if ( (status == STATION_GOT_IP) && (ipinfo.ip.addr != 0) )
+        {
+            sWifiData.staIp = ipinfo.ip;
+            connected = true;
+            PRINT("wifi: online after %.3fs (%s)", (double)(osTime() - now) * 1e-3,
+                sWifiData.fastPending ? "fast" : "normal");
+            // remember AP and IP config for the next time
+            if (sWifiData.fastPending)
+            {
+                sWifiData.nFastAssoc++;
+            }
+            else
+            {
+                sWifiData.nFullAssoc++;
+                sWifiFastSave(&ipinfo);
+            }
+            break;
+        }
+        osSleep(100);
+        n++;
+    }
+
+    return connected;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+// receive next chunk of data from the TCP connection (valid until the next call)
+static err_t sWifiTcpRecv(const int32_t timeout, char **ppData, int *pLen)
+{
+    // next fragment of the current netbuf, or wait for the next netbuf
+    if ( (sWifiData.recvBuf != NULL) && (netbuf_next(sWifiData.recvBuf) < 0) )
+    {
+        netbuf_free(sWifiData.recvBuf);
+        netbuf_delete(sWifiData.recvBuf);
+        sWifiData.recvBuf = NULL;
+    }
+    if (sWifiData.recvBuf == NULL)
+    {
+        netconn_set_recvtimeout(sWifiData.conn, timeout > 0 ? timeout : 1);
+        const err_t errRecv = netconn_recv(sWifiData.conn, &sWifiData.recvBuf);
+        svWifiWakeups++;
+        if (errRecv != ERR_OK)
+        {
+            sWifiData.recvBuf = NULL;
+            return errRecv;
+        }
+        svWifiRadioEvents++;
+    }
+
+    void *data;
+    uint16_t len;
+    const err_t errData = netbuf_data(sWifiData.recvBuf, &data, &len);
+    if (errData != ERR_OK)
+    {
+        ERROR("wifi: netbuf_data() failed: %s", lwipErrStr(errData));
+        return errData;
+    }
+    *ppData = (char *)data;
+    *pLen = len;
+    return ERR_OK;
+}
+
+#if (HAVE_TLS > 0)
+
+// TLS on top of the TCP connection, using BearSSL with one static (half-duplex) record buffer, only a
+// few cipher suites, and the server certificate pinned (no CA, no expiry check, so we don't need the
+// time). The session parameters are kept to resume the session on the next connection, which saves
+// the expensive part of the handshake.
+typedef struct WIFI_TLS_X509_s
+{
+    const br_x509_class    *vtable;
+    br_x509_decoder_context decoder;
+    br_sha256_context       sha;
+    int                     numCerts;
+    bool                    pinned;
+} WIFI_TLS_X509_t;
+
+typedef struct WIFI_TLS_s
+{
+    br_ssl_client_context     cc;
+    WIFI_TLS_X509_t           x509;
+    br_ssl_session_parameters session;
+    bool                      haveSession;
+    uint8_t                   fpr[32];
+    int                       appLen;   // application data handed out by sWifiTlsRecv()
+    char                     *rawData;  // received, but not yet consumed TCP data
+    int                       rawLen;
+    uint32_t                  nFull;
+    uint32_t                  nResumed;
+    uint32_t                  tHandshake;
+} WIFI_TLS_t;
+
+static WIFI_TLS_t sWifiTls;
+static uint8_t sWifiTlsBuf[BR_SSL_BUFSIZE_MONO];
+
+#define WIFI_TLS_HANDSHAKE_TIMEOUT 15000 // [ms]
+
+static const uint16_t skWifiTlsSuites[] =
+{
+    BR_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    BR_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    BR_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+    BR_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+    BR_TLS_RSA_WITH_AES_128_GCM_SHA256,
+};
+
+// X.509 "validation": the first certificate of the chain must be the pinned one
+static void sWifiX509StartChain(const br_x509_class **ctx, const char *serverName)
+{
+    WIFI_TLS_X509_t *pX509 = (WIFI_TLS_X509_t *)ctx;
+    UNUSED(serverName);
+    pX509->numCerts = 0;
+    pX509->pinned = false;
+}
+
+static void sWifiX509StartCert(const br_x509_class **ctx, uint32_t length)
+{
+    WIFI_TLS_X509_t *pX509 = (WIFI_TLS_X509_t *)ctx;
+    UNUSED(length);
+    if (pX509->numCerts == 0)
+    {
+        br_sha256_init(&pX509->sha);
+        br_x509_decoder_init(&pX509->decoder, NULL, NULL);
+    }
+}
+
+static void sWifiX509Append(const br_x509_class **ctx, const unsigned char *buf, size_t len)
+{
+    WIFI_TLS_X509_t *pX509 = (WIFI_TLS_X509_t *)ctx;
+    if (pX509->numCerts == 0)
+    {
+        br_sha256_update(&pX509->sha, buf, len);
+        br_x509_decoder_push(&pX509->decoder, buf, len);
+    }
+}
+
+static void sWifiX509EndCert(const br_x509_class **ctx)
+{
+    WIFI_TLS_X509_t *pX509 = (WIFI_TLS_X509_t *)ctx;
+    if (pX509->numCerts == 0)
+    {
+        uint8_t fpr[sizeof(sWifiTls.fpr)];
+        br_sha256_out(&pX509->sha, fpr);
+        pX509->pinned = memcmp(fpr, sWifiTls.fpr, sizeof(fpr)) == 0;
+    }
+    pX509->numCerts++;
+}
+
+static unsigned sWifiX509EndChain(const br_x509_class **ctx)
+{
+    WIFI_TLS_X509_t *pX509 = (WIFI_TLS_X509_t *)ctx;
+    if (pX509->numCerts < 1)
+    {
+        return BR_ERR_X509_EMPTY_CHAIN;
+    }
+    else if (br_x509_decoder_last_error(&pX509->decoder) != 0)
+    {
+        return br_x509_decoder_last_error(&pX509->decoder);
+    }
+    else if (!pX509->pinned)
+    {
+        ERROR("wifi: tls: certificate fingerprint mismatch");
+        return BR_ERR_X509_NOT_TRUSTED;
+    }
+    return 0;
+}
+
+static const br_x509_pkey *sWifiX509GetPkey(const br_x509_class *const *ctx, unsigned *usages)
+{
+    WIFI_TLS_X509_t *pX509 = (WIFI_TLS_X509_t *)ctx;
+    if (usages != NULL)
+    {
+        *usages = BR_KEYTYPE_KEYX | BR_KEYTYPE_SIGN;
+    }
+    return br_x509_decoder_get_pkey(&pX509->decoder);
+}
+
+static const br_x509_class skWifiX509Class =
+{
+    .context_size = sizeof(WIFI_TLS_X509_t),
+    .start_chain  = sWifiX509StartChain,
+    .start_cert   = sWifiX509StartCert,
+    .append       = sWifiX509Append,
+    .end_cert     = sWifiX509EndCert,
+    .end_chain    = sWifiX509EndChain,
+    .get_pkey     = sWifiX509GetPkey,
+};
+
+// setup the TLS client (once)
+static bool sWifiTlsInit(void)
+{
+    // FF_CFG_BACKENDFPR: 64 hex digits, optionally separated by colons (as "openssl x509 -fingerprint -sha256" prints it)
+    static const char skFprStr[] = FF_CFG_BACKENDFPR;
+    int nDigits = 0;
+    for (int ix = 0; (skFprStr[ix] != '\0') && (nDigits < (2 * (int)sizeof(sWifiTls.fpr))); ix++)
+    {
+        const char c = skFprStr[ix];
+        const int val = (c >= '0') && (c <= '9') ? (c - '0') :
+            ( (c >= 'a') && (c <= 'f') ? (c - 'a' + 10) : ( (c >= 'A') && (c <= 'F') ? (c - 'A' + 10) : -1 ) );
+        if (val >= 0)
+        {
+            sWifiTls.fpr[nDigits / 2] = (sWifiTls.fpr[nDigits / 2] << 4) | val;
+            nDigits++;
+        }
+    }
+    if (nDigits != (2 * (int)sizeof(sWifiTls.fpr)))
+    {
+        ERROR("wifi: tls: illegal fingerprint");
+        return false;
+    }
+
+    br_ssl_client_context *pCc = &sWifiTls.cc;
+    br_ssl_client_zero(pCc);
+    br_ssl_engine_set_versions(&pCc->eng, BR_TLS12, BR_TLS12);
+    br_ssl_engine_set_suites(&pCc->eng, skWifiTlsSuites, NUMOF(skWifiTlsSuites));
+    br_ssl_client_set_default_rsapub(pCc);
+    br_ssl_engine_set_default_rsavrfy(&pCc->eng);
+    br_ssl_engine_set_default_ecdsa(&pCc->eng);
+    br_ssl_engine_set_default_ec(&pCc->eng);
+    br_ssl_engine_set_hash(&pCc->eng, br_sha1_ID,   &br_sha1_vtable);
+    br_ssl_engine_set_hash(&pCc->eng, br_sha256_ID, &br_sha256_vtable);
+    br_ssl_engine_set_hash(&pCc->eng, br_sha384_ID, &br_sha384_vtable);
+    br_ssl_engine_set_hash(&pCc->eng, br_sha512_ID, &br_sha512_vtable);
+    br_ssl_engine_set_prf_sha256(&pCc->eng, &br_tls12_sha256_prf);
+    br_ssl_engine_set_default_aes_gcm(&pCc->eng);
+    br_ssl_engine_set_default_chapol(&pCc->eng);
+    sWifiTls.x509.vtable = &skWifiX509Class;
+    br_ssl_engine_set_x509(&pCc->eng, &sWifiTls.x509.vtable);
+    br_ssl_engine_set_buffer(&pCc->eng, sWifiTlsBuf, sizeof(sWifiTlsBuf), 0);
+    return true;
+}
+
+// run the TLS engine until it's ready for the wanted (BR_SSL_SENDAPP, BR_SSL_RECVAPP), sending and
+// receiving records as necessary
+static err_t sWifiTlsRun(const unsigned want, const uint32_t deadline)
+{
+    br_ssl_engine_context *pEng = &sWifiTls.cc.eng;
+    while (true)
+    {
+        const unsigned state = br_ssl_engine_current_state(pEng);
+        if ((state & BR_SSL_CLOSED) != 0)
+        {
+            const int error = br_ssl_engine_last_error(pEng);
+            if (error != BR_ERR_OK)
+            {
+                ERROR("wifi: tls: error %d", error);
+            }
+            return ERR_CLSD;
+        }
+        // send records first
+        if ((state & BR_SSL_SENDREC) != 0)
+        {
+            size_t len;
+            unsigned char *buf = br_ssl_engine_sendrec_buf(pEng, &len);
+            const err_t err = netconn_write(sWifiData.conn, buf, len, NETCONN_COPY);
+            if (err != ERR_OK)
+            {
+                ERROR("wifi: tls: write failed: %s", lwipErrStr(err));
+                return err;
+            }
+            br_ssl_engine_sendrec_ack(pEng, len);
+            continue;
+        }
+        if ((state & want) != 0)
+        {
+            return ERR_OK;
+        }
+        // feed received data to the engine
+        if ((state & BR_SSL_RECVREC) != 0)
+        {
+            if (sWifiTls.rawLen <= 0)
+            {
+                const int32_t timeout = (int32_t)(deadline - osTime());
+                if (timeout <= 0)
+                {
+                    return ERR_TIMEOUT;
+                }
+                const err_t err = sWifiTcpRecv(timeout, &sWifiTls.rawData, &sWifiTls.rawLen);
+                if (err != ERR_OK)
+                {
+                    sWifiTls.rawLen = 0;
+                    return err;
+                }
+            }
+            size_t len;
+            unsigned char *buf = br_ssl_engine_recvrec_buf(pEng, &len);
+            const int n = (int)len < sWifiTls.rawLen ? (int)len : sWifiTls.rawLen;
+            memcpy(buf, sWifiTls.rawData, n);
+            br_ssl_engine_recvrec_ack(pEng, n);
+            sWifiTls.rawData += n;
+            sWifiTls.rawLen -= n;
+            continue;
+        }
+        // engine wants something we can't provide (can't happen)
+        return ERR_VAL;
+    }
+}
+
+// start TLS session (resumes the previous one if the server still knows it)
+static bool sWifiTlsConnect(void)
+{
+    static bool sInitDone;
+    if (!sInitDone)
+    {
+        sInitDone = sWifiTlsInit();
+        if (!sInitDone)
+        {
+            return false;
+        }
+    }
+
+    br_ssl_engine_context *pEng = &sWifiTls.cc.eng;
+    uint8_t seed[32];
+    hwrand_fill(seed, sizeof(seed));
+    br_ssl_engine_inject_entropy(pEng, seed, sizeof(seed));
+    if (sWifiTls.haveSession)
+    {
+        br_ssl_engine_set_session_parameters(pEng, &sWifiTls.session);
+    }
+    if (!br_ssl_client_reset(&sWifiTls.cc, sWifiData.pBackend->host, sWifiTls.haveSession ? 1 : 0))
+    {
+        ERROR("wifi: tls: reset failed: %d", br_ssl_engine_last_error(pEng));
+        return false;
+    }
+    sWifiTls.appLen = 0;
+    sWifiTls.rawLen = 0;
+
+    // handshake
+    const uint32_t t0 = osTime();
+    const err_t err = sWifiTlsRun(BR_SSL_SENDAPP, t0 + WIFI_TLS_HANDSHAKE_TIMEOUT);
+    sWifiTls.tHandshake = osTime() - t0;
+    if (err != ERR_OK)
+    {
+        ERROR("wifi: tls: handshake failed: %s", lwipErrStr(err));
+        sWifiTls.haveSession = false;
+        return false;
+    }
+
+    // same session ID --> the server has resumed the session
+    br_ssl_session_parameters session;
+    br_ssl_engine_get_session_parameters(pEng, &session);
+    const bool resumed = sWifiTls.haveSession && (session.session_id_len > 0) &&
+        (session.session_id_len == sWifiTls.session.session_id_len) &&
+        (memcmp(session.session_id, sWifiTls.session.session_id, session.session_id_len) == 0);
+    if (resumed)
+    {
+        sWifiTls.nResumed++;
+    }
+    else
+    {
+        sWifiTls.nFull++;
+    }
+    sWifiTls.session = session;
+    sWifiTls.haveSession = session.session_id_len > 0;
+    PRINT("wifi: tls: %s handshake in %ums (suite 0x%04x)", resumed ? "resumed" : "full",
+        sWifiTls.tHandshake, session.cipher_suite);
+    return true;
+}
+
+static err_t sWifiTlsWrite(const char *data, const int len, const bool flush)
+{
+    br_ssl_engine_context *pEng = &sWifiTls.cc.eng;
+    const uint32_t deadline = osTime() + WIFI_TLS_HANDSHAKE_TIMEOUT;
+    int offs = 0;
+    while (offs < len)
+    {
+        const err_t err = sWifiTlsRun(BR_SSL_SENDAPP, deadline);
+        if (err != ERR_OK)
+        {
+            return err;
+        }
+        size_t size;
+        unsigned char *buf = br_ssl_engine_sendapp_buf(pEng, &size);
+        const int n = (int)size < (len - offs) ? (int)size : (len - offs);
+        memcpy(buf, &data[offs], n);
+        br_ssl_engine_sendapp_ack(pEng, n);
+        offs += n;
+    }
+    if (!flush)
+    {
+        return ERR_OK;
+    }
+    br_ssl_engine_flush(pEng, 0);
+    return sWifiTlsRun(BR_SSL_SENDAPP, deadline);
+}
+
+// receive next chunk of (decrypted) data (valid until the next call)
+static err_t sWifiTlsRecv(const int32_t timeout, char **ppData, int *pLen)
+{
+    br_ssl_engine_context *pEng = &sWifiTls.cc.eng;
+    if (sWifiTls.appLen > 0)
+    {
+        br_ssl_engine_recvapp_ack(pEng, sWifiTls.appLen);
+        sWifiTls.appLen = 0;
+    }
+    const err_t err = sWifiTlsRun(BR_SSL_RECVAPP, osTime() + (timeout > 0 ? timeout : 1));
+    if (err != ERR_OK)
+    {
+        return err;
+    }
+    size_t len;
+    *ppData = (char *)br_ssl_engine_recvapp_buf(pEng, &len);
+    *pLen = (int)len;
+    sWifiTls.appLen = (int)len;
+    return ERR_OK;
+}
+
+#endif // (HAVE_TLS > 0)
+
+// backend connection transport (TCP or TLS), flags are NETCONN_COPY or NETCONN_NOCOPY and NETCONN_MORE
+// (more data follows, so don't push it out yet)
+static err_t sWifiWrite(const char *data, const int len, const uint8_t flags)
+{
+    svWifiRadioEvents++;
+#if (HAVE_TLS > 0)
+    if (sWifiData.pBackend->https)
+    {
+        return sWifiTlsWrite(data, len, (flags & NETCONN_MORE) == 0);
+    }
+#endif
+    return len > 0 ? netconn_write(sWifiData.conn, data, len, flags) : ERR_OK;
+}
+
+static err_t sWifiRecv(const int32_t timeout, char **ppData, int *pLen)
+{
+#if (HAVE_TLS > 0)
+    if (sWifiData.pBackend->https)
+    {
+        return sWifiTlsRecv(timeout, ppData, pLen);
+    }
+#endif
+    return sWifiTcpRecv(timeout, ppData, pLen);
+}
+
+static void sWifiClose(void)
+{
+    if (sWifiData.recvBuf != NULL)
+    {
+        netbuf_free(sWifiData.recvBuf);
+        netbuf_delete(sWifiData.recvBuf);
+        sWifiData.recvBuf = NULL;
+    }
+    if (sWifiData.conn != NULL)
+    {
+        netconn_close(sWifiData.conn);
+        netconn_delete(sWifiData.conn);
+        sWifiData.conn = NULL;
+    }
+}
+
+// get IP of backend server
+static bool sWifiLookupHost(WIFI_BACKEND_t *pBackend)
+{
+    DEBUG("wifi: DNS lookup %s", pBackend->host);
+    const err_t err = netconn_gethostbyname(pBackend->host, &pBackend->hostIp);
+    if (err != ERR_OK)
+    {
+        ERROR("wifi: DNS query for %s failed: %s",
+            pBackend->host, lwipErrStr(err));
+        pBackend->hostIpTs = 0;
+        return false;
+    }
+    pBackend->hostIpTs = osTime();
+    return true;
+}
+
+// backends, in the order of preference, and the preferred one from flash
+static bool sWifiParseBackends(void)
+{
+    char urls[sizeof(sWifiCred.urls)];
+    strcpy(urls, sWifiCred.urls);
+    char *pSave = NULL;
+    for (char *pUrl = strtok_r(urls, " ", &pSave); pUrl != NULL; pUrl = strtok_r(NULL, " ", &pSave))
+    {
+        if (sWifiData.nBackends >= WIFI_BACKENDS_MAX)
+        {
+            WARNING("wifi: too many backends, ignoring %s", pUrl);
+            break;
+        }
+        if (strlen(pUrl) > WIFI_URL_MAX)
+        {
+            ERROR("wifi: backend url too long, ignoring %s", pUrl);
+            continue;
+        }
+        // the query is ours
+        WIFI_BACKEND_t *pBackend = &sWifiData.backends[sWifiData.nBackends];
+        snprintf(pBackend->url, sizeof(pBackend->url), "%s?", pUrl);
+        const char *query;
+        if (!reqParamsFromUrl(pBackend->url, pBackend->url, sizeof(pBackend->url),
+                &pBackend->host, &pBackend->path, &query, &pBackend->auth, &pBackend->https, &pBackend->port))
+        {
+            ERROR("wifi: fishy backend url %s!", pUrl);
+            continue;
+        }
+#if (HAVE_TLS == 0)
+        if (pBackend->https)
+        {
+            ERROR("wifi: https needs BACKENDFPR in the config!");
+            continue;
+        }
+#endif
+        DEBUG("wifi: backend %d: host=%s path=%s auth=%s https=%s, port=%u", sWifiData.nBackends,
+            pBackend->host, pBackend->path, pBackend->auth, pBackend->https ? "yes" : "no", pBackend->port);
+        sWifiData.nBackends++;
+    }
+    if (sWifiData.nBackends < 1)
+    {
+        return false;
+    }
+
+    WIFI_BACKEND_PREF_t pref;
+    const uint32_t urlCrc = flashCrc32(0, sWifiCred.urls, strlen(sWifiCred.urls));
+    const bool havePref = (flashKvGet(WIFI_BACKEND_KEY, &pref, sizeof(pref)) == sizeof(pref)) &&
+        (pref.urlCrc == urlCrc) && (pref.ix < sWifiData.nBackends);
+    sWifiData.pBackend = &sWifiData.backends[havePref ? pref.ix : 0];
+    DEBUG("wifi: preferred backend %d", havePref ? pref.ix : 0);
+    return true;
+}
+
+// backends that haven't failed in this round, best first: fewest consecutive failures and fastest
+// connect, on a tie the current one, then the order in the config
+static int sWifiBackendOrder(WIFI_BACKEND_t **ppCands)
+{
+    int nCands = 0;
+    for (int ix = 0; ix < sWifiData.nBackends; ix++)
+    {
+        WIFI_BACKEND_t *pBackend = &sWifiData.backends[ix];
+        if (!pBackend->roundFail)
+        {
+            ppCands[nCands++] = pBackend;
+        }
+    }
+    for (int ix = 1; ix < nCands; ix++)
+    {
+        WIFI_BACKEND_t *pBackend = ppCands[ix];
+        const uint32_t score = ((uint32_t)MIN(pBackend->fails, 10) * WIFI_BACKEND_FAIL_PENALTY) + pBackend->connectTime;
+        int pos = ix;
+        while (pos > 0)
+        {
+            const WIFI_BACKEND_t *pkOther = ppCands[pos - 1];
+            const uint32_t otherScore = ((uint32_t)MIN(pkOther->fails, 10) * WIFI_BACKEND_FAIL_PENALTY) + pkOther->connectTime;
+            if ( (score > otherScore) || ((score == otherScore) && (pBackend != sWifiData.pBackend)) )
+            {
+                break;
+            }
+            ppCands[pos] = ppCands[pos - 1];
+            pos--;
+        }
+        ppCands[pos] = pBackend;
+    }
+    return nCands;
+}
+
+static void sWifiBackendFailed(WIFI_BACKEND_t *pBackend)
+{
+    pBackend->roundFail = true;
+    pBackend->fails++;
+    pBackend->nFail++;
+}
+
+static void sWifiBackendOkay(WIFI_BACKEND_t *pBackend, const uint32_t connectTime)
+{
+    pBackend->fails = 0;
+    pBackend->nOkay++;
+    pBackend->connectTime = pBackend->connectTime != 0 ? ((3 * pBackend->connectTime) + connectTime) / 4 : connectTime;
+
+    // remember it for the next boot (this does nothing if it hasn't changed)
+    WIFI_BACKEND_PREF_t pref;
+    memset(&pref, 0, sizeof(pref));
+    pref.urlCrc = flashCrc32(0, sWifiCred.urls, strlen(sWifiCred.urls));
+    pref.ix = pBackend - sWifiData.backends;
+    flashKvSet(WIFI_BACKEND_KEY, &pref, sizeof(pref));
+}
+
+// connect events (in the tcpip thread): the first one tells if the connection is up, or has failed
+static void sWifiConnCb(struct netconn *conn, enum netconn_evt evt, uint16_t len)
+{
+    UNUSED(len);
+    for (int ix = 0; ix < sWifiData.nBackends; ix++)
+    {
+        WIFI_BACKEND_t *pBackend = &sWifiData.backends[ix];
+        if ( (conn == NULL) || (pBackend->conn != conn) || (pBackend->svConnState != 0) )
+        {
+            continue;
+        }
+        switch (evt)
+        {
+            case NETCONN_EVT_SENDPLUS:
+                pBackend->svConnState = 1;
+                xSemaphoreGive(sWifiData.connSem);
+                break;
+            case NETCONN_EVT_RCVPLUS:
+            case NETCONN_EVT_ERROR:
+                pBackend->svConnState = -1;
+                xSemaphoreGive(sWifiData.connSem);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// start connecting to backend server (non-blocking)
+static bool sWifiConnectStart(WIFI_BACKEND_t *pBackend, const bool lookup)
+{
+    // use the backend address we already know (fast), unless it's outdated
+    const uint32_t now = osTime();
+    pBackend->cachedIp = !lookup && (pBackend->hostIpTs != 0) && ((now - pBackend->hostIpTs) < (1000 * WIFI_DNS_MAX_AGE));
+    if (!pBackend->cachedIp && !sWifiLookupHost(pBackend))
+    {
+        return false;
+    }
+
+    pBackend->svConnState = 0;
+    pBackend->conn = netconn_new_with_callback(NETCONN_TCP, sWifiConnCb);
+    if (pBackend->conn == NULL)
+    {
+        ERROR("wifi: netconn_new() fail");
+        return false;
+    }
+    netconn_set_nonblocking(pBackend->conn, true);
+    DEBUG("wifi: connect %s "IPSTR":%u", pBackend->host, IP2STR(&pBackend->hostIp), pBackend->port);
+    const err_t err = netconn_connect(pBackend->conn, &pBackend->hostIp, pBackend->port);
+    if (err == ERR_OK)
+    {
+        pBackend->svConnState = 1;
+        xSemaphoreGive(sWifiData.connSem);
+    }
+    else if (err != ERR_INPROGRESS)
+    {
+        ERROR("wifi: connect to "IPSTR":%u failed: %s",
+            IP2STR(&pBackend->hostIp), pBackend->port, lwipErrStr(err));
+        netconn_delete(pBackend->conn);
+        pBackend->conn = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void sWifiConnectAbort(WIFI_BACKEND_t *pBackend)
+{
+    struct netconn *conn = pBackend->conn;
+    pBackend->conn = NULL;
+    if (conn != NULL)
+    {
+        netconn_delete(conn);
+    }
+}
+
+// connect to the first candidate, and if that doesn't connect within WIFI_HEDGE_DELAY also to the
+// next one (in parallel), and so on, returns the first one that connects (now sWifiData.conn)
+static WIFI_BACKEND_t *sWifiConnectHedged(WIFI_BACKEND_t * const *ppkCands, const int nCands)
+{
+    const uint32_t t0 = osTime();
+    xSemaphoreTake(sWifiData.connSem, 0);
+    WIFI_BACKEND_t *pWinner = NULL;
+    uint32_t startTs[WIFI_BACKENDS_MAX];
+    int nStarted = 0;
+    int nPending = 0;
+    uint32_t hedgeTs = t0;
+    while (pWinner == NULL)
+    {
+        // start connecting to the next candidate, right away if none is pending
+        const uint32_t now = osTime();
+        if ( (nStarted < nCands) && ( (nPending == 0) || ((int32_t)(now - hedgeTs) >= 0) ) )
+        {
+            WIFI_BACKEND_t *pBackend = ppkCands[nStarted];
+            startTs[nStarted] = now;
+            nStarted++;
+            if (sWifiConnectStart(pBackend, false))
+            {
+                if (nPending > 0)
+                {
+                    DEBUG("wifi: hedging with %s", pBackend->host);
+                    sWifiData.nHedged++;
+                }
+                nPending++;
+            }
+            else
+            {
+                sWifiBackendFailed(pBackend);
+            }
+            hedgeTs = osTime() + WIFI_HEDGE_DELAY;
+            continue;
+        }
+        if (nPending == 0)
+        {
+            break;
+        }
+        if ((now - t0) > WIFI_CONNECT_MAX)
+        {
+            ERROR("wifi: connect timeout");
+            break;
+        }
+
+        // wait for a connect event, or until it's time to start the next candidate
+        const uint32_t waitTs = nStarted < nCands ? hedgeTs : (t0 + WIFI_CONNECT_MAX + 1);
+        xSemaphoreTake(sWifiData.connSem, MS2TICKS(MAX((int32_t)(waitTs - now), 1)));
+
+        for (int ix = 0; (ix < nStarted) && (pWinner == NULL); ix++)
+        {
+            WIFI_BACKEND_t *pBackend = ppkCands[ix];
+            if (pBackend->conn == NULL)
+            {
+                continue;
+            }
+            const int8_t state = pBackend->svConnState;
+            if (state > 0)
+            {
+                pWinner = pBackend;
+            }
+            else if (state < 0)
+            {
+                ERROR("wifi: connect to "IPSTR":%u failed", IP2STR(&pBackend->hostIp), pBackend->port);
+                sWifiConnectAbort(pBackend);
+                nPending--;
+                // the address we knew may be outdated
+                if (pBackend->cachedIp && sWifiConnectStart(pBackend, true))
+                {
+                    nPending++;
+                }
+                else
+                {
+                    pBackend->hostIpTs = 0;
+                    sWifiBackendFailed(pBackend);
+                }
+            }
+        }
+    }
+
+    // abort the others, those that started earlier than the winner are at least this slow
+    const uint32_t now = osTime();
+    for (int ix = 0; ix < nStarted; ix++)
+    {
+        WIFI_BACKEND_t *pBackend = ppkCands[ix];
+        if ( (pBackend == pWinner) || (pBackend->conn == NULL) )
+        {
+            continue;
+        }
+        sWifiConnectAbort(pBackend);
+        if (pWinner == NULL)
+        {
+            sWifiBackendFailed(pBackend);
+        }
+        else
+        {
+            pBackend->connectTime = MAX(pBackend->connectTime, now - startTs[ix]);
+        }
+    }
+    if (pWinner != NULL)
+    {
+        netconn_set_nonblocking(pWinner->conn, false);
+        sWifiData.conn = pWinner->conn;
+        pWinner->conn = NULL;
+    }
+    return pWinner;
+}
+
+// connect to backend
+// -------------------------------------------------------------------------------------------------
+
+#if (HAVE_MQTT == 0)
+
+// query parameters for the backend
+static void sWifiReqQuery(HTTP_CLIENT_t *pHttp, const char *telemetry)
+{
+    char staIp[16];
+    snprintf(staIp, sizeof(staIp), IPSTR, IP2STR(&sWifiData.staIp));
+
+    httpReqConst(pHttp, "cmd=realtime;ascii=1;proto="STRINGIFY(BACKEND_PROTOCOL_VERSION)";client=");
+    httpReqStr(pHttp, getSystemId(), true);
+    httpReqConst(pHttp, ";name=");
+    httpReqStr(pHttp, sWifiData.staName, true);
+    httpReqConst(pHttp, ";stassid=");
+    httpReqStr(pHttp, sWifiCred.ssid, true);
+    httpReqConst(pHttp, ";staip=");
+    httpReqStr(pHttp, staIp, false);
+    httpReqConst(pHttp, ";version=");
+    httpReqStr(pHttp, FF_BUILDVER, true);
+    httpReqConst(pHttp, ";maxch="STRINGIFY(JENKINS_MAX_CH));
+
+    // resume session (see backendSession())
+    const char *session = backendSession();
+    if (session != NULL)
+    {
+        httpReqConst(pHttp, ";session=");
+        httpReqStr(pHttp, session, true);
+    }
+
+    // latest monitor telemetry (stays the same for the two passes, see monGetTelemetry())
+    if (telemetry != NULL)
+    {
+        httpReqConst(pHttp, ";telemetry=");
+        httpReqStr(pHttp, telemetry, true);
+    }
+}
+
+// response body sink for the backend realtime stream
+static bool sWifiBackendSink(char *data, const int len, void *pArg)
+{
+    BACKEND_STATUS_t *pStatus = (BACKEND_STATUS_t *)pArg;
+    *pStatus = backendHandle(data, len);
+    return *pStatus == BACKEND_STATUS_OKAY;
+}
+
+#endif // (HAVE_MQTT == 0)
+
+// connect to a backend server (TCP, and TLS for https), to the current one, or to the best of those that
+// haven't failed in this round (any)
+static bool sWifiOpen(const bool any, bool *pFast)
+{
+    if (!sWifiData.haveBackends)
+    {
+        if (!sWifiParseBackends())
+        {
+            ERROR("wifi: no backend!");
+            return false;
+        }
+        sWifiData.haveBackends = true;
+    }
+
+    WIFI_BACKEND_t *pCands[WIFI_BACKENDS_MAX];
+    const int nCands = any ? sWifiBackendOrder(pCands) : 1;
+    if (!any)
+    {
+        pCands[0] = sWifiData.pBackend;
+    }
+    if (nCands < 1)
+    {
+        return false;
+    }
+    WIFI_BACKEND_t *pBackend = sWifiConnectHedged(pCands, nCands);
+    if (pBackend == NULL)
+    {
+        return false;
+    }
+    if (pBackend != pCands[0])
+    {
+        PRINT("wifi: failover to %s", pBackend->host);
+        sWifiData.nFailover++;
+    }
+    sWifiData.pBackend = pBackend;
+
+#if (HAVE_TLS > 0)
+    if (pBackend->https && !sWifiTlsConnect())
+    {
+        sWifiClose();
+        sWifiBackendFailed(pBackend);
+        return false;
+    }
+#endif
+
+    *pFast = pBackend->cachedIp;
+    return true;
+}
+
+#if (HAVE_MQTT == 0)
+
+// make the realtime request on the connection and wait for the backend's hello
+static bool sWifiRequestBackend(void)
+{
+    const WIFI_BACKEND_t *pkBackend = sWifiData.pBackend;
+
+    // make HTTP POST request
+    HTTP_CLIENT_t *pHttp = &sWifiData.http;
+    httpConnected(pHttp);
+    {
+        // length of the query parameters
+        const char *telemetry = monGetTelemetry();
+        httpReqBegin(pHttp, true);
+        sWifiReqQuery(pHttp, telemetry);
+        const int queryLen = httpReqLen(pHttp);
+        char queryLenStr[12];
+        snprintf(queryLenStr, sizeof(queryLenStr), "%d", queryLen);
+
+        httpReqBegin(pHttp, false);
+        httpReqConst(pHttp, "POST /");                                   // HTTP POST request
+        httpReqConst(pHttp, pkBackend->path);
+        httpReqConst(pHttp, " HTTP/1.1\r\nHost: ");                     // provide host name for virtual host setups
+        httpReqConst(pHttp, pkBackend->host);
+        httpReqConst(pHttp, "\r\nAuthorization: Basic ");               // okay to provide empty one?
+        httpReqConst(pHttp, pkBackend->auth != NULL ? pkBackend->auth : "");
+        httpReqConst(pHttp, "\r\nUser-Agent: "FF_PROGRAM"/"FF_BUILDVER // be nice
+            "\r\nContent-Length: ");                                    // length of query parameters
+        httpReqStr(pHttp, queryLenStr, false);
+        httpReqConst(pHttp, "\r\n\r\n");                                 // end of request headers
+        sWifiReqQuery(pHttp, telemetry);                                 // query parameters
+        const err_t err = httpReqEnd(pHttp);
+        DEBUG("wifi: request POST /%s [%d+%d]", pkBackend->path, httpReqLen(pHttp) - queryLen, queryLen);
+        if (err != ERR_OK)
+        {
+            ERROR("wifi: POST /%s failed: %s", pkBackend->path, lwipErrStr(err));
+            sWifiClose();
+            return false;
+        }
+    }
+
+    // receive response header and the "hello"
+    backendConnect();
+    bool okay = true;
+    const uint32_t deadline = osTime() + WIFI_HELLO_TIMEOUT;
+    while (okay && !backendIsConnected())
+    {
+        const int32_t timeout = (int32_t)(deadline - osTime());
+        if (timeout <= 0)
+        {
+            ERROR("wifi: response timeout");
+            break;
+        }
+        char *pData;
+        int dataLen;
+        const err_t errRecv = sWifiRecv(timeout, &pData, &dataLen);
+        // no data in time
+        if (errRecv == ERR_TIMEOUT)
+        {
+            ERROR("wifi: response timeout");
+            break;
+        }
+        if (errRecv != ERR_OK)
+        {
+            ERROR("wifi: read failed: %s", lwipErrStr(errRecv));
+            break;
+        }
+        //DEBUG("wifi: recv [%d]", dataLen);
+
+        // response header and body (the realtime stream doesn't end)
+        BACKEND_STATUS_t status = BACKEND_STATUS_OKAY;
+        if (httpRespFeed(pHttp, pData, dataLen, sWifiBackendSink, &status) != HTTP_RESP_MORE)
+        {
+            okay = false;
+            break;
+        }
+    }
+    const bool backendReady = okay && backendIsConnected();
+
+    if (backendReady)
+    {
+        // no more tx (TLS may still have to say something)
+        if (!pkBackend->https)
+        {
+            netconn_shutdown(sWifiData.conn, false, true);
+        }
+        return true;
+    }
+    else
+    {
+        ERROR("wifi: no or illegal response from backend %s", pkBackend->host);
+        sWifiClose();
+        return false;
+    }
+}
+
+// connect to the best backend, and fail over to the others (each at most once)
+static bool sWifiConnectBackend(void)
+{
+    for (int ix = 0; ix < sWifiData.nBackends; ix++)
+    {
+        sWifiData.backends[ix].roundFail = false;
+    }
+
+    const uint32_t t0 = osTime();
+    bool fast = false;
+    while (sWifiOpen(true, &fast))
+    {
+        if (sWifiRequestBackend())
+        {
+            sWifiData.connectTime = osTime() - t0;
+            if (fast)
+            {
+                sWifiData.nFastConnect++;
+            }
+            else
+            {
+                sWifiData.nFullConnect++;
+            }
+            sWifiBackendOkay(sWifiData.pBackend, sWifiData.connectTime);
+            PRINT("wifi: backend %s ready after %ums (%s)", sWifiData.pBackend->host, sWifiData.connectTime, fast ? "fast" : "full");
+            return true;
+        }
+        sWifiBackendFailed(sWifiData.pBackend);
+    }
+    return false;
+}
+
+// handle backend connection (wait for more data)
+// return true to force immediate reconnect, false for reconnecting later
+static bool sWifiHandleConnection(void)
+{
+    bool res = true;
+
+    relayStart();
+    svWifiReconnect = false;
+
+    bool keepGoing = true;
+    while (keepGoing)
+    {
+        // the config may have changed
+        sWifiSetPower();
+
+        // reconnect requested (e.g. by the button)
+        if (svWifiReconnect)
+        {
+            PRINT("wifi: reconnect");
+            res = true;
+            break;
+        }
+
+        // check if backend is okay
+        if (!backendIsOkay())
+        {
+            res = false;
+            keepGoing = false;
+            break;
+        }
+
+        // relay the job states to the other Lämpli, or give way to another relay
+        if (relayPoll())
+        {
+            res = true;
+            keepGoing = false;
+            break;
+        }
+
+        // wait for more data from the connection, at most until the heartbeat (or the relay) is due
+        char *pData;
+        int dataLen;
+        const err_t errRecv = sWifiRecv(MIN(backendHeartbeatRemaining(), relayPollRemaining()), &pData, &dataLen);
+
+        // no data until heartbeat deadline, backendIsOkay() above will tell
+        if (errRecv == ERR_TIMEOUT)
+        {
+            continue;
+        }
+
+        if (errRecv != ERR_OK)
+        {
+            ERROR("wifi: read failed: %s", lwipErrStr(errRecv));
+            res = false;
+            break;
+        }
+
+        //DEBUG("wifi: recv [%d]", dataLen);
+        TRACE(TRACE_EV_WIFI_RECV, dataLen);
+        BACKEND_STATUS_t status = BACKEND_STATUS_OKAY;
+        const HTTP_RESP_t resp = httpRespFeed(&sWifiData.http, pData, dataLen, sWifiBackendSink, &status);
+        if ( (resp == HTTP_RESP_DONE) || (resp == HTTP_RESP_FAIL) )
+        {
+            WARNING("wifi: backend response %s", resp == HTTP_RESP_DONE ? "ended" : "failed");
+            status = BACKEND_STATUS_FAIL;
+        }
+        switch (status)
+        {
+            case BACKEND_STATUS_OKAY:                                      break;
+            case BACKEND_STATUS_FAIL:      keepGoing = false; res = false; break;
+            case BACKEND_STATUS_RECONNECT: keepGoing = false; res = true;  break;
+        }
+    }
+
+    relayStop();
+    sWifiClose();
+    backendDisconnect();
+    return res;
+}
+
+#else // (HAVE_MQTT == 0)
+
+// handle broker connection (wait for messages)
+// return true to force immediate reconnect, false for reconnecting later
+static bool sWifiHandleMqtt(void)
+{
+    bool res = true;
+
+    relayStart();
+    svWifiReconnect = false;
+
+    bool keepGoing = true;
+    while (keepGoing)
+    {
+        // the config may have changed
+        sWifiSetPower();
+
+        // reconnect requested (e.g. by the button)
+        if (svWifiReconnect)
+        {
+            PRINT("wifi: reconnect");
+            res = true;
+            break;
+        }
+
+        // check if the broker is still there (MQTT keep-alive)
+        if (!mqttIsConnected())
+        {
+            ERROR("wifi: lost broker");
+            res = false;
+            break;
+        }
+
+        // relay the job states to the other Lämpli, or give way to another relay
+        if (relayPoll())
         {
-            sWifiData.staIp = ipinfo.ip;
-            connected = true;
-            PRINT("wifi: online after %.3fs", (double)(osTime() - now) * 1e-3);
+            res = true;
             break;
         }
-        osSleep(100);
-        n++;
+
+        // wait for messages, at most until the relay is due
+        switch (mqttHandle(relayPollRemaining()))
+        {
+            case BACKEND_STATUS_OKAY:                                      break;
+            case BACKEND_STATUS_FAIL:      keepGoing = false; res = false; break;
+            case BACKEND_STATUS_RECONNECT: keepGoing = false; res = true;  break;
+        }
     }
 
-    return connected;
+    relayStop();
+    mqttDisconnect();
+    backendDisconnect();
+    return res;
 }
 
-// connect to backend
-static bool sWifiConnectBackend(void)
+#endif // (HAVE_MQTT == 0)
+
+// firmware image sink
+static bool sWifiOtaSink(char *data, const int len, void *pArg)
+{
+    UNUSED(pArg);
+    return otaWrite(data, len);
+}
+
+// fetch firmware image from the backend and write it to flash (see ota.h), restarts if successful
+static void sWifiUpdate(const char *image)
 {
-    // check and decompose backend URL
+    if (!otaBegin())
+    {
+        return;
+    }
+    // (from the backend that told us to)
+    bool fast;
+    if (!sWifiOpen(false, &fast))
+    {
+        otaEnd(false);
+        return;
+    }
+    const WIFI_BACKEND_t *pkBackend = sWifiData.pBackend;
+    char path[sizeof(pkBackend->url) + OTA_IMAGE_MAX + 40];
+    snprintf(path, sizeof(path), "%s?cmd=firmware;client=%s;image=%s", pkBackend->path, getSystemId(), image);
+    HTTP_CLIENT_t *pHttp = &sWifiData.http;
+    httpConnected(pHttp);
+    const HTTP_RESP_t resp = httpGet(pHttp, pkBackend->host, path, pkBackend->auth, WIFI_OTA_TIMEOUT, sWifiOtaSink, NULL);
+    sWifiClose();
+    if (otaEnd(resp == HTTP_RESP_DONE))
     {
-        strcpy(sWifiData.url, FF_CFG_BACKENDURL);
-        const int urlLen = strlen(sWifiData.url);
+        statusNoise(STATUS_NOISE_OTHER);
+        osSleep(250);
+        sdk_system_restart();
+    }
+    statusNoise(STATUS_NOISE_ERROR);
+}
 
-        snprintf(&sWifiData.url[urlLen], sizeof(sWifiData.url) - urlLen - 1, "?"BACKEND_QUERY,
-            getSystemId(), sWifiData.staName, IP2STR(&sWifiData.staIp));
-        DEBUG("wifi: backend url=%s", sWifiData.url);
 
-        const int res = reqParamsFromUrl(sWifiData.url, sWifiData.url, sizeof(sWifiData.url),
-            &sWifiData.host, &sWifiData.path, &sWifiData.query, &sWifiData.auth, &sWifiData.https, &sWifiData.port);
-        if (res)
-        {
-            DEBUG("wifi: host=%s path=%s query=%s auth=%s https=%s, port=%u",
-                sWifiData.host, sWifiData.path, sWifiData.query, sWifiData.auth, sWifiData.https ? "yes" : "no", sWifiData.port);
-        }
-        else
-        {
-            ERROR("wifi: fishy backend url!");
-            return false;
-        }
+// -------------------------------------------------------------------------------------------------
+
+// wait, with reconnect tick noises at the end
+static void sWifiWait(const uint32_t waitTime)
+{
+    const uint32_t nTicks = waitTime > 3000 ? 3 : (waitTime / 1000);
+    osSleep(waitTime - (nTicks * 1000));
+    for (uint32_t n = 0; n < nTicks; n++)
+    {
+        statusNoise(STATUS_NOISE_TICK);
+        osSleep(1000);
     }
+}
+
+// truncated exponential backoff with jitter, so that many Lämpli don't all reconnect at the same time
+// (e.g. after a backend restart), returns the time to wait [ms]
+static uint32_t sWifiBackoff(void)
+{
+    static uint32_t sLastFail;
+    static uint32_t sNumFails;
+    static uint32_t sRand;
 
-    // get IP of backend server
+    // last failure was long ago (i.e. the connection was stable) --> start again
+    const uint32_t now = osTime();
+    if ( (sLastFail == 0) || ((now - sLastFail) > (1000 * BACKEND_STABLE_CONN_THRS)) )
     {
-        DEBUG("wifi: DNS lookup %s", sWifiData.host);
-        const err_t err = netconn_gethostbyname(sWifiData.host, &sWifiData.hostIp);
-        if (err != ERR_OK)
-        {
-            ERROR("wifi: DNS query for %s failed: %s",
-                sWifiData.host, lwipErrStr(err));
-            return false;
-        }
+        sNumFails = 0;
     }
 
-    // connect to backend server
+    // per-device pseudo random numbers (xorshift32, seeded from the system ID)
+    if (sRand == 0)
     {
-        sWifiData.conn = netconn_new(NETCONN_TCP);
-        DEBUG("wifi: connect "IPSTR, IP2STR(&sWifiData.hostIp));
-        const err_t err = netconn_connect(sWifiData.conn, &sWifiData.hostIp, sWifiData.port);
-        if (err != ERR_OK)
+        sRand = 2166136261;
+        for (const char *pkId = getSystemId(); *pkId != '\0'; pkId++)
         {
-            ERROR("wifi: connect to "IPSTR":%u failed: %s",
-                IP2STR(&sWifiData.hostIp), sWifiData.port, lwipErrStr(err));
-            return false;
+            sRand = (sRand ^ (uint8_t)*pkId) * 16777619;
         }
+        sRand = sRand != 0 ? sRand : 1;
     }
+    sRand ^= sRand << 13;
+    sRand ^= sRand >> 17;
+    sRand ^= sRand << 5;
 
-    // make HTTP POST request
+    // 10s, 20s, 40s, ... up to 300s, the second half of which is random
+    uint32_t maxWait = 1000 * BACKEND_RECONNECT_INTERVAL;
+    for (uint32_t n = 0; (n < sNumFails) && (maxWait < (1000 * BACKEND_RECONNECT_INTERVAL_SLOW)); n++)
     {
-        char req[sizeof(sWifiData.url) + 128];
-        snprintf(req, sizeof(req),
-            "POST /%s HTTP/1.1\r\n"           // HTTP POST request
-                "Host: %s\r\n"                // provide host name for virtual host setups
-                "Authorization: Basic %s\r\n" // okay to provide empty one?
-                "User-Agent: "FF_PROGRAM"/"FF_BUILDVER"\r\n"  // be nice
-                "Content-Length: %d\r\n"      // length of query parameters
-                "\r\n"                        // end of request headers
-                "%s",                         // query parameters (FIXME: urlencode!)
-            sWifiData.path,
-            sWifiData.host,
-            sWifiData.auth != NULL ? sWifiData.auth : "",
-            strlen(sWifiData.query),
-            sWifiData.query);
-        DEBUG("wifi: request POST /%s: %s", sWifiData.path, sWifiData.query);
-        const err_t err = netconn_write(sWifiData.conn, req, strlen(req), NETCONN_COPY);
-        if (err != ERR_OK)
-        {
-            ERROR("wifi: POST /%s failed: %s", sWifiData.path, lwipErrStr(err));
-            netconn_delete(sWifiData.conn);
-            return false;
-        }
+        maxWait *= 2;
     }
+    if (maxWait > (1000 * BACKEND_RECONNECT_INTERVAL_SLOW))
+    {
+        maxWait = 1000 * BACKEND_RECONNECT_INTERVAL_SLOW;
+    }
+    sNumFails++;
+    const uint32_t waitTime = (maxWait / 2) + (sRand % ((maxWait / 2) + 1));
 
-    // receive header
-    bool backendReady = false;
-    struct netbuf *buf = NULL;
-    netconn_set_nonblocking(sWifiData.conn, true);
-    int helloTimeout = 5 * 100;
-    while (true)
+    // (the time of this failure is when we're done waiting for it)
+    sLastFail = now + waitTime;
+    return waitTime;
+}
+
+static bool sWifiIsOnline(void)
+{
+    const uint8_t status = sdk_wifi_station_get_connect_status();
+    struct ip_info ipinfo;
+    sdk_wifi_get_ip_info(STATION_IF, &ipinfo);
+    return (status == STATION_GOT_IP) && (ipinfo.ip.addr != 0) ? true : false;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+// In the provisioning mode we're an (open) access point with a DHCP server, and we answer all DNS
+// queries with our address. The form is served by the HTTP server (see httpd.c), which calls
+// wifiProvision().
+
+// answer a DNS query: the first question only, with our address if it's for an A record (type 1,
+// class IN), without answers otherwise
+static void sWifiProvDns(struct netconn *conn, struct netbuf *pQuery, const ip4_addr_t *pkIp)
+{
+    void *pData;
+    uint16_t len;
+    netbuf_data(pQuery, &pData, &len);
+    const uint8_t *pkQ = (const uint8_t *)pData;
+
+    // header: id, flags (must be a standard query), and at least one question
+    if ( (len < 12) || (len != netbuf_len(pQuery)) || ((pkQ[2] & 0xf8) != 0) ||
+         (pkQ[4] != 0) || (pkQ[5] < 1) )
     {
-        const err_t errRecv = netconn_recv(sWifiData.conn, &buf);
-        // no more data at the moment
-        if (errRecv == ERR_WOULDBLOCK)
-        {
-            helloTimeout--;
-            if (helloTimeout < 0)
-            {
-                ERROR("wifi: response timeout");
-                break;
-            }
-            else
-            {
-                osSleep(100);
-                continue;
-            }
-        }
-        if (errRecv != ERR_OK)
-        {
-            ERROR("wifi: read failed: %s", lwipErrStr(errRecv));
-            break;
-        }
+        return;
+    }
 
-        // check data for HTTP response
-        // (note: not handling multiple netbufs -- should not be necessary)
-        void *data;
-        uint16_t len;
-        const err_t errData = netbuf_data(buf, &data, &len);
-        if (errData != ERR_OK)
+    // skip the name (labels, uncompressed in a query) and the type and class
+    int qEnd = 12;
+    while ( (qEnd < len) && (pkQ[qEnd] != 0) )
+    {
+        if ((pkQ[qEnd] & 0xc0) != 0)
         {
-            ERROR("wifi: netbuf_data() failed: %s", lwipErrStr(errData));
-            break;
+            return;
         }
-        char *pParse = (char *)data;
-        //DEBUG("wifi: recv [%u] %s", len, pParse);
+        qEnd += pkQ[qEnd] + 1;
+    }
+    qEnd += 1 + 4;
+    if (qEnd > len)
+    {
+        return;
+    }
+    const bool isA = (pkQ[qEnd - 4] == 0) && (pkQ[qEnd - 3] == 1) && (pkQ[qEnd - 2] == 0) && (pkQ[qEnd - 1] == 1);
 
-        // first line: "HTTP/1.1 200 OK\r\n"
-        char *firstLineStart = pParse;
-        char *statusCode = &pParse[9]; // "200 OK\r\n"
-        char *firstLineEnd = strstr(firstLineStart, "\r\n");
-        if ( (firstLineEnd == NULL) || (strncmp(firstLineStart, "HTTP/1.1 ", 8) != 0) )
+    // response: the header and the question from the query, and the answer
+    const int respLen = qEnd + (isA ? 16 : 0);
+    struct netbuf *pResp = netbuf_new();
+    uint8_t *pR = pResp != NULL ? netbuf_alloc(pResp, respLen) : NULL;
+    if (pR != NULL)
+    {
+        memcpy(pR, pkQ, qEnd);
+        pR[2] = 0x84 | (pkQ[2] & 0x01); // response, authoritative, recursion desired (as in query)
+        pR[3] = 0x00;                   // no recursion available, no error
+        pR[4] = 0; pR[5] = 1;           // one question
+        pR[6] = 0; pR[7] = isA ? 1 : 0; // answers
+        pR[8] = 0; pR[9] = 0;           // no authority records
+        pR[10] = 0; pR[11] = 0;         // no additional records
+        if (isA)
         {
-            ERROR("wifi: response is not HTTP/1.1");
-            break;
+            uint8_t *pA = &pR[qEnd];
+            pA[0] = 0xc0; pA[1] = 12;   // name: pointer to the one in the question
+            pA[2] = 0; pA[3] = 1;       // type A
+            pA[4] = 0; pA[5] = 1;       // class IN
+            pA[6] = 0; pA[7] = 0; pA[8] = 0; pA[9] = WIFI_DNS_TTL;
+            pA[10] = 0; pA[11] = 4;     // address
+            memcpy(&pA[12], &pkIp->addr, 4);
         }
-        const int status = atoi(statusCode);
-        *firstLineEnd = '\0';
-        DEBUG("wifi: %s (code %d)", firstLineStart, status);
-        if (status != 200)
+        const err_t err = netconn_sendto(conn, pResp, netbuf_fromaddr(pQuery), netbuf_fromport(pQuery));
+        if (err != ERR_OK)
         {
-            ERROR("wifi: illegal response: %s", statusCode);
-            break;
+            WARNING("wifi: dns: send failed: %s", lwipErrStr(err));
         }
-        pParse = firstLineEnd + 2;
-
-        // seek to end of header
-        char *pBody = strstr(pParse, "\r\n\r\n");
-        if ( (pBody == NULL) || (strlen(pBody) < 10) )
+        else
         {
-            ERROR("wifi: no response (maybe redirect?)");
-            break;
+            sWifiData.nDnsQueries++;
         }
-
-        backendReady = backendConnect(pBody, (int)len - (pBody - (char *)data));
-        break;
     }
-    if (buf != NULL)
+    if (pResp != NULL)
     {
-        netbuf_free(buf);
-        netbuf_delete(buf);
+        netbuf_delete(pResp);
     }
+}
 
-    if (backendReady)
+// provisioning mode: access point, DHCP and DNS, until we have a (new) config or timeout
+static void sWifiProvision(void)
+{
+    sWifiData.nProvision++;
+    svWifiProvisioned = false;
+
+    // access point
+    sdk_wifi_station_disconnect();
+    sdk_wifi_set_opmode_current(SOFTAP_MODE);
+    struct ip_info ipinfo;
+    memset(&ipinfo, 0, sizeof(ipinfo));
+    ip4addr_aton(WIFI_PROV_IP, &ipinfo.ip);
+    ip4addr_aton(WIFI_PROV_IP, &ipinfo.gw);
+    ip4addr_aton("255.255.255.0", &ipinfo.netmask);
+    sdk_wifi_set_ip_info(SOFTAP_IF, &ipinfo);
+    struct sdk_softap_config apConfig;
+    memset(&apConfig, 0, sizeof(apConfig));
+    char ssid[WIFI_SSID_MAX + 1];
+    snprintf(ssid, sizeof(ssid), "%s-setup", sWifiData.staName);
+    apConfig.ssid_len = strlen(ssid);
+    memcpy(apConfig.ssid, ssid, apConfig.ssid_len);
+    apConfig.channel = sWifiData.haveFast ? sWifiData.fast.channel : 1;
+    apConfig.authmode = AUTH_OPEN;
+    apConfig.max_connection = WIFI_PROV_LEASES;
+    apConfig.beacon_interval = 100;
+    sdk_wifi_softap_set_config(&apConfig);
+
+    // DHCP server, which tells the clients that we're the router and the DNS server
+    ip4_addr_t firstIp;
+    IP4_ADDR(&firstIp, ip4_addr1(&ipinfo.ip), ip4_addr2(&ipinfo.ip), ip4_addr3(&ipinfo.ip), ip4_addr4(&ipinfo.ip) + 1);
+    dhcpserver_start(&firstIp, WIFI_PROV_LEASES);
+    dhcpserver_set_router(&ipinfo.ip);
+    dhcpserver_set_dns(&ipinfo.ip);
+
+    // DNS responder
+    struct netconn *dnsConn = netconn_new(NETCONN_UDP);
+    err_t err = dnsConn != NULL ? netconn_bind(dnsConn, IP_ADDR_ANY, WIFI_DNS_PORT) : ERR_MEM;
+    if (err == ERR_OK)
     {
-        netconn_shutdown(sWifiData.conn, false, true); // no more tx
-        return true;
+        netconn_set_recvtimeout(dnsConn, 500);
     }
     else
     {
-        ERROR("wifi: no or illegal response from backend");
-        netconn_close(sWifiData.conn);
-        netconn_delete(sWifiData.conn);
-        return false;
+        ERROR("wifi: dns: bind failed: %s", lwipErrStr(err));
     }
-}
 
-// handle backend connection (wait for more data)
-// return true to force immediate reconnect, false for reconnecting later
-static bool sWifiHandleConnection(void)
-{
-    bool res = true;
+    PRINT("wifi: provisioning at ssid=%s ip=%s...", ssid, WIFI_PROV_IP);
+    statusLed(STATUS_LED_UPDATE);
+    statusNoise(STATUS_NOISE_OTHER);
 
-    bool keepGoing = true;
-    while (keepGoing)
+    // with a config to go back to we give up after a while, otherwise we wait forever
+    const uint32_t t0 = osTime();
+    while ( !svWifiProvisioned && (!sWifiHaveCred() || ((osTime() - t0) < (1000 * WIFI_PROV_TIMEOUT))) )
     {
-        // check if backend is okay
-        if (!backendIsOkay())
-        {
-            res = false;
-            keepGoing = false;
-            break;
-        }
-
-        // read more data from the connection
-        struct netbuf *buf = NULL;
-        const err_t errRecv = netconn_recv(sWifiData.conn, &buf);
-
-        // no more data at the moment
-        if (errRecv == ERR_WOULDBLOCK)
-        {
-            osSleep(23);
-            continue;
-        }
-
-        if (errRecv != ERR_OK)
+        struct netbuf *pBuf = NULL;
+        err = err == ERR_OK ? netconn_recv(dnsConn, &pBuf) : ERR_CONN;
+        if (err == ERR_OK)
         {
-            ERROR("wifi: read failed: %s", lwipErrStr(errRecv));
-            res = false;
-            break;
+            sWifiProvDns(dnsConn, pBuf, &ipinfo.ip);
+            netbuf_delete(pBuf);
         }
-
-        // check data
-        // (note: not handling multiple netbufs -- should not be necessary)
-        void *resp;
-        uint16_t len;
-        const err_t errData = netbuf_data(buf, &resp, &len);
-        if (errData != ERR_OK)
+        else if (err == ERR_TIMEOUT)
         {
-            ERROR("wifi: netbuf_data() failed: %s", lwipErrStr(errData));
-            keepGoing = false;
-            res = false;
+            err = ERR_OK;
         }
         else
         {
-            // convert response to string (nul-terminate it)
-            char *respStr = (char *)resp;
-            respStr[len] = '\0';
-            //DEBUG("wifi: recv [%u] %s", len, respStr);
-            const BACKEND_STATUS_t status = backendHandle(respStr, (int)len);
-            switch (status)
-            {
-                case BACKEND_STATUS_OKAY:                                      break;
-                case BACKEND_STATUS_FAIL:      keepGoing = false; res = false; break;
-                case BACKEND_STATUS_RECONNECT: keepGoing = false; res = true;  break;
-            }
+            // no DNS, but the form still works if one goes to WIFI_PROV_IP directly
+            osSleep(500);
         }
-        netbuf_free(buf);
-        netbuf_delete(buf);
+    }
+    if (svWifiProvisioned)
+    {
+        PRINT("wifi: provisioned ssid=%s", sWifiCred.ssid);
+        // give the HTTP server a moment to send its response
+        osSleep(WIFI_PROV_LINGER);
+    }
+    else
+    {
+        WARNING("wifi: provisioning timeout");
     }
 
-    backendDisconnect();
-    return res;
-}
-
-
-// -------------------------------------------------------------------------------------------------
+    // tear it all down, so that we have all the memory back for the normal operation
+    if (dnsConn != NULL)
+    {
+        netconn_delete(dnsConn);
+    }
+    dhcpserver_stop();
+    sdk_wifi_set_opmode_current(STATION_MODE);
 
-static bool sWifiIsOnline(void)
-{
-    const uint8_t status = sdk_wifi_station_get_connect_status();
-    struct ip_info ipinfo;
-    sdk_wifi_get_ip_info(STATION_IF, &ipinfo);
-    return (status == STATION_GOT_IP) && (ipinfo.ip.addr != 0) ? true : false;
+    // connect the station (with the new config, if any)
+    if (svWifiProvisioned)
+    {
+        sWifiData.nBackends = 0;
+        sWifiData.haveBackends = false;
+        sWifiData.pBackend = NULL;
+        memset(sWifiData.backends, 0, sizeof(sWifiData.backends));
+    }
+    sWifiData.haveFast = sWifiFastLoad();
+    sWifiStationConfig(sWifiData.haveFast);
+    sdk_wifi_station_connect();
+    sWifiData.offlineTs = osTime();
+    svWifiProvisioned = false;
 }
 
 static void sWifiTask(void *pArg)
@@ -400,11 +1875,33 @@ static void sWifiTask(void *pArg)
             oldState = sWifiState;
         }
 
+        // provisioning requested (by the button)
+        if (svWifiProvRequest)
+        {
+            svWifiProvRequest = false;
+            sWifiState = WIFI_STATE_PROVISION;
+        }
+
+        if (sWifiIsOnline())
+        {
+            sWifiData.offlineTs = 0;
+        }
+        else if (sWifiData.offlineTs == 0)
+        {
+            sWifiData.offlineTs = osTime();
+        }
+
         switch (sWifiState)
         {
             // we're offline --> wait for station connect
             case WIFI_STATE_OFFLINE:
             {
+                // no config --> provisioning (with a config only when requested, see wifiStartProvisioning())
+                if (!sWifiHaveCred())
+                {
+                    sWifiState = WIFI_STATE_PROVISION;
+                    break;
+                }
                 PRINT("wifi: state offline, waiting for station connect...");
                 statusNoise(STATUS_NOISE_ABORT);
                 statusLed(STATUS_LED_UPDATE);
@@ -423,8 +1920,19 @@ static void sWifiTask(void *pArg)
             // we're connected to the AP --> connect to the backend
             case WIFI_STATE_ONLINE:
             {
+                // another Lämpli may be relaying the backend already
+                if (relayWait())
+                {
+                    sWifiState = WIFI_STATE_RELAYED;
+                    break;
+                }
+#if (HAVE_MQTT > 0)
+                PRINT("wifi: state online, connecting broker...");
+                if (mqttConnect())
+#else
                 PRINT("wifi: state online, connecting backend...");
                 if (sWifiConnectBackend())
+#endif
                 {
                     sWifiState = WIFI_STATE_CONNECTED;
                 }
@@ -441,8 +1949,27 @@ static void sWifiTask(void *pArg)
                 PRINT("wifi: state connected...");
                 statusNoise(STATUS_NOISE_ONLINE);
                 statusLed(STATUS_LED_HEARTBEAT);
+#if (HAVE_MQTT > 0)
+                if (sWifiHandleMqtt())
+#else
                 if (sWifiHandleConnection())
+#endif
                 {
+                    // the backend may want us to update the firmware
+                    const char *image = otaPending();
+                    if (image != NULL)
+                    {
+                        sWifiUpdate(image);
+                    }
+
+                    // the backend may want us to wait a bit
+                    const int retryHint = backendRetryHint();
+                    if (retryHint > 0)
+                    {
+                        PRINT("wifi: reconnect in %ds", retryHint);
+                        statusLed(STATUS_LED_FAIL);
+                        sWifiWait(1000 * retryHint);
+                    }
                     sWifiState = sWifiIsOnline() ? WIFI_STATE_ONLINE : WIFI_STATE_OFFLINE;
                 }
                 else
@@ -452,34 +1979,38 @@ static void sWifiTask(void *pArg)
                 break;
             }
 
+            // listening to a relay --> until that stops
+            case WIFI_STATE_RELAYED:
+            {
+                PRINT("wifi: state relayed...");
+                statusNoise(STATUS_NOISE_ONLINE);
+                statusLed(STATUS_LED_HEARTBEAT);
+                relayListen();
+                sWifiState = sWifiIsOnline() ? WIFI_STATE_ONLINE : WIFI_STATE_OFFLINE;
+                break;
+            }
+
             // something has failed --> wait a bit
             case WIFI_STATE_FAIL:
             {
-                static uint32_t lastFail;
-                const uint32_t now = osTime();
-                int waitTime = (now - lastFail) > (1000 * BACKEND_STABLE_CONN_THRS) ?
-                    BACKEND_RECONNECT_INTERVAL : BACKEND_RECONNECT_INTERVAL_SLOW;
-                lastFail = now;
+                const uint32_t waitTime = sWifiBackoff();
                 statusNoise(STATUS_NOISE_FAIL);
                 statusLed(STATUS_LED_FAIL);
-                PRINT("wifi: failure... waiting %us", waitTime);
-                while (waitTime > 0)
-                {
-                    osSleep(1000);
-                    if ( (waitTime < 10) || ((waitTime % 10) == 0) )
-                    {
-                        DEBUG("wifi: wait... %d", waitTime);
-                    }
-                    if (waitTime <= 3)
-                    {
-                        statusNoise(STATUS_NOISE_TICK);
-                    }
-                    waitTime--;
-                }
+                PRINT("wifi: failure... waiting %u.%us", waitTime / 1000, (waitTime % 1000) / 100);
+                sWifiWait(waitTime);
                 sWifiState = sWifiIsOnline() ? WIFI_STATE_ONLINE : WIFI_STATE_OFFLINE;
 
                 break;
             }
+
+            // access point for a (new) config --> until we have one
+            case WIFI_STATE_PROVISION:
+            {
+                PRINT("wifi: state provision...");
+                sWifiProvision();
+                sWifiState = WIFI_STATE_OFFLINE;
+                break;
+            }
         }
 
         osSleep(100);
@@ -489,71 +2020,58 @@ static void sWifiTask(void *pArg)
 
 /* ********************************************************************************************** */
 
-#else // (HAVE_CONFIG > 0)
+void wifiReconnect(void)
+{
+    svWifiReconnect = true;
+    relayStopListening();
+}
+
+void wifiStartProvisioning(void)
+{
+    svWifiProvRequest = true;
+    wifiReconnect(); // (drop the backend connection, or stop listening to the relay)
+}
 
-#define WIFI_SCAN_PERIOD 5000
+bool wifiIsProvisioning(void)
+{
+    return sWifiState == WIFI_STATE_PROVISION;
+}
 
-void sWifiScanDoneCb(void *pArg, sdk_scan_status_t status)
+bool wifiProvision(const char *ssid, const char *pass, const char *urls)
 {
-    static const char * const skScanStatusStrs [] =
+    if (sWifiState != WIFI_STATE_PROVISION)
     {
-        [SCAN_OK] = "OK", [SCAN_FAIL] = "FAIL", [SCAN_PENDING] = "PENDING", [SCAN_BUSY] = "BUSY", [SCAN_CANCEL] = "CANCEL"
-    };
-    switch (status)
+        return false;
+    }
+    if (urls[0] == '\0')
     {
-        case SCAN_FAIL:
-        case SCAN_PENDING:
-        case SCAN_BUSY:
-        case SCAN_CANCEL:
-            ERROR("wifi: scan fail: %s", skScanStatusStrs[status]);
-            return;
-        case SCAN_OK:
-            break;
-        default:
-            ERROR("wifi: scan fail: %u", status);
-            return;
+        urls = sWifiCred.urls;
     }
-
-    // we get a list of found access points
-    const struct sdk_bss_info *pkBss = (const struct sdk_bss_info *)pArg;
-    pkBss = STAILQ_NEXT(pkBss, next); // the first is rubbish
-
-    while (pkBss != NULL)
+    const int ssidLen = strlen(ssid);
+    const int passLen = strlen(pass);
+    const int urlsLen = strlen(urls);
+    if ( (ssidLen < 1) || (ssidLen > WIFI_SSID_MAX) ||
+         ((passLen > 0) && (passLen < 8)) || (passLen > WIFI_PASS_MAX) || // WPA needs at least 8
+         (urlsLen > WIFI_URLS_MAX) || (strncmp(urls, "http", 4) != 0) )
     {
-        char ssid[34];
-        strncpy(ssid, (const char *)pkBss->ssid, sizeof(ssid) - 1);
-        const int len = strlen(ssid);
-        if (pkBss->is_hidden != 0)
-        {
-            ssid[len] = '*';
-            ssid[len + 1] = '\0';
-        }
-
-        PRINT("wifi: scan: ssid=%-33s bssid="MACSTR" channel=%02u rssi=%02d auth=%s",
-            ssid, MAC2STR(pkBss->bssid), pkBss->channel, pkBss->rssi, sdkAuthModeStr(pkBss->authmode));
-
-        pkBss = STAILQ_NEXT(pkBss, next);
+        WARNING("wifi: provision: bad config (ssid=%d pass=%d urls=%d)", ssidLen, passLen, urlsLen);
+        return false;
     }
-}
 
-static void sWifiTask(void *pArg)
-{
-    sdk_wifi_set_opmode_current(STATION_MODE);
-    while (true)
+    // (the config isn't used while we're provisioning)
+    memmove(sWifiCred.urls, urls, urlsLen + 1);
+    strcpy(sWifiCred.ssid, ssid);
+    strcpy(sWifiCred.pass, pass);
+    if (!flashSnapSave(FLASH_SNAP_WIFI, &sWifiCred, sizeof(sWifiCred)))
     {
-        static uint32_t sTick;
-        vTaskDelayUntil(&sTick, MS2TICKS(WIFI_SCAN_PERIOD));
-        PRINT("wifi: no config -- initiating wifi scan");
-        struct sdk_scan_config cfg = { .ssid = NULL, .bssid = NULL, .channel = 0, .show_hidden = true };
-        sdk_wifi_station_scan(&cfg, sWifiScanDoneCb);
+        ERROR("wifi: provision: failed storing config");
+        sWifiCredLoad();
+        return false;
     }
+    svWifiProvisioned = true;
+    return true;
 }
 
-#endif // (HAVE_CONFIG > 0)
-
-
-/* ********************************************************************************************** */
-
 void wifiMonStatus(void)
 {
     const char *mode   = sdkWifiOpmodeStr( sdk_wifi_get_opmode() );
@@ -563,13 +2081,53 @@ void wifiMonStatus(void)
     const char *sleep  = sdkWifiSleepTypeStr( sdk_wifi_get_sleep_type() );
     const uint8_t ch   = sdk_wifi_get_channel();
     DEBUG("mon: wifi: state=%s mode=%s status=%s dhcp=%s phy=%s sleep=%s ch=%u",
-#if (HAVE_CONFIG > 0)
         sWifiStateStr(sWifiState),
-#else
-        "n/a",
-#endif
         mode, status, dhcp, phy, sleep, ch);
 
+    // estimated radio-active time, total and since the last report
+    static uint32_t sLastRadioMs;
+    static uint32_t sLastRadioTs;
+    sWifiRadioUpdate();
+    const uint32_t radioMs = sWifiRadioMs;
+    const uint32_t radioTs = sWifiRadioTs;
+    // (integer maths in per-mille, no soft-float)
+    const uint32_t radioPm = (sLastRadioTs != 0) && (radioTs != sLastRadioTs) ?
+        (uint32_t)((uint64_t)(radioMs - sLastRadioMs) * 1000 / (radioTs - sLastRadioTs)) : 0;
+    const uint32_t totalPm = radioTs != 0 ? (uint32_t)((uint64_t)radioMs * 1000 / radioTs) : 0;
+    sLastRadioMs = radioMs;
+    sLastRadioTs = radioTs;
+    DEBUG("mon: wifi: power=%s radio=%u.%us (%u.%u%%, %u.%u%% total, estimated)", configPowerStr(sWifiPower),
+        radioMs / 1000, (radioMs % 1000) / 100, radioPm / 10, radioPm % 10, totalPm / 10, totalPm % 10);
+
+    static uint32_t sLastWakeups;
+    static uint32_t sLastTime;
+    const uint32_t now = osTime();
+    const uint32_t wakeups = svWifiWakeups;
+    const uint32_t perMin10 = (sLastTime != 0) && (now != sLastTime) ? // [0.1/min]
+        (uint32_t)((uint64_t)(wakeups - sLastWakeups) * 600000 / (now - sLastTime)) : 0;
+    sLastWakeups = wakeups;
+    sLastTime = now;
+    DEBUG("mon: wifi: wakeups=%u (%u.%u/min) connect=%ums fast=%u full=%u hedged=%u failover=%u", wakeups,
+        perMin10 / 10, perMin10 % 10,
+        sWifiData.connectTime, sWifiData.nFastConnect, sWifiData.nFullConnect, sWifiData.nHedged, sWifiData.nFailover);
+    for (int ix = 0; ix < sWifiData.nBackends; ix++)
+    {
+        const WIFI_BACKEND_t *pkBackend = &sWifiData.backends[ix];
+        DEBUG("mon: wifi: backend %d%s %s connect=%ums fails=%u okay=%u fail=%u dns=%us", ix,
+            pkBackend == sWifiData.pBackend ? "*" : "", pkBackend->host, pkBackend->connectTime,
+            pkBackend->fails, pkBackend->nOkay, pkBackend->nFail,
+            pkBackend->hostIpTs != 0 ? (now - pkBackend->hostIpTs) / 1000 : 0);
+    }
+    DEBUG("mon: wifi: assoc: fast=%u full=%u last="MACSTR" ch=%u ip="IPSTR, sWifiData.nFastAssoc, sWifiData.nFullAssoc,
+        MAC2STR(sWifiData.fast.bssid), sWifiData.fast.channel, IP2STR((const ip4_addr_t *)&sWifiData.fast.ip));
+    DEBUG("mon: wifi: provision: count=%u dns=%u offline=%us", sWifiData.nProvision, sWifiData.nDnsQueries,
+        sWifiData.offlineTs != 0 ? (now - sWifiData.offlineTs) / 1000 : 0);
+    httpMonStatus(&sWifiData.http);
+#if (HAVE_TLS > 0)
+    DEBUG("mon: wifi: tls: full=%u resumed=%u last=%ums session=%s", sWifiTls.nFull, sWifiTls.nResumed,
+        sWifiTls.tHandshake, sWifiTls.haveSession ? "yes" : "no");
+#endif
+
     struct ip_info ipinfo;
     sdk_wifi_get_ip_info(STATION_IF, &ipinfo);
 #if LWIP_NETIF_HOSTNAME
@@ -582,26 +2140,39 @@ void wifiMonStatus(void)
     {
         name = "???";
     }
-    DEBUG("mon: wifi: name=%s ssid="FF_CFG_STASSID" pass=%d", name, sizeof(FF_CFG_STAPASS) - 1);
+    DEBUG("mon: wifi: name=%s ssid=%s pass=%d", name, sWifiCred.ssid, strlen(sWifiCred.pass));
     uint8_t mac[6];
     sdk_wifi_get_macaddr(STATION_IF, mac);
     DEBUG("mon: wifi: ip="IPSTR" mask="IPSTR" gw="IPSTR" mac="MACSTR,
         IP2STR(&ipinfo.ip), IP2STR(&ipinfo.netmask), IP2STR(&ipinfo.gw), MAC2STR(mac));
 }
 
+// {"state":state,"status":station status,"ch":channel,"rssi":dBm,"ip":ip,"name":hostname,
+//  "power":power mode,"radio":estimated radio-active time [ms],"relay":LAN relay role}
+int wifiGetStatusJson(char *str, const int size)
+{
+    struct ip_info ipinfo;
+    sdk_wifi_get_ip_info(STATION_IF, &ipinfo);
+    const int len = snprintf(str, size,
+        "{\"state\":\"%s\",\"status\":\"%s\",\"ch\":%u,\"rssi\":%d,\"ip\":\""IPSTR"\",\"name\":\"%s\",\"power\":\"%s\",\"radio\":%u,\"relay\":\"%s\"}",
+        sWifiStateStr(sWifiState),
+        sdkStationConnectStatusStr( sdk_wifi_station_get_connect_status() ), sdk_wifi_get_channel(),
+        sdk_wifi_station_get_rssi(), IP2STR(&ipinfo.ip), sWifiData.staName, configPowerStr(sWifiPower), sWifiRadioMs, relayRoleStr());
+    return (len > 0) && (len < size) ? len : 0;
+}
+
 
 //#define PHY_MODE PHY_MODE_11N // doesn't work well
 #define PHY_MODE PHY_MODE_11G
 
-#define SLEEP_MODE WIFI_SLEEP_MODEM
-//#define SLEEP_MODE WIFI_SLEEP_LIGHT
-//#define SLEEP_MODE WIFI_SLEEP_NONE
-
 void wifiInit(void)
 {
     DEBUG("wifi: init");
 
     memset(&sWifiData, 0, sizeof(sWifiData));
+    static StaticSemaphore_t sConnSem;
+    sWifiData.connSem = xSemaphoreCreateBinaryStatic(&sConnSem);
+    httpInit(&sWifiData.http, sWifiWrite, sWifiRecv);
     getSystemName(sWifiData.staName, sizeof(sWifiData.staName));
 
     //sdk_wifi_status_led_install(2, PERIPHS_IO_MUX_GPIO2_U, FUNC_GPIO2);
@@ -638,22 +2209,17 @@ void wifiInit(void)
         }
     }
 #endif // PHY_MODE
-#ifdef SLEEP_MODE
-    //if (sdk_wifi_get_sleep_type() != SLEEP_MODE)
-    {
-        if (!sdk_wifi_set_sleep_type(SLEEP_MODE))
-        {
-            ERROR("wifi: sdk_wifi_set_sleep_type("STRINGIFY(SLEEP_MODE)") fail!");
-            //return false;
-        }
-    }
-#endif // SLEEP_MODE
 
-    struct sdk_station_config config =
-    {
-        .ssid = FF_CFG_STASSID, .password = FF_CFG_STAPASS, .bssid_set = false, .bssid = { 0 }
-    };
-    sdk_wifi_station_set_config(&config);
+    // power saving (as last configured, see configInit())
+    sWifiPower = CONFIG_POWER_UNKNOWN;
+    sWifiSetPower();
+
+    // the provisioned config (or the defaults)
+    sWifiCredLoad();
+
+    // try the last AP and IP config first, if we know it
+    sWifiData.haveFast = sWifiFastLoad();
+    sWifiStationConfig(sWifiData.haveFast);
 
     sdk_wifi_station_set_auto_connect(true);
 }
@@ -662,9 +2228,19 @@ void wifiStart(void)
 {
     DEBUG("wifi: start");
 
-    static StackType_t sWifiTaskStack[768];
+#if (HAVE_TLS > 0)
+    static StackType_t sWifiTaskStack[STACK_SIZE(WIFI_TLS)];
+    const char *stackId = "WIFI_TLS";
+#elif defined(FF_CFG_OTAKEY)
+    static StackType_t sWifiTaskStack[STACK_SIZE(WIFI_OTA)];
+    const char *stackId = "WIFI_OTA";
+#else
+    static StackType_t sWifiTaskStack[STACK_SIZE(WIFI)];
+    const char *stackId = "WIFI";
+#endif
     static StaticTask_t sWifiTaskTCB;
     xTaskCreateStatic(sWifiTask, "ff_wifi", NUMOF(sWifiTaskStack), NULL, 4, sWifiTaskStack, &sWifiTaskTCB);
+    monRegisterStack("ff_wifi", stackId, NUMOF(sWifiTaskStack));
 }
 
 /* ********************************************************************************************** */
@@ -8,6 +8,28 @@
     \defgroup FF_WIFI WIFI
     \ingroup FF
 
+    The last AP (BSSID and channel) and DHCP lease are kept in flash, and the next connect first tries
+    these, which skips the scan and DHCP. Optionally, a static IP config can be given in the config
+    file (STAIP, STAMASK, STAGW and STADNS, e.g. STAIP "192.168.1.10"), which is then always used.
+
+    BACKENDURL can be a space-separated list of (up to three) backends, in the order of preference.
+    The wifi task connects to the best one (fewest recent failures, fastest connect, the last good one
+    is kept in flash). If that doesn't connect within a short time, it also connects to the next one
+    in parallel, and keeps whichever connects first. If there's no hello, it fails over to the others.
+    All https backends must have the same certificate (BACKENDFPR).
+
+    The STASSID, STAPASS and BACKENDURL from the config file are only the defaults. When there are
+    none, or when asked to (a very long press of the button, see button.h and wifiStartProvisioning()),
+    the device goes into the provisioning mode for #WIFI_PROV_TIMEOUT: It opens the (open) access point "<name>-setup" (see
+    getSystemName()) at #WIFI_PROV_IP, answers all DNS queries with that address (so that phones show
+    the captive portal), and the HTTP server (see httpd.h) serves a form for the SSID, the password
+    and the backend URL(s). Those are stored in flash (#FLASH_SNAP_WIFI) and are used instead of
+    the defaults from then on. Then (or on timeout) the access point is closed again and the station
+    connects. Everything the provisioning needs (the DNS responder, the DHCP server and the access
+    point) is only there in the provisioning mode. As the access point and the form are not protected,
+    a device that has a config never goes there by itself (e.g. when the AP is gone for a while), but
+    only when someone is there to push the button.
+
     @{
 */
 #ifndef __WIFI_H__
@@ -15,6 +37,24 @@
 
 #include "stdinc.h"
 
+//! maximum length of the SSID
+#define WIFI_SSID_MAX     32
+
+//! maximum length of the password
+#define WIFI_PASS_MAX     64
+
+//! maximum length of a backend URL
+#define WIFI_URL_MAX     160
+
+//! maximum length of the (space-separated) list of backend URLs
+#define WIFI_URLS_MAX    320
+
+//! provisioning mode ends after this long (if there is a config to go back to) [s]
+#define WIFI_PROV_TIMEOUT  (5 * 60)
+
+//! address of the access point in the provisioning mode (and of our DNS and HTTP server)
+#define WIFI_PROV_IP      "192.168.4.1"
+
 //! initialise
 void wifiInit(void);
 
@@ -23,4 +63,31 @@ void wifiStart(void);
 
 void wifiMonStatus(void);
 
+//! drop the backend (or broker) connection and reconnect (immediately, at the next wake-up of the wifi task)
+void wifiReconnect(void);
+
+//! go to the provisioning mode (immediately, at the next wake-up of the wifi task)
+void wifiStartProvisioning(void);
+
+//! get wifi status
+/*!
+    \param[out] str   buffer for the status (compact JSON with state, RSSI, IP, etc.)
+    \param[in]  size  size of the buffer
+    \returns the length of the status string, or 0 if the buffer was too small
+*/
+int wifiGetStatusJson(char *str, const int size);
+
+//! check if we're in the provisioning mode
+bool wifiIsProvisioning(void);
+
+//! store new wifi and backend config (in the provisioning mode)
+/*!
+    \param[in] ssid  SSID (up to #WIFI_SSID_MAX characters)
+    \param[in] pass  password (up to #WIFI_PASS_MAX characters, empty for an open network)
+    \param[in] urls  space-separated list of backend URLs (up to #WIFI_URLS_MAX characters), or empty to
+                     keep the current ones
+    \returns true if the config was stored (and the provisioning mode ends shortly), false otherwise
+*/
+bool wifiProvision(const char *ssid, const char *pass, const char *urls);
+
 #endif // __WIFI_H__
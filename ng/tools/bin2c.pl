@@ -0,0 +1,37 @@
+#!/usr/bin/perl
+################################################################################
+#
+# convert binary data to a C array
+#
+# Usage: gzip -9 -n -c foo.html | bin2c <name>
+#
+# Copyright (c) 2018 Philippe Kehl <flipflip at oinkzwurgl dot org>
+# https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+#
+################################################################################
+
+use strict;
+use warnings;
+
+die("Usage: ... | $0 <name>") unless ($#ARGV == 0);
+
+my $name = $ARGV[0];
+my $guard = '__' . uc($name) . '_GEN_H__';
+
+binmode(STDIN);
+my $data = do { local $/; <STDIN> };
+$data = '' unless (defined $data);
+my @bytes = unpack('C*', $data);
+
+print("// generated by tools/bin2c.pl, do not edit\n");
+print("#ifndef $guard\n");
+print("#define $guard\n");
+print("static const uint8_t ${name}[] =\n{");
+for (my $ix = 0; $ix <= $#bytes; $ix++)
+{
+    print(($ix % 16) == 0 ? "\n   " : '', sprintf(' 0x%02x,', $bytes[$ix]));
+}
+print("\n};\n");
+print("#endif // $guard\n");
+
+# eof
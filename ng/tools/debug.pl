@@ -22,6 +22,22 @@ use IO::Handle;
 
 my $debug = 0;
 my $n = 0;
+my $trace = 0;                               # decode trace dumps (see src/trace.h)
+my $elf = '';                                # symbolise crash dumps against this
+my $objdump = 'xtensa-lx106-elf-objdump';    # ..using this
+my $csv = '';                                # write the monitor telemetry to this file
+foreach my $opt (@ARGV[1..$#ARGV])
+{
+    if    ($opt eq 'trace')                { $trace = 1; }
+    elsif ($opt =~ m{^elf=(.+)$})          { $elf = $1; }
+    elsif ($opt =~ m{^objdump=(.+)$})      { $objdump = $1; }
+    elsif ($opt =~ m{^csv=(.+)$})          { $csv = $1; }
+    else
+    {
+        printf(STDERR "ERROR: Illegal option '%s'!\n", $opt);
+        @ARGV = ();
+    }
+}
 
 STDOUT->autoflush(1);
 #sed 's/\x1b[^m]*m//g'
@@ -41,6 +57,15 @@ if ($ARGV[0] && ($ARGV[0] =~ m@^(/dev/[^:]+|COM\d)(?::(\d+)|)$@))
         printf(STDERR "ERROR: Failed opening serial port '%s', baudrate %i!\n", $port, $br);
     }
 }
+elsif ($ARGV[0] && (-f $ARGV[0]))
+{
+    my $file = $ARGV[0];
+    printf("file: [%s]\n", $file);# if ($debug);
+    unless ($inputFunc = createHandleFile($file))
+    {
+        printf(STDERR "ERROR: Failed opening file '%s'!\n", $file);
+    }
+}
 elsif ($ARGV[0] && ($ARGV[0] =~ m@^([^:]+)(?::(\d+)|)@))
 {
     my $host = $1;
@@ -55,9 +80,14 @@ elsif ($ARGV[0] && ($ARGV[0] =~ m@^([^:]+)(?::(\d+)|)@))
 unless ($inputFunc)
 {
     print(STDERR "\n\n");
-    print(STDERR "Usage: $0 <device>:<baudrate> | <host>:<port>\n");
+    print(STDERR "Usage: $0 <device>:<baudrate> | <host>:<port> | <logfile> [trace] [elf=<elf> [objdump=<objdump>]] [csv=<csvfile>]\n");
+    print(STDERR "\n");
+    print(STDERR "E.g. $0 /dev/ttyUSB0:115200   or   $0 localhost:6454   or   $0 debug.log elf=build/ng.out\n");
     print(STDERR "\n");
-    print(STDERR "E.g. $0 /dev/ttyUSB0:115200   or   $0 localhost:6454\n");
+    print(STDERR "With 'trace' the output of the 'trace' backend command is shown as a timeline (and per task).\n");
+    print(STDERR "With 'elf' the code addresses in fatal exception dumps, and the allocation sites, are symbolised\n");
+    print(STDERR "(using objdump, default $objdump, and the corresponding addr2line).\n");
+    print(STDERR "With 'csv' the monitor output ('mon: ...' lines) is written to a CSV file (time,round,module,key,value).\n");
     print(STDERR "\n\n");
     exit(1);
 }
@@ -80,12 +110,32 @@ my %colours =
 );
 
 
+################################################################################
+# decoder tables (up here, before the main loop)
+
+# trace events (same order as TRACE_EV_t in src/trace.h)
+my @TRACEEVS = ('none', 'wifi recv', 'backend line', 'jenkins set', 'jenkins update', 'leds state',
+                'leds frame', 'leds flush');
+
+# fatal exception causes (see doc/esp8266_reset_causes_and_common_fatal_exception_causes_en.pdf)
+my %EXCCAUSES =
+(
+    0 => 'IllegalInstruction', 2 => 'InstructionFetchError', 3 => 'LoadStoreError',
+    4 => 'Level1Interrupt', 5 => 'Alloca', 6 => 'IntegerDivideByZero', 9 => 'LoadStoreAlignment',
+    20 => 'InstFetchProhibited', 28 => 'LoadProhibited', 29 => 'StoreProhibited',
+);
+
+
 ################################################################################
 # wait for input data, parse it and display it
 
+symbolsLoad($elf) if ($elf);
+csvOpen($csv) if ($csv);
+
 my $t0 = time();
 my $rxbuf = '';
-while (!$ABORT)
+my $eof = 0;
+while (!$ABORT && !$eof)
 {
     # get more input (rx)
     my $data = $inputFunc->();
@@ -101,7 +151,7 @@ while (!$ABORT)
                    unpack('C*', $data)));
         }
     }
-    else
+    elsif (!$eof)
     {
         usleep(10e3);
     }
@@ -139,9 +189,334 @@ while (!$ABORT)
         {
             printf("%s[%i]\n", $msg->{_name}, $msg->{_size});
         }
+        if ($trace && ($msg->{_name} eq 'DEBUG') && ($msg->{_str} =~ m{^D: trace: (.+)$}))
+        {
+            traceLine($1);
+        }
+        if (($msg->{_name} eq 'DEBUG') && ($msg->{_str} =~ m{^D: mon: (.+)$}))
+        {
+            monLine($1, time() - $t0);
+        }
+        if ($msg->{_name} eq 'ASCII')
+        {
+            crashLine($msg->{_str});
+        }
+    }
+}
+
+
+################################################################################
+# trace dump decoder
+
+my @traceRecs = ();
+my $traceMhz = 80;
+
+sub traceLine
+{
+    my ($str) = @_;
+    if ($str =~ m{^start n=\d+ total=\d+ mhz=(\d+)})
+    {
+        @traceRecs = ();
+        $traceMhz = $1 || 80;
+    }
+    elsif ($str =~ m{^([0-9a-f]{8}) (\d+) (\d+)(?: (\d+)|)$})
+    {
+        push(@traceRecs, [ hex($1), $2, $3, $4 ]);
+    }
+    elsif ($str eq 'end')
+    {
+        traceRender();
+        @traceRecs = ();
+    }
+}
+
+# print the events as a timeline (relative to the first event, the cycle counter may wrap), and where
+# the time goes from receiving data to sending it to the LEDs
+sub traceRender
+{
+    return if ($#traceRecs < 0);
+    my $t = 0;
+    my $prevTs = $traceRecs[0]->[0];
+    my $prevT = 0;
+    my @stages = ();  # [ ev, t ] from "wifi recv" until "leds flush"
+    my %stageDts = ();
+    my @stageKeys = ();
+    my @latencies = ();
+    my %tasks = ();   # task => [ [ t, name, arg ], ... ]
+    print("--- trace timeline ($traceMhz MHz) ---\n");
+    foreach my $rec (@traceRecs)
+    {
+        my ($ts, $ev, $arg, $task) = @{$rec};
+        $t += (($ts - $prevTs) & 0xffffffff) / $traceMhz; # [us]
+        $prevTs = $ts;
+        my $name = $TRACEEVS[$ev] || "ev$ev";
+        my $taskName = defined $task ? traceTaskName($task) : '';
+        printf("%12.1fus %+10.1fus %-30s %5u %-12s |%s\n", $t, $t - $prevT, $name, $arg, $taskName,
+               '-' x ( (($t - $prevT) > 1) ? (log($t - $prevT) / log(10) * 8) : 0 ));
+        $prevT = $t;
+        push(@{$tasks{$taskName}}, [ $t, $name, $arg ]) if (defined $task);
+
+        if ($name eq 'wifi recv')
+        {
+            @stages = ([ $name, $t ]) unless (@stages);
+        }
+        elsif (@stages)
+        {
+            push(@stages, [ $name, $t ]) unless (grep { $_->[0] eq $name } @stages);
+            if ($name eq 'leds flush')
+            {
+                push(@latencies, $t - $stages[0]->[1]);
+                for (my $ix = 1; $ix <= $#stages; $ix++)
+                {
+                    my $key = "$stages[$ix - 1]->[0] -> $stages[$ix]->[0]";
+                    push(@stageKeys, $key) unless ($stageDts{$key});
+                    push(@{$stageDts{$key}}, $stages[$ix]->[1] - $stages[$ix - 1]->[1]);
+                }
+                @stages = ();
+            }
+        }
+    }
+    print("--- latency (wifi recv -> leds flush) ---\n");
+    foreach my $key (@stageKeys)
+    {
+        printf("%-40s %s\n", $key, traceStats(@{$stageDts{$key}}));
+    }
+    printf("%-40s %s\n", 'total', traceStats(@latencies));
+
+    # the same per task, and the gaps between the task's events (i.e. where it was doing other things,
+    # or waiting, or other tasks were running)
+    foreach my $taskName (sort keys %tasks)
+    {
+        print("--- task $taskName ---\n");
+        my $prevTaskT = $tasks{$taskName}->[0]->[0];
+        my @gaps = ();
+        foreach my $ev (@{$tasks{$taskName}})
+        {
+            my ($evT, $name, $arg) = @{$ev};
+            printf("%12.1fus %+10.1fus %-30s %5u\n", $evT, $evT - $prevTaskT, $name, $arg);
+            push(@gaps, $evT - $prevTaskT) if ($evT > $prevTaskT);
+            $prevTaskT = $evT;
+        }
+        printf("%-40s %s\n", 'gaps', traceStats(@gaps));
+    }
+    print("---\n");
+}
+
+# task names from the monitor output ("mon: tsk: <number> <name> ...", see monLine())
+my %taskNames = ();
+
+sub traceTaskName
+{
+    my ($task) = @_;
+    return $taskNames{$task} || ($task ? "task$task" : 'none');
+}
+
+sub traceStats
+{
+    my @vals = sort { $a <=> $b } @_;
+    return 'n/a' if ($#vals < 0);
+    my $sum = 0;
+    $sum += $_ for (@vals);
+    return sprintf('n=%u min=%.1fus mean=%.1fus max=%.1fus', $#vals + 1, $vals[0], $sum / ($#vals + 1), $vals[-1]);
+}
+
+
+################################################################################
+# symbols (for the crash dumps and allocation sites), see also tools/symbols.pl
+
+# (note that the main loop runs before the initialisers down here, so none of these must be needed)
+my @symbols;    # [ addr, size, name ] of the code symbols, sorted by address
+my %symLines;   # addr => "file:line" (from addr2line)
+my $addr2line;  # addr2line to use, if any
+
+sub symbolsLoad
+{
+    my ($file) = @_;
+    unless (-f $file)
+    {
+        printf(STDERR "WARNING: No ELF file '%s', not symbolising!\n", $file);
+        return;
+    }
+    my $fh;
+    unless (open($fh, '-|', $objdump, '-t', $file))
+    {
+        printf(STDERR "WARNING: Failed running '%s': %s\n", $objdump, $!);
+        return;
+    }
+    my @syms = ();
+    while (my $line = <$fh>)
+    {
+        # e.g. "40201234 g     F .irom0.text	00000034 sJenkinsUpdate"
+        if ($line =~ m{^([0-9a-fA-F]{8})\s.{6}F\s+\S+\s+([0-9a-fA-F]+)\s+(\S+)})
+        {
+            my ($addr, $size, $name) = (hex($1), hex($2), $3);
+            push(@syms, [ $addr, $size, $name ]) if (symbolsIsCode($addr));
+        }
+    }
+    close($fh);
+    @symbols = sort { $a->[0] <=> $b->[0] } @syms;
+
+    ($addr2line = $objdump) =~ s{objdump$}{addr2line};
+    $addr2line = undef if ( ($addr2line eq $objdump) || !grep { -x "$_/$addr2line" || -x $addr2line } split(':', $ENV{PATH} || ''));
+    printf("symbols: %u from [%s]%s\n", $#symbols + 1, $file, $addr2line ? " (and $addr2line)" : '');
+}
+
+# iRAM (0x40100000 0x8000) and iROM (0x40200000 0x5c000), like in the Makefile
+sub symbolsIsCode
+{
+    my ($addr) = @_;
+    return ( (($addr >= 0x40100000) && ($addr < 0x40108000)) || (($addr >= 0x40200000) && ($addr < 0x4025c000)) );
+}
+
+# "sym+0xoff (file:line)" for a code address, or undef
+sub symbolsLookup
+{
+    my ($addr) = @_;
+    return undef if ( ($#symbols < 0) || !symbolsIsCode($addr) );
+    my ($lo, $hi) = (0, $#symbols);
+    while ($lo < $hi) # find last symbol <= addr
+    {
+        my $mid = int(($lo + $hi + 1) / 2);
+        if ($symbols[$mid]->[0] <= $addr) { $lo = $mid; } else { $hi = $mid - 1; }
+    }
+    my ($symAddr, $symSize, $name) = @{$symbols[$lo]};
+    return undef if ( ($symAddr > $addr) || ($symSize && ($addr >= ($symAddr + $symSize))) );
+
+    unless (defined $symLines{$addr})
+    {
+        $symLines{$addr} = '';
+        if ($addr2line && open(my $fh, '-|', $addr2line, '-e', $elf, sprintf('0x%08x', $addr)))
+        {
+            my $line = <$fh> || '';
+            close($fh);
+            $line =~ s{[\r\n]+$}{};
+            $symLines{$addr} = $line if ($line && ($line !~ m{^\?\?}));
+        }
+    }
+    return sprintf('%s+0x%x', $name, $addr - $symAddr) . ($symLines{$addr} ? " ($symLines{$addr})" : '');
+}
+
+
+################################################################################
+# fatal exception decoder (the esp-open-rtos dump, see core/debug_dumps.c)
+
+my $crashStack;   # code addresses found on the stack (possible backtrace), undef if not in a stack dump
+
+sub crashLine
+{
+    my ($str) = @_;
+    $str =~ s{(\\[rn])+$}{};
+
+    if ($str =~ m{^Fatal exception \((\d+)\)})
+    {
+        printf("%s--> %s%s\n", $colours{ERROR}, $EXCCAUSES{$1} || "cause $1", $colours{_OFF_});
+        $crashStack = undef;
+    }
+    elsif ($str =~ m{^Stack: SP=})
+    {
+        $crashStack = [];
+    }
+
+    # symbolise all code addresses (epc1, a0, stack contents, ...)
+    my @addrs = map { hex($_) } ($str =~ m{\b0x(4[0-9a-fA-F]{7})\b}g);
+    foreach my $addr (@addrs)
+    {
+        my $sym = symbolsLookup($addr);
+        next unless ($sym);
+        printf("%s--> 0x%08x %s%s\n", $colours{NOTICE}, $addr, $sym, $colours{_OFF_});
+        push(@{$crashStack}, $addr) if ($crashStack);
+    }
+
+    # the stack dump ends with the heap info
+    if ($crashStack && (($str eq '') || ($str =~ m{^Free Heap})))
+    {
+        if ($#{$crashStack} > -1)
+        {
+            printf("%s--> possible backtrace (code addresses on the stack, innermost first):%s\n", $colours{ERROR}, $colours{_OFF_});
+            printf("%s-->   %2u 0x%08x %s%s\n", $colours{ERROR}, $_, $crashStack->[$_], symbolsLookup($crashStack->[$_]), $colours{_OFF_})
+                for (0 .. $#{$crashStack});
+        }
+        $crashStack = undef;
+    }
+}
+
+
+################################################################################
+# monitor telemetry ("mon: <module>: [<what> ...] key=value ...") to CSV
+
+my $csvFh;      # CSV output file, if any
+my $monRound;   # counts the "mon: sys: ..." lines (the first of each monitor output)
+
+sub csvOpen
+{
+    my ($file) = @_;
+    if (open($csvFh, '>', $file))
+    {
+        $csvFh->autoflush(1);
+        print($csvFh "time,round,module,key,value\n");
+    }
+    else
+    {
+        printf(STDERR "ERROR: Failed opening CSV file '%s': %s\n", $file, $!);
+        $csvFh = undef;
+    }
+}
+
+sub monLine
+{
+    my ($str, $t) = @_;
+
+    # task list, e.g. "tsk: 05 ff_jenkins       B  3- 3  143   0.4%", for the trace timeline and the CSV
+    if ($str =~ m{^tsk: (\d+) (\S+)\s+(\S) +(\d+)- *(\d+) +(\d+) +([<\d.]+)%})
+    {
+        my ($num, $name, $state, $prio, $stack, $cpu) = (1 * $1, $2, $3, $4, $6, $7);
+        $taskNames{$num} = $name;
+        csvRow($t, 'tsk', "$name.prio", $prio);
+        csvRow($t, 'tsk', "$name.stack", $stack);
+        csvRow($t, 'tsk', "$name.cpu", $cpu);
+        return;
+    }
+
+    # allocation sites are caller addresses
+    if ( ($str =~ m{^mem: site 0x([0-9a-f]{8}) }) && $elf )
+    {
+        my $sym = symbolsLookup(hex($1));
+        printf("%s--> %s%s\n", $colours{NOTICE}, $sym, $colours{_OFF_}) if ($sym);
+    }
+
+    return unless ($csvFh && ($str =~ m{^(\w+): (.+)$}));
+    my ($module, $rest) = ($1, $2);
+    $monRound++ if ($module eq 'sys');
+
+    # words before the first key=value qualify the keys (e.g. "backend 0", "pool blk")
+    my @prefix = ();
+    my $haveKv = 0;
+    foreach my $word (split(/\s+/, $rest))
+    {
+        if ($word =~ m{^([^=]+)=(.*)$})
+        {
+            my ($key, $value) = ($1, $2);
+            $value =~ s{,$}{};
+            csvRow($t, $module, join('.', @prefix, $key), $value);
+            $haveKv = 1;
+        }
+        elsif (!$haveKv && ($word !~ m{^\(.*\)$}))
+        {
+            $word =~ s{:$}{};
+            push(@prefix, $word);
+        }
     }
 }
 
+sub csvRow
+{
+    my ($t, $module, $key, $value) = @_;
+    return unless ($csvFh);
+    $value =~ s{"}{""}g;
+    printf($csvFh "%.3f,%u,%s,%s,%s\n", $t, $monRound || 0, $module, $key,
+           $value =~ m{[,"\s]} ? "\"$value\"" : $value);
+}
+
 
 ################################################################################
 # input data parser, will return undef or a structure like this:
@@ -269,6 +644,24 @@ sub createHandleSerial
 }
 
 
+################################################################################
+# input function for a (saved) log file, sets $eof at the end
+
+sub createHandleFile
+{
+    my ($file) = @_;
+
+    open(my $fh, '<:raw', $file) || return undef;
+    return sub
+    {
+        my $data;
+        return $data if (read($fh, $data, 4096));
+        $eof = 1;
+        return '';
+    };
+}
+
+
 ################################################################################
 # input function for Art-Net DiagData input
 
@@ -0,0 +1,607 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host-side firmware micro-benchmarks
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    Runs the firmware's hot paths on the workstation (against the simulated SDK in tools/host/) and
+    reports throughput and latency:
+
+    - backend lines (JSON "status" and binary "bstatus") parsed into the Jenkins channels,
+    - the Jenkins update (channels to LED states) that follows,
+    - config JSON parsed (jsmn tokens),
+    - LED frames rendered (effects and effect programs, hsv2rgbN(), driver format) and "sent" via the simulated SPI or
+      I2S DMA, for all drivers,
+    - RTTTL notes iterated.
+
+    Build and run with "make host-bench", optionally with "SANITIZE=1" (address and undefined
+    behaviour sanitizers), and e.g. "perf record build/host-bench" for profiles. The optional
+    argument scales the number of iterations ("build/host-bench 0.1" for a quick run with the
+    sanitizers). It exits with a failure if the config can't be parsed or a bench fails otherwise, so
+    that it can serve as a regression check.
+
+    With "replay <file>" (or "replay -" for stdin) it instead feeds a backend stream to the firmware,
+    line by line as it arrives, and reports the parse time and the line to LEDs latency per line type.
+    tools/tschenggins-stream.pl records such streams and replays them at N times the original speed,
+    e.g. "tools/tschenggins-stream.pl replay -i stream.txt -x 10 | build/host-bench replay -".
+
+    The LEDs module is included here so that the benchmark can reach its internals (there's no LEDs
+    task in the host build, the benchmark renders the frames itself).
+*/
+
+#include "../src/leds.c"
+
+#include <errno.h>
+#include <ctype.h>
+
+#include "backend.h"
+#include "jenkins.h"
+#include "config.h"
+#include "json.h"
+#include "flash.h"
+#include "rtttl.h"
+
+#include "host.h"
+
+// not static in jenkins.c, the Jenkins task calls it for each notification
+void sJenkinsUpdate(void);
+
+/* ***** measurements **************************************************************************** */
+
+#define BENCH_MAX_SAMPLES 200000
+
+typedef struct BENCH_s
+{
+    const char *name;
+    const char *unit;
+    uint64_t    t0;
+    uint32_t    nSamples;
+    uint32_t    samples[BENCH_MAX_SAMPLES]; // [ns]
+} BENCH_t;
+
+static BENCH_t sBench;
+static double  sBenchScale = 1.0;
+
+static uint64_t sBenchNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+static int sBenchNum(const int num)
+{
+    const int n = (int)((double)num * sBenchScale);
+    return n < 1 ? 1 : (n > BENCH_MAX_SAMPLES ? BENCH_MAX_SAMPLES : n);
+}
+
+static void sBenchStart(BENCH_t *pBench, const char *name, const char *unit)
+{
+    pBench->name = name;
+    pBench->unit = unit;
+    pBench->nSamples = 0;
+}
+
+static inline void sBenchAdd(BENCH_t *pBench, const uint64_t dt)
+{
+    if (pBench->nSamples < NUMOF(pBench->samples))
+    {
+        pBench->samples[pBench->nSamples++] = dt > UINT32_MAX ? UINT32_MAX : (uint32_t)dt;
+    }
+}
+
+static inline void sBenchEnter(BENCH_t *pBench)
+{
+    pBench->t0 = sBenchNs();
+}
+
+static inline void sBenchLeave(BENCH_t *pBench)
+{
+    sBenchAdd(pBench, sBenchNs() - pBench->t0);
+}
+
+static int sBenchCmp(const void *a, const void *b)
+{
+    const uint32_t sa = *(const uint32_t *)a;
+    const uint32_t sb = *(const uint32_t *)b;
+    return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
+static void sBenchReport(BENCH_t *pBench, const char *extra)
+{
+    const uint32_t n = pBench->nSamples;
+    if (n == 0)
+    {
+        return;
+    }
+    uint64_t sum = 0;
+    for (uint32_t ix = 0; ix < n; ix++)
+    {
+        sum += pBench->samples[ix];
+    }
+    qsort(pBench->samples, n, sizeof(*pBench->samples), sBenchCmp);
+    const double rate = (double)n * 1e9 / (double)sum;
+    printf("%-22s %10.0f %-7s  latency [us] min %7.2f med %7.2f p99 %7.2f max %8.2f  (n=%u)%s%s\n",
+        pBench->name, rate, pBench->unit,
+        (double)pBench->samples[0] * 1e-3, (double)pBench->samples[n / 2] * 1e-3,
+        (double)pBench->samples[(n * 99) / 100] * 1e-3, (double)pBench->samples[n - 1] * 1e-3,
+        n, extra != NULL ? "  " : "", extra != NULL ? extra : "");
+    fflush(stdout);
+}
+
+
+/* ***** backend and Jenkins ********************************************************************* */
+
+static const char * const skBenchStates[]  = { "running", "idle", "running", "idle" };
+static const char * const skBenchResults[] = { "success", "unstable", "failure", "success" };
+
+// "status <ts> [[0,"job-00","server-a","running","success",<ts>],...]"
+static int sBenchMakeStatus(char *line, const int size, const uint32_t ts, const int n)
+{
+    int len = snprintf(line, size, "status %u [", ts);
+    for (int ix = 0; ix < JENKINS_MAX_CH; ix++)
+    {
+        const int v = (ix + n) % NUMOF(skBenchStates);
+        len += snprintf(&line[len], size - len, "%s[%d,\"project-%02d/branch-%d\",\"server-%c\",\"%s\",\"%s\",%u]",
+            ix > 0 ? "," : "", ix, ix, n % 3, 'a' + (ix % 3), skBenchStates[v], skBenchResults[v], ts - (ix * 60));
+    }
+    len += snprintf(&line[len], size - len, "]\n");
+    return len;
+}
+
+// "bstatus <ts> <base64>" ([ch:8] [state:4|result:4] [ts:32], see backend.c)
+static int sBenchMakeBinStatus(char *line, const int size, const uint32_t ts, const int n)
+{
+    uint8_t recs[JENKINS_MAX_CH * 6];
+    for (int ix = 0; ix < JENKINS_MAX_CH; ix++)
+    {
+        const int v = (ix + n) % 4;
+        const uint32_t t = ts - (ix * 60);
+        uint8_t *pRec = &recs[ix * 6];
+        pRec[0] = ix;
+        pRec[1] = ((v % 2 ? JENKINS_STATE_IDLE : JENKINS_STATE_RUNNING) << 4) |
+            (v == 1 ? JENKINS_RESULT_UNSTABLE : (v == 2 ? JENKINS_RESULT_FAILURE : JENKINS_RESULT_SUCCESS));
+        pRec[2] = t >> 24; pRec[3] = t >> 16; pRec[4] = t >> 8; pRec[5] = t;
+    }
+    // (base64enc() wants a string)
+    static const char skChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char b64[(sizeof(recs) / 3 * 4) + 1];
+    int len = 0;
+    for (int ix = 0; ix < (int)sizeof(recs); ix += 3)
+    {
+        const uint32_t l = ((uint32_t)recs[ix] << 16) | ((uint32_t)recs[ix + 1] << 8) | (uint32_t)recs[ix + 2];
+        b64[len++] = skChars[(l >> 18) & 0x3f];
+        b64[len++] = skChars[(l >> 12) & 0x3f];
+        b64[len++] = skChars[(l >>  6) & 0x3f];
+        b64[len++] = skChars[ l        & 0x3f];
+    }
+    b64[len] = '\0';
+    return snprintf(line, size, "bstatus %u %s\n", ts, b64);
+}
+
+static void sBenchBackend(void)
+{
+    const int num = sBenchNum(20000);
+    static char sLines[16][2048];
+    static int  sLens[NUMOF(sLines)];
+    static char sLine[2048];
+    const uint32_t ts = 1530000000;
+    uint64_t nBytes = 0;
+
+    // JSON status lines, as the in-place parsing modifies the data we need fresh copies
+    for (int ix = 0; ix < (int)NUMOF(sLines); ix++)
+    {
+        sLens[ix] = sBenchMakeStatus(sLines[ix], sizeof(sLines[ix]), ts + ix, ix);
+    }
+    sBenchStart(&sBench, "backend status", "lines/s");
+    for (int n = 0; n < num; n++)
+    {
+        const int ix = n % NUMOF(sLines);
+        memcpy(sLine, sLines[ix], sLens[ix]);
+        nBytes += sLens[ix];
+        sBenchEnter(&sBench);
+        backendHandle(sLine, sLens[ix]);
+        sBenchLeave(&sBench);
+        sJenkinsUpdate();
+    }
+    char str[100];
+    snprintf(str, sizeof(str), "%d bytes/line", (int)(nBytes / num));
+    sBenchReport(&sBench, str);
+
+    // the update that the Jenkins task does after each line
+    sBenchStart(&sBench, "jenkins update", "upd/s");
+    for (int n = 0; n < num; n++)
+    {
+        const int ix = n % NUMOF(sLines);
+        memcpy(sLine, sLines[ix], sLens[ix]);
+        backendHandle(sLine, sLens[ix]);
+        sBenchEnter(&sBench);
+        sJenkinsUpdate();
+        sBenchLeave(&sBench);
+    }
+    sBenchReport(&sBench, NULL);
+
+    // binary status lines
+    nBytes = 0;
+    for (int ix = 0; ix < (int)NUMOF(sLines); ix++)
+    {
+        sLens[ix] = sBenchMakeBinStatus(sLines[ix], sizeof(sLines[ix]), ts + ix, ix);
+    }
+    sBenchStart(&sBench, "backend bstatus", "lines/s");
+    for (int n = 0; n < num; n++)
+    {
+        const int ix = n % NUMOF(sLines);
+        memcpy(sLine, sLines[ix], sLens[ix]);
+        nBytes += sLens[ix];
+        sBenchEnter(&sBench);
+        backendHandle(sLine, sLens[ix]);
+        sBenchLeave(&sBench);
+        sJenkinsUpdate();
+    }
+    snprintf(str, sizeof(str), "%d bytes/line", (int)(nBytes / num));
+    sBenchReport(&sBench, str);
+
+    // the same split into small chunks (line framing, as from a slow connection)
+    sBenchStart(&sBench, "backend bstatus 16b", "lines/s");
+    for (int n = 0; n < num; n++)
+    {
+        const int ix = n % NUMOF(sLines);
+        memcpy(sLine, sLines[ix], sLens[ix]);
+        sBenchEnter(&sBench);
+        for (int offs = 0; offs < sLens[ix]; offs += 16)
+        {
+            backendHandle(&sLine[offs], MIN(16, sLens[ix] - offs));
+        }
+        sBenchLeave(&sBench);
+        sJenkinsUpdate();
+    }
+    sBenchReport(&sBench, NULL);
+}
+
+
+/* ***** config ********************************************************************************** */
+
+static const char skBenchConfig[] =
+    "{\"model\":\"standard\",\"driver\":\"%s\",\"order\":\"GRB\",\"bright\":\"%s\",\"noise\":\"some\","
+    "\"fps\":100,\"spiclk\":4,\"dither\":\"on\",\"leds\":%d,\"chleds\":%d,\"power\":\"none\",\"quiet\":\"22-7\",\"tzoffs\":60,"
+    "\"fx\":\"33020a55ffff640200ffff6402\"}";
+
+static bool sBenchSetConfig(const char *driver, const char *bright, const int leds, const int chLeds)
+{
+    char json[sizeof(skBenchConfig) + 100];
+    const int len = snprintf(json, sizeof(json), skBenchConfig, driver, bright, leds, chLeds);
+    return configParseJson(json, len);
+}
+
+// check that a full config (with all keys, including an effect program) is applied
+static bool sBenchConfigCheck(void)
+{
+    if (!sBenchSetConfig("WS2801", "medium", 100, 4))
+    {
+        ERROR("bench: config check parse fail");
+        return false;
+    }
+    uint8_t fx[CONFIG_FX_MAX];
+    const int fxLen = configGetFx(fx);
+    sLedsProgsCompile(fx, fxLen);
+    const bool okay =
+        (configGetDriver() == CONFIG_DRIVER_WS2801) && (configGetBright() == CONFIG_BRIGHT_MEDIUM) &&
+        (configGetLeds() == 100) && (configGetChLeds() == 4) && (configGetTzOffs() == 60) &&
+        (configGetQuietFrom() == 22) && (configGetQuietTo() == 7) &&
+        (fxLen == 13) && (fx[0] == 0x33) && (sLedsNumProgs == 1) && (sLedsProgFind(0x33) == 0);
+    if (!okay)
+    {
+        ERROR("bench: config check fail (driver=%d leds=%d fx=%d progs=%d)",
+            configGetDriver(), configGetLeds(), fxLen, sLedsNumProgs);
+    }
+    return okay;
+}
+
+static bool sBenchConfig(void)
+{
+    const int num = sBenchNum(20000);
+    static const char * const skBrights[] = { "low", "medium", "high", "full" };
+    int nFail = 0;
+    sBenchStart(&sBench, "config json", "cfg/s");
+    for (int n = 0; n < num; n++)
+    {
+        char json[sizeof(skBenchConfig) + 100];
+        const int len = snprintf(json, sizeof(json), skBenchConfig, "SK9822", skBrights[n % NUMOF(skBrights)], 150, 5);
+        sBenchEnter(&sBench);
+        if (!configParseJson(json, len))
+        {
+            nFail++;
+        }
+        sBenchLeave(&sBench);
+    }
+    sBenchReport(&sBench, NULL);
+    if (nFail > 0)
+    {
+        ERROR("bench: config %d/%d fail", nFail, num);
+        return false;
+    }
+    return true;
+}
+
+
+/* ***** LEDs ************************************************************************************ */
+
+// what the LEDs task does on config changes (see sLedsTask())
+static void sBenchLedsConfig(void)
+{
+    sLedsSetNum(configGetLeds(), configGetChLeds());
+    sLedsSetOrder(configGetOrder());
+    sLedsUpdateLut(configGetDriver(), configGetBright(), configGetDither());
+    uint8_t fx[CONFIG_FX_MAX];
+    sLedsProgsCompile(fx, configGetFx(fx));
+    sLedsClear();
+    sLedsSetAllDirty();
+}
+
+static void sBenchLedsStates(const int n)
+{
+    for (int ix = 0; ix < LEDS_NUM_CH; ix++)
+    {
+        const LEDS_FX_t skFx[] = { LEDS_FX_PULSE, LEDS_FX_FLICKER, LEDS_FX_PROGRESS, LEDS_FX_STILL };
+        const LEDS_PARAM_t param =
+        {
+            .hue = (ix * 13) + n, .sat = 255 - ix, .val = 200, .fx = skFx[(ix + n) % NUMOF(skFx)], .progress = ix * 10,
+            .tag = (ix % 3) == 0 ? 0x33 : 0 // (every third channel runs the effect program)
+        };
+        ledsSetState(ix, &param);
+    }
+}
+
+static bool sBenchLeds(const char *driver, const char *name, const int leds, const int chLeds)
+{
+    const int num = sBenchNum(20000);
+    if (!sBenchSetConfig(driver, "high", leds, chLeds))
+    {
+        ERROR("bench: config %s fail", driver);
+        return false;
+    }
+    sBenchLedsConfig();
+    const CONFIG_DRIVER_t configDriver = configGetDriver();
+    sBenchLedsStates(0);
+    HOST_SPI_STATS_t spi;
+    hostSpiStats(&spi, true);
+    uint64_t nI2s = 0;
+
+    sBenchStart(&sBench, name, "frames/s");
+    for (int n = 0; n < num; n++)
+    {
+        // change the states now and then, like the Jenkins task would
+        if ((n % 100) == 99)
+        {
+            sBenchLedsStates(n);
+        }
+        sBenchEnter(&sBench);
+        sLedsRenderFrame(configDriver);
+        hostSpiRun(LEDS_SPI);
+        nI2s += hostI2sRun();
+        sBenchLeave(&sBench);
+    }
+    hostSpiStats(&spi, false);
+    char str[100];
+    if (configDriver == CONFIG_DRIVER_WS2812)
+    {
+        snprintf(str, sizeof(str), "%u flushes, %.1f DMA bufs/flush", sLedsNumFlushes,
+            sLedsNumFlushes > 0 ? (double)nI2s / (double)sLedsNumFlushes : 0.0);
+    }
+    else
+    {
+        snprintf(str, sizeof(str), "%u flushes, %u SPI trans (%u irq), %.0f bytes/flush", sLedsNumFlushes,
+            spi.nTrans, spi.nIsr, sLedsNumFlushes > 0 ? (double)spi.nBits / 8.0 / (double)sLedsNumFlushes : 0.0);
+    }
+    sBenchReport(&sBench, str);
+    sLedsNumFrames = 0;
+    sLedsNumFlushes = 0;
+    return true;
+}
+
+
+/* ***** RTTTL *********************************************************************************** */
+
+static void sBenchRtttl(void)
+{
+    static const char * const skNames[] = { "SuperMario1", "ImperialMarch", "Tetris3", "ManiacMansion", "BeethovenElise" };
+    const int num = sBenchNum(20000);
+    uint32_t nNotes = 0;
+    int32_t sum = 0;
+    sBenchStart(&sBench, "rtttl melody", "mel/s");
+    for (int n = 0; n < num; n++)
+    {
+        const char *melody = rtttlBuiltinMelody(skNames[n % NUMOF(skNames)]);
+        if (melody == NULL)
+        {
+            ERROR("bench: no melody %s", skNames[n % NUMOF(skNames)]);
+            return;
+        }
+        RTTTL_ITER_t iter;
+        int16_t freq, dur;
+        sBenchEnter(&sBench);
+        rtttlIterInit(&iter, melody);
+        while (rtttlIterNext(&iter, &freq, &dur))
+        {
+            sum += freq + dur;
+            nNotes++;
+        }
+        sBenchLeave(&sBench);
+    }
+    char str[100];
+    snprintf(str, sizeof(str), "%.1f notes/melody (%d)", (double)nNotes / (double)num, (int)(sum & 0xff));
+    sBenchReport(&sBench, str);
+}
+
+
+/* ***** stream replay *************************************************************************** */
+
+// the line types we keep separate statistics for
+static const char * const skReplayTypes[] = { "status", "bstatus", "config", "command", "heartbeat", "session", "hello", "other" };
+
+// feed a recorded (or live) backend stream to the firmware, line by line, as it arrives (see
+// tools/tschenggins-stream.pl, which records streams and replays them at the original pace, or faster)
+static int sBenchReplay(const char *file)
+{
+    FILE *pIn = strcmp(file, "-") == 0 ? stdin : fopen(file, "r");
+    if (pIn == NULL)
+    {
+        fprintf(stderr, "cannot open %s: %s\n", file, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // start with a typical config, the stream may change it
+    if (!sBenchSetConfig("SK9822", "high", 150, 5))
+    {
+        fprintf(stderr, "config fail\n");
+        if (pIn != stdin)
+        {
+            fclose(pIn);
+        }
+        return EXIT_FAILURE;
+    }
+    sBenchLedsConfig();
+    uint32_t configVersion = configGetVersion();
+
+    static BENCH_t sParse[NUMOF(skReplayTypes)];
+    static BENCH_t sLeds[NUMOF(skReplayTypes)];
+    for (int ix = 0; ix < (int)NUMOF(skReplayTypes); ix++)
+    {
+        sBenchStart(&sParse[ix], skReplayTypes[ix], "lines/s");
+        sBenchStart(&sLeds[ix], skReplayTypes[ix], "lines/s");
+    }
+    uint32_t nLines = 0;
+    uint32_t nSkipped = 0;
+    uint32_t nReconnect = 0;
+    uint64_t nBytes = 0;
+    const uint64_t tStart = sBenchNs();
+
+    static char sLine[4096];
+    while (fgets(sLine, sizeof(sLine), pIn) != NULL)
+    {
+        // recorded streams have a "<seconds> " prefix, backend lines start with a letter
+        char *pLine = sLine;
+        if (isdigit((int)pLine[0]))
+        {
+            pLine = strchr(pLine, ' ');
+            if (pLine == NULL)
+            {
+                continue;
+            }
+            pLine++;
+        }
+        const int len = strlen(pLine);
+        // (recorded streams may have comments, and the firmware would really restart)
+        if ( (pLine[0] == '#') || (pLine[0] == '\n') || (strncmp(pLine, "command ", 8) == 0 && strstr(pLine, " reset") != NULL) )
+        {
+            nSkipped++;
+            continue;
+        }
+        int type = 0;
+        while ( (type < (int)NUMOF(skReplayTypes) - 1) &&
+                ( (strncmp(pLine, skReplayTypes[type], strlen(skReplayTypes[type])) != 0) ||
+                  (pLine[strlen(skReplayTypes[type])] != ' ') ) )
+        {
+            type++;
+        }
+        nLines++;
+        nBytes += len;
+
+        // parse line, like the backend connection does..
+        const uint64_t t0 = sBenchNs();
+        if (backendHandle(pLine, len) == BACKEND_STATUS_RECONNECT)
+        {
+            nReconnect++;
+        }
+        const uint64_t t1 = sBenchNs();
+
+        // ..then the Jenkins task and the next LEDs frame
+        sJenkinsUpdate();
+        if (configGetVersion() != configVersion)
+        {
+            configVersion = configGetVersion();
+            sBenchLedsConfig();
+        }
+        sLedsRenderFrame(configGetDriver());
+        hostSpiRun(LEDS_SPI);
+        hostI2sRun();
+        const uint64_t t2 = sBenchNs();
+
+        sBenchAdd(&sParse[type], t1 - t0);
+        sBenchAdd(&sLeds[type], t2 - t0);
+    }
+    if (pIn != stdin)
+    {
+        fclose(pIn);
+    }
+
+    const double dt = (double)(sBenchNs() - tStart) * 1e-9;
+    printf("replay: %u lines (%.0f/s), %llu bytes, %u skipped, %u reconnects, %.1fs\n", nLines,
+        dt > 0.0 ? (double)nLines / dt : 0.0, (unsigned long long)nBytes, nSkipped, nReconnect, dt);
+    printf("parse:\n");
+    for (int ix = 0; ix < (int)NUMOF(skReplayTypes); ix++)
+    {
+        sBenchReport(&sParse[ix], NULL);
+    }
+    printf("line to LEDs:\n");
+    for (int ix = 0; ix < (int)NUMOF(skReplayTypes); ix++)
+    {
+        sBenchReport(&sLeds[ix], NULL);
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/* ***** main ************************************************************************************ */
+
+int main(int argc, char **argv)
+{
+    const char *replay = NULL;
+    if ( (argc > 2) && (strcmp(argv[1], "replay") == 0) )
+    {
+        replay = argv[2];
+    }
+    else if (argc > 1)
+    {
+        sBenchScale = atof(argv[1]);
+        if (sBenchScale <= 0.0)
+        {
+            fprintf(stderr, "usage: %s [<scale>] | replay <file>|-\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // same order as in main.c (less the modules that are not in the host build)
+    stuffInit();
+    jsonInit();
+    flashInit();
+    configInit();
+    backendInit();
+    ledsInit();
+    jenkinsInit();
+
+    // ledsStart() would create the LEDs task, we need the mutex only
+    static StaticSemaphore_t sMutex;
+    sLedsSharedMutex = xSemaphoreCreateMutexStatic(&sMutex);
+
+    if (replay != NULL)
+    {
+        return sBenchReplay(replay);
+    }
+
+    // (the benches double as regression checks, so fail if any of them does)
+    bool okay = true;
+    okay = sBenchConfigCheck() && okay;
+    sBenchBackend();
+    okay = sBenchConfig() && okay;
+    okay = sBenchLeds("SK9822", "leds SK9822 150",  150, 5) && okay;
+    okay = sBenchLeds("WS2801", "leds WS2801 150",  150, 5) && okay;
+    okay = sBenchLeds("WS2812", "leds WS2812 150",  150, 5) && okay;
+    okay = sBenchLeds("SK9822", "leds SK9822 20",    20, 1) && okay;
+    sBenchRtttl();
+
+    return okay ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// eof
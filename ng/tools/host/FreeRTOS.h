@@ -0,0 +1,88 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build FreeRTOS shim (see tools/host/host.h)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    Just enough of FreeRTOS for the firmware modules in the host build: tasks are POSIX threads,
+    queues (and semaphores) and task notifications use mutexes and condition variables, the software
+    timers run in a service thread, and the tick count comes from the monotonic clock. The "static"
+    objects (StaticTask_t etc.) hold the host objects, so that nothing is allocated, like in the
+    firmware.
+*/
+#ifndef __FREERTOS_H__
+#define __FREERTOS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <espressif/esp_common.h>
+
+typedef uint32_t      TickType_t;
+typedef long          BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t      StackType_t;
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdFAIL  0
+#define pdPASS  1
+
+#define portMAX_DELAY      ((TickType_t)0xffffffff)
+#define portTICK_PERIOD_MS 10 // same as the firmware (configTICK_RATE_HZ 100)
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+#define configMAX_TASK_NAME_LEN   16
+#define configMINIMAL_STACK_SIZE  256
+#define configMAX_PRIORITIES      15
+#define tskKERNEL_VERSION_NUMBER  "host"
+
+// task control block (see xTaskCreateStatic())
+struct tskTaskControlBlock
+{
+    pthread_t       thread;
+    char            name[configMAX_TASK_NAME_LEN];
+    void          (*func)(void *);
+    void           *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    uint32_t        notify;   // notification value (see xTaskNotifyGive())
+};
+typedef struct tskTaskControlBlock StaticTask_t;
+
+// queue, also used for the semaphores (with item size 0)
+struct QueueDefinition
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    uint8_t        *storage;
+    UBaseType_t     length;
+    UBaseType_t     itemSize;
+    UBaseType_t     head;
+    UBaseType_t     count;
+};
+typedef struct QueueDefinition StaticQueue_t;
+typedef struct QueueDefinition StaticSemaphore_t;
+
+// software timer (see xTimerCreateStatic())
+struct tmrTimerControl
+{
+    const char             *name;
+    TickType_t              period;
+    UBaseType_t             autoReload;
+    void                   *id;
+    void                  (*func)(struct tmrTimerControl *);
+    bool                    active;
+    TickType_t              expiry;
+    struct tmrTimerControl *next;   // list of all timers
+};
+typedef struct tmrTimerControl StaticTimer_t;
+
+//! critical sections (a global recursive mutex, as there are no interrupts to mask)
+void taskENTER_CRITICAL(void);
+void taskEXIT_CRITICAL(void);
+
+#endif // __FREERTOS_H__
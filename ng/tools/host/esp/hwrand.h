@@ -0,0 +1,15 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build SDK shim, random numbers
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+*/
+#ifndef __HWRAND_H__
+#define __HWRAND_H__
+
+#include <stdint.h>
+
+uint32_t hwrand(void);
+
+#endif // __HWRAND_H__
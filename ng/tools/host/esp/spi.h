@@ -0,0 +1,94 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build SDK shim, SPI peripheral (see tools/host/host.h)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    The SPI registers are plain memory. There's no hardware that clears SPI_CMD_USR when a
+    transaction is done, so the host code has to "run" the peripheral with hostSpiRun(), which
+    takes the data from the W registers, signals the transaction done and calls the interrupt
+    handler.
+*/
+#ifndef __ESP_SPI_H__
+#define __ESP_SPI_H__
+
+#include <espressif/esp_common.h>
+
+struct SPI_REGS
+{
+    volatile uint32_t CMD;
+    volatile uint32_t ADDR;
+    volatile uint32_t CTRL0;
+    volatile uint32_t CTRL1;
+    volatile uint32_t RSTATUS;
+    volatile uint32_t CTRL2;
+    volatile uint32_t CLOCK;
+    volatile uint32_t USER0;
+    volatile uint32_t USER1;
+    volatile uint32_t USER2;
+    volatile uint32_t WSTATUS;
+    volatile uint32_t PIN;
+    volatile uint32_t SLAVE0;
+    volatile uint32_t SLAVE1;
+    volatile uint32_t SLAVE2;
+    volatile uint32_t SLAVE3;
+    volatile uint32_t W[16];
+};
+extern struct SPI_REGS hostSpiRegs[2];
+#define SPI(num) (hostSpiRegs[num])
+
+struct DPORT_REGS
+{
+    volatile uint32_t SPI_INT_STATUS;
+};
+extern struct DPORT_REGS hostDportRegs;
+#define DPORT (hostDportRegs)
+
+#define DPORT_SPI_INT_STATUS_SPI0  BIT(4)
+#define DPORT_SPI_INT_STATUS_SPI1  BIT(7)
+
+#define SPI_CMD_USR                BIT(18)
+#define SPI_USER0_COMMAND          BIT(31)
+#define SPI_USER0_ADDR             BIT(30)
+#define SPI_USER0_DUMMY            BIT(29)
+#define SPI_USER0_MISO             BIT(28)
+#define SPI_USER0_MOSI             BIT(27)
+#define SPI_USER1_MOSI_BITLEN_M    0x000001ff
+#define SPI_USER1_MOSI_BITLEN_S    17
+#define SPI_SLAVE0_RD_BUF_DONE     BIT(0)
+#define SPI_SLAVE0_WR_BUF_DONE     BIT(1)
+#define SPI_SLAVE0_RD_STA_DONE     BIT(2)
+#define SPI_SLAVE0_WR_STA_DONE     BIT(3)
+#define SPI_SLAVE0_TRANS_DONE      BIT(4)
+#define SPI_SLAVE0_RD_BUF_DONE_EN  BIT(5)
+#define SPI_SLAVE0_WR_BUF_DONE_EN  BIT(6)
+#define SPI_SLAVE0_RD_STA_DONE_EN  BIT(7)
+#define SPI_SLAVE0_WR_STA_DONE_EN  BIT(8)
+#define SPI_SLAVE0_TRANS_DONE_EN   BIT(9)
+
+typedef enum { SPI_MODE0 = 0, SPI_MODE1, SPI_MODE2, SPI_MODE3 } spi_mode_t;
+typedef enum { SPI_LITTLE_ENDIAN = 0, SPI_BIG_ENDIAN } spi_endianness_t;
+typedef enum { SPI_8BIT = 1, SPI_16BIT = 2, SPI_32BIT = 4 } spi_word_size_t;
+
+#define SPI_GET_FREQ_DIV(pre, cnt) ((uint32_t)(((cnt) << 16) | (pre)))
+#define SPI_FREQ_DIV_1M   SPI_GET_FREQ_DIV(8, 10)
+#define SPI_FREQ_DIV_2M   SPI_GET_FREQ_DIV(4, 10)
+#define SPI_FREQ_DIV_4M   SPI_GET_FREQ_DIV(2, 10)
+#define SPI_FREQ_DIV_8M   SPI_GET_FREQ_DIV(5, 2)
+#define SPI_FREQ_DIV_10M  SPI_GET_FREQ_DIV(4, 2)
+#define SPI_FREQ_DIV_20M  SPI_GET_FREQ_DIV(2, 2)
+
+typedef struct
+{
+    spi_mode_t       mode;
+    uint32_t         freq_divider;
+    bool             msb;
+    spi_endianness_t endianness;
+    bool             minimal_pins;
+} spi_settings_t;
+
+void spi_set_settings(const uint8_t bus, const spi_settings_t *s);
+void spi_set_frequency_div(const uint8_t bus, const uint32_t divider);
+
+#endif // __ESP_SPI_H__
@@ -0,0 +1,51 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build SDK shim (see tools/host/host.h)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    The bits of the SDK (and esp-open-rtos' core) that the firmware modules in the host build use.
+*/
+#ifndef __ESP_COMMON_H__
+#define __ESP_COMMON_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// common_macros.h
+#define IRAM
+#define BIT(bit) (1UL << (bit))
+#define SET_MASK_BITS(reg, mask)   ((reg) |= (mask))
+#define CLEAR_MASK_BITS(reg, mask) ((reg) &= ~(mask))
+#define VAL2FIELD_M(fieldname, value) (((value) & fieldname##_M) << fieldname##_S)
+#define FIELD2VAL(fieldname, regbits) (((regbits) >> fieldname##_S) & fieldname##_M)
+
+// interrupts (called by hostSpiRun(), see host.h)
+#define INUM_SPI 2
+typedef void (*_xt_isr)(void *arg);
+void _xt_isr_attach(const uint8_t inum, _xt_isr func, void *arg);
+void _xt_isr_mask(const uint32_t mask);
+void _xt_isr_unmask(const uint32_t mask);
+
+// wifi and system
+typedef enum { AUTH_OPEN = 0, AUTH_WEP, AUTH_WPA_PSK, AUTH_WPA2_PSK, AUTH_WPA_WPA2_PSK } AUTH_MODE;
+enum { STATION_IDLE = 0, STATION_CONNECTING, STATION_WRONG_PASSWORD, STATION_NO_AP_FOUND, STATION_CONNECT_FAIL, STATION_GOT_IP };
+enum { NULL_MODE = 0, STATION_MODE, SOFTAP_MODE, STATIONAP_MODE };
+enum sdk_dhcp_status { DHCP_STOPPED = 0, DHCP_STARTED };
+enum sdk_phy_mode { PHY_MODE_11B = 1, PHY_MODE_11G = 2, PHY_MODE_11N = 3 };
+enum sdk_sleep_type { WIFI_SLEEP_NONE = 0, WIFI_SLEEP_LIGHT, WIFI_SLEEP_MODEM };
+
+uint32_t sdk_system_get_chip_id(void);
+uint32_t sdk_system_get_time(void);
+void     sdk_system_restart(void) __attribute__((noreturn));
+
+// flash chip (simulated, see HOST_FLASH_SIZE)
+typedef struct
+{
+    uint32_t chip_size;
+} sdk_flashchip_t;
+extern sdk_flashchip_t sdk_flashchip;
+
+#endif // __ESP_COMMON_H__
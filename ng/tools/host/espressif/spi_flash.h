@@ -0,0 +1,29 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build SDK shim, flash (see tools/host/host.h)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    The flash is simulated in RAM, with the same rules as the real one: erasing sets a whole sector
+    to 0xff, and writing can only clear bits (and wants 4-byte aligned addresses and sizes).
+*/
+#ifndef __SPI_FLASH_H__
+#define __SPI_FLASH_H__
+
+#include "esp_common.h"
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum
+{
+    SPI_FLASH_RESULT_OK = 0,
+    SPI_FLASH_RESULT_ERR,
+    SPI_FLASH_RESULT_TIMEOUT,
+} sdk_SpiFlashOpResult;
+
+sdk_SpiFlashOpResult sdk_spi_flash_erase_sector(const uint16_t sector);
+sdk_SpiFlashOpResult sdk_spi_flash_write(const uint32_t addr, const uint32_t *src, const uint32_t size);
+sdk_SpiFlashOpResult sdk_spi_flash_read(const uint32_t addr, uint32_t *dst, const uint32_t size);
+
+#endif // __SPI_FLASH_H__
@@ -0,0 +1,13 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build SDK shim (see tools/host/espressif/esp_common.h)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+*/
+#ifndef __USER_INTERFACE_H__
+#define __USER_INTERFACE_H__
+
+#include "esp_common.h"
+
+#endif // __USER_INTERFACE_H__
@@ -0,0 +1,783 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build (simulated SDK) (see \ref HOST)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    \defgroup HOST HOST
+    \ingroup FF
+
+    @{
+*/
+
+#define _GNU_SOURCE // pthread_mutexattr_settype()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <semphr.h>
+#include <timers.h>
+#include <espressif/spi_flash.h>
+#include <esp/spi.h>
+#include <esp/hwrand.h>
+#include <i2s_dma/i2s_dma.h>
+
+#include "stdinc.h"
+#include "debug.h"
+#include "stuff.h"
+#include "mon.h"
+#include "status.h"
+#include "ota.h"
+#include "trace.h"
+
+#include "host.h"
+
+/* ***** time ************************************************************************************ */
+
+uint64_t hostTimeUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + ((uint64_t)ts.tv_nsec / 1000);
+}
+
+// absolute (monotonic) time for pthread_cond_timedwait(), ticks from now
+static void sHostTimeout(struct timespec *pTs, const TickType_t ticks)
+{
+    clock_gettime(CLOCK_MONOTONIC, pTs);
+    const uint64_t ns = (uint64_t)pTs->tv_nsec + ((uint64_t)ticks * portTICK_PERIOD_MS * 1000000);
+    pTs->tv_sec += ns / 1000000000;
+    pTs->tv_nsec = ns % 1000000000;
+}
+
+static void sHostCondInit(pthread_cond_t *pCond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(pCond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// wait on the condition (with the locked mutex), returns false on timeout
+static bool sHostCondWait(pthread_cond_t *pCond, pthread_mutex_t *pLock, const TickType_t ticks, const struct timespec *pkTs)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        pthread_cond_wait(pCond, pLock);
+        return true;
+    }
+    return pthread_cond_timedwait(pCond, pLock, pkTs) != ETIMEDOUT;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    static uint64_t sT0;
+    if (sT0 == 0)
+    {
+        sT0 = hostTimeUs();
+    }
+    return (TickType_t)((hostTimeUs() - sT0) / (portTICK_PERIOD_MS * 1000));
+}
+
+uint32_t sdk_system_get_time(void)
+{
+    return (uint32_t)hostTimeUs();
+}
+
+void vTaskDelay(const TickType_t ticks)
+{
+    const struct timespec ts = { .tv_sec = ticks * portTICK_PERIOD_MS / 1000, .tv_nsec = (ticks * portTICK_PERIOD_MS % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+void vTaskDelayUntil(TickType_t *pPrevWake, const TickType_t increment)
+{
+    const TickType_t wake = *pPrevWake + increment;
+    const TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(wake - now) > 0)
+    {
+        vTaskDelay(wake - now);
+    }
+    *pPrevWake = wake;
+}
+
+
+/* ***** critical sections *********************************************************************** */
+
+static pthread_mutex_t sHostCritical;
+static pthread_once_t  sHostCriticalOnce = PTHREAD_ONCE_INIT;
+
+static void sHostCriticalInit(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&sHostCritical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void taskENTER_CRITICAL(void)
+{
+    pthread_once(&sHostCriticalOnce, sHostCriticalInit);
+    pthread_mutex_lock(&sHostCritical);
+}
+
+void taskEXIT_CRITICAL(void)
+{
+    pthread_mutex_unlock(&sHostCritical);
+}
+
+void vTaskSuspendAll(void)
+{
+    taskENTER_CRITICAL();
+}
+
+BaseType_t xTaskResumeAll(void)
+{
+    taskEXIT_CRITICAL();
+    return pdFALSE;
+}
+
+BaseType_t xTaskGetSchedulerState(void)
+{
+    return taskSCHEDULER_RUNNING;
+}
+
+
+/* ***** tasks *********************************************************************************** */
+
+// TCB of the calling thread, for the main thread (and others not made by xTaskCreateStatic()) made on first use
+static __thread struct tskTaskControlBlock *stHostTask;
+
+static void sHostTaskInitTcb(struct tskTaskControlBlock *pTcb, const char *name)
+{
+    strncpy(pTcb->name, name, sizeof(pTcb->name) - 1);
+    pthread_mutex_init(&pTcb->lock, NULL);
+    sHostCondInit(&pTcb->cond);
+    pTcb->notify = 0;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (stHostTask == NULL)
+    {
+        static __thread struct tskTaskControlBlock stTcb;
+        sHostTaskInitTcb(&stTcb, "host");
+        stTcb.thread = pthread_self();
+        stHostTask = &stTcb;
+    }
+    return stHostTask;
+}
+
+static void *sHostTaskThread(void *pArg)
+{
+    struct tskTaskControlBlock *pTcb = (struct tskTaskControlBlock *)pArg;
+    stHostTask = pTcb;
+    pTcb->func(pTcb->arg);
+    // FreeRTOS tasks must not return
+    ERROR("host: task %s returned", pTcb->name);
+    abort();
+    return NULL;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t func, const char *name, const uint32_t stackDepth, void *arg,
+    UBaseType_t prio, StackType_t *stack, StaticTask_t *tcb)
+{
+    UNUSED(stackDepth);
+    UNUSED(prio);
+    UNUSED(stack);
+    memset(tcb, 0, sizeof(*tcb));
+    sHostTaskInitTcb(tcb, name);
+    tcb->func = func;
+    tcb->arg  = arg;
+    if (pthread_create(&tcb->thread, NULL, sHostTaskThread, tcb) != 0)
+    {
+        ERROR("host: task %s create fail", name);
+        return NULL;
+    }
+    pthread_setname_np(tcb->thread, tcb->name);
+    return tcb;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(const BaseType_t clearOnExit, const TickType_t ticks)
+{
+    struct tskTaskControlBlock *pTcb = xTaskGetCurrentTaskHandle();
+    struct timespec ts;
+    sHostTimeout(&ts, ticks);
+    pthread_mutex_lock(&pTcb->lock);
+    while ( (pTcb->notify == 0) && (ticks > 0) && sHostCondWait(&pTcb->cond, &pTcb->lock, ticks, &ts) )
+    {
+    }
+    const uint32_t notify = pTcb->notify;
+    if (notify > 0)
+    {
+        pTcb->notify = clearOnExit ? 0 : (notify - 1);
+    }
+    pthread_mutex_unlock(&pTcb->lock);
+    return notify;
+}
+
+
+/* ***** queues and semaphores ******************************************************************* */
+
+QueueHandle_t xQueueCreateStatic(const UBaseType_t length, const UBaseType_t itemSize, uint8_t *storage,
+    StaticQueue_t *queue)
+{
+    memset(queue, 0, sizeof(*queue));
+    pthread_mutex_init(&queue->lock, NULL);
+    sHostCondInit(&queue->cond);
+    queue->storage  = storage;
+    queue->length   = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, const TickType_t ticks)
+{
+    struct timespec ts;
+    sHostTimeout(&ts, ticks);
+    pthread_mutex_lock(&queue->lock);
+    while ( (queue->count >= queue->length) && (ticks > 0) && sHostCondWait(&queue->cond, &queue->lock, ticks, &ts) )
+    {
+    }
+    BaseType_t res = pdFAIL;
+    if (queue->count < queue->length)
+    {
+        if (queue->itemSize > 0)
+        {
+            const UBaseType_t ix = (queue->head + queue->count) % queue->length;
+            memcpy(&queue->storage[ix * queue->itemSize], item, queue->itemSize);
+        }
+        queue->count++;
+        pthread_cond_broadcast(&queue->cond);
+        res = pdPASS;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return res;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, const TickType_t ticks)
+{
+    struct timespec ts;
+    sHostTimeout(&ts, ticks);
+    pthread_mutex_lock(&queue->lock);
+    while ( (queue->count == 0) && (ticks > 0) && sHostCondWait(&queue->cond, &queue->lock, ticks, &ts) )
+    {
+    }
+    BaseType_t res = pdFAIL;
+    if (queue->count > 0)
+    {
+        if (queue->itemSize > 0)
+        {
+            memcpy(item, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+        }
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->cond);
+        res = pdPASS;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return res;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    const UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *sem)
+{
+    return xQueueCreateStatic(1, 0, NULL, sem);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *sem)
+{
+    SemaphoreHandle_t mutex = xSemaphoreCreateBinaryStatic(sem);
+    xSemaphoreGive(mutex);
+    return mutex;
+}
+
+
+/* ***** software timers ************************************************************************* */
+
+static pthread_mutex_t  sHostTimersLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   sHostTimersCond;
+static StaticTimer_t   *sHostTimers;
+static pthread_t        sHostTimersThread;
+
+static void *sHostTimersService(void *pArg)
+{
+    UNUSED(pArg);
+    pthread_mutex_lock(&sHostTimersLock);
+    while (true)
+    {
+        // find next timer to expire
+        const TickType_t now = xTaskGetTickCount();
+        StaticTimer_t *pNext = NULL;
+        for (StaticTimer_t *pTimer = sHostTimers; pTimer != NULL; pTimer = pTimer->next)
+        {
+            if ( pTimer->active && ( (pNext == NULL) || ((int32_t)(pTimer->expiry - pNext->expiry) < 0) ) )
+            {
+                pNext = pTimer;
+            }
+        }
+
+        // fire it (without holding the lock, the callback may use the timer functions)
+        if ( (pNext != NULL) && ((int32_t)(pNext->expiry - now) <= 0) )
+        {
+            if (pNext->autoReload)
+            {
+                pNext->expiry += pNext->period;
+            }
+            else
+            {
+                pNext->active = false;
+            }
+            pthread_mutex_unlock(&sHostTimersLock);
+            pNext->func(pNext);
+            pthread_mutex_lock(&sHostTimersLock);
+        }
+        // wait for it (or for a change)
+        else
+        {
+            const TickType_t ticks = pNext != NULL ? (pNext->expiry - now) : portMAX_DELAY;
+            struct timespec ts;
+            sHostTimeout(&ts, ticks);
+            sHostCondWait(&sHostTimersCond, &sHostTimersLock, ticks, &ts);
+        }
+    }
+    return NULL;
+}
+
+TimerHandle_t xTimerCreateStatic(const char *name, const TickType_t period, const UBaseType_t autoReload,
+    void *id, TimerCallbackFunction_t func, StaticTimer_t *timer)
+{
+    pthread_mutex_lock(&sHostTimersLock);
+    if (sHostTimers == NULL)
+    {
+        sHostCondInit(&sHostTimersCond);
+        pthread_create(&sHostTimersThread, NULL, sHostTimersService, NULL);
+        pthread_setname_np(sHostTimersThread, "host_timers");
+    }
+    memset(timer, 0, sizeof(*timer));
+    timer->name       = name;
+    timer->period     = period;
+    timer->autoReload = autoReload;
+    timer->id         = id;
+    timer->func       = func;
+    timer->next       = sHostTimers;
+    sHostTimers       = timer;
+    pthread_mutex_unlock(&sHostTimersLock);
+    return timer;
+}
+
+static void sHostTimerChange(TimerHandle_t timer, const bool active, const TickType_t period)
+{
+    pthread_mutex_lock(&sHostTimersLock);
+    if (period > 0)
+    {
+        timer->period = period;
+    }
+    timer->active = active;
+    timer->expiry = xTaskGetTickCount() + timer->period;
+    pthread_cond_signal(&sHostTimersCond);
+    pthread_mutex_unlock(&sHostTimersLock);
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, const TickType_t ticks)
+{
+    UNUSED(ticks);
+    sHostTimerChange(timer, true, 0);
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, const TickType_t ticks)
+{
+    UNUSED(ticks);
+    sHostTimerChange(timer, true, 0);
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, const TickType_t ticks)
+{
+    UNUSED(ticks);
+    sHostTimerChange(timer, false, 0);
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, const TickType_t period, const TickType_t ticks)
+{
+    UNUSED(ticks);
+    sHostTimerChange(timer, true, period);
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    pthread_mutex_lock(&sHostTimersLock);
+    const bool active = timer->active;
+    pthread_mutex_unlock(&sHostTimersLock);
+    return active ? pdTRUE : pdFALSE;
+}
+
+
+/* ***** system ********************************************************************************** */
+
+uint32_t sdk_system_get_chip_id(void)
+{
+    return 0x00c0ffee;
+}
+
+void sdk_system_restart(void)
+{
+    PRINT("host: restart");
+    exit(EXIT_SUCCESS);
+}
+
+uint32_t hwrand(void)
+{
+    // xorshift32, seeded from the clock, good enough for what the firmware uses it for
+    static uint32_t sState;
+    uint32_t r;
+    CS_ENTER;
+    if (sState == 0)
+    {
+        sState = (uint32_t)hostTimeUs() | 1;
+    }
+    sState ^= sState << 13;
+    sState ^= sState >> 17;
+    sState ^= sState << 5;
+    r = sState;
+    CS_LEAVE;
+    return r;
+}
+
+
+/* ***** flash *********************************************************************************** */
+
+sdk_flashchip_t sdk_flashchip = { .chip_size = HOST_FLASH_SIZE };
+
+static uint32_t sHostFlash[HOST_FLASH_SIZE / sizeof(uint32_t)];
+
+static bool sHostFlashCheck(const uint32_t addr, const void *buf, const uint32_t size)
+{
+    if ( ((addr % 4) != 0) || ((size % 4) != 0) || (((uintptr_t)buf % 4) != 0) ||
+         (addr >= HOST_FLASH_SIZE) || (size > (HOST_FLASH_SIZE - addr)) )
+    {
+        WARNING("host: flash access 0x%08x %u fail", addr, size);
+        return false;
+    }
+    return true;
+}
+
+sdk_SpiFlashOpResult sdk_spi_flash_erase_sector(const uint16_t sector)
+{
+    const uint32_t addr = (uint32_t)sector * SPI_FLASH_SEC_SIZE;
+    if (!sHostFlashCheck(addr, sHostFlash, SPI_FLASH_SEC_SIZE))
+    {
+        return SPI_FLASH_RESULT_ERR;
+    }
+    memset(&sHostFlash[addr / sizeof(uint32_t)], 0xff, SPI_FLASH_SEC_SIZE);
+    return SPI_FLASH_RESULT_OK;
+}
+
+sdk_SpiFlashOpResult sdk_spi_flash_write(const uint32_t addr, const uint32_t *src, const uint32_t size)
+{
+    if (!sHostFlashCheck(addr, src, size))
+    {
+        return SPI_FLASH_RESULT_ERR;
+    }
+    for (uint32_t ix = 0; ix < (size / sizeof(uint32_t)); ix++)
+    {
+        sHostFlash[(addr / sizeof(uint32_t)) + ix] &= src[ix]; // can only clear bits
+    }
+    return SPI_FLASH_RESULT_OK;
+}
+
+sdk_SpiFlashOpResult sdk_spi_flash_read(const uint32_t addr, uint32_t *dst, const uint32_t size)
+{
+    if (!sHostFlashCheck(addr, dst, size))
+    {
+        return SPI_FLASH_RESULT_ERR;
+    }
+    memcpy(dst, &sHostFlash[addr / sizeof(uint32_t)], size);
+    return SPI_FLASH_RESULT_OK;
+}
+
+__attribute__((constructor)) static void sHostFlashInit(void)
+{
+    memset(sHostFlash, 0xff, sizeof(sHostFlash));
+}
+
+
+/* ***** interrupts and SPI ********************************************************************** */
+
+struct SPI_REGS   hostSpiRegs[2];
+struct DPORT_REGS hostDportRegs;
+
+static _xt_isr   sHostIsrFuncs[32];
+static void     *sHostIsrArgs[32];
+static uint32_t  sHostIsrMask; // unmasked interrupts
+
+void _xt_isr_attach(const uint8_t inum, _xt_isr func, void *arg)
+{
+    sHostIsrFuncs[inum] = func;
+    sHostIsrArgs[inum]  = arg;
+}
+
+void _xt_isr_mask(const uint32_t mask)
+{
+    sHostIsrMask &= ~mask;
+}
+
+void _xt_isr_unmask(const uint32_t mask)
+{
+    sHostIsrMask |= mask;
+}
+
+// "call" interrupt (with the other interrupts blocked, like on the target)
+static bool sHostIsr(const uint8_t inum)
+{
+    if ( ((sHostIsrMask & BIT(inum)) == 0) || (sHostIsrFuncs[inum] == NULL) )
+    {
+        return false;
+    }
+    taskENTER_CRITICAL();
+    sHostIsrFuncs[inum](sHostIsrArgs[inum]);
+    taskEXIT_CRITICAL();
+    return true;
+}
+
+void spi_set_settings(const uint8_t bus, const spi_settings_t *s)
+{
+    spi_set_frequency_div(bus, s->freq_divider);
+}
+
+void spi_set_frequency_div(const uint8_t bus, const uint32_t divider)
+{
+    SPI(bus).CLOCK = divider;
+}
+
+static HOST_SPI_STATS_t sHostSpiStats;
+
+int hostSpiRun(const int bus)
+{
+    int nTrans = 0;
+    while ((SPI(bus).CMD & SPI_CMD_USR) != 0)
+    {
+        // "send" the data
+        const uint32_t nBits = FIELD2VAL(SPI_USER1_MOSI_BITLEN, SPI(bus).USER1) + 1;
+        const uint32_t nWords = (nBits + 31) / 32;
+        for (uint32_t ix = 0; (ix < nWords) && (ix < NUMOF(SPI(bus).W)); ix++)
+        {
+            const uint32_t word = SPI(bus).W[ix];
+            sHostSpiStats.crc = (sHostSpiStats.crc * 31) + word;
+        }
+        sHostSpiStats.nBits += nBits;
+        sHostSpiStats.nTrans++;
+        nTrans++;
+
+        // transaction done
+        CLEAR_MASK_BITS(SPI(bus).CMD, SPI_CMD_USR);
+        SET_MASK_BITS(SPI(bus).SLAVE0, SPI_SLAVE0_TRANS_DONE);
+        if ((SPI(bus).SLAVE0 & SPI_SLAVE0_TRANS_DONE_EN) != 0)
+        {
+            DPORT.SPI_INT_STATUS = bus == 0 ? DPORT_SPI_INT_STATUS_SPI0 : DPORT_SPI_INT_STATUS_SPI1;
+            if (sHostIsr(INUM_SPI))
+            {
+                sHostSpiStats.nIsr++;
+            }
+            DPORT.SPI_INT_STATUS = 0;
+        }
+    }
+    return nTrans;
+}
+
+void hostSpiStats(HOST_SPI_STATS_t *pStats, const bool clear)
+{
+    *pStats = sHostSpiStats;
+    if (clear)
+    {
+        memset(&sHostSpiStats, 0, sizeof(sHostSpiStats));
+    }
+}
+
+
+/* ***** I2S DMA ********************************************************************************* */
+
+static dma_isr_t         sHostI2sIsr;
+static void             *sHostI2sIsrArg;
+static dma_descriptor_t *sHostI2sDesc; // next descriptor to send, NULL if stopped
+static dma_descriptor_t *sHostI2sEof;  // last descriptor sent, NULL if none
+
+void i2s_dma_init(dma_isr_t isr, void *arg, i2s_clock_div_t clock_div, i2s_pins_t pins)
+{
+    UNUSED(clock_div);
+    UNUSED(pins);
+    sHostI2sIsr = isr;
+    sHostI2sIsrArg = arg;
+}
+
+i2s_clock_div_t i2s_get_clock_div(int32_t freq)
+{
+    const i2s_clock_div_t div = { .bclk_div = 1, .clkm_div = 160000000 / freq };
+    return div;
+}
+
+void i2s_dma_start(dma_descriptor_t *descr)
+{
+    sHostI2sDesc = descr;
+}
+
+void i2s_dma_stop(void)
+{
+    sHostI2sDesc = NULL;
+}
+
+dma_descriptor_t *i2s_dma_get_eof_descriptor(void)
+{
+    return sHostI2sEof;
+}
+
+bool i2s_dma_is_eof_interrupt(void)
+{
+    return sHostI2sEof != NULL;
+}
+
+void i2s_dma_clear_interrupt(void)
+{
+    sHostI2sEof = NULL;
+}
+
+int hostI2sRun(void)
+{
+    int nDesc = 0;
+    while ( (sHostI2sDesc != NULL) && (sHostI2sIsr != NULL) )
+    {
+        sHostI2sEof = sHostI2sDesc;
+        sHostI2sDesc = sHostI2sDesc->next_link_ptr;
+        nDesc++;
+        taskENTER_CRITICAL();
+        sHostI2sIsr(sHostI2sIsrArg);
+        taskEXIT_CRITICAL();
+    }
+    return nDesc;
+}
+
+
+/* ***** modules not in the host build *********************************************************** */
+
+// debug.c (the output goes straight to stdout)
+static pthread_mutex_t sHostDebugLock = PTHREAD_MUTEX_INITIALIZER;
+
+void debugLock(void)
+{
+    pthread_mutex_lock(&sHostDebugLock);
+}
+
+void debugLockBlocking(void)
+{
+    pthread_mutex_lock(&sHostDebugLock);
+}
+
+void debugUnlock(void)
+{
+    fflush(stdout);
+    pthread_mutex_unlock(&sHostDebugLock);
+}
+
+void HEXDUMP(const void *pkData, int size)
+{
+    const uint8_t *pkBytes = (const uint8_t *)pkData;
+    debugLock();
+    for (int ix = 0; ix < size; ix += 16)
+    {
+        printf("0x%04x:", ix);
+        for (int ix2 = ix; (ix2 < (ix + 16)) && (ix2 < size); ix2++)
+        {
+            printf(" %02x", pkBytes[ix2]);
+        }
+        printf("\n");
+    }
+    debugUnlock();
+}
+
+// mon.c
+uint32_t monIsrEnter(void)
+{
+    return 0;
+}
+
+void monIsrLeave(const MON_ISR_t src, const uint32_t t0)
+{
+    UNUSED(src);
+    UNUSED(t0);
+}
+
+void monRegisterStack(const char *task, const char *id, const uint32_t size)
+{
+    UNUSED(task);
+    UNUSED(id);
+    UNUSED(size);
+}
+
+// status.c
+void statusNoise(const STATUS_NOISE_t noise)
+{
+    UNUSED(noise);
+}
+
+void statusMelody(const char *name)
+{
+    UNUSED(name);
+}
+
+void statusCommandMelody(const char *melody)
+{
+    UNUSED(melody);
+}
+
+// ota.c
+bool otaRequest(const char *image, const int imageLen, const uint32_t size, const char *sha256, const char *sig)
+{
+    UNUSED(sha256);
+    UNUSED(sig);
+    DEBUG("host: ota %.*s (%u) ignored", imageLen, image, size);
+    return false;
+}
+
+// trace.c
+void traceEvent(const TRACE_EV_t ev, const uint32_t arg)
+{
+    UNUSED(ev);
+    UNUSED(arg);
+}
+
+void traceDump(void)
+{
+}
+
+
+/* *********************************************************************************************** */
+//@}
+// eof
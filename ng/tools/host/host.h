@@ -0,0 +1,55 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build (simulated SDK)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    The headers in tools/host/ stand in for the esp-open-rtos headers, so that some of the firmware
+    modules (backend, jenkins, json, config, flash, stuff, hsv2rgb, LEDs rendering, RTTTL) compile
+    unchanged for the workstation, e.g. for micro-benchmarks with perf and the sanitizers (see "make
+    host-bench" and tools/host-bench.c). tools/host/host.c implements them on top of POSIX, and
+    provides stand-ins for the firmware modules that are not in the host build (debug output goes
+    to stdout, the status noises and OTA requests are dropped).
+
+    The peripherals have no life on their own: the host code runs them explicitly (see
+    hostSpiRun() and hostI2sRun()).
+*/
+#ifndef __HOST_H__
+#define __HOST_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! size of the simulated flash [bytes] (FLASH_SIZE 32 in the Makefile, i.e. 32Mbit)
+#define HOST_FLASH_SIZE (4 * 1024 * 1024)
+
+//! simulated SPI statistics
+typedef struct HOST_SPI_STATS_s
+{
+    uint32_t nTrans;  //!< number of transactions
+    uint32_t nIsr;    //!< number of interrupts
+    uint64_t nBits;   //!< number of bits sent
+    uint32_t crc;     //!< checksum over all sent data (see flashCrc32())
+} HOST_SPI_STATS_t;
+
+//! run SPI peripheral: complete pending transactions (and call the interrupt handler) until idle
+/*!
+    \param[in] bus  SPI bus (0 or 1)
+    \returns the number of transactions completed
+*/
+int hostSpiRun(const int bus);
+
+//! get (and optionally clear) the simulated SPI statistics
+void hostSpiStats(HOST_SPI_STATS_t *pStats, const bool clear);
+
+//! run I2S DMA: call the interrupt handler for each descriptor until the DMA is stopped
+/*!
+    \returns the number of descriptors (buffers) sent
+*/
+int hostI2sRun(void);
+
+//! time [us] from the monotonic clock
+uint64_t hostTimeUs(void);
+
+#endif // __HOST_H__
@@ -0,0 +1,53 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build I2S DMA shim (see tools/host/host.h)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    Like the SPI (see tools/host/esp/spi.h) the DMA has to be "run" by the host code, with
+    hostI2sRun(), which walks the descriptor ring and calls the interrupt handler for each
+    descriptor until the DMA is stopped.
+*/
+#ifndef __I2S_DMA_H__
+#define __I2S_DMA_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*dma_isr_t)(void *);
+
+typedef struct dma_descriptor
+{
+    uint32_t blocksize:12;
+    uint32_t datalen:12;
+    uint32_t unused:5;
+    uint32_t sub_sof:1;
+    uint32_t eof:1;
+    volatile uint32_t owner:1;
+    void *buf_ptr;
+    struct dma_descriptor *next_link_ptr;
+} dma_descriptor_t;
+
+typedef struct
+{
+    int bclk_div;
+    int clkm_div;
+} i2s_clock_div_t;
+
+typedef struct
+{
+    bool data;
+    bool clock;
+    bool ws;
+} i2s_pins_t;
+
+void              i2s_dma_init(dma_isr_t isr, void *arg, i2s_clock_div_t clock_div, i2s_pins_t pins);
+i2s_clock_div_t   i2s_get_clock_div(int32_t freq);
+void              i2s_dma_start(dma_descriptor_t *descr);
+void              i2s_dma_stop(void);
+dma_descriptor_t *i2s_dma_get_eof_descriptor(void);
+bool              i2s_dma_is_eof_interrupt(void);
+void              i2s_dma_clear_interrupt(void);
+
+#endif // __I2S_DMA_H__
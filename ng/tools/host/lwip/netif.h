@@ -0,0 +1,13 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build lwIP shim (the host build has no network)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+*/
+#ifndef __LWIP_NETIF_H__
+#define __LWIP_NETIF_H__
+
+#include "err.h"
+
+#endif // __LWIP_NETIF_H__
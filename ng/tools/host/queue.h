@@ -0,0 +1,23 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build FreeRTOS shim, queues (see tools/host/FreeRTOS.h)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+*/
+#ifndef __QUEUE_H__
+#define __QUEUE_H__
+
+#include "FreeRTOS.h"
+
+typedef struct QueueDefinition *QueueHandle_t;
+
+QueueHandle_t xQueueCreateStatic(const UBaseType_t length, const UBaseType_t itemSize, uint8_t *storage,
+    StaticQueue_t *queue);
+BaseType_t    xQueueSend(QueueHandle_t queue, const void *item, const TickType_t ticks);
+BaseType_t    xQueueReceive(QueueHandle_t queue, void *item, const TickType_t ticks);
+UBaseType_t   uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#define xQueueSendToBack(queue, item, ticks) xQueueSend(queue, item, ticks)
+
+#endif // __QUEUE_H__
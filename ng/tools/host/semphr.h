@@ -0,0 +1,24 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build FreeRTOS shim, semaphores (see tools/host/FreeRTOS.h)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    Semaphores are queues with item size 0, like in FreeRTOS. Mutexes are binary semaphores that
+    start out given (no priority inheritance, and they're not recursive).
+*/
+#ifndef __SEMPHR_H__
+#define __SEMPHR_H__
+
+#include "queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *sem);
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *sem);
+
+#define xSemaphoreTake(sem, ticks) xQueueReceive(sem, NULL, ticks)
+#define xSemaphoreGive(sem)        xQueueSend(sem, NULL, 0)
+
+#endif // __SEMPHR_H__
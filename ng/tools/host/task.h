@@ -0,0 +1,35 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build FreeRTOS shim, tasks (see tools/host/FreeRTOS.h)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+*/
+#ifndef __TASK_H__
+#define __TASK_H__
+
+#include "FreeRTOS.h"
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define taskSCHEDULER_SUSPENDED   0
+#define taskSCHEDULER_NOT_STARTED 1
+#define taskSCHEDULER_RUNNING     2
+
+// the task runs in a new thread, the stack and the priority are ignored
+TaskHandle_t xTaskCreateStatic(TaskFunction_t func, const char *name, const uint32_t stackDepth, void *arg,
+    UBaseType_t prio, StackType_t *stack, StaticTask_t *tcb);
+
+void         vTaskDelay(const TickType_t ticks);
+void         vTaskDelayUntil(TickType_t *pPrevWake, const TickType_t increment);
+TickType_t   xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t   xTaskGetSchedulerState(void);
+void         vTaskSuspendAll(void);
+BaseType_t   xTaskResumeAll(void);
+
+BaseType_t   xTaskNotifyGive(TaskHandle_t task);
+uint32_t     ulTaskNotifyTake(const BaseType_t clearOnExit, const TickType_t ticks);
+
+#endif // __TASK_H__
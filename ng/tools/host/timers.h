@@ -0,0 +1,25 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host build FreeRTOS shim, software timers (see tools/host/FreeRTOS.h)
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+*/
+#ifndef __TIMERS_H__
+#define __TIMERS_H__
+
+#include "FreeRTOS.h"
+
+typedef struct tmrTimerControl *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t);
+
+// the callbacks run in the timer service thread (started with the first timer)
+TimerHandle_t xTimerCreateStatic(const char *name, const TickType_t period, const UBaseType_t autoReload,
+    void *id, TimerCallbackFunction_t func, StaticTimer_t *timer);
+BaseType_t    xTimerStart(TimerHandle_t timer, const TickType_t ticks);
+BaseType_t    xTimerStop(TimerHandle_t timer, const TickType_t ticks);
+BaseType_t    xTimerReset(TimerHandle_t timer, const TickType_t ticks);
+BaseType_t    xTimerChangePeriod(TimerHandle_t timer, const TickType_t period, const TickType_t ticks);
+BaseType_t    xTimerIsTimerActive(TimerHandle_t timer);
+
+#endif // __TIMERS_H__
@@ -0,0 +1,94 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host-side hsv2rgb() vs. hsv2rgbN() micro-benchmark
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    Checks that both functions give the same results for all inputs and compares their speed for
+    LED strip sized batches. Build and run with "make hsv2rgb-bench" (or just compile this file with
+    the host compiler).
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// pretend we have stdinc.h and what we need from the SDK
+#define __STDINC_H__
+#define IRAM
+#define BIT(bit) (1UL << (bit))
+
+#include "../src/hsv2rgb.c"
+
+#define BENCH_NUM_LEDS   150
+#define BENCH_NUM_FRAMES 100000
+
+static double sBenchNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+int main(void)
+{
+    // check all inputs
+    int nErrors = 0;
+    for (uint32_t hsv = 0; hsv < (1 << 24); hsv++)
+    {
+        const uint8_t in[1][3] = { { hsv >> 16, (hsv >> 8) & 0xff, hsv & 0xff } };
+        uint8_t out1[3], outN[1][3];
+        hsv2rgb(in[0][0], in[0][1], in[0][2], &out1[0], &out1[1], &out1[2]);
+        hsv2rgbN(in, outN, 1);
+        if (memcmp(out1, outN[0], sizeof(out1)) != 0)
+        {
+            if (nErrors < 10)
+            {
+                printf("mismatch: HSV %3u %3u %3u -> %3u %3u %3u != %3u %3u %3u\n", in[0][0], in[0][1], in[0][2],
+                    out1[0], out1[1], out1[2], outN[0][0], outN[0][1], outN[0][2]);
+            }
+            nErrors++;
+        }
+    }
+    printf("check: %d mismatches\n", nErrors);
+
+    // benchmark
+    static uint8_t sHsv[BENCH_NUM_LEDS][3];
+    static uint8_t sRgb[BENCH_NUM_LEDS][3];
+    for (int ix = 0; ix < BENCH_NUM_LEDS; ix++)
+    {
+        sHsv[ix][0] = ix * 7; sHsv[ix][1] = 255 - ix; sHsv[ix][2] = ix * 3;
+    }
+    uint32_t sum = 0;
+
+    const double t0 = sBenchNow();
+    for (int frame = 0; frame < BENCH_NUM_FRAMES; frame++)
+    {
+        sHsv[frame % BENCH_NUM_LEDS][2] = frame;
+        for (int ix = 0; ix < BENCH_NUM_LEDS; ix++)
+        {
+            hsv2rgb(sHsv[ix][0], sHsv[ix][1], sHsv[ix][2], &sRgb[ix][0], &sRgb[ix][1], &sRgb[ix][2]);
+        }
+        sum += sRgb[frame % BENCH_NUM_LEDS][0];
+    }
+    const double t1 = sBenchNow();
+    for (int frame = 0; frame < BENCH_NUM_FRAMES; frame++)
+    {
+        sHsv[frame % BENCH_NUM_LEDS][2] = frame;
+        hsv2rgbN((const uint8_t (*)[3])sHsv, sRgb, BENCH_NUM_LEDS);
+        sum += sRgb[frame % BENCH_NUM_LEDS][0];
+    }
+    const double t2 = sBenchNow();
+
+    const double nConv = (double)BENCH_NUM_LEDS * (double)BENCH_NUM_FRAMES;
+    printf("hsv2rgb():  %6.2fns/LED\n", (t1 - t0) * 1e9 / nConv);
+    printf("hsv2rgbN(): %6.2fns/LED\n", (t2 - t1) * 1e9 / nConv);
+    printf("(%u)\n", sum);
+
+    return nErrors > 0 ? 1 : 0;
+}
+
+// eof
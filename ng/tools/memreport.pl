@@ -0,0 +1,333 @@
+#!/usr/bin/perl
+################################################################################
+#
+# memory (iRAM, iROM, dRAM) usage per module and task stacks, diffed against a baseline
+#
+# Usage: memreport.pl -e img.elf [options] [<archives and objects>...]   (see -h)
+#
+# Copyright (c) 2018 Philippe Kehl <flipflip at oinkzwurgl dot org>
+# https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+#
+################################################################################
+
+use strict;
+use warnings;
+
+# same regions as in the Makefile (.sym_iram etc.)
+my @REGIONS =
+(
+    { name => 'iRAM', start => 0x40100000, size => 0x8000 },
+    { name => 'iROM', start => 0x40200000, size => 0x5c000 },
+    { name => 'dRAM', start => 0x3ffe8000, size => 0x14000 },
+);
+
+# task stack symbols whose task name isn't "ff_<name>" for "s<Name>TaskStack"
+my %STACKTASKS =
+(
+    uxIdleTaskStack  => 'IDLE',
+    uxTimerTaskStack => 'Tmr Svc',
+    sListenTaskStack => 'ff_httpd',
+    sDeferTaskStack  => 'ff_debug',
+);
+
+my $STACKTYPESIZE = 4; # sizeof(StackType_t), the high-water marks are in units of that
+
+my $objdump  = 'objdump';
+my $elf      = '';
+my $baseline = '';
+my $update   = 0;
+my $monlog   = '';
+my $nTop     = 10;
+my %limits   = ();
+my @objects  = ();
+while (my $arg = shift(@ARGV))
+{
+    if    ($arg eq '-O') { $objdump  = shift(@ARGV); }
+    elsif ($arg eq '-e') { $elf      = shift(@ARGV); }
+    elsif ($arg eq '-b') { $baseline = shift(@ARGV); }
+    elsif ($arg eq '-u') { $update   = 1; }
+    elsif ($arg eq '-m') { $monlog   = shift(@ARGV); }
+    elsif ($arg eq '-n') { $nTop     = shift(@ARGV); }
+    elsif ($arg eq '-i') { $limits{iRAM} = shift(@ARGV); }
+    elsif ($arg eq '-r') { $limits{iROM} = shift(@ARGV); }
+    elsif ($arg eq '-d') { $limits{dRAM} = shift(@ARGV); }
+    elsif ($arg eq '-h') { help(); }
+    elsif ($arg =~ m{^-})
+    {
+        die("Illegal argument '$arg'! Try '$0 -h'.\n");
+    }
+    else
+    {
+        push(@objects, $arg);
+    }
+}
+die("Need an ELF file (-e)! Try '$0 -h'.\n") unless ($elf);
+
+################################################################################
+# which module does a symbol (global) or source file (locals) belong to?
+
+my %symModule = ();
+my %fileModule = ();
+foreach my $object (@objects)
+{
+    my $module = '';
+    my $archive = '';
+    open(my $fh, '-|', $objdump, '-t', $object) || die("Failed running $objdump: $!\n");
+    while (my $line = <$fh>)
+    {
+        if ($line =~ m{^In archive (.+):})
+        {
+            $archive = _moduleName($1);
+        }
+        elsif ($line =~ m{^(\S+?):\s+file format})
+        {
+            # the firmware's own objects are modules, libraries are lumped together
+            $module = (!$archive || ($archive eq 'program')) ? _moduleName($1) : $archive;
+        }
+        elsif (my $sym = _parseSym($line))
+        {
+            if ($sym->{flags} =~ m{f})
+            {
+                $fileModule{$sym->{name}} //= $module;
+            }
+            elsif ( ($sym->{scope} eq 'g') && ($sym->{sec} ne '*UND*') )
+            {
+                $symModule{$sym->{name}} //= $module;
+            }
+        }
+    }
+    close($fh);
+}
+
+sub _moduleName
+{
+    my ($name) = @_;
+    $name =~ s{^.*/}{};
+    $name =~ s{^lib}{} if ($name =~ m{\.a$});
+    $name =~ s{\.(o|a)$}{};
+    return $name;
+}
+
+################################################################################
+# symbols in the memory regions
+
+my @symbols = ();
+{
+    my $file = '';
+    open(my $fh, '-|', $objdump, '-t', $elf) || die("Failed running $objdump: $!\n");
+    while (my $line = <$fh>)
+    {
+        my $sym = _parseSym($line) || next;
+        if ($sym->{flags} =~ m{f})
+        {
+            $file = $sym->{name};
+            next;
+        }
+        next if ($sym->{flags} =~ m{d}); # sections
+        my ($region) = grep { ($sym->{addr} >= $_->{start}) && ($sym->{addr} < ($_->{start} + $_->{size})) } @REGIONS;
+        next unless ($region);
+        my $module = $sym->{scope} eq 'l' ? ($fileModule{$file} // _moduleName($file =~ s{\.[cS]$}{.o}r)) : $symModule{$sym->{name}};
+        $sym->{module} = $module || '(sdk)';
+        $sym->{region} = $region->{name};
+        push(@symbols, $sym);
+    }
+    close($fh);
+}
+
+# objdump -t lines, e.g. "3ffe8a10 l     O .bss	00000800 sLedsTaskStack.4321"
+sub _parseSym
+{
+    my ($line) = @_;
+    return undef unless ($line =~ m{^([0-9a-fA-F]{8}) (.{7}) (\S+)\s+([0-9a-fA-F]{8}) (.+?)\r*\n*$});
+    my ($addr, $flags, $sec, $size, $name) = (hex($1), $2, $3, hex($4), $5);
+    return { addr => $addr, scope => substr($flags, 0, 1), flags => $flags, sec => $sec, size => $size, name => $name };
+}
+
+################################################################################
+# usage per region and module (the gaps between symbols count as padding, like tools/symbols.pl does)
+
+my %usage = (); # "region" and "region module" => bytes
+foreach my $region (@REGIONS)
+{
+    my $prev = undef;
+    foreach my $sym (sort { $a->{addr} <=> $b->{addr} } grep { $_->{region} eq $region->{name} } @symbols)
+    {
+        my $size = $sym->{size};
+        if ($prev)
+        {
+            my $prevEnd = $prev->{addr} + $prev->{size};
+            if ($sym->{addr} > $prevEnd)
+            {
+                $usage{"$region->{name} (padding)"} += $sym->{addr} - $prevEnd;
+            }
+            elsif ($sym->{addr} + $size <= $prevEnd)
+            {
+                next; # aliases
+            }
+            else
+            {
+                $size -= $prevEnd - $sym->{addr};
+            }
+        }
+        $usage{"$region->{name} $sym->{module}"} += $size;
+        $prev = $sym;
+    }
+    $usage{$region->{name}} += $usage{$_} for (grep { m{^$region->{name} } } keys %usage);
+}
+
+# static task stacks (local statics have a ".1234" suffix)
+my %stacks = (); # symbol => { size, module, task }
+foreach my $sym (grep { $_->{name} =~ m{^\w+TaskStack(\.\d+)?$} } @symbols)
+{
+    my $name = $sym->{name} =~ s{\.\d+$}{}r;
+    my $task = $STACKTASKS{$name} || ($name =~ m{^s(\w+)TaskStack$} ? 'ff_' . lc($1) : $name);
+    $stacks{$name} = { size => $sym->{size}, module => $sym->{module}, task => $task };
+}
+
+# measured stack high-water marks from the "mon: tsk: ..." lines in the debug output (see src/mon.c)
+my %hwms = (); # task name => lowest high-water mark [bytes]
+if ($monlog)
+{
+    open(my $fh, '<', $monlog) || die("Failed opening $monlog: $!\n");
+    while (my $line = <$fh>)
+    {
+        next unless ($line =~ m{mon: tsk: \d+ (.{16}) \S\s+\d+-\s*\d+\s+(\d+)});
+        my ($task, $hwm) = ($1, $2 * $STACKTYPESIZE);
+        $task =~ s{\s+$}{};
+        $hwms{$task} = $hwm if (!defined $hwms{$task} || ($hwm < $hwms{$task}));
+    }
+    close($fh);
+}
+
+################################################################################
+# baseline: "region <region> <bytes>", "module <region> <module> <bytes>" and "stack <symbol> <bytes>"
+
+my %base = ();
+if ($baseline && -f $baseline && !$update)
+{
+    open(my $fh, '<', $baseline) || die("Failed opening $baseline: $!\n");
+    while (my $line = <$fh>)
+    {
+        next if ($line =~ m{^\s*(#|$)});
+        my @f = split(/\s+/, $line);
+        if    ($f[0] eq 'region') { $base{$f[1]} = $f[2]; }
+        elsif ($f[0] eq 'module') { $base{"$f[1] $f[2]"} = $f[3]; }
+        elsif ($f[0] eq 'stack')  { $base{"stack $f[1]"} = $f[2]; }
+    }
+    close($fh);
+}
+my $haveBase = %base ? 1 : 0;
+
+sub _diff
+{
+    my ($key, $now) = @_;
+    return '' unless ($haveBase);
+    my $diff = $now - ($base{$key} // 0);
+    return sprintf(' %+6d%s', $diff, $diff > 0 ? ' !' : '  ');
+}
+
+################################################################################
+# report
+
+my @modules = do { my %m = map { (split(/ /, $_, 2))[1] => 1 } grep { m{ } } keys %usage; sort keys %m; };
+
+print("***** usage per region *****\n");
+my @failed = ();
+foreach my $region (@REGIONS)
+{
+    my $used = $usage{$region->{name}} // 0;
+    printf("%-4s 0x%08x+0x%05x  %6u/%6u (%5.1f%%)  %6u free%s\n", $region->{name}, $region->{start}, $region->{size},
+           $used, $region->{size}, $used / $region->{size} * 1e2, $region->{size} - $used, _diff($region->{name}, $used));
+    if ($haveBase && defined $limits{$region->{name}} && (($used - ($base{$region->{name}} // 0)) > $limits{$region->{name}}))
+    {
+        push(@failed, sprintf('%s grew by %d bytes (limit %d)', $region->{name}, $used - ($base{$region->{name}} // 0),
+                              $limits{$region->{name}}));
+    }
+}
+
+print("\n***** usage per module *****\n");
+printf("%-24s %s\n", 'module', join('', map { sprintf(' %6s%s', $_->{name}, $haveBase ? '         ' : '') } @REGIONS));
+foreach my $module (sort { ($usage{"iRAM $b"} // 0) <=> ($usage{"iRAM $a"} // 0) || $a cmp $b } @modules)
+{
+    printf("%-24s %s\n", $module, join('', map
+    {
+        my $key = "$_->{name} $module";
+        sprintf(' %6u%s', $usage{$key} // 0, $haveBase ? (defined $usage{$key} || defined $base{$key} ? _diff($key, $usage{$key} // 0) : ' ' x 9) : '');
+    } @REGIONS));
+}
+
+foreach my $region (@REGIONS)
+{
+    printf("\n***** top %d %s symbols *****\n", $nTop, $region->{name});
+    my @top = sort { $b->{size} <=> $a->{size} || $a->{name} cmp $b->{name} } grep { $_->{region} eq $region->{name} } @symbols;
+    printf("%6u  0x%08x  %-16s %-14s %s\n", $_->{size}, $_->{addr}, $_->{module}, $_->{sec}, $_->{name})
+        for (@top[0 .. ($nTop < ($#top + 1) ? $nTop : ($#top + 1)) - 1]);
+}
+
+print("\n***** task stacks *****\n");
+printf("%-20s %-10s %-10s %6s%s %8s %6s\n", 'symbol', 'module', 'task', 'size', $haveBase ? '         ' : '', 'min free', 'used');
+my $stacksTotal = 0;
+foreach my $name (sort { $stacks{$b}->{size} <=> $stacks{$a}->{size} || $a cmp $b } keys %stacks)
+{
+    my $s = $stacks{$name};
+    my $hwm = $hwms{$s->{task}};
+    printf("%-20s %-10s %-10s %6u%s %8s %6s\n", $name, $s->{module}, $s->{task}, $s->{size}, _diff("stack $name", $s->{size}),
+           defined $hwm ? $hwm : '?', defined $hwm ? sprintf('%.0f%%', ($s->{size} - $hwm) / $s->{size} * 1e2) : '?');
+    $stacksTotal += $s->{size};
+    if ($haveBase && defined $base{"stack $name"} && ($s->{size} > $base{"stack $name"}))
+    {
+        push(@failed, sprintf('%s grew by %d bytes', $name, $s->{size} - $base{"stack $name"}));
+    }
+}
+printf("%-42s %6u\n", 'total', $stacksTotal);
+
+if ($baseline && $update)
+{
+    open(my $fh, '>', $baseline) || die("Failed writing $baseline: $!\n");
+    print($fh "# memory usage baseline, see tools/memreport.pl and \"make mem-baseline\"\n");
+    printf($fh "region %s %u\n", $_->{name}, $usage{$_->{name}} // 0) for (@REGIONS);
+    foreach my $module (@modules)
+    {
+        printf($fh "module %s %s %u\n", $_->{name}, $module, $usage{"$_->{name} $module"}) for (grep { defined $usage{"$_->{name} $module"} } @REGIONS);
+    }
+    printf($fh "stack %s %u\n", $_, $stacks{$_}->{size}) for (sort keys %stacks);
+    close($fh);
+    print("\nbaseline $baseline updated\n");
+}
+elsif ($baseline && !$haveBase)
+{
+    print("\nno baseline $baseline (make mem-baseline)\n");
+}
+
+if (@failed)
+{
+    print("\n");
+    print("memory usage regression: $_\n") for (@failed);
+    exit(1);
+}
+
+sub help
+{
+    print(
+          "Usage: $0 -e <elf> [-O <objdump>] [-b <baseline> [-u]] [-m <debuglog>] [-n <top>] [-i|-r|-d <bytes>] [<archives and objects>...]\n",
+          "\n",
+          "  -e <elf>        firmware image\n",
+          "  -O <objdump>    objdump to use (default $objdump)\n",
+          "  -b <baseline>   baseline to compare against (with -u: to write)\n",
+          "  -u              update the baseline\n",
+          "  -m <debuglog>   debug output with \"mon: tsk:\" lines for the stack high-water marks\n",
+          "  -n <top>        number of largest symbols to show per region (default $nTop)\n",
+          "  -i <bytes>      fail if iRAM grew by more than this compared to the baseline\n",
+          "  -r <bytes>      same for iROM\n",
+          "  -d <bytes>      same for dRAM\n",
+          "\n",
+          "The archives and objects are used to find the module of each global symbol (local symbols\n",
+          "go by the source file). The firmware's own objects (from program.a) are reported\n",
+          "individually, libraries by archive. Growth of any task stack fails, too.\n",
+         );
+    exit(0);
+}
+
+################################################################################
+1;
+__END__
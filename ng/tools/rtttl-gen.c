@@ -0,0 +1,54 @@
+/*!
+    \file
+    \brief flipflip's Tschenggins Lämpli: host-side precompiler for the builtin RTTTL melodies
+
+    - Copyright (c) 2018 Philippe Kehl (flipflip at oinkzwurgl dot org),
+      https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+
+    Parses the builtin melodies from 3rdparty/rtttl.c (with the same rtttlIterNext() as the firmware)
+    and prints a header with the notes as TONE_NOTE(freq, dur) lists for tone.c, which turns them
+    into timer values and toggle counts at compile time. The build runs this to generate rtttl_gen.h.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../3rdparty/rtttl.c"
+
+int main(void)
+{
+    const int nMelodies = (int)(sizeof(skRtttlMelodies) / sizeof(*skRtttlMelodies));
+
+    printf("// generated by tools/rtttl-gen.c from 3rdparty/rtttl.c, do not edit\n");
+    printf("#ifndef __RTTTL_GEN_H__\n");
+    printf("#define __RTTTL_GEN_H__\n");
+
+    for (int ix = 0; ix < nMelodies; ix++)
+    {
+        RTTTL_ITER_t iter;
+        rtttlIterInit(&iter, skRtttlMelodies[ix]);
+        printf("static const TONE_NOTE_t skRtttlGen%02d[] = {", ix);
+        int nNotes = 0;
+        int16_t freq, dur;
+        while (rtttlIterNext(&iter, &freq, &dur))
+        {
+            printf("%s TONE_NOTE(%d, %d),", (nNotes % 8) == 0 ? "\n   " : "", freq, dur);
+            nNotes++;
+        }
+        printf("\n};\n");
+    }
+
+    printf("static const TONE_BUILTIN_t skRtttlGenMelodies[] =\n{\n");
+    for (int ix = 0; ix < nMelodies; ix++)
+    {
+        const char *pkName = skRtttlMelodies[ix];
+        const int nameLen = (int)(strchr(pkName, ':') - pkName);
+        printf("    { \"%.*s\", skRtttlGen%02d, NUMOF(skRtttlGen%02d) },\n", nameLen, pkName, ix, ix);
+    }
+    printf("};\n");
+
+    printf("#endif // __RTTTL_GEN_H__\n");
+    return 0;
+}
+
+// eof
@@ -0,0 +1,73 @@
+#!/usr/bin/perl
+################################################################################
+#
+# right-sized task stacks from the calibration build's debug output (see src/stacks.h)
+#
+# Usage: stacks.pl [-m <margin%>] [-w <words>] <debuglog>... > src/stacks_gen.h
+#
+# Copyright (c) 2018 Philippe Kehl <flipflip at oinkzwurgl dot org>
+# https://oinkzwurgl.org/projaeggd/tschenggins-laempli
+#
+################################################################################
+
+use strict;
+use warnings;
+
+my $margin = 25; # [%] of the peak usage
+my $extra  = 32; # [StackType_t] on top of that (for the interrupts and the SDK's callbacks)
+my $round  = 16; # [StackType_t]
+my @logs   = ();
+while (my $arg = shift(@ARGV))
+{
+    if    ($arg eq '-m') { $margin = shift(@ARGV); }
+    elsif ($arg eq '-w') { $extra  = shift(@ARGV); }
+    elsif ($arg =~ m{^-})
+    {
+        die("Usage: $0 [-m <margin%>] [-w <words>] <debuglog>... > src/stacks_gen.h\n");
+    }
+    else
+    {
+        push(@logs, $arg);
+    }
+}
+
+# "mon: stk: <id> <task> <size> <lowest high-water mark>" lines from src/mon.c (sizes in StackType_t)
+my %stacks = (); # id => { size, peak, tasks => { task => 1 } }
+my $nLines = 0;
+foreach my $log (@logs ? @logs : ('-'))
+{
+    open(my $fh, '<', $log) || die("Failed opening $log: $!\n");
+    while (my $line = <$fh>)
+    {
+        next unless ($line =~ m{mon: stk: (\w+) (\S+) (\d+) (\d+)});
+        my ($id, $task, $size, $hwm) = ($1, $2, $3, $4);
+        my $peak = $size - $hwm;
+        my $s = ($stacks{$id} //= { size => $size, peak => 0, tasks => {} });
+        $s->{peak} = $peak if ($peak > $s->{peak});
+        $s->{tasks}->{$task} = 1;
+        $nLines++;
+    }
+    close($fh);
+}
+die("No \"mon: stk:\" lines found. Is this the debug output of a calibration build (STACKSCALIB=1)?\n") unless ($nLines);
+
+print("// generated by tools/stacks.pl (make stacks-gen), do not edit, see src/stacks.h\n");
+printf("// peak usage + %d%% + %d words, rounded up to %d words, from %d measurements\n", $margin, $extra, $round, $nLines);
+print("#ifndef __STACKS_GEN_H__\n");
+print("#define __STACKS_GEN_H__\n");
+foreach my $id (sort keys %stacks)
+{
+    my $s = $stacks{$id};
+    my $size = int( (($s->{peak} * (100 + $margin) / 100) + $extra + $round - 1) / $round ) * $round;
+    if ($s->{peak} >= $s->{size})
+    {
+        warn("Stack $id overflowed in the calibration!\n");
+    }
+    printf("#define STACK_%-19s %4u // %s: peak %u of %u (default %u)\n", $id, $size,
+           join(', ', sort keys %{$s->{tasks}}), $s->{peak}, $s->{size}, $s->{size} / 2);
+}
+print("#endif // __STACKS_GEN_H__\n");
+
+################################################################################
+1;
+__END__
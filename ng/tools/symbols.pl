@@ -4,6 +4,7 @@
 # show ram symbols
 #
 # Usage: objdump -t img.elf | ramsyms
+#        objdump -t img.elf | ramsyms lookup <addr> ...   (symbolise addresses, see also tools/debug.pl)
 #
 # Copyright (c) 2017 Philippe Kehl <flipflip at oinkzwurgl dot org>
 # https://oinkzwurgl.org/projaeggd/tschenggins-laempli
@@ -13,7 +14,38 @@
 use strict;
 use warnings;
 
-die("Usage: objdump -t foo.elf | $0 <regName> <regStart> <regSize>") unless ($#ARGV == 2);
+die("Usage: objdump -t foo.elf | $0 <regName> <regStart> <regSize>\n" .
+    "       objdump -t foo.elf | $0 lookup <addr> ...") unless ( ($#ARGV == 2) || ($ARGV[0] && ($ARGV[0] eq 'lookup')) );
+
+# symbolise addresses, e.g. the epc1 and the stack contents of a fatal exception dump:
+# "<addr> <symbol>+<offset> <section>"
+if ($ARGV[0] eq 'lookup')
+{
+    my @addrs = map { 1 * ($_ =~ m{^0x|h$} ? hex($_) : $_) } @ARGV[1..$#ARGV];
+    my @syms = ();
+    while (<STDIN>)
+    {
+        if (m/^([0-9a-fA-F]{8})\s.{7}\s(\S+)\s+([0-9a-fA-F]{8})\s+(.*?)\r*\n*$/)
+        {
+            push(@syms, { addr => hex($1), sec => $2, size => hex($3), sym => $4 }) if (hex($1));
+        }
+    }
+    @syms = sort { $a->{addr} <=> $b->{addr} } @syms;
+    foreach my $addr (@addrs)
+    {
+        # last symbol at or before the address (that contains it, if it has a size)
+        my ($s) = grep { ($_->{addr} <= $addr) && (!$_->{size} || ($addr < ($_->{addr} + $_->{size}))) } reverse @syms;
+        if ($s)
+        {
+            printf("0x%08x  %s+0x%x  %s\n", $addr, $s->{sym}, $addr - $s->{addr}, $s->{sec});
+        }
+        else
+        {
+            printf("0x%08x  ???\n", $addr);
+        }
+    }
+    exit(0);
+}
 
 my $regName  = $ARGV[0];
 my $regStart = 1 * ($ARGV[1] =~ m{^0x|h$} ? hex($ARGV[1]) : $ARGV[1]);
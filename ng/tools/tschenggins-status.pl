@@ -23,9 +23,11 @@ use warnings;
 use CGI qw(-nosticky); # -debug
 use CGI::Carp qw(fatalsToBrowser);
 use JSON::PP;
+BEGIN { eval { require JSON::XS; }; }
 use Fcntl qw(:flock :seek);
 use FindBin;
 use Digest::MD5;
+use Digest::SHA;
 use Data::Dumper;
 $Data::Dumper::Sortkeys = 1;
 $Data::Dumper::Terse = 1;
@@ -33,6 +35,9 @@ use lib "/mnt/fry/d1/flip/tschenggins-laempli/ng/tools";
 use Pod::Usage;
 use IO::Handle;
 use Time::HiRes qw(time);
+use MIME::Base64;
+use IO::Socket::UNIX;
+use IO::Select;
 
 my $q = CGI->new();
 
@@ -40,17 +45,38 @@ my @DEBUGSTRS     = ();
 my $DATADIR       = $FindBin::Bin;
 my $VALIDRESULT   = { unknown => 1, success => 2, unstable => 3, failure => 4 };
 my $VALIDSTATE    = { unknown => 1, off => 2, running => 3, idle => 4 };
+my $BINRESULT     = { unknown => 0, success => 1, unstable => 2, failure => 3 }; # JENKINS_RESULT_t in the firmware
+my $BINSTATE      = { unknown => 0, off => 1, running => 2, idle => 3 };         # JENKINS_STATE_t in the firmware
+my $GROUPSTATE    = { unknown => 0, off => 1, idle => 2, running => 3 };         # worst (highest) state wins in a job group
+my $GROUPSERVER   = 'group'; # server name of job groups (see _groupSet())
 my $UNKSTATE      = { name => 'unknown', server => 'unknown', result => 'unknown', state => 'unknown', ts => int(time()) };
 my $JOBNAMERE     = qr{^[-_a-zA-Z0-9]{5,50}$};
 my $SERVERNAMERE  = qr{^[-_a-zA-Z0-9.]{5,50}$};
 my $JOBIDRE       = qr{^[0-9a-z]{8,8}$};
+my $FWIMAGERE     = qr{^[-_a-zA-Z0-9][-_.a-zA-Z0-9]{0,46}$}; # OTA_IMAGE_MAX in the firmware
+my $FWDIR         = "$DATADIR/firmware"; # firmware images for cmd=firmware (see "make ota-image")
 my $DBFILE        = $ENV{'REMOTE_USER'} ? "$DATADIR/tschenggins-status-$ENV{'REMOTE_USER'}.json" : "$DATADIR/tschenggins-status.json";
+my $DBLOCKFILE    = "$DBFILE.lock";
+my $DBLOGMAX      = 512 * 1024; # write new snapshot when the log gets bigger than this
+my $DBCOLLS       = { jobs => 1, clients => 1, config => 1, cmd => 1, jobclients => 1, jobgroups => 1, telemetry => 1 };
+my $DBREADONLY    = { hello => 1, delay => 1, list => 1, get => 1, help => 1, gui => 1, rawdb => 1, metrics => 1, firmware => 1 };
+my $RTRESTARTSPREAD = 60; # spread reconnects over this many seconds when the realtime daemon stops
+my $RTSESSIONSNAPS = 16; # number of states kept per realtime session (see _realtimeResume())
+my $TELEMETRYHIST = 24; # number of telemetry records kept per client (see _telemetry())
+my $METRICSFILE   = "$DBFILE.metrics";
+my $METRICSBUCKETS = [ 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5 ];
+my %METRICS       = ( counters => {}, hists => {}, gauges => {} ); # this process' metrics (see _metricsFlush())
+my @METRICSCPU    = ( 0, 0 ); # this process' user and system CPU time already accounted for (see _metricsFlush())
+my $SOCKFILE      = $ENV{'REMOTE_USER'} ? "$DATADIR/tschenggins-status-$ENV{'REMOTE_USER'}.sock" : "$DATADIR/tschenggins-status.sock";
+my $JSONCLASS     = $JSON::XS::VERSION ? 'JSON::XS' : 'JSON::PP'; # use the faster JSON::XS if available
+my $MQTTURL       = $ENV{'TSCHENGGINS_MQTT'} || ''; # "mqtt://[<user>:<pass>@]<host>[:<port>]/<prefix>", see _mqttPublish()
 
 #DEBUG("DATADIR=%s, VALIDRESULT=%s, VALIDSTATE=%s", $DATADIR, $VALIDRESULT, $VALIDSTATE);
 
 do
 {
     my $TITLE  = 'Tschenggins Lämpli';
+    my $t0     = time();
 
     ##### get parameters #####
 
@@ -96,8 +122,21 @@ do
 
 =item * C<maxch> -- maximum number of channels the client can handle
 
+=item * C<proto> -- realtime protocol version the client understands (default 1, JSON status only;
+        2 = also binary "bstatus" updates; 3 = also "session" lines)
+
+=item * C<session> -- realtime session to resume ("<id>:<seq>" from the last "session" line)
+
+=item * C<telemetry> -- client resource usage record (compact JSON, see the firmware's monGetTelemetry())
+
+=item * C<image> -- firmware image name (for cmd=firmware)
+
+=item * C<offset>, C<limit> -- paging for lists (default 0, i.e. from the start and everything),
+        e.g. for cmd=list and cmd=jobs
+
 =item * C<chunked> -- use "Transfer-Encoding: chunked" with given chunk size
-        (default 0, i.e. not chunked), only for JSON output (e.g. cmd=list)
+        (default 0, i.e. not chunked), only for JSON output (e.g. cmd=list). The output is encoded
+        and sent incrementally, chunk by chunk.
 
 =back
 
@@ -123,6 +162,9 @@ do
     my $version  = $q->param('version')  || '';
     my $maxch    = $q->param('maxch')    || 10;
     my $chunked  = $q->param('chunked')  || 0;
+    my $proto    = $q->param('proto')    || 1;
+    my $session  = $q->param('session')  || '';
+    my $telemetry = $q->param('telemetry') || '';
     my @states   = (); # $q->multi_param('states');
     my @jobs     = $q->multi_param('jobs');
     my $model    = $q->param('model')    || '';
@@ -130,7 +172,17 @@ do
     my $order    = $q->param('order')    || '';
     my $bright   = $q->param('bright')   || '';
     my $noise    = $q->param('noise')    || '';
+    my $fps      = $q->param('fps')      || '';
+    my $spiclk   = $q->param('spiclk')   || '';
+    my $dither   = $q->param('dither')   || '';
+    my $leds     = $q->param('leds')     || '';
+    my $chleds   = $q->param('chleds')   || '';
+    my $power    = $q->param('power')    || '';
+    my $relay    = $q->param('relay')    || '';
+    my $quiet    = $q->param('quiet')    || '';
+    my $fx       = $q->param('fx')       || '';
     my $cfgcmd   = $q->param('cfgcmd')   || '';
+    my $image    = $q->param('image')    || '';
 
     # default: gui
     if (!$cmd)
@@ -149,7 +201,7 @@ do
         {
             local $^W;
             local $SIG{__DIE__} = 'IGNORE';
-            $jsonObj = JSON::PP->new()->utf8()->decode($jsonStr);
+            $jsonObj = $JSONCLASS->new()->utf8()->decode($jsonStr);
         };
         if ($jsonObj)
         {
@@ -163,6 +215,49 @@ do
     $q->param('debug', 1) if ($debug);
     DEBUG("cmd=%s user=%s", $cmd, $ENV{'REMOTE_USER'} || 'anonymous');
     $chunked = 0 if ($chunked !~ m{^\d+$}); # positive integers only
+    $offset  = 0 if ($offset  !~ m{^\d+$});
+    $limit   = 0 if ($limit   !~ m{^\d+$});
+
+
+    ##### realtime daemon #####
+
+=pod
+
+=head2 Realtime Daemon
+
+C<< ./tschenggins-status.pl cmd=realtimed [debug=1] >>
+
+Runs the realtime daemon, which serves all C<cmd=realtime> clients from a single process. It has to
+run as the same user as the web server (and with the same C<REMOTE_USER> environment variable, if
+any). It listens on a Unix socket next to the database file (F<tschenggins-status.sock>), keeps a copy
+of the database in memory and sends the changes to the connected clients as they happen. Commands that
+change the database notify it via the socket (or C<kill -USR1> it). The C<cmd=realtime> requests then
+only copy the daemon's output to the client. Without the daemon each C<cmd=realtime> request polls the
+database itself. When the daemon is stopped it tells the clients to reconnect after a random delay
+("reconnect <ts> <seconds>"), so that they don't all come back at the same time.
+
+=head2 MQTT
+
+With the C<TSCHENGGINS_MQTT> environment variable set to an MQTT broker
+("mqtt://[<user>:<pass>@]<host>[:<port>]/<prefix>", needs L<Net::MQTT::Simple>) the changes are also
+published to the broker, for clients built with C<make ... MQTT=1> (see the firmware's F<mqtt.h>): the
+job states to C<< <prefix>/job/<server>/<job> >>, the realtime lines for each client to
+C<< <prefix>/client/<clientid> >>, the commands to C<< <prefix>/client/<clientid>/command >> and the
+time to C<< <prefix>/heartbeat >>. Only the commands aren't retained. The retained messages of removed
+jobs stay on the broker.
+
+=cut
+
+    if ($cmd eq 'realtimed')
+    {
+        if ($ENV{GATEWAY_INTERFACE})
+        {
+            print($q->header(-type => 'text/plain', -status => 400), "400 Bad Request: command line only\n");
+            exit(0);
+        }
+        _realtimed($debug); # this doesn't return
+        exit(0);
+    }
 
 
     ##### output is HTML, JSON or text #####
@@ -170,18 +265,20 @@ do
     my @html = ();
     my $data = undef;
     my $text = '';
+    my $binary = '';
     my $error = '';
 
 
     ##### load and lock "database" #####
 
-    (my $dbHandle, my $db, $error) = _dbOpen();
+    (my $dbHandle, my $db, $error) = _dbOpen($DBREADONLY->{$cmd});
     if ($error)
     {
         $cmd = '';
     }
 
     my $signalClient = 0;
+    my $notifyRealtime = 0;
 
     ##### handle requests #####
 
@@ -217,7 +314,9 @@ Connection check. Responds with "hi there" (immediately or after a delay).
 =item B<< C<< cmd=update [debug=...] [ascii=...] <states=...> [...] >> >>
 
 This expects a application/json POST request. The C<states> array consists of objects with the following
-fields: C<server>, C<name> and optionally C<state> and/or C<result>.
+fields: C<server>, C<name> and optionally C<state> and/or C<result>. All states are applied at once, in
+one database update (or not at all if one of them is invalid), and the realtime clients are notified
+once.
 
 =cut
 
@@ -227,6 +326,7 @@ fields: C<server>, C<name> and optionally C<state> and/or C<result>.
         (my $res, $error) = _update($db, @states);
         if ($res)
         {
+            $notifyRealtime = 1;
             $text = "db updated";
             #$data = { res => $res, text => 'db updated' };
         }
@@ -269,42 +369,48 @@ Get job state.
 
 =pod
 
-=item B<<  C<< cmd=jobs client=<clientid> name=<client name> staip=<client station IP> stassid=<client station SSID> version=<client sw version> strlen=<number> maxch=<number> >> >>
+=item B<<  C<< cmd=jobs client=<clientid> name=<client name> staip=<client station IP> stassid=<client station SSID> version=<client sw version> strlen=<number> maxch=<number> offset=<number> limit=<number> >> >>
 
-Returns info for a client and updates client info.
+Returns info for a client (with optional offset and/or limit into the list of jobs) and updates client info.
 
 =cut
 
     elsif ($cmd eq 'jobs')
     {
-        ($data, $error) = _jobs($db, $client, $strlen,
+        ($data, $error) = _jobs($db, $client, $strlen, $offset, $limit,
             { name => $name, staip => $staip, stassid => $stassid, version => $version, maxch => $maxch });
     }
 
 =pod
 
-=item B<<  C<< cmd=realtime client=<clientid> name=<client name> staip=<client station IP> stassid=<client station SSID> version=<client sw version> strlen=<number> maxch=<number> >> >>
+=item B<<  C<< cmd=realtime client=<clientid> name=<client name> staip=<client station IP> stassid=<client station SSID> version=<client sw version> strlen=<number> maxch=<number> session=<id>:<seq> telemetry=<json> >> >>
 
 Returns info for a client and updates client info. This persistent connection with real-time update as things happen.
 
+With protocol version 3 each batch of updates is followed by a "session <ts> <id> <seq>" line. A client
+that reconnects with C<session=<id>:<seq>> of the last such line it has applied gets only the changes
+since then (if the realtime daemon still knows that state), otherwise a new session starts with all
+channels (up to C<maxch>).
+
 =cut
 
     elsif ($cmd eq 'realtime')
     {
         # dummy call like cmd=leds to check the parameters and update the client info in the DB
-        ($data, $error) = _jobs($db, $client, $strlen,
+        ($data, $error) = _jobs($db, $client, $strlen, 0, 0,
             { name => $name, staip => $staip, stassid => $stassid, version => $version, maxch => $maxch });
+        _telemetry($db, $client, $telemetry) if ($data);
 
         # clear pending commands
         $db->{cmd}->{$client} = '';
-        $db->{_dirtiness}++;
+        _dbDirty($db, 'cmd', $client);
 
         # save pid so that previous instances can terminate in case they're still running
         # and haven't noticed yet that the Lämpli is gone (Apache waiting "forever" for TCP timeout)
         unless ($error)
         {
             $db->{clients}->{$client}->{pid} = $$;
-            $db->{_dirtiness}++;
+            _dbDirty($db, 'clients', $client);
         }
 
         # continues in call to _realtime() below... (unless $error)
@@ -312,6 +418,30 @@ Returns info for a client and updates client info. This persistent connection wi
 
 =pod
 
+=item B<<  C<< cmd=firmware client=<clientid> image=<name> >> >>
+
+Returns the firmware image F<< firmware/<name>.bin >> (as application/octet-stream) for an over-the-air
+update. Clients fetch it when they get the "update <ts> <name> <size> <sha256> <signature>" command (see
+C<cmd=cfgcmd>).
+
+=cut
+
+    elsif ($cmd eq 'firmware')
+    {
+        my ($file, $size, $sha, $sig) = _firmwareInfo($image);
+        if ($file)
+        {
+            DEBUG("firmware $client $image $size $sha");
+            $binary = $file;
+        }
+        else
+        {
+            $error = 'illegal image';
+        }
+    }
+
+=pod
+
 =back
 
 =head3 Web Interface Commands
@@ -361,6 +491,7 @@ Set job state and/or result.
         (my $res, $error) = _set($db, $job, $state, $result);
         if ($res)
         {
+            $notifyRealtime = 1;
             $text = "db updated";
         }
     }
@@ -378,6 +509,7 @@ Add job.
         (my $res, $error) = _add($db, $server, $job, $state, $result);
         if ($res)
         {
+            $notifyRealtime = 1;
             $text = "db updated";
         }
     }
@@ -395,6 +527,7 @@ Delete job.
         (my $res, $error) = _del($db, $job);
         if ($res)
         {
+            $notifyRealtime = 1;
             $text = "db updated";
         }
     }
@@ -409,8 +542,26 @@ Returns the raw database (JSON).
 
     elsif ($cmd eq 'rawdb')
     {
-        delete $db->{_dirtiness};
-        $data = { db => $db, res => 1 };
+        # (stream the collections record by record)
+        my $dbData = _dbData($db);
+        $dbData->{$_} = _jsonStreamHash($dbData->{$_}) for (keys %{$DBCOLLS});
+        $data = { db => $dbData, res => 1 };
+    }
+
+=pod
+
+=item B<<  C<< cmd=metrics >> >>
+
+Returns metrics in the Prometheus text format: number of requests, errors and latency histograms
+per command, latency histograms of the database operations (lock wait, read, write, snapshot), the
+number of clients online, the number of realtime daemon connections and bytes streamed to the
+realtime clients, and the CPU time used by all backend processes (see also F<tschenggins-stream.pl>).
+
+=cut
+
+    elsif ($cmd eq 'metrics')
+    {
+        $text = _metrics($db);
     }
 
 =pod
@@ -426,9 +577,13 @@ Remove client info.
     {
         if ($client && $db->{clients}->{$client})
         {
+            _dbSetClientJobs($db, $client, undef);
             delete $db->{clients}->{$client};
             delete $db->{config}->{$client};
-            $db->{_dirtiness}++;
+            delete $db->{cmd}->{$client};
+            delete $db->{telemetry}->{$client};
+            _dbDirty($db, $_, $client) for (qw(clients config cmd telemetry));
+            $notifyRealtime = 1;
             $text = "client $client removed";
         }
         else
@@ -439,7 +594,7 @@ Remove client info.
 
 =item B<<  C<< cmd=cfgjobs client=<clientid> jobs=<jobID> ... >> >>
 
-Set client jobs configuration.
+Set client jobs configuration. The job IDs can also be the IDs of job groups (see C<cmd=cfggroup>).
 
 =cut
 
@@ -451,10 +606,10 @@ Set client jobs configuration.
         {
             # remove illegal and empty IDs
             @jobs = map { $_ && $db->{jobs}->{$_} ? $_ : '' } @jobs;
-            $db->{config}->{$client}->{jobs} = \@jobs;
-            $db->{_dirtiness}++;
+            _dbSetClientJobs($db, $client, \@jobs);
             $text = "client $client set jobs @jobs";
             # signal server
+            $notifyRealtime = 1;
             if ($db->{clients}->{$client}->{pid})
             {
                 $signalClient = $db->{clients}->{$client}->{pid};
@@ -466,16 +621,41 @@ Set client jobs configuration.
         }
     }
 
-=item B<<  C<< cmd=cfgdevice client=<clientid> model=<...> driver=<...> order=<...> bright=<...> noise=<...> name=<...> >> >>
+=item B<<  C<< cmd=cfggroup name=<group name> jobs=<jobID> ... >> >>
+
+Set the jobs of a job group (add the group if necessary, remove it if there are no jobs). A group is
+a job (server "group") whose state and result are the worst of its jobs' (running before idle before
+off, failure before unstable before success). It is recomputed whenever one of its jobs changes, and
+it goes on a channel like any other job (C<cmd=cfgjobs>), i.e. a client gets one channel (and one
+update) for the group no matter how many jobs it has.
+
+=cut
+
+    # set job group
+    elsif ($cmd eq 'cfggroup')
+    {
+        DEBUG("group $name @jobs");
+        (my $res, $error) = _groupSet($db, $name, grep { $_ } @jobs);
+        if ($res)
+        {
+            $text = "group $name set jobs @jobs";
+            $notifyRealtime = 1;
+        }
+    }
+
+=item B<<  C<< cmd=cfgdevice client=<clientid> model=<...> driver=<...> order=<...> bright=<...> noise=<...> fps=<...> spiclk=<...> dither=<...> leds=<...> chleds=<...> power=<...> relay=<...> quiet=<...> fx=<...> name=<...> >> >>
 
-Set client device configuration.
+Set client device configuration. The quiet hours (no noises) are given as C<< <from>-<to> >> in the local time
+of the server, e.g. C<22-7>. With C<relay=on> devices on the same network share one backend connection (see
+the firmware's relay.h). The LED effect programs are given as a hex string (up to 96 bytes, see the firmware's
+leds.h).
 
 =cut
 
     # set client device configuration
     elsif ($cmd eq 'cfgdevice')
     {
-        DEBUG("cfg $client $model $driver $order $bright $noise $name");
+        DEBUG("cfg $client $model $driver $order $bright $noise $fps $spiclk $dither $leds $chleds $power $relay $quiet $fx $name");
         if ($client && $db->{config}->{$client}) # && $model && $driver && $order && $bright && $noise && $name)
         {
             $db->{config}->{$client}->{model}  = $model;
@@ -483,11 +663,21 @@ Set client device configuration.
             $db->{config}->{$client}->{order}  = $order;
             $db->{config}->{$client}->{bright} = $bright;
             $db->{config}->{$client}->{noise}  = $noise;
+            $db->{config}->{$client}->{fps}    = $fps;
+            $db->{config}->{$client}->{spiclk} = $spiclk;
+            $db->{config}->{$client}->{dither} = $dither;
+            $db->{config}->{$client}->{leds}   = $leds   =~ m{^\d+$} ? $leds   : '';
+            $db->{config}->{$client}->{chleds} = $chleds =~ m{^\d+$} ? $chleds : '';
+            $db->{config}->{$client}->{power}  = $power;
+            $db->{config}->{$client}->{relay}  = $relay;
+            $db->{config}->{$client}->{quiet}  = $quiet =~ m{^([01]?\d|2[0-3])-([01]?\d|2[0-3])$} ? $quiet : '';
+            $db->{config}->{$client}->{fx}     = $fx =~ m{^(?:[0-9a-fA-F]{2}){1,96}$} ? lc($fx) : '';
             $name =~ s{[^a-z0-9A-Z]}{_}g;
             $db->{config}->{$client}->{name}   = substr($name, 0, 20);
-            $db->{_dirtiness}++;
-            $text = "client $client set config $model $driver $order $bright $noise $name";
+            _dbDirty($db, 'config', $client);
+            $text = "client $client set config $model $driver $order $bright $noise $fps $spiclk $dither $leds $chleds $power $relay $quiet $fx $name";
             # signal server
+            $notifyRealtime = 1;
             if ($db->{clients}->{$client}->{pid})
             {
                 $signalClient = $db->{clients}->{$client}->{pid};
@@ -503,7 +693,11 @@ Set client device configuration.
 
 =item B<<  C<< cmd=cfgcmd cfgcmd=<...> >> >>
 
-Send command to client.
+Send command to client. Besides the commands offered in the GUI, C<< melody <name> >> plays a builtin
+melody and C<< melody <RTTTL> >> (e.g. C<< melody Beep:d=4,o=6,b=120:c,e,g >>) plays the given melody.
+C<< update <name> >> updates the client's firmware with the image F<< firmware/<name>.bin >> (the command
+sent to the client has the size, SHA-256 and signature of the image added, see C<cmd=firmware>, and "make
+ota-image" in the firmware).
 
 =cut
 
@@ -511,12 +705,19 @@ Send command to client.
     elsif ($cmd eq 'cfgcmd')
     {
         DEBUG("cmd $client $cfgcmd");
+        # firmware update: add size, hash and signature of the image
+        if ($cfgcmd =~ m{^update\s+(\S+)$})
+        {
+            my ($file, $size, $sha, $sig) = _firmwareInfo($1);
+            $cfgcmd = $file ? "update $1 $size $sha $sig" : '';
+        }
         if ($client && $db->{config}->{$client} && $cfgcmd)
         {
             $db->{cmd}->{$client} = $cfgcmd;
-            $db->{_dirtiness}++;
+            _dbDirty($db, 'cmd', $client);
             $text = "client $client send command $cfgcmd";
             # signal server
+            $notifyRealtime = 1;
             if ($db->{clients}->{$client}->{pid})
             {
                 $signalClient = $db->{clients}->{$client}->{pid};
@@ -547,10 +748,22 @@ Send command to client.
 
     ##### close, update database with changes, and unlock #####
 
+    # what to publish to the MQTT broker (the dirty records are gone after closing the database)
+    my $mqttDirty = $MQTTURL && !$error && $db ? { map { $_, [ keys %{$db->{_dirty}->{$_} || {}} ] } qw(jobs config cmd) } : undef;
+
     _dbClose($dbHandle, $db, $debug, $error ? 0 : 1);
 
-    # signal client?
-    if ($signalClient)
+    # publish the changes to the MQTT broker
+    _mqttPublish($db, $mqttDirty) if ($mqttDirty);
+
+    # request metrics (by command, but don't let random commands clutter the metrics)
+    my $cmdLabel = sprintf('cmd="%s"', ($error && ($error eq 'illegal command')) || ($cmd !~ m{^[a-z]+$}) ? 'other' : $cmd);
+    _metricsCount('tschenggins_requests_total', $cmdLabel);
+    _metricsCount('tschenggins_request_errors_total', $cmdLabel) if ($error);
+    _metricsObserve('tschenggins_request_seconds', $cmdLabel, time() - $t0);
+
+    # tell the realtime daemon, or signal the client (if there's no daemon)
+    if ($notifyRealtime && !_realtimedNotify() && $signalClient)
     {
         kill('USR1', $signalClient);
     }
@@ -560,7 +773,17 @@ Send command to client.
 
     if ( !$error && ($cmd eq 'realtime') )
     {
-        _realtime($client, $strlen, { name => $name, staip => $staip, stassid => $stassid, version => $version }); # this doesn't return
+        my $info = { name => $name, staip => $staip, stassid => $stassid, version => $version };
+        _metricsFlush();
+        my $sock = _realtimedConnect();
+        if ($sock)
+        {
+            _realtimeProxy($sock, $client, $strlen, $proto, $session, $info); # this doesn't return
+        }
+        else
+        {
+            _realtime($client, $strlen, $proto, $info); # this doesn't return (and can't resume sessions)
+        }
         exit(0);
     }
 
@@ -617,40 +840,65 @@ Send command to client.
               $content
              );
     }
+    elsif (!$error && $binary)
+    {
+        my $content = '';
+        if (open(my $fh, '<', $binary))
+        {
+            binmode($fh);
+            local $/;
+            $content = <$fh>;
+            close($fh);
+        }
+        binmode(STDOUT);
+        print(
+              $q->header( -type => 'application/octet-stream', -expires => 'now',
+                          '-Content-Length' => length($content),
+                        ),
+              $content
+             );
+    }
     elsif (!$error && $data)
     {
         $data->{debug} = \@DEBUGSTRS if ($debug );
         $data->{res} = 0 unless ($data->{res});
-        my $json = JSON::PP->new()->ascii($ascii ? 1 : 0)->utf8($ascii ? 0 : 1)->canonical(1)->pretty($debug ? 1 : 0)->encode($data);
+        my $json = $JSONCLASS->new()->ascii($ascii ? 1 : 0)->utf8($ascii ? 0 : 1)->canonical(1)->pretty($debug ? 1 : 0)->allow_nonref(1);
         if (!$chunked)
         {
+            my $content = '';
+            _jsonStream($json, $data, sub { $content .= $_[0]; });
             print(
                   $q->header( -type => 'application/json', -expires => 'now', charset => ($ascii ? 'US-ASCII' : 'UTF-8'),
                               # avoid "Transfer-Encoding: chunked" by specifying the actual content length
                               # so that the raw output will be exactly and only the json string
                               # (i.e. no https://en.wikipedia.org/wiki/Chunked_transfer_encoding markers)
-                              '-Content-Length' => length($json),
+                              '-Content-Length' => length($content),
                               #'-Access-Control-Allow-Origin' => '*'
                             ),
-                  $json
+                  $content
                  );
         }
         else
         {
             print(
                   $q->header( -type => 'application/json', -expires => 'now', charset => ($ascii ? 'US-ASCII' : 'UTF-8'),
-                              #'-Transfer-Encoding' => 'chunked',
+                              # no content length, so the web server will use "Transfer-Encoding: chunked"
                               #'-Access-Control-Allow-Origin' => '*'
                             )
                  );
-            STDOUT->autoflush(1);
-            for (my $offs = 0; $offs < length($json); $offs += $chunked)
+            # send the output as it's being encoded (flushing the output makes the web server send a chunk)
+            my $chunk = '';
+            _jsonStream($json, $data, sub
             {
-                print(substr($json, $offs, $chunked));
-                #STDOUT->flush();
-                Time::HiRes::usleep(1e3); # FIXME: is this the right way to force the chunk to be sent?
-            }
-
+                $chunk .= $_[0];
+                if (length($chunk) >= $chunked)
+                {
+                    print($chunk);
+                    STDOUT->flush();
+                    $chunk = '';
+                }
+            });
+            print($chunk);
         }
     }
     else
@@ -667,6 +915,11 @@ Send command to client.
     }
 };
 
+END
+{
+    _metricsFlush();
+}
+
 sub DEBUG
 {
     my $debug = $q->param('debug') || 0;
@@ -676,76 +929,282 @@ sub DEBUG
     return 1;
 }
 
+# The database consists of a snapshot ($DBFILE, JSON) and a log of changes since the snapshot
+# ($DBFILE.<gen>.log, one JSON object per line with the collection, the key and the new value of a
+# record, or null if the record was deleted). Writers lock $DBFILE.lock, append the changed records to
+# the log and occasionally write a new snapshot (with the next generation number and a new, empty log),
+# which is renamed into place. Readers don't lock at all: the snapshot is never modified in place and the
+# log is only ever appended to (a trailing incomplete line is a write in progress and is ignored).
 sub _dbOpen
 {
-    # open database
+    my ($readOnly, $db) = @_;
+
+    # writers lock
     my $dbHandle;
-    my $db;
     my $error = '';
-    unless (open($dbHandle, '+>>', $DBFILE))
+    unless ($readOnly)
     {
-        $error = "failed opening database file: $!";
-        return (undef, undef, $error);
+        unless (open($dbHandle, '>>', $DBLOCKFILE))
+        {
+            $error = "failed opening database lock file: $!";
+            return (undef, undef, $error);
+        }
+        my $t0 = time();
+        unless (flock($dbHandle, LOCK_EX))
+        {
+            $error = "failed locking database: $!";
+            return (undef, undef, $error);
+        }
+        _metricsObserve('tschenggins_db_seconds', 'op="lock"', time() - $t0);
     }
-    unless (flock($dbHandle, LOCK_EX))
+
+    # refresh given database or load it
+    my $t0 = time();
+    if ($db)
     {
-        $error = "failed locking database file: $!";
-        return (undef, undef, $error);
+        _dbRefresh($db);
     }
-
-    if (!$error)
+    else
     {
-
-        # read database
-        eval
+        # retry in case a new snapshot was written while we were loading
+        for (my $try = 0; !$db && ($try < 5); $try++)
         {
-            seek($dbHandle, 0, SEEK_SET);
-            local $/;
-            my $dbJson = <$dbHandle>;
-            $db = JSON::PP->new()->utf8()->decode($dbJson);
-        };
+            $db = _dbLoad();
+        }
         unless ($db)
         {
-            $db = { };
+            $error = "failed loading database";
+            close($dbHandle) if ($dbHandle);
+            return (undef, undef, $error);
         }
-        $db->{_dirtiness} =  0  unless (exists $db->{_dirtiness});
-        $db->{jobs}       = { } unless (exists $db->{jobs});
-        $db->{config}     = { } unless (exists $db->{config});
-        $db->{clients}    = { } unless (exists $db->{clients});
-        $db->{cmd}        = { } unless (exists $db->{cmd});
+    }
+    _metricsObserve('tschenggins_db_seconds', 'op="read"', time() - $t0);
+    $db->{_dirtiness} = 0;
+    $db->{_dirty} = {};
+    return ($dbHandle, $db, $error);
+}
+
+sub _dbLogFile
+{
+    my ($gen) = @_;
+    return "$DBFILE.$gen.log";
+}
 
-        # add helper arrays
-        my @jobIds = ();
-        foreach my $jobId (sort
-                         { $db->{jobs}->{$a}->{server} cmp $db->{jobs}->{$b}->{server} or
-                             $db->{jobs}->{$a}->{name}   cmp $db->{jobs}->{$b}->{name}
-                         } keys %{$db->{jobs}})
+# load snapshot and apply the log
+sub _dbLoad
+{
+    my $db;
+    if (open(my $fh, '<', $DBFILE))
+    {
+        eval
         {
-            push(@jobIds, $jobId);
-        }
-        $db->{_jobIds} = \@jobIds;
-        my @clientIds = ();
-        my %clientIdSeen = ();
-        foreach my $clientId (sort keys %{$db->{clients}}, sort keys %{$db->{config}})
+            local $/;
+            my $dbJson = <$fh>;
+            $db = $JSONCLASS->new()->utf8()->decode($dbJson);
+        };
+        close($fh);
+    }
+    $db = { } unless ($db && (ref($db) eq 'HASH'));
+    $db->{gen} = 0 unless ($db->{gen});
+    $db->{$_}  = { } for (grep { !$db->{$_} } keys %{$DBCOLLS});
+    $db->{_logOffset} = 0;
+    $db->{_changed} = { };
+    $db->{_changedAll} = 1;
+
+    # the log must exist (except for the very first snapshot, or a database from before there was a log)
+    my $gen = $db->{gen};
+    if ( !defined _dbReadLog($db) && $gen )
+    {
+        DEBUG("log %s gone", _dbLogFile($gen));
+        return undef;
+    }
+
+    # add missing (empty) client info and config
+    foreach my $clientId (keys %{$db->{clients}}, keys %{$db->{config}})
+    {
+        $db->{clients}->{$clientId} = { } unless ($db->{clients}->{$clientId});
+        $db->{config}->{$clientId}  = { jobs => [] } unless ($db->{config}->{$clientId});
+    }
+
+    # job to clients index (from a database from before there was the index)
+    unless (%{$db->{jobclients}})
+    {
+        foreach my $clientId (keys %{$db->{config}})
         {
-            if (!$clientIdSeen{$clientId})
-            {
-                push(@clientIds, $clientId);
-            }
-            $clientIdSeen{$clientId} = 1;
-            if (!$db->{clients}->{$clientId})
+            my $jobs = $db->{config}->{$clientId}->{jobs} || [];
+            foreach my $jobId (grep { $_ } @{$jobs})
             {
-                $db->{clients}->{$clientId} = {};
+                $db->{jobclients}->{$jobId}->{$clientId} = 1;
+                $db->{_indexDirty} = 1;
             }
-            if (!$db->{config}->{$clientId})
+        }
+    }
+
+    # job to groups index (from a database from before there were groups, or the index had been lost)
+    unless (%{$db->{jobgroups}})
+    {
+        foreach my $groupId (grep { $db->{jobs}->{$_}->{members} } keys %{$db->{jobs}})
+        {
+            foreach my $jobId (@{$db->{jobs}->{$groupId}->{members}})
             {
-                $db->{config}->{$clientId} = { jobs => [] };
+                $db->{jobgroups}->{$jobId}->{$groupId} = 1;
+                $db->{_indexDirty} = 1;
             }
         }
-        $db->{_clientIds} = \@clientIds;
-        #DEBUG("db=%s", Dumper($db));
     }
-    return ($dbHandle, $db, $error);
+
+    #DEBUG("db=%s", Dumper($db));
+    return $db;
+}
+
+# apply new log entries, returns the number of changed records (undef if the log is gone)
+sub _dbReadLog
+{
+    my ($db) = @_;
+    my $logFile = _dbLogFile($db->{gen});
+    my $fh;
+    unless (open($fh, '<', $logFile))
+    {
+        return undef;
+    }
+    my $n = 0;
+    my $json = $JSONCLASS->new()->utf8();
+    seek($fh, $db->{_logOffset}, SEEK_SET);
+    while (my $line = <$fh>)
+    {
+        # incomplete line, write in progress
+        last unless ($line =~ m{\n$});
+        $db->{_logOffset} += length($line);
+        my $rec;
+        eval { $rec = $json->decode($line); };
+        next unless ($rec && $rec->{c} && $DBCOLLS->{$rec->{c}} && defined $rec->{k});
+        if (defined $rec->{v})
+        {
+            $db->{$rec->{c}}->{$rec->{k}} = $rec->{v};
+        }
+        else
+        {
+            delete $db->{$rec->{c}}->{$rec->{k}};
+        }
+        $db->{_changed}->{$rec->{c}}->{$rec->{k}} = 1;
+        $n++;
+    }
+    close($fh);
+    if ($n)
+    {
+        delete $db->{_jobIds};
+        delete $db->{_clientIds};
+    }
+    return $n;
+}
+
+# update database with changes from other processes, returns true if anything changed (the changed
+# records are collected in $db->{_changed}->{<collection>}->{<key>}, $db->{_changedAll} is set if the
+# whole database was reloaded, see _dbChanges())
+sub _dbRefresh
+{
+    my ($db) = @_;
+    my $logSize = -s _dbLogFile($db->{gen});
+    if ( defined $logSize && ($logSize == $db->{_logOffset}) )
+    {
+        return 0;
+    }
+    my $n = _dbReadLog($db);
+    if (defined $n)
+    {
+        return $n;
+    }
+    # the log was compacted into a new snapshot, reload
+    my $new;
+    for (my $try = 0; !$new && ($try < 5); $try++)
+    {
+        $new = _dbLoad();
+    }
+    return 0 unless ($new);
+    %{$db} = %{$new};
+    return 1;
+}
+
+# returns and clears the changes collected by _dbRefresh(): the changed records by collection and key,
+# and a flag if everything may have changed
+sub _dbChanges
+{
+    my ($db) = @_;
+    my $changed = $db->{_changed} || { };
+    my $all = $db->{_changedAll} ? 1 : 0;
+    $db->{_changed} = { };
+    $db->{_changedAll} = 0;
+    return ($changed, $all);
+}
+
+# mark a record as modified (or deleted, if it no longer exists)
+sub _dbDirty
+{
+    my ($db, $coll, $key) = @_;
+    $db->{_dirty}->{$coll}->{$key} = 1;
+    $db->{_dirtiness}++;
+    if ( ($coll eq 'jobs') || ($coll eq 'clients') || ($coll eq 'config') )
+    {
+        delete $db->{_jobIds};
+        delete $db->{_clientIds};
+    }
+}
+
+# set client jobs (or remove client from index if $jobs is undef), maintains the job to clients index
+sub _dbSetClientJobs
+{
+    my ($db, $client, $jobs) = @_;
+    my %old = map { $_, 1 } grep { $_ } @{ $db->{config}->{$client} ? $db->{config}->{$client}->{jobs} || [] : [] };
+    my %new = map { $_, 1 } grep { $_ } @{ $jobs || [] };
+    foreach my $jobId (grep { !$new{$_} } keys %old)
+    {
+        delete $db->{jobclients}->{$jobId}->{$client};
+        delete $db->{jobclients}->{$jobId} unless (%{$db->{jobclients}->{$jobId}});
+        _dbDirty($db, 'jobclients', $jobId);
+    }
+    foreach my $jobId (grep { !$old{$_} } keys %new)
+    {
+        $db->{jobclients}->{$jobId}->{$client} = 1;
+        _dbDirty($db, 'jobclients', $jobId);
+    }
+    if ($jobs)
+    {
+        $db->{config}->{$client}->{jobs} = $jobs;
+        _dbDirty($db, 'config', $client);
+    }
+}
+
+# job IDs sorted by server and name
+sub _dbJobIds
+{
+    my ($db) = @_;
+    unless ($db->{_jobIds})
+    {
+        my $jobs = $db->{jobs};
+        $db->{_jobIds} = [ sort { $jobs->{$a}->{server} cmp $jobs->{$b}->{server} or
+                                    $jobs->{$a}->{name}   cmp $jobs->{$b}->{name} } keys %{$jobs} ];
+    }
+    return @{$db->{_jobIds}};
+}
+
+# client IDs sorted
+sub _dbClientIds
+{
+    my ($db) = @_;
+    unless ($db->{_clientIds})
+    {
+        $db->{_clientIds} = [ sort keys %{$db->{clients}} ];
+    }
+    return @{$db->{_clientIds}};
+}
+
+# the persistent part of the database
+sub _dbData
+{
+    my ($db) = @_;
+    my %data = map { $_, $db->{$_} } keys %{$DBCOLLS};
+    $data{gen} = $db->{gen};
+    return \%data;
 }
 
 sub _dbClose
@@ -756,16 +1215,68 @@ sub _dbClose
     {
         return;
     }
+
+    # records from an old database without the job to clients index
+    if ($update && $db->{_indexDirty})
+    {
+        foreach my $coll (qw(jobclients jobgroups))
+        {
+            _dbDirty($db, $coll, $_) for (keys %{$db->{$coll}});
+        }
+        delete $db->{_indexDirty};
+    }
+
     if ($update && $db->{_dirtiness})
     {
         DEBUG("updating db, dirtiness $db->{_dirtiness}");
-        delete $db->{_dirtiness};
-        delete $db->{_clientIds};
-        delete $db->{_jobIds};
-        my $dbJson = JSON::PP->new()->utf8(1)->canonical(1)->pretty($debug ? 1 : 0)->encode($db);
-        truncate($dbHandle, 0);
-        seek($dbHandle, 0, SEEK_SET);
-        print($dbHandle $dbJson);
+        my $t0 = time();
+
+        # time for a new snapshot?
+        if ($db->{_logOffset} > $DBLOGMAX)
+        {
+            my $gen = $db->{gen} + 1;
+            my $tmpFile = "$DBFILE.tmp";
+            my $dbJson = $JSONCLASS->new()->utf8(1)->canonical(1)->pretty($debug ? 1 : 0)->encode({ %{_dbData($db)}, gen => $gen });
+            if ( open(my $fh, '>', $tmpFile) && open(my $logFh, '>', _dbLogFile($gen)) )
+            {
+                print($fh $dbJson);
+                close($fh);
+                close($logFh);
+                if (rename($tmpFile, $DBFILE))
+                {
+                    DEBUG("new snapshot, gen $gen");
+                    _metricsObserve('tschenggins_db_seconds', 'op="snapshot"', time() - $t0);
+                    unlink(_dbLogFile($db->{gen}));
+                    $db->{gen} = $gen;
+                    $db->{_logOffset} = 0;
+                    $db->{_dirty} = {};
+                }
+            }
+        }
+
+        # append changed records to the log, in one write
+        my $json = $JSONCLASS->new()->utf8(1)->canonical(1);
+        my $log = '';
+        foreach my $coll (sort keys %{$db->{_dirty}})
+        {
+            foreach my $key (sort keys %{$db->{_dirty}->{$coll}})
+            {
+                $log .= $json->encode({ c => $coll, k => $key, v => $db->{$coll}->{$key} }) . "\n";
+            }
+        }
+        if ($log)
+        {
+            if (open(my $fh, '>>', _dbLogFile($db->{gen})))
+            {
+                binmode($fh);
+                syswrite($fh, $log);
+                close($fh);
+                $db->{_logOffset} += length($log);
+            }
+            _metricsObserve('tschenggins_db_seconds', 'op="write"', time() - $t0);
+        }
+        $db->{_dirtiness} = 0;
+        $db->{_dirty} = {};
     }
     close($dbHandle);
 }
@@ -786,6 +1297,7 @@ sub _update
 
     my $ok = 1;
     my $error = '';
+    my @ids = ();
     foreach my $st (@states)
     {
         my $jobName  = $st->{name}   || '';
@@ -826,8 +1338,14 @@ sub _update
         $db->{jobs}->{$id}->{result} //= 'unknown';
         $db->{jobs}->{$id}->{state}  = $jState       if ($jState);
         $db->{jobs}->{$id}->{result} = $jResult      if ($jResult);
-        $db->{_dirtiness}++;
+        $db->{jobs}->{$id}->{ver}    = ($db->{jobs}->{$id}->{ver} || 0) + 1;
+        _dbDirty($db, 'jobs', $id);
+        push(@ids, $id);
     }
+
+    # the groups of the changed jobs, once for all of them
+    _groupUpdate($db, _groupsOf($db, @ids));
+
     return $ok, $error;
 }
 
@@ -840,17 +1358,20 @@ sub _list
     my ($db, $offset, $limit) = @_;
     DEBUG("_list() %i %i", $offset, $limit);
 
-    $limit = $#{$db->{_jobIds}} + 1 - $offset if (!$limit || ($limit + $offset > $#{$db->{_jobIds}}));
+    _dbJobIds($db);
+    my $jobIds = $db->{_jobIds};
+    ($offset, $limit) = _page($#{$jobIds} + 1, $offset, $limit);
 
-    my @list = ();
-    for (my $ix = $offset; $ix < $offset + $limit; $ix++)
+    # the list entries are generated while the output is encoded
+    my $ix = $offset;
+    my $list = _jsonStreamArray(sub
     {
-        my $id = $db->{_jobIds}->[$ix];
-        my $str = "$db->{jobs}->{$id}->{server}: $db->{jobs}->{$id}->{name}";
-        push(@list, [ $id, $str ]);
-    }
+        return () if ($ix >= ($offset + $limit));
+        my $id = $jobIds->[$ix++];
+        return [ $id, "$db->{jobs}->{$id}->{server}: $db->{jobs}->{$id}->{name}" ];
+    });
 
-    return { res => 1, offset => $offset, limit => $limit, num => ($#list + 1), list => \@list };
+    return { res => 1, offset => $offset, limit => $limit, num => $limit, list => $list };
 }
 
 sub _get
@@ -877,94 +1398,172 @@ sub _get
 
 sub _jobs
 {
-    my ($db, $client, $strlen, $info) = @_;
+    my ($db, $client, $strlen, $offset, $limit, $info) = @_;
 
-    DEBUG("_jobs() $client $strlen");
+    DEBUG("_jobs() $client $strlen $offset $limit");
 
     if ( !$client )
     {
         return undef, 'missing parameters';
     }
-    my $data = { jobs => [], res => 1 };
     my $now = time();
 
     if (!$db->{config}->{$client}->{jobs})
     {
         $db->{config}->{$client}->{jobs} = [];
+        _dbDirty($db, 'config', $client);
     }
 
-    foreach my $jobId (@{$db->{config}->{$client}->{jobs}})
+    my $jobIds = $db->{config}->{$client}->{jobs};
+    ($offset, $limit) = _page($#{$jobIds} + 1, $offset, $limit);
+    my $ix = $offset;
+    my $jobs = _jsonStreamArray(sub
     {
-        my $st = $db->{jobs}->{$jobId};
-        if ($st)
-        {
-            my $state  = $st->{state};
-            my $result = $st->{result};
-            my $name   = $st->{name};
-            my $server = $st->{server};
-            my $ts     = $st->{ts};
-            push(@{$data->{jobs}},
-                 [ substr($name, 0, $strlen), substr($server, 0, $strlen), $state, $result, int($ts) ]);
-        }
-        else
-        {
-            push(@{$data->{jobs}}, []);
-        }
-    }
+        return $ix < ($offset + $limit) ? _jobTuple($db, $jobIds->[$ix++], $strlen) : ();
+    });
+    my $data = { jobs => $jobs, offset => $offset, limit => $limit, res => 1 };
 
     $db->{clients}->{$client}->{ts} = int($now + 0.5);
     $db->{clients}->{$client}->{$_} = $info->{$_} for (keys %{$info});
 
-    $db->{_dirtiness}++;
+    _dbDirty($db, 'clients', $client);
 
     return $data, '';
 }
 
-# to test:
-# curl --raw -s -v -i "http://..../tschenggins-status.pl?cmd=realtime;client=...;debug=1"
-sub _realtime
+# store client telemetry record (heap, ISR rate, tasks CPU and stack, RSSI, traffic counters), keeps the
+# last few records per client
+sub _telemetry
 {
-    my ($client, $strlen, $info) = @_;
-    print($q->header(-type => 'text/plain', -expires => 'now', charset => 'US-ASCII'));
-    my $n = 0;
-    my $nHeartbeat = 0;
-    my $lastTs = 0;
-    my @lastStatus = ();
-    my $lastConfig = 'not a possible config string';
-    my $lastCheck = 0;
-    my $startTs = time();
-    my $debugServer = 0;
-    my $doCheck = 0;
-    $SIG{USR1} = sub { $doCheck = 1; };
-
-    $0 = $info->{name} || "client$client";
-    STDOUT->autoflush(1);
-    print("hello $client $strlen $info->{name}\r\n");
-    while (1)
+    my ($db, $client, $str) = @_;
+    return unless ($client && $str);
+    my $tel;
+    eval { $tel = $JSONCLASS->new()->decode($str); };
+    unless ($tel && (ref($tel) eq 'HASH'))
     {
-        sleep(1);
-        my $now = time();
-        my $nowInt = int($now + 0.5);
-        if ( ($n % 5) == 0 )
-        {
-            $nHeartbeat++;
-            printf("\r\nheartbeat $nowInt $nHeartbeat\r\n");
-        }
-        $n++;
-
-        # don't run forever
-        if ( ($now - $startTs) > (4 * 3600) )
-        {
-            exit(0);
+        DEBUG("_telemetry() $client fishy record");
+        return;
+    }
+    my $rec = { ts => int(time() + 0.5) };
+    foreach my $key (qw(up heap minheap isr isrload rssi rx lines conns))
+    {
+        $rec->{$key} = int($tel->{$key}) if (defined $tel->{$key} && ($tel->{$key} =~ m{^-?\d+$}));
+    }
+    if (ref($tel->{tasks}) eq 'ARRAY')
+    {
+        $rec->{tasks} = [ map { [ substr($_->[0] || '', 0, 16), int($_->[1] || 0), int($_->[2] || 0) ] }
+                          grep { ref($_) eq 'ARRAY' } @{$tel->{tasks}}[0 .. ($#{$tel->{tasks}} < 15 ? $#{$tel->{tasks}} : 15)] ];
+    }
+    if (ref($tel->{isrs}) eq 'ARRAY')
+    {
+        $rec->{isrs} = [ map { [ substr($_->[0] || '', 0, 16), int($_->[1] || 0), int($_->[2] || 0), int($_->[3] || 0) ] }
+                         grep { ref($_) eq 'ARRAY' } @{$tel->{isrs}}[0 .. ($#{$tel->{isrs}} < 15 ? $#{$tel->{isrs}} : 15)] ];
+    }
+    my $hist = $db->{telemetry}->{$client} || [];
+    push(@{$hist}, $rec);
+    splice(@{$hist}, 0, $#{$hist} + 1 - $TELEMETRYHIST) if ($#{$hist} >= $TELEMETRYHIST);
+    $db->{telemetry}->{$client} = $hist;
+    _dbDirty($db, 'telemetry', $client);
+}
+
+# firmware image file, size, SHA-256 (hex) and signature (hex), or () if there is no such (signed) image
+sub _firmwareInfo
+{
+    my ($image) = @_;
+    return () unless ($image && ($image =~ $FWIMAGERE));
+    my $file = "$FWDIR/$image.bin";
+    return () unless (-f $file);
+    my $sig = '';
+    if (open(my $fh, '<', "$FWDIR/$image.sig"))
+    {
+        binmode($fh);
+        local $/;
+        $sig = unpack('H*', <$fh> // '');
+        close($fh);
+    }
+    return () unless ($sig);
+    my $sha = Digest::SHA->new(256);
+    $sha->addfile($file, 'b');
+    return $file, -s $file, $sha->hexdigest(), $sig;
+}
+
+# available firmware images (names)
+sub _firmwareImages
+{
+    return sort grep { $_ =~ $FWIMAGERE } map { m{([^/]+)\.bin$} ? $1 : () } glob("$FWDIR/*.bin");
+}
+
+# clamp offset and limit (0 = everything) for a list of the given size
+sub _page
+{
+    my ($size, $offset, $limit) = @_;
+    $offset = $size if ($offset > $size);
+    $limit = $size - $offset if (!$limit || (($offset + $limit) > $size));
+    return $offset, $limit;
+}
+
+# job info for clients: [ name, server, state, result, timestamp ], or [] for unknown jobs
+sub _jobTuple
+{
+    my ($db, $jobId, $strlen) = @_;
+    my $st = $jobId ? $db->{jobs}->{$jobId} : undef;
+    if ($st)
+    {
+        return [ substr($st->{name}, 0, $strlen), substr($st->{server}, 0, $strlen), $st->{state}, $st->{result}, int($st->{ts}) ];
+    }
+    else
+    {
+        return [];
+    }
+}
+
+# to test:
+# curl --raw -s -v -i "http://..../tschenggins-status.pl?cmd=realtime;client=...;debug=1"
+#
+# protocol version 2 adds "bstatus" updates for channels whose job and server names have already
+# been sent (in a "status" line) on this connection: base64 encoded records of
+# pack('CCN', channel, (state << 4) | result, timestamp), see $BINSTATE and $BINRESULT
+sub _realtime
+{
+    my ($client, $strlen, $proto, $info) = @_;
+    print($q->header(-type => 'text/plain', -expires => 'now', charset => 'US-ASCII'));
+    my $n = 0;
+    my $nHeartbeat = 0;
+    my $db = undef;
+    my $rtState = _realtimeResume(undef, $client, $strlen, $proto, '');
+    my $lastCheck = 0;
+    my $startTs = time();
+    my $debugServer = 0;
+    my $doCheck = 0;
+    $SIG{USR1} = sub { $doCheck = 1; };
+
+    $0 = $info->{name} || "client$client";
+    STDOUT->autoflush(1);
+    print("hello $client $strlen $info->{name}\r\n");
+    while (1)
+    {
+        sleep(1);
+        my $now = time();
+        my $nowInt = int($now + 0.5);
+        if ( ($n % 5) == 0 )
+        {
+            $nHeartbeat++;
+            printf("\r\nheartbeat %s\r\n", _heartbeatArgs($nHeartbeat));
+        }
+        $n++;
+
+        # don't run forever
+        if ( ($now - $startTs) > (4 * 3600) )
+        {
+            print("\r\nreconnect $nowInt\r\n");
+            exit(0);
         }
 
         # check database...
         # ...if it has changed
-        my $ts = -f $DBFILE ? (stat($DBFILE))[9] : 0;
-        if ($ts != $lastTs)
+        if (!$db || _dbRefresh($db))
         {
             $doCheck = 1;
-            $lastTs = $ts;
         }
         # ...and every once in a while
         elsif (($now - $lastCheck) > 10)
@@ -979,15 +1578,16 @@ sub _realtime
             printf(STDERR "doCheck\n") if ($debugServer);
             my $sendCmd = '';
 
-            # load database
-            my ($dbHandle, $db, $error) = _dbOpen();;
+            # load (or refresh) database
+            (my $dbHandle, $db, my $error) = _dbOpen(0, $db);
+            next unless ($db);
 
             # command pending?
             if ($db->{cmd}->{$client})
             {
                 $sendCmd = $db->{cmd}->{$client};
                 $db->{cmd}->{$client} = '';
-                $db->{_dirtiness}++;
+                _dbDirty($db, 'cmd', $client);
             }
 
             # assume that while we're running the connection is still up
@@ -995,7 +1595,7 @@ sub _realtime
                 (!$db->{clients}->{$client}->{check} || (($nowInt - $db->{clients}->{$client}->{check}) > 10)))
             {
                 $db->{clients}->{$client}->{check} = $nowInt;
-                $db->{_dirtiness}++;
+                _dbDirty($db, 'clients', $client);
             }
 
             # close database
@@ -1018,56 +1618,783 @@ sub _realtime
                 print("\r\ncommand $nowInt $sendCmd\r\n");
             }
 
-            # check if we're interested in any changes
-            if ($db && $db->{config} && $db->{config}->{$client})
+            # send changes
+            _dbChanges($db);
+            my $out = join('', _realtimeCheck($db, $rtState, $nowInt));
+            print($out);
+            _metricsCount('tschenggins_realtime_bytes_total', '', length($out));
+            _metricsFlush();
+        }
+
+        # FIXME: if we just could read some data from the client here to determine if it is still alive..
+        # reading from STDIN doesn't show any data... :-(
+    }
+}
+
+# state of a realtime connection (what the client already knows)
+sub _realtimeState
+{
+    my ($client, $strlen, $proto) = @_;
+    return { client => $client, strlen => $strlen, proto => $proto, lastStatus => [], lastNames => [],
+             lastVer => [], lastConfig => 'not a possible config string' };
+}
+
+# realtime state for a connection, continuing the given session if we know it ("<id>:<seq>", sessions
+# are for protocol version 3 and later), or starting a new session. The session keeps a copy of the
+# realtime state, i.e. the job versions and what was sent per channel, for the last few updates, so a
+# client that reconnects gets only the changes since the last update it has applied.
+sub _realtimeResume
+{
+    my ($sessions, $client, $strlen, $proto, $resume) = @_;
+    my $rtState = _realtimeState($client, $strlen, $proto);
+    return $rtState if ($proto < 3);
+    my ($id, $seq) = ($resume || '') =~ m{^([0-9a-f]+):(\d+)$} ? ($1, $2) : ('', -1);
+    my $session = $sessions ? $sessions->{$client} : undef;
+    my $snap = $session && ($session->{id} eq $id) && ($session->{strlen} == $strlen) ? $session->{snaps}->{$seq} : undef;
+    if ($snap)
+    {
+        $rtState->{$_} = ref($snap->{$_}) ? [ @{$snap->{$_}} ] : $snap->{$_} for (keys %{$snap});
+        # the later states are from updates that the client didn't get (or didn't apply)
+        delete $session->{snaps}->{$_} for (grep { $_ > $seq } keys %{$session->{snaps}});
+        $session->{seq} = $seq;
+    }
+    else
+    {
+        $session = { id => sprintf('%08x', int(rand(0xffffffff))), seq => 0, strlen => $strlen, snaps => {} };
+        $sessions->{$client} = $session if ($sessions);
+    }
+    $session->{ts} = time();
+    $rtState->{session} = $session;
+    return $rtState;
+}
+
+# returns the heartbeat arguments: the (rounded) time, the heartbeat counter and the sub-second part of the
+# time [ms], which the devices use to synchronise their animations
+sub _heartbeatArgs
+{
+    my ($nHeartbeat) = @_;
+    my $now = time();
+    my $nowInt = int($now + 0.5);
+    return sprintf('%d %d %d', $nowInt, $nHeartbeat, int(($now - $nowInt) * 1000));
+}
+
+# returns the local time offset from UTC [min]
+sub _tzOffs
+{
+    my ($ts) = @_;
+    my @lt = localtime($ts);
+    my @gt = gmtime($ts);
+    my $days = ($lt[5] <=> $gt[5]) || ($lt[7] <=> $gt[7]);
+    return ($days * 24 * 60) + (($lt[2] - $gt[2]) * 60) + ($lt[1] - $gt[1]);
+}
+
+# returns the realtime protocol lines for the changes since the last call (config, status, bstatus),
+# either for all channels (and the config), or for the given channels only
+sub _realtimeCheck
+{
+    my ($db, $rtState, $nowInt, @chIxs) = @_;
+    my $client = $rtState->{client};
+    my @lines = ();
+
+    # check if we're interested in any changes
+    if ( $db && $db->{config} && $db->{config}->{$client} && ($#chIxs < 0) )
+    {
+        my @cfgKeys = grep { $_ ne 'jobs' } sort keys %{$db->{config}->{$client}};
+        my %data = map { $_, $db->{config}->{$client}->{$_} } @cfgKeys;
+        # the device has no idea of time zones, so tell it our offset for the quiet hours (this changes with DST)
+        $data{tzoffs} = _tzOffs($nowInt) if ($data{quiet});
+        my $config = join(' ', map { "$_=$data{$_}" } sort keys %data);
+        if ($config ne $rtState->{lastConfig})
+        {
+            my $json = $JSONCLASS->new()->ascii(1)->canonical(1)->pretty(0)->encode(\%data);
+            push(@lines, "\r\nconfig $nowInt $json\r\n");
+            $rtState->{lastConfig} = $config;
+        }
+    }
+    if ($db && $db->{clients} && $db->{clients}->{$client})
+    {
+        # we send only changed jobs info
+        my @changedJobs = ();
+        my $binStatus = '';
+        my $lastStatus = $rtState->{lastStatus};
+        my $lastNames = $rtState->{lastNames};
+        my $lastVer = $rtState->{lastVer};
+        my $jobIds = $db->{config}->{$client} ? $db->{config}->{$client}->{jobs} || [] : [];
+        if ($#chIxs < 0)
+        {
+            # with sessions the client keeps its channels, so also tell it about unused ones
+            my $nCh = $#{$jobIds} + 1;
+            my $maxCh = $db->{clients}->{$client}->{maxch} || 0;
+            $nCh = $maxCh if ( $rtState->{session} && ($maxCh =~ m{^\d+$}) && ($maxCh > $nCh) );
+            @chIxs = (0 .. ($nCh - 1));
+        }
+        foreach my $ix (sort { $a <=> $b } @chIxs)
+        {
+            # same version of the same job as last time?
+            my $jobId = $jobIds->[$ix];
+            my $ver = $jobId && $db->{jobs}->{$jobId} && $db->{jobs}->{$jobId}->{ver} ? "$jobId $db->{jobs}->{$jobId}->{ver}" : undef;
+            next if ( defined $ver && defined $lastVer->[$ix] && ($lastVer->[$ix] eq $ver) );
+            $lastVer->[$ix] = $ver;
+
+            # add index to results, find jobs that have changed
+            my $tuple = _jobTuple($db, $jobId, $rtState->{strlen});
+            my @job = (int($ix), @{$tuple});
+            my $status = join(' ', map { $_ } @job); # join copy of array to avoid stringification of integers
+            if (!defined $lastStatus->[$ix] || ($lastStatus->[$ix] ne $status))
             {
-                my @cfgKeys = grep { $_ ne 'jobs' } sort keys %{$db->{config}->{$client}};
-                my $config = join(' ', map { "$_=$db->{config}->{$client}->{$_}" } @cfgKeys);
-                if ($config ne $lastConfig)
+                $lastStatus->[$ix] = $status;
+                my $names = $#{$tuple} > -1 ? "$job[1] $job[2]" : '';
+                # client already knows job and server, send binary update
+                if ( ($rtState->{proto} >= 2) && $names && defined $lastNames->[$ix] && ($lastNames->[$ix] eq $names) )
                 {
-                    my %data = map { $_, $db->{config}->{$client}->{$_} } @cfgKeys;
-                    my $json = JSON::PP->new()->ascii(1)->canonical(1)->pretty(0)->encode(\%data);
-                    print("\r\nconfig $nowInt $json\r\n");
-                    $lastConfig = $config;
+                    $binStatus .= pack('CCN', $ix,
+                        (($BINSTATE->{$job[3]} || 0) << 4) | ($BINRESULT->{$job[4]} || 0), $job[5]);
                 }
+                else
+                {
+                    push(@changedJobs, \@job);
+                }
+                $lastNames->[$ix] = $names;
             }
-            if ($db && $db->{clients} && $db->{clients}->{$client})
+        }
+        # send list of changed jobs
+        if ($#changedJobs > -1)
+        {
+            my $json = $JSONCLASS->new()->ascii(1)->canonical(1)->pretty(0)->encode(\@changedJobs);
+            push(@lines, "\r\nstatus $nowInt $json\r\n");
+        }
+        if ($binStatus)
+        {
+            push(@lines, "\r\nbstatus $nowInt " . encode_base64($binStatus, '') . "\r\n");
+        }
+    }
+
+    # remember what the client knows after these updates, tell it the session
+    my $session = $rtState->{session};
+    if ( $session && ($#lines > -1) )
+    {
+        my $seq = ++$session->{seq};
+        $session->{snaps}->{$seq} = { lastConfig => $rtState->{lastConfig}, map { $_ => [ @{$rtState->{$_}} ] } qw(lastStatus lastNames lastVer) };
+        delete $session->{snaps}->{$_} for (grep { $_ <= ($seq - $RTSESSIONSNAPS) } keys %{$session->{snaps}});
+        push(@lines, "\r\nsession $nowInt $session->{id} $seq\r\n");
+    }
+    return @lines;
+}
+
+# subscription index for realtime change fan-out: { jobs => { job ID => { connection key => [ channel indices ] } },
+# keys => { connection key => [ job IDs ] } }
+sub _realtimeIndexSet
+{
+    my ($index, $key, $jobIds) = @_;
+    _realtimeIndexRemove($index, $key);
+    for (my $ix = 0; $ix <= $#{$jobIds}; $ix++)
+    {
+        my $jobId = $jobIds->[$ix];
+        push(@{$index->{jobs}->{$jobId}->{$key}}, $ix) if ($jobId);
+    }
+    $index->{keys}->{$key} = [ grep { $_ } @{$jobIds} ];
+}
+
+sub _realtimeIndexRemove
+{
+    my ($index, $key) = @_;
+    foreach my $jobId (@{ $index->{keys}->{$key} || [] })
+    {
+        next unless ($index->{jobs}->{$jobId});
+        delete $index->{jobs}->{$jobId}->{$key};
+        delete $index->{jobs}->{$jobId} unless (%{$index->{jobs}->{$jobId}});
+    }
+    delete $index->{keys}->{$key};
+}
+
+# returns the channels (connection key -> channel indices) affected by changes to the given jobs
+sub _realtimeIndexLookup
+{
+    my ($index, @jobIds) = @_;
+    my %chIxs = ();
+    foreach my $jobId (grep { $index->{jobs}->{$_} } @jobIds)
+    {
+        push(@{$chIxs{$_}}, @{$index->{jobs}->{$jobId}->{$_}}) for (keys %{$index->{jobs}->{$jobId}});
+    }
+    return \%chIxs;
+}
+
+####################################################################################################
+# MQTT
+
+# publish changes to the MQTT broker ($MQTTURL, for firmware built with "make ... MQTT=1", see the
+# firmware's mqtt.h), $dirty are the changed job, config and cmd keys: the job states go to
+# "<prefix>/job/<server>/<job>" (with the names truncated like in the firmware), the realtime lines
+# (config and status, like for a new connection) to "<prefix>/client/<client>", the commands to
+# "<prefix>/client/<client>/command", and the time to "<prefix>/heartbeat"
+sub _mqttPublish
+{
+    my ($db, $dirty) = @_;
+    my ($user, $pass, $host, $prefix) = $MQTTURL =~ m{^mqtt://(?:([^:@/]+):([^@/]*)@)?([^/]+)/(.+)$};
+    if (!$host)
+    {
+        DEBUG("fishy MQTT URL");
+        return;
+    }
+    my $mqtt;
+    eval
+    {
+        local $SIG{__DIE__} = 'IGNORE';
+        # the firmware doesn't do TLS either
+        local $ENV{MQTT_SIMPLE_ALLOW_INSECURE_LOGIN} = 1;
+        require Net::MQTT::Simple;
+        my $m = Net::MQTT::Simple->new($host =~ m{:\d+$} ? $host : "$host:1883");
+        $m->login($user, $pass) if ($user);
+        $mqtt = $m;
+    };
+    if (!$mqtt)
+    {
+        DEBUG("MQTT $host failed: %s", $@ || 'unknown error');
+        return;
+    }
+    my $nowInt = int(time() + 0.5);
+
+    # job states, and the clients that have the jobs
+    my %clients = map { $_, 1 } @{$dirty->{config}};
+    foreach my $jobId (@{$dirty->{jobs}})
+    {
+        my $st = $db->{jobs}->{$jobId};
+        next unless ($st);
+        my $topic = sprintf('%s/job/%s/%s', $prefix, substr($st->{server}, 0, 31), substr($st->{name}, 0, 47));
+        $mqtt->retain($topic, "$st->{state} $st->{result} " . int($st->{ts}));
+        $clients{$_} = 1 for (keys %{$db->{jobclients}->{$jobId} || {}});
+    }
+
+    # realtime lines for the clients, the empty message clears the retained message of a removed client
+    foreach my $client (sort keys %clients)
+    {
+        my $lines = '';
+        if ($db->{config}->{$client} && $db->{clients}->{$client})
+        {
+            my $rtState = _realtimeState($client, 256, 1);
+            my @lines = _realtimeCheck($db, $rtState, $nowInt);
+            # the client keeps its channels, so also tell it about unused ones
+            my $nCh = $#{$db->{config}->{$client}->{jobs} || []} + 1;
+            my $maxCh = $db->{clients}->{$client}->{maxch} || 0;
+            push(@lines, _realtimeCheck($db, $rtState, $nowInt, $nCh .. ($maxCh - 1))) if ( ($maxCh =~ m{^\d+$}) && ($maxCh > $nCh) );
+            $lines = join('', @lines);
+        }
+        $mqtt->retain("$prefix/client/$client", $lines);
+    }
+
+    # commands (not retained, only for clients that are connected now)
+    foreach my $client (@{$dirty->{cmd}})
+    {
+        my $cmd = $db->{cmd}->{$client};
+        $mqtt->publish("$prefix/client/$client/command", "\r\ncommand $nowInt $cmd\r\n") if ($cmd);
+    }
+
+    $mqtt->retain("$prefix/heartbeat", "heartbeat $nowInt 0");
+    $mqtt->disconnect();
+    DEBUG("MQTT published %i jobs, %i clients", $#{$dirty->{jobs}} + 1, scalar keys %clients);
+}
+
+####################################################################################################
+# realtime daemon
+
+# connect to the realtime daemon, returns the socket (or undef if it's not running)
+sub _realtimedConnect
+{
+    return -S $SOCKFILE ? IO::Socket::UNIX->new(Type => SOCK_STREAM(), Peer => $SOCKFILE) : undef;
+}
+
+# tell the realtime daemon that the database has changed, returns true if it was reached
+sub _realtimedNotify
+{
+    my $sock = _realtimedConnect();
+    if ($sock)
+    {
+        print($sock "notify\n");
+        close($sock);
+        return 1;
+    }
+    return 0;
+}
+
+# cmd=realtime via the daemon, we just copy its output to the client
+sub _realtimeProxy
+{
+    my ($sock, $client, $strlen, $proto, $session, $info) = @_;
+    print($q->header(-type => 'text/plain', -expires => 'now', charset => 'US-ASCII'));
+    $0 = $info->{name} || "client$client";
+    $SIG{PIPE} = 'IGNORE';
+    STDOUT->autoflush(1);
+    print("hello $client $strlen $info->{name}\r\n");
+    $sock->autoflush(1);
+    print($sock "realtime $client $strlen $proto" . ($session =~ m{^[0-9a-f]+:\d+$} ? " $session" : '') . "\n");
+    while (1)
+    {
+        # this blocks until the daemon has something for us (heartbeats are sent every 5 seconds)
+        my $n = sysread($sock, my $buf, 4096);
+        last unless ($n);
+        # stop once the client has gone
+        last unless (print($buf));
+    }
+    close($sock);
+    exit(0);
+}
+
+# the realtime daemon (cmd=realtimed)
+sub _realtimed
+{
+    my ($debug) = @_;
+
+    unlink($SOCKFILE);
+    my $listen = IO::Socket::UNIX->new(Type => SOCK_STREAM(), Local => $SOCKFILE, Listen => SOMAXCONN());
+    unless ($listen)
+    {
+        die("failed creating $SOCKFILE: $!\n");
+    }
+    $listen->blocking(0);
+    $0 = 'tschenggins-realtimed';
+    $SIG{PIPE} = 'IGNORE';
+    my $doSync = 1;
+    my $doStop = 0;
+    $SIG{INT} = $SIG{TERM} = sub { $doStop = 1; };
+    $SIG{USR1} = sub { $doSync = 1; };
+    printf(STDERR "realtimed: listening on %s\n", $SOCKFILE) if ($debug);
+
+    my %conns = ();   # connections by fileno
+    my %subs = ();    # subscription index (by fileno, see _realtimeIndexSet())
+    my %sessions = (); # realtime sessions (by client, see _realtimeResume())
+    my $db = undef;   # our copy of the database
+    my $lastSync = 0;
+    while (1)
+    {
+        # wait for data, connections, or so
+        my $rSel = IO::Select->new($listen, map { $_->{sock} } values %conns);
+        my $wSel = IO::Select->new(map { $_->{sock} } grep { $_->{out} ne '' } values %conns);
+        my ($rReady, $wReady) = IO::Select->select($rSel, $wSel, undef, 1.0);
+        my $now = time();
+        my $nowInt = int($now + 0.5);
+
+        # stop, and tell the clients to come back later (but not all at the same time)
+        if ($doStop)
+        {
+            printf(STDERR "realtimed: stopping\n") if ($debug);
+            unlink($SOCKFILE);
+            foreach my $conn (grep { $_->{rt} } values %conns)
             {
-                # same as cmd=jobs to get the data but we won't store the database (this updates $db->{clients}->{$client})
-                my ($data, $error) = _jobs($db, $client, $strlen, $info);
-                if ($error)
+                my $hint = 1 + int(rand($RTRESTARTSPREAD));
+                $conn->{sock}->blocking(1);
+                syswrite($conn->{sock}, "$conn->{out}\r\nreconnect $nowInt $hint\r\n");
+            }
+            exit(0);
+        }
+
+        # new connections, and requests from them
+        foreach my $sock (@{$rReady || []})
+        {
+            if ($sock == $listen)
+            {
+                while (my $new = $listen->accept())
                 {
-                    print("\r\nerror $nowInt $error\r\n");
+                    $new->blocking(0);
+                    $conns{fileno($new)} = { sock => $new, in => '', out => '', rt => undef, close => 0,
+                                             startTs => $now, heartbeatTs => 0, nHeartbeat => 0 };
                 }
-                elsif ($data)
+                next;
+            }
+            my $conn = $conns{fileno($sock)};
+            next unless ($conn);
+            my $n = sysread($sock, my $buf, 1024);
+            if (!defined $n && $!{EAGAIN})
+            {
+                next;
+            }
+            if (!$n)
+            {
+                printf(STDERR "realtimed: %s gone\n", $conn->{rt} ? $conn->{rt}->{client} : 'connection') if ($debug);
+                _realtimeIndexRemove(\%subs, fileno($sock));
+                delete $conns{fileno($sock)};
+                close($sock);
+                next;
+            }
+            $conn->{in} .= $buf;
+            while ($conn->{in} =~ s{^(.*?)\r?\n}{})
+            {
+                my ($req, @args) = split(/\s+/, $1);
+                $req //= '';
+                # from a command that changed the database
+                if ($req eq 'notify')
                 {
-                    # we send only changed jobs info
-                    my @changedJobs = ();
-                    # add index to results, find jobs that have changed
-                    my @jobs = @{$data->{jobs}};
-                    for (my $ix = 0; $ix <= $#jobs; $ix++)
-                    {
-                        my @job = (int($ix), @{$jobs[$ix]});
-                        my $status = join(' ', map { $_ } @job); # join copy of array to avoid stringification of integers
-                        if (!defined $lastStatus[$ix] || ($lastStatus[$ix] ne $status))
-                        {
-                            $lastStatus[$ix] = $status;
-                            push(@changedJobs, \@job);
-                        }
-                    }
-                    # send list of changed jobs
-                    if ($#changedJobs > -1)
+                    $doSync = 1;
+                    $conn->{close} = 1;
+                }
+                # from cmd=realtime
+                elsif ( ($req eq 'realtime') && !$conn->{rt} && ( ($#args == 2) || ($#args == 3) ) )
+                {
+                    my ($client, $strlen, $proto, $resume) = @args;
+                    printf(STDERR "realtimed: %s connected%s\n", $client, $resume ? " (session $resume)" : '') if ($debug);
+                    # we're in charge now
+                    foreach my $other (grep { $_->{rt} && ($_->{rt}->{client} eq $client) } values %conns)
                     {
-                        my $json = JSON::PP->new()->ascii(1)->canonical(1)->pretty(0)->encode(\@changedJobs);
-                        print("\r\nstatus $nowInt $json\r\n");
+                        $other->{out} .= "\r\nreconnect $nowInt\r\n";
+                        $other->{close} = 1;
                     }
+                    $conn->{rt} = _realtimeResume(\%sessions, $client, $strlen, $proto, $resume);
+                    $conn->{subscribe} = 1;
+                    $doSync = 1;
+                }
+                else
+                {
+                    $conn->{close} = 1;
                 }
             }
         }
 
-        # FIXME: if we just could read some data from the client here to determine if it is still alive..
-        # reading from STDIN doesn't show any data... :-(
+        # heartbeats
+        foreach my $conn (grep { $_->{rt} && !$_->{close} } values %conns)
+        {
+            if (($now - $conn->{heartbeatTs}) >= 5)
+            {
+                $conn->{rt}->{session}->{ts} = $now if ($conn->{rt}->{session});
+                $conn->{nHeartbeat}++;
+                $conn->{heartbeatTs} = $now;
+                $conn->{out} .= "\r\nheartbeat " . _heartbeatArgs($conn->{nHeartbeat}) . "\r\n";
+            }
+            # don't run forever
+            if (($now - $conn->{startTs}) > (4 * 3600))
+            {
+                $conn->{out} .= "\r\nreconnect $nowInt\r\n";
+                $conn->{close} = 1;
+            }
+        }
+
+        # database changed (by someone that didn't tell us), or time to update the client check timestamps
+        if ( ($db && _dbRefresh($db)) || (($now - $lastSync) > 10) )
+        {
+            $doSync = 1;
+        }
+
+        # load database, send changes
+        if ($doSync)
+        {
+            $doSync = 0;
+            $lastSync = $now;
+            $db = _realtimedSync($db, \%conns, $nowInt);
+            delete $sessions{$_} for (grep { ($now - $sessions{$_}->{ts}) > 86400 } keys %sessions);
+            my ($changed, $all) = _dbChanges($db);
+            _metricsGauge('tschenggins_realtime_connections', '', scalar grep { $_->{rt} } values %conns);
+            _metricsFlush();
+
+            # new clients and clients whose config has changed: (re-)subscribe, check all channels
+            my %done = ();
+            foreach my $key (grep { $conns{$_}->{rt} && !$conns{$_}->{close} } keys %conns)
+            {
+                my $conn = $conns{$key};
+                my $client = $conn->{rt}->{client};
+                if ( $all || $conn->{subscribe} || $changed->{config}->{$client} )
+                {
+                    $conn->{subscribe} = 0;
+                    _realtimeIndexSet(\%subs, $key, $db->{config}->{$client} ? $db->{config}->{$client}->{jobs} || [] : []);
+                    $conn->{out} .= $_ for (_realtimeCheck($db, $conn->{rt}, $nowInt));
+                    $done{$key} = 1;
+                }
+            }
+
+            # changed jobs: only the channels that show them
+            my $chIxs = _realtimeIndexLookup(\%subs, keys %{$changed->{jobs} || {}});
+            foreach my $key (grep { !$done{$_} && $conns{$_} && !$conns{$_}->{close} } keys %{$chIxs})
+            {
+                $conns{$key}->{out} .= $_ for (_realtimeCheck($db, $conns{$key}->{rt}, $nowInt, @{$chIxs->{$key}}));
+            }
+        }
+
+        # send data, close connections
+        foreach my $conn (values %conns)
+        {
+            if ($conn->{out} ne '')
+            {
+                my $n = syswrite($conn->{sock}, $conn->{out});
+                if (defined $n)
+                {
+                    substr($conn->{out}, 0, $n, '');
+                    _metricsCount('tschenggins_realtime_bytes_total', '', $n) if ($conn->{rt});
+                }
+                elsif (!$!{EAGAIN})
+                {
+                    $conn->{out} = '';
+                    $conn->{close} = 1;
+                }
+            }
+            if ($conn->{close} && ($conn->{out} eq ''))
+            {
+                _realtimeIndexRemove(\%subs, fileno($conn->{sock}));
+                delete $conns{fileno($conn->{sock})};
+                close($conn->{sock});
+            }
+        }
+    }
+}
+
+# load database and handle what the realtime connections need there (pending commands, client check
+# timestamps), the database is only written if necessary
+sub _realtimedSync
+{
+    my ($oldDb, $conns, $nowInt) = @_;
+    my ($dbHandle, $db, $error) = _dbOpen(0, $oldDb);
+    if ($error)
+    {
+        printf(STDERR "realtimed: %s\n", $error);
+        return $oldDb;
+    }
+    foreach my $conn (grep { $_->{rt} && !$_->{close} } values %{$conns})
+    {
+        my $client = $conn->{rt}->{client};
+
+        # client was deleted
+        if (!$db->{clients}->{$client})
+        {
+            $conn->{out} .= "\r\nreconnect $nowInt\r\n";
+            $conn->{close} = 1;
+            next;
+        }
+
+        # command pending?
+        if ($db->{cmd}->{$client})
+        {
+            $conn->{out} .= "\r\ncommand $nowInt $db->{cmd}->{$client}\r\n";
+            $db->{cmd}->{$client} = '';
+            _dbDirty($db, 'cmd', $client);
+        }
+
+        # assume that while we're connected the connection to the client is still up
+        if (!$db->{clients}->{$client}->{check} || (($nowInt - $db->{clients}->{$client}->{check}) > 10))
+        {
+            $db->{clients}->{$client}->{check} = $nowInt;
+            _dbDirty($db, 'clients', $client);
+        }
     }
+    _dbClose($dbHandle, $db, 0, 1);
+    return $db;
+}
+
+####################################################################################################
+# incremental JSON output
+
+# Values can be streams, whose array elements (or hash key-value pairs) are generated and encoded one
+# at a time while the output is sent. The iterator returns the next element (key and value), or an
+# empty list at the end.
+sub _jsonStreamArray
+{
+    my ($iter) = @_;
+    return bless({ iter => $iter, hash => 0 }, 'JSONSTREAM');
+}
+
+sub _jsonStreamHash
+{
+    my ($hash) = @_;
+    my @keys = sort keys %{$hash};
+    return bless({ iter => sub { return $#keys < 0 ? () : do { my $key = shift(@keys); ($key, $hash->{$key}) } }, hash => 1 }, 'JSONSTREAM');
+}
+
+sub _jsonHasStream
+{
+    my ($val) = @_;
+    my $ref = ref($val);
+    return ($ref eq 'JSONSTREAM') || ( ($ref eq 'HASH') && (grep { _jsonHasStream($_) } values %{$val}) ) ? 1 : 0;
+}
+
+# encode data with streams, passing the JSON string piece by piece to the output function
+sub _jsonStream
+{
+    my ($json, $val, $out) = @_;
+    my $ref = ref($val);
+    my $nl = $json->get_indent() ? "\n" : '';
+    my $enc = sub { my $str = $json->encode($_[0]); chomp($str); return $str; };
+    if ($ref eq 'JSONSTREAM')
+    {
+        $out->(($val->{hash} ? '{' : '[') . $nl);
+        my $sep = '';
+        while (my @next = $val->{iter}->())
+        {
+            if ($val->{hash})
+            {
+                $out->($sep . $enc->("$next[0]") . ':');
+                _jsonStream($json, $next[1], $out);
+            }
+            else
+            {
+                $out->($sep);
+                _jsonStream($json, $next[0], $out);
+            }
+            $sep = ",$nl";
+        }
+        $out->($nl . ($val->{hash} ? '}' : ']'));
+    }
+    elsif ( ($ref eq 'HASH') && _jsonHasStream($val) )
+    {
+        $out->("{$nl");
+        my $sep = '';
+        foreach my $key (sort keys %{$val})
+        {
+            $out->($sep . $enc->("$key") . ':');
+            _jsonStream($json, $val->{$key}, $out);
+            $sep = ",$nl";
+        }
+        $out->("$nl}");
+    }
+    else
+    {
+        $out->($enc->($val));
+    }
+}
+
+####################################################################################################
+# metrics
+
+sub _metricsCount
+{
+    my ($name, $labels, $n) = @_;
+    $METRICS{counters}->{$name}->{$labels} += $n // 1;
+}
+
+sub _metricsGauge
+{
+    my ($name, $labels, $value) = @_;
+    $METRICS{gauges}->{$name}->{$labels} = [ $value, int(time()) ];
+}
+
+sub _metricsObserve
+{
+    my ($name, $labels, $dt) = @_;
+    my $hist = $METRICS{hists}->{$name}->{$labels} //= { buckets => [ map { 0 } @{$METRICSBUCKETS} ], sum => 0, count => 0 };
+    for (my $ix = 0; $ix <= $#{$METRICSBUCKETS}; $ix++)
+    {
+        $hist->{buckets}->[$ix]++ if ($dt <= $METRICSBUCKETS->[$ix]);
+    }
+    $hist->{sum} += $dt;
+    $hist->{count}++;
+}
+
+# add this process' metrics to the metrics file
+sub _metricsFlush
+{
+    my ($user, $system) = times();
+    _metricsCount('tschenggins_cpu_seconds_total', 'mode="user"',   $user   - $METRICSCPU[0]) if ($user   > $METRICSCPU[0]);
+    _metricsCount('tschenggins_cpu_seconds_total', 'mode="system"', $system - $METRICSCPU[1]) if ($system > $METRICSCPU[1]);
+    @METRICSCPU = ($user, $system);
+    return unless (%{$METRICS{counters}} || %{$METRICS{hists}} || %{$METRICS{gauges}});
+    my $fh;
+    unless (open($fh, '+>>', $METRICSFILE) && flock($fh, LOCK_EX))
+    {
+        return;
+    }
+    seek($fh, 0, SEEK_SET);
+    my $metrics;
+    eval
+    {
+        local $/;
+        my $json = <$fh>;
+        $metrics = $JSONCLASS->new()->utf8()->decode($json);
+    };
+    $metrics = { } unless ($metrics && (ref($metrics) eq 'HASH'));
+    foreach my $name (keys %{$METRICS{counters}})
+    {
+        foreach my $labels (keys %{$METRICS{counters}->{$name}})
+        {
+            $metrics->{counters}->{$name}->{$labels} += $METRICS{counters}->{$name}->{$labels};
+        }
+    }
+    foreach my $name (keys %{$METRICS{hists}})
+    {
+        foreach my $labels (keys %{$METRICS{hists}->{$name}})
+        {
+            my $src = $METRICS{hists}->{$name}->{$labels};
+            my $dst = $metrics->{hists}->{$name}->{$labels};
+            # (the buckets must match, otherwise start again)
+            if ( !$dst || ($#{$dst->{buckets}} != $#{$src->{buckets}}) )
+            {
+                $dst = $metrics->{hists}->{$name}->{$labels} = { buckets => [ map { 0 } @{$METRICSBUCKETS} ], sum => 0, count => 0 };
+            }
+            $dst->{buckets}->[$_] += $src->{buckets}->[$_] for (0 .. $#{$src->{buckets}});
+            $dst->{sum}   += $src->{sum};
+            $dst->{count} += $src->{count};
+        }
+    }
+    foreach my $name (keys %{$METRICS{gauges}})
+    {
+        $metrics->{gauges}->{$name}->{$_} = $METRICS{gauges}->{$name}->{$_} for (keys %{$METRICS{gauges}->{$name}});
+    }
+    truncate($fh, 0);
+    seek($fh, 0, SEEK_SET);
+    print($fh $JSONCLASS->new()->utf8(1)->canonical(1)->encode($metrics));
+    close($fh);
+    %METRICS = ( counters => {}, hists => {}, gauges => {} );
+}
+
+# all metrics in the Prometheus text format
+sub _metrics
+{
+    my ($db) = @_;
+    _metricsFlush();
+    my $metrics = { };
+    if (open(my $fh, '<', $METRICSFILE))
+    {
+        flock($fh, LOCK_SH);
+        eval
+        {
+            local $/;
+            my $json = <$fh>;
+            $metrics = $JSONCLASS->new()->utf8()->decode($json);
+        };
+        close($fh);
+    }
+    my $now = time();
+    my $str = '';
+    my $fmtName = sub { my ($name, $labels, $extra) = @_; my $l = join(',', grep { $_ } $labels, $extra); return $l ? "$name\{$l\}" : $name; };
+    foreach my $name (sort keys %{$metrics->{counters} || {}})
+    {
+        $str .= "# TYPE $name counter\n";
+        $str .= $fmtName->($name, $_) . " $metrics->{counters}->{$name}->{$_}\n" for (sort keys %{$metrics->{counters}->{$name}});
+    }
+    foreach my $name (sort keys %{$metrics->{hists} || {}})
+    {
+        $str .= "# TYPE $name histogram\n";
+        foreach my $labels (sort keys %{$metrics->{hists}->{$name}})
+        {
+            my $hist = $metrics->{hists}->{$name}->{$labels};
+            for (my $ix = 0; $ix <= $#{$METRICSBUCKETS}; $ix++)
+            {
+                $str .= $fmtName->("${name}_bucket", $labels, "le=\"$METRICSBUCKETS->[$ix]\"") . " " . ($hist->{buckets}->[$ix] || 0) . "\n";
+            }
+            $str .= $fmtName->("${name}_bucket", $labels, 'le="+Inf"') . " $hist->{count}\n";
+            $str .= $fmtName->("${name}_sum", $labels) . sprintf(" %.6f\n", $hist->{sum});
+            $str .= $fmtName->("${name}_count", $labels) . " $hist->{count}\n";
+        }
+    }
+    # gauges that are regularly updated (skip stale ones, e.g. from a realtime daemon that's gone)
+    foreach my $name (sort keys %{$metrics->{gauges} || {}})
+    {
+        my @labels = grep { ($now - $metrics->{gauges}->{$name}->{$_}->[1]) < 60 } sort keys %{$metrics->{gauges}->{$name}};
+        next if ($#labels < 0);
+        $str .= "# TYPE $name gauge\n";
+        $str .= $fmtName->($name, $_) . " $metrics->{gauges}->{$name}->{$_}->[0]\n" for (@labels);
+    }
+    # clients online (same as in the web interface)
+    my $nOnline = grep { $_->{check} && (($now - $_->{check}) < 15) } values %{$db->{clients}};
+    $str .= "# TYPE tschenggins_clients gauge\n";
+    $str .= "tschenggins_clients " . (scalar keys %{$db->{clients}}) . "\n";
+    $str .= "# TYPE tschenggins_clients_online gauge\n";
+    $str .= "tschenggins_clients_online $nOnline\n";
+    $str .= "# TYPE tschenggins_jobs gauge\n";
+    $str .= "tschenggins_jobs " . (scalar keys %{$db->{jobs}}) . "\n";
+    # latest client telemetry
+    my %tels = map { $_, $db->{telemetry}->{$_}->[-1] } grep { ref($db->{telemetry}->{$_}) eq 'ARRAY' } sort keys %{$db->{telemetry}};
+    foreach my $key (qw(heap minheap isr isrload rssi rx up))
+    {
+        my @clients = grep { defined $tels{$_}->{$key} } sort keys %tels;
+        next if ($#clients < 0);
+        $str .= "# TYPE tschenggins_client_$key gauge\n";
+        $str .= "tschenggins_client_$key\{client=\"$_\"\} $tels{$_}->{$key}\n" for (@clients);
+    }
+    return $str;
 }
 
 ####################################################################################################
@@ -1082,10 +2409,16 @@ sub _set
         return 0, 'illegal job id';
     }
     my $st = $db->{jobs}->{$id};
+    if ($st->{members})
+    {
+        return 0, 'job group state is computed';
+    }
     $db->{jobs}->{$id}->{state}  = $state  if ($state);
     $db->{jobs}->{$id}->{result} = $result if ($result);
     $db->{jobs}->{$id}->{ts}     = int(time() + 0.5);
-    $db->{_dirtiness}++;
+    $db->{jobs}->{$id}->{ver}    = ($db->{jobs}->{$id}->{ver} || 0) + 1;
+    _dbDirty($db, 'jobs', $id);
+    _groupUpdate($db, _groupsOf($db, $id));
     return 1, '';
 }
 
@@ -1106,8 +2439,20 @@ sub _del
     DEBUG("_del() %s", $job || 'undef');
     if ($db->{jobs}->{$job})
     {
+        # a group: remove it from its jobs' index, a job: remove it from its groups
+        my @groupIds = _groupsOf($db, $job);
+        _groupIndex($db, $job, $db->{jobs}->{$job}->{members}, undef);
+        foreach my $groupId (@groupIds)
+        {
+            my @members = grep { $_ ne $job } @{$db->{jobs}->{$groupId}->{members}};
+            $db->{jobs}->{$groupId}->{members} = \@members;
+            _dbDirty($db, 'jobs', $groupId);
+        }
+        delete $db->{jobgroups}->{$job};
+        _dbDirty($db, 'jobgroups', $job);
         delete $db->{jobs}->{$job};
-        $db->{_dirtiness}++;
+        _dbDirty($db, 'jobs', $job);
+        _groupUpdate($db, @groupIds);
         return 1, '';
     }
     else
@@ -1116,6 +2461,90 @@ sub _del
     }
 }
 
+# job groups
+
+# IDs of the groups that have any of the given jobs
+sub _groupsOf
+{
+    my ($db, @jobIds) = @_;
+    my %groupIds = map { %{$db->{jobgroups}->{$_} || {}} } @jobIds;
+    return sort keys %groupIds;
+}
+
+# update the job to groups index for a group from the old to the new list of jobs (either may be undef)
+sub _groupIndex
+{
+    my ($db, $groupId, $old, $new) = @_;
+    my %old = map { $_, 1 } @{$old || []};
+    my %new = map { $_, 1 } @{$new || []};
+    foreach my $jobId (grep { !$new{$_} } keys %old)
+    {
+        delete $db->{jobgroups}->{$jobId}->{$groupId};
+        delete $db->{jobgroups}->{$jobId} unless (%{$db->{jobgroups}->{$jobId} || {}});
+        _dbDirty($db, 'jobgroups', $jobId);
+    }
+    foreach my $jobId (grep { !$old{$_} } keys %new)
+    {
+        $db->{jobgroups}->{$jobId}->{$groupId} = 1;
+        _dbDirty($db, 'jobgroups', $jobId);
+    }
+}
+
+# add, change or (without jobs) remove a job group
+sub _groupSet
+{
+    my ($db, $name, @jobIds) = @_;
+    if (!$name || ($name !~ m{$JOBNAMERE}))
+    {
+        return 0, "not a valid group name: $name";
+    }
+    my $groupId = substr(Digest::MD5::md5_hex("$GROUPSERVER:$name"), -8);
+    if ($#jobIds < 0)
+    {
+        return $db->{jobs}->{$groupId} ? _del($db, $groupId) : (0, "no such group: $name");
+    }
+    # (no groups in groups)
+    my %seen = ();
+    my @members = grep { $db->{jobs}->{$_} && !$db->{jobs}->{$_}->{members} && !$seen{$_}++ } @jobIds;
+    if ($#members < 0)
+    {
+        return 0, 'illegal job ids';
+    }
+    my $group = $db->{jobs}->{$groupId};
+    _groupIndex($db, $groupId, $group ? $group->{members} : undef, \@members);
+    $db->{jobs}->{$groupId} = { name => $name, server => $GROUPSERVER, state => 'unknown', result => 'unknown',
+        ts => int(time() + 0.5), ver => 0, %{$group || {}}, members => \@members };
+    _groupUpdate($db, $groupId);
+    _dbDirty($db, 'jobs', $groupId);
+    return 1, '';
+}
+
+# recompute the state and result of the given job groups (the worst of their jobs')
+sub _groupUpdate
+{
+    my ($db, @groupIds) = @_;
+    foreach my $groupId (@groupIds)
+    {
+        my $group = $db->{jobs}->{$groupId};
+        next unless ($group && $group->{members});
+        my ($state, $result, $ts) = ('unknown', 'unknown', 0);
+        foreach my $st (grep { $_ } map { $db->{jobs}->{$_} } @{$group->{members}})
+        {
+            $state  = $st->{state}  if ( ($GROUPSTATE->{$st->{state}}  || 0) > $GROUPSTATE->{$state} );
+            $result = $st->{result} if ( ($BINRESULT->{$st->{result}} || 0) > $BINRESULT->{$result} );
+            $ts = $st->{ts} if ( ($st->{ts} || 0) > $ts );
+        }
+        # (the device only needs to know when the state or result changes)
+        next if ( ($group->{state} eq $state) && ($group->{result} eq $result) && $group->{ver} );
+        DEBUG("_groupUpdate() $group->{name} $state $result");
+        $group->{state}  = $state;
+        $group->{result} = $result;
+        $group->{ts}     = $ts || int(time() + 0.5);
+        $group->{ver}    = ($group->{ver} || 0) + 1;
+        _dbDirty($db, 'jobs', $groupId);
+    }
+}
+
 sub _gui
 {
     my ($db, $gui, $client) = @_;
@@ -1160,14 +2589,14 @@ sub _gui_jobs
 
     # results
     push(@html, $q->div({ -style => 'float: left; margin: 0 0 1em 1em;' }, $q->h2('Results'),
-                        __gui_results($db, @{$db->{_jobIds}})));
+                        __gui_results($db, _dbJobIds($db))));
 
     # helpers
     my $jobSelectArgs =
     {
         -name         => 'job',
-        -values       => [ '', @{$db->{_jobIds}} ],
-        -labels       => { '' => '<empty>', map { $_, "$db->{jobs}->{$_}->{server}: $db->{jobs}->{$_}->{name}" } @{$db->{_jobIds}} },
+        -values       => [ '', _dbJobIds($db) ],
+        -labels       => { '' => '<empty>', map { $_, "$db->{jobs}->{$_}->{server}: $db->{jobs}->{$_}->{name}" } _dbJobIds($db) },
         -autocomplete => 'off',
         -default      => '',
         -size         => 10,
@@ -1280,6 +2709,37 @@ sub _gui_jobs
                  $q->end_form())
         );
 
+    # job group (no groups in groups)
+    my @memberIds = grep { !$db->{jobs}->{$_}->{members} } _dbJobIds($db);
+    push(@html,
+         $q->div({ -style => 'float: left; margin: 0 0 1em 1em;' },
+                 $q->h2('Group'),
+                 $q->start_form(-method => 'GET', -action => $q->url() ),
+                 $q->table(
+                           $q->Tr(
+                                  $q->td('group: '),
+                                  $q->td($q->input({
+                                                    -type => 'text',
+                                                    -name => 'name',
+                                                    -size => 20,
+                                                    -autocomplete => 'off',
+                                                    -default => '',
+                                                   })),
+                                 ),
+                           $q->Tr(
+                                  $q->td('jobs: '),
+                                  $q->td($q->scrolling_list({ %{$jobSelectArgs}, -name => 'jobs', -multiple => 1,
+                                                              -values => \@memberIds })),
+                                 ),
+                           $q->Tr($q->td({ -colspan => 2, -align => 'center' },
+                                         $q->submit(-value => 'set group (no jobs: delete)')))
+                          ),
+                 ($debug ? $q->hidden(-name => 'debug', -default => $debug ) : ''),
+                 $q->hidden(-name => 'cmd', -default => 'cfggroup'),
+                 $q->hidden(-name => 'redirect', -default => 'cmd=gui;gui=jobs'),
+                 $q->end_form())
+        );
+
     return $q->div({}, @html), $q->div({ -style => 'clear: both;' });
 }
 
@@ -1289,7 +2749,7 @@ sub _gui_clients
     my @html = ();
 
     my @trs = ();
-    foreach my $clientId (sort  @{$db->{_clientIds}})
+    foreach my $clientId (_dbClientIds($db))
     {
         my $now = time();
         my $client = $db->{clients}->{$clientId};
@@ -1357,14 +2817,30 @@ sub _gui_client
                 )
         );
 
+    # telemetry (latest record)
+    my $tel = ref($db->{telemetry}->{$clientId}) eq 'ARRAY' ? $db->{telemetry}->{$clientId}->[-1] : undef;
+    if ($tel)
+    {
+        push(@html,
+             $q->div({ -style => 'float: left; margin: 0 0 1em 1em;' },
+                     $q->h3({}, 'Telemetry'),
+                     $q->table({},
+                               (map { $q->Tr({}, $q->th({}, $_), $q->td({}, $tel->{$_})) } grep { !ref($tel->{$_}) } sort keys %{$tel}),
+                               (map { $q->Tr({}, $q->th({}, $_->[0]), $q->td({}, sprintf('%.1f%% cpu, %u stack', $_->[1] / 10, $_->[2]))) } @{$tel->{tasks} || []}),
+                               (map { $q->Tr({}, $q->th({}, "$_->[0] ISR"), $q->td({}, sprintf('%uHz, %u/%uus', $_->[1], $_->[2], $_->[3]))) } @{$tel->{isrs} || []}),
+                              ),
+                    )
+            );
+    }
+
     #$q->Tr({}, $q->th({}, 'config'), $q->td({}, $q->pre({}, $rawconfig)))
 
     # config: jobs
     my $jobSelectArgs =
     {
         -name         => 'jobs',
-        -values       => [ '', @{$db->{_jobIds}} ],
-        -labels       => { map { $_, "$db->{jobs}->{$_}->{server}: $db->{jobs}->{$_}->{name}" } @{$db->{_jobIds}} },
+        -values       => [ '', _dbJobIds($db) ],
+        -labels       => { map { $_, "$db->{jobs}->{$_}->{server}: $db->{jobs}->{$_}->{name}" } _dbJobIds($db) },
         -autocomplete => 'off',
         -default      => '',
     };
@@ -1406,7 +2882,7 @@ sub _gui_client
     my $driverSelectArgs =
     {
         -name         => 'driver',
-        -values       => [ '', 'WS2801', 'SK9822' ],
+        -values       => [ '', 'WS2801', 'WS2812', 'SK9822' ],
         -autocomplete => 'off',
         -default      => ($config->{driver} || ''),
     };
@@ -1433,6 +2909,77 @@ sub _gui_client
         -autocomplete => 'off',
         -default      => ($config->{noise} || ''),
     };
+    my $fpsSelectArgs =
+    {
+        -name         => 'fps',
+        -values       => [ '', qw(10 25 50 100) ],
+        -labels       => { '' => 'default' },
+        -autocomplete => 'off',
+        -default      => ($config->{fps} || ''),
+    };
+    my $spiclkSelectArgs =
+    {
+        -name         => 'spiclk',
+        -values       => [ '', qw(1 2 4 8 10 20) ],
+        -labels       => { '' => 'default' },
+        -autocomplete => 'off',
+        -default      => ($config->{spiclk} || ''),
+    };
+    my $ditherSelectArgs =
+    {
+        -name         => 'dither',
+        -values       => [ '', qw(off on) ],
+        -autocomplete => 'off',
+        -default      => ($config->{dither} || ''),
+    };
+    my $powerSelectArgs =
+    {
+        -name         => 'power',
+        -values       => [ '', qw(none modem light) ],
+        -labels       => { '' => 'default', none => 'none (always on)', modem => 'modem sleep', light => 'light sleep' },
+        -autocomplete => 'off',
+        -default      => ($config->{power} || ''),
+    };
+    my $relaySelectArgs =
+    {
+        -name         => 'relay',
+        -values       => [ '', qw(off on) ],
+        -labels       => { '' => 'default (off)' },
+        -autocomplete => 'off',
+        -default      => ($config->{relay} || ''),
+    };
+    my $quietInputArgs =
+    {
+        -type         => 'text',
+        -name         => 'quiet',
+        -size         => 5,
+        -value        => ($config->{quiet} || ''),
+        -autocomplete => 'off',
+    };
+    my $fxInputArgs =
+    {
+        -type         => 'text',
+        -name         => 'fx',
+        -size         => 30,
+        -value        => ($config->{fx} || ''),
+        -autocomplete => 'off',
+    };
+    my $ledsInputArgs =
+    {
+        -type         => 'text',
+        -name         => 'leds',
+        -size         => 4,
+        -value        => ($config->{leds} || ''),
+        -autocomplete => 'off',
+    };
+    my $chledsInputArgs =
+    {
+        -type         => 'text',
+        -name         => 'chleds',
+        -size         => 4,
+        -value        => ($config->{chleds} || ''),
+        -autocomplete => 'off',
+    };
     my $nameInputArgs =
     {
         -type         => 'text',
@@ -1450,7 +2997,16 @@ sub _gui_client
                            $q->Tr({}, $q->td({}, 'LED driver:'), $q->td({}, $q->popup_menu($driverSelectArgs))),
                            $q->Tr({}, $q->td({}, 'LED colour order:'), $q->td({}, $q->popup_menu($orderSelectArgs))),
                            $q->Tr({}, $q->td({}, 'LED brightness:'), $q->td({}, $q->popup_menu($brightSelectArgs))),
+                           $q->Tr({}, $q->td({}, 'LED frame rate:'), $q->td({}, $q->popup_menu($fpsSelectArgs))),
+                           $q->Tr({}, $q->td({}, 'LED SPI clock [MHz]:'), $q->td({}, $q->popup_menu($spiclkSelectArgs))),
+                           $q->Tr({}, $q->td({}, 'LED dithering:'), $q->td({}, $q->popup_menu($ditherSelectArgs))),
+                           $q->Tr({}, $q->td({}, 'number of LEDs:'), $q->td({}, $q->input($ledsInputArgs))),
+                           $q->Tr({}, $q->td({}, 'LEDs per job:'), $q->td({}, $q->input($chledsInputArgs))),
+                           $q->Tr({}, $q->td({}, 'LED effect programs (hex):'), $q->td({}, $q->input($fxInputArgs))),
                            $q->Tr({}, $q->td({}, 'noise:'), $q->td({}, $q->popup_menu($noiseSelectArgs))),
+                           $q->Tr({}, $q->td({}, 'quiet hours (e.g. 22-7):'), $q->td({}, $q->input($quietInputArgs))),
+                           $q->Tr({}, $q->td({}, 'wifi power saving:'), $q->td({}, $q->popup_menu($powerSelectArgs))),
+                           $q->Tr({}, $q->td({}, 'share connection (LAN relay):'), $q->td({}, $q->popup_menu($relaySelectArgs))),
                            $q->Tr({}, $q->td({}, 'name:'), $q->td({}, $q->input($nameInputArgs))),
                            $q->Tr({ }, $q->td({ -colspan => 3, -align => 'center' }, $q->submit(-value => 'apply config'))),
                           ),
@@ -1466,7 +3022,7 @@ sub _gui_client
     my $cmdSelectArgs =
     {
         -name         => 'cfgcmd',
-        -values       => [ '', qw(reset reconnect identify random dummy) ],
+        -values       => [ '', qw(reset reconnect identify random trace dump dummy), map { "update $_" } _firmwareImages() ],
         -autocomplete => 'off',
         -default      => '',
     };
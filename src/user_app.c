@@ -70,6 +70,7 @@ typedef struct LEDS_s
     char             jobName[APP_LED_JOBNAME_LEN];
     char             serverName[APP_LED_SERVER_LEN];
     int32_t          time;
+    uint32_t         version;  // sAppStatusVersion when this last changed
 } LEDS_t;
 
 // storage for jenkins state/result
@@ -77,16 +78,23 @@ static LEDS_t sLeds[USER_APP_NUM_LEDS];
 
 JENKINS_RESULT_t sWorstResult = JENKINS_RESULT_OFF;
 
+// status version (incremented on every change of sLeds[], see sAppStatusChanged())
+static uint32_t sAppStatusVersion = 1;
+
+static void sAppStatusChanged(void);
+
 static void ICACHE_FLASH_ATTR sSetLedsUnknown(void)
 {
     for (uint16_t ledIx = 0; ledIx < NUMOF(sLeds); ledIx++)
     {
         sLeds[ledIx].jState  = JENKINS_STATE_UNKNOWN;
         sLeds[ledIx].jResult = JENKINS_RESULT_UNKNOWN;
-        strcat_P(sLeds[ledIx].jobName, PSTR("unknown"));
-        strcat_P(sLeds[ledIx].serverName, PSTR("unknown"));
+        strcpy_P(sLeds[ledIx].jobName, PSTR("unknown"));
+        strcpy_P(sLeds[ledIx].serverName, PSTR("unknown"));
         sLeds[ledIx].time = 0;
+        sLeds[ledIx].version = sAppStatusVersion + 1;
     }
+    sAppStatusChanged();
 }
 
 // --------------------------------------------------------------------------------------------------
@@ -977,6 +985,7 @@ static void ICACHE_FLASH_ATTR sAppJsonResponseToState(char *resp, const int resp
     jsmn_init(&parser);
     const int numTokens = jsmn_parse(&parser, resp, respLen, pTokens, maxTokens);
     bool okay = true;
+    bool changed = false;
     if (numTokens < 1)
     {
         switch (numTokens)
@@ -1149,8 +1158,18 @@ static void ICACHE_FLASH_ATTR sAppJsonResponseToState(char *resp, const int resp
             DEBUG("sAppWgetResponse() arrIx=%02d ledIx=%02d name=%s server=%s state=%s result=%s time=%s",
                 arrIx, ledIx, nameStr, serverStr, stateStr, resultStr, timeStr);
 
-            sLeds[ledIx].jState  = sStrToState(stateStr);
-            sLeds[ledIx].jResult = sStrToResult(resultStr);
+            const JENKINS_STATE_t  jState  = sStrToState(stateStr);
+            const JENKINS_RESULT_t jResult = sStrToResult(resultStr);
+            if ( (sLeds[ledIx].jState != jState) || (sLeds[ledIx].jResult != jResult) ||
+                 (os_strncmp(sLeds[ledIx].jobName,    nameStr,   sizeof(sLeds[ledIx].jobName) - 1) != 0) ||
+                 (os_strncmp(sLeds[ledIx].serverName, serverStr, sizeof(sLeds[ledIx].serverName) - 1) != 0) )
+            {
+                sLeds[ledIx].version = sAppStatusVersion + 1;
+                changed = true;
+            }
+
+            sLeds[ledIx].jState  = jState;
+            sLeds[ledIx].jResult = jResult;
             os_strncpy(sLeds[ledIx].jobName,    nameStr,   sizeof(sLeds[ledIx].jobName) - 1);
             os_strncpy(sLeds[ledIx].serverName, serverStr, sizeof(sLeds[ledIx].serverName) - 1);
             sLeds[ledIx].time = atoi(timeStr);
@@ -1159,6 +1178,12 @@ static void ICACHE_FLASH_ATTR sAppJsonResponseToState(char *resp, const int resp
         break;
     }
 
+    // tell the status page viewers
+    if (changed)
+    {
+        sAppStatusChanged();
+    }
+
     // are we happy?
     if (okay)
     {
@@ -1213,15 +1238,12 @@ static void ICACHE_FLASH_ATTR sAppJsonResponseToState(char *resp, const int resp
 
 /* ***** web interface *************************************************************************** */
 
-static const char skAppStatusHtml[] PROGMEM = USER_APP_STATUS_HTML_STR;
-
-#define APP_STATUS_HTML_SIZE (6 * 1024)
+HTML_TMPL_DEF(skAppStatusTmpl, USER_APP_STATUS_HTML);
 
-#define APP_STATUS_TR_FMT "<tr><td><div class=\"led led-%s led-%s-ani\" title=\"%s %s\"></div></td>" \
+#define APP_STATUS_TR_FMT "<tr data-ix=\"%d\"><td><div class=\"led led-%s led-%s-ani\" title=\"%s %s\"></div></td>" \
         "<td><span class=\"name\">%s</span></br><span class=\"server\">%s</span></td></tr>"
 
 #define APP_STATUS_TR_SIZE (NUMOF(sLeds) * 256)
-#define APP_STATUS_RESP_SIZE (sizeof(skAppStatusHtml) + sizeof(sLeds) + APP_STATUS_TR_SIZE)
 
 static bool ICACHE_FLASH_ATTR sAppStatusRequestCb(struct espconn *pConn, const HTTPD_REQCB_INFO_t *pkInfo)
 {
@@ -1243,22 +1265,13 @@ static bool ICACHE_FLASH_ATTR sAppStatusRequestCb(struct espconn *pConn, const H
         }
     }
 
-    char *pResp = memAlloc(APP_STATUS_RESP_SIZE);
-    if (pResp == NULL)
-    {
-        ERROR("sAppStatusRequestCb(%p) malloc %u fail", pConn, APP_STATUS_RESP_SIZE);
-        return false;
-    }
     char *pTr = memAlloc(APP_STATUS_TR_SIZE);
     if (pTr == NULL)
     {
         ERROR("sAppStatusRequestCb(%p) malloc %u fail", pConn, APP_STATUS_TR_SIZE);
-        memFree(pResp);
         return false;
     }
 
-    strcpy_P(pResp, skAppStatusHtml);
-
     pTr[0] = '\0';
     int trLen = 0;
     for (int ledIx = 0; ledIx < (int)NUMOF(sLeds); ledIx++)
@@ -1280,7 +1293,7 @@ static bool ICACHE_FLASH_ATTR sAppStatusRequestCb(struct espconn *pConn, const H
         const int remSize = APP_STATUS_TR_SIZE - 1 - trLen;
         if (reqLen < remSize)
         {
-            sprintf_PP(&pTr[trLen], PSTR(APP_STATUS_TR_FMT),
+            sprintf_PP(&pTr[trLen], PSTR(APP_STATUS_TR_FMT), ledIx,
                 colour, sLeds[ledIx].jState == JENKINS_STATE_RUNNING ? colour : PSTR("nope"),
                 skJenkinsStateStrs[ sLeds[ledIx].jState ],
                 skJenkinsResultStrs[ sLeds[ledIx].jResult ],
@@ -1295,22 +1308,180 @@ static bool ICACHE_FLASH_ATTR sAppStatusRequestCb(struct espconn *pConn, const H
     char age[20];
     sprintf_PP(age, PSTR("%u"), ((system_get_time() / 1000) - sAppLocalTime) / 1000);
 
-    const char *templKeys[] = { PSTR("STATUSTABLE"), PSTR("STATE"), PSTR("LOCALTIME"), PSTR("AGE") };
-    const char *templVals[] = {       pTr,                 state,         localtime,         age   };
+    char version[12];
+    sprintf_PP(version, PSTR("%u"), sAppStatusVersion);
+
+    const char *templKeys[] = { PSTR("STATUSTABLE"), PSTR("STATE"), PSTR("LOCALTIME"), PSTR("AGE"), PSTR("VERSION") };
+    const char *templVals[] = {       pTr,                 state,         localtime,         age,          version   };
 
-    const int htmlLen = htmlRender(
-        pResp, pResp, APP_STATUS_RESP_SIZE, templKeys, templVals, (int)NUMOF(templKeys), true);
+    DEBUG("sAppStatusRequestCb(%p) use %d/%d", pConn, trLen, APP_STATUS_TR_SIZE);
+
+    const bool res = httpSendHtmlTmpl(pConn, &skAppStatusTmpl, templKeys, templVals, (int)NUMOF(templKeys), false);
 
     memFree(pTr);
 
-    DEBUG("sAppStatusRequestCb(%p) use %d/%d %d/%d", pConn,
-            trLen, APP_STATUS_TR_SIZE, htmlLen, APP_STATUS_RESP_SIZE);
+    return res;
+}
+
+// --------------------------------------------------------------------------------------------------
 
-    const bool res = httpSendHtmlPage(pConn, pResp, false);
+// status.json?v=<version> long-poll: the response has the leds that changed since the given version,
+// and it's delayed until there is a change (or APP_STATUS_POLL_TIMEOUT)
 
-    memFree(pResp);
+#define APP_STATUS_POLL_NUM      4
+#define APP_STATUS_POLL_TIMEOUT  25 // [s]
+#define APP_STATUS_JSON_SIZE     (NUMOF(sLeds) * (APP_LED_JOBNAME_LEN + APP_LED_SERVER_LEN + 40) + 64)
 
-    return res;
+typedef struct APP_STATUS_POLL_s
+{
+    struct espconn *pConn;
+    uint32_t        version;
+    uint32_t        deadline;
+} APP_STATUS_POLL_t;
+
+static APP_STATUS_POLL_t sAppStatusPolls[APP_STATUS_POLL_NUM];
+static os_timer_t sAppStatusPollTimer;
+
+// JSON: { "version":N, "state":"...", "leds":[ [ ix, "state", "result", "name", "server" ], ... ] }
+static bool ICACHE_FLASH_ATTR sAppStatusJsonSend(struct espconn *pConn, const uint32_t since)
+{
+    char json[APP_STATUS_JSON_SIZE];
+    sprintf_PP(json, PSTR("{\"version\":%u,\"state\":\"%s\",\"leds\":["),
+        sAppStatusVersion, skUpdateStateStrs[sUpdateState]);
+    int jsonLen = os_strlen(json);
+    bool first = true;
+    for (int ledIx = 0; ledIx < (int)NUMOF(sLeds); ledIx++)
+    {
+        // (all of them for a client that doesn't know anything or has seen a version from before the last reset)
+        if ( (since != 0) && (since <= sAppStatusVersion) && (sLeds[ledIx].version <= since) )
+        {
+            continue;
+        }
+        sprintf_PP(&json[jsonLen], PSTR("%s[%d,\"%s\",\"%s\",\"%s\",\"%s\"]"), first ? PSTR("") : PSTR(","), ledIx,
+            skJenkinsStateStrs[ sLeds[ledIx].jState ], skJenkinsResultStrs[ sLeds[ledIx].jResult ],
+            sLeds[ledIx].jobName, sLeds[ledIx].serverName);
+        jsonLen += os_strlen(&json[jsonLen]);
+        first = false;
+    }
+    os_strcat(json, "]}");
+    jsonLen += 2;
+
+    return httpdSendResponse(pConn, PSTR("200 OK"),
+        PSTR("Content-Type: application/json; charset=UTF-8\r\nCache-Control: no-cache\r\n"),
+        (const uint8_t *)json, jsonLen);
+}
+
+// answer a waiting request
+static void ICACHE_FLASH_ATTR sAppStatusPollDone(const int pollIx)
+{
+    APP_STATUS_POLL_t *pPoll = &sAppStatusPolls[pollIx];
+    struct espconn *pConn = pPoll->pConn;
+    const uint32_t version = pPoll->version;
+    pPoll->pConn = NULL;
+    if (!sAppStatusJsonSend(pConn, version))
+    {
+        espconn_abort(pConn);
+    }
+}
+
+static void ICACHE_FLASH_ATTR sAppStatusPollTimerFunc(void *pArg)
+{
+    UNUSED(pArg);
+    const uint32_t msss = system_get_time() / 1000;
+    bool waiting = false;
+    for (int pollIx = 0; pollIx < (int)NUMOF(sAppStatusPolls); pollIx++)
+    {
+        if (sAppStatusPolls[pollIx].pConn != NULL)
+        {
+            if ((int32_t)(msss - sAppStatusPolls[pollIx].deadline) >= 0)
+            {
+                sAppStatusPollDone(pollIx);
+            }
+            else
+            {
+                waiting = true;
+            }
+        }
+    }
+    if (!waiting)
+    {
+        os_timer_disarm(&sAppStatusPollTimer);
+    }
+}
+
+// sLeds[] have changed
+static void ICACHE_FLASH_ATTR sAppStatusChanged(void)
+{
+    sAppStatusVersion++;
+    for (int pollIx = 0; pollIx < (int)NUMOF(sAppStatusPolls); pollIx++)
+    {
+        if (sAppStatusPolls[pollIx].pConn != NULL)
+        {
+            sAppStatusPollDone(pollIx);
+        }
+    }
+}
+
+static bool ICACHE_FLASH_ATTR sAppStatusPollConnCb(struct espconn *pConn, HTTPD_CONN_DATA_t *pData, const HTTPD_CONNCB_t reason)
+{
+    switch (reason)
+    {
+        // response sent
+        case HTTPD_CONNCB_SENT:
+            httpdUnregisterConnCb(pConn);
+            break;
+
+        // client gone while waiting
+        case HTTPD_CONNCB_ABORT:
+        case HTTPD_CONNCB_CLOSE:
+            sAppStatusPolls[pData->i].pConn = NULL;
+            break;
+    }
+    return true;
+}
+
+static bool ICACHE_FLASH_ATTR sAppStatusJsonRequestCb(struct espconn *pConn, const HTTPD_REQCB_INFO_t *pkInfo)
+{
+    uint32_t since = 0;
+    for (int ix = 0; ix < pkInfo->numKV; ix++)
+    {
+        if (strcmp_PP(pkInfo->keys[ix], PSTR("v")) == 0)
+        {
+            since = atoi(pkInfo->vals[ix]);
+        }
+    }
+
+    // respond now if there's something new (or the client doesn't know anything)
+    if (since != sAppStatusVersion)
+    {
+        return sAppStatusJsonSend(pConn, since);
+    }
+
+    // wait for changes
+    for (int pollIx = 0; pollIx < (int)NUMOF(sAppStatusPolls); pollIx++)
+    {
+        APP_STATUS_POLL_t *pPoll = &sAppStatusPolls[pollIx];
+        if (pPoll->pConn == NULL)
+        {
+            pPoll->pConn    = pConn;
+            pPoll->version  = since;
+            pPoll->deadline = (system_get_time() / 1000) + (APP_STATUS_POLL_TIMEOUT * 1000);
+
+            HTTPD_CONN_DATA_t templ = { .p = NULL, .i = pollIx, .u = 0 };
+            httpdRegisterConnCb(pConn, &templ, sAppStatusPollConnCb);
+
+            // don't let the httpd close the connection while we wait
+            espconn_regist_time(pConn, APP_STATUS_POLL_TIMEOUT + 5, 1);
+
+            os_timer_disarm(&sAppStatusPollTimer);
+            os_timer_setfn(&sAppStatusPollTimer, (os_timer_func_t *)sAppStatusPollTimerFunc, NULL);
+            os_timer_arm(&sAppStatusPollTimer, 1000, 1); // 1s, repeated
+            return true;
+        }
+    }
+
+    // too many viewers, let this one poll again later
+    return sAppStatusJsonSend(pConn, since);
 }
 
 
@@ -1382,6 +1553,7 @@ void ICACHE_FLASH_ATTR appInit(void)
     sSetLedsUnknown();
 
     httpdRegisterRequestCb(PSTR("/status"), HTTPD_AUTH_USER, sAppStatusRequestCb);
+    httpdRegisterRequestCb(PSTR("/status.json"), HTTPD_AUTH_USER, sAppStatusJsonRequestCb);
     httpdRegisterRequestCb(PSTR("/sound"),  HTTPD_AUTH_USER, sAppSoundRequestCb);
 }
 
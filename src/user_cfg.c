@@ -302,9 +302,7 @@ static uint16_t ICACHE_FLASH_ATTR sCfgChecksum(const uint8_t *pkData, int size)
 
 // -------------------------------------------------------------------------------------------------
 
-static const char skCfgFormHtml[] PROGMEM = USER_CFG_FORM_HTML_STR;
-
-#define CFG_FORM_SIZE (sizeof(USER_CFG_FORM_HTML_STR) + 512)
+HTML_TMPL_DEF(skCfgFormTmpl, USER_CFG_FORM_HTML);
 
 static os_timer_t sWifiChangeTimer;
 static void ICACHE_FLASH_ATTR sWifiChangeTimerFunc(void *pArg)
@@ -617,16 +615,6 @@ static bool ICACHE_FLASH_ATTR sCfgRequestCb(struct espconn *pConn, const HTTPD_R
     }
 
 
-    // render config form
-    char *pResp = memAlloc(CFG_FORM_SIZE);
-    if (pResp == NULL)
-    {
-        ERROR("sCfgRequestCb(%p) malloc %u fail", pConn, CFG_FORM_SIZE);
-        return false;
-    }
-
-    strcpy_P(pResp, skCfgFormHtml);
-
     // get current config
     const char *emptyStr   = PSTR("");
     const char *checkedStr = PSTR("checked");
@@ -679,15 +667,7 @@ static bool ICACHE_FLASH_ATTR sCfgRequestCb(struct espconn *pConn, const HTTPD_R
         ledIds
     };
 
-    const int htmlLen = htmlRender(
-        pResp, pResp, CFG_FORM_SIZE, formKeys, formVals, (int)NUMOF(formKeys), true);
-    DEBUG("sCfgRequestCb() htmlLen=%d/%d", htmlLen, CFG_FORM_SIZE);
-
-    const bool res = httpSendHtmlPage(pConn, pResp, false);
-
-    memFree(pResp);
-
-    return res;
+    return httpSendHtmlTmpl(pConn, &skCfgFormTmpl, formKeys, formVals, (int)NUMOF(formKeys), false);
 }
 
 /* *********************************************************************************************** */
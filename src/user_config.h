@@ -123,6 +123,15 @@
 //! maximum number of connections we can maintain in parallel
 #define USER_HTTPD_CONN_NUM 10
 
+//! number of preallocated send buffers (a connection holds one while it sends a response)
+#define USER_HTTPD_BUF_NUM 4
+
+//! size of the send buffers (must be a multiple of 4, see \ref USER_FS)
+#define USER_HTTPD_BUF_SIZE 2048
+
+//! close idle (keep-alive) connections after this many seconds
+#define USER_HTTPD_IDLE_TIMEOUT 5
+
 //! maximum username length
 #define USER_HTTPD_USER_LEN_MAX 16
 
@@ -17,13 +17,17 @@
 typedef struct FS_TOC_ENTRY_s
 {
     char     name[32];
-    char     type[32];
+    char     type[28];
+    uint32_t etag;     // content hash (of the data as stored)
+    uint8_t  flags;    // FS_FLAG_...
+    __PAD(3);
     uint32_t size;
     uint32_t offset;
     uint32_t magic;
-    __PAD(4);
 } FS_TOC_ENTRY_t;
 
+#define FS_FLAG_GZIP 0x01 // data is gzip compressed
+
 #define FS_MAGIC 0xb5006bb1 // 0xb16b00b5
 
 
@@ -35,6 +39,107 @@ static const char skSpiOpResStr[][8] PROGMEM =
     { "OK\0" }, { "ERROR\0" }, { "TIMEOUT\0" }
 };
 
+// index of the files (built from the TOC in fsInit(), sorted by name hash)
+typedef struct FS_INDEX_s
+{
+    uint32_t hash;     // hash of the name (see sFsNameHash())
+    uint32_t addr;     // flash address of the data
+    uint32_t size;     // size of the data
+    uint32_t etag;     // see FS_TOC_ENTRY_t
+    uint8_t  type;     // index into skFsTypes
+    uint8_t  flags;    // see FS_TOC_ENTRY_t
+    __PAD(2);
+} FS_INDEX_t;
+
+#define FS_MAX_FILES 16
+
+static FS_INDEX_t sFsIndex[FS_MAX_FILES];
+static int sFsIndexNum;
+
+// the content types that tools/mkfs.pl knows (the first one is the default)
+static const char skFsTypes[][28] PROGMEM =
+{
+    { "application/octet-stream\0" }, { "text/javascript\0" }, { "application/json\0" },
+    { "text/css\0" }, { "image/jpeg\0" }, { "image/png\0" }
+};
+
+// name hash (FNV-1a)
+static uint32_t ICACHE_FLASH_ATTR sFsNameHash(const char *name)
+{
+    uint32_t hash = 2166136261;
+    while (*name != '\0')
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+// find file in index (binary search)
+static const FS_INDEX_t * ICACHE_FLASH_ATTR sFsFind(const char *name)
+{
+    const uint32_t hash = sFsNameHash(name);
+    int lo = 0;
+    int hi = sFsIndexNum - 1;
+    while (lo <= hi)
+    {
+        const int mid = (lo + hi) / 2;
+        if (sFsIndex[mid].hash == hash)
+        {
+            return &sFsIndex[mid];
+        }
+        else if (sFsIndex[mid].hash < hash)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    return NULL;
+}
+
+// add file to index (keeping it sorted)
+static bool ICACHE_FLASH_ATTR sFsIndexAdd(const FS_TOC_ENTRY_t *pkToc)
+{
+    if (sFsIndexNum >= NUMOF(sFsIndex))
+    {
+        WARNING("fs: too many files (%s)", pkToc->name);
+        return false;
+    }
+    const uint32_t hash = sFsNameHash(pkToc->name);
+    if (sFsFind(pkToc->name) != NULL)
+    {
+        WARNING("fs: hash collision (%s)", pkToc->name);
+        return false;
+    }
+    uint8_t type = 0;
+    for (uint8_t ix = 0; ix < NUMOF(skFsTypes); ix++)
+    {
+        if (strcmp_PP(pkToc->type, skFsTypes[ix]) == 0)
+        {
+            type = ix;
+            break;
+        }
+    }
+    int ix = sFsIndexNum;
+    while ( (ix > 0) && (sFsIndex[ix - 1].hash > hash) )
+    {
+        sFsIndex[ix] = sFsIndex[ix - 1];
+        ix--;
+    }
+    FS_INDEX_t *pIndex = &sFsIndex[ix];
+    pIndex->hash  = hash;
+    pIndex->addr  = FS_ADDR + SPI_FLASH_SEC_SIZE + pkToc->offset;
+    pIndex->size  = pkToc->size;
+    pIndex->etag  = pkToc->etag;
+    pIndex->type  = type;
+    pIndex->flags = pkToc->flags;
+    sFsIndexNum++;
+    return true;
+}
+
 // forward declaration
 static bool sFsRequestCb(struct espconn *pConn, const HTTPD_REQCB_INFO_t *pkInfo);
 
@@ -49,21 +154,25 @@ void ICACHE_FLASH_ATTR fsInit(void)
         return;
     }
 
-    // get filesystem toc and register callback to serve the files
+    // get filesystem toc, index it and register callback to serve the files
+    sFsIndexNum = 0;
     const SpiFlashOpResult res = spi_flash_read(FS_ADDR, pBuf, SPI_FLASH_SEC_SIZE);
     if (res == SPI_FLASH_RESULT_OK)
     {
         //hexdump(pBuf, 200);
         const FS_TOC_ENTRY_t *pkToc = (const FS_TOC_ENTRY_t *)pBuf;
-        while ( (pkToc->magic == FS_MAGIC) && ((const uint8_t *)pkToc < ((const uint8_t *)pBuf + SPI_FLASH_SEC_SIZE)) )
+        while ( ((const uint8_t *)&pkToc[1] <= ((const uint8_t *)pBuf + SPI_FLASH_SEC_SIZE)) && (pkToc->magic == FS_MAGIC) )
         {
-            DEBUG("fs: %s (%s, %u) @ 0x%08x (%u)",
-                pkToc->name, pkToc->type, pkToc->size, FS_ADDR + pkToc->offset,
-                FS_SECTOR + 1 + (pkToc->offset / SPI_FLASH_SEC_SIZE));
+            DEBUG("fs: %s (%s, %u%s, %08x) @ 0x%08x (%u)",
+                pkToc->name, pkToc->type, pkToc->size, pkToc->flags & FS_FLAG_GZIP ? PSTR(" gz") : PSTR(""),
+                pkToc->etag, FS_ADDR + pkToc->offset, FS_SECTOR + 1 + (pkToc->offset / SPI_FLASH_SEC_SIZE));
 
-            char path[sizeof(pkToc->name) + 2];
-            os_sprintf(path, "/%s", pkToc->name);
-            httpdRegisterRequestCb(path, HTTPD_AUTH_PUBLIC, sFsRequestCb);
+            if (sFsIndexAdd(pkToc))
+            {
+                char path[sizeof(pkToc->name) + 2];
+                os_sprintf(path, "/%s", pkToc->name);
+                httpdRegisterRequestCb(path, HTTPD_AUTH_PUBLIC, sFsRequestCb);
+            }
 
             pkToc++;
         }
@@ -90,89 +199,147 @@ void ICACHE_FLASH_ATTR fsInit(void)
 #endif
 
 
-static bool sFsConnCb(struct espconn *pConn, HTTPD_CONN_DATA_t *pData, const HTTPD_CONNCB_t reason);
-
-static bool ICACHE_FLASH_ATTR sFsRequestCb(struct espconn *pConn, const HTTPD_REQCB_INFO_t *pkInfo)
+// parse decimal number, *ppEnd is set to the first character after it
+static uint32_t ICACHE_FLASH_ATTR sFsStrToNum(const char *str, const char **ppEnd)
 {
-    uint32_t *pBuf = memAlloc(SPI_FLASH_SEC_SIZE);
-    if (pBuf == NULL)
+    uint32_t num = 0;
+    while ( (*str >= '0') && (*str <= '9') )
     {
-        return httpdSendError(pConn, pkInfo->path, 500, NULL, PSTR("fs: malloc fail"));
+        num = (num * 10) + (*str - '0');
+        str++;
     }
-    REQ_DEBUG("sFsRequestCb(%p) pBuf=%p", pConn, pBuf);
-
-    const char *errorMsg = NULL;
-    bool error = false;
+    *ppEnd = str;
+    return num;
+}
 
-    // find toc entry
-    REQ_DEBUG("sFsRequestCb(%p) read toc addr=%u (%u)", pConn, FS_ADDR, FS_ADDR / SPI_FLASH_SEC_SIZE);
-    const SpiFlashOpResult res = spi_flash_read(FS_ADDR, pBuf, SPI_FLASH_SEC_SIZE);
-    if (res == SPI_FLASH_RESULT_OK)
+// parse "bytes=<first>-<last>", "bytes=<first>-" or "bytes=-<suffixlen>" (single range only),
+// returns false if there is no (usable) range, and sets *pFirst > *pLast if it's not satisfiable
+static bool ICACHE_FLASH_ATTR sFsParseRange(const char *range, const uint32_t size, uint32_t *pFirst, uint32_t *pLast)
+{
+    if ( (range == NULL) || (size == 0) || (strncmp_PP(range, PSTR("bytes="), 6) != 0) )
     {
-        //hexdump(pBuf, 200);
-        const FS_TOC_ENTRY_t *pkToc = (const FS_TOC_ENTRY_t *)pBuf;
-        while ( (pkToc->magic == FS_MAGIC) && ((const uint8_t *)pkToc < ((const uint8_t *)pBuf + SPI_FLASH_SEC_SIZE)) )
+        return false;
+    }
+    const char *pkStr = &range[6];
+    const char *pEnd;
+    uint32_t first = 0;
+    uint32_t last = size - 1;
+    if (*pkStr == '-')
+    {
+        const uint32_t suffixLen = sFsStrToNum(&pkStr[1], &pEnd);
+        if ( (pEnd == &pkStr[1]) || (*pEnd != '\0') )
         {
-            if (os_strcmp(pkToc->name, &pkInfo->path[1]) == 0)
-            {
-                break;
-            }
-            pkToc++;
+            return false;
         }
-
-        // file found?
-        if (pkToc->magic != FS_MAGIC)
+        first = suffixLen < size ? size - suffixLen : 0;
+        if (suffixLen == 0)
         {
-            errorMsg = PSTR("fs: toc find fail");
+            first = size; // not satisfiable
         }
-        while (pkToc->magic == FS_MAGIC)
+    }
+    else
+    {
+        first = sFsStrToNum(pkStr, &pEnd);
+        if ( (pEnd == pkStr) || (*pEnd != '-') )
         {
-            REQ_DEBUG("fs: %s (%s, %u) @ 0x%08x (%u)",
-                pkToc->name, pkToc->type, pkToc->size, pkToc->offset,
-                FS_SECTOR + 1 + (pkToc->offset / SPI_FLASH_SEC_SIZE));
-
-            // send header
-            char head[256];
-            sprintf_PP(head, PSTR("HTTP/1.1 200 OK\r\n"
-                    "Content-Length: %u\r\n"
-                    "Content-Type: %s; charset=UTF-8\r\n"
-                    "Cache-Control: max-age=86400\r\n"
-                    "Connection: close\r\n" // or we'll get ourselves in malloc()/free() trouble
-                    "\r\n"), pkToc->size, pkToc->type);
-            if (!httpdSendData(pConn, (uint8_t *)head, os_strlen(head)))
+            return false;
+        }
+        pkStr = &pEnd[1];
+        if (*pkStr != '\0')
+        {
+            last = sFsStrToNum(pkStr, &pEnd);
+            if ( (pEnd == pkStr) || (*pEnd != '\0') || (last < first) )
             {
-                error = true;
-                break;
+                return false;
+            }
+            if (last >= size)
+            {
+                last = size - 1;
             }
-
-            // prepare for sending the file contents (we must wait until the system has finished
-            // sending the headers before we can send more on this connection)
-            HTTPD_CONN_DATA_t templ; // httpdRegisterSentCb() will copy templ, so it's okay on the stack
-            templ.p = pBuf;
-            templ.i = (int)pkToc->size;
-            templ.u = FS_ADDR +  SPI_FLASH_SEC_SIZE + pkToc->offset;
-            httpdRegisterConnCb(pConn, &templ, sFsConnCb);
-            break;
         }
     }
-    else
+    *pFirst = first;
+    *pLast  = first < size ? last : 0;
+    return true;
+}
+
+static bool sFsConnCb(struct espconn *pConn, HTTPD_CONN_DATA_t *pData, const HTTPD_CONNCB_t reason);
+
+static bool ICACHE_FLASH_ATTR sFsRequestCb(struct espconn *pConn, const HTTPD_REQCB_INFO_t *pkInfo)
+{
+    // find file (no need to read the toc again, see fsInit())
+    const FS_INDEX_t *pkIndex = sFsFind(&pkInfo->path[1]);
+    if (pkIndex == NULL)
     {
-        ERROR("fs: toc read fail (%s)",
-            res < NUMOF(skSpiOpResStr) ? skSpiOpResStr[res] : PSTR("???"));
-        errorMsg = PSTR("fs read fail");
+        return httpdSendError(pConn, pkInfo->path, 404, NULL, PSTR("fs: file not found"));
     }
+    REQ_DEBUG("sFsRequestCb(%p) %s size=%u addr=0x%08x etag=%08x", pConn,
+        pkInfo->path, pkIndex->size, pkIndex->addr, pkIndex->etag);
 
-    if (error || (errorMsg != NULL) )
+    // client has it already?
+    char etag[12];
+    os_sprintf(etag, "\"%08x\"", pkIndex->etag);
+    if ( (pkInfo->ifNoneMatch != NULL) && (os_strstr(pkInfo->ifNoneMatch, etag) != NULL) )
     {
-        memFree(pBuf);
-        // we've already sent headers and maybe some data, so all we cannot send an error message
-        // and all we can do is abort the connection
-        return errorMsg == NULL ? false : httpdSendError(pConn, pkInfo->path, 500, NULL, errorMsg);
+        REQ_DEBUG("sFsRequestCb(%p) not modified %s", pConn, etag);
+        char head[100];
+        sprintf_PP(head, PSTR("ETag: %s\r\n"
+                "Cache-Control: max-age=86400\r\n"), etag);
+        return httpdSendResponse(pConn, PSTR("304 Not Modified"), head, NULL, 0);
     }
-    else
+
+    // range request?
+    uint32_t first = 0;
+    uint32_t last = pkIndex->size - 1;
+    const bool isRange = sFsParseRange(pkInfo->range, pkIndex->size, &first, &last);
+    if (isRange && (first > last))
     {
-        return true;
+        char head[100];
+        sprintf_PP(head, PSTR("Content-Range: bytes */%u\r\n"), pkIndex->size);
+        return httpdSendError(pConn, pkInfo->path, 416, head, NULL);
     }
+    const uint32_t size = pkIndex->size > 0 ? last - first + 1 : 0;
+
+    uint8_t *pBuf = httpdGetConnBuf(pConn);
+    if (pBuf == NULL)
+    {
+        return httpdSendError(pConn, pkInfo->path, 503, PSTR("Retry-After: 1\r\n"), PSTR("fs: no buffer"));
+    }
+    REQ_DEBUG("sFsRequestCb(%p) pBuf=%p range=%u-%u", pConn, pBuf, first, last);
+
+    // send header
+    char range[50];
+    range[0] = '\0';
+    if (isRange)
+    {
+        os_sprintf(range, "Content-Range: bytes %u-%u/%u\r\n", first, last, pkIndex->size);
+    }
+    char head[350];
+    sprintf_PP(head, PSTR("HTTP/1.1 %s\r\n"
+            "Content-Length: %u\r\n"
+            "Content-Type: %s; charset=UTF-8\r\n"
+            "%s%s"
+            "Accept-Ranges: bytes\r\n"
+            "ETag: %s\r\n"
+            "Cache-Control: max-age=86400\r\n"
+            "\r\n"), isRange ? PSTR("206 Partial Content") : PSTR("200 OK"),
+        size, skFsTypes[pkIndex->type],
+        pkIndex->flags & FS_FLAG_GZIP ? PSTR("Content-Encoding: gzip\r\n") : PSTR(""), range, etag);
+    if (!httpdSendData(pConn, (uint8_t *)head, os_strlen(head)))
+    {
+        // we may have sent some of the headers, so all we can do is abort the connection
+        return false;
+    }
+
+    // prepare for sending the file contents (we must wait until the system has finished
+    // sending the headers before we can send more on this connection)
+    HTTPD_CONN_DATA_t templ; // httpdRegisterSentCb() will copy templ, so it's okay on the stack
+    templ.p = pBuf;
+    templ.i = (int)size;
+    templ.u = pkIndex->addr + first;
+    httpdRegisterConnCb(pConn, &templ, sFsConnCb);
+
+    return true;
 }
 
 static bool sFsConnCb(struct espconn *pConn, HTTPD_CONN_DATA_t *pData, const HTTPD_CONNCB_t reason)
@@ -184,11 +351,10 @@ static bool sFsConnCb(struct espconn *pConn, HTTPD_CONN_DATA_t *pData, const HTT
         //    return true;
         //    break;
 
-        // free memory
+        // nothing to clean up (the buffer belongs to the httpd)
         case HTTPD_CONNCB_ABORT:
         case HTTPD_CONNCB_CLOSE:
             REQ_DEBUG("sFsSentCb(%p, %p) abort/disconnect", pConn, pData);
-            memFree(pData->p);
             return true;
 
         // continue below
@@ -203,22 +369,26 @@ static bool sFsConnCb(struct espconn *pConn, HTTPD_CONN_DATA_t *pData, const HTT
     if (pData->i <= 0)
     {
         REQ_DEBUG("sFsSentCb(%p) done", pConn);
+        httpdUnregisterConnCb(pConn);
         return true;
     }
 
-    // load data from flash
-    const SpiFlashOpResult readRes = spi_flash_read(pData->u, pData->p, SPI_FLASH_SEC_SIZE);
+    // load data from flash (the flash can only be read at word aligned addresses, which the start
+    // of a range may not be, files are sector aligned and padded, so we can always read a full buffer)
+    const uint32_t readAddr = pData->u & ~0x3;
+    const uint32_t skip = pData->u - readAddr;
+    const SpiFlashOpResult readRes = spi_flash_read(readAddr, pData->p, USER_HTTPD_BUF_SIZE);
     if (readRes != SPI_FLASH_RESULT_OK)
     {
-        ERROR("fs: read fail 0x%08x (%s)", pData->u,
+        ERROR("fs: read fail 0x%08x (%s)", readAddr,
             readRes < NUMOF(skSpiOpResStr) ? skSpiOpResStr[readRes] : PSTR("???"));
         return false;
     }
 
     // send data
-    const int sendSize = pData->i > SPI_FLASH_SEC_SIZE ? SPI_FLASH_SEC_SIZE : pData->i;
+    const int sendSize = pData->i > (int)(USER_HTTPD_BUF_SIZE - skip) ? (int)(USER_HTTPD_BUF_SIZE - skip) : pData->i;
     REQ_DEBUG("sFsSentCb(%p) sendSize=%d", pConn, sendSize);
-    if (!httpdSendData(pConn, (uint8_t *)pData->p, sendSize))
+    if (!httpdSendData(pConn, (uint8_t *)pData->p + skip, sendSize))
     {
         ERROR("fs: send fail");
         pData->i = 0;
@@ -227,7 +397,7 @@ static bool sFsConnCb(struct espconn *pConn, HTTPD_CONN_DATA_t *pData, const HTT
 
     // prepare for next chunk
     pData->i -= sendSize;
-    pData->u += SPI_FLASH_SEC_SIZE;
+    pData->u += sendSize;
 
     return true;
 }
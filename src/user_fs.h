@@ -10,7 +10,12 @@
 
     This implements a read-only filesystem. It registers a \ref USER_HTTPD callback for every file
     found. The \c tools/mkfs.pl script is used to generate an image of the filesystem, which is
-    loaded to the flash (see \c Makefile).
+    loaded to the flash (see \c Makefile). Text files are stored gzip compressed (if that makes
+    them smaller) and served with "Content-Encoding: gzip". All files are served with an "ETag"
+    (a hash of the stored data), so that browsers can revalidate their cached copy ("If-None-Match")
+    and get a "304 Not Modified" instead of the file. The table of contents is read once in fsInit()
+    into a small index (sorted by name hash), so requests go straight to the file data. Single
+    "Range: bytes=..." requests are answered with "206 Partial Content".
 
     Configuration:
     - see the \c Makefile for \c FF_FSADDR
@@ -23,245 +23,165 @@ void ICACHE_FLASH_ATTR htmlInit(void)
 
 // -------------------------------------------------------------------------------------------------
 
-static const char skHtmlDefaultTemplate[] PROGMEM = USER_HTML_TEMPL_HTML_STR;
+#define HTML_SLOT_MARKER '\001' // see tools/html2c.pl
 
-int ICACHE_FLASH_ATTR htmlRender(const char *template, char *html, const int size,
-    const char *keys[], const char *vals[], const int numKV, const bool clearKeys)
+// read character from RAM or ROM string
+static inline char sHtmlChar(const char *pkStr)
 {
-    // use default template
-    if (template == NULL)
-    {
-        template = skHtmlDefaultTemplate;
-    }
+    return (const void *)pkStr > (const void *)ESP_FLASH_BASE ? (char)pgm_read_uint8(pkStr) : *pkStr;
+}
 
-    // copy template
-    if (template != html)
+// assign the values to the slots of a template
+static void ICACHE_FLASH_ATTR sHtmlAssignSlots(const char *pkSlots, const char *slotVals[],
+    const char *keys[], const char *vals[], const int numKV)
+{
+    os_memset(slotVals, 0, HTML_SLOTS_MAX * sizeof(*slotVals));
+    int slotIx = 0;
+    while ( (slotIx < HTML_SLOTS_MAX) && (pgm_read_uint8(pkSlots) != '\0') )
     {
-        os_memset(html, 0, size);
-        //os_strcpy(html, template); // works for ROM strings, too it seems
-        strcpy_P(html, template);
-        // FIXME: add size check
+        for (int keyIx = 0; keyIx < numKV; keyIx++)
+        {
+            if (strcmp_PP(keys[keyIx], pkSlots) == 0)
+            {
+                slotVals[slotIx] = vals[keyIx];
+                break;
+            }
+        }
+        pkSlots += strlen_P(pkSlots) + 1;
+        slotIx++;
     }
-    // else: template == html
+}
 
-    const int htmlLenMax = size - 1;
-    int htmlLen = os_strlen(html);
-    //DEBUG("htmlRender() template=%p html=%p %d/%d", template, html, htmlLen, htmlLenMax);
+void ICACHE_FLASH_ATTR htmlRenderInit(HTML_RENDER_t *pRender, const HTML_TMPL_t *pkTmpl,
+    const char *keys[], const char *vals[], const int numKV)
+{
+    os_memset(pRender, 0, sizeof(*pRender));
+    pRender->pkStr[0]  = pkTmpl->str;
+    pRender->pkSlots   = pkTmpl->slots;
+    pRender->innerSlot = -1;
+    sHtmlAssignSlots(pkTmpl->slots, pRender->vals[0], keys, vals, numKV);
+}
 
-    // interpolate keys
-    int htmlIx = 0;
-    while (htmlIx < htmlLen)
+void ICACHE_FLASH_ATTR htmlRenderNest(HTML_RENDER_t *pRender, const char *key, const HTML_TMPL_t *pkTmpl,
+    const char *keys[], const char *vals[], const int numKV)
+{
+    const char *pkSlots = pRender->pkSlots;
+    int slotIx = 0;
+    while ( (slotIx < HTML_SLOTS_MAX) && (pgm_read_uint8(pkSlots) != '\0') )
     {
-        //DEBUG("htmlIx=%d: %c", htmlIx, html[htmlIx]);
-
-        // stop at NUL character
-        if (html[htmlIx] == '\0')
+        if (strcmp_PP(key, pkSlots) == 0)
         {
-            break;
+            pRender->innerSlot = slotIx;
+            pRender->pkInner = pkTmpl->str;
+            sHtmlAssignSlots(pkTmpl->slots, pRender->vals[1], keys, vals, numKV);
+            return;
         }
+        pkSlots += strlen_P(pkSlots) + 1;
+        slotIx++;
+    }
+    WARNING("html: no slot %s", key);
+}
 
-        // interpolate key?
-        if (html[htmlIx] == '%')
+int ICACHE_FLASH_ATTR htmlRenderCopyVals(HTML_RENDER_t *pRender, char *buf, const int size)
+{
+    int used = 0;
+    for (int level = 0; level < (int)NUMOF(pRender->vals); level++)
+    {
+        for (int slotIx = 0; slotIx < HTML_SLOTS_MAX; slotIx++)
         {
-            char key[20];
-            const char *pkKey = NULL;
-            const char *pkVal = NULL;
+            const char *pkVal = pRender->vals[level][slotIx];
+            if ( (pkVal == NULL) || ((const void *)pkVal > (const void *)ESP_FLASH_BASE) )
+            {
+                continue;
+            }
+            const int len = os_strlen(pkVal) + 1;
+            if ((used + len) > size)
+            {
+                return -1;
+            }
+            os_memcpy(&buf[used], pkVal, len);
+            pRender->vals[level][slotIx] = &buf[used];
+            used += len;
+        }
+    }
+    return used;
+}
 
-            // have "%%"
-            if (html[htmlIx + 1] == '%')
+// render up to size bytes (or just count them if buf is NULL)
+int ICACHE_FLASH_ATTR htmlRenderNext(HTML_RENDER_t *pRender, char *buf, const int size)
+{
+    int len = 0;
+    while (len < size)
+    {
+        // inserting a value
+        if (pRender->pkVal != NULL)
+        {
+            const char c = sHtmlChar(pRender->pkVal);
+            if (c == '\0')
             {
-                pkKey = "%%";
-                pkVal = "%";
+                pRender->pkVal = NULL;
             }
             else
             {
-                //DEBUG("key at %d? %c%c%c%c", htmlIx, html[htmlIx+0], html[htmlIx+1], html[htmlIx+2], html[htmlIx+3]);
-
-                // look for key (/^%[A-Za-z0-9]{0,20}%$/)
-                int htmlIx2 = htmlIx + 1, tIx = 0;
-                key[tIx] = html[htmlIx];
-                while (
-                    ( (html[htmlIx2] == '%') || isalnum((int)html[htmlIx2]) ) &&
-                    (htmlIx2 < htmlLen) &&
-                    (tIx < ((int)sizeof(key) - 1)) )
+                if (buf != NULL)
                 {
-                    const char c = html[htmlIx2];
-                    //DEBUG("try %c at %d", c, htmlIx2);
-                    key[++tIx] = c;
-                    if (c == '%')
-                    {
-                        break;
-                    }
-                    htmlIx2++;
-                }
-
-                // have key
-                if ((tIx > 1) && (key[tIx] == '%'))
-                {
-                    key[tIx + 1] = '\0';
-                    pkKey = key;
-
-                    // find value for it
-                    for (int keyIx = 0; keyIx < numKV; keyIx++)
-                    {
-                        if (/*os_strncmp*/strncmp_PP(keys[keyIx], &pkKey[1], tIx - 1) == 0)
-                        {
-                            pkVal = vals[keyIx];
-                            break;
-                        }
-                    }
-                    //DEBUG("key? %d / %s / %s", tIx, key, pkVal);
-
-                    // handle built-in variables unless overriden by user
-                    //if (pkVal == NULL)
-                    //{
-                    //    if (/*os_strncmp*/strncmp_PP(&pkKey[1], PSTR("MENU"), 4) == 0)
-                    //    {
-                    //        pkVal = sHtmlMenu;
-                    //    }
-                    //}
-
-                    // no value
-                    if (pkVal == NULL)
-                    {
-                        // clear key (replace with the empty string)
-                        if (clearKeys)
-                        {
-                            pkVal = "";
-                        }
-                        // leave key in
-                        else
-                        {
-                            pkKey = NULL;
-                        }
-                    }
+                    buf[len] = c;
                 }
+                len++;
+                pRender->pkVal++;
             }
+            continue;
+        }
 
-            // replace key with value
-            if (pkKey)
+        // end of template?
+        const int level = pRender->level;
+        const char c = pgm_read_uint8(pRender->pkStr[level]);
+        if (c == '\0')
+        {
+            // continue with the outer template
+            if (level > 0)
             {
-                // calculate how far and in what direction we have to move the right part of the string
-                int tokLen = os_strlen(pkKey);
-                int valLen = os_strlen(pkVal);
-                int move   = valLen - tokLen;
-                //NOTICE("==> %s at %d --> %s (tokLen=%d valLen=%d move=%d)",
-                //    pkKey, htmlIx, pkVal, tokLen, valLen, move);
-
-                // remove key if there is not enough space to interpolate val
-                if ((htmlLen + move) > htmlLenMax)
-                {
-                    ERROR("htmlRender() fail interpolate %s at %d (%d > %d)",
-                        pkKey, htmlIx, htmlLen + move, htmlLenMax);
-                    move = -(tokLen);
-                    valLen = 0;
-                    pkVal = "";
-                }
-                // move right part of string
-                if (move < 0) // move to the left
-                {
-                    char *pHtml = &html[htmlIx + tokLen + move];
-                    int n = htmlLen - htmlIx - tokLen + 1;
-                    while (n--)
-                    {
-                        //*(pHtml + move) = *pHtml;
-                        *pHtml = *(pHtml - move);
-                        pHtml++;
-                    }
-                }
-                else if (move > 0) // move to the right
-                {
-                    char *pHtml = &html[htmlLen + move];
-                    int n = htmlLen - htmlIx - tokLen + 1;
-                    while (n--)
-                    {
-                        *pHtml = *(pHtml - move);
-                        pHtml--;
-                    }
-                }
-
-                htmlLen += move;
-                //html[htmlLen] = '\0'; // add NUL terminator
-
-                // insert value
-                int n = valLen;
-                if ((const void *)pkVal > (const void *)ESP_FLASH_BASE)
-                {
-                    const char *p = &pkVal[n];
-                    while (n--)
-                    {
-                        p--;
-                        html[htmlIx + n] = pgm_read_uint8(p);;
-                    }
-                }
-                else
-                {
-                    while (n--)
-                    {
-                        html[htmlIx + n] = pkVal[n];
-                    }
-                }
-
-                //DEBUG("html=%s (%d, %d)", html, os_strlen(html), htmlLen);
+                pRender->level = 0;
+                continue;
             }
+            // done
+            break;
+        }
+        pRender->pkStr[level]++;
 
-        } // html[htmlIx] == '%'
+        // slot: continue with the value or the inner template
+        if (c == HTML_SLOT_MARKER)
+        {
+            const int slotIx = pgm_read_uint8(pRender->pkStr[level]) - 'A';
+            pRender->pkStr[level]++;
+            if ( (level == 0) && (slotIx == pRender->innerSlot) )
+            {
+                pRender->pkStr[1] = pRender->pkInner;
+                pRender->level = 1;
+            }
+            else if ( (slotIx >= 0) && (slotIx < HTML_SLOTS_MAX) )
+            {
+                pRender->pkVal = pRender->vals[level][slotIx];
+            }
+            continue;
+        }
 
-        htmlIx++;
-    }
-    const int lenCheck = os_strlen(html);
-    //DEBUG("done %d %d", htmlLen, lenCheck);
-    if (htmlLen != lenCheck)
-    {
-        ERROR("htmlRender() %d != %d", htmlLen, lenCheck);
+        // literal text
+        if (buf != NULL)
+        {
+            buf[len] = c;
+        }
+        len++;
     }
-
-    return htmlLen;
+    return len;
 }
 
-
-// -------------------------------------------------------------------------------------------------
-
-
-#if 0
-#  warning htmlTest() compiled in
-static const char templ[] PROGMEM = "foo %FOO% bar %BAR% baz %BAZ% gugus 42% %GUGUS%";
-void ICACHE_FLASH_ATTR htmlTest(void)
+int ICACHE_FLASH_ATTR htmlRenderSize(const HTML_RENDER_t *pkRender)
 {
-#if 1
-    DEBUG("html: templ=%p %s", templ, templ);
-
-    //const char *keys[] = { "FOO" };
-    //const char *vals[] = { "iamfoo" };
-    //const char *keys[] = { "FOO", "BAR" };
-    //const char *vals[] = { "iamfoo", "iambar" };
-
-    //const char *keys[] = { "BAR" };
-    //const char *vals[] = { "iambar" };
-    //const char *keys[] = { "FOO" };
-    //const char *vals[] = { "f!" };
-
-    const char *keys[] = { "FOO", "BAR" };
-    //const char *vals[] = { "iamfoo!", "b!" };
-    static const char bar[] PROGMEM = "b!";
-    const char *vals[] = { "iamfoo!", bar };
-
-    char *html = os_malloc(1000);
-    const int len = htmlRender(templ, html, 1000, keys, vals, (int)NUMOF(keys), true);
-    DEBUG("html=%s (%p, %d, %d)", html, html, len, os_strlen(html));
-    os_free(html);
-#endif
-
-#if 1
-    DEBUG("html: test %p %s", skHtmlDefaultTemplate, skHtmlDefaultTemplate);
-
-    uint8_t *resp = os_malloc(8192);
-    const int len2 = htmlRender(NULL, (char *)resp, 8192, NULL, NULL, 0, true);
-    DEBUG("resp=%s (%p, %d, %d)", resp, resp, len2, os_strlen(resp));
-    os_free(resp);
-#endif
+    HTML_RENDER_t render = *pkRender;
+    return htmlRenderNext(&render, NULL, INT32_MAX);
 }
-#endif
+
 
 /* *********************************************************************************************** */
 //@}
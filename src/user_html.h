@@ -10,8 +10,12 @@
 
     This implements a simple HTML template system.
 
-    It also comes with the \c tools/html2c.pl that translates html files into string literals that
-    can be used as input templates (or otherwise). See html_gen.h.
+    The \c tools/html2c.pl script translates html files into string literals (see html_gen.h). For
+    each file it generates the plain HTML (\c FOO_HTML_STR) and a compiled template, the literal
+    text with the "%KEYNAME%" variables replaced by slot markers (\c FOO_HTML_TMPL), and the list
+    of slot names (\c FOO_HTML_SLOTS). The renderer interpolates the values for the slots while it
+    copies the template to the output in a single pass and in chunks of any size, so that a page
+    can be sent without ever having all of it in memory (see httpSendHtmlTmpl()).
 
     @{
 */
@@ -23,49 +27,98 @@
 //! initialise HMTL template engine
 void htmlInit(void);
 
-//! render a HTML template
-/*!
-    Interpolates given variables in a template (in the form "%KEYNAME%") with values. Optionally removes
-    unmatched keys. Keys for which the interploation would make the target \c html overflow are
-    ignored and the corresponding variable are removed.
+//! maximum number of different variables (slots) in a template (see \c tools/html2c.pl)
+#define HTML_SLOTS_MAX 16
 
-    \param[in] template   the template string (can be a ROM string), or #NULL to use the built-in one
-    \param[in] html       target HTML string (can be the same as the \c template)
-    \param[in] size       size of \c html buffer (> strlen(template)+1 !)
-    \param[in] keys       parameter names
-    \param[in] vals       parameter values
-    \param[in] numKV      number of \c keys and \c vals
-    \param[in] clearKeys  clear keys from template that have not been interpolated
-    \returns the length of the \c html string after interpolation
+//! a compiled template
+typedef struct HTML_TMPL_s
+{
+    const char *str;     //!< the template (ROM string, \c FOO_HTML_TMPL)
+    const char *slots;   //!< the slot names (ROM string, \c FOO_HTML_SLOTS)
+} HTML_TMPL_t;
 
-    \note There is no size check that \c template fits into \c html.
+//! define a compiled template
+/*!
+    \param[in] _var   name of the (static) template variable
+    \param[in] _name  name of the template in html_gen.h (e.g. \c USER_FOO_HTML for foo.html)
 
     Example:
 \code{.c}
-const char *pkTemplate = PSTR("foo %BAR% %BAZ%baz %GUGUS% bla");
-char html[30];
-const char *keys[] = { PSTR("BAR"), PSTR("BAZ") };
-const char *vals[] = { PSTR("11"), PSTR("22222") };
-const int htmlLen = htmlRender(pkTemplate, html, sizeof(html), keys, vals, NUMOF(keys), true);
-// --> htmlLen = 10, html = "foo 11 22222baz bla\0\0\0\0\0\0\0\0\0\0\0"
-\endcode
-And since \c template and \c html can be the same buffer:
-\code{.c}
-const char *pkTemplate = PSTR("foo %BAR% %BAZ%baz %GUGUS% bla");
-char html[30];
-strcpy_P(html, pkTemplate); // or from elsewhere
+HTML_TMPL_DEF(skFooTmpl, USER_FOO_HTML);
 const char *keys[] = { PSTR("BAR"), PSTR("BAZ") };
-const char *vals[] = { PSTR("11"), PSTR("22222") };
-const int htmlLen = htmlRender(html, html, sizeof(html), keys, vals, NUMOF(keys), true);
-// --> htmlLen = 10, html = "foo 11 22222baz bla\0\0\0\0\0\0\0\0\0\0\0"
+const char *vals[] = { PSTR("11"), someString };
+return httpSendHtmlTmpl(pConn, &skFooTmpl, keys, vals, NUMOF(keys), false);
 \endcode
+    \hideinitializer
+*/
+#define HTML_TMPL_DEF(_var, _name) \
+    static const char _var ## Str[] PROGMEM = _name ## _TMPL; \
+    static const char _var ## Slots[] PROGMEM = _name ## _SLOTS; \
+    static const HTML_TMPL_t _var = { _var ## Str, _var ## Slots }
+
+//! template rendering state (see htmlRenderInit())
+typedef struct HTML_RENDER_s
+{
+    const char *pkStr[2];                   // current position in the template (outer, inner)
+    const char *vals[2][HTML_SLOTS_MAX];    // values for the slots (outer, inner)
+    const char *pkSlots;                    // slot names of the outer template
+    const char *pkInner;                    // the (optional) inner template
+    const char *pkVal;                      // value being inserted, or NULL
+    int8_t      level;                      // 0 = outer, 1 = inner template
+    int8_t      innerSlot;                  // slot of the outer template for the inner template, or -1
+    __PAD(2);
+} HTML_RENDER_t;
+
+//! start rendering a template
+/*!
+    \param[out] pRender  rendering state
+    \param[in]  pkTmpl   the template
+    \param[in]  keys     variable names (can be ROM strings)
+    \param[in]  vals     variable values (can be ROM strings)
+    \param[in]  numKV    number of \c keys and \c vals
+
+    Variables of the template without a value are replaced with the empty string. The values are not
+    copied and must stay valid until rendering is complete, or see htmlRenderCopyVals().
 */
-int htmlRender(const char *template, char *html, const int size,
-    const char *keys[], const char *vals[], const int numKV,
-    const bool clearKeys);
+void htmlRenderInit(HTML_RENDER_t *pRender, const HTML_TMPL_t *pkTmpl,
+    const char *keys[], const char *vals[], const int numKV);
 
+//! render another template in place of a variable
+/*!
+    \param[in,out] pRender  rendering state (from htmlRenderInit())
+    \param[in]     key      the variable of the outer template to replace
+    \param[in]     pkTmpl   the (inner) template
+    \param[in]     keys     variable names for the inner template (can be ROM strings)
+    \param[in]     vals     variable values for the inner template (can be ROM strings)
+    \param[in]     numKV    number of \c keys and \c vals
+*/
+void htmlRenderNest(HTML_RENDER_t *pRender, const char *key, const HTML_TMPL_t *pkTmpl,
+    const char *keys[], const char *vals[], const int numKV);
+
+//! copy the values that are in RAM
+/*!
+    \param[in,out] pRender  rendering state
+    \param[out]    buf      buffer for the values
+    \param[in]     size     size of the buffer
+    \returns the number of bytes used in the buffer, or -1 if the values don't fit
+*/
+int htmlRenderCopyVals(HTML_RENDER_t *pRender, char *buf, const int size);
 
-//void htmlTest(void);
+//! render the next chunk
+/*!
+    \param[in,out] pRender  rendering state
+    \param[out]    buf      output buffer (not NUL terminated)
+    \param[in]     size     size of the output buffer
+    \returns the number of bytes rendered (0 once rendering is complete)
+*/
+int htmlRenderNext(HTML_RENDER_t *pRender, char *buf, const int size);
+
+//! calculate the size of the rendered output
+/*!
+    \param[in] pkRender  rendering state (as returned by htmlRenderInit() or htmlRenderNest())
+    \returns the size of the output in bytes
+*/
+int htmlRenderSize(const HTML_RENDER_t *pkRender);
 
 
 #endif // __USER_HTML_H__
@@ -37,8 +37,10 @@ typedef struct HTTPD_CONN_DATA_STORE_s
 {
     uint32_t             remote_ip;
     int                  remote_port;
-    bool                 requestDone;
-    __PAD(3);
+    bool                 busy;        // request received, response not yet complete
+    bool                 keepAlive;   // keep the connection open after the response
+    __PAD(2);
+    uint8_t             *pBuf;        // send buffer (one of sHttpdBufs[], or NULL)
     HTTPD_CONNCB_FUNC_t *connCb;
     HTTPD_CONN_DATA_t    data;
 } HTTPD_CONN_DATA_STORE_t;
@@ -48,11 +50,12 @@ static void sHttpdConnectCb(void *pArg);
 static bool sHttpdConnDataSet(struct espconn *pConn);
 static HTTPD_CONN_DATA_STORE_t *sHttpdConnDataGet(struct espconn *pConn);
 static void sHttpdConnDataDel(struct espconn *pConn);
+static void sHttpdResponseDone(struct espconn *pConn, HTTPD_CONN_DATA_STORE_t *pDataStore);
 static void sHttpdRecvCb(void *pArg, char *data, uint16_t size);
 static void sHttpdSentCb(void *pArg);
 static void sHttpdReconCb(void *pArg, int8_t err);
 static void sHttpdDisconCb(void *pArg);
-static bool sHttpdHandleRequest(struct espconn *pConn, char *data, const uint16_t size);
+static bool sHttpdHandleRequest(struct espconn *pConn, char *data, const uint16_t size, bool *pKeepAlive);
 static int sHttpdSplitQueryString(char *str, const char *keys[], const char *vals[], const int num);
 static HTTPD_REQCB_ENTRY_t *sHttpdGetRequestCb(const char *path);
 
@@ -68,6 +71,8 @@ static uint32_t sHttpdSendSize;
 static uint32_t sHttpdHandleCnt;
 static uint32_t sHttpdHandleGetCnt;
 static uint32_t sHttpdHandlePostCnt;
+static uint32_t sHttpdKeepAliveCnt;
+static uint32_t sHttpdNoBufCnt;
 
 // user and admin authentication ("auth basic" style, base64)
 #define HTTPD_AUTHLEN(ulen, plen) BASE64_ENCLEN((ulen) + 1 + (plen))
@@ -81,6 +86,10 @@ HTTPD_REQCB_ENTRY_t sHttpdReqCbs[USER_HTTPD_REQUESTCB_NUM];
 
 HTTPD_CONN_DATA_t sHttpdConns[USER_HTTPD_CONN_NUM];
 
+// send buffers (preallocated, so that serving files and pages doesn't fragment the heap)
+static uint8_t sHttpdBufs[USER_HTTPD_BUF_NUM][USER_HTTPD_BUF_SIZE] __attribute__ ((aligned (4)));
+static bool sHttpdBufsUsed[USER_HTTPD_BUF_NUM];
+
 // http request debugging
 #if 0
 #  warning REQ_DEBUG is on
@@ -118,6 +127,9 @@ void ICACHE_FLASH_ATTR httpdStart(void)
     //espconn_secure_accept(&esp_conn);
     espconn_accept(&sHttpdConn);
 
+    // close idle (keep-alive) connections after a while
+    espconn_regist_time(&sHttpdConn, USER_HTTPD_IDLE_TIMEOUT, 0);
+
     PRINT("httpd: listen "IPSTR":%u",
         IP2STR(&sHttpdTcp.local_ip), sHttpdTcp.local_port);
 
@@ -132,6 +144,17 @@ void ICACHE_FLASH_ATTR httpdStart(void)
 
 HTTPD_CONN_DATA_STORE_t sHttpdConnData[USER_HTTPD_CONN_NUM];
 
+static void ICACHE_FLASH_ATTR sHttpdBufRelease(HTTPD_CONN_DATA_STORE_t *pDataStore)
+{
+    if (pDataStore->pBuf != NULL)
+    {
+        const int ix = (pDataStore->pBuf - &sHttpdBufs[0][0]) / USER_HTTPD_BUF_SIZE;
+        REQ_DEBUG("sHttpdBufRelease(%p) %d", pDataStore, ix);
+        sHttpdBufsUsed[ix] = false;
+        pDataStore->pBuf = NULL;
+    }
+}
+
 static bool ICACHE_FLASH_ATTR sHttpdConnDataSet(struct espconn *pConn)
 {
     const struct _esp_tcp *pkTcp = pConn->proto.tcp;
@@ -198,6 +221,7 @@ static void ICACHE_FLASH_ATTR sHttpdConnDataDel(struct espconn *pConn)
     {
         REQ_DEBUG("sHttpdConnDataDel(%p) "IPSTR":%u (%p)", pConn,
             IP2STR(&pkTcp->remote_ip), pkTcp->remote_port, pData);
+        sHttpdBufRelease(pData);
         os_memset(pData, 0, sizeof(*pData));
     }
     else
@@ -234,6 +258,62 @@ static void ICACHE_FLASH_ATTR sHttpdConnDataDel(struct espconn *pConn)
 #endif
 }
 
+uint8_t * ICACHE_FLASH_ATTR httpdGetConnBuf(struct espconn *pConn)
+{
+    HTTPD_CONN_DATA_STORE_t *pDataStore = sHttpdConnDataGet(pConn);
+    if (pDataStore == NULL)
+    {
+        return NULL;
+    }
+    if (pDataStore->pBuf == NULL)
+    {
+        for (int ix = 0; ix < (int)NUMOF(sHttpdBufs); ix++)
+        {
+            if (!sHttpdBufsUsed[ix])
+            {
+                sHttpdBufsUsed[ix] = true;
+                pDataStore->pBuf = sHttpdBufs[ix];
+                break;
+            }
+        }
+        if (pDataStore->pBuf == NULL)
+        {
+            sHttpdNoBufCnt++;
+            WARNING("httpd: no send buffer");
+        }
+    }
+    REQ_DEBUG("httpdGetConnBuf(%p) pBuf=%p", pConn, pDataStore->pBuf);
+    return pDataStore->pBuf;
+}
+
+void ICACHE_FLASH_ATTR httpdUnregisterConnCb(struct espconn *pConn)
+{
+    HTTPD_CONN_DATA_STORE_t *pDataStore = sHttpdConnDataGet(pConn);
+    REQ_DEBUG("httpdUnregisterConnCb(%p) pDataStore=%p", pConn, pDataStore);
+    if (pDataStore != NULL)
+    {
+        pDataStore->connCb = NULL;
+    }
+}
+
+// the response has been sent, release resources, and close the connection or wait for the next request
+static void ICACHE_FLASH_ATTR sHttpdResponseDone(struct espconn *pConn, HTTPD_CONN_DATA_STORE_t *pDataStore)
+{
+    REQ_DEBUG("sHttpdResponseDone(%p) keepAlive=%d", pConn, pDataStore->keepAlive);
+    sHttpdBufRelease(pDataStore);
+    pDataStore->busy = false;
+    if (!pDataStore->keepAlive)
+    {
+        espconn_disconnect(pConn);
+    }
+}
+
+static const char * ICACHE_FLASH_ATTR sHttpdConnectionHeader(struct espconn *pConn)
+{
+    const HTTPD_CONN_DATA_STORE_t *pkDataStore = sHttpdConnDataGet(pConn);
+    return (pkDataStore != NULL) && !pkDataStore->keepAlive ? PSTR("Connection: close\r\n") : PSTR("");
+}
+
 void httpdRegisterConnCb(
     struct espconn *pConn, const HTTPD_CONN_DATA_t *pkTempl, HTTPD_CONNCB_FUNC_t connCb)
 {
@@ -300,14 +380,21 @@ static void ICACHE_FLASH_ATTR sHttpdRecvCb(void *pArg, char *data, uint16_t size
         return;
     }
 
-    // first data must be the request, dispatch it
-    if (!pDataStore->requestDone)
+    // first data (after connect or after the previous response is complete) must be the request,
+    // dispatch it (more data while we're busy, e.g. pipelined requests, is ignored)
+    if (!pDataStore->busy)
     {
         if (size)
         {
             REQ_DEBUG("sHttpdRecvCb(%p) "IPSTR":%u size=%u",
                 pConn, IP2STR(&pkTcp->remote_ip), pkTcp->remote_port, size);
-            if (!sHttpdHandleRequest(pConn, data, size))
+            if (pDataStore->keepAlive)
+            {
+                sHttpdKeepAliveCnt++;
+            }
+            pDataStore->busy = true;
+            pDataStore->keepAlive = true;
+            if (!sHttpdHandleRequest(pConn, data, size, &pDataStore->keepAlive))
             {
                 ERROR("httpd: fail handle request");
                 espconn_abort(pConn);
@@ -318,7 +405,10 @@ static void ICACHE_FLASH_ATTR sHttpdRecvCb(void *pArg, char *data, uint16_t size
             WARNING("http: empty request "IPSTR":%u",
                 IP2STR(&pkTcp->remote_ip), pkTcp->remote_port);
         }
-        pDataStore->requestDone = true;
+    }
+    else
+    {
+        REQ_DEBUG("sHttpdRecvCb(%p) busy, ignoring %u bytes", pConn, size);
     }
     // call user callback
     //else
@@ -360,8 +450,14 @@ static void ICACHE_FLASH_ATTR sHttpdSentCb(void *pArg)
         {
             ERROR("httpd: conncb sent fail");
             espconn_abort(pConn);
+            return;
         }
-        return;
+    }
+
+    // response complete (no callback, or the callback has unregistered itself)?
+    if (pDataStore->connCb == NULL)
+    {
+        sHttpdResponseDone(pConn, pDataStore);
     }
 }
 
@@ -448,7 +544,7 @@ bool httpdSetAuth(const HTTPD_AUTH_LEVEL_t authLevel, const char *username, cons
 // -------------------------------------------------------------------------------------------------
 
 static bool ICACHE_FLASH_ATTR sHttpdHandleRequest(
-    struct espconn *pConn, char *data, const uint16_t size)
+    struct espconn *pConn, char *data, const uint16_t size, bool *pKeepAlive)
 {
     const struct _esp_tcp *pkTcp = pConn->proto.tcp;
 
@@ -555,10 +651,16 @@ static bool ICACHE_FLASH_ATTR sHttpdHandleRequest(
         REQ_DEBUG("sHttpdHandleRequest(%p) body=%s (%d)", pConn, body, os_strlen(body));
         REQ_DEBUG("sHttpdHandleRequest(%p) headers=%s (%d)", pConn, headers, os_strlen(headers));
 
-        // extract headers (authorization, host)
+        // extract headers (authorization, host, if-none-match, range, connection)
         if (headers != NULL)
         {
+            if (strcasestr_P(headers, PSTR("Connection: close")) != NULL)
+            {
+                *pKeepAlive = false;
+            }
             const char *host = strcasestr_P(headers, PSTR("Host: "));
+            char *ifNoneMatch = strcasestr_P(headers, PSTR("If-None-Match: "));
+            char *range = strcasestr_P(headers, PSTR("\r\nRange: ")); // (not "If-Range: ", and browsers send "Host: " first)
             auth = strcasestr_P(headers, PSTR("Authorization: Basic "));
             if (auth != NULL)
             {
@@ -590,6 +692,26 @@ static bool ICACHE_FLASH_ATTR sHttpdHandleRequest(
                     cbInfo.host = host;
                 }
             }
+
+            if (ifNoneMatch != NULL)
+            {
+                char *ifNoneMatchEnd = os_strstr(ifNoneMatch, "\r\n");
+                if (ifNoneMatchEnd != NULL)
+                {
+                    *ifNoneMatchEnd = '\0';
+                }
+                cbInfo.ifNoneMatch = ifNoneMatch + 15; // "If-None-Match: "
+            }
+
+            if (range != NULL)
+            {
+                char *rangeEnd = os_strstr(&range[2], "\r\n");
+                if (rangeEnd != NULL)
+                {
+                    *rangeEnd = '\0';
+                }
+                cbInfo.range = range + 9; // "\r\nRange: "
+            }
         }
 
         // redirect to correct hostname on ap network (with fake DNS, but not for the captive portal path thingy)
@@ -811,7 +933,9 @@ bool ICACHE_FLASH_ATTR httpdSendResponse(
         + 2                           // \r\n
         + bodySize;                   // response body data
 
-    uint8_t *pResp = memAlloc(allocSize);
+    // use the connection's send buffer if it's large enough
+    uint8_t *pBuf = allocSize <= USER_HTTPD_BUF_SIZE ? httpdGetConnBuf(pConn) : NULL;
+    uint8_t *pResp = pBuf != NULL ? pBuf : memAlloc(allocSize);
     if (pResp == NULL)
     {
         ERROR("httpdSendResponse(%p) "IPSTR":%u malloc %u fail",
@@ -820,8 +944,8 @@ bool ICACHE_FLASH_ATTR httpdSendResponse(
     }
 
     // add HTTP status and headers
-    sprintf_PP((char *)pResp, PSTR("HTTP/1.1 %s\r\nConnection: close\r\nContent-Length: %u\r\n%s\r\n"),
-        status, bodySize, headers);
+    sprintf_PP((char *)pResp, PSTR("HTTP/1.1 %s\r\n%sContent-Length: %u\r\n%s\r\n"),
+        status, sHttpdConnectionHeader(pConn), bodySize, headers);
     uint16_t respSize = os_strlen(pResp);
 
     // add response body data
@@ -842,7 +966,10 @@ bool ICACHE_FLASH_ATTR httpdSendResponse(
     }
 
     // clean up
-    memFree(pResp);
+    if (pResp != pBuf)
+    {
+        memFree(pResp);
+    }
 
     return res;
 }
@@ -863,6 +990,7 @@ bool ICACHE_FLASH_ATTR httpdSendError(struct espconn *pConn,
         case 401: pkStatus = PSTR("401 Unauthorized"); break;
         case 403: pkStatus = PSTR("403 Forbidden");    break;
         case 404: pkStatus = PSTR("404 Not Found");    break;
+        case 416: pkStatus = PSTR("416 Range Not Satisfiable"); break;
         case 503: pkStatus = PSTR("503 Service Unavailable"); break;
         default: break;
     }
@@ -883,7 +1011,7 @@ bool ICACHE_FLASH_ATTR httpdSendError(struct espconn *pConn,
         sprintf_PP(head, PSTR("HTTP/1.1 %s\r\n"
             "Content-Length: %d\r\n"
             "Content-Type: text/html; charset=UTF-8\r\n"
-            "%s\r\n"), pkStatus, bodyLen, xtraHeaders);
+            "%s%s\r\n"), pkStatus, bodyLen, sHttpdConnectionHeader(pConn), xtraHeaders);
 
         os_strcpy(resp, head);
         os_strcat(resp, body);
@@ -1164,28 +1292,32 @@ static bool ICACHE_FLASH_ATTR sHttpdAboutRequestCb(struct espconn *pConn, const
 // -------------------------------------------------------------------------------------------------
 
 #define HTTP_HEAD_SIZE 256
-#define HTTP_BODY_SIZE ((8 * 1024) - HTTP_HEAD_SIZE)
+#define HTTP_WINDOW_MIN 512
 
-// helper to send a full HTML page using the template with htmlRender() (user_html.c)
-bool ICACHE_FLASH_ATTR httpSendHtmlPage(struct espconn *pConn, const char *content, const bool noMenu)
+HTML_TMPL_DEF(skHttpdPageTmpl, USER_HTML_TEMPL_HTML);
+
+static bool sHttpdHtmlConnCb(struct espconn *pConn, HTTPD_CONN_DATA_t *pData, const HTTPD_CONNCB_t reason);
+
+// helper to send a full HTML page using the page template, with either the given content string or
+// the given template (and its variables) as the content
+static bool ICACHE_FLASH_ATTR sHttpdSendHtml(struct espconn *pConn, const char *content,
+    const HTML_TMPL_t *pkTmpl, const char *tmplKeys[], const char *tmplVals[], const int numKV, const bool noMenu)
 {
     const struct _esp_tcp *pkTcp = pConn->proto.tcp;
 
-    uint8_t *resp = memAlloc(HTTP_HEAD_SIZE + HTTP_BODY_SIZE);
-    if (resp == NULL)
-    {
-        ERROR("httpSendHtmlPage() alloc fail");
-        return false;
-    }
-
-    // generate html
+    // prepare rendering
     USER_CFG_t userConfig;
     cfgGet(&userConfig);
     const char *sysId = getSystemId();
     const char *keys[] = { PSTR("CONTENT"), PSTR("SYSNAME"), PSTR("SYSID"), PSTR("MENUSTYLE") };
     const char *vals[] = {  content,   userConfig.staName,         sysId,   noMenu ? PSTR("display: none;") : NULL };
-    const int htmlLen = htmlRender(
-        NULL, (char *)&resp[HTTP_HEAD_SIZE], HTTP_BODY_SIZE, keys, vals, (int)NUMOF(keys), true);
+    HTML_RENDER_t render;
+    htmlRenderInit(&render, &skHttpdPageTmpl, keys, vals, (int)NUMOF(keys));
+    if (pkTmpl != NULL)
+    {
+        htmlRenderNest(&render, PSTR("CONTENT"), pkTmpl, tmplKeys, tmplVals, numKV);
+    }
+    const int htmlLen = htmlRenderSize(&render);
 
     // generate HTTP status and headers
     char head[HTTP_HEAD_SIZE];
@@ -1195,21 +1327,61 @@ bool ICACHE_FLASH_ATTR httpSendHtmlPage(struct espconn *pConn, const char *conte
         "Cache-Control: no-cache, no-store, must-revalidate\r\n"
         "Pragma: no-cache\r\n"
         "Expires: -1\r\n"
-        "\r\n"), htmlLen);
+        "%s"
+        "\r\n"), htmlLen, sHttpdConnectionHeader(pConn));
     const int headLen = os_strlen(head);
 
-    // add header to response
-    const int headOffs = HTTP_HEAD_SIZE - headLen;
-    memcpy(&resp[headOffs], head, headLen);
+    // stream the page using the connection's send buffer for the rendering state, a copy of the
+    // values and the window to render into, send the headers and the first chunk now and the rest
+    // from the sent callback
+    uint8_t *pBuf = httpdGetConnBuf(pConn);
+    if (pBuf != NULL)
+    {
+        HTML_RENDER_t *pRender = (HTML_RENDER_t *)pBuf;
+        *pRender = render;
+        char *pVals = (char *)&pRender[1];
+        const int valsLen = htmlRenderCopyVals(pRender, pVals,
+            USER_HTTPD_BUF_SIZE - (int)sizeof(*pRender) - HTTP_WINDOW_MIN);
+        if (valsLen >= 0)
+        {
+            char *pWindow = &pVals[valsLen];
+            const int windowSize = (char *)&pBuf[USER_HTTPD_BUF_SIZE] - pWindow;
+            os_memcpy(pWindow, head, headLen);
+            const int chunkLen = htmlRenderNext(pRender, &pWindow[headLen], windowSize - headLen);
+
+            REQ_DEBUG("sHttpdSendHtml(%p) "IPSTR":%u 200 OK %d+%d (stream, vals %d, window %d)",
+                pConn, IP2STR(&pkTcp->remote_ip), pkTcp->remote_port,
+                headLen, htmlLen, valsLen, windowSize);
+
+            if (!httpdSendData(pConn, (uint8_t *)pWindow, headLen + chunkLen))
+            {
+                ERROR("sHttpdSendHtml(%p) "IPSTR":%u send %u fail",
+                    pConn, IP2STR(&pkTcp->remote_ip), pkTcp->remote_port, headLen + chunkLen);
+                return false;
+            }
 
-    // the response
-    uint8_t *pResp = &resp[headOffs];
+            HTTPD_CONN_DATA_t templ;
+            templ.p = pRender;
+            templ.i = (uint8_t *)pWindow - pBuf;
+            templ.u = 0;
+            httpdRegisterConnCb(pConn, &templ, sHttpdHtmlConnCb);
+            return true;
+        }
+    }
+
+    // the values don't fit into the buffer (or there is none), render the whole page at once
+    uint8_t *pResp = memAlloc(headLen + htmlLen);
+    if (pResp == NULL)
+    {
+        ERROR("sHttpdSendHtml() alloc fail");
+        return false;
+    }
+    os_memcpy(pResp, head, headLen);
+    htmlRenderNext(&render, (char *)&pResp[headLen], htmlLen);
     const uint16_t respSize = headLen + htmlLen;
 
     // debug
-    //DEBUG("httpSendHtmlPage() headLen=%d htmlLen=%d headOffs=%d respSize=%u",
-    //    headLen, htmlLen, headOffs, respSize);
-    REQ_DEBUG("httpSendHtmlPage(%p) "IPSTR":%u 200 OK %d+%d=%u",
+    REQ_DEBUG("sHttpdSendHtml(%p) "IPSTR":%u 200 OK %d+%d=%u",
         pConn, IP2STR(&pkTcp->remote_ip), pkTcp->remote_port,
         headLen, htmlLen, respSize);
 
@@ -1217,16 +1389,51 @@ bool ICACHE_FLASH_ATTR httpSendHtmlPage(struct espconn *pConn, const char *conte
     const bool res = httpdSendData(pConn, pResp, respSize);
     if (!res)
     {
-        ERROR("httpSendHtmlPage(%p) "IPSTR":%u send %u fail",
+        ERROR("sHttpdSendHtml(%p) "IPSTR":%u send %u fail",
             pConn, IP2STR(&pkTcp->remote_ip), pkTcp->remote_port, respSize);
     }
 
     // clean up
-    memFree(resp);
+    memFree(pResp);
 
     return res;
 }
 
+// render and send the next chunk of the page
+static bool ICACHE_FLASH_ATTR sHttpdHtmlConnCb(struct espconn *pConn, HTTPD_CONN_DATA_t *pData, const HTTPD_CONNCB_t reason)
+{
+    // nothing to clean up (the buffer belongs to the connection)
+    if (reason != HTTPD_CONNCB_SENT)
+    {
+        return true;
+    }
+
+    HTML_RENDER_t *pRender = (HTML_RENDER_t *)pData->p;
+    char *pWindow = (char *)pData->p + pData->i;
+    const int chunkLen = htmlRenderNext(pRender, pWindow, USER_HTTPD_BUF_SIZE - pData->i);
+    REQ_DEBUG("sHttpdHtmlConnCb(%p) chunkLen=%d", pConn, chunkLen);
+
+    // done
+    if (chunkLen == 0)
+    {
+        httpdUnregisterConnCb(pConn);
+        return true;
+    }
+
+    return httpdSendData(pConn, (uint8_t *)pWindow, chunkLen);
+}
+
+bool ICACHE_FLASH_ATTR httpSendHtmlPage(struct espconn *pConn, const char *content, const bool noMenu)
+{
+    return sHttpdSendHtml(pConn, content, NULL, NULL, NULL, 0, noMenu);
+}
+
+bool ICACHE_FLASH_ATTR httpSendHtmlTmpl(struct espconn *pConn, const HTML_TMPL_t *pkTmpl,
+    const char *keys[], const char *vals[], const int numKV, const bool noMenu)
+{
+    return sHttpdSendHtml(pConn, NULL, pkTmpl, keys, vals, numKV, noMenu);
+}
+
 // -------------------------------------------------------------------------------------------------
 #define HTTPD_TEST_CALLBACKS 0
 
@@ -1309,12 +1516,21 @@ void ICACHE_FLASH_ATTR httpdStatus(void)
             slots++;
         }
     }
+    int bufs = 0;
+    ix = (int)NUMOF(sHttpdBufsUsed);
+    while (ix--)
+    {
+        if (sHttpdBufsUsed[ix])
+        {
+            bufs++;
+        }
+    }
 
-    DEBUG("mon: httpd: slots=%d/%d active=%d connect=%u recon=%u discon=%u recv=%u (%u) send=%u (%u) req=%u get=%u post=%u",
-        slots, (int)NUMOF(sHttpdConnData),
+    DEBUG("mon: httpd: slots=%d/%d bufs=%d/%d (%u) active=%d connect=%u recon=%u discon=%u recv=%u (%u) send=%u (%u) req=%u get=%u post=%u keepalive=%u",
+        slots, (int)NUMOF(sHttpdConnData), bufs, (int)NUMOF(sHttpdBufsUsed), sHttpdNoBufCnt,
         sActiveConnCnt, sHttpdConnectCnt, sHttpdReconCnt, sHttpdDisconCnt,
         sHttpdRecvCnt, sHttpdRecvSize, sHttpdSendCnt, sHttpdSendSize,
-        sHttpdHandleCnt, sHttpdHandleGetCnt, sHttpdHandlePostCnt);
+        sHttpdHandleCnt, sHttpdHandleGetCnt, sHttpdHandlePostCnt, sHttpdKeepAliveCnt);
 }
 
 
@@ -8,12 +8,17 @@
     \defgroup USER_HTTPD HTTPD
     \ingroup USER
 
-    This implements a HTTP server.
+    This implements a HTTP server. Connections are kept open after a response (HTTP/1.1
+    keep-alive) unless the client asks for "Connection: close", and idle connections are closed
+    after #USER_HTTPD_IDLE_TIMEOUT seconds.
 
     Configuration:
     - #USER_HTTP_NUMPARAM
     - #USER_HTTPD_REQUESTCB_NUM
     - #USER_HTTPD_CONN_NUM
+    - #USER_HTTPD_BUF_NUM
+    - #USER_HTTPD_BUF_SIZE
+    - #USER_HTTPD_IDLE_TIMEOUT
     - #USER_HTTPD_USER_LEN_MAX
     - #USER_HTTPD_PASS_LEN_MAX
 
@@ -24,6 +29,7 @@
 
 #include "user_stuff.h"
 #include "user_config.h"
+#include "user_html.h"
 
 
 //! initialise HTTP server
@@ -52,6 +58,8 @@ typedef struct HTTPD_REQCB_INFO_s
     const char        *method;               //!< request method ("GET" or "POST")
     HTTPD_AUTH_LEVEL_t authRequired;         //!< required authentication level
     HTTPD_AUTH_LEVEL_t authProvided;         //!< provided authentication level (always >= \c authRequired)
+    const char        *ifNoneMatch;          //!< the "If-None-Match" request header (NULL if there is none)
+    const char        *range;                //!< the "Range" request header (NULL if there is none)
 
     // query parameters
     int                numKV;                //!< number of query parameters in request
@@ -102,10 +110,28 @@ typedef bool (HTTPD_CONNCB_FUNC_t)(struct espconn *pConn, HTTPD_CONN_DATA_t *pDa
     \param[in]     connCb   callback function
 
     See \ref USER_FS for an example application where this is used to send large files from flash in
-    chunks (i.e. send next chunk once sending the previous chunk has completed).
+    chunks (i.e. send next chunk once sending the previous chunk has completed). The callback must
+    call httpdUnregisterConnCb() once it has sent everything, so that the connection can be used
+    for the next request (keep-alive) or closed.
 */
 void httpdRegisterConnCb(struct espconn *pConn, const HTTPD_CONN_DATA_t *pkTempl, HTTPD_CONNCB_FUNC_t connCb);
 
+//! unregister http server connection callback (the response is complete)
+/*!
+    \param[in,out] pConn    network connection handle
+*/
+void httpdUnregisterConnCb(struct espconn *pConn);
+
+//! get the connection's send buffer
+/*!
+    \param[in,out] pConn    network connection handle
+    \returns a buffer of #USER_HTTPD_BUF_SIZE bytes, or NULL if all buffers are in use
+
+    The buffer is taken from a small pool of preallocated buffers and belongs to the connection
+    until the response is complete (or the connection is closed).
+*/
+uint8_t *httpdGetConnBuf(struct espconn *pConn);
+
 //! set authentication information for the given level (public or admin)
 /*!
     \param[in] authLevel  authentication level to set credentials for (#HTTPD_AUTH_USER or #HTTPD_AUTH_ADMIN)
@@ -137,6 +163,23 @@ bool ICACHE_FLASH_ATTR httpdSendResponse(
 */
 bool httpSendHtmlPage(struct espconn *pConn, const char *content, const bool noMenu);
 
+//! send HTML page using \ref USER_HTML template with a compiled template as the content
+/*
+    \param[in,out] pConn     network connection handle
+    \param[in]     pkTmpl    template for the content (see HTML_TMPL_DEF())
+    \param[in]     keys      variable names for the content template (can be ROM strings)
+    \param[in]     vals      variable values for the content template (can be ROM strings)
+    \param[in]     numKV     number of \c keys and \c vals
+    \param[in]     noMenu    set to true to remove menu from template
+    \returns true on success
+
+    The page is rendered and sent in chunks from the connection's send buffer (see httpdGetConnBuf()).
+    Values in RAM are copied, so they need not be valid after this returns. If they don't fit into the
+    send buffer the page is rendered all at once instead.
+*/
+bool httpSendHtmlTmpl(struct espconn *pConn, const HTML_TMPL_t *pkTmpl,
+    const char *keys[], const char *vals[], const int numKV, const bool noMenu);
+
 //! send generic HTTP error
 /*
     This sends a generic http error, such as "404 Not Found", as HTTP status and corresponding
@@ -155,6 +198,7 @@ bool httpSendHtmlPage(struct espconn *pConn, const char *content, const bool noM
     - 401 Unauthorized
     - 403 Forbidden
     - 404 Not Found
+    - 416 Range Not Satisfiable
     - 503 Service Unavailable
 */
 bool httpdSendError(struct espconn *pConn, const char *path, const int status, const char *xtraHeaders, const char *xtraMessage);
@@ -619,22 +619,11 @@ bool ICACHE_FLASH_ATTR wifiIsApNet(const uint8_t ip[4])
 
 /* ***** configuration ************************************************************************** */
 
-static const char sWifiStatusHtml[] PROGMEM = USER_WIFI_STATUS_HTML_STR;
-
-#define WIFI_CONFIG_STATUS_SIZE (sizeof(USER_WIFI_STATUS_HTML_STR) + 512)
+HTML_TMPL_DEF(skWifiStatusTmpl, USER_WIFI_STATUS_HTML);
 
 // wifi config web interface (/wifi)
 static bool ICACHE_FLASH_ATTR sWifiStatusRequestCb(struct espconn *pConn, const HTTPD_REQCB_INFO_t *pkInfo)
 {
-    char *pResp = memAlloc(WIFI_CONFIG_STATUS_SIZE);
-    if (pResp == NULL)
-    {
-        ERROR("sWifiStatusRequestCb(%p) malloc %u fail", pConn, WIFI_CONFIG_STATUS_SIZE);
-        return false;
-    }
-
-    strcpy_P(pResp, sWifiStatusHtml);
-
     USER_CFG_t userCfg;
     cfgGet(&userCfg);
 
@@ -718,14 +707,7 @@ static bool ICACHE_FLASH_ATTR sWifiStatusRequestCb(struct espconn *pConn, const
     const char *keys[] = { PSTR("STASTATUS"), PSTR("APSTATUS") };
     const char *vals[] = {       staStatus,         apStatus  };
 
-    /*const int htmlLen = */htmlRender(
-        pResp, pResp, WIFI_CONFIG_STATUS_SIZE, keys, vals, (int)NUMOF(keys), true);
-
-    const bool res = httpSendHtmlPage(pConn, pResp, false);
-
-    memFree(pResp);
-
-    return res;
+    return httpSendHtmlTmpl(pConn, &skWifiStatusTmpl, keys, vals, (int)NUMOF(keys), false);
 }
 
 
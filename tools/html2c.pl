@@ -84,11 +84,37 @@ foreach my $infile (@ARGV)
     $defname =~ s{\.}{_}g;
     $defname = uc($defname) . '_STR';
 
+    # compiled template (see user_html.h): "%KEY%" become slot markers ("\001" followed by the slot
+    # letter), "%%" becomes "%", and a list of the slot (key) names
+    my @slots = ();
+    my %slotIx = ();
+    my $compiled = $wrapped;
+    $compiled =~ s{%%|%([A-Za-z0-9]{1,18})%}{
+        if (!defined($1)) { '%' }
+        else
+        {
+            if (!defined($slotIx{$1}))
+            {
+                die("Too many keys in $infile!") if ($#slots >= 15); # HTML_SLOTS_MAX
+                $slotIx{$1} = $#slots + 1;
+                push(@slots, $1);
+            }
+            '\001' . chr(ord('A') + $slotIx{$1});
+        }
+    }ge;
+    my $tmplname = $defname;
+    $tmplname =~ s{_STR$}{};
+
     print("//----- $infile -----\n");
     print(map { $_ =~ s{\s+$}{}; $_ ? "// $_\n" : "//\n" } split(/\r?\n/, $html));
     printf("#define $defname /* %i -> %i bytes */ \\\n", length($html), length($packed));
     print($wrapped);
     print("\n\n");
+    printf("#define ${tmplname}_TMPL /* %i slots */ \\\n", $#slots + 1);
+    print($compiled);
+    print("\n");
+    print("#define ${tmplname}_SLOTS " . join(' ', map { "\"$_\\0\"" } @slots) . " \"\"\n");
+    print("\n\n");
 }
 
 
@@ -17,6 +17,8 @@ use FindBin;
 use lib "$FindBin::Bin";
 
 use Time::HiRes qw(time sleep usleep);
+use IO::Compress::Gzip qw(gzip $GzipError);
+use Digest::MD5 qw(md5);
 
 use Ffi::Debug ':all';
 
@@ -77,6 +79,7 @@ foreach my $file (@inFiles)
     DEBUG("mkfs: %-32s %6i %s", $name, $fsize, $file);
 
     my $type = 'application/octet-stream';
+    my $compress = 1;
     if ($name =~ m{\.js$})
     {
         $type = 'text/javascript';
@@ -92,20 +95,41 @@ foreach my $file (@inFiles)
     elsif ($name =~ m{\.jpe?g$})
     {
         $type = 'image/jpeg';
+        $compress = 0;
     }
     elsif ($name =~ m{\.png$})
     {
         $type = 'image/png';
+        $compress = 0;
     }
+    die("type too long: $type") unless (length($type) < 28);
 
-    push(@files, { name => $name, data => $data, size => $fsize, type => $type });
+    # store compressed (minimal gzip header, i.e. no name or timestamp, so that the image is reproducible)
+    my $flags = 0x00;
+    if ($compress)
+    {
+        my $gzData;
+        gzip(\$data => \$gzData, Minimal => 1, -Level => 9) or die("gzip $file: $GzipError");
+        if (length($gzData) < $dsize)
+        {
+            DEBUG("mkfs: %-32s %6i gzip", $name, length($gzData));
+            $data = $gzData;
+            $fsize = length($gzData);
+            $flags |= 0x01; # FS_FLAG_GZIP
+        }
+    }
+
+    # content hash for the ETag
+    my $etag = unpack('V', md5($data));
+
+    push(@files, { name => $name, data => $data, size => $fsize, type => $type, flags => $flags, etag => $etag });
 }
 
 
 # calculate fs layout
 my $offset = 0;
 my $totsize = 0;
-PRINT("mkfs: ix name                             offset       size type");
+PRINT("mkfs: ix name                             offset       size            etag     type");
 for (my $ix = 0; $ix <= $#files; $ix++)
 {
     my $f = $files[$ix];
@@ -115,9 +139,9 @@ for (my $ix = 0; $ix <= $#files; $ix++)
     $offset += $f->{padsize};
     $totsize += $f->{size};
 
-    PRINT("mkfs: %2i %-32s %6i (%3i) %6i (%6i, %3i) %s",
+    PRINT("mkfs: %2i %-32s %6i (%3i) %6i (%6i, %3i) %08x %s%s",
           $ix, $f->{name}, $f->{offset}, $f->{offset} / $sectSize, $f->{size},
-          $f->{padsize}, $f->{padsize} / $sectSize, $f->{type});
+          $f->{padsize}, $f->{padsize} / $sectSize, $f->{etag}, $f->{type}, $f->{flags} & 0x01 ? ' (gzip)' : '');
 }
 PRINT("mkfs: total %i files, %i bytes (%.1fkb) net, %i bytes (%.1fkb, %i sectors) with padding",
       $#files + 1, $totsize, $totsize / 1024, $offset, $offset / 1024, $offset / $sectSize);
@@ -132,7 +156,8 @@ for (my $ix = 0; $ix <= $#files; $ix++)
     $data .= $d;
 
     # like FS_TOC_ENTRY_t in user_fs.c
-    my $t = pack('Z32Z32VVNCCCC', $f->{name}, $f->{type}, $f->{size}, $f->{offset}, 0xb16b00b5, 0xff, 0xff, 0xff, 0xff);
+    my $t = pack('Z32Z28VCCCCVVN', $f->{name}, $f->{type}, $f->{etag}, $f->{flags}, 0xff, 0xff, 0xff,
+                 $f->{size}, $f->{offset}, 0xb16b00b5);
     $toc .= $t;
 }
 die("toc too big, too many files") if (length($toc) > $sectSize);